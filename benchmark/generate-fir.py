@@ -0,0 +1,158 @@
+#!/usr/bin/env python3
+
+# ===- generate-fir.py - Generate the firtool benchmarks -----*- python -*-===//
+#
+# Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+# See https://llvm.org/LICENSE.txt for license information.
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+#
+# ===-----------------------------------------------------------------------===//
+#
+# Generate the corpus of the firtool benchmarks: large .fir circuits, each
+# stressing one aspect of the compiler.
+#
+#   wide_bundles  modules with wide bundle-typed wires and registers
+#   deep_whens    modules with deeply nested when statements
+#   memories      modules with a memory each
+#   instances     a wide and deep instance hierarchy
+#
+# Every circuit chains units with the same ports, such that the size of the
+# corpus grows linearly with --scale.
+#
+# ===-----------------------------------------------------------------------===//
+
+import argparse
+import os
+import sys
+
+UnitPorts = """    input clock: Clock
+    input c: UInt<16>
+    input x: UInt<16>
+    output y: UInt<16>"""
+
+
+def connect_unit(lines, inst, module, x):
+    lines.append(f"    inst {inst} of {module}")
+    lines.append(f"    {inst}.clock <= clock")
+    lines.append(f"    {inst}.c <= c")
+    lines.append(f"    {inst}.x <= {x}")
+
+
+def chain_module(name, units):
+    """Return a module which chains instances of the given units."""
+    lines = [f"  module {name} :", UnitPorts]
+    x = "x"
+    for i, unit in enumerate(units):
+        connect_unit(lines, f"u{i}", unit, x)
+        x = f"u{i}.y"
+    lines.append(f"    y <= {x}")
+    return "\n".join(lines) + "\n"
+
+
+def wide_bundle_unit(name, width):
+    fields = ", ".join(f"f{i}: UInt<16>" for i in range(width))
+    lines = [f"  module {name} :", UnitPorts]
+    lines.append(f"    wire b : {{{fields}}}")
+    lines.append(f"    reg r : {{{fields}}}, clock")
+    for i in range(width):
+        lines.append(f"    b.f{i} <= xor(x, UInt<16>({i}))")
+    lines.append("    r <= b")
+    lines.append("    node s0 = r.f0")
+    for i in range(1, width):
+        lines.append(f"    node s{i} = xor(s{i - 1}, r.f{i})")
+    lines.append(f"    y <= s{width - 1}")
+    return "\n".join(lines) + "\n"
+
+
+def deep_when_unit(name, depth):
+    lines = [f"  module {name} :", UnitPorts]
+    lines.append("    y <= x")
+    for i in range(depth):
+        indent = "    " + "  " * i
+        lines.append(f"{indent}when bits(c, {i % 16}, {i % 16}) :")
+        lines.append(f"{indent}  y <= tail(add(x, UInt<16>({i + 1})), 1)")
+    # Close the nested blocks with an else at every other level.
+    for i in reversed(range(0, depth, 2)):
+        indent = "    " + "  " * i
+        lines.append(f"{indent}else :")
+        lines.append(f"{indent}  y <= xor(x, UInt<16>({i}))")
+    return "\n".join(lines) + "\n"
+
+
+def memory_unit(name, depth):
+    addrWidth = max(1, (depth - 1).bit_length())
+    return f"""  module {name} :
+{UnitPorts}
+    mem m :
+      data-type => UInt<16>
+      depth => {depth}
+      read-latency => 0
+      write-latency => 1
+      reader => r
+      writer => w
+      read-under-write => undefined
+    m.r.addr <= bits(x, {addrWidth - 1}, 0)
+    m.r.en <= UInt<1>(1)
+    m.r.clk <= clock
+    m.w.addr <= bits(c, {addrWidth - 1}, 0)
+    m.w.en <= bits(c, 15, 15)
+    m.w.clk <= clock
+    m.w.data <= x
+    m.w.mask <= UInt<1>(1)
+    y <= m.r.data
+"""
+
+
+def instance_tree(fanout, depth):
+    """Return the modules of an instance tree, from the leaf to the root."""
+    modules = [f"""  module Level0 :
+{UnitPorts}
+    reg r : UInt<16>, clock
+    r <= xor(x, c)
+    y <= r
+"""]
+    for level in range(1, depth + 1):
+        modules.append(chain_module(f"Level{level}",
+                                    [f"Level{level - 1}"] * fanout))
+    return modules
+
+
+def write_circuit(output_dir, name, modules, units):
+    with open(os.path.join(output_dir, name + ".fir"), "w") as f:
+        f.write(f"circuit {name} :\n")
+        for module in modules:
+            f.write(module)
+        f.write(chain_module(name, units))
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Generate the firtool benchmark circuits.")
+    parser.add_argument("-o", "--output-dir", required=True,
+                        help="Directory to write the circuits to.")
+    parser.add_argument("--scale", type=int, default=1,
+                        help="Multiply the number of units of each circuit.")
+    args = parser.parse_args()
+    os.makedirs(args.output_dir, exist_ok=True)
+    numUnits = 100 * args.scale
+
+    units = [f"Bundle{i}" for i in range(numUnits)]
+    write_circuit(args.output_dir, "wide_bundles",
+                  [wide_bundle_unit(u, 64) for u in units], units)
+
+    units = [f"When{i}" for i in range(numUnits)]
+    write_circuit(args.output_dir, "deep_whens",
+                  [deep_when_unit(u, 32) for u in units], units)
+
+    units = [f"Mem{i}" for i in range(numUnits)]
+    write_circuit(args.output_dir, "memories",
+                  [memory_unit(u, 1024) for u in units], units)
+
+    # The top module instantiates many trees of 584 instances.
+    write_circuit(args.output_dir, "instances", instance_tree(8, 3),
+                  ["Level3"] * (10 * numUnits))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
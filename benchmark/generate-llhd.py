@@ -0,0 +1,255 @@
+#!/usr/bin/env python3
+
+# ===- generate-llhd.py - Generate the llhd-sim benchmarks ---*- python -*-===//
+#
+# Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+# See https://llvm.org/LICENSE.txt for license information.
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+#
+# ===-----------------------------------------------------------------------===//
+#
+# Generate the workloads of the llhd-sim benchmarks, each stressing one aspect
+# of the simulator.
+#
+#   counters        many independent clocked counters
+#   shift_chain     a long chain of registers, one delta step per stage
+#   wide_mux        multiplexers selecting from a wide array every cycle
+#   array_memory    memories held in array signals, written and read through
+#                   dynamically indexed elements
+#   processes       a testbench of processes waiting on time and on signals
+#   hierarchy       a deep binary tree of entity instances
+#
+# All the workloads are driven by one clock with a 2ns period.
+#
+# ===-----------------------------------------------------------------------===//
+
+import argparse
+import os
+import sys
+
+Clock = """llhd.entity @clock () -> (%clk : !llhd.sig<i1>) {
+  %0 = llhd.prb %clk : !llhd.sig<i1>
+  %1 = llhd.not %0 : i1
+  %t = llhd.const #llhd.time<1ns, 0d, 0e> : !llhd.time
+  llhd.drv %clk, %1 after %t : !llhd.sig<i1>
+}
+"""
+
+
+def counter(width):
+    """A counter incremented on every rising clock edge."""
+    return f"""llhd.entity @counter_i{width} (%clk : !llhd.sig<i1>) -> (%q : !llhd.sig<i{width}>) {{
+  %c = llhd.prb %clk : !llhd.sig<i1>
+  %v = llhd.prb %q : !llhd.sig<i{width}>
+  %one = llhd.const 1 : i{width}
+  %n = addi %v, %one : i{width}
+  %t = llhd.const #llhd.time<0ns, 1d, 0e> : !llhd.time
+  llhd.reg %q, (%n, "rise" %c after %t : i{width}) : !llhd.sig<i{width}>
+}}
+"""
+
+
+Register = """llhd.entity @dff (%clk : !llhd.sig<i1>, %d : !llhd.sig<i32>) -> (%q : !llhd.sig<i32>) {
+  %c = llhd.prb %clk : !llhd.sig<i1>
+  %v = llhd.prb %d : !llhd.sig<i32>
+  %t = llhd.const #llhd.time<0ns, 1d, 0e> : !llhd.time
+  llhd.reg %q, (%v, "rise" %c after %t : i32) : !llhd.sig<i32>
+}
+"""
+
+
+def root(body):
+    lines = ["llhd.entity @root () -> () {",
+             "  %false = llhd.const 0 : i1",
+             "  %zero = llhd.const 0 : i32",
+             '  %clk = llhd.sig "clk" %false : i1',
+             "  llhd.inst \"clock\" @clock () -> (%clk) : () -> "
+             "(!llhd.sig<i1>)"]
+    lines += ["  " + line for line in body]
+    lines.append("}")
+    return "\n".join(lines) + "\n"
+
+
+def inst(name, unit, ins, outs):
+    insTypes = ", ".join(t for _, t in ins)
+    outsTypes = ", ".join(t for _, t in outs)
+    return (f'llhd.inst "{name}" @{unit} ({", ".join(v for v, _ in ins)}) -> '
+            f'({", ".join(v for v, _ in outs)}) : ({insTypes}) -> '
+            f'({outsTypes})')
+
+
+Clk = ("%clk", "!llhd.sig<i1>")
+Sig32 = "!llhd.sig<i32>"
+
+
+def counters(n):
+    body = []
+    for i in range(n):
+        body.append(f'%q{i} = llhd.sig "q{i}" %zero : i32')
+        body.append(inst(f"cnt{i}", "counter_i32", [Clk], [(f"%q{i}", Sig32)]))
+    return Clock + counter(32) + root(body)
+
+
+def shift_chain(n):
+    body = ['%q0 = llhd.sig "q0" %zero : i32',
+            inst("src", "counter_i32", [Clk], [("%q0", Sig32)])]
+    for i in range(1, n + 1):
+        body.append(f'%q{i} = llhd.sig "q{i}" %zero : i32')
+        body.append(inst(f"ff{i}", "dff", [Clk, (f"%q{i - 1}", Sig32)],
+                         [(f"%q{i}", Sig32)]))
+    return Clock + counter(32) + Register + root(body)
+
+
+def wide_mux(n, width):
+    selWidth = (width - 1).bit_length()
+    arrayType = f"!llhd.array<{width} x i32>"
+    elements = [f"%e{i} = llhd.const {i} : i32" for i in range(width)]
+    mux = f"""llhd.entity @mux (%data : !llhd.sig<{arrayType}>, %sel : !llhd.sig<i{selWidth}>) -> (%out : !llhd.sig<i32>) {{
+  %d = llhd.prb %data : !llhd.sig<{arrayType}>
+  %s = llhd.prb %sel : !llhd.sig<i{selWidth}>
+  %v = llhd.dyn_extract_element %d, %s : ({arrayType}, i{selWidth}) -> i32
+  %t = llhd.const #llhd.time<0ns, 1d, 0e> : !llhd.time
+  llhd.drv %out, %v after %t : !llhd.sig<i32>
+}}
+"""
+    body = elements + [
+        f"%init = llhd.array {', '.join(f'%e{i}' for i in range(width))} : "
+        f"{arrayType}",
+        f'%data = llhd.sig "data" %init : {arrayType}',
+        f"%sel0 = llhd.const 0 : i{selWidth}",
+        f'%sel = llhd.sig "sel" %sel0 : i{selWidth}',
+        inst("selcnt", f"counter_i{selWidth}", [Clk],
+             [("%sel", f"!llhd.sig<i{selWidth}>")]),
+    ]
+    for i in range(n):
+        body.append(f'%out{i} = llhd.sig "out{i}" %zero : i32')
+        body.append(inst(f"mux{i}", "mux",
+                         [("%data", f"!llhd.sig<{arrayType}>"),
+                          ("%sel", f"!llhd.sig<i{selWidth}>")],
+                         [(f"%out{i}", Sig32)]))
+    return Clock + counter(selWidth) + mux + root(body)
+
+
+def array_memory(n, depth):
+    addrWidth = (depth - 1).bit_length()
+    arrayType = f"!llhd.array<{depth} x i32>"
+    memory = f"""llhd.entity @memory (%clk : !llhd.sig<i1>, %addr : !llhd.sig<i{addrWidth}>, %wdata : !llhd.sig<i32>) -> (%rdata : !llhd.sig<i32>) {{
+  %zero = llhd.const 0 : i32
+  %init = llhd.array_uniform %zero : {arrayType}
+  %mem = llhd.sig "mem" %init : {arrayType}
+  %c = llhd.prb %clk : !llhd.sig<i1>
+  %a = llhd.prb %addr : !llhd.sig<i{addrWidth}>
+  %w = llhd.prb %wdata : !llhd.sig<i32>
+  %t = llhd.const #llhd.time<0ns, 1d, 0e> : !llhd.time
+  %elem = llhd.dyn_extract_element %mem, %a : (!llhd.sig<{arrayType}>, i{addrWidth}) -> !llhd.sig<i32>
+  llhd.reg %elem, (%w, "rise" %c after %t : i32) : !llhd.sig<i32>
+  %m = llhd.prb %mem : !llhd.sig<{arrayType}>
+  %one = llhd.const 1 : i{addrWidth}
+  %ra = addi %a, %one : i{addrWidth}
+  %r = llhd.dyn_extract_element %m, %ra : ({arrayType}, i{addrWidth}) -> i32
+  llhd.drv %rdata, %r after %t : !llhd.sig<i32>
+}}
+"""
+    body = [f"%addr0 = llhd.const 0 : i{addrWidth}",
+            f'%addr = llhd.sig "addr" %addr0 : i{addrWidth}',
+            inst("addrcnt", f"counter_i{addrWidth}", [Clk],
+                 [("%addr", f"!llhd.sig<i{addrWidth}>")]),
+            '%wdata = llhd.sig "wdata" %zero : i32',
+            inst("datacnt", "counter_i32", [Clk], [("%wdata", Sig32)])]
+    for i in range(n):
+        body.append(f'%rdata{i} = llhd.sig "rdata{i}" %zero : i32')
+        body.append(inst(f"mem{i}", "memory",
+                         [Clk, ("%addr", f"!llhd.sig<i{addrWidth}>"),
+                          ("%wdata", Sig32)],
+                         [(f"%rdata{i}", Sig32)]))
+    return Clock + counter(addrWidth) + counter(32) + memory + root(body)
+
+
+def processes(n):
+    # The stimulus processes count on their own time base, the monitors count
+    # the changes of the signal they watch.
+    procs = """llhd.proc @stimulus () -> (%a : !llhd.sig<i32>) {
+  br ^loop
+^loop:
+  %v = llhd.prb %a : !llhd.sig<i32>
+  %one = llhd.const 1 : i32
+  %n = addi %v, %one : i32
+  %eps = llhd.const #llhd.time<0ns, 0d, 1e> : !llhd.time
+  llhd.drv %a, %n after %eps : !llhd.sig<i32>
+  %t = llhd.const #llhd.time<1ns, 0d, 0e> : !llhd.time
+  llhd.wait for %t, ^loop
+}
+
+llhd.proc @monitor (%a : !llhd.sig<i32>) -> (%count : !llhd.sig<i32>) {
+  br ^wait
+^wait:
+  llhd.wait (%a : !llhd.sig<i32>), ^update
+^update:
+  %c = llhd.prb %count : !llhd.sig<i32>
+  %one = llhd.const 1 : i32
+  %n = addi %c, %one : i32
+  %t = llhd.const #llhd.time<0ns, 1d, 0e> : !llhd.time
+  llhd.drv %count, %n after %t : !llhd.sig<i32>
+  br ^wait
+}
+"""
+    body = []
+    for i in range(n):
+        body.append(f'%a{i} = llhd.sig "a{i}" %zero : i32')
+        body.append(f'%count{i} = llhd.sig "count{i}" %zero : i32')
+        body.append(inst(f"stim{i}", "stimulus", [], [(f"%a{i}", Sig32)]))
+        body.append(inst(f"mon{i}", "monitor", [(f"%a{i}", Sig32)],
+                         [(f"%count{i}", Sig32)]))
+    return Clock + procs + root(body)
+
+
+def hierarchy(depth):
+    units = [Clock, counter(32)]
+    for level in range(1, depth + 1):
+        child = f"node{level - 1}" if level > 1 else "counter_i32"
+        units.append(f"""llhd.entity @node{level} (%clk : !llhd.sig<i1>) -> (%q : !llhd.sig<i32>) {{
+  %zero = llhd.const 0 : i32
+  %a = llhd.sig "a" %zero : i32
+  %b = llhd.sig "b" %zero : i32
+  {inst("left", child, [Clk], [("%a", Sig32)])}
+  {inst("right", child, [Clk], [("%b", Sig32)])}
+  %x = llhd.prb %a : !llhd.sig<i32>
+  %y = llhd.prb %b : !llhd.sig<i32>
+  %z = llhd.xor %x, %y : i32
+  %t = llhd.const #llhd.time<0ns, 1d, 0e> : !llhd.time
+  llhd.drv %q, %z after %t : !llhd.sig<i32>
+}}
+""")
+    body = ['%q = llhd.sig "q" %zero : i32',
+            inst("top", f"node{depth}", [Clk], [("%q", Sig32)])]
+    return "".join(units) + root(body)
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Generate the llhd-sim benchmark workloads.")
+    parser.add_argument("-o", "--output-dir", required=True,
+                        help="Directory to write the workloads to.")
+    parser.add_argument("--scale", type=int, default=1,
+                        help="Multiply the size of each workload.")
+    args = parser.parse_args()
+    os.makedirs(args.output_dir, exist_ok=True)
+    scale = max(1, args.scale)
+
+    workloads = {
+        "counters": counters(1000 * scale),
+        "shift_chain": shift_chain(1000 * scale),
+        "wide_mux": wide_mux(100 * scale, 256),
+        "array_memory": array_memory(10 * scale, 1024),
+        "processes": processes(500 * scale),
+        # Every level doubles the number of instances.
+        "hierarchy": hierarchy(9 + scale.bit_length()),
+    }
+    for name, text in workloads.items():
+        with open(os.path.join(args.output_dir, name + ".mlir"), "w") as f:
+            f.write(text)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
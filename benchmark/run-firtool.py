@@ -0,0 +1,193 @@
+#!/usr/bin/env python3
+
+# ===- run-firtool.py - Run the firtool benchmarks -----------*- python -*-===//
+#
+# Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+# See https://llvm.org/LICENSE.txt for license information.
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+#
+# ===-----------------------------------------------------------------------===//
+#
+# Compile every .fir circuit of a corpus to Verilog with firtool, and report the
+# time spent in each phase, the peak memory use and the throughput of the
+# import, lowering and export as JSON. With --baseline, compare against an
+# earlier report and fail if any circuit got slower than --threshold allows.
+#
+# ===-----------------------------------------------------------------------===//
+
+import argparse
+import glob
+import json
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+DefaultFirtoolArgs = ["-lower-to-rtl", "-enable-lower-types", "-verilog"]
+
+
+def parse_json_objects(text):
+    """Return the JSON objects found in 'text', ignoring anything else."""
+    decoder = json.JSONDecoder()
+    objects = []
+    pos = text.find("{")
+    while pos >= 0:
+        try:
+            obj, pos = decoder.raw_decode(text, pos)
+            objects.append(obj)
+        except ValueError:
+            pos += 1
+        pos = text.find("{", pos)
+    return objects
+
+
+def run_once(firtool, input, args):
+    """Compile 'input' once and return its measurements."""
+    with tempfile.TemporaryDirectory() as tmp:
+        output = os.path.join(tmp, "out.sv")
+        cmd = [firtool, input, "-timing", "-timing-format=json", "-o", output]
+        start = time.perf_counter()
+        proc = subprocess.Popen(cmd + args, stdout=subprocess.DEVNULL,
+                                stderr=subprocess.PIPE)
+        stderr = proc.stderr.read().decode("utf-8", "replace")
+        proc.stderr.close()
+        # Wait for this child only, to get its own peak memory use.
+        _, status, rusage = os.wait4(proc.pid, 0)
+        wall = time.perf_counter() - start
+        proc.returncode = os.WEXITSTATUS(status) if os.WIFEXITED(status) else 1
+        if proc.returncode != 0:
+            sys.stderr.write(stderr)
+            raise RuntimeError(f"firtool failed on {input}")
+        with open(output, "rb") as f:
+            numLines = f.read().count(b"\n")
+
+    timing = next(
+        (obj for obj in parse_json_objects(stderr) if "phases" in obj), None)
+    if timing is None:
+        raise RuntimeError(f"no -timing report for {input}")
+    phases = {p["name"]: p["seconds"] for p in timing["phases"]}
+    counters = timing["counters"]
+    # Linux reports the peak resident set size in kilobytes, macOS in bytes.
+    peakRSS = rusage.ru_maxrss
+    if sys.platform != "darwin":
+        peakRSS *= 1024
+
+    importTime = phases.get("import", 0.0)
+    lowerTime = phases.get("lower", 0.0)
+    exportTime = phases.get("export", 0.0)
+    return {
+        "wall.seconds": wall,
+        "import.seconds": importTime,
+        "lower.seconds": lowerTime,
+        "export.seconds": exportTime,
+        "peak-rss.bytes": peakRSS,
+        "import.ops": counters.get("import.ops", 0),
+        "final.ops": counters.get("final.ops", 0),
+        "emitted.lines": numLines,
+        "phases": phases,
+    }
+
+
+def rate(amount, seconds):
+    return amount / seconds if seconds > 0 else 0.0
+
+
+def run_benchmark(firtool, input, args, repeat):
+    """Compile 'input' 'repeat' times and keep the fastest run of each phase,
+    which is the least disturbed by the rest of the machine."""
+    runs = [run_once(firtool, input, args) for _ in range(repeat)]
+    best = {}
+    for key in runs[0]:
+        if key == "phases":
+            best[key] = {
+                name: min(r["phases"].get(name, 0.0) for r in runs)
+                for name in runs[0]["phases"]
+            }
+        elif key.endswith(".seconds") or key.endswith(".bytes"):
+            best[key] = min(r[key] for r in runs)
+        else:
+            best[key] = runs[0][key]
+
+    size = os.path.getsize(input)
+    best["input.bytes"] = size
+    best["import.mb-per-second"] = rate(size / 1e6, best["import.seconds"])
+    best["lower.ops-per-second"] = rate(best["import.ops"],
+                                        best["lower.seconds"])
+    best["export.lines-per-second"] = rate(best["emitted.lines"],
+                                           best["export.seconds"])
+    return best
+
+
+def compare(results, baseline, threshold):
+    """Print the phases which got slower than 'threshold' compared with
+    'baseline', and return how many did."""
+    numRegressions = 0
+    for name, result in results.items():
+        old = baseline.get(name)
+        if old is None:
+            continue
+        for key in ["wall.seconds", "import.seconds", "lower.seconds",
+                    "export.seconds", "peak-rss.bytes"]:
+            if key not in old or old[key] <= 0:
+                continue
+            change = result[key] / old[key] - 1
+            if change > threshold:
+                print(f"{name}: {key} regressed by {change * 100:.1f}% "
+                      f"({old[key]:.4g} -> {result[key]:.4g})",
+                      file=sys.stderr)
+                numRegressions += 1
+    return numRegressions
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Run the firtool benchmarks and report them as JSON.")
+    parser.add_argument("--firtool", default="firtool",
+                        help="The firtool binary to benchmark.")
+    parser.add_argument("--corpus", required=True,
+                        help="Directory holding the .fir circuits.")
+    parser.add_argument("-o", "--output", default="-",
+                        help="File to write the JSON report to.")
+    parser.add_argument("--repeat", type=int, default=3,
+                        help="Number of runs per circuit.")
+    parser.add_argument("--baseline",
+                        help="JSON report to compare the results with.")
+    parser.add_argument("--threshold", type=float, default=0.1,
+                        help="Slowdown over the baseline which is reported "
+                        "as a regression, 0.1 for 10%%.")
+    parser.add_argument("firtool_args", nargs="*",
+                        help="Options passed to firtool, after '--'.")
+    args = parser.parse_args()
+
+    inputs = sorted(glob.glob(os.path.join(args.corpus, "*.fir")))
+    if not inputs:
+        print(f"no .fir circuit in {args.corpus}", file=sys.stderr)
+        return 1
+    firtoolArgs = args.firtool_args or DefaultFirtoolArgs
+
+    results = {}
+    for input in inputs:
+        name = os.path.splitext(os.path.basename(input))[0]
+        print(f"Running {name}...", file=sys.stderr)
+        results[name] = run_benchmark(args.firtool, input, firtoolArgs,
+                                      max(1, args.repeat))
+
+    report = {"firtool.args": firtoolArgs, "benchmarks": results}
+    text = json.dumps(report, indent=2, sort_keys=True) + "\n"
+    if args.output == "-":
+        sys.stdout.write(text)
+    else:
+        with open(args.output, "w") as f:
+            f.write(text)
+
+    if args.baseline:
+        with open(args.baseline) as f:
+            baseline = json.load(f)["benchmarks"]
+        if compare(results, baseline, args.threshold):
+            return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,144 @@
+#!/usr/bin/env python3
+
+# ===- run-llhd-sim.py - Run the llhd-sim benchmarks ---------*- python -*-===//
+#
+# Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+# See https://llvm.org/LICENSE.txt for license information.
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+#
+# ===-----------------------------------------------------------------------===//
+#
+# Simulate every .mlir workload of a corpus with llhd-sim in each trace format,
+# and report as JSON the time spent compiling the design, the delta cycles and
+# signal changes simulated per second, and the peak memory use.
+#
+# The compile time is measured by a run stopped after the first delta cycle,
+# and subtracted from the time of the full runs. The signal changes don't
+# depend on the trace format, they are counted once by a --profile run.
+#
+# ===-----------------------------------------------------------------------===//
+
+import argparse
+import glob
+import json
+import os
+import re
+import subprocess
+import sys
+import tempfile
+import time
+
+DefaultTraceFormats = ["no-trace", "merged-reduce", "merged", "full", "vcd"]
+
+
+def run_sim(llhdSim, input, args):
+    """Run llhd-sim once and return its wall time, peak memory use and
+    number of delta cycles."""
+    with tempfile.TemporaryDirectory() as tmp:
+        cmd = [llhdSim, input, "-o", os.path.join(tmp, "trace")] + args
+        start = time.perf_counter()
+        proc = subprocess.Popen(cmd, stdout=subprocess.DEVNULL,
+                                stderr=subprocess.PIPE)
+        stderr = proc.stderr.read().decode("utf-8", "replace")
+        proc.stderr.close()
+        # Wait for this child only, to get its own peak memory use.
+        _, status, rusage = os.wait4(proc.pid, 0)
+        wall = time.perf_counter() - start
+        proc.returncode = os.WEXITSTATUS(status) if os.WIFEXITED(status) else 1
+    if proc.returncode != 0:
+        sys.stderr.write(stderr)
+        raise RuntimeError(f"llhd-sim failed on {input}")
+
+    match = re.search(r"Finished at .* \((\d+) cycles\)", stderr)
+    # Linux reports the peak resident set size in kilobytes, macOS in bytes.
+    peakRSS = rusage.ru_maxrss
+    if sys.platform != "darwin":
+        peakRSS *= 1024
+    return wall, peakRSS, int(match.group(1)) if match else 0
+
+
+def count_signal_changes(llhdSim, input, args):
+    with tempfile.TemporaryDirectory() as tmp:
+        profile = os.path.join(tmp, "profile.json")
+        run_sim(llhdSim, input,
+                args + ["--trace-format=no-trace", f"--profile={profile}"])
+        with open(profile) as f:
+            return sum(s["changes"] for s in json.load(f)["signals"])
+
+
+def rate(amount, seconds):
+    return amount / seconds if seconds > 0 else 0.0
+
+
+def run_benchmark(llhdSim, input, args, traceFormats, repeat):
+    # Compile the design and run a single delta cycle.
+    jit = min(run_sim(llhdSim, input, ["-n", "1", "--trace-format=no-trace"] +
+                      args)[0] for _ in range(repeat))
+    changes = count_signal_changes(llhdSim, input, args)
+
+    result = {"jit.seconds": jit, "signal-changes": changes, "traces": {}}
+    for traceFormat in traceFormats:
+        runs = [run_sim(llhdSim, input,
+                        [f"--trace-format={traceFormat}"] + args)
+                for _ in range(repeat)]
+        # Keep the fastest run, the least disturbed by the rest of the machine.
+        wall, peakRSS, cycles = min(runs)
+        sim = max(0.0, wall - jit)
+        result["traces"][traceFormat] = {
+            "wall.seconds": wall,
+            "sim.seconds": sim,
+            "peak-rss.bytes": peakRSS,
+            "delta-cycles": cycles,
+            "delta-cycles-per-second": rate(cycles, sim),
+            "signal-changes-per-second": rate(changes, sim),
+        }
+    return result
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Run the llhd-sim benchmarks and report them as JSON.")
+    parser.add_argument("--llhd-sim", default="llhd-sim",
+                        help="The llhd-sim binary to benchmark.")
+    parser.add_argument("--corpus", required=True,
+                        help="Directory holding the .mlir workloads.")
+    parser.add_argument("-o", "--output", default="-",
+                        help="File to write the JSON report to.")
+    parser.add_argument("--repeat", type=int, default=3,
+                        help="Number of runs per workload and trace format.")
+    parser.add_argument("--sim-time", type=int, default=200000,
+                        help="Simulated time of each run, in picoseconds.")
+    parser.add_argument("--trace-formats",
+                        default=",".join(DefaultTraceFormats),
+                        help="Comma-separated trace formats to run with.")
+    parser.add_argument("llhd_sim_args", nargs="*",
+                        help="Options passed to llhd-sim, after '--', e.g. "
+                        "--threads=4 or --levelize.")
+    args = parser.parse_args()
+
+    inputs = sorted(glob.glob(os.path.join(args.corpus, "*.mlir")))
+    if not inputs:
+        print(f"no .mlir workload in {args.corpus}", file=sys.stderr)
+        return 1
+    simArgs = ["-T", str(args.sim_time)] + args.llhd_sim_args
+    traceFormats = [f for f in args.trace_formats.split(",") if f]
+
+    results = {}
+    for input in inputs:
+        name = os.path.splitext(os.path.basename(input))[0]
+        print(f"Running {name}...", file=sys.stderr)
+        results[name] = run_benchmark(args.llhd_sim, input, simArgs,
+                                      traceFormats, max(1, args.repeat))
+
+    report = {"llhd-sim.args": simArgs, "benchmarks": results}
+    text = json.dumps(report, indent=2, sort_keys=True) + "\n"
+    if args.output == "-":
+        sys.stdout.write(text)
+    else:
+        with open(args.output, "w") as f:
+            f.write(text)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
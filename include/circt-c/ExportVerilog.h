@@ -0,0 +1,34 @@
+//===-- circt-c/ExportVerilog.h - C API for Verilog emission ------*- C -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This header declares the C interface for emitting Verilog from RTL and SV
+// dialect code.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CIRCT_C_EXPORTVERILOG_H
+#define CIRCT_C_EXPORTVERILOG_H
+
+#include "mlir-c/IR.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Emits the Verilog for the RTL and SV code in `module`. The output is handed
+/// to `callback` in pieces, along with `userData`, such that the caller can
+/// collect it in a buffer of its own.
+MlirLogicalResult mlirExportVerilog(MlirModule module,
+                                    MlirStringCallback callback,
+                                    void *userData);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CIRCT_C_EXPORTVERILOG_H
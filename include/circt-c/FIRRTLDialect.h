@@ -0,0 +1,45 @@
+//===-- circt-c/FIRRTLDialect.h - C API for FIRRTL dialect --------*- C -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This header declares the C interface for registering and accessing the
+// FIRRTL dialect, and for importing .fir sources into it.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CIRCT_C_FIRRTLDIALECT_H
+#define CIRCT_C_FIRRTLDIALECT_H
+
+#include "mlir-c/IR.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Registers the FIRRTL dialect with the given context. This allows the
+/// dialect to be loaded dynamically if needed when parsing.
+void mlirContextRegisterFIRRTLDialect(MlirContext context);
+
+/// Loads the FIRRTL dialect into the given context. The dialect does _not_ have
+/// to be registered in advance.
+MlirDialect mlirContextLoadFIRRTLDialect(MlirContext context);
+
+/// Returns the namespace of the FIRRTL dialect, suitable for loading it.
+MlirStringRef mlirFIRRTLDialectGetNamespace();
+
+/// Parses the .fir source held in `buffer` into a new module, without going
+/// through a file. `bufferName` is used as the file name of the locations.
+/// Errors are reported to the diagnostic handlers of the context, and a null
+/// module is returned.
+MlirModule mlirFIRRTLImportFIRBuffer(MlirContext context, MlirStringRef buffer,
+                                     MlirStringRef bufferName);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CIRCT_C_FIRRTLDIALECT_H
@@ -0,0 +1,32 @@
+//===-- circt-c/Passes.h - C API for CIRCT passes -----------------*- C -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This header declares the C interface for registering the CIRCT passes, such
+// that lowering pipelines can be built with `mlirParsePassPipeline` and run
+// with the pass manager of the MLIR C API.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CIRCT_C_PASSES_H
+#define CIRCT_C_PASSES_H
+
+#include "mlir-c/Support.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Registers the FIRRTL, RTL and SV passes, the conversions between the CIRCT
+/// dialects, and the canonicalizer and CSE passes they are used with.
+void mlirRegisterCIRCTPasses();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CIRCT_C_PASSES_H
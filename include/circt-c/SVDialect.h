@@ -0,0 +1,38 @@
+//===-- circt-c/SVDialect.h - C API for SV dialect ----------------*- C -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This header declares the C interface for registering and accessing the
+// SV dialect.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CIRCT_C_SVDIALECT_H
+#define CIRCT_C_SVDIALECT_H
+
+#include "mlir-c/IR.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Registers the SV dialect with the given context. This allows the dialect to
+/// be loaded dynamically if needed when parsing.
+void mlirContextRegisterSVDialect(MlirContext context);
+
+/// Loads the SV dialect into the given context. The dialect does _not_ have to
+/// be registered in advance.
+MlirDialect mlirContextLoadSVDialect(MlirContext context);
+
+/// Returns the namespace of the SV dialect, suitable for loading it.
+MlirStringRef mlirSVDialectGetNamespace();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CIRCT_C_SVDIALECT_H
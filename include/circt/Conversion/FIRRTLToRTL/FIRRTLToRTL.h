@@ -14,6 +14,7 @@
 #ifndef CIRCT_CONVERSION_FIRRTLTORTL_FIRRTLTORTL_H
 #define CIRCT_CONVERSION_FIRRTLTORTL_FIRRTLTORTL_H
 
+#include "llvm/ADT/StringRef.h"
 #include <memory>
 
 namespace mlir {
@@ -24,6 +25,9 @@ namespace circt {
 namespace firrtl {
 
 std::unique_ptr<mlir::Pass> createLowerFIRRTLToRTLModulePass();
+std::unique_ptr<mlir::Pass>
+createLowerFIRRTLToRTLModulePass(uint64_t memMacroThreshold,
+                                 llvm::StringRef memMacroConf = "");
 std::unique_ptr<mlir::Pass> createLowerFIRRTLToRTLPass();
 
 } // namespace firrtl
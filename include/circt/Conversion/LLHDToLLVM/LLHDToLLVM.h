@@ -28,14 +28,22 @@ namespace circt {
 namespace llhd {
 using namespace mlir;
 
-/// Get the LLHD to LLVM conversion patterns.
+/// Get the LLHD to LLVM conversion patterns. If inlineDrives is set, the units
+/// take a pointer to a drive buffer as an additional argument, and drives of
+/// integers fitting in one word are appended to it instead of calling into the
+/// runtime library. If batchEntities is set, a `<name>_batch` function running
+/// an entity for an array of instances is created along every entity.
 void populateLLHDToLLVMConversionPatterns(LLVMTypeConverter &converter,
                                           OwningRewritePatternList &patterns,
                                           size_t &sigCounter,
-                                          size_t &regCounter);
+                                          size_t &regCounter,
+                                          bool inlineDrives = false,
+                                          bool batchEntities = false);
 
 /// Create an LLHD to LLVM conversion pass.
-std::unique_ptr<OperationPass<ModuleOp>> createConvertLLHDToLLVMPass();
+std::unique_ptr<OperationPass<ModuleOp>>
+createConvertLLHDToLLVMPass(bool inlineDrives = false,
+                            bool batchEntities = false);
 
 void initLLHDToLLVMPass();
 } // namespace llhd
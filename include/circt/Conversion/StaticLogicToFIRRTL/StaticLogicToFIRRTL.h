@@ -0,0 +1,23 @@
+//===- StaticLogicToFIRRTL.h ------------------------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares passes which lower scheduled StaticLogic pipelines to the
+// FIRRTL dialect.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CIRCT_CONVERSION_STATICLOGICTOFIRRTL_H_
+#define CIRCT_CONVERSION_STATICLOGICTOFIRRTL_H_
+
+namespace circt {
+namespace staticlogic {
+void registerStaticLogicToFIRRTLPasses();
+} // namespace staticlogic
+} // namespace circt
+
+#endif // CIRCT_CONVERSION_STATICLOGICTOFIRRTL_H_
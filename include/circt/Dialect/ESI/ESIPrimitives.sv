@@ -118,3 +118,247 @@ module ESI_PipelineStage # (
     end
   end
 endmodule
+
+/// ESI_FIFO: a DEPTH entry FIFO which ESI uses for deep channel buffers. The
+/// storage has one write port and an asynchronous read port so that synthesis
+/// maps it to LUTRAM (or SRAM where the device supports asynchronous reads).
+/// A token is visible on the output one cycle after it's accepted and the FIFO
+/// sustains one token per cycle in and out simultaneously. Like
+/// ESI_PipelineStage, a_ready only depends on registered state, so there is no
+/// combinational path from x_ready to a_ready.
+module ESI_FIFO # (
+  int WIDTH = 8,
+  int DEPTH = 16
+) (
+  input logic clk,
+  input logic rstn,
+
+  // Input LI channel.
+  input logic a_valid,
+  input logic [WIDTH-1:0] a,
+  output logic a_ready,
+
+  // Output LI channel.
+  output logic x_valid,
+  output logic [WIDTH-1:0] x,
+  input logic x_ready
+);
+
+  localparam int PTR_WIDTH = DEPTH > 1 ? $clog2(DEPTH) : 1;
+
+  logic [WIDTH-1:0] mem [DEPTH];
+  logic [PTR_WIDTH-1:0] rd_ptr, wr_ptr;
+  // One wider than the pointers so that a full FIFO is representable.
+  logic [PTR_WIDTH:0] count;
+
+  assign a_ready = count != DEPTH;
+  assign x_valid = count != 0;
+  assign x = mem[rd_ptr];
+
+  wire push = a_valid && a_ready;
+  wire pop = x_valid && x_ready;
+
+  function automatic logic [PTR_WIDTH-1:0] next_ptr(logic [PTR_WIDTH-1:0] p);
+    return p == PTR_WIDTH'(DEPTH - 1) ? '0 : p + 1'b1;
+  endfunction
+
+  always_ff @(posedge clk)
+    if (push)
+      mem[wr_ptr] <= a;
+
+  always_ff @(posedge clk) begin
+    if (~rstn) begin
+      rd_ptr <= '0;
+      wr_ptr <= '0;
+      count <= '0;
+    end else begin
+      if (push)
+        wr_ptr <= next_ptr(wr_ptr);
+      if (pop)
+        rd_ptr <= next_ptr(rd_ptr);
+      if (push && !pop)
+        count <= count + 1'b1;
+      else if (pop && !push)
+        count <= count - 1'b1;
+    end
+  end
+endmodule
+
+/// ESI_Pack: a gearbox which collects OUT_WIDTH / IN_WIDTH consecutive input
+/// tokens and sends them as one output token, the first in the least
+/// significant bits. Accepts a token every cycle, even while sending the
+/// previous wide token, so a full-rate producer fully utilizes the output.
+module ESI_Pack # (
+  int IN_WIDTH = 8,
+  int OUT_WIDTH = 32
+) (
+  input logic clk,
+  input logic rstn,
+
+  // Input LI channel.
+  input logic a_valid,
+  input logic [IN_WIDTH-1:0] a,
+  output logic a_ready,
+
+  // Output LI channel.
+  output logic x_valid,
+  output logic [OUT_WIDTH-1:0] x,
+  input logic x_ready
+);
+
+  localparam int RATIO = OUT_WIDTH / IN_WIDTH;
+  localparam int IDX_WIDTH = RATIO > 1 ? $clog2(RATIO) : 1;
+
+  logic [OUT_WIDTH-1:0] x_reg;
+  logic x_valid_reg;
+  logic [IDX_WIDTH-1:0] idx;
+  assign x = x_reg;
+  assign x_valid = x_valid_reg;
+
+  // The wide token is complete and waiting to be sent. Slot 0 can be refilled
+  // in the same cycle it gets sent.
+  wire xmit = x_valid_reg && x_ready;
+  assign a_ready = ~x_valid_reg || x_ready;
+  wire a_rcv = a_valid && a_ready;
+  wire last = idx == IDX_WIDTH'(RATIO - 1);
+
+  always_ff @(posedge clk) begin
+    if (~rstn) begin
+      idx <= '0;
+      x_valid_reg <= 1'b0;
+    end else begin
+      if (xmit)
+        x_valid_reg <= 1'b0;
+      if (a_rcv) begin
+        x_reg[idx * IN_WIDTH +: IN_WIDTH] <= a;
+        idx <= last ? '0 : idx + 1'b1;
+        if (last)
+          x_valid_reg <= 1'b1;
+      end
+    end
+  end
+endmodule
+
+/// ESI_Unpack: a gearbox which sends each input token as IN_WIDTH / OUT_WIDTH
+/// consecutive output tokens, least significant bits first. The next input
+/// token is accepted in the same cycle the last slice of the current one is
+/// sent, so the output runs at one token per cycle.
+module ESI_Unpack # (
+  int IN_WIDTH = 32,
+  int OUT_WIDTH = 8
+) (
+  input logic clk,
+  input logic rstn,
+
+  // Input LI channel.
+  input logic a_valid,
+  input logic [IN_WIDTH-1:0] a,
+  output logic a_ready,
+
+  // Output LI channel.
+  output logic x_valid,
+  output logic [OUT_WIDTH-1:0] x,
+  input logic x_ready
+);
+
+  localparam int RATIO = IN_WIDTH / OUT_WIDTH;
+  localparam int IDX_WIDTH = RATIO > 1 ? $clog2(RATIO) : 1;
+
+  logic [IN_WIDTH-1:0] a_reg;
+  logic valid_reg;
+  logic [IDX_WIDTH-1:0] idx;
+  assign x = a_reg[idx * OUT_WIDTH +: OUT_WIDTH];
+  assign x_valid = valid_reg;
+
+  wire xmit = valid_reg && x_ready;
+  wire last = idx == IDX_WIDTH'(RATIO - 1);
+  assign a_ready = ~valid_reg || (xmit && last);
+  wire a_rcv = a_valid && a_ready;
+
+  always_ff @(posedge clk) begin
+    if (~rstn) begin
+      idx <= '0;
+      valid_reg <= 1'b0;
+    end else begin
+      if (xmit) begin
+        idx <= last ? '0 : idx + 1'b1;
+        if (last)
+          valid_reg <= 1'b0;
+      end
+      if (a_rcv) begin
+        a_reg <= a;
+        valid_reg <= 1'b1;
+      end
+    end
+  end
+endmodule
+
+/// ESI_CreditLink: a drop-in replacement for ESI_PipelineStage which uses
+/// credit-based flow control across the link instead of a ready signal. The
+/// sending side keeps a count of the free entries in the receiving side's
+/// CREDITS entry buffer and the receiver returns a credit whenever a token
+/// leaves it. Both the forward data and the credit return are registered, so
+/// there's no combinational path across the link in either direction. The
+/// credit round trip is four cycles, so CREDITS >= 4 sustains one token per
+/// cycle; longer links just need more credits.
+module ESI_CreditLink # (
+  int WIDTH = 8,
+  int CREDITS = 4
+) (
+  input logic clk,
+  input logic rstn,
+
+  // Input LI channel.
+  input logic a_valid,
+  input logic [WIDTH-1:0] a,
+  output logic a_ready,
+
+  // Output LI channel.
+  output logic x_valid,
+  output logic [WIDTH-1:0] x,
+  input logic x_ready
+);
+
+  localparam int CNT_WIDTH = $clog2(CREDITS + 1);
+
+  // Sending side. Only send tokens we know the receiver has room for.
+  logic [CNT_WIDTH-1:0] credits;
+  logic credit_return;
+  assign a_ready = credits != 0;
+  wire send = a_valid && a_ready;
+
+  always_ff @(posedge clk) begin
+    if (~rstn)
+      credits <= CNT_WIDTH'(CREDITS);
+    else if (send && !credit_return)
+      credits <= credits - 1'b1;
+    else if (credit_return && !send)
+      credits <= credits + 1'b1;
+  end
+
+  // The link itself.
+  logic link_valid;
+  logic [WIDTH-1:0] link_data;
+  always_ff @(posedge clk) begin
+    link_valid <= rstn ? send : 1'b0;
+    link_data <= a;
+  end
+
+  // Receiving side. It can never overflow since the sender never has more
+  // tokens in flight than there are entries.
+  logic xmit;
+  ESI_FIFO #(.WIDTH(WIDTH), .DEPTH(CREDITS)) buffer (
+    .clk(clk),
+    .rstn(rstn),
+    .a_valid(link_valid),
+    .a(link_data),
+    .a_ready(),
+    .x_valid(x_valid),
+    .x(x),
+    .x_ready(x_ready)
+  );
+  assign xmit = x_valid && x_ready;
+
+  always_ff @(posedge clk)
+    credit_return <= rstn ? xmit : 1'b0;
+endmodule
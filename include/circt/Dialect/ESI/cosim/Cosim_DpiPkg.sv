@@ -74,4 +74,67 @@ import "DPI-C" sv2cCosimserverEpTryGet =
     inout  int unsigned data_size
     );
 
+// Attempt to recieve several messages from a client in one call.
+//   - Returns negative when call failed (e.g. EP not registered).
+//   - Packs as many whole messages as fit into data[], back to back, and puts
+//   the size of each in sizes[].
+//   - If no message, return 0 with num_msgs == 0.
+import "DPI-C" sv2cCosimserverEpTryGetMultiple =
+  function int cosim_ep_tryget_multiple(
+    // The ID of the endpoint from which data should be recieved.
+    input  int unsigned endpoint_id,
+    // The buffer in which to put the messages.
+    inout byte unsigned data[],
+    // The size of each message put in data[].
+    inout int unsigned sizes[],
+    // Input: the maximum number of messages to get. If -1, use the size of
+    // sizes[].
+    // Output: the number of messages put in data[].
+    inout  int unsigned num_msgs
+    );
+
+// --------------------- Endpoint Polling ------------------------------------
+
+// Find the endpoints with messages from a client waiting.
+//   - Returns negative when call failed (e.g. server not running).
+//   - Sets bit i%32 of mask[i/32] if endpoint i has messages waiting and clears
+//   it otherwise, for all the endpoint IDs covered by mask[].
+import "DPI-C" sv2cCosimserverPoll =
+  function int cosim_poll(
+    // The bitmask of endpoints with messages waiting.
+    inout int unsigned mask[]
+    );
+
+// Report the current simulation time to the server, which tags the recorded
+// messages with it and releases the replayed messages recorded up to it.
+import "DPI-C" sv2cCosimserverSetTime =
+  function void cosim_set_time(
+    // The current simulation time.
+    input longint tick
+    );
+
+// The endpoint IDs covered by the polled mask. Endpoints with larger IDs are
+// always assumed to have messages waiting.
+localparam int POLL_MAX_ENDPOINTS = 1024;
+int unsigned PollMask[POLL_MAX_ENDPOINTS/32];
+time PollTime;
+bit PollValid = 1'b0;
+
+// Return true if an endpoint may have messages from a client waiting. The
+// server is polled for all the endpoints at once, on the first call of each
+// time step, so that idle endpoints don't each cross into the server. The
+// simulation time is reported to the server at the same time.
+function automatic bit cosim_ep_has_messages(input int unsigned endpoint_id);
+  if (!PollValid || PollTime != $time) begin
+    cosim_set_time($time);
+    if (cosim_poll(PollMask) != 0)
+      return 1'b1;
+    PollTime = $time;
+    PollValid = 1'b1;
+  end
+  if (endpoint_id >= POLL_MAX_ENDPOINTS)
+    return 1'b1;
+  return PollMask[endpoint_id / 32][endpoint_id % 32];
+endfunction
+
 endpackage // Cosim_DpiPkg
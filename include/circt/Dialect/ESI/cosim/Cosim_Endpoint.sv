@@ -20,7 +20,10 @@ module Cosim_Endpoint
   parameter longint SEND_TYPE_ID = -1,
   parameter int SEND_TYPE_SIZE_BITS = -1,
   parameter longint RECV_TYPE_ID = -1,
-  parameter int RECV_TYPE_SIZE_BITS = -1
+  parameter int RECV_TYPE_SIZE_BITS = -1,
+  // The number of messages to drain from the cosim server per DPI call. If more
+  // than one, they are buffered here and handed out one per transfer.
+  parameter int MAX_MSGS_PER_POLL = 1
 )
 (
   input  logic clk,
@@ -65,12 +68,50 @@ module Cosim_Endpoint
       = SEND_TYPE_SIZE_BYTES_FLOOR * 8;
 
   byte unsigned DataOutBuffer[SEND_TYPE_SIZE_BYTES-1:0];
+
+  // Messages drained from the server but not yet handed out. Only used when
+  // MAX_MSGS_PER_POLL > 1.
+  byte unsigned DrainBuffer[MAX_MSGS_PER_POLL*SEND_TYPE_SIZE_BYTES-1:0];
+  int unsigned DrainSizes[MAX_MSGS_PER_POLL-1:0];
+  int unsigned DrainCount;
+  int unsigned DrainNext;
+  int unsigned DrainOffset;
+
   always @(posedge clk) begin
     if (rstn && Initialized) begin
       if (DataOutValid && DataOutReady) // A transfer occurred.
         DataOutValid <= 1'b0;
 
-      if (!DataOutValid || DataOutReady) begin
+      if (MAX_MSGS_PER_POLL > 1 && (!DataOutValid || DataOutReady)) begin
+        if (DrainNext == DrainCount && cosim_ep_has_messages(ENDPOINT_ID))
+        begin
+          int unsigned num_msgs;
+          int rc;
+
+          num_msgs = MAX_MSGS_PER_POLL;
+          rc = cosim_ep_tryget_multiple(ENDPOINT_ID, DrainBuffer, DrainSizes,
+                                        num_msgs);
+          if (rc != 0) begin
+            $error("cosim_ep_tryget_multiple(%d, *, *, %d) returned %d",
+                   ENDPOINT_ID, MAX_MSGS_PER_POLL, rc);
+            num_msgs = 0;
+          end
+          DrainCount = num_msgs;
+          DrainNext = 0;
+          DrainOffset = 0;
+        end
+        if (DrainNext < DrainCount) begin
+          if (DrainSizes[DrainNext] != SEND_TYPE_SIZE_BYTES)
+            $error("cosim_ep_tryget_multiple(%d) message %d has size %d!",
+                   ENDPOINT_ID, DrainNext, DrainSizes[DrainNext]);
+          for (int i = 0; i < SEND_TYPE_SIZE_BYTES; i++)
+            DataOutBuffer[i] = DrainBuffer[DrainOffset + i];
+          DrainOffset = DrainOffset + DrainSizes[DrainNext];
+          DrainNext = DrainNext + 1;
+          DataOutValid <= 1'b1;
+        end
+      end else if ((!DataOutValid || DataOutReady) &&
+                   cosim_ep_has_messages(ENDPOINT_ID)) begin
         int data_limit;
         int rc;
 
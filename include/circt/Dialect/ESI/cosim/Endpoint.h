@@ -13,18 +13,264 @@
 #ifndef CIRCT_DIALECT_ESI_COSIM_ENDPOINT_H
 #define CIRCT_DIALECT_ESI_COSIM_ENDPOINT_H
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
 #include <functional>
 #include <map>
 #include <memory>
 #include <mutex>
-#include <queue>
+#include <string>
+#include <vector>
 
 namespace circt {
 namespace esi {
 namespace cosim {
 
+/// A fixed-capacity, lock-free queue of messages between exactly one producer
+/// thread and one consumer thread. The ring lives in a caller-provided memory
+/// region, which may be shared with a client process, and contains all the
+/// message slots, so neither side allocates or blocks when queuing or polling
+/// messages. The region layout, in 64-bit little-endian words, is:
+///
+///   [0]              head: index of the next message to consume
+///   [8]              tail: index of the next slot to fill
+///   [16]             the number of slots, a power of two
+///   [17]             the size of a slot in words
+///   [24, 24+n)       the size in bytes of the message in each slot
+///   [24+n, ...)      the slots, each 8-byte aligned
+///
+/// Indexes grow monotonically and are taken modulo the number of slots.
+class MessageRing {
+public:
+  /// Return the number of slots of a ring asked for numSlots slots.
+  static size_t getNumSlots(size_t numSlots) {
+    size_t p = 1;
+    while (p < numSlots)
+      p <<= 1;
+    return p;
+  }
+
+  /// Return the size in bytes of the region holding a ring of numSlots slots,
+  /// each able to hold a message of up to maxSize bytes.
+  static size_t getRegionSize(size_t numSlots, size_t maxSize) {
+    numSlots = getNumSlots(numSlots);
+    size_t size = sizeof(Header) + numSlots * sizeof(uint64_t) +
+                  numSlots * getSlotWords(maxSize) * sizeof(uint64_t);
+    // Keep consecutive rings cache-line aligned.
+    return (size + 63) & ~size_t(63);
+  }
+
+  /// Construct a ring in the given region, which has to be 64-byte aligned and
+  /// at least getRegionSize bytes large. If `init` is false, attach to a ring
+  /// previously initialized in the region, e.g. by another process.
+  MessageRing(void *region, size_t numSlots, size_t maxSize, bool init = true)
+      : header(static_cast<Header *>(region)),
+        numSlots(getNumSlots(numSlots)), slotWords(getSlotWords(maxSize)),
+        sizes(reinterpret_cast<uint64_t *>(header + 1)),
+        slots(sizes + this->numSlots) {
+    if (init) {
+      header->head.store(0, std::memory_order_relaxed);
+      header->tail.store(0, std::memory_order_relaxed);
+      header->numSlots = this->numSlots;
+      header->slotWords = slotWords;
+    }
+  }
+  MessageRing(const MessageRing &) = delete;
+
+  /// Return the maximum size of a message, in bytes.
+  size_t getMaxSize() const { return slotWords * 8; }
+
+  /// Producer side: return the storage of the next free slot, or nullptr if
+  /// the ring is full. The message is only visible to the consumer once it is
+  /// committed with `commit`.
+  uint8_t *reserve() {
+    auto t = header->tail.load(std::memory_order_relaxed);
+    if (t - header->head.load(std::memory_order_acquire) == numSlots)
+      return nullptr;
+    return getSlot(t);
+  }
+
+  /// Producer side: publish the reserved slot holding a message of the given
+  /// size.
+  void commit(size_t size) {
+    auto t = header->tail.load(std::memory_order_relaxed);
+    sizes[t & (numSlots - 1)] = size;
+    header->tail.store(t + 1, std::memory_order_release);
+  }
+
+  /// Producer side: copy a message to the ring. Return false if the ring is
+  /// full or the message is larger than a slot.
+  bool push(const uint8_t *data, size_t size) {
+    if (size > getMaxSize())
+      return false;
+    auto *slot = reserve();
+    if (!slot)
+      return false;
+    std::memcpy(slot, data, size);
+    commit(size);
+    return true;
+  }
+
+  /// Consumer side: get the oldest message. Return false if the ring is empty.
+  /// The message stays valid until it is released with `pop`.
+  bool front(const uint8_t *&data, size_t &size) {
+    auto h = header->head.load(std::memory_order_relaxed);
+    if (h == header->tail.load(std::memory_order_acquire))
+      return false;
+    data = getSlot(h);
+    size = sizes[h & (numSlots - 1)];
+    return true;
+  }
+
+  /// Consumer side: return the number of queued messages. More messages may be
+  /// queued concurrently, but never fewer.
+  size_t size() const {
+    return header->tail.load(std::memory_order_acquire) -
+           header->head.load(std::memory_order_relaxed);
+  }
+
+  /// Return the number of messages committed and popped so far. The producer
+  /// and the consumer respectively get exact counts, the other side may see
+  /// older ones.
+  uint64_t getNumCommitted() const {
+    return header->tail.load(std::memory_order_relaxed);
+  }
+  uint64_t getNumPopped() const {
+    return header->head.load(std::memory_order_relaxed);
+  }
+  /// Consumer side: release the oldest message.
+  void pop() {
+    header->head.store(header->head.load(std::memory_order_relaxed) + 1,
+                       std::memory_order_release);
+  }
+
+private:
+  /// The control words at the start of the region. Head and tail are written
+  /// by different sides, so they live in separate cache lines.
+  struct Header {
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+    alignas(64) uint64_t numSlots;
+    uint64_t slotWords;
+  };
+  static_assert(std::atomic<uint64_t>::is_always_lock_free,
+                "rings shared across processes need lock-free atomics");
+
+  static size_t getSlotWords(size_t maxSize) {
+    return std::max<size_t>(1, (maxSize + 7) / 8);
+  }
+
+  uint8_t *getSlot(uint64_t index) const {
+    return reinterpret_cast<uint8_t *>(slots +
+                                       (index & (numSlots - 1)) * slotWords);
+  }
+
+  Header *header;
+  const size_t numSlots;
+  const size_t slotWords;
+  uint64_t *sizes;
+  uint64_t *slots;
+};
+
+/// The memory holding the message queues of an endpoint. If given a name, the
+/// region is a POSIX shared memory object which co-located clients can map to
+/// access the queues directly. Otherwise, or if creating the shared memory
+/// object fails, it is private memory. The region starts with a header
+/// locating the two queues:
+///
+///   [0]  magic number, 0x4d49534f43495345 ("ESICOSIM")
+///   [1]  layout version, currently 1
+///   [2]  byte offset of the queue to the simulation
+///   [3]  byte offset of the queue to the client
+class EndpointRegion {
+public:
+  static constexpr uint64_t magic = 0x4d49534f43495345ULL;
+  static constexpr uint64_t version = 1;
+  /// The size of the header, such that the queues are cache-line aligned.
+  static constexpr size_t headerSize = 64;
+
+  EndpointRegion(const std::string &shmName, size_t size);
+  ~EndpointRegion();
+  EndpointRegion(const EndpointRegion &) = delete;
+
+  uint8_t *data() const { return static_cast<uint8_t *>(addr); }
+  /// Return the name of the shared memory object, or an empty string if the
+  /// region is private.
+  const std::string &getShmName() const { return shmName; }
+
+private:
+  void *addr;
+  size_t size;
+  std::string shmName;
+};
+
+/// Wakes up the threads waiting for messages, e.g. the RPC server threads when
+/// the simulation queues messages for the clients, such that blocked receive
+/// calls complete without waiting for the next poll. Notifying never blocks
+/// the notifying thread. Every notification bumps a generation counter; a
+/// waiter returns once the generation differs from the last one it saw, so
+/// the notifications sent while it was busy are not lost. A notification
+/// racing with the start of the wait itself may be missed, which only delays
+/// the wakeup until the wait times out.
+class MessageNotifier {
+public:
+  void notify() {
+    generation.fetch_add(1, std::memory_order_release);
+    cv.notify_all();
+  }
+
+  /// Return the current generation, to start waiting from.
+  uint64_t getGeneration() const {
+    return generation.load(std::memory_order_acquire);
+  }
+
+  /// Wait for a notification later than the `seen` generation, at most for the
+  /// given duration, and update `seen` to the current generation.
+  void wait(uint64_t &seen, std::chrono::microseconds timeout) {
+    std::unique_lock<std::mutex> lock(m);
+    cv.wait_for(lock, timeout, [&] { return getGeneration() != seen; });
+    seen = getGeneration();
+  }
+
+private:
+  std::mutex m;
+  std::condition_variable cv;
+  std::atomic<uint64_t> generation{0};
+};
+
+/// A snapshot of the traffic counters of an endpoint.
+struct EndpointStats {
+  /// The traffic of the queue in one direction.
+  struct Queue {
+    /// The number and total size of the messages queued so far.
+    uint64_t messages = 0;
+    uint64_t bytes = 0;
+    /// The number of messages queued now, and the most ever queued at once.
+    uint64_t depth = 0;
+    uint64_t maxDepth = 0;
+    /// The total and maximum time the popped messages spent in the queue, in
+    /// nanoseconds.
+    uint64_t queuedNs = 0;
+    uint64_t maxQueuedNs = 0;
+  };
+  Queue toSim;
+  Queue toClient;
+  /// The number of times the simulation polled the endpoint for messages, and
+  /// the number of those polls which found some.
+  uint64_t polls = 0;
+  uint64_t pollsWithData = 0;
+};
+
 /// Implements a bi-directional, thread-safe bridge between the RPC server and
-/// DPI functions.
+/// DPI functions. Messages to the simulation are only queued by the RPC server
+/// thread servicing the client which opened the endpoint and polled by the
+/// simulator thread, and the other way around for messages to the client, so
+/// each direction is a single-producer, single-consumer ring. An endpoint is
+/// only open by one client at a time, and the inUse lock orders the accesses
+/// of successive clients serviced by different threads.
 ///
 /// Several of the methods below are inline with the declaration to make them
 /// candidates for inlining during compilation. This is particularly important
@@ -32,15 +278,17 @@ namespace cosim {
 /// want to slow down the simulation any more than necessary.
 class Endpoint {
 public:
-  /// Representing messages as shared pointers to vectors may be a performance
-  /// issue in the future but it is the easiest way to ensure memory
-  /// correctness.
-  using Blob = std::vector<uint8_t>;
-  using BlobPtr = std::shared_ptr<Blob>;
+  /// The number of messages which can be queued in each direction.
+  static constexpr size_t queueDepth = 64;
 
   /// Construct an endpoint which knows and the type IDs in both directions.
+  /// The notifiers, if any, are signaled for every message to the client and
+  /// to the simulation respectively. If a shared memory name is given, the
+  /// message queues are put in a shared memory object of that name.
   Endpoint(uint64_t sendTypeId, int sendTypeMaxSize, uint64_t recvTypeId,
-           int recvTypeMaxSize);
+           int recvTypeMaxSize, MessageNotifier *notifier = nullptr,
+           MessageNotifier *simNotifier = nullptr,
+           const std::string &shmName = "");
   ~Endpoint();
   /// Disallow copying. There is only ONE endpoint object per logical endpoint
   /// so copying is almost always a bug.
@@ -48,67 +296,164 @@ public:
 
   uint64_t getSendTypeId() const { return sendTypeId; }
   uint64_t getRecvTypeId() const { return recvTypeId; }
+  /// Return the name of the shared memory object holding the message queues,
+  /// or an empty string if they are not shared.
+  const std::string &getShmName() const { return region.getShmName(); }
 
   /// These two are used to set and unset the inUse flag, to ensure that an open
   /// endpoint is not opened again.
   bool setInUse();
   void returnForUse();
 
-  /// Queue message to the simulation.
-  void pushMessageToSim(BlobPtr msg) {
-    Lock g(m);
-    toCosim.push(msg);
+  /// Return the buffer of the next message to the simulation, or nullptr if
+  /// the queue is full. The message is queued by `commitMessageToSim`.
+  uint8_t *reserveMessageToSim() { return toCosim.reserve(); }
+  void commitMessageToSim(size_t size) {
+    toSimCounters.commit(toCosim, size);
+    toCosim.commit(size);
+    if (simNotifier)
+      simNotifier->notify();
   }
+  size_t getMaxMessageToSimSize() const { return toCosim.getMaxSize(); }
 
-  /// Pop from the to-simulator queue. Return true if there was a message in the
-  /// queue.
-  bool getMessageToSim(BlobPtr &msg) {
-    Lock g(m);
-    if (toCosim.empty())
-      return false;
-    msg = toCosim.front();
+  /// Get the oldest message of the to-simulator queue. Return true if there
+  /// was a message in the queue. The message stays valid until it is popped
+  /// with `popMessageToSim`.
+  bool getMessageToSim(const uint8_t *&data, size_t &size) {
+    return toCosim.front(data, size);
+  }
+  /// Same as `getMessageToSim`, counted as a poll of the simulation in the
+  /// statistics.
+  bool pollMessageToSim(const uint8_t *&data, size_t &size) {
+    bool found = toCosim.front(data, size);
+    polls.fetch_add(1, std::memory_order_relaxed);
+    if (found)
+      pollsWithData.fetch_add(1, std::memory_order_relaxed);
+    return found;
+  }
+  void popMessageToSim() {
+    toSimCounters.pop(toCosim);
     toCosim.pop();
-    return true;
   }
+  /// Return true if messages are queued to the simulation.
+  bool hasMessagesToSim() const { return toCosim.size() != 0; }
 
-  /// Queue message to the RPC client.
-  void pushMessageToClient(BlobPtr msg) {
-    Lock g(m);
-    toClient.push(msg);
+  /// Return the buffer of the next message to the RPC client, or nullptr if
+  /// the queue is full. The message is queued by `commitMessageToClient`.
+  uint8_t *reserveMessageToClient() { return toClient.reserve(); }
+  void commitMessageToClient(size_t size) {
+    toClientCounters.commit(toClient, size);
+    toClient.commit(size);
+    if (notifier)
+      notifier->notify();
   }
+  size_t getMaxMessageToClientSize() const { return toClient.getMaxSize(); }
 
-  /// Pop from the to-RPC-client queue. Return true if there was a message in
-  /// the queue.
-  bool getMessageToClient(BlobPtr &msg) {
-    Lock g(m);
-    if (toClient.empty())
-      return false;
-    msg = toClient.front();
+  /// Get the oldest message of the to-RPC-client queue. Return true if there
+  /// was a message in the queue. The message stays valid until it is popped
+  /// with `popMessageToClient`.
+  bool getMessageToClient(const uint8_t *&data, size_t &size) {
+    return toClient.front(data, size);
+  }
+  void popMessageToClient() {
+    toClientCounters.pop(toClient);
     toClient.pop();
-    return true;
   }
+  /// Return the number of messages queued to the RPC client.
+  size_t getNumMessagesToClient() const { return toClient.size(); }
+
+  /// Return a snapshot of the traffic counters. It may be taken while both
+  /// sides run, so the counters are not necessarily consistent with each
+  /// other. The messages queued by a client through shared memory are not
+  /// counted.
+  EndpointStats getStats() const;
 
 private:
+  /// The traffic counters of one queue. They are only written by the side of
+  /// the queue they describe, and read by any thread taking a snapshot, so
+  /// relaxed atomics suffice. The time each message was queued at is kept per
+  /// slot, in nanoseconds of the steady clock, zero if it wasn't queued by the
+  /// endpoint.
+  class QueueCounters {
+  public:
+    explicit QueueCounters(size_t numSlots) : queuedAt(numSlots) {}
+
+    /// Producer side: count a message about to be committed.
+    void commit(const MessageRing &ring, size_t size) {
+      auto t = ring.getNumCommitted();
+      queuedAt[t & (queuedAt.size() - 1)].store(now(),
+                                                std::memory_order_relaxed);
+      messages.fetch_add(1, std::memory_order_relaxed);
+      bytes.fetch_add(size, std::memory_order_relaxed);
+      uint64_t depth = t + 1 - ring.getNumPopped();
+      if (depth > maxDepth.load(std::memory_order_relaxed))
+        maxDepth.store(depth, std::memory_order_relaxed);
+    }
+
+    /// Consumer side: count the oldest message, about to be popped.
+    void pop(const MessageRing &ring) {
+      auto &slot = queuedAt[ring.getNumPopped() & (queuedAt.size() - 1)];
+      uint64_t start = slot.exchange(0, std::memory_order_relaxed);
+      if (!start)
+        return;
+      uint64_t queued = now() - start;
+      queuedNs.fetch_add(queued, std::memory_order_relaxed);
+      if (queued > maxQueuedNs.load(std::memory_order_relaxed))
+        maxQueuedNs.store(queued, std::memory_order_relaxed);
+    }
+
+    /// Fill in the statistics of the given ring.
+    void get(const MessageRing &ring, EndpointStats::Queue &stats) const;
+
+  private:
+    static uint64_t now() {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                 std::chrono::steady_clock::now().time_since_epoch())
+          .count();
+    }
+
+    std::vector<std::atomic<uint64_t>> queuedAt;
+    std::atomic<uint64_t> messages{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> maxDepth{0};
+    std::atomic<uint64_t> queuedNs{0};
+    std::atomic<uint64_t> maxQueuedNs{0};
+  };
+
   const uint64_t sendTypeId;
   const uint64_t recvTypeId;
   bool inUse;
 
   using Lock = std::lock_guard<std::mutex>;
 
-  /// This class needs to be thread-safe. All of the mutable member variables
-  /// are protected with this object-wide lock. This may be a performance issue
-  /// in the future.
+  /// Protects the inUse flag. The message queues are lock-free.
   std::mutex m;
+  /// The memory holding both message queues.
+  EndpointRegion region;
   /// Message queue from RPC client to the simulation.
-  std::queue<BlobPtr> toCosim;
+  MessageRing toCosim;
   /// Message queue to RPC client from the simulation.
-  std::queue<BlobPtr> toClient;
+  MessageRing toClient;
+  MessageNotifier *notifier;
+  MessageNotifier *simNotifier;
+  /// The traffic counters of both queues, and the polls of the simulation.
+  QueueCounters toSimCounters;
+  QueueCounters toClientCounters;
+  std::atomic<uint64_t> polls{0};
+  std::atomic<uint64_t> pollsWithData{0};
 };
 
 /// The Endpoint registry is where Endpoints report their existence (register)
 /// and they are looked up by RPC clients.
 class EndpointRegistry {
 public:
+  /// Put the message queues of the endpoints registered from now on in shared
+  /// memory objects, named after the given prefix and the endpoint ID.
+  void setShmPrefix(const std::string &prefix) {
+    Lock g(m);
+    shmPrefix = prefix;
+  }
+
   /// Register an Endpoint. Creates the Endpoint object and owns it. Returns
   /// false if unsuccessful.
   bool registerEndpoint(int epId, uint64_t sendTypeId, int sendTypeMaxSize,
@@ -117,15 +462,30 @@ public:
   /// Get the specified endpoint. Return nullptr if it does not exist. This
   /// method is defined inline so it can be inlined at compile time. Performance
   /// is important here since this method is used in the polling call from the
-  /// simulator. Returns nullptr if the endpoint cannot be found.
+  /// simulator. Endpoint IDs covered by the lookup table are resolved without
+  /// taking the lock. Returns nullptr if the endpoint cannot be found.
   Endpoint *operator[](int epId) {
-    Lock g(m);
-    auto it = endpoints.find(epId);
-    if (it == endpoints.end())
-      return nullptr;
-    return &it->second;
+    const LookupTable *table = lookupTable.load(std::memory_order_acquire);
+    if (table && epId >= 0 && (size_t)epId < table->size())
+      return (*table)[epId];
+    return find(epId);
   }
 
+  /// Signaled whenever a registered endpoint queues a message to the client.
+  MessageNotifier notifier;
+  /// Signaled whenever the RPC server queues a message to the simulation.
+  /// Clients sharing the queues in memory don't signal it.
+  MessageNotifier simNotifier;
+
+  /// Return true if any endpoint has messages queued to the simulation. This
+  /// is only called by the simulation thread.
+  bool hasMessagesToSim();
+
+  /// Set bit i%32 of mask[i/32] if endpoint i has messages queued to the
+  /// simulation and clear it otherwise, for all the IDs covered by the mask.
+  /// This is only called by the simulation thread, and doesn't take the lock.
+  void pollMessagesToSim(uint32_t *mask, size_t numWords);
+
   /// Iterate over the list of endpoints, calling the provided function for each
   /// endpoint.
   void iterateEndpoints(std::function<void(int id, const Endpoint &)> f) const;
@@ -134,12 +494,30 @@ public:
 
 private:
   using Lock = std::lock_guard<std::mutex>;
+  /// A dense table of endpoints, indexed by endpoint ID.
+  using LookupTable = std::vector<Endpoint *>;
+
+  /// Endpoint IDs at or above this limit are not put in the lookup table, to
+  /// bound its size.
+  static constexpr int maxTableId = 1 << 16;
+
+  /// Look up an endpoint in the map, taking the lock.
+  Endpoint *find(int epId);
 
-  /// This object needs to be thread-safe. An object-wide mutex is sufficient.
+  /// This object needs to be thread-safe. Registration and the lookups of the
+  /// IDs not covered by the lookup table take an object-wide mutex.
   std::mutex m;
 
   /// Endpoint ID to object pointer mapping.
   std::map<int, Endpoint> endpoints;
+
+  /// The shared memory name prefix of the endpoint queues, if shared.
+  std::string shmPrefix;
+
+  /// Every registration publishes a new lookup table. Readers may still use
+  /// an older one, so they are all kept alive with the registry.
+  std::vector<std::unique_ptr<LookupTable>> tables;
+  std::atomic<const LookupTable *> lookupTable{nullptr};
 };
 
 } // namespace cosim
@@ -0,0 +1,109 @@
+//===- MessageLog.h - Cosim message recording and replay --------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Record the messages the simulation exchanges with the cosim clients, and
+// replay them later without any RPC server or client.
+//
+// The log is a binary file starting with an 8-byte magic number, "ESICOREC",
+// and a 32-bit version. Every message follows as a record holding, in host
+// byte order:
+//
+//   uint64_t tick         the simulation time of the exchange
+//   uint32_t endpointId
+//   uint8_t  direction    0 to the simulation, 1 to the client
+//   uint32_t size         the size of the message data in bytes
+//   uint8_t  data[size]
+//
+// Messages to the simulation are recorded when the simulation takes them from
+// their endpoint, which only depends on the RTL, so that replaying them at the
+// same tick reproduces the run exactly.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CIRCT_DIALECT_ESI_COSIM_MESSAGELOG_H
+#define CIRCT_DIALECT_ESI_COSIM_MESSAGELOG_H
+
+#include "circt/Dialect/ESI/cosim/Endpoint.h"
+
+#include <cstdio>
+#include <deque>
+#include <map>
+
+namespace circt {
+namespace esi {
+namespace cosim {
+
+/// The direction of a logged message.
+enum class MessageDirection : uint8_t { ToSim = 0, ToClient = 1 };
+
+/// Writes the messages exchanged by the simulation to a log. Only used by the
+/// simulation thread.
+class MessageRecorder {
+public:
+  static constexpr uint64_t magic = 0x4345524f43495345ULL; // "ESICOREC"
+  static constexpr uint32_t version = 1;
+
+  ~MessageRecorder();
+
+  /// Create the log file. Return false on failure.
+  bool open(const std::string &path);
+
+  /// Append a message exchanged at the given tick.
+  void record(uint64_t tick, unsigned endpointId, MessageDirection dir,
+              const uint8_t *data, size_t size);
+
+private:
+  FILE *file = nullptr;
+};
+
+/// Feeds the messages to the simulation of a log to the endpoints at their
+/// recorded ticks, and checks the messages the simulation sends to the clients
+/// against the recorded ones. Only used by the simulation thread.
+class MessageReplayer {
+public:
+  /// Read the whole log. Return false on failure.
+  bool open(const std::string &path);
+
+  /// Queue the messages to the simulation recorded at or before the given tick
+  /// to their endpoints. The messages which don't fit in their endpoint queue
+  /// are queued by a later call, in order.
+  void advance(uint64_t tick, EndpointRegistry &endpoints);
+
+  /// Compare a message the simulation sends to a client with the next one
+  /// recorded for the endpoint. Return false if they differ.
+  bool checkMessageToClient(uint64_t tick, unsigned endpointId,
+                            const uint8_t *data, size_t size);
+
+  /// Return true if messages to the simulation remain to be queued.
+  bool hasPendingMessagesToSim() const { return numPendingToSim != 0; }
+
+  /// Print a summary of the replay: the messages which were not replayed and
+  /// the mismatching messages to the clients. Return the number of problems.
+  size_t report() const;
+
+private:
+  struct Message {
+    uint64_t tick;
+    std::vector<uint8_t> data;
+  };
+  struct EndpointLog {
+    std::deque<Message> toSim;
+    std::deque<Message> toClient;
+  };
+
+  std::map<unsigned, EndpointLog> logs;
+  size_t numPendingToSim = 0;
+  size_t numMismatches = 0;
+  size_t numUnexpected = 0;
+};
+
+} // namespace cosim
+} // namespace esi
+} // namespace circt
+
+#endif
@@ -18,18 +18,22 @@
 
 #include "circt/Dialect/ESI/cosim/Endpoint.h"
 
-namespace std {
-class thread;
-} // namespace std
+#include <thread>
 
 namespace circt {
 namespace esi {
 namespace cosim {
 
 /// The main RpcServer. Does not implement any capnp RPC interfaces but contains
-/// the capnp main RPC server. We run the capnp server in its own thread to be
+/// the capnp RPC servers. We run the capnp servers in their own threads to be
 /// more responsive to network traffic and so as to not slow down the
 /// simulation.
+///
+/// Each server thread runs its own event loop and accepts connections from a
+/// shared listening socket, so a client and all the endpoints it opens are
+/// serviced by a single thread. Clients on different threads don't wait for
+/// each other, and the endpoints handed out by `open` are only accessed by
+/// the thread of the client which holds them.
 class RpcServer {
 public:
   EndpointRegistry endpoints;
@@ -37,18 +41,24 @@ public:
   RpcServer();
   ~RpcServer();
 
-  /// Start and stop the server thread.
-  void run(uint16_t port);
+  /// Start the server threads, listening on the given port. Zero threads
+  /// means one per hardware thread, up to `defaultMaxThreads`.
+  void run(uint16_t port, unsigned numThreads = 0);
+  /// Signal the server threads to stop and wait for them to exit.
   void stop();
 
+  static constexpr unsigned defaultMaxThreads = 4;
+
 private:
   using Lock = std::lock_guard<std::mutex>;
 
-  /// The thread's main loop function. Exits on shutdown.
-  void mainLoop(uint16_t port);
+  /// The main loop function of each server thread, servicing the connections
+  /// it accepts on the given listening socket. Exits on shutdown.
+  void serverLoop(int listenFd);
 
-  std::thread *mainThread;
-  volatile bool stopSig;
+  std::vector<std::thread> threads;
+  bool started;
+  std::atomic<bool> stopSig;
   std::mutex m;
 };
 
@@ -35,16 +35,37 @@ extern int sv2cCosimserverEpTryGet(unsigned int endpointId,
                                    // NOLINTNEXTLINE(misc-misplaced-const)
                                    const svOpenArrayHandle data,
                                    unsigned int *sizeBytes);
+/// Try to get as many whole messages from a client as fit in a buffer.
+extern int sv2cCosimserverEpTryGetMultiple(unsigned int endpointId,
+                                           // NOLINTNEXTLINE(misc-misplaced-const)
+                                           const svOpenArrayHandle data,
+                                           // NOLINTNEXTLINE(misc-misplaced-const)
+                                           const svOpenArrayHandle sizes,
+                                           unsigned int *numMsgs);
+/// Find the endpoints with messages from a client waiting, as a bitmask.
+extern int sv2cCosimserverPoll(
+    // NOLINTNEXTLINE(misc-misplaced-const)
+    const svOpenArrayHandle mask);
 /// Send a message to a client.
 extern int sv2cCosimserverEpTryPut(unsigned int endpointId,
                                    // NOLINTNEXTLINE(misc-misplaced-const)
                                    const svOpenArrayHandle data, int dataLimit);
+/// Report the current simulation time, used to record and replay messages.
+extern void sv2cCosimserverSetTime(long long tick);
 
 /// Start the server. Not required as the first endpoint registration will do
 /// this. Provided if one wants to start the server early.
 extern int sv2cCosimserverInit();
 /// Shutdown the RPC server.
 extern void sv2cCosimserverFinish();
+
+/// The idle skip protocol, called by simulation drivers rather than from RTL.
+/// Return the number of messages the simulation got from or sent to clients.
+extern unsigned long long cosimserverGetActivity();
+/// Block until a client queues a message to the simulation, at most for the
+/// given time. Return 1 if a message is queued, 0 on timeout and -1 if the
+/// server isn't running.
+extern int cosimserverWaitForMessages(unsigned int timeoutMs);
 #ifdef __cplusplus
 }
 
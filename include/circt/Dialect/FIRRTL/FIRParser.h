@@ -14,12 +14,16 @@
 #ifndef CIRCT_DIALECT_FIRRTL_FIRPARSER_H
 #define CIRCT_DIALECT_FIRRTL_FIRPARSER_H
 
+#include "circt/Support/LLVM.h"
+#include "mlir/Support/LogicalResult.h"
+
 namespace llvm {
 class SourceMgr;
 }
 
 namespace mlir {
 class MLIRContext;
+class ModuleOp;
 class OwningModuleRef;
 } // namespace mlir
 
@@ -30,12 +34,35 @@ struct FIRParserOptions {
   /// If this is set to true, the @info locators are ignored, and the locations
   /// are set to the location in the .fir file.
   bool ignoreInfoLocators = false;
+
+  /// If this is set to true, the module bodies are parsed concurrently. This
+  /// only takes effect if multithreading is enabled on the context.
+  bool parseModulesInParallel = false;
 };
 
 mlir::OwningModuleRef importFIRRTL(llvm::SourceMgr &sourceMgr,
                                    mlir::MLIRContext *context,
                                    FIRParserOptions options = {});
 
+/// Parse the specified .fir file one module at a time, to bound the memory
+/// used by large circuits.  Each module is handed to 'processModule' in an MLIR
+/// module of its own, along with external module declarations of the modules
+/// it instantiates, and the name of the module.  The MLIR module is destroyed
+/// when 'processModule' returns; only the module signatures stay alive until
+/// the end of the parse.  If the circuit can't be split into modules, the
+/// whole circuit is handed over at once with an empty module name.
+mlir::LogicalResult importFIRRTLStreaming(
+    llvm::SourceMgr &sourceMgr, mlir::MLIRContext *context,
+    llvm::function_ref<mlir::LogicalResult(mlir::ModuleOp, llvm::StringRef)>
+        processModule,
+    FIRParserOptions options = {});
+
+/// Lex the specified .fir file without parsing it, returning the number of
+/// tokens in it, or None if the lexer reported an error.  This is used to
+/// benchmark the lexer.
+llvm::Optional<size_t> lexFIRRTL(llvm::SourceMgr &sourceMgr,
+                                 mlir::MLIRContext *context);
+
 void registerFromFIRRTLTranslation();
 
 } // namespace firrtl
@@ -15,11 +15,13 @@
 
 #include "mlir/IR/BuiltinAttributes.h"
 #include "mlir/IR/Dialect.h"
+#include <memory>
 
 namespace circt {
 namespace firrtl {
 using namespace mlir;
 class FIRRTLType;
+struct FlatBundleFieldEntry;
 
 class FIRRTLDialect : public Dialect {
 public:
@@ -34,6 +36,14 @@ public:
                                  Location loc) override;
 
   static StringRef getDialectNamespace() { return "firrtl"; }
+
+  /// Return the flattened ground fields of the specified type, computing and
+  /// caching them on first use.  This is safe to call from multiple threads.
+  ArrayRef<FlatBundleFieldEntry> getFlatBundleFields(FIRRTLType type);
+
+private:
+  struct FlatBundleCache;
+  std::unique_ptr<FlatBundleCache> flatBundleCache;
 };
 
 /// If the specified attribute list has a firrtl.name attribute, return its
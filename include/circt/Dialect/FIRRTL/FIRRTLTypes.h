@@ -260,6 +260,9 @@ public:
 
   /// Return this type with any flip types recursively removed from itself.
   FIRRTLType getPassiveType();
+
+  /// Return this type with widths of all ground types removed.
+  FIRRTLType getWidthlessType();
 };
 
 //===----------------------------------------------------------------------===//
@@ -282,8 +285,37 @@ public:
 
   /// Return this type with any flip types recursively removed from itself.
   FIRRTLType getPassiveType();
+
+  /// Return this type with widths of all ground types removed.
+  FIRRTLType getWidthlessType();
 };
 
+//===----------------------------------------------------------------------===//
+// Bundle Flattening
+//===----------------------------------------------------------------------===//
+
+/// This represents one ground field of a flattened bundle type.
+struct FlatBundleFieldEntry {
+  /// This is the underlying ground type of the field.
+  FIRRTLType type;
+  /// This is the suffix to append to the name of the flattened value, like
+  /// "_a_b".  It is empty when the type is not a bundle.  The string is owned
+  /// by the FIRRTL dialect and lives as long as the context.
+  StringRef suffix;
+  /// This indicates whether the field was flipped to be an output.
+  bool isOutput;
+
+  /// Helper to determine if a fully flattened type needs to be flipped.
+  FIRRTLType getPortType() const {
+    return isOutput ? FlipType::get(type) : type;
+  }
+};
+
+/// Convert a nested bundle of fields into a flat list of ground fields, in
+/// order.  Vectors are not flattened.  The result is computed once per type
+/// and cached in the FIRRTL dialect.
+ArrayRef<FlatBundleFieldEntry> getFlatBundleFields(FIRRTLType type);
+
 } // namespace firrtl
 } // namespace circt
 
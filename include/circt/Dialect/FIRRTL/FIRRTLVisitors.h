@@ -46,7 +46,8 @@ public:
             AsNonPassivePrimOp,
 
             // Conversion from FIRRTL to RTL dialect types.
-            StdIntCastOp, AnalogInOutCastOp>([&](auto expr) -> ResultType {
+            StdIntCastOp, AnalogInOutCastOp,
+            VectorArrayCastOp>([&](auto expr) -> ResultType {
           return thisCast->visitExpr(expr, args...);
         })
         .Default([&](auto expr) -> ResultType {
@@ -142,6 +143,7 @@ public:
   // Conversion from FIRRTL to RTL dialect types.
   HANDLE(StdIntCastOp, Unhandled);
   HANDLE(AnalogInOutCastOp, Unhandled);
+  HANDLE(VectorArrayCastOp, Unhandled);
 #undef HANDLE
 };
 
@@ -24,6 +24,16 @@ namespace firrtl {
 
 std::unique_ptr<mlir::Pass> createLowerFIRRTLTypesPass();
 
+std::unique_ptr<mlir::Pass> createInferWidthsPass();
+
+std::unique_ptr<mlir::Pass> createDeadCodePass();
+
+std::unique_ptr<mlir::Pass> createIMConstPropPass();
+
+std::unique_ptr<mlir::Pass> createDedupPass();
+
+std::unique_ptr<mlir::Pass> createExpandWhensPass();
+
 /// Generate the code for registering passes.
 #define GEN_PASS_REGISTRATION
 #include "circt/Dialect/FIRRTL/Passes.h.inc"
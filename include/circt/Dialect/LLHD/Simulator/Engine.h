@@ -17,39 +17,242 @@
 
 #include "mlir/IR/BuiltinOps.h"
 
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringMap.h"
+
+#include <functional>
+#include <vector>
+
 namespace mlir {
 class ExecutionEngine;
 } // namespace mlir
 
 namespace llvm {
 class Error;
+template <typename T>
+class Expected;
 class Module;
+class ThreadPool;
+namespace orc {
+class LLJIT;
+} // namespace orc
 } // namespace llvm
 
 namespace circt {
+class InstanceGraph;
+
 namespace llhd {
 namespace sim {
 
 struct State;
 struct Instance;
+struct Time;
+struct EventBuffer;
+struct DriveBuffer;
+struct Profile;
+struct SignalDetail;
+struct SimulationRun;
+struct TierUp;
+class Trace;
+class Transport;
+class WakeupSet;
+
+/// An external drive of a signal, applied at the given real time in
+/// picoseconds. The value bytes are in little-endian order, and zero-extended
+/// or truncated to the signal size.
+struct StimulusDrive {
+  uint64_t time;
+  unsigned signal;
+  std::vector<uint8_t> value;
+};
+
+/// The action taken when a watchpoint is hit.
+enum class WatchAction {
+  /// Stop the simulation at the end of the current step.
+  stop,
+  /// Write a checkpoint at the end of the current step.
+  checkpoint,
+  /// Start tracing, which is off until the watchpoint is hit.
+  trace
+};
 
 class Engine {
 public:
+  /// A callback notified of the new value of a signal, in little-endian byte
+  /// order.
+  using ChangeCallback =
+      std::function<void(unsigned signal, llvm::ArrayRef<uint8_t> value)>;
+
   /// Initialize an LLHD simulation engine. This initializes the state, as well
-  /// as the mlir::ExecutionEngine with the given module.
+  /// as the mlir::ExecutionEngine with the given module. If more than one
+  /// thread is requested, the instances woken up in the same delta step are run
+  /// in parallel. If a JIT cache directory is given, the compiled object is
+  /// stored there, keyed on the module, root and optimization level, and
+  /// reused by later engines instead of lowering and compiling the module
+  /// again. In that case the module is not lowered. If levelize is set, the
+  /// combinational entity instances are run in a static order instead, see
+  /// `buildLevelizedSchedule`. If lazy is set, every function of the lowered
+  /// module is compiled, at the given optimization level, on its first call
+  /// instead of up front, and the compiled code is not cached. A non-zero
+  /// tierUpThreshold enables tiered compilation: the units are compiled lazily
+  /// without optimizations, and the units of the instances run that many times
+  /// are recompiled at the given optimization level in the background.
   Engine(
       llvm::raw_ostream &out, ModuleOp module,
       llvm::function_ref<mlir::LogicalResult(mlir::ModuleOp)> mlirTransformer,
       llvm::function_ref<llvm::Error(llvm::Module *)> llvmTransformer,
-      std::string root, int mode);
+      std::string root, int mode, unsigned threads = 1,
+      StringRef jitCacheDir = "", unsigned optLevel = 2, bool levelize = false,
+      bool lazy = false, unsigned tierUpThreshold = 0);
 
   /// Default destructor
   ~Engine();
 
   /// Run simulation up to n steps or maxTime picoseconds of simulation time.
-  /// n=0 and T=0 make the simulation run indefinitely.
+  /// n=0 and T=0 make the simulation run indefinitely. Calling it again
+  /// continues the simulation where the previous call stopped.
   int simulate(int n, uint64_t maxTime);
 
+  /// Start a simulation run driven step by step, e.g. by an embedding
+  /// testbench, with `stepDelta` and `runUntil`. This initializes the design
+  /// and traces the initial signal values. Does nothing if a run is already
+  /// in progress. Not supported in distributed mode.
+  mlir::LogicalResult start();
+
+  /// Run the next pending time slot, i.e. one delta step, starting a run if
+  /// needed. Does nothing if no slot is pending.
+  mlir::LogicalResult stepDelta();
+
+  /// Run all the pending time slots up to the given real time in picoseconds,
+  /// including all their delta steps, starting a run if needed. Stops early
+  /// if a watchpoint stops the simulation.
+  mlir::LogicalResult runUntil(uint64_t time);
+
+  /// Return true if a time slot or an external drive is pending.
+  bool hasPendingEvents() const;
+
+  /// Return the real time of the last time slot run, in picoseconds.
+  uint64_t getTime() const;
+
+  /// Finish the current run and flush its trace. Later steps start a new run,
+  /// continuing from the current state.
+  void finish();
+
+  /// Return the current value of the signal with the given index, as returned
+  /// by `lookupSignal`, in little-endian byte order. The value is updated in
+  /// place by the following steps. The design has to be initialized, see
+  /// `start`.
+  llvm::ArrayRef<uint8_t> peek(unsigned signal) const;
+
+  /// Drive the signal with the given index with a little-endian value,
+  /// zero-extended or truncated to the signal size. The drive takes effect in
+  /// the next delta step, after the drives of the design for that step. The
+  /// design has to be initialized, see `start`.
+  void poke(unsigned signal, llvm::ArrayRef<uint8_t> value);
+
+  /// Call the given callback whenever the signal with the given index changes,
+  /// before waking up the instances sensitive to it.
+  void onChange(unsigned signal, ChangeCallback callback);
+
+  /// Set the initial signal values listed in the given stimulus file. Every
+  /// line of the file holds the hierarchical name of a signal, e.g.
+  /// `root/foo/s`, followed by a hexadecimal value.
+  mlir::LogicalResult applyStimulus(StringRef path);
+
+  /// Return the index of the signal with the given hierarchical name, e.g.
+  /// `root/foo/s`, or -1 if there is no such signal.
+  int lookupSignal(StringRef path);
+
+  /// Inject the external drives produced by the given callback into the
+  /// simulation. The callback fills in the next drive and returns true, or
+  /// returns false once there are no more drives. It is only asked for the
+  /// next drive once the previous one is queued, when the simulation reaches
+  /// its time, such that the drives are consumed incrementally. The drives
+  /// have to come in nondecreasing time order.
+  void setStimulusSource(std::function<bool(StimulusDrive &)> next);
+
+  /// Report that the stimulus source failed to produce the next drive, when
+  /// it returns false for a malformed input rather than the end of it. The
+  /// simulation stops with an error once it gets to that point.
+  void setStimulusError() { stimulusError = true; }
+
+  /// Stream the external drives of a binary stimulus file into the
+  /// simulation, see `setStimulusSource`. The file starts with the magic
+  /// `LLHDSTIM`, followed by the number of driven signals and, for each of
+  /// them, the length of its hierarchical name and the name. The rest of the
+  /// file is a sequence of drives, each made of the time in picoseconds, the
+  /// position of the signal in the name list, the number of value bytes and
+  /// the value bytes. Times are 64-bit and numbers 32-bit little-endian
+  /// integers.
+  mlir::LogicalResult streamStimulus(StringRef path);
+
+  /// Watch the signal with the given hierarchical name. Whenever its value
+  /// changes, the predicate is called with the new value and its size in
+  /// bytes, and the first time it holds the action is taken. A checkpoint
+  /// action writes to the given path. Signals without watchpoints are not
+  /// checked at all. Fails if there is no such signal.
+  mlir::LogicalResult
+  addWatchpoint(StringRef signal,
+                std::function<bool(const uint8_t *, uint64_t)> predicate,
+                WatchAction action, StringRef checkpointPath = "");
+
+  /// Return true if the last `simulate` call was stopped by a watchpoint.
+  bool stoppedByWatchpoint() const { return watchStopped; }
+
+  /// Run one independent simulation per stimulus file, sharing the compiled
+  /// design. The runs are distributed over the given number of threads, and
+  /// the trace of each run is written next to its stimulus file, with a
+  /// `.trace` extension. Has to be called before simulating with this engine.
+  int simulateBatch(ArrayRef<std::string> stimuli, int n, uint64_t maxTime,
+                    unsigned jobs);
+
+  /// Run this process's part of a distributed simulation. The subtrees of the
+  /// instance hierarchy below the root are spread over the processes of the
+  /// transport, and each process only runs the instances of its subtrees.
+  /// Process 0 also runs the root instance. Drives of signals used by several
+  /// processes are exchanged at the end of each time window. A window is one
+  /// time slot. If every drive in the design is delayed by some real time, a
+  /// window instead covers all the slots within that delay of the earliest
+  /// pending slot of all the processes. All the processes have to call this
+  /// with the same design and arguments. n then counts windows. Each trace
+  /// only covers the signals of the local instances. Has to be called before
+  /// simulating with this engine.
+  int simulateDistributed(Transport &transport, int n, uint64_t maxTime);
+
+  /// Write a checkpoint of the current simulation state to the given file.
+  mlir::LogicalResult checkpoint(StringRef path);
+
+  /// Restore the simulation state from a checkpoint file written by an engine
+  /// running the same design. The following `simulate` call continues from the
+  /// restored state.
+  mlir::LogicalResult restore(StringRef path);
+
+  /// Restrict the trace to the signals matching the given hierarchical glob
+  /// filters and appearing at most maxDepth levels below the root. A negative
+  /// maxDepth means no depth limit. Fails if a filter is malformed.
+  mlir::LogicalResult setTraceFilters(ArrayRef<std::string> filters,
+                                      int maxDepth);
+
+  /// Record the activations and run time of each instance, the drives and
+  /// changes of each signal and per-step queue statistics during the following
+  /// `simulate` calls.
+  void enableProfiling();
+
+  /// Dump the statistics recorded in profiling mode in JSON format.
+  void dumpProfile(llvm::raw_ostream &os);
+
+  /// Run the instances of an entity woken up in the same step with a single
+  /// call of its `<name>_batch` function, if the module was lowered with
+  /// batched entities. The instances of other units then run before or after
+  /// the whole group. Has no effect with several threads, in profiling mode or
+  /// with tiered compilation. Has to be called before simulating.
+  void enableEntityBatching() { batchEntities = true; }
+
+  /// Run the clock processes through their unit, instead of toggling their
+  /// signal natively, see `findClockUnits`. Has to be called before
+  /// simulating.
+  void disableNativeClocks() { nativeClocks = false; }
+
   /// Build the instance layout of the design.
   void buildLayout(ModuleOp module);
 
@@ -66,14 +269,180 @@ public:
   void dumpStateSignalTriggers();
 
 private:
-  void walkEntity(EntityOp entity, Instance &child);
+  /// The delays of a clock process, see `findClockUnits`, each given as a real
+  /// time in picoseconds, a number of delta steps and of epsilon steps.
+  struct ClockUnit {
+    uint64_t driveDelay[3];
+    uint64_t waitDelay[3];
+  };
+
+  /// Create an engine for one run of a batch, sharing the compiled design of
+  /// the parent engine.
+  Engine(Engine &parent, llvm::raw_ostream &out);
+
+  void walkEntity(EntityOp entity, Instance &child,
+                  const InstanceGraph &instanceGraph);
+
+  /// Run the design initialization and look up the unit functions, if not
+  /// already done.
+  mlir::LogicalResult initialize();
+
+  /// Run the next pending time slot of the current run.
+  mlir::LogicalResult runSlot();
+
+  /// Look up the packed interface of a jitted function.
+  llvm::Expected<void (*)(void **)> lookup(StringRef name);
+
+  /// Invoke the unit of the i-th instance, with the given buffer for its
+  /// inlined drives.
+  void runInstance(unsigned i, DriveBuffer &drives);
+
+  /// Run the given instances on the thread pool. Queue insertions are buffered
+  /// per chunk of instances and committed in wakeup queue order.
+  void runParallel(ArrayRef<unsigned> wakeupQueue);
+
+  /// Run the given instances on the main thread, grouping the instances of
+  /// each batched unit into one call of its batched function. The instances
+  /// without a batched function run first, in wakeup order, followed by the
+  /// groups in the order of their first instance.
+  void runBatched(ArrayRef<unsigned> wakeups);
+
+  /// Compute a static evaluation order of the combinational entity instances,
+  /// i.e. the instances of entities without registers whose drives are all
+  /// delayed by delta steps only. They are sorted such that every instance
+  /// comes after the instances driving its signals. Instances on a
+  /// combinational loop are left to the event-driven scheduling.
+  void buildLevelizedSchedule(ModuleOp module);
+
+  /// Find the clock processes of the module, i.e. the processes without
+  /// inputs which forever probe their only output, a single bit, drive its
+  /// negation and wait for a constant time. Their instances toggle the signal
+  /// and schedule their next wakeup without running any compiled code.
+  void findClockUnits(ModuleOp module);
+
+  /// Toggle the signal of the i-th instance, which runs the given clock
+  /// process, and schedule its next wakeup.
+  void runClock(unsigned i, const ClockUnit &clock);
+
+  /// Run the levelized instances of the wakeup queue in their static order.
+  /// Their delta drives are applied to the signals right away, such that the
+  /// instances they trigger run in the same step, and a combinational network
+  /// settles in a single step instead of one delta step per level.
+  void runLevelized(WakeupSet &wakeupQueue, Trace &trace);
+
+  /// Insert the pending external drives due no later than the next queued slot
+  /// into the queue. Fails if a drive is out of order or drives an unknown
+  /// signal.
+  mlir::LogicalResult injectStimulus();
+
+  /// Evaluate the watchpoints of the given signal, which just changed.
+  void checkWatchpoints(unsigned sigIndex, Trace &trace);
+
+  /// Add the instances sensitive to the given signal, which just changed, to
+  /// the wakeup queue.
+  void wakeupTriggered(unsigned sigIndex, WakeupSet &wakeupQueue);
+
+  /// Assign the subtrees of the instance hierarchy to the processes of the
+  /// transport. The largest subtrees are assigned first, each to the process
+  /// with the fewest instances so far. Marks the signals used by instances of
+  /// several processes for export.
+  void partitionInstances(Transport &transport);
+
+  /// Send the exported drives and the time of the next local slot to all the
+  /// other processes, and queue the drives they sent. Sets next to the
+  /// earliest pending slot of all the processes, or None if there is none or
+  /// some process stopped.
+  mlir::LogicalResult synchronize(bool stop, llvm::Optional<Time> &next);
 
   llvm::raw_ostream &out;
   std::string root;
   std::unique_ptr<State> state;
   std::unique_ptr<ExecutionEngine> engine;
+  // The JIT holding a cached object, used instead of the engine on cache hits,
+  // or compiling the module lazily.
+  std::unique_ptr<llvm::orc::LLJIT> cachedEngine;
   ModuleOp module;
   int traceMode;
+  std::vector<std::string> traceFilters;
+  int traceMaxDepth = -1;
+  unsigned threads;
+  std::unique_ptr<llvm::ThreadPool> pool;
+  std::vector<EventBuffer> eventBuffers;
+  // The buffers of the inlined drives, one for the main thread followed by one
+  // per worker thread.
+  std::vector<DriveBuffer> driveBuffers;
+  std::unique_ptr<Profile> profile;
+  // Whether the design has been initialized and the simulation started.
+  bool initialized = false;
+  bool started = false;
+  // The current run, if any.
+  std::unique_ptr<SimulationRun> run;
+  // The levelized instances in evaluation order, and whether each instance is
+  // levelized. Empty if not running in levelized mode.
+  std::vector<unsigned> levelOrder;
+  std::vector<bool> isLevelized;
+  // The batched functions of the entity units, and the batched function of
+  // each instance, -1 if it runs on its own. Empty unless batching is enabled
+  // and the module has batched entities.
+  bool batchEntities = false;
+  std::vector<void (*)(void **)> batchFPtrs;
+  std::vector<int> batchOf;
+  // The woken up instances of each batched function in the current step, and
+  // the arguments of the current batch.
+  std::vector<std::vector<unsigned>> batches;
+  std::vector<uint8_t *> batchStates;
+  std::vector<SignalDetail *> batchTables;
+  // The background recompilation of the hot units and the number of runs of
+  // each instance, in tiered mode. Declared after the JIT it compiles with.
+  std::unique_ptr<TierUp> tierUp;
+  unsigned tierUpThreshold = 0;
+  std::vector<uint32_t> activations;
+  // The clock processes of the design, and the clock process run by each
+  // instance, null if it runs its unit. Empty if no instance is a clock.
+  bool nativeClocks = true;
+  llvm::StringMap<ClockUnit> clockUnits;
+  std::vector<const ClockUnit *> clockOf;
+  // The source of the external drives and the next drive, if any.
+  std::function<bool(StimulusDrive &)> stimulusSource;
+  StimulusDrive pendingStimulus;
+  bool hasPendingStimulus = false;
+  bool stimulusError = false;
+  /// A watched signal value predicate.
+  struct Watchpoint {
+    std::string name;
+    unsigned signal;
+    std::function<bool(const uint8_t *, uint64_t)> predicate;
+    WatchAction action;
+    std::string checkpointPath;
+    bool hit = false;
+  };
+  std::vector<Watchpoint> watchpoints;
+  // The change callbacks of the signals, and whether each signal has any,
+  // empty if there are none.
+  std::vector<std::pair<unsigned, ChangeCallback>> changeCallbacks;
+  std::vector<bool> hasChangeCallbacks;
+  // Whether each signal has watchpoints, empty if there are none.
+  std::vector<bool> isWatched;
+  // The checkpoints to write at the end of the current step.
+  std::vector<std::string> pendingCheckpoints;
+  bool watchStopped = false;
+  // Whether changes are traced, and whether tracing waits for a watchpoint.
+  bool tracing = false;
+  bool traceDeferred = false;
+  // The connections to the other processes, the drives to forward to them,
+  // and whether each instance and signal is run or owned by this process, in
+  // distributed mode.
+  Transport *transport = nullptr;
+  std::unique_ptr<EventBuffer> exports;
+  std::vector<bool> isLocalInstance;
+  std::vector<bool> isLocalSignal;
+  // The minimum real-time delay of all the drives in picoseconds, zero if
+  // some drive has a delta or epsilon delay only, or an unknown delay.
+  uint64_t lookahead = 0;
+  // The engine owning the compiled design, for the runs of a batch.
+  Engine *parent = nullptr;
+  // The functions resolved for the runs of a batch.
+  llvm::StringMap<void (*)(void **)> symbols;
 };
 
 } // namespace sim
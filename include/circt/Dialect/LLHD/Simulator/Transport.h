@@ -0,0 +1,74 @@
+//===- Transport.h - Distributed simulation transport -----------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the connections between the processes of a distributed
+// LLHD simulation.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CIRCT_DIALECT_LLHD_SIMULATOR_TRANSPORT_H
+#define CIRCT_DIALECT_LLHD_SIMULATOR_TRANSPORT_H
+
+#include "mlir/Support/LogicalResult.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/Support/Error.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace circt {
+namespace llhd {
+namespace sim {
+
+/// The connections of one process of a distributed simulation. Every process
+/// has a rank, from 0 to the number of processes minus one, and is connected
+/// to all the other processes. The messages sent to a peer are received by it
+/// in order.
+class Transport {
+public:
+  virtual ~Transport();
+
+  /// Return the rank of this process.
+  virtual unsigned getRank() const = 0;
+
+  /// Return the number of processes.
+  virtual unsigned getSize() const = 0;
+
+  /// Send a message to the given peer.
+  virtual mlir::LogicalResult send(unsigned peer,
+                                   llvm::ArrayRef<uint8_t> message) = 0;
+
+  /// Receive the next message of the given peer, blocking until it arrives.
+  virtual mlir::LogicalResult receive(unsigned peer,
+                                      std::vector<uint8_t> &message) = 0;
+
+  /// Close the connections. The process which started the others also waits
+  /// for them to exit, and fails if any of them failed.
+  virtual mlir::LogicalResult close() { return mlir::success(); }
+};
+
+/// Fork the calling process into the given number of processes, connected by
+/// local sockets, and return the transport of each process. The calling
+/// process gets rank 0.
+llvm::Expected<std::unique_ptr<Transport>> forkLocalTransport(unsigned size);
+
+/// Connect to the other processes of a distributed simulation over TCP. The
+/// endpoints list the `host:port` of every rank. Each process listens on its
+/// own endpoint, accepts the connections of the higher ranks and connects to
+/// the lower ones, retrying until the given number of seconds passed.
+llvm::Expected<std::unique_ptr<Transport>>
+connectSocketTransport(unsigned rank, llvm::ArrayRef<std::string> endpoints,
+                       unsigned timeout = 30);
+
+} // namespace sim
+} // namespace llhd
+} // namespace circt
+
+#endif // CIRCT_DIALECT_LLHD_SIMULATOR_TRANSPORT_H
@@ -35,6 +35,11 @@ std::unique_ptr<OperationPass<ProcOp>> createMemoryToBlockArgumentPass();
 
 std::unique_ptr<OperationPass<ProcOp>> createEarlyCodeMotionPass();
 
+std::unique_ptr<OperationPass<ModuleOp>> createEntityInliningPass();
+
+std::unique_ptr<OperationPass<ModuleOp>>
+createSignalForwardingPass(bool removeDeadSignals = true);
+
 /// Register the LLHD Transformation passes.
 void initLLHDTransformationPasses();
 
@@ -0,0 +1,35 @@
+//===- Passes.h - SV pass entry points --------------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This header file defines prototypes that expose pass constructors.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CIRCT_DIALECT_SV_PASSES_H
+#define CIRCT_DIALECT_SV_PASSES_H
+
+#include <memory>
+
+namespace mlir {
+class Pass;
+} // namespace mlir
+
+namespace circt {
+namespace sv {
+
+std::unique_ptr<mlir::Pass> createSVMergeAlwaysPass();
+std::unique_ptr<mlir::Pass> createSVRetimePass();
+
+/// Generate the code for registering passes.
+#define GEN_PASS_REGISTRATION
+#include "circt/Dialect/SV/Passes.h.inc"
+
+} // namespace sv
+} // namespace circt
+
+#endif // CIRCT_DIALECT_SV_PASSES_H
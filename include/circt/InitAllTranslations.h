@@ -14,6 +14,8 @@
 #include "circt/Dialect/ESI/ESIDialect.h"
 #include "circt/Dialect/FIRRTL/FIRParser.h"
 #include "circt/Dialect/LLHD/Translation/TranslateToVerilog.h"
+#include "circt/Translation/BinaryIR.h"
+#include "circt/Translation/ExportCXXSim.h"
 #include "circt/Translation/ExportVerilog.h"
 
 #ifndef CIRCT_INITALLTRANSLATIONS_H
@@ -26,6 +28,8 @@ namespace circt {
 // automatically.
 inline void registerAllTranslations() {
   static bool initOnce = []() {
+    registerBinaryIRTranslations();
+    registerToCXXSimTranslation();
     registerToVerilogTranslation();
     registerFIRRTLToVerilogTranslation();
     esi::registerESITranslations();
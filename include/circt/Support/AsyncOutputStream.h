@@ -0,0 +1,73 @@
+//===- AsyncOutputStream.h - Output stream with a writer thread -*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// An output stream which collects the output in large chunks, and writes them
+// to another stream on a thread of its own. The emitters produce their output
+// in many small pieces, and this overlaps the writes with the emission work,
+// which matters when writing to slow (e.g. network) file systems.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CIRCT_SUPPORT_ASYNCOUTPUTSTREAM_H
+#define CIRCT_SUPPORT_ASYNCOUTPUTSTREAM_H
+
+#include "llvm/Support/raw_ostream.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace circt {
+
+/// Collect the output in chunks of `chunkSize` bytes, and write them to the
+/// target stream on a writer thread. At most `maxPendingChunks` chunks are
+/// waiting for the writer at any time, the stream blocks until the writer
+/// catches up beyond that. The target stream must not be used until this
+/// stream is destroyed, which flushes it.
+class AsyncOutputStream : public llvm::raw_ostream {
+public:
+  explicit AsyncOutputStream(llvm::raw_ostream &target,
+                             size_t chunkSize = 1 << 20,
+                             size_t maxPendingChunks = 8);
+  ~AsyncOutputStream() override;
+
+private:
+  void write_impl(const char *ptr, size_t size) override;
+  uint64_t current_pos() const override { return pos; }
+
+  /// Hand the current chunk over to the writer thread.
+  void submitChunk();
+
+  /// The body of the writer thread.
+  void writeChunks();
+
+  llvm::raw_ostream &target;
+  const size_t chunkSize;
+  const size_t maxPendingChunks;
+
+  /// The number of bytes written to this stream so far.
+  uint64_t pos = 0;
+
+  /// The chunk being filled.
+  std::vector<char> chunk;
+
+  /// The chunks waiting for the writer thread, and the chunks which it wrote
+  /// and which can be reused.
+  std::deque<std::vector<char>> pending;
+  std::vector<std::vector<char>> freeChunks;
+  bool done = false;
+  std::mutex mutex;
+  std::condition_variable pendingChanged;
+
+  std::thread writer;
+};
+
+} // namespace circt
+
+#endif // CIRCT_SUPPORT_ASYNCOUTPUTSTREAM_H
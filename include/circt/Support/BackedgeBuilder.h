@@ -17,6 +17,7 @@
 
 #include "mlir/IR/Location.h"
 #include "mlir/IR/Value.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/SmallVector.h"
 
 namespace mlir {
@@ -33,6 +34,12 @@ class Backedge;
 /// this class is destructed, usually at the end of a scope. It will check that
 /// invariant then erase all the backedge ops during destruction.
 ///
+/// The backedges of a type are handed out from the results of shared
+/// placeholder ops, which are created with more and more results as the
+/// backedges of the type are requested, such that building many backedges only
+/// creates and erases a few ops.  A placeholder op is inserted where the first
+/// backedge it provides was requested.
+///
 /// Example use:
 /// ```
 ///   circt::BackedgeBuilder back(rewriter, loc);
@@ -55,8 +62,16 @@ public:
   Backedge get(mlir::Type resultType);
 
 private:
+  /// The placeholder op currently handing out the backedges of a type, and
+  /// the index of its next free result.
+  struct Pool {
+    mlir::Operation *op = nullptr;
+    unsigned nextResult = 0;
+  };
+
   mlir::PatternRewriter &rewriter;
   mlir::Location loc;
+  llvm::SmallDenseMap<mlir::Type, Pool, 4> pools;
   llvm::SmallVector<mlir::Operation *, 16> edges;
 };
 
@@ -67,7 +82,7 @@ class Backedge {
   friend class BackedgeBuilder;
 
   /// `Backedge` is constructed exclusively by `BackedgeBuilder`.
-  Backedge(mlir::Operation *op);
+  Backedge(mlir::Value placeholder);
 
 public:
   operator mlir::Value();
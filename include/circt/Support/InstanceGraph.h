@@ -0,0 +1,125 @@
+//===- InstanceGraph.h - Module instantiation graph -------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines an analysis of which modules instantiate which others. It
+// works on any operation holding a symbol table of modules, like a
+// firrtl.circuit or a builtin.module containing rtl.module's or llhd.entity's.
+// An instance is any operation inside a module which refers to another module
+// of the table with a flat symbol reference, like firrtl.instance,
+// rtl.instance and llhd.inst.
+//
+// The graph is computed once, so that passes don't have to look up the module
+// of every instance by name.  It is not updated as the IR changes, except
+// through `replaceInstance`.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CIRCT_SUPPORT_INSTANCEGRAPH_H
+#define CIRCT_SUPPORT_INSTANCEGRAPH_H
+
+#include "circt/Support/LLVM.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringMap.h"
+#include <memory>
+#include <vector>
+
+namespace mlir {
+class Operation;
+} // namespace mlir
+
+namespace circt {
+
+class InstanceGraphNode;
+
+/// An instance of a module: the edge of the instance graph from the module
+/// containing the instance to the module it instantiates.
+class InstanceRecord {
+public:
+  InstanceRecord(mlir::Operation *instance, InstanceGraphNode *parent,
+                 InstanceGraphNode *target)
+      : instance(instance), parent(parent), target(target) {}
+
+  /// Get the instance operation.
+  mlir::Operation *getInstance() const { return instance; }
+
+  /// Get the node of the module containing the instance.
+  InstanceGraphNode *getParent() const { return parent; }
+
+  /// Get the node of the module which is instantiated.
+  InstanceGraphNode *getTarget() const { return target; }
+
+private:
+  friend class InstanceGraph;
+
+  mlir::Operation *instance;
+  InstanceGraphNode *parent;
+  InstanceGraphNode *target;
+};
+
+/// A module of the instance graph.
+class InstanceGraphNode {
+public:
+  explicit InstanceGraphNode(mlir::Operation *module) : module(module) {}
+
+  /// Get the module operation.
+  mlir::Operation *getModule() const { return module; }
+
+  /// Get the instances inside this module, in the order they appear.
+  ArrayRef<InstanceRecord> getInstances() const { return instances; }
+
+  /// Get the instances of this module.
+  ArrayRef<InstanceRecord *> getUses() const { return uses; }
+
+private:
+  friend class InstanceGraph;
+
+  mlir::Operation *module;
+  SmallVector<InstanceRecord, 4> instances;
+  SmallVector<InstanceRecord *, 4> uses;
+};
+
+/// The instance graph of the modules in a symbol table operation.  This can be
+/// used as an MLIR analysis.
+class InstanceGraph {
+public:
+  explicit InstanceGraph(mlir::Operation *operation);
+
+  /// Look up the node of a module by name or operation.  Return null if it
+  /// isn't a module of the graph.
+  InstanceGraphNode *lookup(StringRef name) const;
+  InstanceGraphNode *lookup(mlir::Operation *module) const;
+
+  /// Look up the record of an instance, or return null if it isn't an instance
+  /// of the graph.
+  InstanceRecord *lookupInstance(mlir::Operation *instance) const;
+
+  /// Return the module instantiated by `instance`, or null if it isn't an
+  /// instance of the graph.
+  mlir::Operation *getReferencedModule(mlir::Operation *instance) const;
+
+  /// Return the nodes in post order: every module comes after the modules it
+  /// instantiates, except in cycles.  Visiting the modules in this order
+  /// processes them bottom-up.
+  ArrayRef<InstanceGraphNode *> getPostOrder() const { return postOrder; }
+
+  /// Record that `newInstance` replaced `oldInstance`, which instantiates the
+  /// same module.
+  void replaceInstance(mlir::Operation *oldInstance,
+                       mlir::Operation *newInstance);
+
+private:
+  std::vector<std::unique_ptr<InstanceGraphNode>> nodes;
+  llvm::StringMap<InstanceGraphNode *> nodesByName;
+  DenseMap<mlir::Operation *, InstanceGraphNode *> nodesByModule;
+  DenseMap<mlir::Operation *, InstanceRecord *> instanceRecords;
+  std::vector<InstanceGraphNode *> postOrder;
+};
+
+} // namespace circt
+
+#endif // CIRCT_SUPPORT_INSTANCEGRAPH_H
@@ -0,0 +1,97 @@
+//===- MemoryStats.h - Per-pass memory usage reporting ----------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Track the memory used by the process and the size of the IR before and after
+// each pass of a pipeline, and around other phases of a tool such as parsing
+// and emission, to find out which of them is responsible for the peak memory
+// use. The tools enable it with `-memory-stats`.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CIRCT_SUPPORT_MEMORYSTATS_H
+#define CIRCT_SUPPORT_MEMORYSTATS_H
+
+#include "circt/Support/LLVM.h"
+#include "llvm/ADT/StringMap.h"
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace mlir {
+class Operation;
+class PassManager;
+} // namespace mlir
+
+namespace circt {
+
+/// The memory used by the process, and the size of some IR, at one point.
+struct MemorySnapshot {
+  /// The resident set size of the process, in bytes. Zero if unknown.
+  uint64_t rss = 0;
+  /// The peak resident set size of the process so far, in bytes. Zero if
+  /// unknown.
+  uint64_t peakRSS = 0;
+  /// The bytes allocated through malloc and not freed yet. Zero if unknown.
+  uint64_t mallocBytes = 0;
+  /// The number of operations in the IR, including the root.
+  uint64_t numOps = 0;
+  /// The number of distinct types and attributes used by the IR. The context
+  /// may hold more, which are no longer used.
+  uint64_t numTypes = 0;
+  uint64_t numAttrs = 0;
+
+  /// Take a snapshot of the process, and of the IR nested in 'op' if not null.
+  /// Counting the types and attributes walks all the IR, which can be skipped.
+  static MemorySnapshot take(mlir::Operation *op, bool countUniqued = true);
+};
+
+/// Collects the memory used by each phase, summed over all the runs of the
+/// phase. A pass nested on many operations runs once per operation, possibly
+/// in parallel, in which case the changes of the process-wide numbers overlap.
+class MemoryStats {
+public:
+  /// Record a run of 'phase', given snapshots taken before and after it.
+  void addPhase(StringRef phase, const MemorySnapshot &before,
+                const MemorySnapshot &after);
+
+  /// Print a table, or a JSON report if 'json' is set.
+  void print(raw_ostream &os, bool json) const;
+
+private:
+  struct Phase {
+    std::string name;
+    uint64_t runs = 0;
+    int64_t rssDelta = 0;
+    int64_t mallocDelta = 0;
+    int64_t opsDelta = 0;
+    uint64_t peakRSS = 0;
+    /// The IR size after the last run.
+    uint64_t numOps = 0, numTypes = 0, numAttrs = 0;
+  };
+
+  mutable std::mutex mutex;
+  llvm::StringMap<size_t> phaseIndex;
+  std::vector<Phase> phases;
+};
+
+/// Register the `-memory-stats` and `-memory-stats-format` command line
+/// options. Call next to `mlir::registerPassManagerCLOptions`.
+void registerMemoryStatsCLOptions();
+
+/// Return true if `-memory-stats` was given.
+bool isMemoryStatsEnabled();
+
+/// If `-memory-stats` was given, instrument 'pm' to record the memory used by
+/// each of its passes, and return the statistics, which are printed to stderr
+/// when 'pm' is destroyed. The caller may record other phases in them until
+/// then. Return null otherwise. Call next to `mlir::applyPassManagerCLOptions`.
+MemoryStats *applyMemoryStatsCLOptions(mlir::PassManager &pm);
+
+} // namespace circt
+
+#endif // CIRCT_SUPPORT_MEMORYSTATS_H
@@ -0,0 +1,49 @@
+//===- BinaryIR.h - Binary IR serialization ---------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Defines the interface to the compact binary IR format used to hand designs
+// between CIRCT tools without printing and re-parsing textual MLIR.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CIRCT_TRANSLATION_BINARYIR_H
+#define CIRCT_TRANSLATION_BINARYIR_H
+
+namespace llvm {
+class raw_ostream;
+class SourceMgr;
+class StringRef;
+} // namespace llvm
+
+namespace mlir {
+struct LogicalResult;
+class MLIRContext;
+class ModuleOp;
+class OwningModuleRef;
+} // namespace mlir
+
+namespace circt {
+
+/// Return true if `buffer` starts with the binary IR magic number.
+bool isBinaryIR(llvm::StringRef buffer);
+
+/// Write `module` to `os` in the binary IR format.  Strings, types, attributes
+/// and locations are interned, so each one is stored and parsed only once.
+mlir::LogicalResult writeBinaryIR(mlir::ModuleOp module, llvm::raw_ostream &os);
+
+/// Read a module in the binary IR format from the main buffer of `sourceMgr`.
+/// Returns a null module and emits a diagnostic on failure.
+mlir::OwningModuleRef readBinaryIR(llvm::SourceMgr &sourceMgr,
+                                   mlir::MLIRContext *context);
+
+/// Register the `emit-binary` and `parse-binary` translations.
+void registerBinaryIRTranslations();
+
+} // namespace circt
+
+#endif // CIRCT_TRANSLATION_BINARYIR_H
@@ -0,0 +1,39 @@
+//===- ExportCXXSim.h - C++ simulation model emitter ------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Defines the interface to the C++ simulation model emitter, which turns RTL
+// modules and their SV registers into C++ without going through Verilog.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CIRCT_TRANSLATION_EXPORTCXXSIM_H
+#define CIRCT_TRANSLATION_EXPORTCXXSIM_H
+
+namespace llvm {
+class raw_ostream;
+} // namespace llvm
+
+namespace mlir {
+struct LogicalResult;
+class ModuleOp;
+} // namespace mlir
+
+namespace circt {
+
+/// Emit a C++ struct for each RTL module in `module` which simulates it cycle
+/// by cycle.  Each struct has a member for every port, and an `eval()` method
+/// which settles the combinational logic in levelized order and applies the
+/// clock edges of its `sv.always` blocks.
+mlir::LogicalResult exportCXXSim(mlir::ModuleOp module, llvm::raw_ostream &os);
+
+/// Register the `emit-cxx-sim` translation.
+void registerToCXXSimTranslation();
+
+} // namespace circt
+
+#endif // CIRCT_TRANSLATION_EXPORTCXXSIM_H
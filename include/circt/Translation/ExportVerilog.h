@@ -13,8 +13,12 @@
 #ifndef CIRCT_TRANSLATION_EXPORTVERILOG_H
 #define CIRCT_TRANSLATION_EXPORTVERILOG_H
 
+#include <atomic>
+#include <cstdint>
+
 namespace llvm {
 class raw_ostream;
+class StringRef;
 } // namespace llvm
 
 namespace mlir {
@@ -24,8 +28,52 @@ class ModuleOp;
 
 namespace circt {
 
+/// Counters filled in by the Verilog emitter.  They are atomic because modules
+/// may be emitted in parallel.
+struct ExportVerilogStatistics {
+  /// The number of expressions that were given a wire of their own.
+  std::atomic<uint64_t> numExpressionWires{0};
+
+  /// The number of expressions that would have been given a wire of their own
+  /// if no multiply used expressions were duplicated into their users.
+  std::atomic<uint64_t> numExpressionWiresWithoutInlining{0};
+};
+
+/// Options that control how RTL and SV dialect code is printed as Verilog.
+struct ExportVerilogOptions {
+  /// If the context allows multithreading, print each top-level module into
+  /// its own buffer on the thread pool, and concatenate the buffers in the
+  /// original order.
+  bool emitInParallel = false;
+
+  /// Only print the primary location of each statement in its location
+  /// comment, rather than every location it was built from.
+  bool primaryLocationOnly = false;
+
+  /// Leave out a location comment that is the same as the one on the line
+  /// before it.
+  bool omitRepeatedLocationInfo = false;
+
+  /// Expressions with several uses normally get a wire of their own.  Those
+  /// that print at most this many operations are instead duplicated into each
+  /// of their users.  Zero gives every multiply used expression a wire.
+  unsigned maxInlineExpressionSize = 0;
+
+  /// If set, the emitter adds its counters to these statistics.
+  ExportVerilogStatistics *statistics = nullptr;
+};
+
 /// Export a module containing RTL, and SV dialect code.
 mlir::LogicalResult exportVerilog(mlir::ModuleOp module, llvm::raw_ostream &os);
+mlir::LogicalResult exportVerilog(mlir::ModuleOp module, llvm::raw_ostream &os,
+                                  const ExportVerilogOptions &options);
+
+/// Export a module containing RTL, and SV dialect code into one `.sv` file per
+/// module and interface in the directory `dirname`, along with a `filelist.f`
+/// that lists them.  Files whose contents did not change are not rewritten.
+mlir::LogicalResult
+exportSplitVerilog(mlir::ModuleOp module, llvm::StringRef dirname,
+                   const ExportVerilogOptions &options = {});
 
 /// Register a translation for exporting FIRRTL, RTL, and SV
 void registerToVerilogTranslation();
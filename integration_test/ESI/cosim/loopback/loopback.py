@@ -77,3 +77,18 @@ class LoopbackTester:
             dataRecv.append(self.read(ep))
         ep.close().wait()
         assert dataSent == dataRecv
+
+    def test_stats(self, num_msgs):
+        """Check the traffic counters after 'num_msgs' messages looped back."""
+        ifaces = self.cosim.list().wait().ifaces
+        stats = self.cosim.stats().wait().endpoints
+        assert len(stats) == len(ifaces)
+        ep = next(s for s in stats if s.endpointID == ifaces[0].endpointID)
+        print(ep)
+        assert ep.toSim.messages >= num_msgs
+        assert ep.toClient.messages >= num_msgs
+        assert ep.toSim.bytes > 0 and ep.toClient.bytes > 0
+        assert ep.toSim.depth == 0 and ep.toClient.depth == 0
+        assert 1 <= ep.toSim.maxDepth <= ep.toSim.messages
+        assert ep.toClient.maxQueuedNs <= ep.toClient.queuedNs
+        assert 1 <= ep.pollsWithData <= ep.polls
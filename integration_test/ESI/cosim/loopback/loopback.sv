@@ -3,6 +3,7 @@
 // PY: rpc.test_list()
 // PY: rpc.test_open_close()
 // PY: rpc.write_read_many(5)
+// PY: rpc.test_stats(5)
 
 import Cosim_DpiPkg::*;
 
@@ -0,0 +1,25 @@
+//===- ExportVerilog.cpp - C Interface for Verilog emission ---------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+//  Implements a C Interface for emitting Verilog
+//
+//===----------------------------------------------------------------------===//
+
+#include "circt-c/ExportVerilog.h"
+#include "circt/Translation/ExportVerilog.h"
+#include "mlir-c/IR.h"
+#include "mlir/CAPI/IR.h"
+#include "mlir/CAPI/Support.h"
+#include "mlir/CAPI/Utils.h"
+
+MlirLogicalResult mlirExportVerilog(MlirModule module,
+                                    MlirStringCallback callback,
+                                    void *userData) {
+  mlir::detail::CallbackOstream stream(callback, userData);
+  return wrap(circt::exportVerilog(unwrap(module), stream));
+}
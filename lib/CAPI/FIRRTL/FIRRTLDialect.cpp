@@ -0,0 +1,44 @@
+//===- FIRRTLDialect.cpp - C Interface for the FIRRTL Dialect -------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+//  Implements a C Interface for the FIRRTL Dialect
+//
+//===----------------------------------------------------------------------===//
+
+#include "circt-c/FIRRTLDialect.h"
+#include "circt/Dialect/FIRRTL/FIRParser.h"
+#include "circt/Dialect/FIRRTL/FIRRTLOps.h"
+#include "mlir-c/IR.h"
+#include "mlir/CAPI/IR.h"
+#include "mlir/CAPI/Support.h"
+#include "mlir/IR/BuiltinOps.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+
+void mlirContextRegisterFIRRTLDialect(MlirContext context) {
+  unwrap(context)->getDialectRegistry().insert<circt::firrtl::FIRRTLDialect>();
+}
+
+MlirDialect mlirContextLoadFIRRTLDialect(MlirContext context) {
+  return wrap(
+      unwrap(context)->getOrLoadDialect<circt::firrtl::FIRRTLDialect>());
+}
+
+MlirStringRef mlirFIRRTLDialectGetNamespace() {
+  return wrap(circt::firrtl::FIRRTLDialect::getDialectNamespace());
+}
+
+MlirModule mlirFIRRTLImportFIRBuffer(MlirContext context, MlirStringRef buffer,
+                                     MlirStringRef bufferName) {
+  llvm::SourceMgr sourceMgr;
+  sourceMgr.AddNewSourceBuffer(
+      llvm::MemoryBuffer::getMemBufferCopy(unwrap(buffer), unwrap(bufferName)),
+      llvm::SMLoc());
+  auto module = circt::firrtl::importFIRRTL(sourceMgr, unwrap(context));
+  return wrap(module.release());
+}
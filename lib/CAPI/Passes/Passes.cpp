@@ -0,0 +1,27 @@
+//===- Passes.cpp - C Interface for the CIRCT passes ----------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+//  Implements a C Interface for registering the CIRCT passes
+//
+//===----------------------------------------------------------------------===//
+
+#include "circt-c/Passes.h"
+#include "circt/Conversion/Passes.h"
+#include "circt/Dialect/FIRRTL/Passes.h"
+#include "circt/Dialect/RTL/Passes.h"
+#include "circt/Dialect/SV/Passes.h"
+#include "mlir/Transforms/Passes.h"
+
+void mlirRegisterCIRCTPasses() {
+  mlir::registerCanonicalizerPass();
+  mlir::registerCSEPass();
+  circt::firrtl::registerPasses();
+  circt::rtl::registerPasses();
+  circt::sv::registerPasses();
+  circt::registerConversionPasses();
+}
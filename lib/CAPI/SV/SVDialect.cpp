@@ -0,0 +1,29 @@
+//===- SVDialect.cpp - C Interface for the SV Dialect ---------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+//  Implements a C Interface for the SV Dialect
+//
+//===----------------------------------------------------------------------===//
+
+#include "circt-c/SVDialect.h"
+#include "circt/Dialect/SV/SVOps.h"
+#include "mlir-c/IR.h"
+#include "mlir/CAPI/IR.h"
+#include "mlir/CAPI/Support.h"
+
+void mlirContextRegisterSVDialect(MlirContext context) {
+  unwrap(context)->getDialectRegistry().insert<circt::sv::SVDialect>();
+}
+
+MlirDialect mlirContextLoadSVDialect(MlirContext context) {
+  return wrap(unwrap(context)->getOrLoadDialect<circt::sv::SVDialect>());
+}
+
+MlirStringRef mlirSVDialectGetNamespace() {
+  return wrap(circt::sv::SVDialect::getDialectNamespace());
+}
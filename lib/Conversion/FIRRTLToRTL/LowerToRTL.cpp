@@ -18,9 +18,16 @@
 #include "circt/Dialect/RTL/RTLTypes.h"
 #include "circt/Dialect/SV/SVOps.h"
 #include "circt/Support/ImplicitLocOpBuilder.h"
+#include "circt/Support/InstanceGraph.h"
 #include "mlir/IR/BuiltinTypes.h"
+#include "mlir/IR/Diagnostics.h"
 #include "mlir/Pass/Pass.h"
+#include "mlir/Support/FileUtilities.h"
+#include "llvm/ADT/StringSet.h"
 #include "llvm/ADT/TinyPtrVector.h"
+#include "llvm/Support/Parallel.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/xxhash.h"
 using namespace circt;
 using namespace firrtl;
 
@@ -34,6 +41,16 @@ static Type lowerType(Type type) {
   // Ignore flip types.
   firType = firType.getPassiveType();
 
+  // Vectors of ground types are kept as a whole, as an RTL array.  Zero bit
+  // elements have no RTL equivalent.
+  if (auto vectorType = firType.dyn_cast<FVectorType>()) {
+    auto elementType = lowerType(vectorType.getElementType());
+    if (!elementType || elementType.isInteger(0) ||
+        vectorType.getNumElements() == 0)
+      return {};
+    return rtl::ArrayType::get(elementType, vectorType.getNumElements());
+  }
+
   auto width = firType.getBitWidthOrSentinel();
   if (width >= 0) // IntType, analog with known width, clock, etc.
     return IntegerType::get(type.getContext(), width);
@@ -56,7 +73,11 @@ static Value castToFIRRTLType(Value val, Type type,
   if (type.isa<AnalogType>())
     return builder.createOrFold<AnalogInOutCastOp>(firType, val);
 
-  val = builder.createOrFold<StdIntCastOp>(firType.getPassiveType(), val);
+  auto passiveType = firType.getPassiveType();
+  if (val.getType().isa<rtl::ArrayType>())
+    val = builder.createOrFold<VectorArrayCastOp>(passiveType, val);
+  else
+    val = builder.createOrFold<StdIntCastOp>(passiveType, val);
 
   // Handle the flip type if needed.
   if (type != val.getType())
@@ -69,6 +90,8 @@ static Value castFromFIRRTLType(Value val, Type type,
                                 ImplicitLocOpBuilder &builder) {
   // Strip off Flip type if needed.
   val = builder.createOrFold<AsPassivePrimOp>(val);
+  if (type.isa<rtl::ArrayType>())
+    return builder.createOrFold<VectorArrayCastOp>(type, val);
   return builder.createOrFold<StdIntCastOp>(type, val);
 }
 
@@ -83,6 +106,32 @@ static bool isZeroBitFIRRTLType(Type type) {
 //===----------------------------------------------------------------------===//
 
 namespace {
+/// The connects driving the ports, instance ports and wires of a module body,
+/// collected in a single walk of the body before it is lowered, instead of
+/// scanning the use list of every one of them.
+class DriverIndex {
+public:
+  explicit DriverIndex(Block *body);
+
+  /// Return the connects driving the value if these are all its uses, in IR
+  /// order, or an empty list otherwise.
+  ArrayRef<ConnectOp> getOnlyDrivers(Value value) const;
+
+  /// Return the connect driving the value if it is the only one, and the value
+  /// is not accessed through another operation which could drive it.
+  ConnectOp getSingleDriver(Value value) const;
+
+private:
+  struct Entry {
+    SmallVector<ConnectOp, 1> connects;
+    /// Whether the value is read, or accessed through an aggregate or
+    /// non-passive view which could drive it.
+    bool isRead = false;
+    bool isAliased = false;
+  };
+  DenseMap<Value, Entry> entries;
+};
+
 struct FIRRTLModuleLowering
     : public LowerFIRRTLToRTLModuleBase<FIRRTLModuleLowering> {
 
@@ -90,6 +139,7 @@ struct FIRRTLModuleLowering
 
 private:
   void lowerFileHeader(CircuitOp op);
+  LogicalResult extractMemMacros(CircuitOp circuit, Block *topLevelModule);
   LogicalResult lowerPorts(ArrayRef<ModulePortInfo> firrtlPorts,
                            SmallVectorImpl<rtl::ModulePortInfo> &ports,
                            Operation *moduleOp);
@@ -97,11 +147,14 @@ private:
   rtl::RTLExternModuleOp lowerExtModule(FExtModuleOp oldModule,
                                         Block *topLevelModule);
 
-  void lowerModuleBody(FModuleOp oldModule,
-                       DenseMap<Operation *, Operation *> &oldToNewModuleMap);
+  void
+  lowerModuleBody(FModuleOp oldModule, const InstanceGraph &instanceGraph,
+                  const DenseMap<Operation *, Operation *> &oldToNewModuleMap);
 
-  void lowerInstance(InstanceOp instance, CircuitOp circuitOp,
-                     DenseMap<Operation *, Operation *> &oldToNewModuleMap);
+  void
+  lowerInstance(InstanceOp instance, const InstanceGraph &instanceGraph,
+                const DenseMap<Operation *, Operation *> &oldToNewModuleMap,
+                const DriverIndex &drivers);
 };
 } // end anonymous namespace
 
@@ -110,6 +163,15 @@ std::unique_ptr<mlir::Pass> circt::firrtl::createLowerFIRRTLToRTLModulePass() {
   return std::make_unique<FIRRTLModuleLowering>();
 }
 
+std::unique_ptr<mlir::Pass>
+circt::firrtl::createLowerFIRRTLToRTLModulePass(uint64_t memMacroThreshold,
+                                                StringRef memMacroConf) {
+  auto pass = std::make_unique<FIRRTLModuleLowering>();
+  pass->memMacroThreshold = memMacroThreshold;
+  pass->memMacroConf = memMacroConf.str();
+  return pass;
+}
+
 /// Run on the firrtl.circuit operation, lowering any firrtl.module operations
 /// it contains.
 void FIRRTLModuleLowering::runOnOperation() {
@@ -130,6 +192,9 @@ void FIRRTLModuleLowering::runOnOperation() {
   // Emit all the macros and preprocessor gunk at the start of the file.
   lowerFileHeader(circuit);
 
+  if (failed(extractMemMacros(circuit, moduleBody)))
+    return signalPassFailure();
+
   auto *circuitBody = circuit.getBody();
 
   // Keep track of the mapping from old to new modules.  The result may be null
@@ -163,11 +228,21 @@ void FIRRTLModuleLowering::runOnOperation() {
   // any instances that refer to the old modules.  Only rtl.instance can refer
   // to an rtl.module, not a firrtl.instance.
   //
-  // TODO: This is a trivially parallelizable for loop.  We should be able to
-  // process each module in parallel.
-  for (auto &op : circuitBody->getOperations()) {
-    if (auto module = dyn_cast<FModuleOp>(op))
-      lowerModuleBody(module, oldToNewModuleMap);
+  // Each body only touches its own old and new module, and only reads the
+  // signatures of the modules it instantiates, so the bodies can be lowered in
+  // parallel.  The circuit itself is not modified until they are all done.
+  InstanceGraph instanceGraph(circuit);
+  SmallVector<FModuleOp, 0> modules(circuitBody->getOps<FModuleOp>());
+  if (getContext().isMultithreadingEnabled()) {
+    ParallelDiagnosticHandler diagHandler(&getContext());
+    llvm::parallelForEachN(0, modules.size(), [&](size_t i) {
+      diagHandler.setOrderIDForThread(i);
+      lowerModuleBody(modules[i], instanceGraph, oldToNewModuleMap);
+      diagHandler.eraseOrderIDForThread();
+    });
+  } else {
+    for (auto module : modules)
+      lowerModuleBody(module, instanceGraph, oldToNewModuleMap);
   }
 
   // Finally delete all the old modules.
@@ -251,6 +326,132 @@ void FIRRTLModuleLowering::lowerFileHeader(CircuitOp op) {
   emitString("");
 }
 
+/// Return the name of the attribute naming the external macro a memory is
+/// lowered to.
+static StringRef getMemMacroAttrName() { return "firrtl.memMacro"; }
+
+/// Build the ports of the external macro a memory with the specified ports is
+/// lowered to.  Each read port N becomes "RN_addr", "RN_en", "RN_clk" inputs
+/// and an "RN_data" output, each write port N "WN_addr", "WN_en", "WN_clk",
+/// "WN_data" and "WN_mask" inputs, in the order of the ports of the memory.
+static void
+getMemMacroPorts(ArrayRef<std::pair<Identifier, MemOp::PortKind>> memPorts,
+                 uint64_t depth, Type dataType,
+                 SmallVectorImpl<rtl::ModulePortInfo> &ports) {
+  auto *context = dataType.getContext();
+  auto addrType =
+      IntegerType::get(context, std::max(1U, llvm::Log2_64_Ceil(depth)));
+  auto bitType = IntegerType::get(context, 1);
+
+  size_t numArgs = 0, numResults = 0;
+  auto addPort = [&](const Twine &name, Type type, bool isOutput) {
+    rtl::ModulePortInfo port;
+    port.name = StringAttr::get(name.str(), context);
+    port.type = type;
+    port.direction =
+        isOutput ? rtl::PortDirection::OUTPUT : rtl::PortDirection::INPUT;
+    port.argNum = isOutput ? numResults++ : numArgs++;
+    ports.push_back(port);
+  };
+
+  unsigned numReads = 0, numWrites = 0;
+  for (auto memPort : memPorts) {
+    bool isRead = memPort.second == MemOp::PortKind::Read;
+    std::string prefix = isRead ? "R" + llvm::utostr(numReads++)
+                                : "W" + llvm::utostr(numWrites++);
+    addPort(prefix + "_addr", addrType, false);
+    addPort(prefix + "_en", bitType, false);
+    addPort(prefix + "_clk", bitType, false);
+    addPort(prefix + "_data", dataType, isRead);
+    if (!isRead)
+      addPort(prefix + "_mask", bitType, false);
+  }
+}
+
+/// Replace the memories that are big enough by instances of external SRAM
+/// macros.  Each such memory is tagged with the rtl.externmodule its ports are
+/// wired to, which the body lowering turns into an rtl.instance.  Memories
+/// with the same configuration share a macro, and the configurations are
+/// written to the conf file in the format of the Scala FIRRTL compiler's
+/// ReplSeqMem pass.
+LogicalResult FIRRTLModuleLowering::extractMemMacros(CircuitOp circuit,
+                                                     Block *topLevelModule) {
+  if (memMacroThreshold == 0)
+    return success();
+
+  OpBuilder builder(topLevelModule->getTerminator());
+  SymbolTable circuitSymbols(circuit);
+  llvm::StringMap<FlatSymbolRefAttr> macrosByConf;
+  llvm::StringSet<> macroNames;
+  std::string confFile;
+
+  for (auto module : circuit.getBody()->getOps<FModuleOp>()) {
+    module.walk([&](MemOp mem) {
+      // Only ground type memories with the latencies of a synchronous SRAM
+      // and without read-write ports can be mapped to one.
+      auto dataType = mem.getDataTypeOrNull();
+      if (!dataType || !dataType.isa<IntType>() || mem.readLatency() != 1 ||
+          mem.writeLatency() != 1)
+        return;
+      int32_t width = dataType.getBitWidthOrSentinel();
+      uint64_t depth = mem.depth();
+      if (width <= 0 || depth * width < memMacroThreshold)
+        return;
+
+      SmallVector<std::pair<Identifier, MemOp::PortKind>, 4> memPorts;
+      mem.getPorts(memPorts);
+      std::string portList;
+      bool hasWrite = false;
+      for (auto memPort : memPorts) {
+        if (memPort.second == MemOp::PortKind::ReadWrite)
+          return;
+        if (!portList.empty())
+          portList += ',';
+        bool isWrite = memPort.second == MemOp::PortKind::Write;
+        portList += isWrite ? "mwrite" : "read";
+        hasWrite |= isWrite;
+      }
+
+      std::string conf = "depth " + llvm::utostr(depth) + " width " +
+                         llvm::utostr(width) + " ports " + portList;
+      if (hasWrite)
+        conf += " mask_gran " + llvm::utostr(width);
+
+      FlatSymbolRefAttr &macro = macrosByConf[conf];
+      if (!macro) {
+        // Name the macro after the first memory using it.
+        std::string baseName =
+            (mem.name().getValueOr("mem") + Twine("_ext")).str();
+        std::string name = baseName;
+        for (unsigned i = 0;
+             macroNames.count(name) || circuitSymbols.lookup(name); ++i)
+          name = baseName + "_" + llvm::utostr(i);
+        macroNames.insert(name);
+
+        SmallVector<rtl::ModulePortInfo, 8> ports;
+        getMemMacroPorts(memPorts, depth, builder.getIntegerType(width),
+                         ports);
+        builder.create<rtl::RTLExternModuleOp>(
+            mem.getLoc(), builder.getStringAttr(name), ports);
+        macro = builder.getSymbolRefAttr(name);
+        confFile += "name " + name + " " + conf + "\n";
+      }
+      mem->setAttr(getMemMacroAttrName(), macro);
+    });
+  }
+
+  if (memMacroConf.empty())
+    return success();
+
+  std::string errorMessage;
+  auto output = openOutputFile(memMacroConf, &errorMessage);
+  if (!output)
+    return circuit.emitError(errorMessage);
+  output->os() << confFile;
+  output->keep();
+  return success();
+}
+
 LogicalResult
 FIRRTLModuleLowering::lowerPorts(ArrayRef<ModulePortInfo> firrtlPorts,
                                  SmallVectorImpl<rtl::ModulePortInfo> &ports,
@@ -370,6 +571,43 @@ collectOperationTreeBelowMarker(Value value, Operation *marker,
   return false;
 }
 
+DriverIndex::DriverIndex(Block *body) {
+  body->walk([&](Operation *op) {
+    for (auto &operand : op->getOpOperands()) {
+      // Only the ports, instance ports and wires can be forwarded.
+      Value value = operand.get();
+      if (!value.isa<BlockArgument>() && !value.getDefiningOp<WireOp>() &&
+          !value.getDefiningOp<SubfieldOp>())
+        continue;
+
+      auto &entry = entries[value];
+      auto connect = dyn_cast<ConnectOp>(op);
+      if (connect && operand.getOperandNumber() == 0)
+        entry.connects.push_back(connect);
+      else if (isa<AsNonPassivePrimOp, SubfieldOp, SubindexOp, SubaccessOp,
+                   PartialConnectOp>(op))
+        entry.isAliased = true;
+      else
+        entry.isRead = true;
+    }
+  });
+}
+
+ArrayRef<ConnectOp> DriverIndex::getOnlyDrivers(Value value) const {
+  auto it = entries.find(value);
+  if (it == entries.end() || it->second.isRead || it->second.isAliased)
+    return {};
+  return it->second.connects;
+}
+
+ConnectOp DriverIndex::getSingleDriver(Value value) const {
+  auto it = entries.find(value);
+  if (it == entries.end() || it->second.isAliased ||
+      it->second.connects.size() != 1)
+    return {};
+  return it->second.connects.front();
+}
+
 /// Given a value of flip type, check to see if all of the uses of it are
 /// connects.  If so, remove the connects and return the value being connected
 /// to it, converted to an RTL type.  If this isn't a situation we can handle,
@@ -379,12 +617,16 @@ collectOperationTreeBelowMarker(Value value, Operation *marker,
 /// firrtl.invalid is used.  The 'mergePoint' location is where a 'rtl.merge'
 /// operation should be inserted if needed.
 static Value tryEliminatingConnectsToValue(Value flipValue,
-                                           Operation *insertPoint) {
+                                           Operation *insertPoint,
+                                           const DriverIndex &drivers) {
   SmallVector<ConnectOp, 2> connects;
-  for (auto *use : flipValue.getUsers()) {
-    // We only know about 'connect' uses, where this is the destination.
-    auto connect = dyn_cast<ConnectOp>(use);
-    if (!connect || connect.src() == flipValue)
+  auto destTy = flipValue.getType().cast<FIRRTLType>().getPassiveType();
+  // Take the connects in reverse IR order, the order of the use list of a
+  // freshly built body, such that multiple drivers are merged as before.
+  for (auto connect : llvm::reverse(drivers.getOnlyDrivers(flipValue))) {
+    // Vectors can't be padded, leave element width mismatches to the wire.
+    auto srcTy = connect.src().getType().cast<FIRRTLType>().getPassiveType();
+    if (destTy.isa<FVectorType>() && srcTy != destTy)
       return {};
 
     connects.push_back(connect);
@@ -454,7 +696,6 @@ static Value tryEliminatingConnectsToValue(Value flipValue,
 
     // We know it must be the destination operand due to the types, but the
     // source may not match the destination width.
-    auto destTy = flipValue.getType().cast<FIRRTLType>().getPassiveType();
     if (destTy != connectSrc.getType()) {
       // The only type mismatch we can have is due to integer width differences.
       auto destWidth = destTy.getBitWidthOrSentinel();
@@ -476,18 +717,68 @@ static Value tryEliminatingConnectsToValue(Value flipValue,
   return builder.createOrFold<rtl::MergeOp>(results);
 }
 
+/// If the wire is an unnamed temporary of integer type, driven by a single
+/// connect in its block, replace it with the value connected to it and remove
+/// it along with the connect.  Return true if the wire was removed.
+static bool tryForwardingWire(WireOp wire, const DriverIndex &drivers) {
+  // Named wires are kept in the output.
+  if (wire.name().hasValue() && !wire.name().getValue().empty())
+    return false;
+
+  auto destTy = wire.getType().dyn_cast<IntType>();
+  if (!destTy || destTy.getBitWidthOrSentinel() <= 0)
+    return false;
+
+  auto connect = drivers.getSingleDriver(wire);
+  if (!connect || connect->getBlock() != wire->getBlock())
+    return false;
+
+  // The wire may be read above the connect, move the computation of the value
+  // above the wire like for the ports of an instance.
+  SmallVector<Operation *, 8> opsToMove;
+  SmallPtrSet<Operation *, 8> visited;
+  if (collectOperationTreeBelowMarker(connect.src(), wire, opsToMove, visited))
+    return false;
+  for (auto *op : opsToMove)
+    op->moveBefore(wire);
+
+  ImplicitLocOpBuilder builder(wire.getLoc(), wire);
+  Value value = connect.src();
+  if (!value.getType().cast<FIRRTLType>().isPassive())
+    value = builder.createOrFold<AsPassivePrimOp>(value);
+  if (value.getType() != destTy)
+    value = builder.createOrFold<PadPrimOp>(destTy, value,
+                                           destTy.getBitWidthOrSentinel());
+
+  connect.erase();
+  wire.replaceAllUsesWith(value);
+  wire.erase();
+  return true;
+}
+
 /// Now that we have the operations for the rtl.module's corresponding to the
 /// firrtl.module's, we can go through and move the bodies over, updating the
 /// ports and instances.
 void FIRRTLModuleLowering::lowerModuleBody(
-    FModuleOp oldModule,
-    DenseMap<Operation *, Operation *> &oldToNewModuleMap) {
+    FModuleOp oldModule, const InstanceGraph &instanceGraph,
+    const DenseMap<Operation *, Operation *> &oldToNewModuleMap) {
   auto newModule =
-      dyn_cast_or_null<rtl::RTLModuleOp>(oldToNewModuleMap[oldModule]);
+      dyn_cast_or_null<rtl::RTLModuleOp>(oldToNewModuleMap.lookup(oldModule));
   // Don't touch modules if we failed to lower ports.
   if (!newModule)
     return;
 
+  // Find the drivers of the ports, instance ports and wires once, ahead of the
+  // changes below.
+  DriverIndex drivers(oldModule.getBodyBlock());
+
+  // Forward the temporary wires to the value they are connected to.  This
+  // moves operations around, so collect the wires first.
+  SmallVector<WireOp, 16> wires;
+  oldModule.getBodyBlock()->walk([&](WireOp wire) { wires.push_back(wire); });
+  for (auto wire : wires)
+    tryForwardingWire(wire, drivers);
+
   ImplicitLocOpBuilder bodyBuilder(oldModule.getLoc(), newModule.body());
 
   // Use a placeholder instruction be a cursor that indicates where we want to
@@ -543,7 +834,7 @@ void FIRRTLModuleLowering::lowerModuleBody(
       continue;
     }
 
-    if (auto value = tryEliminatingConnectsToValue(oldArg, outputOp)) {
+    if (auto value = tryEliminatingConnectsToValue(oldArg, outputOp, drivers)) {
       // If we were able to find the value being connected to the output,
       // directly use it!
       outputs.push_back(value);
@@ -595,8 +886,7 @@ void FIRRTLModuleLowering::lowerModuleBody(
 
     // We found an instance - lower it.  On successful return there will be
     // zero uses and we can remove the operation.
-    lowerInstance(instance, oldModule->getParentOfType<CircuitOp>(),
-                  oldToNewModuleMap);
+    lowerInstance(instance, instanceGraph, oldToNewModuleMap, drivers);
     opIt = Block::iterator(cursor);
   }
 
@@ -612,11 +902,12 @@ void FIRRTLModuleLowering::lowerModuleBody(
 /// On success, this returns with the firrtl.instance op having no users,
 /// letting the caller erase it.
 void FIRRTLModuleLowering::lowerInstance(
-    InstanceOp oldInstance, CircuitOp circuitOp,
-    DenseMap<Operation *, Operation *> &oldToNewModuleMap) {
+    InstanceOp oldInstance, const InstanceGraph &instanceGraph,
+    const DenseMap<Operation *, Operation *> &oldToNewModuleMap,
+    const DriverIndex &drivers) {
 
-  auto *oldModule = circuitOp.lookupSymbol(oldInstance.moduleName());
-  auto newModule = oldToNewModuleMap[oldModule];
+  auto *oldModule = instanceGraph.getReferencedModule(oldInstance);
+  auto newModule = oldToNewModuleMap.lookup(oldModule);
   if (!newModule) {
     oldInstance->emitOpError("could not find module referenced by instance");
     return;
@@ -684,7 +975,8 @@ void FIRRTLModuleLowering::lowerInstance(
     auto &subfields = subfieldsByPortIndex[portIndex];
     if (subfields.size() == 1) {
       auto subfield = cast<SubfieldOp>(subfields[0]);
-      if (auto value = tryEliminatingConnectsToValue(subfield, oldInstance)) {
+      if (auto value =
+              tryEliminatingConnectsToValue(subfield, oldInstance, drivers)) {
         // If we got a value connecting to the input port, then we can pass it
         // into the RTL instance without a temporary wire.
         operands.push_back(value);
@@ -771,10 +1063,16 @@ struct FIRRTLLowering : public LowerFIRRTLToRTLBase<FIRRTLLowering>,
   Value getPossiblyInoutLoweredValue(Value value);
   Value getLoweredValue(Value value);
   Value getLoweredAndExtendedValue(Value value, Type destType);
+  Value getArrayInOut(Value array);
   LogicalResult setLowering(Value orig, Value result);
   template <typename ResultOpType, typename... CtorArgTypes>
   LogicalResult setLoweringTo(Operation *orig, CtorArgTypes... args);
   void emitRandomizePrologIfNeeded();
+  void emitRegisterInit(Value reg, Value resetSignal, StringRef value);
+  void emitMemoryInit(ArrayRef<Value> regs, uint64_t depth, StringRef value);
+  void initializeRegister(Value reg, Value resetSignal);
+  void initializeMemory(ArrayRef<Value> regs, uint64_t depth);
+  void emitModuleInitialization();
 
   using FIRRTLVisitor<FIRRTLLowering, LogicalResult>::visitExpr;
   using FIRRTLVisitor<FIRRTLLowering, LogicalResult>::visitDecl;
@@ -785,6 +1083,9 @@ struct FIRRTLLowering : public LowerFIRRTLToRTLBase<FIRRTLLowering>,
   UnloweredOpResult handleUnloweredOp(Operation *op);
   LogicalResult visitExpr(ConstantOp op);
   LogicalResult visitExpr(SubfieldOp op);
+  LogicalResult visitExpr(SubindexOp op);
+  LogicalResult visitExpr(SubaccessOp op);
+  LogicalResult lowerArrayIndex(Operation *op, Value input, Value index);
   LogicalResult visitUnhandledOp(Operation *op) { return failure(); }
   LogicalResult visitInvalidOp(Operation *op) { return failure(); }
 
@@ -794,6 +1095,10 @@ struct FIRRTLLowering : public LowerFIRRTLToRTLBase<FIRRTLLowering>,
   LogicalResult visitDecl(RegOp op);
   LogicalResult visitDecl(RegResetOp op);
   LogicalResult visitDecl(MemOp op);
+  LogicalResult lowerMemToMacro(MemOp op, FlatSymbolRefAttr macro,
+                                StringRef memName);
+  Value emitDelay(Value clock, Value enable, Value value, const Twine &name,
+                  unsigned stages);
 
   // Unary Ops.
   LogicalResult lowerNoopCast(Operation *op);
@@ -806,6 +1111,7 @@ struct FIRRTLLowering : public LowerFIRRTLToRTLBase<FIRRTLLowering>,
 
   LogicalResult visitExpr(StdIntCastOp op);
   LogicalResult visitExpr(AnalogInOutCastOp op);
+  LogicalResult visitExpr(VectorArrayCastOp op);
   LogicalResult visitExpr(CvtPrimOp op);
   LogicalResult visitExpr(NotPrimOp op);
   LogicalResult visitExpr(NegPrimOp op);
@@ -906,9 +1212,23 @@ private:
   /// key should have a FIRRTL type, the result will have an RTL dialect type.
   DenseMap<Value, Value> valueMapping;
 
+  /// Lowered arrays which aren't inout, e.g. input ports, are copied into a
+  /// wire the first time they are indexed.  This maps them to that wire.
+  DenseMap<Value, Value> arrayWires;
+
   /// This is true if we've emitted `INIT_RANDOM_PROLOG_ into an initial block
   /// in this module already.
   bool randomizePrologEmitted;
+
+  /// The parsed `init-mode` option.
+  enum InitKind { RandomInit, SeededInit, ZeroInit };
+  InitKind initKind;
+
+  /// Registers, along with their reset signal if any, and memories which are
+  /// initialized by the single initial block of the module rather than by
+  /// their own.
+  SmallVector<std::pair<Value, Value>, 8> moduleInitRegs;
+  SmallVector<std::pair<SmallVector<Value, 1>, uint64_t>, 2> moduleInitMems;
 };
 } // end anonymous namespace
 
@@ -926,6 +1246,17 @@ void FIRRTLLowering::runOnOperation() {
 
   randomizePrologEmitted = false;
 
+  if (initMode == "random")
+    initKind = RandomInit;
+  else if (initMode == "seeded")
+    initKind = SeededInit;
+  else if (initMode == "zero")
+    initKind = ZeroInit;
+  else {
+    getOperation().emitError("unknown init-mode '") << initMode << "'";
+    return signalPassFailure();
+  }
+
   SmallVector<Operation *, 16> opsToRemove;
 
   // Iterate through each operation in the module body, attempting to lower
@@ -951,6 +1282,9 @@ void FIRRTLLowering::runOnOperation() {
       }
     }
   }
+  builder->setInsertionPoint(body->getTerminator());
+  builder->setLoc(getOperation().getLoc());
+  emitModuleInitialization();
   builder = nullptr;
 
   // Now that all of the operations that can be lowered are, remove the original
@@ -965,6 +1299,7 @@ void FIRRTLLowering::runOnOperation() {
 
   // Clear out the value mapping for next time, so we don't have dangling keys.
   valueMapping.clear();
+  arrayWires.clear();
 }
 
 //===----------------------------------------------------------------------===//
@@ -1025,6 +1360,16 @@ Value FIRRTLLowering::getLoweredAndExtendedValue(Value value, Type destType) {
   if (destWidth == -1)
     return {};
 
+  // Vectors are connected as a whole, their elements aren't extended.
+  if (destType.isa<FVectorType>()) {
+    auto result = getLoweredValue(value);
+    if (result && result.getType() != lowerType(destType)) {
+      builder->emitError("vector element widths should match");
+      return {};
+    }
+    return result;
+  }
+
   auto result = getLoweredValue(value);
   if (!result) {
     // If this was a zero bit operand being extended, then produce a zero of the
@@ -1060,6 +1405,20 @@ Value FIRRTLLowering::getLoweredAndExtendedValue(Value value, Type destType) {
   return builder->createOrFold<rtl::ConcatOp>(zero, result);
 }
 
+/// Return an inout value holding the specified lowered array, so that it can be
+/// indexed.  Arrays that don't live in a wire or register are copied into one.
+Value FIRRTLLowering::getArrayInOut(Value array) {
+  if (array.getType().isa<rtl::InOutType>())
+    return array;
+
+  auto &wire = arrayWires[array];
+  if (!wire) {
+    wire = builder->create<rtl::WireOp>(array.getType());
+    builder->create<rtl::ConnectOp>(wire, array);
+  }
+  return wire;
+}
+
 /// Set the lowered value of 'orig' to 'result', remembering this in a map.
 /// This always returns success() to make it more convenient in lowering code.
 ///
@@ -1159,6 +1518,41 @@ LogicalResult FIRRTLLowering::visitExpr(SubfieldOp op) {
   return failure();
 }
 
+/// Lower an element access of a vector to an index of the array it was lowered
+/// to.  The result is an inout that is implicitly read by its users, and can
+/// be the destination of a connect.
+LogicalResult FIRRTLLowering::lowerArrayIndex(Operation *op, Value input,
+                                              Value index) {
+  auto array = getPossiblyInoutLoweredValue(input);
+  if (!array)
+    return failure();
+
+  return setLoweringTo<rtl::ArrayIndexOp>(op, getArrayInOut(array), index);
+}
+
+LogicalResult FIRRTLLowering::visitExpr(SubindexOp op) {
+  auto vectorType = op.input()
+                        .getType()
+                        .cast<FIRRTLType>()
+                        .getPassiveType()
+                        .cast<FVectorType>();
+  auto indexWidth =
+      std::max(1U, llvm::Log2_64_Ceil(vectorType.getNumElements()));
+  auto index = builder->create<rtl::ConstantOp>(APInt(indexWidth, op.index()));
+  return lowerArrayIndex(op, op.input(), index);
+}
+
+LogicalResult FIRRTLLowering::visitExpr(SubaccessOp op) {
+  auto index = getLoweredValue(op.index());
+  if (!index) {
+    // A zero bit index can only select the first element.
+    if (!isZeroBitFIRRTLType(op.index().getType()))
+      return failure();
+    index = builder->create<rtl::ConstantOp>(APInt(1, 0));
+  }
+  return lowerArrayIndex(op, op.input(), index);
+}
+
 //===----------------------------------------------------------------------===//
 // Declarations
 //===----------------------------------------------------------------------===//
@@ -1208,30 +1602,180 @@ void FIRRTLLowering::emitRandomizePrologIfNeeded() {
   randomizePrologEmitted = true;
 }
 
-LogicalResult FIRRTLLowering::visitDecl(RegOp op) {
-  auto resultType = lowerType(op.result().getType());
-  if (!resultType)
-    return failure();
-  if (resultType.isInteger(0))
-    return setLowering(op, Value());
+/// Assign the textual `value` to a register.  If it has a reset, this only
+/// happens if the reset isn't asserted at start.
+void FIRRTLLowering::emitRegisterInit(Value reg, Value resetSignal,
+                                      StringRef value) {
+  auto emitAssign = [&]() {
+    auto type = rtl::getInOutElementType(reg.getType());
+    auto initVal = builder->create<sv::TextualValueOp>(type, value);
+    builder->create<sv::BPAssignOp>(reg, initVal);
+  };
+  if (!resetSignal)
+    return emitAssign();
+
+  auto one = builder->create<rtl::ConstantOp>(APInt(1, 1));
+  auto notResetValue = builder->create<rtl::XorOp>(resetSignal, one);
+  builder->create<sv::IfOp>(notResetValue, emitAssign);
+}
+
+/// Assign the textual `value` to every element of the registers of a memory
+/// with the specified depth.
+void FIRRTLLowering::emitMemoryInit(ArrayRef<Value> regs, uint64_t depth,
+                                    StringRef value) {
+  if (depth == 1) { // Don't emit a for loop for one element.
+    for (Value reg : regs) {
+      auto type = rtl::getInOutElementType(reg.getType());
+      type = rtl::getAnyRTLArrayElementType(type);
+      auto initVal = builder->create<sv::TextualValueOp>(type, value);
+      auto zero = builder->create<rtl::ConstantOp>(APInt(1, 0));
+      auto subscript = builder->create<rtl::ArrayIndexOp>(reg, zero);
+      builder->create<sv::BPAssignOp>(subscript, initVal);
+    }
+    return;
+  }
+  if (regs.empty())
+    return;
 
-  auto regResult = builder->create<sv::RegOp>(resultType, op.nameAttr());
-  setLowering(op, regResult);
+  assert(depth < (1ULL << 31) && "FIXME: Our initialization logic uses "
+                                 "'integer' which doesn't support "
+                                 "mems greater than 2^32");
+
+  std::string action = "integer {{0}}_initvar;\n";
+  action += "for ({{0}}_initvar = 0; {{0}}_initvar < " + llvm::utostr(depth) +
+            "; {{0}}_initvar = {{0}}_initvar+1)";
+  if (regs.size() != 1)
+    action += " begin";
+
+  for (size_t i = 0, e = regs.size(); i != e; ++i)
+    action += "\n  {{" + llvm::utostr(i) + "}}[{{0}}_initvar] = " +
+              value.str() + ";";
+
+  if (regs.size() != 1)
+    action += "\nend";
+  builder->create<sv::VerbatimOp>(action, regs);
+}
+
+/// Emit the simulation initializer of a register, or defer it to the initial
+/// block of the module if the init mode asks for one.
+void FIRRTLLowering::initializeRegister(Value reg, Value resetSignal) {
+  if (initKind != RandomInit) {
+    moduleInitRegs.push_back({reg, resetSignal});
+    return;
+  }
 
-  // Emit the initializer expression for simulation that fills it with random
-  // value.
   builder->create<sv::IfDefOp>("!SYNTHESIS", [&]() {
     builder->create<sv::InitialOp>([&]() {
       emitRandomizePrologIfNeeded();
 
+      // When RANDOMIZE_REG_INIT is enabled, we assign a random value to the reg
+      // if the reset line is low at start.
       builder->create<sv::IfDefOp>("RANDOMIZE_REG_INIT", [&]() {
-        auto type = regResult.getType().getElementType();
-        auto randomVal = builder->create<sv::TextualValueOp>(type, "`RANDOM");
-        builder->create<sv::BPAssignOp>(regResult, randomVal);
+        emitRegisterInit(reg, resetSignal, "`RANDOM");
+      });
+    });
+  });
+}
+
+/// Emit the simulation initializer of the registers of a memory, or defer it
+/// to the initial block of the module if the init mode asks for one or its
+/// contents are loaded from a file.
+void FIRRTLLowering::initializeMemory(ArrayRef<Value> regs, uint64_t depth) {
+  if (initKind != RandomInit || memInitFiles) {
+    if (!regs.empty())
+      moduleInitMems.push_back(
+          {SmallVector<Value, 1>(regs.begin(), regs.end()), depth});
+    return;
+  }
+
+  builder->create<sv::IfDefOp>("!SYNTHESIS", [&]() {
+    builder->create<sv::InitialOp>([&]() {
+      emitRandomizePrologIfNeeded();
+
+      builder->create<sv::IfDefOp>("RANDOMIZE_MEM_INIT", [&]() {
+        emitMemoryInit(regs, depth, "`RANDOM");
       });
     });
   });
+}
+
+/// Emit the single initial block of the module which initializes all of the
+/// registers and memories that were deferred to it.  The "seeded" mode draws
+/// their values from a `$random` stream seeded by the module name, and by
+/// `INIT_SEED` if it is defined, so every module has its own reproducible
+/// sequence.
+void FIRRTLLowering::emitModuleInitialization() {
+  if (moduleInitRegs.empty() && moduleInitMems.empty())
+    return;
+
+  StringRef value = initKind == ZeroInit ? "'0" : "$random(_init_seed)";
+  builder->create<sv::IfDefOp>("!SYNTHESIS", [&]() {
+    builder->create<sv::InitialOp>([&]() {
+      if (initKind == SeededInit) {
+        builder->create<sv::VerbatimOp>("integer _init_seed;");
+        emitRandomizePrologIfNeeded();
+
+        auto moduleName = getOperation().getName();
+        auto seed = "32'd" + llvm::utostr(llvm::xxHash64(moduleName) >> 32);
+        builder->create<sv::IfDefOp>(
+            "INIT_SEED",
+            [&]() {
+              builder->create<sv::VerbatimOp>("_init_seed = `INIT_SEED ^ " +
+                                              seed + ";");
+            },
+            [&]() {
+              builder->create<sv::VerbatimOp>("_init_seed = " + seed + ";");
+            });
+      }
+
+      // Random values are only assigned when asked for, like in the "random"
+      // mode, zeroing always happens.
+      auto emitGuarded = [&](StringRef cond, std::function<void()> fn) {
+        if (initKind == SeededInit)
+          builder->create<sv::IfDefOp>(cond, fn);
+        else
+          fn();
+      };
+
+      if (!moduleInitRegs.empty())
+        emitGuarded("RANDOMIZE_REG_INIT", [&]() {
+          for (auto &reg : moduleInitRegs)
+            emitRegisterInit(reg.first, reg.second, value);
+        });
+
+      for (auto &mem : moduleInitMems) {
+        if (memInitFiles) {
+          for (Value reg : mem.first) {
+            auto name = cast<sv::RegOp>(reg.getDefiningOp()).name();
+            builder->create<sv::VerbatimOp>(
+                ("$readmemh(\"" + name.getValueOr("") + ".hex\", {{0}});")
+                    .str(),
+                reg);
+          }
+          continue;
+        }
+        emitGuarded("RANDOMIZE_MEM_INIT",
+                    [&]() { emitMemoryInit(mem.first, mem.second, value); });
+      }
+    });
+  });
 
+  moduleInitRegs.clear();
+  moduleInitMems.clear();
+}
+
+LogicalResult FIRRTLLowering::visitDecl(RegOp op) {
+  auto resultType = lowerType(op.result().getType());
+  if (!resultType)
+    return failure();
+  if (resultType.isInteger(0))
+    return setLowering(op, Value());
+
+  auto regResult = builder->create<sv::RegOp>(resultType, op.nameAttr());
+  setLowering(op, regResult);
+
+  // Emit the initializer expression for simulation.
+  initializeRegister(regResult, Value());
   return success();
 }
 
@@ -1267,139 +1811,137 @@ LogicalResult FIRRTLLowering::visitDecl(RegResetOp op) {
     builder->create<sv::AlwaysOp>(EventControl::AtPosEdge, clockVal, resetFn);
   }
 
-  // Emit the initializer expression for simulation that fills it with random
-  // value.
-  builder->create<sv::IfDefOp>("!SYNTHESIS", [&]() {
-    builder->create<sv::InitialOp>([&]() {
-      emitRandomizePrologIfNeeded();
+  // Emit the initializer expression for simulation.
+  initializeRegister(regResult, resetSignal);
+  return success();
+}
 
-      // When RANDOMIZE_REG_INIT is enabled, we assign a random value to the reg
-      // if the reset line is low at start.
-      builder->create<sv::IfDefOp>("RANDOMIZE_REG_INIT", [&]() {
-        auto one = builder->create<rtl::ConstantOp>(APInt(1, 1));
-        auto notResetValue = builder->create<rtl::XorOp>(resetSignal, one);
-        builder->create<sv::IfOp>(notResetValue, [&]() {
-          auto type = regResult.getType().getElementType();
-          auto randomVal = builder->create<sv::TextualValueOp>(type, "`RANDOM");
-          builder->create<sv::BPAssignOp>(regResult, randomVal);
-        });
-      });
-    });
+/// Delay `value` by `stages` cycles of `clock` through a chain of registers
+/// named after `name`.  If `enable` is set, the first register only loads while
+/// it is high.
+Value FIRRTLLowering::emitDelay(Value clock, Value enable, Value value,
+                                const Twine &name, unsigned stages) {
+  if (stages == 0)
+    return value;
+
+  SmallVector<Value, 4> regs;
+  for (unsigned i = 0; i != stages; ++i)
+    regs.push_back(builder->create<sv::RegOp>(
+        value.getType(),
+        builder->getStringAttr(name + "_pipe_" + Twine(i))));
+
+  builder->create<sv::AlwaysOp>(EventControl::AtPosEdge, clock, [&]() {
+    if (enable) {
+      builder->create<sv::IfOp>(
+          enable, [&]() { builder->create<sv::PAssignOp>(regs[0], value); });
+    } else {
+      builder->create<sv::PAssignOp>(regs[0], value);
+    }
+    for (unsigned i = 1; i != stages; ++i) {
+      auto prev = builder->create<rtl::ReadInOutOp>(regs[i - 1]);
+      builder->create<sv::PAssignOp>(regs[i], prev);
+    }
   });
+  return builder->create<rtl::ReadInOutOp>(regs.back());
+}
+
+/// Lower a memory to an instance of the external macro `macro`, which was
+/// generated for it when its module was lowered.  Every port field gets a wire
+/// as in the register lowering, and the wires are connected to the ports of the
+/// macro.
+LogicalResult FIRRTLLowering::lowerMemToMacro(MemOp op, FlatSymbolRefAttr macro,
+                                              StringRef memName) {
+  SmallVector<std::pair<Identifier, MemOp::PortKind>, 4> memPorts;
+  op.getPorts(memPorts);
+
+  // Create the wires for the fields of all ports, collecting the inputs of the
+  // macro and the wires its outputs drive in the order of its ports.
+  auto memType = op.getType().cast<BundleType>();
+  llvm::StringMap<Value> portWires;
+  SmallVector<Value, 16> operands;
+  SmallVector<Type, 4> resultTypes;
+  SmallVector<Value, 4> resultWires;
+  for (auto memPort : memPorts) {
+    auto portType = memType.getElementType(memPort.first.strref())
+                        .getPassiveType()
+                        .cast<BundleType>();
+    auto getWire = [&](StringRef fieldName) -> Value {
+      auto fieldType = lowerType(portType.getElementType(fieldName));
+      auto name =
+          (Twine(memName) + "_" + memPort.first.strref() + "_" + fieldName)
+              .str();
+      auto wire = builder->create<rtl::WireOp>(fieldType, name);
+      portWires[(Twine(memPort.first.strref()) + "." + fieldName).str()] = wire;
+      return wire;
+    };
 
-  return success();
-}
+    for (StringRef fieldName : {"addr", "en", "clk"})
+      operands.push_back(builder->create<rtl::ReadInOutOp>(getWire(fieldName)));
 
-namespace {
-/// This represents a flattened bundle field element.
-struct FlatBundleFieldEntry {
-  /// This is the underlying ground type of the field.
-  Type type;
-  /// This is a field name with any suffixes to make it unique.
-  std::string name;
-};
-} // end anonymous namespace.
-
-/// Convert a nested bundle of fields into a flat list of fields.  This is used
-/// when working with mems to flatten them.  Return true if we fail to lower
-/// any of the element types, or false if successul.
-static bool flattenBundleTypes(Type type, StringRef nameSoFar,
-                               SmallVectorImpl<FlatBundleFieldEntry> &results) {
-  // Ignore flips.
-  if (auto flip = type.dyn_cast<FlipType>())
-    return flattenBundleTypes(flip.getElementType(), nameSoFar, results);
-
-  // In the base case we record this field.
-  auto bundle = type.dyn_cast<BundleType>();
-  if (!bundle) {
-    auto rtlType = lowerType(type);
-    if (rtlType && !rtlType.isInteger(0))
-      results.push_back({rtlType, nameSoFar.str()});
-    return rtlType == Type();
-  }
-
-  SmallString<16> tmpName(nameSoFar);
-
-  // Otherwise, we have a bundle type.  Break it down.
-  for (auto &elt : bundle.getElements()) {
-    // Construct the suffix to pass down.
-    tmpName.resize(nameSoFar.size());
-    tmpName.push_back('_');
-    tmpName.append(elt.name.strref());
-    // Recursively process subelements.
-    if (flattenBundleTypes(elt.type, tmpName, results))
-      return true;
+    auto data = getWire("data");
+    if (memPort.second == MemOp::PortKind::Read) {
+      resultTypes.push_back(rtl::getInOutElementType(data.getType()));
+      resultWires.push_back(data);
+    } else {
+      operands.push_back(builder->create<rtl::ReadInOutOp>(data));
+      operands.push_back(builder->create<rtl::ReadInOutOp>(getWire("mask")));
+    }
   }
-  return false;
-}
 
-LogicalResult FIRRTLLowering::visitDecl(MemOp op) {
-  if (op.readLatency() != 0 || op.writeLatency() != 1) {
-    // FIXME: This should be an error.
-    op.emitWarning("FIXME: need to support mem read/write latency correctly");
+  auto inst = builder->create<rtl::InstanceOp>(
+      resultTypes, builder->getStringAttr(memName), macro, operands,
+      DictionaryAttr());
+  for (auto result : llvm::zip(resultWires, inst.getResults()))
+    builder->create<rtl::ConnectOp>(std::get<0>(result), std::get<1>(result));
+
+  // Rewrite the subfields of the ports to use the wires, dropping the
+  // references to the memory as in the register lowering.
+  while (!op->use_empty()) {
+    auto port = cast<SubfieldOp>(*op->user_begin());
+    port->dropAllReferences();
+    while (!port->use_empty()) {
+      auto portField = cast<SubfieldOp>(*port->user_begin());
+      portField->dropAllReferences();
+      auto key = (Twine(port.fieldname()) + "." + portField.fieldname()).str();
+      setLowering(portField, portWires.lookup(key));
+    }
   }
+  return success();
+}
 
+LogicalResult FIRRTLLowering::visitDecl(MemOp op) {
   StringRef memName = "mem";
   if (op.name().hasValue())
     memName = op.name().getValue();
 
-  // Aggregate mems may declare multiple reg's.  We need to declare and random
-  // initialize them all.
-  SmallVector<FlatBundleFieldEntry, 8> fieldTypes;
-  if (auto dataType = op.getDataTypeOrNull()) {
-    if (flattenBundleTypes(dataType, memName, fieldTypes))
-      return op.emitError("could not lower mem element type");
-  }
+  if (auto macro = op->getAttrOfType<FlatSymbolRefAttr>(getMemMacroAttrName()))
+    return lowerMemToMacro(op, macro, memName);
 
   uint64_t depth = op.depth();
 
-  // Add one reg declaration for each field of the mem.
+  // Aggregate mems may declare multiple reg's.  We need to declare and random
+  // initialize them all.  Add one reg declaration for each non-zero width
+  // field of the mem, ignoring flips.
   SmallVector<Value> regs;
-  for (const auto &field : fieldTypes) {
-    auto resultType = rtl::UnpackedArrayType::get(field.type, depth);
-    auto name = builder->getStringAttr(field.name);
-    regs.push_back(builder->create<sv::RegOp>(resultType, name));
-  }
+  if (auto dataType = op.getDataTypeOrNull()) {
+    SmallString<16> name(memName);
+    for (auto field : getFlatBundleFields(dataType)) {
+      auto rtlType = lowerType(field.type);
+      if (!rtlType)
+        return op.emitError("could not lower mem element type");
+      if (rtlType.isInteger(0))
+        continue;
 
-  // Emit the initializer expression for simulation that fills it with random
-  // value.
-  builder->create<sv::IfDefOp>("!SYNTHESIS", [&]() {
-    builder->create<sv::InitialOp>([&]() {
-      emitRandomizePrologIfNeeded();
+      name.resize(memName.size());
+      name += field.suffix;
+      auto resultType = rtl::UnpackedArrayType::get(rtlType, depth);
+      regs.push_back(builder->create<sv::RegOp>(resultType,
+                                                builder->getStringAttr(name)));
+    }
+  }
 
-      builder->create<sv::IfDefOp>("RANDOMIZE_MEM_INIT", [&]() {
-        if (depth == 1) { // Don't emit a for loop for one element.
-          for (Value reg : regs) {
-            auto type = rtl::getInOutElementType(reg.getType());
-            type = rtl::getAnyRTLArrayElementType(type);
-            auto randomVal =
-                builder->create<sv::TextualValueOp>(type, "`RANDOM");
-            auto zero = builder->create<rtl::ConstantOp>(APInt(1, 0));
-            auto subscript = builder->create<rtl::ArrayIndexOp>(reg, zero);
-            builder->create<sv::BPAssignOp>(subscript, randomVal);
-          }
-        } else if (!regs.empty()) {
-          assert(depth < (1ULL << 31) && "FIXME: Our initialization logic uses "
-                                         "'integer' which doesn't support "
-                                         "mems greater than 2^32");
-
-          std::string action = "integer {{0}}_initvar;\n";
-          action += "for ({{0}}_initvar = 0; {{0}}_initvar < " +
-                    llvm::utostr(depth) + "; {{0}}_initvar = {{0}}_initvar+1)";
-          if (regs.size() != 1)
-            action += " begin";
-
-          for (size_t i = 0, e = regs.size(); i != e; ++i)
-            action +=
-                "\n  {{" + llvm::utostr(i) + "}}[{{0}}_initvar] = `RANDOM;";
-
-          if (regs.size() != 1)
-            action += "\nend";
-          builder->create<sv::VerbatimOp>(action, regs);
-        }
-      });
-    });
-  });
+  // Emit the initializer expression for simulation.
+  initializeMemory(regs, depth);
 
   // Keep track of whether this mem is an even power of two or not.
   bool isPowerOfTwo = llvm::isPowerOf2_64(depth);
@@ -1467,16 +2009,28 @@ LogicalResult FIRRTLLowering::visitDecl(MemOp op) {
                      "write ports by previous passes");
       continue;
     case MemOp::PortKind::Read: {
+      // With a read latency, the address is registered on the clock of the
+      // port while it is enabled and pipelined for the remaining cycles, and
+      // the memory is read with the delayed address.
+      Value delayedAddr;
+      if (op.readLatency() != 0 && !regs.empty()) {
+        auto clock = getPortFieldValue("clk");
+        auto enable = getPortFieldValue("en");
+        auto addr = getPortFieldValue("addr");
+        delayedAddr =
+            emitDelay(clock, enable, addr,
+                      Twine(memName) + "_" + port.fieldname() + "_addr",
+                      op.readLatency());
+      }
+
       auto emitReads = [&](bool masked) {
         // TODO: not handling bundle elements correctly yet.
         if (regs.size() > 1)
           op.emitOpError("don't support bundle elements yet");
 
         // Emit an assign to the read port, using the address.
-        // TODO(firrtl-spec): It appears that the clock signal on the read port
-        // is ignored, why does it exist?
         for (auto reg : regs) {
-          auto addr = getPortFieldValue("addr");
+          auto addr = delayedAddr ? delayedAddr : getPortFieldValue("addr");
           Value value = builder->create<rtl::ArrayIndexOp>(reg, addr);
           value = builder->create<rtl::ReadInOutOp>(value);
 
@@ -1520,14 +2074,35 @@ LogicalResult FIRRTLLowering::visitDecl(MemOp op) {
       //     _M[_M_write_addr] <= _M_write_data;
       // end
       auto clock = getPortFieldValue("clk");
+
+      // A write latency of more than one cycle delays all the write signals by
+      // the extra cycles before they reach the memory.
+      Value delayedEnable, delayedMask, delayedData, delayedAddr;
+      unsigned stages = op.writeLatency() - 1;
+      if (stages != 0 && !regs.empty()) {
+        auto delay = [&](StringRef field) -> Value {
+          return emitDelay(clock, {}, getPortFieldValue(field),
+                           Twine(memName) + "_" + port.fieldname() + "_" +
+                               field,
+                           stages);
+        };
+        delayedEnable = delay("en");
+        delayedMask = delay("mask");
+        delayedData = delay("data");
+        delayedAddr = delay("addr");
+      }
+      auto getWriteValue = [&](Value delayed, StringRef field) -> Value {
+        return delayed ? delayed : getPortFieldValue(field);
+      };
+
       builder->create<sv::AlwaysOp>(EventControl::AtPosEdge, clock, [&]() {
-        auto enable = getPortFieldValue("en");
-        auto mask = getPortFieldValue("mask");
+        auto enable = getWriteValue(delayedEnable, "en");
+        auto mask = getWriteValue(delayedMask, "mask");
         auto cond = builder->create<rtl::AndOp>(enable, mask);
         builder->create<sv::IfOp>(cond, [&]() {
           // FIXME: This isn't right for multi-slot data mems.
-          auto data = getPortFieldValue("data");
-          auto addr = getPortFieldValue("addr");
+          auto data = getWriteValue(delayedData, "data");
+          auto addr = getWriteValue(delayedAddr, "addr");
 
           for (auto reg : regs) {
             auto slot = builder->create<rtl::ArrayIndexOp>(reg, addr);
@@ -1598,6 +2173,20 @@ LogicalResult FIRRTLLowering::visitExpr(AnalogInOutCastOp op) {
   return setLowering(op, result);
 }
 
+LogicalResult FIRRTLLowering::visitExpr(VectorArrayCastOp op) {
+  // RTL -> FIRRTL.
+  if (!op.getOperand().getType().isa<FIRRTLType>())
+    return setLowering(op, op.getOperand());
+
+  // FIRRTL -> RTL.
+  auto result = getLoweredValue(op.getOperand());
+  if (!result)
+    return failure();
+
+  op.replaceAllUsesWith(result);
+  return success();
+}
+
 LogicalResult FIRRTLLowering::visitExpr(CvtPrimOp op) {
   auto operand = getLoweredValue(op.getOperand());
   if (!operand) {
@@ -1839,8 +2428,9 @@ LogicalResult FIRRTLLowering::visitExpr(BitsPrimOp op) {
 }
 
 LogicalResult FIRRTLLowering::visitExpr(InvalidValuePrimOp op) {
+  // There is no constant of array type to lower invalid vectors to.
   auto resultTy = lowerType(op.getType());
-  if (!resultTy)
+  if (!resultTy || resultTy.isa<rtl::ArrayType>())
     return failure();
 
   // We lower invalid to 0.  TODO: the FIRRTL spec mentions something about
@@ -1967,9 +2557,17 @@ LogicalResult FIRRTLLowering::visitStmt(ConnectOp op) {
   if (!destVal.getType().isa<rtl::InOutType>())
     return op.emitError("destination isn't an inout type");
 
+  // Connects to an element of a vector are gated like the vector itself.
+  auto *destOp = dest.getDefiningOp();
+  bool hasDynamicIndex = false;
+  while (isa_and_nonnull<SubindexOp, SubaccessOp>(destOp)) {
+    hasDynamicIndex |= isa<SubaccessOp>(destOp);
+    destOp = destOp->getOperand(0).getDefiningOp();
+  }
+
   // If this is an assignment to a register, then the connect implicitly
   // happens under the clock that gates the register.
-  if (auto regOp = dyn_cast_or_null<RegOp>(dest.getDefiningOp())) {
+  if (auto regOp = dyn_cast_or_null<RegOp>(destOp)) {
     Value clockVal = getLoweredValue(regOp.clockVal());
     if (!clockVal)
       return failure();
@@ -1982,7 +2580,7 @@ LogicalResult FIRRTLLowering::visitStmt(ConnectOp op) {
 
   // If this is an assignment to a RegInit, then the connect implicitly
   // happens under the clock and reset that gate the register.
-  if (auto regResetOp = dyn_cast_or_null<RegResetOp>(dest.getDefiningOp())) {
+  if (auto regResetOp = dyn_cast_or_null<RegResetOp>(destOp)) {
     Value clockVal = getLoweredValue(regResetOp.clockVal());
     Value resetSignal = getLoweredValue(regResetOp.resetSignal());
     if (!clockVal || !resetSignal)
@@ -2009,6 +2607,12 @@ LogicalResult FIRRTLLowering::visitStmt(ConnectOp op) {
     return success();
   }
 
+  // A continuous assignment can't pick its destination element at runtime, so
+  // such vectors have to be scalarized before they get here.
+  if (hasDynamicIndex)
+    return op.emitError("cannot lower a connect to a dynamically indexed "
+                        "vector which isn't a register");
+
   builder->create<rtl::ConnectOp>(destVal, srcVal);
   return success();
 }
@@ -11,12 +11,16 @@
 //===----------------------------------------------------------------------===//
 
 #include "circt/Conversion/HandshakeToFIRRTL/HandshakeToFIRRTL.h"
+#include "circt/Dialect/ESI/ESIOps.h"
 #include "circt/Dialect/FIRRTL/FIRRTLOps.h"
 #include "circt/Dialect/FIRRTL/FIRRTLTypes.h"
 #include "circt/Dialect/Handshake/HandshakeOps.h"
 #include "circt/Dialect/Handshake/Visitor.h"
+#include "circt/Dialect/RTL/RTLOps.h"
 #include "mlir/Transforms/DialectConversion.h"
 #include "mlir/Transforms/Utils.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
 #include "llvm/ADT/TypeSwitch.h"
 #include "llvm/Support/MathExtras.h"
 
@@ -214,8 +218,57 @@ static Value createMuxTree(ArrayRef<Value> inputs, Value select,
   return lastLayer[0];
 }
 
+/// One-hot selections among more than this many inputs are built as an AND-OR
+/// reduction instead of a chain of muxes.
+static const size_t oneHotMuxChainLimit = 4;
+
+/// Construct a one-hot selection of the given inputs as an AND-OR reduction:
+/// every input is masked by its select bit, and the masked values are combined
+/// in a balanced tree of ORs. This has a logarithmic depth in the number of
+/// inputs.
+static Value createOneHotAndOr(ArrayRef<Value> inputs, Value select,
+                               Location insertLoc,
+                               ConversionPatternRewriter &rewriter) {
+  auto inputType = inputs[0].getType().cast<FIRRTLType>();
+  auto inputWidth = inputType.getBitWidthOrSentinel();
+  auto uintType = UIntType::get(rewriter.getContext(), inputWidth);
+  auto zeroValue =
+      createConstantOp(uintType, APInt(inputWidth, 0), insertLoc, rewriter);
+
+  // Mask each input by its select bit. ORs produce unsigned values, so signed
+  // inputs are reinterpreted as unsigned ones first.
+  SmallVector<Value, 8> layer;
+  for (size_t i = 0, e = inputs.size(); i != e; ++i) {
+    Value input = inputs[i];
+    if (input.getType() != uintType)
+      input = rewriter.create<AsUIntPrimOp>(insertLoc, uintType, input);
+
+    Value selectBit = rewriter.create<BitsPrimOp>(insertLoc, select, i, i);
+    layer.push_back(rewriter.create<MuxPrimOp>(insertLoc, uintType, selectBit,
+                                               input, zeroValue));
+  }
+
+  // Combine pairs of values until a single one is left.
+  while (layer.size() > 1) {
+    SmallVector<Value, 8> nextLayer;
+    for (size_t i = 0, e = layer.size(); i + 1 < e; i += 2)
+      nextLayer.push_back(rewriter.create<OrPrimOp>(insertLoc, uintType,
+                                                    layer[i], layer[i + 1]));
+    if (layer.size() % 2)
+      nextLayer.push_back(layer.back());
+    layer = std::move(nextLayer);
+  }
+
+  Value result = layer.front();
+  if (inputType != uintType)
+    result = rewriter.create<AsSIntPrimOp>(insertLoc, inputType, result);
+  return result;
+}
+
 /// Construct a tree of 1-bit muxes to multiplex arbitrary numbers of signals
-/// using a one-hot select value. Assumes select has a UIntType.
+/// using a one-hot select value. Assumes select has a UIntType. Small numbers
+/// of inputs are selected by a chain of muxes, larger ones by an AND-OR
+/// reduction to keep the logic depth down.
 static Value createOneHotMuxTree(ArrayRef<Value> inputs, Value select,
                                  Location insertLoc,
                                  ConversionPatternRewriter &rewriter) {
@@ -225,6 +278,9 @@ static Value createOneHotMuxTree(ArrayRef<Value> inputs, Value select,
   assert(numInputs == selectType.getWidthOrSentinel() &&
          "one-hot select can't mux inputs");
 
+  if (inputs.size() > oneHotMuxChainLimit)
+    return createOneHotAndOr(inputs, select, insertLoc, rewriter);
+
   // Start the mux tree with zero value.
   auto inputType = inputs[0].getType().cast<FIRRTLType>();
   auto inputWidth = inputType.getBitWidthOrSentinel();
@@ -323,6 +379,63 @@ static void createMergeArgReady(ArrayRef<Value> outputs, Value fired,
   }
 }
 
+/// Construct an elastic pipeline of the given number of register stages between
+/// an input and an output channel. Every stage holds one token, so up to
+/// numStages tokens can be in flight and they leave in the order they entered.
+/// A stage accepts a new token when it is empty or its token moves on.
+static void createElasticPipeline(Value inValid, Value inReady, Value inData,
+                                  Value outValid, Value outReady, Value outData,
+                                  unsigned numStages, Value clock, Value reset,
+                                  Location insertLoc,
+                                  ConversionPatternRewriter &rewriter) {
+  assert(numStages > 0 && "pipeline needs at least one stage");
+  auto bitType = UIntType::get(rewriter.getContext(), 1);
+  auto dataType = inData.getType().cast<FIRRTLType>();
+  auto falseConst = createConstantOp(bitType, APInt(1, 0), insertLoc, rewriter);
+
+  // Create the valid and data registers of each stage.
+  SmallVector<Value, 4> validRegs, dataRegs;
+  for (unsigned i = 0; i < numStages; ++i) {
+    auto validName = rewriter.getStringAttr("stageValid" + std::to_string(i));
+    validRegs.push_back(rewriter.create<RegResetOp>(
+        insertLoc, bitType, clock, reset, falseConst, validName));
+    auto dataName = rewriter.getStringAttr("stageData" + std::to_string(i));
+    dataRegs.push_back(
+        rewriter.create<RegOp>(insertLoc, dataType, clock, dataName));
+  }
+
+  // Compute the ready signal of each stage, starting from the output.
+  SmallVector<Value, 4> stageReady(numStages);
+  Value nextReady = outReady;
+  for (unsigned i = numStages; i > 0; --i) {
+    auto notValid = rewriter.create<NotPrimOp>(insertLoc, bitType,
+                                               validRegs[i - 1]);
+    nextReady =
+        rewriter.create<OrPrimOp>(insertLoc, bitType, notValid, nextReady);
+    stageReady[i - 1] = nextReady;
+  }
+  rewriter.create<ConnectOp>(insertLoc, inReady, stageReady[0]);
+
+  // Each stage takes the token of the stage before it when it's ready, and
+  // otherwise keeps its own.
+  Value prevValid = inValid;
+  Value prevData = inData;
+  for (unsigned i = 0; i < numStages; ++i) {
+    auto validMux = rewriter.create<MuxPrimOp>(
+        insertLoc, bitType, stageReady[i], prevValid, validRegs[i]);
+    rewriter.create<ConnectOp>(insertLoc, validRegs[i], validMux);
+    auto dataMux = rewriter.create<MuxPrimOp>(insertLoc, dataType,
+                                              stageReady[i], prevData,
+                                              dataRegs[i]);
+    rewriter.create<ConnectOp>(insertLoc, dataRegs[i], dataMux);
+    prevValid = validRegs[i];
+    prevData = dataRegs[i];
+  }
+
+  rewriter.create<ConnectOp>(insertLoc, outValid, prevValid);
+  rewriter.create<ConnectOp>(insertLoc, outData, prevData);
+}
+
 //===----------------------------------------------------------------------===//
 // FIRRTL Top-module Related Functions
 //===----------------------------------------------------------------------===//
@@ -413,23 +526,55 @@ static FModuleOp createTopModuleOp(handshake::FuncOp funcOp, unsigned numClocks,
 // FIRRTL Sub-module Related Functions
 //===----------------------------------------------------------------------===//
 
-/// Check whether a submodule with the same name has been created elsewhere.
-/// Return the matched submodule if true, otherwise return nullptr.
-static FModuleOp checkSubModuleOp(FModuleOp topModuleOp, Operation *oldOp) {
-  for (auto &op : topModuleOp->getParentRegion()->front()) {
-    if (auto subModuleOp = dyn_cast<FModuleOp>(op)) {
-      if (getSubModuleName(oldOp) == subModuleOp.getName()) {
-        return subModuleOp;
-      }
-    }
-  }
-  return FModuleOp(nullptr);
+/// Return the structural signature of the sub-module the given operation is
+/// lowered to. Operations with the same name, types, and attributes lower to
+/// identical sub-modules, so they can share one.
+static std::string getSubModuleSignature(Operation *oldOp) {
+  std::string signature;
+  llvm::raw_string_ostream os(signature);
+  os << oldOp->getName() << '(';
+  llvm::interleaveComma(oldOp->getOperandTypes(), os);
+  os << ")->(";
+  llvm::interleaveComma(oldOp->getResultTypes(), os);
+  os << ')' << oldOp->getAttrDictionary();
+  return os.str();
 }
 
+namespace {
+/// Keeps track of the sub-modules created for a circuit, so that operations
+/// with the same structure are lowered only once and the instances share the
+/// sub-module.
+class SubModuleCache {
+public:
+  /// Return the sub-module previously created for an operation with the same
+  /// signature, or null if there is none.
+  FModuleOp lookup(StringRef signature) const {
+    return subModules.lookup(signature);
+  }
+
+  /// Remember the sub-module created for an operation with the given signature.
+  void insert(StringRef signature, FModuleOp subModuleOp) {
+    subModules[signature] = subModuleOp;
+  }
+
+  /// Return a unique name for a new sub-module, based on the given name.
+  std::string getUniqueName(StringRef name) {
+    std::string uniqueName = name.str();
+    for (unsigned suffix = 1; !usedNames.insert(uniqueName).second; ++suffix)
+      uniqueName = (name + "_" + Twine(suffix)).str();
+    return uniqueName;
+  }
+
+private:
+  llvm::StringMap<FModuleOp> subModules;
+  llvm::StringSet<> usedNames;
+};
+} // namespace
+
 /// All standard expressions and handshake elastic components will be converted
 /// to a FIRRTL sub-module and be instantiated in the top-module.
 static FModuleOp createSubModuleOp(FModuleOp topModuleOp, Operation *oldOp,
-                                   bool hasClock,
+                                   StringRef name, bool hasClock,
                                    ConversionPatternRewriter &rewriter) {
   rewriter.setInsertionPoint(topModuleOp);
   llvm::SmallVector<ModulePortInfo, 8> ports;
@@ -469,9 +614,8 @@ static FModuleOp createSubModuleOp(FModuleOp topModuleOp, Operation *oldOp,
         {rewriter.getStringAttr("reset"), rewriter.getType<UIntType>(1)});
   }
 
-  return rewriter.create<FModuleOp>(
-      topModuleOp.getLoc(), rewriter.getStringAttr(getSubModuleName(oldOp)),
-      ports);
+  return rewriter.create<FModuleOp>(topModuleOp.getLoc(),
+                                   rewriter.getStringAttr(name), ports);
 }
 
 /// Extract all subfields of all ports of the sub-module.
@@ -619,11 +763,23 @@ void StdExprBuilder::buildBinaryLogic() {
 //===----------------------------------------------------------------------===//
 
 namespace {
+/// Configuration of the handshake.memory lowering.
+struct MemoryLoweringOptions {
+  /// The number of register stages on the load data path. Zero returns the
+  /// load data in the same cycle as the address.
+  unsigned readLatency = 0;
+  /// The number of banks the memory is split into, interleaved on the low
+  /// address bits. Must be a power of two which divides the memory depth.
+  unsigned numBanks = 1;
+};
+
 class HandshakeBuilder : public HandshakeVisitor<HandshakeBuilder, bool> {
 public:
   HandshakeBuilder(ValueVectorList portList, Location insertLoc,
-                   ConversionPatternRewriter &rewriter)
-      : portList(portList), insertLoc(insertLoc), rewriter(rewriter) {}
+                   ConversionPatternRewriter &rewriter,
+                   const MemoryLoweringOptions &memOptions)
+      : portList(portList), insertLoc(insertLoc), rewriter(rewriter),
+        memOptions(memOptions) {}
   using HandshakeVisitor::visitHandshake;
 
   bool visitInvalidOp(Operation *op) { return false; }
@@ -651,6 +807,7 @@ private:
   ValueVectorList portList;
   Location insertLoc;
   ConversionPatternRewriter &rewriter;
+  const MemoryLoweringOptions &memOptions;
 };
 } // namespace
 
@@ -1358,14 +1515,24 @@ bool HandshakeBuilder::visitHandshake(MemoryOp op) {
     return false;
   }
 
+  // Check the banking can be done on the low address bits.
+  uint64_t depth = type.getNumElements();
+  unsigned numBanks = memOptions.numBanks;
+  if (!llvm::isPowerOf2_32(numBanks) || depth % numBanks != 0) {
+    op.emitError("memory of depth ")
+        << depth << " can't be split into " << numBanks << " banks";
+    return false;
+  }
+  unsigned bankBits = llvm::Log2_32(numBanks);
+
   // Set up FIRRTL memory attributes. This circuit relies on a read latency of 0
-  // and a write latency of 1, but this could be generalized.
+  // and a write latency of 1, but this could be generalized. A pipelined
+  // lowering registers the load data after the memory instead.
   uint32_t readLatency = 0;
   uint32_t writeLatency = 1;
   RUWAttr ruw = RUWAttr::Old;
-  uint64_t depth = type.getNumElements();
   FIRRTLType dataType = getFIRRTLType(elementType);
-  StringAttr name = rewriter.getStringAttr("mem" + std::to_string(op.id()));
+  std::string name = "mem" + std::to_string(op.id());
 
   // Helpers to get port identifiers.
   auto loadIdentifier = [&](size_t i) {
@@ -1391,20 +1558,58 @@ bool HandshakeBuilder::visitHandshake(MemoryOp op) {
     ports.push_back({portName, portKind});
   }
 
-  // Create the special type to represent this memory.
-  FIRRTLType memType = MemOp::getTypeForPortList(depth, dataType, ports);
-
-  // Create the actual mem op.
-  auto memOp = rewriter.create<MemOp>(insertLoc, memType, readLatency,
-                                      writeLatency, depth, ruw, name);
+  // Create the special type to represent this memory. Every bank has the same
+  // ports and holds an equal share of the elements.
+  uint64_t bankDepth = depth / numBanks;
+  FIRRTLType memType = MemOp::getTypeForPortList(bankDepth, dataType, ports);
+
+  // Create the actual mem op of each bank.
+  SmallVector<MemOp, 4> memOps;
+  for (unsigned b = 0; b < numBanks; ++b) {
+    auto bankName = numBanks == 1 ? name : name + "_bank" + std::to_string(b);
+    memOps.push_back(rewriter.create<MemOp>(
+        insertLoc, memType, readLatency, writeLatency, bankDepth, ruw,
+        rewriter.getStringAttr(bankName)));
+  }
 
   // Prepare to create each load and store port logic.
-  BundleType resultType = memOp.getType().cast<BundleType>();
+  BundleType resultType = memType.cast<BundleType>();
   auto bitType = UIntType::get(rewriter.getContext(), 1);
   auto numPorts = portList.size();
   auto clock = portList[numPorts - 2][0];
   auto reset = portList[numPorts - 1][0];
 
+  // Since addresses coming from Handshake are IndexType and have a hardcoded
+  // 64-bit width in this pass, we may need to truncate down to the actual
+  // size of the address port used by the FIRRTL memory. With banking, the bank
+  // is selected by the low address bits and the rest index into the bank.
+  auto getBankAddress = [&](Value addr, FIRRTLType memAddrType) -> Value {
+    auto addrType = addr.getType().cast<FIRRTLType>();
+    if (memAddrType == addrType)
+      return addr;
+    auto memAddrPassiveType = memAddrType.getPassiveType();
+    auto memAddrWidth = memAddrPassiveType.getBitWidthOrSentinel();
+    if (numBanks > 1)
+      return rewriter.create<BitsPrimOp>(insertLoc, addr,
+                                         bankBits + memAddrWidth - 1, bankBits);
+    auto tailAmount = addrType.getBitWidthOrSentinel() - memAddrWidth;
+    return rewriter.create<TailPrimOp>(insertLoc, memAddrPassiveType, addr,
+                                       tailAmount);
+  };
+
+  // Return a 1-bit signal which is asserted when the given address falls into
+  // the given bank, or null if the memory isn't banked.
+  auto getBankSelect = [&](Value addr, unsigned bank) -> Value {
+    if (numBanks == 1)
+      return Value();
+    auto bankIndex = rewriter.create<BitsPrimOp>(insertLoc, addr, bankBits - 1,
+                                                 0);
+    auto bankIndexType = UIntType::get(rewriter.getContext(), bankBits);
+    auto bankConst = createConstantOp(bankIndexType, APInt(bankBits, bank),
+                                      insertLoc, rewriter);
+    return rewriter.create<EQPrimOp>(insertLoc, bitType, bankIndex, bankConst);
+  };
+
   // Collect load arguments.
   for (size_t i = 0; i < numLoads; ++i) {
     // Extract load ports from the port list.
@@ -1420,58 +1625,78 @@ bool HandshakeBuilder::visitHandshake(MemoryOp op) {
     auto loadAddrData = loadAddr[2];
 
     // Unpack load data.
+    auto loadDataValid = loadData[0];
+    auto loadDataReady = loadData[1];
     auto loadDataData = loadData[2];
 
-    // Create a subfield op to access this port in the memory.
+    // Create a subfield op to access this port in each bank.
     auto fieldName = loadIdentifier(i);
     auto bundleType = resultType.getElementType(fieldName).cast<BundleType>();
-    auto memBundle =
-        rewriter.create<SubfieldOp>(insertLoc, bundleType, memOp, fieldName);
-
-    // Get the clock out of the bundle and connect it.
-    auto memClockType = bundleType.getElementType("clk");
-    auto memClock =
-        rewriter.create<SubfieldOp>(insertLoc, memClockType, memBundle, "clk");
-    rewriter.create<ConnectOp>(insertLoc, memClock, clock);
-
-    // Get the load address out of the bundle.
-    auto memAddrType = bundleType.getElementType("addr");
-    auto memAddr =
-        rewriter.create<SubfieldOp>(insertLoc, memAddrType, memBundle, "addr");
-
-    // Since addresses coming from Handshake are IndexType and have a hardcoded
-    // 64-bit width in this pass, we may need to truncate down to the actual
-    // size of the address port used by the FIRRTL memory.
-    auto loadAddrType = loadAddrData.getType().cast<FIRRTLType>();
-    if (memAddrType != loadAddrType) {
-      auto memAddrPassiveType = memAddrType.getPassiveType();
-      auto tailAmount = loadAddrType.getBitWidthOrSentinel() -
-                        memAddrPassiveType.getBitWidthOrSentinel();
-      loadAddrData = rewriter.create<TailPrimOp>(insertLoc, memAddrPassiveType,
-                                                 loadAddrData, tailAmount);
+    SmallVector<Value, 4> bankData;
+    for (unsigned b = 0; b < numBanks; ++b) {
+      auto memBundle = rewriter.create<SubfieldOp>(insertLoc, bundleType,
+                                                   memOps[b], fieldName);
+
+      // Get the clock out of the bundle and connect it.
+      auto memClockType = bundleType.getElementType("clk");
+      auto memClock = rewriter.create<SubfieldOp>(insertLoc, memClockType,
+                                                  memBundle, "clk");
+      rewriter.create<ConnectOp>(insertLoc, memClock, clock);
+
+      // Get the load address out of the bundle and connect it.
+      auto memAddrType = bundleType.getElementType("addr");
+      auto memAddr = rewriter.create<SubfieldOp>(insertLoc, memAddrType,
+                                                 memBundle, "addr");
+      rewriter.create<ConnectOp>(insertLoc, memAddr,
+                                 getBankAddress(loadAddrData, memAddrType));
+
+      // Get the load data out of the bundle.
+      auto memDataType = bundleType.getElementType("data");
+      bankData.push_back(rewriter.create<SubfieldOp>(insertLoc, memDataType,
+                                                     memBundle, "data"));
+
+      // Get the load enable out of the bundle.
+      auto memEnableType = bundleType.getElementType("en");
+      auto memEnable = rewriter.create<SubfieldOp>(insertLoc, memEnableType,
+                                                   memBundle, "en");
+
+      // Connect the address valid signal to the memory enable, if the address
+      // falls into this bank.
+      Value enable = loadAddrValid;
+      if (auto bankSelect = getBankSelect(loadAddrData, b))
+        enable = rewriter.create<AndPrimOp>(insertLoc, bitType, loadAddrValid,
+                                            bankSelect);
+      rewriter.create<ConnectOp>(insertLoc, memEnable, enable);
     }
 
-    // Connect the load address to the memory.
-    rewriter.create<ConnectOp>(insertLoc, memAddr, loadAddrData);
-
-    // Get the load data out of the bundle.
-    auto memDataType = bundleType.getElementType("data");
-    auto memData =
-        rewriter.create<SubfieldOp>(insertLoc, memDataType, memBundle, "data");
-
-    // Connect the memory to the load data.
-    rewriter.create<ConnectOp>(insertLoc, loadDataData, memData);
+    // Select the data of the bank the address falls into.
+    Value memData = bankData.front();
+    if (numBanks > 1) {
+      auto bankIndex =
+          rewriter.create<BitsPrimOp>(insertLoc, loadAddrData, bankBits - 1, 0);
+      memData = createMuxTree(bankData, bankIndex, insertLoc, rewriter);
+    }
 
-    // Get the load enable out of the bundle.
-    auto memEnableType = bundleType.getElementType("en");
-    auto memEnable =
-        rewriter.create<SubfieldOp>(insertLoc, memEnableType, memBundle, "en");
+    if (memOptions.readLatency == 0) {
+      // Connect the memory to the load data.
+      rewriter.create<ConnectOp>(insertLoc, loadDataData, memData);
 
-    // Connect the address valid signal to the memory enable.
-    rewriter.create<ConnectOp>(insertLoc, memEnable, loadAddrValid);
+      // Create control-only fork for the load address valid and ready signal.
+      buildForkLogic(&loadAddr, {&loadData, &loadControl}, clock, reset, true);
+      continue;
+    }
 
-    // Create control-only fork for the load address valid and ready signal.
-    buildForkLogic(&loadAddr, {&loadData, &loadControl}, clock, reset, true);
+    // The fork issues the load into the load data pipeline instead, so further
+    // loads can be issued while earlier ones are still on their way out.
+    auto issueValid = rewriter.create<WireOp>(
+        insertLoc, bitType, rewriter.getStringAttr("issueValid"));
+    auto issueReady = rewriter.create<WireOp>(
+        insertLoc, bitType, rewriter.getStringAttr("issueReady"));
+    ValueVector loadIssue = {issueValid, issueReady};
+    buildForkLogic(&loadAddr, {&loadIssue, &loadControl}, clock, reset, true);
+    createElasticPipeline(issueValid, issueReady, memData, loadDataValid,
+                          loadDataReady, loadDataData, memOptions.readLatency,
+                          clock, reset, insertLoc, rewriter);
   }
 
   // Collect store arguments.
@@ -1498,47 +1723,38 @@ bool HandshakeBuilder::visitHandshake(MemoryOp op) {
     auto storeControlValid = storeControl[0];
     auto storeControlReady = storeControl[1];
 
-    // Create a subfield op to access this port in the memory.
+    // Create a subfield op to access this port in each bank.
     auto fieldName = storeIdentifier(i);
     auto subfieldType = resultType.getElementType(fieldName).cast<FlipType>();
     auto bundleType = subfieldType.getElementType().cast<BundleType>();
-    auto memBundle =
-        rewriter.create<SubfieldOp>(insertLoc, subfieldType, memOp, fieldName);
-
-    // Get the clock out of the bundle and connect it.
-    auto memClockType = FlipType::get(bundleType.getElementType("clk"));
-    auto memClock =
-        rewriter.create<SubfieldOp>(insertLoc, memClockType, memBundle, "clk");
-    rewriter.create<ConnectOp>(insertLoc, memClock, clock);
-
-    // Get the store address out of the bundle.
-    auto memAddrType = FlipType::get(bundleType.getElementType("addr"));
-    auto memAddr =
-        rewriter.create<SubfieldOp>(insertLoc, memAddrType, memBundle, "addr");
-
-    // Since addresses coming from Handshake are IndexType and have a hardcoded
-    // 64-bit width in this pass, we may need to truncate down to the actual
-    // size of the address port used by the FIRRTL memory.
-    auto storeAddrType = storeAddrData.getType().cast<FIRRTLType>();
-    if (memAddrType != storeAddrType) {
-      auto memAddrPassiveType = memAddrType.getPassiveType();
-      auto tailAmount = storeAddrType.getBitWidthOrSentinel() -
-                        memAddrPassiveType.getBitWidthOrSentinel();
-      storeAddrData = rewriter.create<TailPrimOp>(insertLoc, memAddrPassiveType,
-                                                  storeAddrData, tailAmount);
+    SmallVector<Value, 4> memBundles;
+    for (unsigned b = 0; b < numBanks; ++b) {
+      auto memBundle = rewriter.create<SubfieldOp>(insertLoc, subfieldType,
+                                                   memOps[b], fieldName);
+      memBundles.push_back(memBundle);
+
+      // Get the clock out of the bundle and connect it.
+      auto memClockType = FlipType::get(bundleType.getElementType("clk"));
+      auto memClock = rewriter.create<SubfieldOp>(insertLoc, memClockType,
+                                                  memBundle, "clk");
+      rewriter.create<ConnectOp>(insertLoc, memClock, clock);
+
+      // Get the store address out of the bundle and connect it.
+      auto memAddrType = FlipType::get(bundleType.getElementType("addr"));
+      auto memAddr = rewriter.create<SubfieldOp>(insertLoc, memAddrType,
+                                                 memBundle, "addr");
+      rewriter.create<ConnectOp>(insertLoc, memAddr,
+                                 getBankAddress(storeAddrData, memAddrType));
+
+      // Get the store data out of the bundle.
+      auto memDataType = FlipType::get(bundleType.getElementType("data"));
+      auto memData = rewriter.create<SubfieldOp>(insertLoc, memDataType,
+                                                 memBundle, "data");
+
+      // Connect the store data to the memory.
+      rewriter.create<ConnectOp>(insertLoc, memData, storeDataData);
     }
 
-    // Connect the store address to the memory.
-    rewriter.create<ConnectOp>(insertLoc, memAddr, storeAddrData);
-
-    // Get the store data out of the bundle.
-    auto memDataType = FlipType::get(bundleType.getElementType("data"));
-    auto memData =
-        rewriter.create<SubfieldOp>(insertLoc, memDataType, memBundle, "data");
-
-    // Connect the store data to the memory.
-    rewriter.create<ConnectOp>(insertLoc, memData, storeDataData);
-
     // Create a register to buffer the valid path by 1 cycle, to match the write
     // latency of 1.
     auto falseConst =
@@ -1581,22 +1797,30 @@ bool HandshakeBuilder::visitHandshake(MemoryOp op) {
     rewriter.create<ConnectOp>(insertLoc, writeValidBuffer,
                                writeValidBufferMux);
 
-    // Get the store enable out of the bundle.
-    auto memEnableType = FlipType::get(bundleType.getElementType("en"));
-    auto memEnable =
-        rewriter.create<SubfieldOp>(insertLoc, memEnableType, memBundle, "en");
-
-    // Connect the write valid signal to the memory enable.
-    rewriter.create<ConnectOp>(insertLoc, memEnable, writeValid);
-
-    // Get the store mask out of the bundle.
-    auto memMaskType = FlipType::get(bundleType.getElementType("mask"));
-    auto memMask =
-        rewriter.create<SubfieldOp>(insertLoc, memMaskType, memBundle, "mask");
-
-    // Since we are not storing bundles in the memory, we can assume the mask is
-    // a single bit.
-    rewriter.create<ConnectOp>(insertLoc, memMask, writeValid);
+    for (unsigned b = 0; b < numBanks; ++b) {
+      // Only write to this bank if the address falls into it.
+      Value bankWriteValid = writeValid;
+      if (auto bankSelect = getBankSelect(storeAddrData, b))
+        bankWriteValid = rewriter.create<AndPrimOp>(insertLoc, bitType,
+                                                    writeValid, bankSelect);
+
+      // Get the store enable out of the bundle.
+      auto memEnableType = FlipType::get(bundleType.getElementType("en"));
+      auto memEnable = rewriter.create<SubfieldOp>(insertLoc, memEnableType,
+                                                   memBundles[b], "en");
+
+      // Connect the write valid signal to the memory enable.
+      rewriter.create<ConnectOp>(insertLoc, memEnable, bankWriteValid);
+
+      // Get the store mask out of the bundle.
+      auto memMaskType = FlipType::get(bundleType.getElementType("mask"));
+      auto memMask = rewriter.create<SubfieldOp>(insertLoc, memMaskType,
+                                                 memBundles[b], "mask");
+
+      // Since we are not storing bundles in the memory, we can assume the mask
+      // is a single bit.
+      rewriter.create<ConnectOp>(insertLoc, memMask, bankWriteValid);
+    }
   }
 
   return true;
@@ -1695,7 +1919,8 @@ static void convertReturnOp(Operation *oldOp, FModuleOp topModuleOp,
 /// 1)  Create and go into a new FIRRTL top-module;
 /// 2)  Inline Handshake FuncOp region into the FIRRTL top-module;
 /// 3)  Traverse and convert each Standard or Handshake operation:
-///   i)    Check if an identical sub-module exists. If so, skip to vi);
+///   i)    Check if a sub-module with the same signature exists. If so, skip
+///         to vi);
 ///   ii)   Create and go into a new FIRRTL sub-module;
 ///   iii)  Extract data (if applied), valid, and ready subfield from each port
 ///         of the sub-module;
@@ -1706,7 +1931,7 @@ static void convertReturnOp(Operation *oldOp, FModuleOp topModuleOp,
 /// 4)  Erase the Handshake FuncOp.
 ///
 /// createTopModuleOp():  1) and 2)
-/// checkSubModuleOp():   3.i)
+/// SubModuleCache:       3.i)
 /// createSubModuleOp():  3.ii)
 /// extractSubfields():   3.iii)
 /// build*Logic():        3.iv)
@@ -1714,7 +1939,10 @@ static void convertReturnOp(Operation *oldOp, FModuleOp topModuleOp,
 ///
 /// Please refer to test_addi.mlir test case.
 struct HandshakeFuncOpLowering : public OpConversionPattern<handshake::FuncOp> {
-  using OpConversionPattern<handshake::FuncOp>::OpConversionPattern;
+  HandshakeFuncOpLowering(MLIRContext *context,
+                          const MemoryLoweringOptions &memOptions)
+      : OpConversionPattern<handshake::FuncOp>(context),
+        memOptions(memOptions) {}
 
   LogicalResult
   matchAndRewrite(handshake::FuncOp funcOp, ArrayRef<Value> operands,
@@ -1725,6 +1953,9 @@ struct HandshakeFuncOpLowering : public OpConversionPattern<handshake::FuncOp> {
     rewriter.setInsertionPointToStart(circuitOp.getBody());
     auto topModuleOp = createTopModuleOp(funcOp, /*numClocks=*/1, rewriter);
 
+    SubModuleCache subModules;
+    subModules.getUniqueName(topModuleOp.getName());
+
     // Traverse and convert each operation in funcOp.
     for (Operation &op : topModuleOp.getBody().front()) {
       if (isa<handshake::ReturnOp>(op))
@@ -1733,12 +1964,16 @@ struct HandshakeFuncOpLowering : public OpConversionPattern<handshake::FuncOp> {
       // This branch takes care of all non-timing operations that require to
       // be instantiated in the top-module.
       else if (op.getDialect()->getNamespace() != "firrtl") {
-        FModuleOp subModuleOp = checkSubModuleOp(topModuleOp, &op);
+        std::string signature = getSubModuleSignature(&op);
+        FModuleOp subModuleOp = subModules.lookup(signature);
         bool hasClock = op.hasTrait<OpTrait::HasClock>();
 
         // Check if the sub-module already exists.
         if (!subModuleOp) {
-          subModuleOp = createSubModuleOp(topModuleOp, &op, hasClock, rewriter);
+          auto name = subModules.getUniqueName(getSubModuleName(&op));
+          subModuleOp =
+              createSubModuleOp(topModuleOp, &op, name, hasClock, rewriter);
+          subModules.insert(signature, subModuleOp);
 
           Operation *termOp = subModuleOp.getBody().front().getTerminator();
           Location insertLoc = termOp->getLoc();
@@ -1747,7 +1982,7 @@ struct HandshakeFuncOpLowering : public OpConversionPattern<handshake::FuncOp> {
           ValueVectorList portList =
               extractSubfields(subModuleOp, insertLoc, rewriter);
 
-          if (HandshakeBuilder(portList, insertLoc, rewriter)
+          if (HandshakeBuilder(portList, insertLoc, rewriter, memOptions)
                   .dispatchHandshakeVisitor(&op)) {
           } else if (StdExprBuilder(portList, insertLoc, rewriter)
                          .dispatchStdExprVisitor(&op)) {
@@ -1764,6 +1999,8 @@ struct HandshakeFuncOpLowering : public OpConversionPattern<handshake::FuncOp> {
 
     return success();
   }
+
+  MemoryLoweringOptions memOptions;
 };
 
 namespace {
@@ -1771,6 +2008,21 @@ class HandshakeToFIRRTLPass
     : public mlir::PassWrapper<HandshakeToFIRRTLPass,
                                OperationPass<handshake::FuncOp>> {
 public:
+  HandshakeToFIRRTLPass() = default;
+  HandshakeToFIRRTLPass(const HandshakeToFIRRTLPass &other)
+      : PassWrapper<HandshakeToFIRRTLPass, OperationPass<handshake::FuncOp>>(
+            other) {}
+
+  Option<unsigned> memReadLatency{
+      *this, "mem-read-latency",
+      llvm::cl::desc("The number of register stages on the load data path of "
+                     "memories. Each stage can hold an outstanding load"),
+      llvm::cl::init(0)};
+  Option<unsigned> memBanks{
+      *this, "mem-banks",
+      llvm::cl::desc("The number of banks memories are interleaved into"),
+      llvm::cl::init(1)};
+
   void runOnOperation() override {
     auto op = getOperation();
 
@@ -1778,8 +2030,12 @@ public:
     target.addLegalDialect<FIRRTLDialect>();
     target.addIllegalDialect<handshake::HandshakeOpsDialect>();
 
+    MemoryLoweringOptions memOptions;
+    memOptions.readLatency = memReadLatency;
+    memOptions.numBanks = memBanks;
+
     OwningRewritePatternList patterns;
-    patterns.insert<HandshakeFuncOpLowering>(op.getContext());
+    patterns.insert<HandshakeFuncOpLowering>(op.getContext(), memOptions);
 
     if (failed(applyPartialConversion(op, target, std::move(patterns))))
       signalPassFailure();
@@ -1787,7 +2043,246 @@ public:
 };
 } // end anonymous namespace
 
+//===----------------------------------------------------------------------===//
+// ESI wrapper Pass
+//===----------------------------------------------------------------------===//
+
+namespace {
+/// The ports of a lowered top-module which make up the channel of one
+/// argument or result of the handshake function.  Control-only channels have
+/// no data port.
+struct ChannelPorts {
+  Optional<rtl::ModulePortInfo> valid, ready, data;
+};
+} // end anonymous namespace
+
+/// Split the name of a port of a lowered top-module, like "arg3_valid", into
+/// the index of its channel and the signal it carries.  Return false if it
+/// isn't such a port.
+static bool parseChannelPortName(StringRef name, unsigned &index,
+                                 StringRef &signal) {
+  if (!name.consume_front("arg"))
+    return false;
+  StringRef indexStr;
+  std::tie(indexStr, signal) = name.split('_');
+  if (indexStr.getAsInteger(10, index))
+    return false;
+  return signal == "valid" || signal == "ready" || signal == "data";
+}
+
+/// Group the ports of 'module' into handshake channels and clock and reset
+/// signals.  Return failure, emitting an error if 'diagnose' is set, if any
+/// port is neither or a channel is incomplete.
+static LogicalResult
+getChannelPorts(rtl::RTLModuleOp module,
+                SmallVectorImpl<ChannelPorts> &channels,
+                SmallVectorImpl<rtl::ModulePortInfo> &clockAndReset,
+                bool diagnose) {
+  auto fail = [&](const Twine &message) {
+    if (diagnose)
+      module.emitError(message);
+    return failure();
+  };
+
+  SmallVector<rtl::ModulePortInfo, 16> modulePorts;
+  module.getPortInfo(modulePorts);
+  for (auto &port : modulePorts) {
+    if (port.getName() == "clock" || port.getName() == "reset") {
+      if (port.isOutput())
+        return fail("port '" + port.getName() + "' should be an input");
+      clockAndReset.push_back(port);
+      continue;
+    }
+
+    unsigned index;
+    StringRef signal;
+    if (!parseChannelPortName(port.getName(), index, signal))
+      return fail("port '" + port.getName() +
+                  "' is not part of a handshake channel");
+    if (index >= channels.size())
+      channels.resize(index + 1);
+    auto &channel = channels[index];
+    auto &slot = signal == "valid"   ? channel.valid
+                 : signal == "ready" ? channel.ready
+                                     : channel.data;
+    if (slot)
+      return fail("duplicate port '" + port.getName() + "'");
+    slot = port;
+  }
+
+  if (channels.empty())
+    return fail("has no handshake channels");
+  for (auto channel : llvm::enumerate(channels)) {
+    auto &ports = channel.value();
+    std::string name = "arg" + std::to_string(channel.index());
+    if (!ports.valid || !ports.ready)
+      return fail("channel '" + name + "' needs a valid and a ready port");
+    if (ports.valid->isOutput() == ports.ready->isOutput() ||
+        (ports.data && ports.data->isOutput() != ports.valid->isOutput()))
+      return fail("the ports of channel '" + name +
+                  "' have inconsistent directions");
+  }
+  return success();
+}
+
+/// Create a module named after 'module' with an "_esi" suffix, with an ESI
+/// channel port for every handshake channel of 'module', which instantiates
+/// it.  Control-only channels carry an i1 which is always zero.
+static LogicalResult createESIWrapper(rtl::RTLModuleOp module) {
+  SmallVector<ChannelPorts, 8> channels;
+  SmallVector<rtl::ModulePortInfo, 2> clockAndReset;
+  if (failed(getChannelPorts(module, channels, clockAndReset,
+                             /*diagnose=*/true)))
+    return failure();
+
+  auto *context = module.getContext();
+  auto loc = module.getLoc();
+  OpBuilder builder(context);
+  auto wrapperName = builder.getStringAttr(module.getName() + "_esi");
+  auto topModule = module->getParentOfType<ModuleOp>();
+  if (topModule.lookupSymbol(wrapperName.getValue()))
+    return module.emitError("wrapper module name '")
+           << wrapperName.getValue() << "' is already taken";
+
+  // The wrapper has a channel port per channel in the original order,
+  // followed by the clock and reset.
+  SmallVector<rtl::ModulePortInfo, 8> wrapperPorts;
+  size_t numInputs = 0, numOutputs = 0;
+  auto i1Type = builder.getI1Type();
+  for (auto channel : llvm::enumerate(channels)) {
+    auto &ports = channel.value();
+    bool isOutput = ports.valid->isOutput();
+    Type innerType = ports.data ? ports.data->type : i1Type;
+    wrapperPorts.push_back(
+        {builder.getStringAttr("arg" + Twine(channel.index())),
+         isOutput ? rtl::OUTPUT : rtl::INPUT,
+         esi::ChannelPort::get(context, innerType),
+         isOutput ? numOutputs++ : numInputs++});
+  }
+  for (auto port : clockAndReset) {
+    port.argNum = numInputs++;
+    wrapperPorts.push_back(port);
+  }
+
+  builder.setInsertionPointAfter(module);
+  auto wrapper =
+      builder.create<rtl::RTLModuleOp>(loc, wrapperName, wrapperPorts);
+  Block *body = wrapper.getBodyBlock();
+  builder.setInsertionPointToStart(body);
+
+  // The ready signals flow against the data, so unwrapping an input needs an
+  // output of the instance, and wrapping an output needs an input of it.
+  // Connect them to a placeholder first and fix them up at the end.
+  auto placeholder = builder.create<rtl::ConstantOp>(loc, APInt(1, 0));
+  auto moduleType = rtl::getModuleType(module);
+  SmallVector<Value, 16> operands(moduleType.getNumInputs(),
+                                  placeholder.getResult());
+  SmallVector<esi::UnwrapValidReady, 8> unwraps(channels.size());
+  for (auto channel : llvm::enumerate(channels)) {
+    auto &ports = channel.value();
+    if (ports.valid->isOutput())
+      continue;
+    Value arg = body->getArgument(wrapperPorts[channel.index()].argNum);
+    auto unwrap =
+        builder.create<esi::UnwrapValidReady>(loc, arg, placeholder);
+    operands[ports.valid->argNum] = unwrap.valid();
+    if (ports.data)
+      operands[ports.data->argNum] = unwrap.rawOutput();
+    unwraps[channel.index()] = unwrap;
+  }
+  for (auto port : llvm::enumerate(clockAndReset))
+    operands[port.value().argNum] = body->getArgument(
+        wrapperPorts[channels.size() + port.index()].argNum);
+
+  auto instance = builder.create<rtl::InstanceOp>(
+      loc, moduleType.getResults(), module.getName(), module.getName(),
+      operands, DictionaryAttr());
+
+  SmallVector<Value, 8> outputs;
+  for (auto channel : llvm::enumerate(channels)) {
+    auto &ports = channel.value();
+    if (!ports.valid->isOutput()) {
+      unwraps[channel.index()]->setOperand(
+          1, instance.getResult(ports.ready->argNum));
+      continue;
+    }
+    Value data;
+    if (ports.data)
+      data = instance.getResult(ports.data->argNum);
+    else
+      data = builder.create<rtl::ConstantOp>(loc, APInt(1, 0));
+    auto wrap = builder.create<esi::WrapValidReady>(
+        loc, data, instance.getResult(ports.valid->argNum));
+    instance->setOperand(ports.ready->argNum, wrap.ready());
+    outputs.push_back(wrap.chanOutput());
+  }
+  placeholder.erase();
+  body->getTerminator()->setOperands(outputs);
+  return success();
+}
+
+namespace {
+/// Wrap the RTL modules lowered from handshake functions into modules with an
+/// ESI channel port for every argument and result of the function.
+class HandshakeESIWrapperPass
+    : public mlir::PassWrapper<HandshakeESIWrapperPass,
+                               OperationPass<ModuleOp>> {
+public:
+  HandshakeESIWrapperPass() = default;
+  HandshakeESIWrapperPass(const HandshakeESIWrapperPass &other)
+      : PassWrapper<HandshakeESIWrapperPass, OperationPass<ModuleOp>>(other) {
+  }
+
+  ListOption<std::string> moduleNames{
+      *this, "modules",
+      llvm::cl::desc("The modules to wrap. By default, every module which "
+                     "isn't instantiated and only has handshake channel, "
+                     "clock and reset ports is wrapped"),
+      llvm::cl::ZeroOrMore, llvm::cl::MiscFlags::CommaSeparated};
+
+  void getDependentDialects(DialectRegistry &registry) const override {
+    registry.insert<rtl::RTLDialect, esi::ESIDialect>();
+  }
+
+  void runOnOperation() override {
+    auto top = getOperation();
+
+    SmallVector<rtl::RTLModuleOp, 4> modules;
+    if (moduleNames.empty()) {
+      llvm::StringSet<> instantiated;
+      top.walk([&](rtl::InstanceOp instance) {
+        instantiated.insert(instance.moduleName());
+      });
+      for (auto module : top.getOps<rtl::RTLModuleOp>()) {
+        SmallVector<ChannelPorts, 8> channels;
+        SmallVector<rtl::ModulePortInfo, 2> clockAndReset;
+        if (!instantiated.count(module.getName()) &&
+            succeeded(getChannelPorts(module, channels, clockAndReset,
+                                      /*diagnose=*/false)))
+          modules.push_back(module);
+      }
+    } else {
+      for (auto &name : moduleNames) {
+        auto module = top.lookupSymbol<rtl::RTLModuleOp>(name);
+        if (!module) {
+          top.emitError("no module named '") << name << "' to wrap";
+          return signalPassFailure();
+        }
+        modules.push_back(module);
+      }
+    }
+
+    for (auto module : modules)
+      if (failed(createESIWrapper(module)))
+        return signalPassFailure();
+  }
+};
+} // end anonymous namespace
+
 void handshake::registerHandshakeToFIRRTLPasses() {
   PassRegistration<HandshakeToFIRRTLPass>("lower-handshake-to-firrtl",
                                           "Lowering to FIRRTL Dialect");
+  PassRegistration<HandshakeESIWrapperPass>(
+      "handshake-esi-wrapper",
+      "Wrap lowered handshake functions into modules with ESI channel ports");
 }
@@ -85,6 +85,39 @@ static Type getLLVMSigType(LLVM::LLVMDialect *dialect) {
                                           {i8PtrTy, i64Ty, i64Ty, i64Ty});
 }
 
+/// Return the LLVM type of the buffer the lowered units append their inlined
+/// drives to. It corresponds to a struct with the format: {entriesPtr, size,
+/// capacity}, where each entry has the format: {signalPtr, value, width, time,
+/// delta, eps}. Has to be kept in sync with the simulator's `DriveBuffer`.
+static Type getLLVMDriveBufferType(LLVM::LLVMDialect *dialect) {
+  auto i64Ty = IntegerType::get(dialect->getContext(), 64);
+  auto entryTy = LLVM::LLVMStructType::getLiteral(
+      dialect->getContext(),
+      {LLVM::LLVMPointerType::get(getLLVMSigType(dialect)), i64Ty, i64Ty,
+       i64Ty, i64Ty, i64Ty});
+  return LLVM::LLVMStructType::getLiteral(
+      dialect->getContext(),
+      {LLVM::LLVMPointerType::get(entryTy), i64Ty, i64Ty});
+}
+
+/// Return the argument types of a lowered unit: a pointer to the global
+/// simulation state, a pointer to the unit's local state, a pointer to the
+/// instance's signal table and, if drives are inlined, a pointer to the drive
+/// buffer.
+static SmallVector<Type, 4> getUnitArgTypes(LLVM::LLVMDialect *dialect,
+                                            Type localStatePtrTy,
+                                            bool inlineDrives) {
+  auto i8PtrTy =
+      LLVM::LLVMPointerType::get(IntegerType::get(dialect->getContext(), 8));
+  SmallVector<Type, 4> types(
+      {i8PtrTy, localStatePtrTy,
+       LLVM::LLVMPointerType::get(getLLVMSigType(dialect))});
+  if (inlineDrives)
+    types.push_back(
+        LLVM::LLVMPointerType::get(getLLVMDriveBufferType(dialect)));
+  return types;
+}
+
 /// Extract the details from the given signal struct. The details are returned
 /// in the original struct order.
 static std::vector<Value> getSignalDetail(ConversionPatternRewriter &rewriter,
@@ -193,14 +226,19 @@ static Type unwrapLLVMPtr(Type ty) {
 
 /// Gather the types of values that are used outside of the block they're
 /// defined in. An LLVMType structure containing those types, in order of
-/// appearance, is returned.
-static Type getProcPersistenceTy(LLVM::LLVMDialect *dialect,
-                                 TypeConverter *converter, ProcOp &proc) {
+/// appearance, is returned. If `sigFields` is given, the indices of the
+/// persisted signals are added to it.
+static Type
+getProcPersistenceTy(LLVM::LLVMDialect *dialect, TypeConverter *converter,
+                     ProcOp &proc,
+                     SmallVectorImpl<unsigned> *sigFields = nullptr) {
   SmallVector<Type, 3> types = SmallVector<Type, 3>();
   proc.walk([&](Operation *op) -> void {
     if (op->isUsedOutsideOfBlock(op->getBlock()) || isWaitDestArg(op)) {
       auto ty = op->getResult(0).getType();
       auto convertedTy = converter->convertType(ty);
+      if (sigFields && ty.isa<SigType>())
+        sigFields->push_back(types.size());
       if (ty.isa<PtrType, SigType>()) {
         // Persist the unwrapped value.
         types.push_back(unwrapLLVMPtr(convertedTy));
@@ -723,18 +761,82 @@ static Type convertTupleType(TupleType type, LLVMTypeConverter &converter) {
 // Unit conversions
 //===----------------------------------------------------------------------===//
 
+/// Create a `<unit>_batch` function running the given lowered unit for several
+/// instances in a loop. It takes the same arguments as the unit, except that
+/// the local state and signal table pointers are replaced by the number of
+/// instances, followed by an array of local state pointers and an array of
+/// signal table pointers.
+static void createBatchFunction(ConversionPatternRewriter &rewriter,
+                                Location loc, LLVM::LLVMFuncOp unit,
+                                ArrayRef<Type> unitArgTys, Type voidTy) {
+  auto i64Ty = IntegerType::get(rewriter.getContext(), 64);
+  SmallVector<Type, 5> argTys({unitArgTys[0], i64Ty,
+                               LLVM::LLVMPointerType::get(unitArgTys[1]),
+                               LLVM::LLVMPointerType::get(unitArgTys[2])});
+  argTys.append(unitArgTys.begin() + 3, unitArgTys.end());
+  auto func = rewriter.create<LLVM::LLVMFuncOp>(
+      loc, (unit.getName() + "_batch").str(),
+      LLVM::LLVMFunctionType::get(voidTy, argTys));
+
+  OpBuilder::InsertionGuard guard(rewriter);
+  auto &body = func.getBody();
+  auto *entry = rewriter.createBlock(&body, body.end(), argTys);
+  auto *header = rewriter.createBlock(&body, body.end(), i64Ty);
+  auto *loop = rewriter.createBlock(&body, body.end());
+  auto *exit = rewriter.createBlock(&body, body.end());
+
+  rewriter.setInsertionPointToEnd(entry);
+  auto zero = rewriter.create<LLVM::ConstantOp>(loc, i64Ty,
+                                                rewriter.getI64IntegerAttr(0));
+  rewriter.create<LLVM::BrOp>(loc, ValueRange({zero}), header);
+
+  rewriter.setInsertionPointToEnd(header);
+  auto index = header->getArgument(0);
+  auto more = rewriter.create<LLVM::ICmpOp>(loc, LLVM::ICmpPredicate::ult,
+                                            index, entry->getArgument(1));
+  rewriter.create<LLVM::CondBrOp>(loc, more, loop, ValueRange(), exit,
+                                  ValueRange());
+
+  // Load the pointers of the current instance and run the unit.
+  rewriter.setInsertionPointToEnd(loop);
+  auto loadElement = [&](Value array, Type elementTy) -> Value {
+    auto gep = rewriter.create<LLVM::GEPOp>(
+        loc, LLVM::LLVMPointerType::get(elementTy), array,
+        ArrayRef<Value>(index));
+    return rewriter.create<LLVM::LoadOp>(loc, elementTy, gep);
+  };
+  SmallVector<Value, 4> args(
+      {entry->getArgument(0), loadElement(entry->getArgument(2), unitArgTys[1]),
+       loadElement(entry->getArgument(3), unitArgTys[2])});
+  args.append(entry->args_begin() + 4, entry->args_end());
+  rewriter.create<LLVM::CallOp>(loc, voidTy,
+                                rewriter.getSymbolRefAttr(unit.getName()),
+                                args);
+  auto one = rewriter.create<LLVM::ConstantOp>(loc, i64Ty,
+                                               rewriter.getI64IntegerAttr(1));
+  auto next = rewriter.create<LLVM::AddOp>(loc, i64Ty, index, one);
+  rewriter.create<LLVM::BrOp>(loc, ValueRange({next}), header);
+
+  rewriter.setInsertionPointToEnd(exit);
+  rewriter.create<LLVM::ReturnOp>(loc, ValueRange());
+}
+
 namespace {
 /// Convert an `llhd.entity` entity to LLVM dialect. The result is an
 /// `llvm.func` which takes a pointer to the global simulation state, a pointer
 /// to the entity's local state, and a pointer to the instance's signal table as
-/// arguments.
+/// arguments, followed by a pointer to the drive buffer if drives are inlined.
+/// If batchEntities is set, a batched variant of the function is created too,
+/// see `createBatchFunction`.
 struct EntityOpConversion : public ConvertToLLVMPattern {
   explicit EntityOpConversion(MLIRContext *ctx,
                               LLVMTypeConverter &typeConverter,
-                              size_t &sigCounter, size_t &regCounter)
+                              size_t &sigCounter, size_t &regCounter,
+                              bool inlineDrives, bool batchEntities)
       : ConvertToLLVMPattern(llhd::EntityOp::getOperationName(), ctx,
                              typeConverter),
-        sigCounter(sigCounter), regCounter(regCounter) {}
+        sigCounter(sigCounter), regCounter(regCounter),
+        inlineDrives(inlineDrives), batchEntities(batchEntities) {}
 
   LogicalResult
   matchAndRewrite(Operation *op, ArrayRef<Value> operands,
@@ -746,11 +848,12 @@ struct EntityOpConversion : public ConvertToLLVMPattern {
 
     // Collect used llvm types.
     auto voidTy = getVoidType();
-    auto i8PtrTy = getVoidPtrType();
     auto i32Ty = IntegerType::get(rewriter.getContext(), 32);
     auto sigTy = getLLVMSigType(&getDialect());
     auto entityStatePtrTy =
         LLVM::LLVMPointerType::get(getRegStateTy(&getDialect(), op));
+    auto unitArgTys =
+        getUnitArgTypes(&getDialect(), entityStatePtrTy, inlineDrives);
 
     regCounter = 0;
 
@@ -759,8 +862,7 @@ struct EntityOpConversion : public ConvertToLLVMPattern {
     LLVMTypeConverter::SignatureConversion intermediate(
         entityOp.getNumArguments());
     // Add state and signal table arguments.
-    intermediate.addInputs(std::array<Type, 3>(
-        {i8PtrTy, entityStatePtrTy, LLVM::LLVMPointerType::get(sigTy)}));
+    intermediate.addInputs(unitArgTys);
     for (size_t i = 0, e = entityOp.getNumArguments(); i < e; ++i)
       intermediate.addInputs(i, voidTy);
     rewriter.applySignatureConversion(&entityOp.getBody(), intermediate);
@@ -769,9 +871,8 @@ struct EntityOpConversion : public ConvertToLLVMPattern {
         OpBuilder::atBlockBegin(&entityOp.getBlocks().front());
     LLVMTypeConverter::SignatureConversion final(
         intermediate.getConvertedTypes().size());
-    final.addInputs(0, i8PtrTy);
-    final.addInputs(1, entityStatePtrTy);
-    final.addInputs(2, LLVM::LLVMPointerType::get(sigTy));
+    for (size_t i = 0, e = unitArgTys.size(); i < e; ++i)
+      final.addInputs(i, unitArgTys[i]);
 
     // The first n elements of the signal table represent the entity arguments,
     // while the remaining elements represent the entity's owned signals.
@@ -784,14 +885,13 @@ struct EntityOpConversion : public ConvertToLLVMPattern {
           op->getLoc(), LLVM::LLVMPointerType::get(sigTy),
           entityOp.getArgument(2), ArrayRef<Value>(index));
       // Remap i-th original argument to the gep'd signal pointer.
-      final.remapInput(i + 3, gep.getResult());
+      final.remapInput(i + unitArgTys.size(), gep.getResult());
     }
 
     rewriter.applySignatureConversion(&entityOp.getBody(), final);
 
     // Get the converted entity signature.
-    auto funcTy = LLVM::LLVMFunctionType::get(
-        voidTy, {i8PtrTy, entityStatePtrTy, LLVM::LLVMPointerType::get(sigTy)});
+    auto funcTy = LLVM::LLVMFunctionType::get(voidTy, unitArgTys);
 
     // Create the a new llvm function to house the lowered entity.
     auto llvmFunc = rewriter.create<LLVM::LLVMFuncOp>(
@@ -801,6 +901,13 @@ struct EntityOpConversion : public ConvertToLLVMPattern {
     rewriter.inlineRegionBefore(entityOp.getBody(), llvmFunc.getBody(),
                                 llvmFunc.end());
 
+    // The simulator runs the instances of an entity woken up in the same step
+    // with one call of the batched variant, into which the entity can be
+    // inlined and optimized across instances.
+    if (batchEntities)
+      createBatchFunction(rewriter, op->getLoc(), llvmFunc, unitArgTys,
+                          voidTy);
+
     // Erase the original operation.
     rewriter.eraseOp(op);
 
@@ -810,6 +917,8 @@ struct EntityOpConversion : public ConvertToLLVMPattern {
 private:
   size_t &sigCounter;
   size_t &regCounter;
+  bool inlineDrives;
+  bool batchEntities;
 };
 } // namespace
 
@@ -837,8 +946,10 @@ namespace {
 /// logic to resume execution after an `llhd.wait` operation, as well as state
 /// keeping for values that need to persist across suspension.
 struct ProcOpConversion : public ConvertToLLVMPattern {
-  explicit ProcOpConversion(MLIRContext *ctx, LLVMTypeConverter &typeConverter)
-      : ConvertToLLVMPattern(ProcOp::getOperationName(), ctx, typeConverter) {}
+  explicit ProcOpConversion(MLIRContext *ctx, LLVMTypeConverter &typeConverter,
+                            bool inlineDrives)
+      : ConvertToLLVMPattern(ProcOp::getOperationName(), ctx, typeConverter),
+        inlineDrives(inlineDrives) {}
 
   LogicalResult
   matchAndRewrite(Operation *op, ArrayRef<Value> operands,
@@ -850,7 +961,6 @@ struct ProcOpConversion : public ConvertToLLVMPattern {
 
     // Collect used llvm types.
     auto voidTy = getVoidType();
-    auto i8PtrTy = getVoidPtrType();
     auto i1Ty = IntegerType::get(rewriter.getContext(), 1);
     auto i32Ty = IntegerType::get(rewriter.getContext(), 32);
     auto senseTableTy = LLVM::LLVMPointerType::get(
@@ -871,9 +981,8 @@ struct ProcOpConversion : public ConvertToLLVMPattern {
     LLVMTypeConverter::SignatureConversion intermediate(
         procOp.getNumArguments());
     // Add state, process state table and signal table arguments.
-    std::array<Type, 3> procArgTys({i8PtrTy,
-                                    LLVM::LLVMPointerType::get(stateTy),
-                                    LLVM::LLVMPointerType::get(sigTy)});
+    auto procArgTys = getUnitArgTypes(
+        &getDialect(), LLVM::LLVMPointerType::get(stateTy), inlineDrives);
     intermediate.addInputs(procArgTys);
     for (size_t i = 0, e = procOp.getNumArguments(); i < e; ++i)
       intermediate.addInputs(i, voidTy);
@@ -884,9 +993,8 @@ struct ProcOpConversion : public ConvertToLLVMPattern {
         OpBuilder::atBlockBegin(&procOp.getBlocks().front());
     LLVMTypeConverter::SignatureConversion final(
         intermediate.getConvertedTypes().size());
-    final.addInputs(0, i8PtrTy);
-    final.addInputs(1, LLVM::LLVMPointerType::get(stateTy));
-    final.addInputs(2, LLVM::LLVMPointerType::get(sigTy));
+    for (size_t i = 0, e = procArgTys.size(); i < e; ++i)
+      final.addInputs(i, procArgTys[i]);
 
     for (size_t i = 0, e = procOp.getNumArguments(); i < e; ++i) {
       // Create gep operations from the signal table for each original argument.
@@ -897,13 +1005,11 @@ struct ProcOpConversion : public ConvertToLLVMPattern {
           procOp.getArgument(2), ArrayRef<Value>({index}));
 
       // Remap the i-th original argument to the gep'd value.
-      final.remapInput(i + 3, gep.getResult());
+      final.remapInput(i + procArgTys.size(), gep.getResult());
     }
 
     // Get the converted process signature.
-    auto funcTy = LLVM::LLVMFunctionType::get(
-        voidTy, {i8PtrTy, LLVM::LLVMPointerType::get(stateTy),
-                 LLVM::LLVMPointerType::get(sigTy)});
+    auto funcTy = LLVM::LLVMFunctionType::get(voidTy, procArgTys);
     // Create a new llvm function to house the lowered process.
     auto llvmFunc = rewriter.create<LLVM::LLVMFuncOp>(op->getLoc(),
                                                       procOp.getName(), funcTy);
@@ -926,6 +1032,9 @@ struct ProcOpConversion : public ConvertToLLVMPattern {
 
     return success();
   }
+
+private:
+  bool inlineDrives;
 };
 } // namespace
 
@@ -1094,7 +1203,8 @@ struct WaitOpConversion : public ConvertToLLVMPattern {
 namespace {
 /// Lower an llhd.inst operation to LLVM dialect. This generates malloc calls
 /// and allocSignal calls (to store the pointer into the state) for each signal
-/// in the instantiated entity.
+/// in the instantiated entity. The entity and process states are allocated
+/// from the simulation state with allocInstanceState calls.
 struct InstOpConversion : public ConvertToLLVMPattern {
   explicit InstOpConversion(MLIRContext *ctx, LLVMTypeConverter &typeConverter)
       : ConvertToLLVMPattern(InstOp::getOperationName(), ctx, typeConverter) {}
@@ -1126,40 +1236,59 @@ struct InstOpConversion : public ConvertToLLVMPattern {
     auto mallFunc = getOrInsertFunction(module, rewriter, op->getLoc(),
                                         "malloc", mallocSigFuncTy);
 
+    // Get or insert the allocInstanceState library call definition, which
+    // allocates the entity and process states from the simulation state.
+    // Signature: (i8* state, i64 size) -> i8* pointer
+    auto allocStateFuncTy =
+        LLVM::LLVMFunctionType::get(i8PtrTy, {i8PtrTy, i64Ty});
+    auto allocStateFunc =
+        getOrInsertFunction(module, rewriter, op->getLoc(),
+                            "allocInstanceState", allocStateFuncTy);
+
     // Get or insert the allocSignal library call definition.
-    // allocSignal function signature: (i8* %state, i8* %sig_name, i8*
-    // %sig_owner, i32 %value) -> i32 %sig_index.
+    // allocSignal function signature: (i8* %state, i32 %sig_index, i8*
+    // %sig_owner, i8* %value, i64 %size, i64 %width) -> i32 %sig_index.
     auto allocSigFuncTy = LLVM::LLVMFunctionType::get(
-        i32Ty, {i8PtrTy, i32Ty, i8PtrTy, i8PtrTy, i64Ty});
+        i32Ty, {i8PtrTy, i32Ty, i8PtrTy, i8PtrTy, i64Ty, i64Ty});
     auto sigFunc = getOrInsertFunction(module, rewriter, op->getLoc(),
                                        "allocSignal", allocSigFuncTy);
 
     // Add information about the elements of an array signal to the state.
-    // Signature: (i8* state, i32 signalIndex, i32 size, i32 numElements) ->
-    // void
-    auto addSigArrElemFuncTy =
-        LLVM::LLVMFunctionType::get(voidTy, {i8PtrTy, i32Ty, i32Ty, i32Ty});
+    // Signature: (i8* state, i32 signalIndex, i32 size, i32 numElements,
+    // i32 width) -> void
+    auto addSigArrElemFuncTy = LLVM::LLVMFunctionType::get(
+        voidTy, {i8PtrTy, i32Ty, i32Ty, i32Ty, i32Ty});
     auto addSigElemFunc =
         getOrInsertFunction(module, rewriter, op->getLoc(),
                             "addSigArrayElements", addSigArrElemFuncTy);
 
     // Add information about one element of a struct signal to the state.
-    // Signature: (i8* state, i32 signalIndex, i32 offset, i32 size) -> void
-    auto addSigStructElemFuncTy =
-        LLVM::LLVMFunctionType::get(voidTy, {i8PtrTy, i32Ty, i32Ty, i32Ty});
+    // Signature: (i8* state, i32 signalIndex, i32 offset, i32 size, i32 width)
+    // -> void
+    auto addSigStructElemFuncTy = LLVM::LLVMFunctionType::get(
+        voidTy, {i8PtrTy, i32Ty, i32Ty, i32Ty, i32Ty});
     auto addSigStructFunc =
         getOrInsertFunction(module, rewriter, op->getLoc(),
                             "addSigStructElement", addSigStructElemFuncTy);
 
     // Get or insert allocProc library call definition.
-    auto allocProcFuncTy =
-        LLVM::LLVMFunctionType::get(voidTy, {i8PtrTy, i8PtrTy, i8PtrTy});
+    // Signature: (i8* state, i8* owner, i8* procState, i64 size) -> void
+    auto allocProcFuncTy = LLVM::LLVMFunctionType::get(
+        voidTy, {i8PtrTy, i8PtrTy, i8PtrTy, i64Ty});
     auto allocProcFunc = getOrInsertFunction(module, rewriter, op->getLoc(),
                                              "allocProc", allocProcFuncTy);
 
+    // Get or insert addProcSignal library call definition.
+    // Signature: (i8* state, i8* procState, i64 offset) -> void
+    auto addProcSignalFuncTy =
+        LLVM::LLVMFunctionType::get(voidTy, {i8PtrTy, i8PtrTy, i64Ty});
+    auto addProcSignalFunc = getOrInsertFunction(
+        module, rewriter, op->getLoc(), "addProcSignal", addProcSignalFuncTy);
+
     // Get or insert allocEntity library call definition.
-    auto allocEntityFuncTy =
-        LLVM::LLVMFunctionType::get(voidTy, {i8PtrTy, i8PtrTy, i8PtrTy});
+    // Signature: (i8* state, i8* owner, i8* entityState, i64 size) -> void
+    auto allocEntityFuncTy = LLVM::LLVMFunctionType::get(
+        voidTy, {i8PtrTy, i8PtrTy, i8PtrTy, i64Ty});
     auto allocEntityFunc = getOrInsertFunction(
         module, rewriter, op->getLoc(), "allocEntity", allocEntityFuncTy);
 
@@ -1201,12 +1330,12 @@ struct InstOpConversion : public ConvertToLLVMPattern {
       auto regSize =
           initBuilder.create<LLVM::PtrToIntOp>(op->getLoc(), i64Ty, regGep);
 
-      // Malloc reg state.
+      // Allocate reg state.
       auto regMall =
           initBuilder
               .create<LLVM::CallOp>(op->getLoc(), i8PtrTy,
-                                    rewriter.getSymbolRefAttr(mallFunc),
-                                    ArrayRef<Value>({regSize}))
+                                    rewriter.getSymbolRefAttr(allocStateFunc),
+                                    ArrayRef<Value>({initStatePtr, regSize}))
               .getResult(0);
       auto regMallBC = initBuilder.create<LLVM::BitcastOp>(
           op->getLoc(), regStatePtrTy, regMall);
@@ -1236,7 +1365,17 @@ struct InstOpConversion : public ConvertToLLVMPattern {
       // Add reg state pointer to global state.
       initBuilder.create<LLVM::CallOp>(
           op->getLoc(), voidTy, rewriter.getSymbolRefAttr(allocEntityFunc),
-          ArrayRef<Value>({initStatePtr, owner, regMall}));
+          ArrayRef<Value>({initStatePtr, owner, regMall, regSize}));
+
+      // The width in bits of the integer signals and elements, used to trace
+      // them. Zero for the other types.
+      auto getWidthConst = [&](Location loc, Type type, Type constTy) {
+        unsigned width = 0;
+        if (auto intTy = type.dyn_cast<IntegerType>())
+          width = intTy.getWidth();
+        return initBuilder.create<LLVM::ConstantOp>(
+            loc, constTy, rewriter.getIntegerAttr(constTy, width));
+      };
 
       // Index of the signal in the entity's signal table.
       int initCounter = 0;
@@ -1293,8 +1432,9 @@ struct InstOpConversion : public ConvertToLLVMPattern {
           passSize = size;
         }
 
-        std::array<Value, 5> args(
-            {initStatePtr, indexConst, owner, mall, passSize});
+        std::array<Value, 6> args(
+            {initStatePtr, indexConst, owner, mall, passSize,
+             getWidthConst(op.getLoc(), underlyingTy, i64Ty)});
         auto sigIndex =
             initBuilder
                 .create<LLVM::CallOp>(op.getLoc(), i32Ty,
@@ -1323,7 +1463,10 @@ struct InstOpConversion : public ConvertToLLVMPattern {
           initBuilder.create<LLVM::CallOp>(
               op.getLoc(), llvm::None,
               rewriter.getSymbolRefAttr(addSigElemFunc),
-              ArrayRef<Value>({initStatePtr, sigIndex, toInt, numElements}));
+              ArrayRef<Value>(
+                  {initStatePtr, sigIndex, toInt, numElements,
+                   getWidthConst(op.getLoc(), arrayTy.getElementType(),
+                                 i32Ty)}));
         } else if (auto structTy =
                        underlyingTy.dyn_cast<LLVM::LLVMStructType>()) {
           auto zeroC = initBuilder.create<LLVM::ConstantOp>(
@@ -1358,7 +1501,9 @@ struct InstOpConversion : public ConvertToLLVMPattern {
                 op.getLoc(), llvm::None,
                 rewriter.getSymbolRefAttr(addSigStructFunc),
                 ArrayRef<Value>(
-                    {initStatePtr, sigIndex, elemToInt, elemSizeToInt}));
+                    {initStatePtr, sigIndex, elemToInt, elemSizeToInt,
+                     getWidthConst(op.getLoc(), structTy.getBody()[i],
+                                   i32Ty)}));
           }
         }
       });
@@ -1366,11 +1511,13 @@ struct InstOpConversion : public ConvertToLLVMPattern {
       // Handle process instantiation.
       auto sensesPtrTy = LLVM::LLVMPointerType::get(
           LLVM::LLVMArrayType::get(i1Ty, proc.getNumArguments()));
+      SmallVector<unsigned, 4> sigFields;
       auto procStatePtrTy =
           LLVM::LLVMPointerType::get(LLVM::LLVMStructType::getLiteral(
               rewriter.getContext(),
               {i32Ty, i32Ty, sensesPtrTy,
-               getProcPersistenceTy(&getDialect(), typeConverter, proc)}));
+               getProcPersistenceTy(&getDialect(), typeConverter, proc,
+                                    &sigFields)}));
 
       auto zeroC = initBuilder.create<LLVM::ConstantOp>(
           op->getLoc(), i32Ty, rewriter.getI32IntegerAttr(0));
@@ -1387,11 +1534,11 @@ struct InstOpConversion : public ConvertToLLVMPattern {
           ArrayRef<Value>({oneC}));
       auto procStateSize = initBuilder.create<LLVM::PtrToIntOp>(
           op->getLoc(), i64Ty, procStateGep);
-      std::array<Value, 1> procStateMArgs({procStateSize});
+      std::array<Value, 2> procStateMArgs({initStatePtr, procStateSize});
       auto procStateMall =
           initBuilder
               .create<LLVM::CallOp>(op->getLoc(), i8PtrTy,
-                                    rewriter.getSymbolRefAttr(mallFunc),
+                                    rewriter.getSymbolRefAttr(allocStateFunc),
                                     procStateMArgs)
               .getResult(0);
 
@@ -1404,19 +1551,20 @@ struct InstOpConversion : public ConvertToLLVMPattern {
           ArrayRef<Value>({zeroC, oneC}));
       initBuilder.create<LLVM::StoreOp>(op->getLoc(), zeroC, resumeGep);
 
-      // Malloc space for the senses table.
+      // Allocate space for the senses table.
       auto sensesNullPtr =
           initBuilder.create<LLVM::NullOp>(op->getLoc(), sensesPtrTy);
       auto sensesGep = initBuilder.create<LLVM::GEPOp>(
           op->getLoc(), sensesPtrTy, sensesNullPtr, ArrayRef<Value>({oneC}));
       auto sensesSize =
           initBuilder.create<LLVM::PtrToIntOp>(op->getLoc(), i64Ty, sensesGep);
-      std::array<Value, 1> senseMArgs({sensesSize});
-      auto sensesMall = initBuilder
-                            .create<LLVM::CallOp>(
-                                op->getLoc(), i8PtrTy,
-                                rewriter.getSymbolRefAttr(mallFunc), senseMArgs)
-                            .getResult(0);
+      std::array<Value, 2> senseMArgs({initStatePtr, sensesSize});
+      auto sensesMall =
+          initBuilder
+              .create<LLVM::CallOp>(op->getLoc(), i8PtrTy,
+                                    rewriter.getSymbolRefAttr(allocStateFunc),
+                                    senseMArgs)
+              .getResult(0);
 
       auto sensesBC = initBuilder.create<LLVM::BitcastOp>(
           op->getLoc(), sensesPtrTy, sensesMall);
@@ -1444,10 +1592,30 @@ struct InstOpConversion : public ConvertToLLVMPattern {
       initBuilder.create<LLVM::StoreOp>(op->getLoc(), sensesBC,
                                         procStateSensesPtr);
 
-      std::array<Value, 3> allocProcArgs({initStatePtr, owner, procStateMall});
+      std::array<Value, 4> allocProcArgs(
+          {initStatePtr, owner, procStateMall, procStateSize});
       initBuilder.create<LLVM::CallOp>(op->getLoc(), voidTy,
                                        rewriter.getSymbolRefAttr(allocProcFunc),
                                        allocProcArgs);
+
+      // Tell the state where the persisted signals are, their value pointers
+      // have to be relocated when a checkpoint is restored.
+      auto threeC = initBuilder.create<LLVM::ConstantOp>(
+          op->getLoc(), i32Ty, rewriter.getI32IntegerAttr(3));
+      for (auto field : sigFields) {
+        auto fieldC = initBuilder.create<LLVM::ConstantOp>(
+            op->getLoc(), i32Ty, rewriter.getI32IntegerAttr(field));
+        auto fieldGep = initBuilder.create<LLVM::GEPOp>(
+            op->getLoc(),
+            LLVM::LLVMPointerType::get(getLLVMSigType(&getDialect())),
+            procStateNullPtr,
+            ArrayRef<Value>({zeroC, threeC, fieldC}));
+        auto fieldOffset = initBuilder.create<LLVM::PtrToIntOp>(
+            op->getLoc(), i64Ty, fieldGep);
+        initBuilder.create<LLVM::CallOp>(
+            op->getLoc(), voidTy, rewriter.getSymbolRefAttr(addProcSignalFunc),
+            ArrayRef<Value>({initStatePtr, procStateMall, fieldOffset}));
+      }
     }
 
     rewriter.eraseOp(op);
@@ -1569,9 +1737,11 @@ namespace {
 /// the module if missing. The required arguments are either generated or
 /// fetched.
 struct DrvOpConversion : public ConvertToLLVMPattern {
-  explicit DrvOpConversion(MLIRContext *ctx, LLVMTypeConverter &typeConverter)
+  explicit DrvOpConversion(MLIRContext *ctx, LLVMTypeConverter &typeConverter,
+                           bool inlineDrives)
       : ConvertToLLVMPattern(llhd::DrvOp::getOperationName(), ctx,
-                             typeConverter) {}
+                             typeConverter),
+        inlineDrives(inlineDrives) {}
 
   LogicalResult
   matchAndRewrite(Operation *op, ArrayRef<Value> operands,
@@ -1643,6 +1813,80 @@ struct DrvOpConversion : public ConvertToLLVMPattern {
       rewriter.setInsertionPointToStart(drvBlock);
     }
 
+    // Get the time values.
+    Value realTime, delta, eps;
+    auto extractTime = [&]() {
+      realTime = rewriter.create<LLVM::ExtractValueOp>(
+          op->getLoc(), i64Ty, transformed.time(), rewriter.getI32ArrayAttr(0));
+      delta = rewriter.create<LLVM::ExtractValueOp>(
+          op->getLoc(), i64Ty, transformed.time(), rewriter.getI32ArrayAttr(1));
+      eps = rewriter.create<LLVM::ExtractValueOp>(
+          op->getLoc(), i64Ty, transformed.time(), rewriter.getI32ArrayAttr(2));
+    };
+
+    // Append drives of integers fitting in one word to the drive buffer, which
+    // the simulator commits in bulk. Only call into the runtime if the buffer
+    // is full.
+    if (inlineDrives && underlyingTy.isa<IntegerType>() &&
+        underlyingTy.getIntOrFloatBitWidth() <= 64) {
+      extractTime();
+      auto block = rewriter.getInsertionBlock();
+      auto continueBlock =
+          rewriter.splitBlock(block, rewriter.getInsertionPoint());
+      auto callBlock = rewriter.createBlock(continueBlock);
+      auto appendBlock = rewriter.createBlock(callBlock);
+      rewriter.setInsertionPointToEnd(block);
+
+      auto driveBuffer =
+          op->getParentOfType<LLVM::LLVMFuncOp>().getArgument(3);
+      auto zeroC = rewriter.create<LLVM::ConstantOp>(
+          op->getLoc(), i32Ty, rewriter.getI32IntegerAttr(0));
+      auto gepField = [&](Value ptr, unsigned field, Type fieldTy) -> Value {
+        auto fieldC = rewriter.create<LLVM::ConstantOp>(
+            op->getLoc(), i32Ty, rewriter.getI32IntegerAttr(field));
+        return rewriter.create<LLVM::GEPOp>(
+            op->getLoc(), LLVM::LLVMPointerType::get(fieldTy), ptr,
+            ArrayRef<Value>({zeroC, fieldC}));
+      };
+      auto sizePtr = gepField(driveBuffer, 1, i64Ty);
+      auto size = rewriter.create<LLVM::LoadOp>(op->getLoc(), i64Ty, sizePtr);
+      auto capacity = rewriter.create<LLVM::LoadOp>(
+          op->getLoc(), i64Ty, gepField(driveBuffer, 2, i64Ty));
+      auto isFull = rewriter.create<LLVM::ICmpOp>(
+          op->getLoc(), LLVM::ICmpPredicate::uge, size, capacity);
+      rewriter.create<LLVM::CondBrOp>(op->getLoc(), isFull, callBlock,
+                                      appendBlock);
+
+      // Store the drive in the next free entry.
+      rewriter.setInsertionPointToEnd(appendBlock);
+      auto entriesPtrTy = getLLVMDriveBufferType(&getDialect())
+                              .cast<LLVM::LLVMStructType>()
+                              .getBody()[0];
+      auto entries = rewriter.create<LLVM::LoadOp>(
+          op->getLoc(), entriesPtrTy, gepField(driveBuffer, 0, entriesPtrTy));
+      auto entry = rewriter.create<LLVM::GEPOp>(
+          op->getLoc(), entriesPtrTy, entries, ArrayRef<Value>(size));
+      Value value = transformed.value();
+      if (underlyingTy.getIntOrFloatBitWidth() < 64)
+        value = rewriter.create<LLVM::ZExtOp>(op->getLoc(), i64Ty, value);
+      std::array<Value, 6> fields(
+          {transformed.signal(), value, sigWidth, realTime, delta, eps});
+      for (unsigned i = 0; i < fields.size(); ++i)
+        rewriter.create<LLVM::StoreOp>(
+            op->getLoc(), fields[i],
+            gepField(entry, i, fields[i].getType()));
+      auto oneC = rewriter.create<LLVM::ConstantOp>(
+          op->getLoc(), i64Ty, rewriter.getI64IntegerAttr(1));
+      auto newSize = rewriter.create<LLVM::AddOp>(op->getLoc(), size, oneC);
+      rewriter.create<LLVM::StoreOp>(op->getLoc(), newSize, sizePtr);
+      rewriter.create<LLVM::BrOp>(op->getLoc(), ValueRange(), continueBlock);
+
+      // Fall back to the runtime library call otherwise.
+      rewriter.setInsertionPointToEnd(callBlock);
+      rewriter.create<LLVM::BrOp>(op->getLoc(), ValueRange(), continueBlock);
+      rewriter.setInsertionPointToStart(callBlock);
+    }
+
     auto oneConst = rewriter.create<LLVM::ConstantOp>(
         op->getLoc(), i32Ty, rewriter.getI32IntegerAttr(1));
     auto alloca = rewriter.create<LLVM::AllocaOp>(
@@ -1650,14 +1894,8 @@ struct DrvOpConversion : public ConvertToLLVMPattern {
         oneConst, 4);
     rewriter.create<LLVM::StoreOp>(op->getLoc(), transformed.value(), alloca);
     auto bc = rewriter.create<LLVM::BitcastOp>(op->getLoc(), i8PtrTy, alloca);
-
-    // Get the time values.
-    auto realTime = rewriter.create<LLVM::ExtractValueOp>(
-        op->getLoc(), i64Ty, transformed.time(), rewriter.getI32ArrayAttr(0));
-    auto delta = rewriter.create<LLVM::ExtractValueOp>(
-        op->getLoc(), i64Ty, transformed.time(), rewriter.getI32ArrayAttr(1));
-    auto eps = rewriter.create<LLVM::ExtractValueOp>(
-        op->getLoc(), i64Ty, transformed.time(), rewriter.getI32ArrayAttr(2));
+    if (!realTime)
+      extractTime();
 
     // Define the driveSignal library call arguments.
     std::array<Value, 7> args(
@@ -1669,6 +1907,9 @@ struct DrvOpConversion : public ConvertToLLVMPattern {
     rewriter.eraseOp(op);
     return success();
   }
+
+private:
+  bool inlineDrives;
 };
 } // namespace
 
@@ -2703,13 +2944,19 @@ using LoadOpConversion =
 namespace {
 struct LLHDToLLVMLoweringPass
     : public ConvertLLHDToLLVMBase<LLHDToLLVMLoweringPass> {
+  LLHDToLLVMLoweringPass() = default;
+  LLHDToLLVMLoweringPass(bool inlineDrives, bool batchEntities) {
+    this->inlineDrives = inlineDrives;
+    this->batchEntities = batchEntities;
+  }
   void runOnOperation() override;
 };
 } // namespace
 
 void llhd::populateLLHDToLLVMConversionPatterns(
     LLVMTypeConverter &converter, OwningRewritePatternList &patterns,
-    size_t &sigCounter, size_t &regCounter) {
+    size_t &sigCounter, size_t &regCounter, bool inlineDrives,
+    bool batchEntities) {
   MLIRContext *ctx = converter.getDialect()->getContext();
 
   // Value creation conversion patterns.
@@ -2735,12 +2982,15 @@ void llhd::populateLLHDToLLVMConversionPatterns(
                                                                     converter);
 
   // Unit conversion patterns.
-  patterns.insert<TerminatorOpConversion, ProcOpConversion, WaitOpConversion,
-                  HaltOpConversion>(ctx, converter);
-  patterns.insert<EntityOpConversion>(ctx, converter, sigCounter, regCounter);
+  patterns.insert<TerminatorOpConversion, WaitOpConversion, HaltOpConversion>(
+      ctx, converter);
+  patterns.insert<ProcOpConversion>(ctx, converter, inlineDrives);
+  patterns.insert<EntityOpConversion>(ctx, converter, sigCounter, regCounter,
+                                      inlineDrives, batchEntities);
 
   // Signal conversion patterns.
-  patterns.insert<PrbOpConversion, DrvOpConversion>(ctx, converter);
+  patterns.insert<PrbOpConversion>(ctx, converter);
+  patterns.insert<DrvOpConversion>(ctx, converter, inlineDrives);
   patterns.insert<SigOpConversion>(ctx, converter, sigCounter);
   patterns.insert<RegOpConversion>(ctx, converter, regCounter);
 
@@ -2785,7 +3035,7 @@ void LLHDToLLVMLoweringPass::runOnOperation() {
   // Setup the full conversion.
   populateStdToLLVMConversionPatterns(converter, patterns);
   populateLLHDToLLVMConversionPatterns(converter, patterns, sigCounter,
-                                       regCounter);
+                                       regCounter, inlineDrives, batchEntities);
 
   target.addLegalDialect<LLVM::LLVMDialect>();
   target.addLegalOp<ModuleOp, ModuleTerminatorOp>();
@@ -2798,8 +3048,10 @@ void LLHDToLLVMLoweringPass::runOnOperation() {
 
 /// Create an LLHD to LLVM conversion pass.
 std::unique_ptr<OperationPass<ModuleOp>>
-circt::llhd::createConvertLLHDToLLVMPass() {
-  return std::make_unique<LLHDToLLVMLoweringPass>();
+circt::llhd::createConvertLLHDToLLVMPass(bool inlineDrives,
+                                         bool batchEntities) {
+  return std::make_unique<LLHDToLLVMLoweringPass>(inlineDrives,
+                                                  batchEntities);
 }
 
 /// Register the LLHD to LLVM convesion pass.
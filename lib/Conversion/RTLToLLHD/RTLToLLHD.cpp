@@ -15,9 +15,12 @@
 #include "circt/Dialect/LLHD/IR/LLHDOps.h"
 #include "circt/Dialect/RTL/RTLDialect.h"
 #include "circt/Dialect/RTL/RTLOps.h"
+#include "circt/Dialect/SV/SVOps.h"
+#include "mlir/Dialect/StandardOps/IR/Ops.h"
 #include "mlir/IR/BuiltinTypes.h"
 #include "mlir/Pass/Pass.h"
 #include "mlir/Transforms/DialectConversion.h"
+#include "llvm/ADT/MapVector.h"
 
 namespace circt {
 namespace llhd {
@@ -63,6 +66,23 @@ void circt::llhd::registerRTLToLLHDPasses() { registerPasses(); }
 /// Forward declare conversion patterns.
 struct ConvertRTLModule;
 struct ConvertOutput;
+struct ConvertConstant;
+template <typename SourceOp, typename TargetOp>
+struct ConvertVariadic;
+struct ConvertICmp;
+struct ConvertMux;
+struct ConvertExtract;
+struct ConvertConcat;
+struct ConvertSExt;
+struct ConvertAndR;
+struct ConvertOrR;
+struct ConvertXorR;
+struct ConvertWire;
+struct ConvertConnect;
+struct ConvertReadInOut;
+struct ConvertReg;
+struct ConvertAlways;
+struct ConvertSimulationInit;
 
 /// This is the main entrypoint for the RTL to LLHD conversion pass.
 void RTLToLLHDPass::runOnOperation() {
@@ -70,14 +90,43 @@ void RTLToLLHDPass::runOnOperation() {
   ModuleOp module = getOperation();
 
   ConversionTarget target(context);
-  target.addLegalDialect<LLHDDialect>();
+  target.addLegalDialect<LLHDDialect, StandardOpsDialect>();
   target.addIllegalOp<RTLModuleOp>();
+  target.addIllegalOp<rtl::ConstantOp, rtl::AddOp, rtl::SubOp, rtl::MulOp,
+                      rtl::DivUOp, rtl::DivSOp, rtl::ModUOp, rtl::ModSOp,
+                      rtl::ShlOp, rtl::ShrUOp, rtl::ShrSOp, rtl::AndOp,
+                      rtl::OrOp, rtl::XorOp, rtl::ICmpOp, rtl::MuxOp,
+                      rtl::ExtractOp, rtl::ConcatOp, rtl::SExtOp, rtl::AndROp,
+                      rtl::OrROp, rtl::XorROp>();
+  target.addIllegalOp<rtl::WireOp, rtl::ConnectOp, rtl::ReadInOutOp,
+                      sv::RegOp, sv::AlwaysOp>();
 
   RTLToLLHDTypeConverter typeConverter;
   OwningRewritePatternList patterns;
   patterns.insert<ConvertRTLModule>(typeConverter, &context);
   patterns.insert<ConvertOutput>(typeConverter, &context);
 
+  // Combinational logic is converted to plain values within the entity, such
+  // that only ports, wires and registers become signals.
+  patterns.insert<ConvertConstant, ConvertICmp, ConvertMux, ConvertExtract,
+                  ConvertConcat, ConvertSExt, ConvertAndR, ConvertOrR,
+                  ConvertXorR>(&context);
+  patterns.insert<ConvertVariadic<rtl::AddOp, AddIOp>,
+                  ConvertVariadic<rtl::SubOp, SubIOp>,
+                  ConvertVariadic<rtl::MulOp, MulIOp>,
+                  ConvertVariadic<rtl::DivUOp, UnsignedDivIOp>,
+                  ConvertVariadic<rtl::DivSOp, SignedDivIOp>,
+                  ConvertVariadic<rtl::ModUOp, UnsignedRemIOp>,
+                  ConvertVariadic<rtl::ModSOp, SignedRemIOp>,
+                  ConvertVariadic<rtl::ShlOp, ShiftLeftOp>,
+                  ConvertVariadic<rtl::ShrUOp, UnsignedShiftRightOp>,
+                  ConvertVariadic<rtl::ShrSOp, SignedShiftRightOp>,
+                  ConvertVariadic<rtl::AndOp, mlir::AndOp>,
+                  ConvertVariadic<rtl::OrOp, mlir::OrOp>,
+                  ConvertVariadic<rtl::XorOp, XOrOp>>(&context);
+  patterns.insert<ConvertWire, ConvertConnect, ConvertReadInOut, ConvertReg,
+                  ConvertAlways, ConvertSimulationInit>(&context);
+
   if (failed(applyPartialConversion(module, target, std::move(patterns))))
     signalPassFailure();
 }
@@ -146,6 +195,25 @@ struct ConvertRTLModule : public OpConversionPattern<RTLModuleOp> {
   }
 };
 
+//===----------------------------------------------------------------------===//
+// Conversion helpers
+//===----------------------------------------------------------------------===//
+
+/// Return the value carried by `value`, probing it if it is a signal.
+static Value getProbedValue(Value value, Location loc,
+                            ConversionPatternRewriter &rewriter) {
+  if (auto sigTy = value.getType().dyn_cast<SigType>())
+    return rewriter.create<PrbOp>(loc, sigTy.getUnderlyingType(), value);
+  return value;
+}
+
+/// Construct the `1d` time value used for drives and register updates.
+static Value getDeltaTime(Location loc, ConversionPatternRewriter &rewriter) {
+  auto timeType = TimeType::get(rewriter.getContext());
+  auto deltaAttr = TimeAttr::get(timeType, {0, 1, 0}, "ns");
+  return rewriter.create<ConstOp>(loc, timeType, deltaAttr);
+}
+
 /// This works on each output op, creating ops to drive the appropriate results.
 struct ConvertOutput : public OpConversionPattern<OutputOp> {
   using OpConversionPattern::OpConversionPattern;
@@ -154,9 +222,7 @@ struct ConvertOutput : public OpConversionPattern<OutputOp> {
   matchAndRewrite(OutputOp output, ArrayRef<Value> operands,
                   ConversionPatternRewriter &rewriter) const override {
     // Construct the `1d` time value for the drive.
-    auto timeType = TimeType::get(rewriter.getContext());
-    auto deltaAttr = TimeAttr::get(timeType, {0, 1, 0}, "ns");
-    auto delta = rewriter.create<ConstOp>(output.getLoc(), timeType, deltaAttr);
+    auto delta = getDeltaTime(output.getLoc(), rewriter);
 
     // Get the number of inputs in the entity to offset into the block args.
     auto entity = output->getParentOfType<EntityOp>();
@@ -170,9 +236,7 @@ struct ConvertOutput : public OpConversionPattern<OutputOp> {
       assert(src && dest && "output operand must map to result block arg");
 
       // If the source has a signal type, probe it.
-      if (auto sigTy = src.getType().dyn_cast<SigType>())
-        src = rewriter.create<PrbOp>(output.getLoc(), sigTy.getUnderlyingType(),
-                                     src);
+      src = getProbedValue(src, output.getLoc(), rewriter);
 
       // Drive the destination block argument value.
       rewriter.create<DrvOp>(output.getLoc(), dest, src, delta, Value());
@@ -184,3 +248,406 @@ struct ConvertOutput : public OpConversionPattern<OutputOp> {
     return success();
   }
 };
+
+//===----------------------------------------------------------------------===//
+// Convert combinational operations
+//===----------------------------------------------------------------------===//
+
+/// Convert a constant to an LLHD constant.
+struct ConvertConstant : public OpConversionPattern<rtl::ConstantOp> {
+  using OpConversionPattern::OpConversionPattern;
+
+  LogicalResult
+  matchAndRewrite(rtl::ConstantOp op, ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const override {
+    rewriter.replaceOpWithNewOp<ConstOp>(op, op.getType(), op.valueAttr());
+    return success();
+  }
+};
+
+/// Convert a binary or variadic operation to a left-leaning chain of binary
+/// standard operations.
+template <typename SourceOp, typename TargetOp>
+struct ConvertVariadic : public OpConversionPattern<SourceOp> {
+  using OpConversionPattern<SourceOp>::OpConversionPattern;
+
+  LogicalResult
+  matchAndRewrite(SourceOp op, ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const override {
+    Value result = getProbedValue(operands.front(), op.getLoc(), rewriter);
+    for (auto operand : operands.drop_front())
+      result = rewriter.create<TargetOp>(
+          op.getLoc(), result, getProbedValue(operand, op.getLoc(), rewriter));
+    rewriter.replaceOp(op, result);
+    return success();
+  }
+};
+
+/// Convert an integer comparison to the equivalent standard comparison.
+struct ConvertICmp : public OpConversionPattern<rtl::ICmpOp> {
+  using OpConversionPattern::OpConversionPattern;
+
+  LogicalResult
+  matchAndRewrite(rtl::ICmpOp op, ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const override {
+    CmpIPredicate predicate;
+    switch (op.predicate()) {
+    case ICmpPredicate::eq:
+      predicate = CmpIPredicate::eq;
+      break;
+    case ICmpPredicate::ne:
+      predicate = CmpIPredicate::ne;
+      break;
+    case ICmpPredicate::slt:
+      predicate = CmpIPredicate::slt;
+      break;
+    case ICmpPredicate::sle:
+      predicate = CmpIPredicate::sle;
+      break;
+    case ICmpPredicate::sgt:
+      predicate = CmpIPredicate::sgt;
+      break;
+    case ICmpPredicate::sge:
+      predicate = CmpIPredicate::sge;
+      break;
+    case ICmpPredicate::ult:
+      predicate = CmpIPredicate::ult;
+      break;
+    case ICmpPredicate::ule:
+      predicate = CmpIPredicate::ule;
+      break;
+    case ICmpPredicate::ugt:
+      predicate = CmpIPredicate::ugt;
+      break;
+    case ICmpPredicate::uge:
+      predicate = CmpIPredicate::uge;
+      break;
+    }
+    rewriter.replaceOpWithNewOp<CmpIOp>(
+        op, predicate, getProbedValue(operands[0], op.getLoc(), rewriter),
+        getProbedValue(operands[1], op.getLoc(), rewriter));
+    return success();
+  }
+};
+
+/// Convert a mux to a select.
+struct ConvertMux : public OpConversionPattern<rtl::MuxOp> {
+  using OpConversionPattern::OpConversionPattern;
+
+  LogicalResult
+  matchAndRewrite(rtl::MuxOp op, ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const override {
+    auto loc = op.getLoc();
+    rewriter.replaceOpWithNewOp<SelectOp>(
+        op, getProbedValue(operands[0], loc, rewriter),
+        getProbedValue(operands[1], loc, rewriter),
+        getProbedValue(operands[2], loc, rewriter));
+    return success();
+  }
+};
+
+/// Convert a bit extraction to an LLHD slice extraction.
+struct ConvertExtract : public OpConversionPattern<rtl::ExtractOp> {
+  using OpConversionPattern::OpConversionPattern;
+
+  LogicalResult
+  matchAndRewrite(rtl::ExtractOp op, ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const override {
+    rewriter.replaceOpWithNewOp<ExtractSliceOp>(
+        op, op.getType(), getProbedValue(operands[0], op.getLoc(), rewriter),
+        rewriter.getIndexAttr(op.lowBit()));
+    return success();
+  }
+};
+
+/// Convert a concatenation to a sequence of LLHD slice insertions into a zero
+/// value, the first operand ending up in the most significant bits.
+struct ConvertConcat : public OpConversionPattern<rtl::ConcatOp> {
+  using OpConversionPattern::OpConversionPattern;
+
+  LogicalResult
+  matchAndRewrite(rtl::ConcatOp op, ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const override {
+    auto loc = op.getLoc();
+    Value result = rewriter.create<ConstOp>(
+        loc, op.getType(), rewriter.getIntegerAttr(op.getType(), 0));
+    unsigned offset = op.getType().getIntOrFloatBitWidth();
+    for (auto operand : operands) {
+      auto value = getProbedValue(operand, loc, rewriter);
+      offset -= value.getType().getIntOrFloatBitWidth();
+      result = rewriter.create<InsertSliceOp>(loc, op.getType(), result, value,
+                                              rewriter.getIndexAttr(offset));
+    }
+    rewriter.replaceOp(op, result);
+    return success();
+  }
+};
+
+/// Convert a sign extension to the equivalent standard operation.
+struct ConvertSExt : public OpConversionPattern<rtl::SExtOp> {
+  using OpConversionPattern::OpConversionPattern;
+
+  LogicalResult
+  matchAndRewrite(rtl::SExtOp op, ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const override {
+    rewriter.replaceOpWithNewOp<SignExtendIOp>(
+        op, op.getType(), getProbedValue(operands[0], op.getLoc(), rewriter));
+    return success();
+  }
+};
+
+/// Convert an and-reduction to a comparison against all ones.
+struct ConvertAndR : public OpConversionPattern<rtl::AndROp> {
+  using OpConversionPattern::OpConversionPattern;
+
+  LogicalResult
+  matchAndRewrite(rtl::AndROp op, ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const override {
+    auto input = getProbedValue(operands[0], op.getLoc(), rewriter);
+    auto type = input.getType().cast<IntegerType>();
+    auto allOnes = rewriter.create<ConstOp>(
+        op.getLoc(), type,
+        rewriter.getIntegerAttr(type, APInt::getAllOnesValue(type.getWidth())));
+    rewriter.replaceOpWithNewOp<CmpIOp>(op, CmpIPredicate::eq, input, allOnes);
+    return success();
+  }
+};
+
+/// Convert an or-reduction to a comparison against zero.
+struct ConvertOrR : public OpConversionPattern<rtl::OrROp> {
+  using OpConversionPattern::OpConversionPattern;
+
+  LogicalResult
+  matchAndRewrite(rtl::OrROp op, ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const override {
+    auto input = getProbedValue(operands[0], op.getLoc(), rewriter);
+    auto type = input.getType();
+    auto zero = rewriter.create<ConstOp>(op.getLoc(), type,
+                                         rewriter.getIntegerAttr(type, 0));
+    rewriter.replaceOpWithNewOp<CmpIOp>(op, CmpIPredicate::ne, input, zero);
+    return success();
+  }
+};
+
+/// Convert a xor-reduction to a chain of xors of the individual bits.
+struct ConvertXorR : public OpConversionPattern<rtl::XorROp> {
+  using OpConversionPattern::OpConversionPattern;
+
+  LogicalResult
+  matchAndRewrite(rtl::XorROp op, ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const override {
+    auto loc = op.getLoc();
+    auto input = getProbedValue(operands[0], loc, rewriter);
+    auto bitType = rewriter.getI1Type();
+    Value result;
+    for (unsigned i = 0, e = input.getType().getIntOrFloatBitWidth(); i != e;
+         ++i) {
+      Value bit = rewriter.create<ExtractSliceOp>(loc, bitType, input,
+                                                  rewriter.getIndexAttr(i));
+      result = result ? rewriter.create<XOrOp>(loc, result, bit) : bit;
+    }
+    rewriter.replaceOp(op, result);
+    return success();
+  }
+};
+
+//===----------------------------------------------------------------------===//
+// Convert wires and registers
+//===----------------------------------------------------------------------===//
+
+/// Create a signal carrying `type`, initialized to zero.
+static Value createSignal(Location loc, StringRef name, Type type,
+                          ConversionPatternRewriter &rewriter) {
+  auto init =
+      rewriter.create<ConstOp>(loc, type, rewriter.getIntegerAttr(type, 0));
+  return rewriter.create<SigOp>(loc, SigType::get(type), name, init);
+}
+
+/// Convert a wire to a signal.
+struct ConvertWire : public OpConversionPattern<rtl::WireOp> {
+  using OpConversionPattern::OpConversionPattern;
+
+  LogicalResult
+  matchAndRewrite(rtl::WireOp op, ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const override {
+    auto type = op.getType().cast<InOutType>().getElementType();
+    if (!type.isSignlessInteger())
+      return rewriter.notifyMatchFailure(op, "only integer wires supported");
+    rewriter.replaceOp(op, createSignal(op.getLoc(), op.name().getValueOr(""),
+                                        type, rewriter));
+    return success();
+  }
+};
+
+/// Convert a connection to a drive of the destination signal.
+struct ConvertConnect : public OpConversionPattern<rtl::ConnectOp> {
+  using OpConversionPattern::OpConversionPattern;
+
+  LogicalResult
+  matchAndRewrite(rtl::ConnectOp op, ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const override {
+    auto loc = op.getLoc();
+    rewriter.create<DrvOp>(loc, operands[0],
+                           getProbedValue(operands[1], loc, rewriter),
+                           getDeltaTime(loc, rewriter), Value());
+    rewriter.eraseOp(op);
+    return success();
+  }
+};
+
+/// Convert a read of a wire, register or inout port to a probe.
+struct ConvertReadInOut : public OpConversionPattern<rtl::ReadInOutOp> {
+  using OpConversionPattern::OpConversionPattern;
+
+  LogicalResult
+  matchAndRewrite(rtl::ReadInOutOp op, ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const override {
+    if (!operands[0].getType().isa<SigType>())
+      return rewriter.notifyMatchFailure(op, "input isn't a signal");
+    rewriter.replaceOp(op, getProbedValue(operands[0], op.getLoc(), rewriter));
+    return success();
+  }
+};
+
+/// Convert a register declaration to a signal. The `always` blocks assigning
+/// it become `llhd.reg` operations driving that signal.
+struct ConvertReg : public OpConversionPattern<sv::RegOp> {
+  using OpConversionPattern::OpConversionPattern;
+
+  LogicalResult
+  matchAndRewrite(sv::RegOp op, ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const override {
+    auto type = op.getType().cast<InOutType>().getElementType();
+    if (!type.isSignlessInteger())
+      return rewriter.notifyMatchFailure(op, "only integer regs supported");
+    rewriter.replaceOp(op, createSignal(op.getLoc(), op.name().getValueOr(""),
+                                        type, rewriter));
+    return success();
+  }
+};
+
+/// Convert an edge triggered `always` block, which only contains non-blocking
+/// assignments nested in `if` blocks, to one `llhd.reg` per assigned register.
+/// Every assignment contributes one trigger per edge of the block, gated by the
+/// conditions of its enclosing `if` blocks. Later assignments come first, since
+/// the left-most applicable trigger of a `llhd.reg` wins.
+struct ConvertAlways : public OpConversionPattern<sv::AlwaysOp> {
+  using OpConversionPattern::OpConversionPattern;
+
+  LogicalResult
+  matchAndRewrite(sv::AlwaysOp op, ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const override {
+    auto loc = op.getLoc();
+
+    // Map the edges of the block to register modes.
+    SmallVector<RegMode, 2> modes;
+    for (size_t i = 0, e = op.getNumConditions(); i != e; ++i) {
+      switch (op.getCondition(i).event) {
+      case sv::EventControl::AtPosEdge:
+        modes.push_back(RegMode::rise);
+        break;
+      case sv::EventControl::AtNegEdge:
+        modes.push_back(RegMode::fall);
+        break;
+      case sv::EventControl::AtEdge:
+        modes.push_back(RegMode::both);
+        break;
+      }
+    }
+
+    // Collect the assignments and check that there is nothing else.
+    SmallVector<sv::PAssignOp, 4> assigns;
+    auto walkResult = op.getBodyBlock()->walk([&](Operation *nested) {
+      if (auto assign = dyn_cast<sv::PAssignOp>(nested)) {
+        assigns.push_back(assign);
+        return WalkResult::advance();
+      }
+      if (isa<sv::IfOp, sv::YieldOp>(nested))
+        return WalkResult::advance();
+      return WalkResult::interrupt();
+    });
+    if (walkResult.wasInterrupted())
+      return rewriter.notifyMatchFailure(
+          op, "only non-blocking assignments and ifs supported");
+
+    SmallVector<Value, 2> triggers;
+    for (auto clock : operands)
+      triggers.push_back(getProbedValue(clock, loc, rewriter));
+    auto delta = getDeltaTime(loc, rewriter);
+    auto one = rewriter.create<ConstOp>(loc, rewriter.getI1Type(),
+                                        rewriter.getBoolAttr(true));
+
+    // Compute the gate of an assignment, null if it is unconditional.
+    auto getGate = [&](sv::PAssignOp assign) {
+      Value gate;
+      for (auto *block = assign->getBlock(); block != op.getBodyBlock();
+           block = block->getParentOp()->getBlock()) {
+        auto ifOp = cast<sv::IfOp>(block->getParentOp());
+        Value cond = getProbedValue(rewriter.getRemappedValue(ifOp.cond()),
+                                    loc, rewriter);
+        if (block->getParent() == &ifOp.elseRegion())
+          cond = rewriter.create<XOrOp>(loc, cond, one);
+        gate = gate ? rewriter.create<mlir::AndOp>(loc, gate, cond) : cond;
+      }
+      return gate;
+    };
+
+    // Group the assignments by register, latest first.
+    llvm::MapVector<Value, SmallVector<sv::PAssignOp, 2>> regAssigns;
+    for (auto assign : llvm::reverse(assigns))
+      regAssigns[assign.dest()].push_back(assign);
+
+    for (auto &entry : regAssigns) {
+      Value signal = rewriter.getRemappedValue(entry.first);
+      if (!signal.getType().isa<SigType>())
+        return rewriter.notifyMatchFailure(op, "destination isn't a signal");
+
+      SmallVector<Attribute, 4> modeAttrs, gateMask;
+      SmallVector<Value, 4> values, regTriggers, delays, gates;
+      for (auto assign : entry.second) {
+        auto value = getProbedValue(rewriter.getRemappedValue(assign.src()),
+                                    loc, rewriter);
+        auto gate = getGate(assign);
+        for (size_t i = 0, e = modes.size(); i != e; ++i) {
+          modeAttrs.push_back(
+              rewriter.getI64IntegerAttr(static_cast<int64_t>(modes[i])));
+          values.push_back(value);
+          regTriggers.push_back(triggers[i]);
+          delays.push_back(delta);
+          if (gate)
+            gates.push_back(gate);
+          gateMask.push_back(rewriter.getI64IntegerAttr(gate ? gates.size()
+                                                             : 0));
+        }
+      }
+      rewriter.create<llhd::RegOp>(loc, signal,
+                                   rewriter.getArrayAttr(modeAttrs), values,
+                                   regTriggers, delays, gates,
+                                   rewriter.getArrayAttr(gateMask));
+    }
+
+    rewriter.eraseOp(op);
+    return success();
+  }
+};
+
+/// Drop the `initial` blocks which only randomize registers in simulation,
+/// along with the `ifdef` blocks guarding them. LLHD signals start at zero.
+struct ConvertSimulationInit : public OpConversionPattern<sv::IfDefOp> {
+  using OpConversionPattern::OpConversionPattern;
+
+  LogicalResult
+  matchAndRewrite(sv::IfDefOp op, ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const override {
+    auto walkResult = op->walk([](Operation *nested) {
+      if (isa<sv::IfDefOp, sv::InitialOp, sv::YieldOp>(nested) ||
+          nested->getParentOfType<sv::InitialOp>())
+        return WalkResult::advance();
+      return WalkResult::interrupt();
+    });
+    if (walkResult.wasInterrupted())
+      return rewriter.notifyMatchFailure(op, "not a simulation initializer");
+    rewriter.eraseOp(op);
+    return success();
+  }
+};
@@ -38,6 +38,8 @@ using namespace std;
 
 typedef DenseMap<Block *, vector<Value>> BlockValues;
 typedef DenseMap<Block *, vector<Operation *>> BlockOps;
+// The merge of each block which propagates a given defining value
+typedef DenseMap<std::pair<Block *, Value>, Operation *> BlockMergeIndex;
 
 /// Remove basic blocks inside the given FuncOp. This allows the result to be
 /// a valid graph region, since multi-basic block regions are not allowed to
@@ -367,7 +369,8 @@ bool blockHasSrcOp(Value val, Block *block) {
 }
 
 // Get value from predBlock which will be set as operand of op (merge)
-Value getMergeOperand(Operation *op, Block *predBlock, BlockOps blockMerges) {
+Value getMergeOperand(Operation *op, Block *predBlock,
+                      const BlockMergeIndex &mergeIndex) {
   // Helper value (defining value of merge) to identify Merges which propagate
   // the same defining value
   Value srcVal = op->getOperand(0);
@@ -375,14 +378,14 @@ Value getMergeOperand(Operation *op, Block *predBlock, BlockOps blockMerges) {
   Block *block = op->getBlock();
 
   // Value comes from predecessor block (i.e., not an argument of this block)
-  if (std::find(block->getArguments().begin(), block->getArguments().end(),
-                srcVal) == block->getArguments().end()) {
+  auto srcArg = srcVal.dyn_cast<BlockArgument>();
+  if (!srcArg || srcArg.getOwner() != block) {
     // Value is not defined by operation in predBlock
     if (!blockHasSrcOp(srcVal, predBlock)) {
       // Find the corresponding Merge
-      for (Operation *predOp : blockMerges[predBlock])
-        if (predOp->getOperand(0) == srcVal)
-          return predOp->getResult(0);
+      auto it = mergeIndex.find({predBlock, srcVal});
+      if (it != mergeIndex.end())
+        return it->second->getResult(0);
     } else
       return srcVal;
   }
@@ -437,13 +440,20 @@ Operation *getStartOp(Block *block) {
   return nullptr;
 }
 
-void reconnectMergeOps(handshake::FuncOp f, BlockOps blockMerges) {
+void reconnectMergeOps(handshake::FuncOp f, BlockOps &blockMerges) {
   // All merge operands are initially set to original (defining) value
   // We here replace defining value with appropriate value from predecessor
   // block The predecessor can either be a merge, the original defining value,
   // or a branch Operand Operand(0) is helper defining value for identifying
   // matching merges, it does not correspond to any predecessor block
 
+  // Index the merges by block and defining value once, operand(0) doesn't
+  // change until all merges are connected
+  BlockMergeIndex mergeIndex;
+  for (auto &blockAndMerges : blockMerges)
+    for (Operation *op : blockAndMerges.second)
+      mergeIndex.try_emplace({blockAndMerges.first, op->getOperand(0)}, op);
+
   for (Block &block : f) {
     for (Operation *op : blockMerges[&block]) {
 
@@ -451,16 +461,20 @@ void reconnectMergeOps(handshake::FuncOp f, BlockOps blockMerges) {
 
       // Set appropriate operand from predecessor block
       for (auto *predBlock : block.getPredecessors()) {
-        Value mgOperand = getMergeOperand(op, predBlock, blockMerges);
+        Value mgOperand = getMergeOperand(op, predBlock, mergeIndex);
         assert(mgOperand != nullptr);
         op->setOperand(count, mgOperand);
         count++;
       }
       // Reconnect all operands originating from livein defining value through
-      // corresponding merge of that block
-      for (Operation &opp : block)
-        if (!isa<MergeLikeOpInterface>(opp))
-          opp.replaceUsesOfWith(op->getOperand(0), op->getResult(0));
+      // corresponding merge of that block.  Only the uses of the defining
+      // value are visited, not the whole block
+      Value srcVal = op->getOperand(0);
+      for (auto &use : llvm::make_early_inc_range(srcVal.getUses())) {
+        Operation *user = use.getOwner();
+        if (user->getBlock() == &block && !isa<MergeLikeOpInterface>(user))
+          use.set(op->getResult(0));
+      }
     }
   }
 
@@ -664,15 +678,6 @@ void connectConstantsToControl(handshake::FuncOp f,
   }
 }
 
-void replaceFirstUse(Operation *op, Value oldVal, Value newVal) {
-  for (int i = 0, e = op->getNumOperands(); i < e; ++i)
-    if (op->getOperand(i) == oldVal) {
-      op->setOperand(i, newVal);
-      break;
-    }
-  return;
-}
-
 void insertFork(Operation *op, Value result, bool isLazy, OpBuilder &rewriter) {
   // Get successor operations
   vector<Operation *> opsToProcess;
@@ -690,9 +695,16 @@ void insertFork(Operation *op, Value result, bool isLazy, OpBuilder &rewriter) {
 
   // Modify operands of successor
   // opsToProcess may have multiple instances of same operand
-  // Replace uses one by one to assign different fork outputs to them
-  for (int i = 0, e = opsToProcess.size(); i < e; ++i)
-    replaceFirstUse(opsToProcess[i], result, newOp->getResult(i));
+  // Replace uses one by one to assign different fork outputs to them, in
+  // operand order.  Each successor's operands are only scanned once
+  DenseMap<Operation *, unsigned> nextOperand;
+  for (int i = 0, e = opsToProcess.size(); i < e; ++i) {
+    Operation *user = opsToProcess[i];
+    unsigned &index = nextOperand[user];
+    while (user->getOperand(index) != result)
+      ++index;
+    user->setOperand(index++, newOp->getResult(i));
+  }
 }
 
 // Insert Fork Operation for every operation with more than one successor
@@ -1491,15 +1503,84 @@ struct FuncOpLowering : public OpConversionPattern<mlir::FuncOp> {
 };
 
 namespace {
+/// Insert a buffer on the channel feeding 'use'.
+static void insertBufferOnUse(OpOperand &use, bool sequential, unsigned slots,
+                              OpBuilder &builder) {
+  Value value = use.get();
+  builder.setInsertionPoint(use.getOwner());
+  auto bufferOp = builder.create<handshake::BufferOp>(
+      use.getOwner()->getLoc(), value.getType(), value, sequential,
+      /*control=*/value.getType().isa<NoneType>(), slots);
+  use.set(bufferOp);
+}
+
+/// Collect the uses which close a cycle when the graph is explored depth first
+/// from the function arguments.  Removing them leaves an acyclic graph.
+static void findBackEdges(handshake::FuncOp f,
+                          DenseSet<OpOperand *> &backEdges) {
+  DenseSet<Operation *> visited, onStack;
+  // Each entry is an operation and the uses of its results still to visit.
+  SmallVector<std::pair<Operation *, SmallVector<OpOperand *, 4>>, 16> stack;
+  auto push = [&](Operation *op) {
+    visited.insert(op);
+    onStack.insert(op);
+    SmallVector<OpOperand *, 4> uses;
+    for (auto result : op->getResults())
+      for (auto &use : result.getUses())
+        uses.push_back(&use);
+    std::reverse(uses.begin(), uses.end());
+    stack.push_back({op, std::move(uses)});
+  };
+
+  auto visit = [&](OpOperand &use) {
+    auto *user = use.getOwner();
+    if (onStack.count(user))
+      backEdges.insert(&use);
+    else if (!visited.count(user))
+      push(user);
+  };
+
+  for (auto arg : f.getBody().front().getArguments()) {
+    for (auto &use : arg.getUses()) {
+      visit(use);
+      while (!stack.empty()) {
+        auto &uses = stack.back().second;
+        if (uses.empty()) {
+          onStack.erase(stack.back().first);
+          stack.pop_back();
+          continue;
+        }
+        visit(*uses.pop_back_val());
+      }
+    }
+  }
+}
+
 struct HandshakeInsertBufferPass
     : public PassWrapper<HandshakeInsertBufferPass,
                          OperationPass<handshake::FuncOp>> {
+  HandshakeInsertBufferPass() = default;
+  HandshakeInsertBufferPass(const HandshakeInsertBufferPass &other)
+      : PassWrapper<HandshakeInsertBufferPass,
+                    OperationPass<handshake::FuncOp>>(other) {}
+
+  Option<std::string> strategy{
+      *this, "strategy",
+      llvm::cl::desc("Where to insert buffers: 'cycles' puts one into every "
+                     "graph cycle, 'all' puts one on every channel, and "
+                     "'throughput' also balances the latency of reconvergent "
+                     "paths with transparent buffers"),
+      llvm::cl::init("cycles")};
+  Option<unsigned> bufferSize{
+      *this, "buffer-size",
+      llvm::cl::desc("The number of slots of the sequential buffers"),
+      llvm::cl::init(2)};
 
   DenseMap<Operation *, bool> opVisited;
   DenseMap<Operation *, bool> opOnStack;
 
   /// DFS-based graph cycle detection and naive buffer insertion. Exactly one
-  /// 2-slot non-transparent buffer will be inserted into each graph cycle.
+  /// non-transparent buffer will be inserted into each graph cycle.
   void insertBufferOp(Operation *op, OpBuilder &builder) {
     // Mark operation as visited and push into the stack.
     opVisited[op] = true;
@@ -1518,7 +1599,7 @@ struct HandshakeInsertBufferPass
         auto bufferOp = builder.create<handshake::BufferOp>(
             op->getLoc(), value.getType(), value, /*sequential=*/true,
             /*control=*/value.getType().isa<NoneType>(),
-            /*slots=*/2);
+            /*slots=*/bufferSize);
         value.replaceUsesWithIf(
             bufferOp,
             function_ref<bool(OpOperand &)>([](OpOperand &operand) -> bool {
@@ -1533,8 +1614,7 @@ struct HandshakeInsertBufferPass
     opOnStack[op] = false;
   }
 
-  void runOnOperation() override {
-    auto f = getOperation();
+  void insertCycleBuffers(handshake::FuncOp f, OpBuilder &builder) {
     for (auto &block : f) {
       for (auto &op : block) {
         opVisited[&op] = false;
@@ -1542,7 +1622,6 @@ struct HandshakeInsertBufferPass
       }
     }
     // Traverse each use of each argument of the entry block.
-    auto builder = OpBuilder(f.getContext());
     for (auto &arg : f.getBody().front().getArguments()) {
       for (auto &operand : arg.getUses()) {
         if (!opVisited[operand.getOwner()])
@@ -1550,6 +1629,288 @@ struct HandshakeInsertBufferPass
       }
     }
   }
+
+  /// Put a sequential buffer on every channel that isn't already buffered.
+  void insertAllBuffers(handshake::FuncOp f, OpBuilder &builder) {
+    SmallVector<OpOperand *, 32> uses;
+    auto collect = [&](Value value) {
+      if (value.getDefiningOp<handshake::BufferOp>())
+        return;
+      for (auto &use : value.getUses())
+        if (!isa<handshake::BufferOp>(use.getOwner()))
+          uses.push_back(&use);
+    };
+    for (auto arg : f.getBody().front().getArguments())
+      collect(arg);
+    for (auto &op : f.getBody().front())
+      for (auto result : op.getResults())
+        collect(result);
+
+    for (auto *use : uses)
+      insertBufferOnUse(*use, /*sequential=*/true, bufferSize, builder);
+  }
+
+  /// Balance reconvergent paths.  Every sequential buffer delays a token by a
+  /// cycle, so when the inputs of an operation arrive through a different
+  /// number of them, the early tokens back up into the forks that produced
+  /// them and stall the other paths.  Give each early input a transparent
+  /// buffer large enough to hold the tokens in flight on the slowest input.
+  /// This assumes the cycles have been broken already.
+  void balancePaths(handshake::FuncOp f, OpBuilder &builder) {
+    DenseSet<OpOperand *> backEdges;
+    findBackEdges(f, backEdges);
+
+    // Order the operations topologically, ignoring the back edges.
+    DenseMap<Operation *, unsigned> numPending;
+    SmallVector<Operation *, 32> worklist, order;
+    for (auto &op : f.getBody().front()) {
+      unsigned pending = 0;
+      for (auto &operand : op.getOpOperands())
+        if (operand.get().getDefiningOp() && !backEdges.count(&operand))
+          ++pending;
+      numPending[&op] = pending;
+      if (!pending)
+        worklist.push_back(&op);
+    }
+    while (!worklist.empty()) {
+      auto *op = worklist.pop_back_val();
+      order.push_back(op);
+      for (auto result : op->getResults())
+        for (auto &use : result.getUses())
+          if (!backEdges.count(&use) && --numPending[use.getOwner()] == 0)
+            worklist.push_back(use.getOwner());
+    }
+
+    // Compute the latest cycle each operation's inputs arrive in.
+    DenseMap<Operation *, unsigned> depth;
+    auto getArrival = [&](Value value) -> unsigned {
+      auto *def = value.getDefiningOp();
+      if (!def)
+        return 0;
+      unsigned latency = 0;
+      if (auto bufferOp = dyn_cast<handshake::BufferOp>(def))
+        latency = bufferOp.isSequential() ? 1 : 0;
+      return depth.lookup(def) + latency;
+    };
+
+    for (auto *op : order) {
+      unsigned opDepth = 0;
+      for (auto &operand : op->getOpOperands())
+        if (!backEdges.count(&operand))
+          opDepth = std::max(opDepth, getArrival(operand.get()));
+      depth[op] = opDepth;
+
+      // Only one input of a merge carries a token at a time.
+      if (op->getNumOperands() < 2 || isa<MergeLikeOpInterface>(op))
+        continue;
+
+      SmallVector<std::pair<OpOperand *, unsigned>, 4> early;
+      for (auto &operand : op->getOpOperands()) {
+        if (backEdges.count(&operand))
+          continue;
+        unsigned arrival = getArrival(operand.get());
+        if (arrival < opDepth)
+          early.push_back({&operand, opDepth - arrival});
+      }
+      for (auto &entry : early)
+        insertBufferOnUse(*entry.first, /*sequential=*/false, entry.second,
+                          builder);
+    }
+  }
+
+  void runOnOperation() override {
+    auto f = getOperation();
+    auto builder = OpBuilder(f.getContext());
+
+    if (strategy == "cycles") {
+      insertCycleBuffers(f, builder);
+    } else if (strategy == "all") {
+      insertAllBuffers(f, builder);
+    } else if (strategy == "throughput") {
+      insertCycleBuffers(f, builder);
+      balancePaths(f, builder);
+    } else {
+      f.emitError("unknown buffer insertion strategy '") << strategy << "'";
+      signalPassFailure();
+    }
+  }
+};
+
+/// The residue modulo `stride` of the values an affine expression takes over
+/// the iterations of the loops around an access.
+struct AccessPattern {
+  /// Zero if the expression is constant.
+  int64_t stride = 0;
+  int64_t offset = 0;
+};
+
+/// Return the pattern of `expr`, a result of an access map over `operands`, or
+/// None if it isn't linear.  An affine.for induction variable is a multiple of
+/// the loop step past its lower bound, any other operand can take any value.
+static Optional<AccessPattern> getAccessPattern(AffineExpr expr,
+                                                ArrayRef<Value> operands,
+                                                unsigned numDims,
+                                                unsigned numSymbols) {
+  SmallVector<int64_t, 8> flattened;
+  if (failed(getFlattenedAffineExpr(expr, numDims, numSymbols, &flattened)) ||
+      flattened.size() != operands.size() + 1)
+    return None;
+
+  AccessPattern pattern;
+  pattern.offset = flattened.back();
+  for (auto it : llvm::enumerate(operands)) {
+    int64_t coefficient = flattened[it.index()];
+    if (coefficient == 0)
+      continue;
+    auto forOp = getForInductionVarOwner(it.value());
+    if (forOp && forOp.hasConstantLowerBound()) {
+      pattern.offset += coefficient * forOp.getConstantLowerBound();
+      coefficient *= forOp.getStep();
+    }
+    pattern.stride = llvm::GreatestCommonDivisor64(pattern.stride,
+                                                   std::abs(coefficient));
+  }
+  return pattern;
+}
+
+/// Split the memrefs allocated in a function into banks, each of which
+/// becomes a separate handshake.memory with its own ports.
+struct HandshakePartitionMemRefsPass
+    : public PassWrapper<HandshakePartitionMemRefsPass,
+                         OperationPass<mlir::FuncOp>> {
+  HandshakePartitionMemRefsPass() = default;
+  HandshakePartitionMemRefsPass(const HandshakePartitionMemRefsPass &other)
+      : PassWrapper<HandshakePartitionMemRefsPass,
+                    OperationPass<mlir::FuncOp>>(other) {}
+
+  Option<unsigned> maxBanks{
+      *this, "max-banks",
+      llvm::cl::desc("The maximum number of banks of a memref"),
+      llvm::cl::init(4)};
+
+  /// Split the memref allocated by `alloc` cyclically along one dimension, in
+  /// as many banks as possible such that every access hits the same bank on
+  /// all iterations.  Nothing happens if the memref isn't only used by affine
+  /// loads, stores and a dealloc.
+  void partitionMemRef(Operation *alloc) {
+    auto memref = alloc->getResult(0);
+    auto type = memref.getType().cast<MemRefType>();
+    if (!type.hasStaticShape() || !type.getAffineMaps().empty() ||
+        type.getRank() == 0)
+      return;
+
+    struct Access {
+      Operation *op;
+      AffineValueMap map;
+    };
+    SmallVector<Access, 8> accesses;
+    SmallVector<Operation *, 1> deallocs;
+    for (auto *user : memref.getUsers()) {
+      if (isa<DeallocOp>(user)) {
+        deallocs.push_back(user);
+        continue;
+      }
+      auto store = dyn_cast<AffineStoreOp>(user);
+      if (!isa<AffineLoadOp>(user) &&
+          (!store || store.getValueToStore() == memref))
+        return;
+      accesses.push_back({user, {}});
+      MemRefAccess(user).getAccessMap(&accesses.back().map);
+    }
+    if (accesses.empty())
+      return;
+
+    // Bank along the dimension which allows the most banks, the innermost on
+    // a tie.
+    unsigned bankDim = 0;
+    int64_t numBanks = 1;
+    for (unsigned dim = type.getRank(); dim-- != 0;) {
+      int64_t stride = type.getDimSize(dim);
+      for (auto &access : accesses) {
+        auto pattern = getAccessPattern(
+            access.map.getResult(dim), access.map.getOperands(),
+            access.map.getNumDims(), access.map.getNumSymbols());
+        if (!pattern) {
+          stride = 1;
+          break;
+        }
+        stride = llvm::GreatestCommonDivisor64(stride, pattern->stride);
+      }
+      // The number of banks must divide the stride, so that each access
+      // stays in its bank, and the dimension, so that the banks are equal.
+      int64_t dimBanks =
+          std::max<int64_t>(std::min<int64_t>(stride, maxBanks), 1);
+      while (stride % dimBanks)
+        --dimBanks;
+      if (dimBanks > numBanks) {
+        bankDim = dim;
+        numBanks = dimBanks;
+      }
+    }
+    if (numBanks <= 1)
+      return;
+
+    SmallVector<int64_t, 4> shape(type.getShape().begin(),
+                                  type.getShape().end());
+    shape[bankDim] /= numBanks;
+    auto bankType = MemRefType::get(shape, type.getElementType(), {},
+                                    type.getMemorySpace());
+    OpBuilder builder(alloc);
+    SmallVector<Value, 4> banks;
+    for (int64_t i = 0; i != numBanks; ++i) {
+      auto bank = builder.clone(*alloc)->getResult(0);
+      bank.setType(bankType);
+      banks.push_back(bank);
+    }
+
+    // Element `i` of the banked dimension is element `i floordiv numBanks` of
+    // bank `i mod numBanks`.
+    for (auto &access : accesses) {
+      auto map = access.map.getAffineMap();
+      auto pattern = *getAccessPattern(map.getResult(bankDim),
+                                       access.map.getOperands(),
+                                       map.getNumDims(), map.getNumSymbols());
+      int64_t bank = (pattern.offset % numBanks + numBanks) % numBanks;
+      SmallVector<AffineExpr, 4> results(map.getResults().begin(),
+                                         map.getResults().end());
+      results[bankDim] = (results[bankDim] - bank).floorDiv(numBanks);
+      map = AffineMap::get(map.getNumDims(), map.getNumSymbols(), results,
+                           map.getContext());
+
+      auto *op = access.op;
+      builder.setInsertionPoint(op);
+      if (auto load = dyn_cast<AffineLoadOp>(op)) {
+        auto newLoad = builder.create<AffineLoadOp>(
+            op->getLoc(), banks[bank], map, access.map.getOperands());
+        load.getResult().replaceAllUsesWith(newLoad.getResult());
+      } else {
+        builder.create<AffineStoreOp>(
+            op->getLoc(), cast<AffineStoreOp>(op).getValueToStore(),
+            banks[bank], map, access.map.getOperands());
+      }
+      op->erase();
+    }
+
+    for (auto *dealloc : deallocs) {
+      builder.setInsertionPoint(dealloc);
+      for (auto bank : banks)
+        builder.create<DeallocOp>(dealloc->getLoc(), bank);
+      dealloc->erase();
+    }
+    alloc->erase();
+  }
+
+  void runOnOperation() override {
+    // Function arguments can't be split without changing the interface of the
+    // function, only the memrefs it allocates are.
+    SmallVector<Operation *, 8> allocs;
+    getOperation().walk([&](Operation *op) {
+      if (isa<AllocOp, AllocaOp>(op))
+        allocs.push_back(op);
+    });
+    for (auto *alloc : allocs)
+      partitionMemRef(alloc);
+  }
 };
 
 struct HandshakeRemoveBlockPass
@@ -1670,5 +2031,9 @@ void handshake::registerStandardToHandshakePasses() {
   PassRegistration<HandshakeRemoveBlockPass>(
       "remove-block-structure", "Remove block structure in handshake IR");
   PassRegistration<HandshakeInsertBufferPass>(
-      "handshake-insert-buffer", "Insert buffers to break graph cycles.");
+      "handshake-insert-buffer",
+      "Insert buffers to break graph cycles and raise throughput.");
+  PassRegistration<HandshakePartitionMemRefsPass>(
+      "partition-memrefs",
+      "Split memrefs into banks accessed in parallel, before create-dataflow.");
 }
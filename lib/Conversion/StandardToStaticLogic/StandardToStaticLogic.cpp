@@ -13,6 +13,7 @@
 #include "circt/Conversion/StandardToStaticLogic/StandardToStaticLogic.h"
 #include "circt/Dialect/StaticLogic/StaticLogic.h"
 #include "mlir/Dialect/StandardOps/IR/Ops.h"
+#include "mlir/Interfaces/ControlFlowInterfaces.h"
 
 using namespace mlir;
 using namespace circt;
@@ -61,7 +62,290 @@ valueVector getPipelineResults(Block &block) {
   return results;
 }
 
-static void createPipeline(mlir::FuncOp f, OpBuilder &builder) {
+//===----------------------------------------------------------------------===//
+// Modulo scheduling
+//===----------------------------------------------------------------------===//
+
+/// The number of cycles after which the result of an operation is available.
+/// Constants are free, memory accesses and simple integer operations take one
+/// cycle, multipliers and dividers take longer.
+static unsigned getOpLatency(Operation *op) {
+  if (isa<mlir::ConstantOp>(op))
+    return 0;
+  if (isa<MulIOp, MulFOp, AddFOp, SubFOp>(op))
+    return 3;
+  if (isa<SignedDivIOp, UnsignedDivIOp, SignedRemIOp, UnsignedRemIOp, DivFOp,
+          RemFOp>(op))
+    return 8;
+  return 1;
+}
+
+/// Return the memref accessed by the given operation, or null if it doesn't
+/// access memory. Every memref has a single port, so accesses to the same
+/// memref compete for it.
+static Value getAccessedMemRef(Operation *op) {
+  if (auto load = dyn_cast<LoadOp>(op))
+    return load.getMemRef();
+  if (auto store = dyn_cast<StoreOp>(op))
+    return store.getMemRef();
+  return Value();
+}
+
+namespace {
+/// A dependence between two operations of a pipeline: 'to' can start
+/// 'latency' cycles after 'from' started, 'distance' iterations later.
+struct Dependence {
+  unsigned from, to;
+  int latency;
+  unsigned distance;
+};
+
+/// An iterative modulo scheduler, following B. R. Rau, "Iterative Modulo
+/// Scheduling: An Algorithm For Software Pipelining Loops", MICRO 1994.
+/// Operations are placed in priority order of their height in the dependence
+/// graph, and placing an operation evicts the operations it conflicts with,
+/// which are then rescheduled later.
+class ModuloScheduler {
+public:
+  ModuloScheduler(ArrayRef<Operation *> ops, ArrayRef<Dependence> deps,
+                  ArrayRef<int> resources)
+      : ops(ops), deps(deps), resources(resources) {}
+
+  /// Return the minimum initiation interval allowed by the resources and the
+  /// recurrences.
+  unsigned getMinII() const;
+
+  /// Try to schedule the operations with the given initiation interval. On
+  /// success, 'times' holds the start cycle of every operation.
+  bool schedule(unsigned ii, SmallVectorImpl<int> &times) const;
+
+private:
+  /// Compute the longest path from every operation to the end of an iteration
+  /// with the given initiation interval. Return false if a recurrence doesn't
+  /// fit into it.
+  bool computeHeights(unsigned ii, SmallVectorImpl<int> &heights) const;
+
+  ArrayRef<Operation *> ops;
+  ArrayRef<Dependence> deps;
+  /// The resource used by each operation, or -1 if it uses none.
+  ArrayRef<int> resources;
+};
+} // namespace
+
+bool ModuloScheduler::computeHeights(unsigned ii,
+                                     SmallVectorImpl<int> &heights) const {
+  heights.assign(ops.size(), 0);
+  for (unsigned i = 0, e = ops.size(); i <= e; ++i) {
+    bool changed = false;
+    for (auto &dep : deps) {
+      int height = heights[dep.to] + dep.latency - int(ii * dep.distance);
+      if (height > heights[dep.from]) {
+        heights[dep.from] = height;
+        changed = true;
+      }
+    }
+    if (!changed)
+      return true;
+  }
+  // Still changing after as many rounds as there are operations means there is
+  // a recurrence with a positive length.
+  return false;
+}
+
+unsigned ModuloScheduler::getMinII() const {
+  // Every resource can be used once per cycle.
+  DenseMap<int, unsigned> uses;
+  unsigned ii = 1;
+  for (int resource : resources)
+    if (resource >= 0)
+      ii = std::max(ii, ++uses[resource]);
+
+  // Every recurrence must fit into its distance in iterations.
+  SmallVector<int, 16> heights;
+  while (!computeHeights(ii, heights))
+    ++ii;
+  return ii;
+}
+
+bool ModuloScheduler::schedule(unsigned ii, SmallVectorImpl<int> &times) const {
+  SmallVector<int, 16> heights;
+  if (!computeHeights(ii, heights))
+    return false;
+
+  unsigned numOps = ops.size();
+  times.assign(numOps, -1);
+  SmallVector<int, 16> prevTimes(numOps, -1);
+  // The modulo reservation table, mapping a resource and a cycle modulo the II
+  // to the operation using it.
+  DenseMap<std::pair<int, unsigned>, unsigned> reservations;
+
+  auto unschedule = [&](unsigned op) {
+    if (resources[op] >= 0)
+      reservations.erase({resources[op], times[op] % ii});
+    times[op] = -1;
+  };
+
+  unsigned numScheduled = 0;
+  for (unsigned budget = 8 * numOps; numScheduled != numOps; --budget) {
+    if (budget == 0)
+      return false;
+
+    // Pick the unscheduled operation with the largest height.
+    unsigned op = numOps;
+    for (unsigned i = 0; i < numOps; ++i)
+      if (times[i] < 0 && (op == numOps || heights[i] > heights[op]))
+        op = i;
+
+    // The earliest start allowed by the scheduled predecessors.
+    int earliest = 0;
+    for (auto &dep : deps)
+      if (dep.to == op && dep.from != op && times[dep.from] >= 0)
+        earliest = std::max(earliest, times[dep.from] + dep.latency -
+                                          int(ii * dep.distance));
+
+    // Find a cycle where the resource is free, or force the operation in.
+    int time = -1;
+    for (int t = earliest; t < earliest + int(ii) && time < 0; ++t)
+      if (resources[op] < 0 || !reservations.count({resources[op], t % ii}))
+        time = t;
+    if (time < 0)
+      time = prevTimes[op] < 0 || earliest > prevTimes[op] ? earliest
+                                                           : prevTimes[op] + 1;
+
+    // Evict the operations this one conflicts with.
+    if (resources[op] >= 0) {
+      auto it = reservations.find({resources[op], time % ii});
+      if (it != reservations.end()) {
+        unschedule(it->second);
+        --numScheduled;
+      }
+    }
+    for (auto &dep : deps) {
+      if (dep.from != op || dep.to == op || times[dep.to] < 0)
+        continue;
+      if (times[dep.to] < time + dep.latency - int(ii * dep.distance)) {
+        unschedule(dep.to);
+        --numScheduled;
+      }
+    }
+
+    times[op] = prevTimes[op] = time;
+    if (resources[op] >= 0)
+      reservations[{resources[op], time % ii}] = op;
+    ++numScheduled;
+  }
+  return true;
+}
+
+/// Schedule the operations of a pipeline. Every operation gets a
+/// "staticlogic.stage" attribute with the cycle it starts in, relative to the
+/// start of the iteration. The pipeline gets an "II" attribute with the
+/// initiation interval reached and a "latency" attribute with the number of
+/// cycles until all the results of an iteration are available. Values produced
+/// by the pipeline and fed back to its own operands through the successors of
+/// its block are loop-carried dependences with a distance of one iteration.
+static void schedulePipeline(staticlogic::PipelineOp pipeline,
+                             unsigned targetII, OpBuilder &builder) {
+  Block &body = pipeline.getRegion().front();
+  SmallVector<Operation *, 16> ops;
+  DenseMap<Operation *, unsigned> opIndex;
+  for (auto &op : body.without_terminator()) {
+    opIndex[&op] = ops.size();
+    ops.push_back(&op);
+  }
+  if (ops.empty())
+    return;
+
+  // Data dependences inside an iteration.
+  SmallVector<Dependence, 32> deps;
+  for (unsigned i = 0, e = ops.size(); i != e; ++i)
+    for (auto operand : ops[i]->getOperands())
+      if (auto *def = operand.getDefiningOp())
+        if (opIndex.count(def))
+          deps.push_back({opIndex[def], i, int(getOpLatency(def)), 0});
+
+  // Data dependences on the previous iteration.
+  auto *terminator = body.getTerminator();
+  auto branch =
+      dyn_cast<BranchOpInterface>(pipeline->getBlock()->getTerminator());
+  for (unsigned s = 0, e = branch ? branch->getNumSuccessors() : 0; s != e;
+       ++s) {
+    Block *succ = branch->getSuccessor(s);
+    auto succOperands = branch.getSuccessorOperands(s);
+    if (!succOperands)
+      continue;
+    for (auto operand : llvm::enumerate(*succOperands)) {
+      auto result = operand.value().dyn_cast<OpResult>();
+      if (!result || result.getOwner() != pipeline)
+        continue;
+      auto *def = terminator->getOperand(result.getResultNumber())
+                      .getDefiningOp();
+      if (!def || !opIndex.count(def))
+        continue;
+      Value succArg = succ->getArgument(operand.index());
+      for (auto pipelineOperand : llvm::enumerate(pipeline.getOperands())) {
+        if (pipelineOperand.value() != succArg)
+          continue;
+        for (auto *user : body.getArgument(pipelineOperand.index()).getUsers())
+          if (opIndex.count(user))
+            deps.push_back(
+                {opIndex[def], opIndex[user], int(getOpLatency(def)), 1});
+      }
+    }
+  }
+
+  // Memory accesses to the same memref keep their order within an iteration
+  // and across consecutive iterations, unless they are both loads.
+  SmallVector<int, 16> resources(ops.size(), -1);
+  DenseMap<Value, int> memRefIds;
+  for (unsigned i = 0, e = ops.size(); i != e; ++i) {
+    Value memRef = getAccessedMemRef(ops[i]);
+    if (!memRef)
+      continue;
+    resources[i] = memRefIds.insert({memRef, memRefIds.size()}).first->second;
+    for (unsigned j = 0; j < i; ++j) {
+      if (resources[j] != resources[i] ||
+          (isa<LoadOp>(ops[i]) && isa<LoadOp>(ops[j])))
+        continue;
+      deps.push_back({j, i, int(getOpLatency(ops[j])), 0});
+      deps.push_back({i, j, int(getOpLatency(ops[i])), 1});
+    }
+  }
+
+  // Try increasing initiation intervals until the operations can be placed.
+  // Once the II covers a whole iteration executed one operation after the
+  // other, iterations can't overlap anymore and that sequential schedule is
+  // used instead.
+  unsigned sequentialII = 1;
+  for (auto *op : ops)
+    sequentialII += getOpLatency(op) + 1;
+
+  ModuloScheduler scheduler(ops, deps, resources);
+  unsigned ii = std::max(targetII, scheduler.getMinII());
+  SmallVector<int, 16> times;
+  while (ii < sequentialII && !scheduler.schedule(ii, times))
+    ++ii;
+  if (ii >= sequentialII) {
+    ii = std::max(ii, sequentialII);
+    times.clear();
+    int time = 0;
+    for (auto *op : ops) {
+      times.push_back(time);
+      time += getOpLatency(op) + 1;
+    }
+  }
+
+  int latency = 0;
+  for (unsigned i = 0, e = ops.size(); i != e; ++i) {
+    ops[i]->setAttr("staticlogic.stage", builder.getI64IntegerAttr(times[i]));
+    latency = std::max(latency, times[i] + int(getOpLatency(ops[i])));
+  }
+  pipeline->setAttr("II", builder.getI64IntegerAttr(ii));
+  pipeline->setAttr("latency", builder.getI64IntegerAttr(latency));
+}
+
+static void createPipeline(mlir::FuncOp f, unsigned targetII,
+                           OpBuilder &builder) {
   for (Block &block : f) {
     if (block.front().isKnownNonTerminator()) {
 
@@ -104,16 +388,32 @@ static void createPipeline(mlir::FuncOp f, OpBuilder &builder) {
       }
     }
   }
+
+  // Schedule the pipelines once all of them exist, so the loop-carried values
+  // can be found through the pipeline results.
+  f.walk([&](staticlogic::PipelineOp pipeline) {
+    schedulePipeline(pipeline, targetII, builder);
+  });
 }
 
 namespace {
 
 struct CreatePipelinePass
     : public PassWrapper<CreatePipelinePass, OperationPass<mlir::FuncOp>> {
+  CreatePipelinePass() = default;
+  CreatePipelinePass(const CreatePipelinePass &other)
+      : PassWrapper<CreatePipelinePass, OperationPass<mlir::FuncOp>>(other) {}
+
+  Option<unsigned> targetII{
+      *this, "target-ii",
+      llvm::cl::desc("The smallest initiation interval to schedule pipelines "
+                     "with"),
+      llvm::cl::init(1)};
+
   void runOnOperation() override {
     mlir::FuncOp f = getOperation();
     auto builder = OpBuilder(f.getContext());
-    createPipeline(f, builder);
+    createPipeline(f, targetII, builder);
   }
 };
 
@@ -0,0 +1,399 @@
+//===- StaticLogicToFIRRTL.cpp - Translate StaticLogic into FIRRTL --------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This is the main StaticLogic to FIRRTL Conversion Pass Implementation. Every
+// pipeline scheduled by the create-pipeline pass becomes a FIRRTL module with
+// a register for every cycle a value has to live across, a valid bit shifting
+// along with each iteration, and stall and flush controls.
+//
+//===----------------------------------------------------------------------===//
+
+#include "circt/Conversion/StaticLogicToFIRRTL/StaticLogicToFIRRTL.h"
+#include "circt/Dialect/FIRRTL/FIRRTLOps.h"
+#include "circt/Dialect/FIRRTL/FIRRTLTypes.h"
+#include "circt/Dialect/StaticLogic/StaticLogic.h"
+#include "mlir/Dialect/StandardOps/IR/Ops.h"
+#include "llvm/ADT/TypeSwitch.h"
+
+using namespace mlir;
+using namespace circt;
+using namespace circt::firrtl;
+
+/// Get the FIRRTL type of a value of the given standard type. Integers and
+/// indices are treated as unsigned, just as in the Handshake lowering.
+static FIRRTLType getFIRRTLType(Type type) {
+  MLIRContext *context = type.getContext();
+  return TypeSwitch<Type, FIRRTLType>(type)
+      .Case<IntegerType>([&](IntegerType integerType) -> FIRRTLType {
+        return UIntType::get(context, integerType.getWidth());
+      })
+      .Case<IndexType>([&](IndexType) -> FIRRTLType {
+        return UIntType::get(context, IndexType::kInternalStorageBitWidth);
+      })
+      .Default([&](Type) { return FIRRTLType(); });
+}
+
+/// Return the stage an operation of a scheduled pipeline starts in.
+static unsigned getStage(Operation *op) {
+  return op->getAttrOfType<IntegerAttr>("staticlogic.stage").getInt();
+}
+
+namespace {
+/// Builds the FIRRTL module of a single scheduled pipeline.
+///
+/// An iteration enters the pipeline in a cycle where 'in_valid' is asserted
+/// and 'stall' is not. The operations of the pipeline are computed in the
+/// cycle of their stage, and their results are registered for every cycle
+/// they have to live until their last use. Arguments are registered the same
+/// way, starting from the cycle the iteration entered. After 'latency' cycles
+/// the results are presented together with 'out_valid'.
+///
+/// While 'stall' is asserted, all registers keep their value. 'flush' drops
+/// all iterations in flight by clearing their valid bits.
+///
+/// Values carried from one iteration to the next leave the pipeline and enter
+/// it again through its results and arguments. The surrounding control issues
+/// a new iteration at most every 'II' cycles, which the schedule guarantees is
+/// enough for these values to be ready.
+class PipelineBuilder {
+public:
+  PipelineBuilder(staticlogic::PipelineOp pipeline, FModuleOp module,
+                  OpBuilder &builder)
+      : pipeline(pipeline), builder(builder), loc(pipeline.getLoc()) {
+    Block *moduleBody = &module.getBody().front();
+    builder.setInsertionPoint(moduleBody->getTerminator());
+    auto args = moduleBody->getArguments();
+    unsigned numArgs = pipeline.getNumOperands();
+    unsigned numResults = pipeline.getNumResults();
+    moduleArgs = args.take_front(numArgs);
+    clock = args[numArgs];
+    reset = args[numArgs + 1];
+    inValid = args[numArgs + 2];
+    stall = args[numArgs + 3];
+    flush = args[numArgs + 4];
+    moduleResults = args.slice(numArgs + 5, numResults);
+    outValid = args[numArgs + 5 + numResults];
+  }
+
+  LogicalResult build();
+
+private:
+  /// Return the given value delayed by the given number of cycles after the
+  /// stage it's produced in.
+  Value getDelayed(Value value, unsigned cycles);
+
+  /// Return the lowered operand, as seen in the given stage.
+  Value getOperand(Value value, unsigned stage);
+
+  /// Lower a single operation of the pipeline, in the stage it's scheduled in.
+  LogicalResult lowerOp(Operation *op);
+
+  /// Create a register which takes the given value unless the pipeline is
+  /// stalled.
+  Value createStageRegister(Value input);
+
+  /// Create a binary primitive operation with the width of the first operand.
+  template <typename OpTy>
+  Value createBinary(Value lhs, Value rhs);
+
+  /// Truncate the value to the given width. Widths are only ever grown by the
+  /// primitive operations, so no extension is needed.
+  Value truncate(Value value, int32_t width);
+
+  staticlogic::PipelineOp pipeline;
+  OpBuilder &builder;
+  Location loc;
+
+  ArrayRef<BlockArgument> moduleArgs, moduleResults;
+  Value clock, reset, inValid, stall, flush, outValid;
+
+  /// All registered versions of each value of the pipeline. The first entry is
+  /// the value in the stage it's produced in.
+  DenseMap<Value, SmallVector<Value, 4>> delayChains;
+  /// The stage every value of the pipeline is produced in.
+  DenseMap<Value, unsigned> valueStages;
+  unsigned numRegisters = 0;
+};
+} // namespace
+
+Value PipelineBuilder::createStageRegister(Value input) {
+  auto name = builder.getStringAttr("reg" + std::to_string(numRegisters++));
+  Value reg = builder.create<RegOp>(loc, input.getType(), clock, name);
+  auto next =
+      builder.create<MuxPrimOp>(loc, input.getType(), stall, reg, input);
+  builder.create<ConnectOp>(loc, reg, next);
+  return reg;
+}
+
+Value PipelineBuilder::getDelayed(Value value, unsigned cycles) {
+  auto &chain = delayChains[value];
+  assert(!chain.empty() && "value used before it was lowered");
+  while (chain.size() <= cycles)
+    chain.push_back(createStageRegister(chain.back()));
+  return chain[cycles];
+}
+
+Value PipelineBuilder::getOperand(Value value, unsigned stage) {
+  // Constants don't need to be registered.
+  if (auto *def = value.getDefiningOp())
+    if (isa<mlir::ConstantOp>(def))
+      return delayChains[value].front();
+
+  unsigned defStage = valueStages.lookup(value);
+  assert(stage >= defStage && "value used before it is produced");
+  return getDelayed(value, stage - defStage);
+}
+
+Value PipelineBuilder::truncate(Value value, int32_t width) {
+  auto type = value.getType().cast<FIRRTLType>();
+  if (type.getBitWidthOrSentinel() == width)
+    return value;
+  return builder.create<BitsPrimOp>(loc, value, width - 1, 0);
+}
+
+template <typename OpTy>
+Value PipelineBuilder::createBinary(Value lhs, Value rhs) {
+  auto lhsType = lhs.getType().cast<FIRRTLType>();
+  auto resultType =
+      OpTy::getResultType(lhsType, rhs.getType().cast<FIRRTLType>(), loc);
+  auto result = builder.create<OpTy>(loc, resultType, lhs, rhs);
+  return truncate(result, lhsType.getBitWidthOrSentinel());
+}
+
+LogicalResult PipelineBuilder::lowerOp(Operation *op) {
+  unsigned stage = getStage(op);
+  SmallVector<Value, 3> operands;
+  for (auto operand : op->getOperands())
+    operands.push_back(getOperand(operand, stage));
+
+  auto bitType = UIntType::get(builder.getContext(), 1);
+
+  // Compare the operands, reinterpreted as signed integers if the predicate
+  // asks for it.
+  auto lowerCmp = [&](CmpIOp cmpOp) -> Value {
+    Value lhs = operands[0], rhs = operands[1];
+    auto predicate = cmpOp.getPredicate();
+    switch (predicate) {
+    case CmpIPredicate::slt:
+    case CmpIPredicate::sle:
+    case CmpIPredicate::sgt:
+    case CmpIPredicate::sge: {
+      auto width = lhs.getType().cast<FIRRTLType>().getBitWidthOrSentinel();
+      auto sintType = SIntType::get(builder.getContext(), width);
+      lhs = builder.create<AsSIntPrimOp>(loc, sintType, lhs);
+      rhs = builder.create<AsSIntPrimOp>(loc, sintType, rhs);
+      break;
+    }
+    default:
+      break;
+    }
+
+    switch (predicate) {
+    case CmpIPredicate::eq:
+      return builder.create<EQPrimOp>(loc, bitType, lhs, rhs);
+    case CmpIPredicate::ne:
+      return builder.create<NEQPrimOp>(loc, bitType, lhs, rhs);
+    case CmpIPredicate::slt:
+    case CmpIPredicate::ult:
+      return builder.create<LTPrimOp>(loc, bitType, lhs, rhs);
+    case CmpIPredicate::sle:
+    case CmpIPredicate::ule:
+      return builder.create<LEQPrimOp>(loc, bitType, lhs, rhs);
+    case CmpIPredicate::sgt:
+    case CmpIPredicate::ugt:
+      return builder.create<GTPrimOp>(loc, bitType, lhs, rhs);
+    case CmpIPredicate::sge:
+    case CmpIPredicate::uge:
+      return builder.create<GEQPrimOp>(loc, bitType, lhs, rhs);
+    }
+    llvm_unreachable("unknown comparison predicate");
+  };
+
+  Value result =
+      TypeSwitch<Operation *, Value>(op)
+          .Case<mlir::ConstantOp>([&](auto constOp) -> Value {
+            auto type = getFIRRTLType(constOp.getType());
+            auto value = constOp.getValue().template dyn_cast<IntegerAttr>();
+            if (!type || !value)
+              return {};
+            auto width = type.getBitWidthOrSentinel();
+            return builder.create<firrtl::ConstantOp>(
+                loc, type, value.getValue().zextOrTrunc(width));
+          })
+          .Case<AddIOp>([&](auto) {
+            return createBinary<AddPrimOp>(operands[0], operands[1]);
+          })
+          .Case<SubIOp>([&](auto) {
+            return createBinary<SubPrimOp>(operands[0], operands[1]);
+          })
+          .Case<MulIOp>([&](auto) {
+            return createBinary<MulPrimOp>(operands[0], operands[1]);
+          })
+          .Case<UnsignedDivIOp>([&](auto) {
+            return createBinary<DivPrimOp>(operands[0], operands[1]);
+          })
+          .Case<UnsignedRemIOp>([&](auto) {
+            return createBinary<RemPrimOp>(operands[0], operands[1]);
+          })
+          .Case<AndOp>([&](auto) {
+            return createBinary<AndPrimOp>(operands[0], operands[1]);
+          })
+          .Case<OrOp>([&](auto) {
+            return createBinary<OrPrimOp>(operands[0], operands[1]);
+          })
+          .Case<XOrOp>([&](auto) {
+            return createBinary<XorPrimOp>(operands[0], operands[1]);
+          })
+          .Case<CmpIOp>(lowerCmp)
+          .Case<SelectOp>([&](auto) -> Value {
+            return builder.create<MuxPrimOp>(loc, operands[1].getType(),
+                                             operands[0], operands[1],
+                                             operands[2]);
+          })
+          .Default([&](Operation *) { return Value(); });
+
+  if (!result)
+    return op->emitError("unsupported operation in pipeline");
+
+  Value opResult = op->getResult(0);
+  delayChains[opResult].push_back(result);
+  valueStages[opResult] = stage;
+  return success();
+}
+
+LogicalResult PipelineBuilder::build() {
+  auto latencyAttr = pipeline->getAttrOfType<IntegerAttr>("latency");
+  if (!latencyAttr)
+    return pipeline.emitError("pipeline has not been scheduled");
+  unsigned latency = latencyAttr.getInt();
+
+  // The arguments are produced in the first stage.
+  Block &body = pipeline.getRegion().front();
+  for (auto arg : llvm::enumerate(body.getArguments())) {
+    delayChains[arg.value()].push_back(moduleArgs[arg.index()]);
+    valueStages[arg.value()] = 0;
+  }
+
+  // Lower the operations in their schedule order, so that the operands are
+  // always lowered before their uses.
+  SmallVector<Operation *, 16> ops;
+  for (auto &op : body.without_terminator()) {
+    if (!op.getAttrOfType<IntegerAttr>("staticlogic.stage"))
+      return op.emitError("operation has not been scheduled");
+    if (op.getNumResults() != 1)
+      return op.emitError("unsupported operation in pipeline");
+    ops.push_back(&op);
+  }
+  std::stable_sort(ops.begin(), ops.end(), [](Operation *lhs, Operation *rhs) {
+    return getStage(lhs) < getStage(rhs);
+  });
+  for (auto *op : ops)
+    if (failed(lowerOp(op)))
+      return failure();
+
+  // Present the results once the iteration is complete.
+  auto *terminator = body.getTerminator();
+  for (auto operand : llvm::enumerate(terminator->getOperands()))
+    builder.create<ConnectOp>(loc, moduleResults[operand.index()],
+                              getOperand(operand.value(), latency));
+
+  // Shift a valid bit along with each iteration.
+  auto bitType = UIntType::get(builder.getContext(), 1);
+  auto falseConst =
+      builder.create<firrtl::ConstantOp>(loc, bitType, APInt(1, 0));
+  Value valid = builder.create<AndPrimOp>(
+      loc, bitType, inValid, builder.create<NotPrimOp>(loc, bitType, stall));
+  for (unsigned i = 0; i < latency; ++i) {
+    auto name = builder.getStringAttr("valid" + std::to_string(i));
+    Value reg = builder.create<RegResetOp>(loc, bitType, clock, reset,
+                                           falseConst, name);
+    auto next = builder.create<MuxPrimOp>(loc, bitType, stall, reg, valid);
+    auto flushed =
+        builder.create<MuxPrimOp>(loc, bitType, flush, falseConst, next);
+    builder.create<ConnectOp>(loc, reg, flushed);
+    valid = reg;
+  }
+  builder.create<ConnectOp>(loc, outValid, valid);
+  return success();
+}
+
+/// Create the FIRRTL module for a pipeline, in a circuit of its own.
+static FModuleOp createPipelineModule(staticlogic::PipelineOp pipeline,
+                                      StringRef name, OpBuilder &builder) {
+  auto circuit =
+      builder.create<CircuitOp>(pipeline.getLoc(), builder.getStringAttr(name));
+  builder.setInsertionPointToStart(circuit.getBody());
+
+  auto bitType = UIntType::get(builder.getContext(), 1);
+  SmallVector<ModulePortInfo, 8> ports;
+  auto addPort = [&](const Twine &portName, FIRRTLType type) {
+    ports.push_back({builder.getStringAttr(portName), type});
+  };
+  for (auto arg : llvm::enumerate(pipeline.getOperandTypes()))
+    addPort("arg" + Twine(arg.index()), getFIRRTLType(arg.value()));
+  addPort("clock", builder.getType<ClockType>());
+  addPort("reset", bitType);
+  addPort("in_valid", bitType);
+  addPort("stall", bitType);
+  addPort("flush", bitType);
+  for (auto result : llvm::enumerate(pipeline.getResultTypes()))
+    addPort("result" + Twine(result.index()),
+            FlipType::get(getFIRRTLType(result.value())));
+  addPort("out_valid", FlipType::get(bitType));
+
+  return builder.create<FModuleOp>(pipeline.getLoc(),
+                                   builder.getStringAttr(name), ports);
+}
+
+namespace {
+struct StaticLogicToFIRRTLPass
+    : public PassWrapper<StaticLogicToFIRRTLPass, OperationPass<ModuleOp>> {
+  void runOnOperation() override {
+    ModuleOp module = getOperation();
+    OpBuilder builder(module.getContext());
+
+    // Collect the pipelines first, the circuits are added to the same module.
+    SmallVector<std::pair<mlir::FuncOp, staticlogic::PipelineOp>, 4> pipelines;
+    for (auto func : module.getOps<mlir::FuncOp>())
+      func.walk([&](staticlogic::PipelineOp pipeline) {
+        pipelines.push_back({func, pipeline});
+      });
+
+    DenseMap<Operation *, unsigned> numPipelines;
+    for (auto &entry : pipelines) {
+      mlir::FuncOp func = entry.first;
+      staticlogic::PipelineOp pipeline = entry.second;
+
+      for (auto type : pipeline.getOperandTypes())
+        if (!getFIRRTLType(type)) {
+          pipeline.emitError("unsupported argument type ") << type;
+          return signalPassFailure();
+        }
+      for (auto type : pipeline.getResultTypes())
+        if (!getFIRRTLType(type)) {
+          pipeline.emitError("unsupported result type ") << type;
+          return signalPassFailure();
+        }
+
+      std::string name = (func.getName() + "_pipeline" +
+                          Twine(numPipelines[func]++))
+                             .str();
+      builder.setInsertionPoint(module.getBody()->getTerminator());
+      auto firrtlModule = createPipelineModule(pipeline, name, builder);
+      if (failed(PipelineBuilder(pipeline, firrtlModule, builder).build()))
+        return signalPassFailure();
+    }
+  }
+};
+} // end anonymous namespace
+
+void staticlogic::registerStaticLogicToFIRRTLPasses() {
+  PassRegistration<StaticLogicToFIRRTLPass>(
+      "lower-staticlogic-to-firrtl",
+      "Lower scheduled StaticLogic pipelines to FIRRTL modules");
+}
@@ -64,6 +64,14 @@ static void print(OpAsmPrinter &p, ChannelBuffer &op) {
   p << " : " << op.output().getType().cast<ChannelPort>().getInner();
 }
 
+static LogicalResult verify(ChannelBuffer op) {
+  StringAttr kind = op.options().kind();
+  if (kind && kind.getValue() != "pipeline" && kind.getValue() != "fifo")
+    return op.emitOpError("unknown buffer kind '")
+           << kind.getValue() << "', expected 'pipeline' or 'fifo'";
+  return success();
+}
+
 //===----------------------------------------------------------------------===//
 // PipelineStage functions.
 //===----------------------------------------------------------------------===//
@@ -96,6 +104,52 @@ static void print(OpAsmPrinter &p, PipelineStage &op) {
   p << " : " << op.output().getType().cast<ChannelPort>().getInner();
 }
 
+//===----------------------------------------------------------------------===//
+// ChannelFIFO functions.
+//===----------------------------------------------------------------------===//
+
+/// Same syntax as `esi.stage`, with the depth in the attribute dictionary.
+static ParseResult parseChannelFIFO(OpAsmParser &parser,
+                                    OperationState &result) {
+  return parsePipelineStage(parser, result);
+}
+
+static void print(OpAsmPrinter &p, ChannelFIFO &op) {
+  p << "esi.fifo " << op.clk() << ", " << op.rstn() << ", " << op.input()
+    << " ";
+  p.printOptionalAttrDict(op.getAttrs());
+  p << " : " << op.output().getType().cast<ChannelPort>().getInner();
+}
+
+//===----------------------------------------------------------------------===//
+// Gearbox functions.
+//===----------------------------------------------------------------------===//
+
+/// Check that 'wide' is a whole multiple as wide as 'narrow'. Both have to be
+/// integers.
+static LogicalResult verifyGearboxTypes(Operation *op, Type narrow, Type wide) {
+  auto narrowInt = narrow.dyn_cast<IntegerType>();
+  auto wideInt = wide.dyn_cast<IntegerType>();
+  if (!narrowInt || !wideInt)
+    return op->emitOpError("only supports channels of integers");
+  if (wideInt.getWidth() % narrowInt.getWidth() != 0)
+    return op->emitOpError("width of ")
+           << wide << " is not a multiple of the width of " << narrow;
+  return success();
+}
+
+static LogicalResult verifyGearbox(ChannelPack op) {
+  return verifyGearboxTypes(
+      op, op.input().getType().cast<ChannelPort>().getInner(),
+      op.output().getType().cast<ChannelPort>().getInner());
+}
+
+static LogicalResult verifyGearbox(ChannelUnpack op) {
+  return verifyGearboxTypes(
+      op, op.output().getType().cast<ChannelPort>().getInner(),
+      op.input().getType().cast<ChannelPort>().getInner());
+}
+
 //===----------------------------------------------------------------------===//
 // Wrap / unwrap.
 //===----------------------------------------------------------------------===//
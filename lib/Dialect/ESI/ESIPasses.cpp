@@ -17,13 +17,19 @@
 #include "circt/Dialect/SV/SVOps.h"
 #include "circt/Support/BackedgeBuilder.h"
 #include "circt/Support/ImplicitLocOpBuilder.h"
+#include "circt/Support/InstanceGraph.h"
 
 #include "mlir/Dialect/StandardOps/IR/Ops.h"
 #include "mlir/IR/BuiltinTypes.h"
+#include "mlir/IR/Diagnostics.h"
 #include "mlir/Pass/Pass.h"
 #include "mlir/Transforms/DialectConversion.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/SetVector.h"
 #include "llvm/ADT/TypeSwitch.h"
+#include "llvm/Support/Parallel.h"
 
+#include <cmath>
 #include <memory>
 
 #ifdef CAPNP
@@ -66,6 +72,10 @@ public:
   ESIRTLBuilder(Operation *top);
 
   RTLExternModuleOp declareStage();
+  RTLExternModuleOp declareFIFO();
+  RTLExternModuleOp declareCreditLink();
+  RTLExternModuleOp declarePack();
+  RTLExternModuleOp declareUnpack();
   RTLExternModuleOp declareCosimEndpoint();
 
   InterfaceOp getOrConstructInterface(ChannelPort);
@@ -76,7 +86,7 @@ public:
   const StringAttr dataOutValid, dataOutReady, dataOut, dataInValid,
       dataInReady, dataIn;
   const StringAttr clk, rstn;
-  const Identifier width;
+  const Identifier width, depth, inWidth, outWidth, creditsId;
 
   // Various identifier strings. Keep them all here in case we rename them.
   static constexpr char dataStr[] = "data", validStr[] = "valid",
@@ -88,7 +98,16 @@ private:
   /// taken in the symbol table.
   StringAttr constructInterfaceName(ChannelPort);
 
+  /// Declare (once, caching it in 'declared') a primitive with the a/x channel
+  /// ports of the pipeline stage.
+  RTLExternModuleOp declareStageLike(StringRef name,
+                                     RTLExternModuleOp &declared);
+
   RTLExternModuleOp declaredStage;
+  RTLExternModuleOp declaredFIFO;
+  RTLExternModuleOp declaredCreditLink;
+  RTLExternModuleOp declaredPack;
+  RTLExternModuleOp declaredUnpack;
   RTLExternModuleOp declaredCosimEndpoint;
   llvm::DenseMap<Type, InterfaceOp> portTypeLookup;
 };
@@ -116,7 +135,14 @@ ESIRTLBuilder::ESIRTLBuilder(Operation *top)
       dataIn(StringAttr::get("DataIn", getContext())),
       clk(StringAttr::get("clk", getContext())),
       rstn(StringAttr::get("rstn", getContext())),
-      width(Identifier::get("WIDTH", getContext())), declaredStage(nullptr) {
+      width(Identifier::get("WIDTH", getContext())),
+      depth(Identifier::get("DEPTH", getContext())),
+      inWidth(Identifier::get("IN_WIDTH", getContext())),
+      outWidth(Identifier::get("OUT_WIDTH", getContext())),
+      creditsId(Identifier::get("CREDITS", getContext())),
+      declaredStage(nullptr), declaredFIFO(nullptr),
+      declaredCreditLink(nullptr), declaredPack(nullptr),
+      declaredUnpack(nullptr) {
 
   auto regions = top->getRegions();
   if (regions.size() == 0) {
@@ -156,15 +182,11 @@ StringAttr ESIRTLBuilder::constructInterfaceName(ChannelPort port) {
   return StringAttr::get(proposedName, getContext());
 }
 
-/// Write an 'ExternModuleOp' to use a hand-coded SystemVerilog module. Said
-/// module implements pipeline stage, adding 1 cycle latency. This particular
-/// implementation is double-buffered and fully pipelines the reverse-flow ready
-/// signal.
-RTLExternModuleOp ESIRTLBuilder::declareStage() {
-  if (declaredStage)
-    return declaredStage;
+RTLExternModuleOp
+ESIRTLBuilder::declareStageLike(StringRef name, RTLExternModuleOp &declared) {
+  if (declared)
+    return declared;
 
-  auto name = StringAttr::get("ESI_PipelineStage", getContext());
   // Since this module has parameterized widths on the a input and x output,
   // give the extern declation a None type since nothing else makes sense.
   // Will be refining this when we decide how to better handle parameterized
@@ -177,8 +199,43 @@ RTLExternModuleOp ESIRTLBuilder::declareStage() {
                             {x, PortDirection::OUTPUT, getNoneType(), 1},
                             {xValid, PortDirection::OUTPUT, getI1Type(), 2},
                             {xReady, PortDirection::INPUT, getI1Type(), 4}};
-  declaredStage = create<RTLExternModuleOp>(name, ports);
-  return declaredStage;
+  declared = create<RTLExternModuleOp>(StringAttr::get(name, getContext()),
+                                       ports);
+  return declared;
+}
+
+/// Write an 'ExternModuleOp' to use a hand-coded SystemVerilog module. Said
+/// module implements pipeline stage, adding 1 cycle latency. This particular
+/// implementation is double-buffered and fully pipelines the reverse-flow ready
+/// signal.
+RTLExternModuleOp ESIRTLBuilder::declareStage() {
+  return declareStageLike("ESI_PipelineStage", declaredStage);
+}
+
+/// Write an 'ExternModuleOp' to use a hand-coded SystemVerilog module. Said
+/// module implements a RAM-backed FIFO with the same ports as the pipeline
+/// stage.
+RTLExternModuleOp ESIRTLBuilder::declareFIFO() {
+  return declareStageLike("ESI_FIFO", declaredFIFO);
+}
+
+/// Write an 'ExternModuleOp' to use a hand-coded SystemVerilog module. Said
+/// module implements a credit-based link with the same ports as the pipeline
+/// stage.
+RTLExternModuleOp ESIRTLBuilder::declareCreditLink() {
+  return declareStageLike("ESI_CreditLink", declaredCreditLink);
+}
+
+/// Write an 'ExternModuleOp' to use a hand-coded SystemVerilog module. Said
+/// module packs OUT_WIDTH / IN_WIDTH narrow tokens into each wide token.
+RTLExternModuleOp ESIRTLBuilder::declarePack() {
+  return declareStageLike("ESI_Pack", declaredPack);
+}
+
+/// Write an 'ExternModuleOp' to use a hand-coded SystemVerilog module. Said
+/// module splits each wide token into IN_WIDTH / OUT_WIDTH narrow tokens.
+RTLExternModuleOp ESIRTLBuilder::declareUnpack() {
+  return declareStageLike("ESI_Unpack", declaredUnpack);
 }
 
 /// Write an 'ExternModuleOp' to use a hand-coded SystemVerilog module. Said
@@ -242,9 +299,9 @@ InterfaceOp ESIRTLBuilder::constructInterface(ChannelPort chan) {
 //===----------------------------------------------------------------------===//
 
 namespace {
-/// Lower `ChannelBuffer`s, breaking out the various options. For now, just
-/// replace with the specified number of pipeline stages (since that's the only
-/// option).
+/// Lower `ChannelBuffer`s, breaking out the various options. Replace with the
+/// specified number of pipeline stages or, for FIFO buffers, a FIFO of that
+/// depth.
 struct ChannelBufferLowering : public OpConversionPattern<ChannelBuffer> {
 public:
   using OpConversionPattern::OpConversionPattern;
@@ -272,6 +329,19 @@ LogicalResult ChannelBufferLowering::matchAndRewrite(
   }
   Value input = buffer.input();
   StringAttr bufferName = buffer.options().name();
+  StringAttr kind = opts.kind();
+  if (kind && kind.getValue() == "fifo") {
+    auto fifo = rewriter.create<ChannelFIFO>(
+        loc, type, buffer.clk(), buffer.rstn(), input,
+        rewriter.getI64IntegerAttr(numStages));
+    if (bufferName) {
+      SmallString<64> fifoName({bufferName.getValue(), "_fifo"});
+      fifo->setAttr("name", StringAttr::get(fifoName, rewriter.getContext()));
+    }
+    rewriter.replaceOp(buffer, fifo.output());
+    return success();
+  }
+
   for (uint64_t i = 0; i < numStages; ++i) {
     // Create the stages, connecting them up as we build.
     auto stage = rewriter.create<PipelineStage>(loc, type, buffer.clk(),
@@ -312,19 +382,216 @@ void ESIToPhysicalPass::runOnOperation() {
     signalPassFailure();
 };
 
+//===----------------------------------------------------------------------===//
+// Buffer insertion pass.
+//===----------------------------------------------------------------------===//
+
+/// The number of cycles a module takes from its input channels to its output
+/// channels, from its `esi.latency` annotation. Unannotated modules are assumed
+/// to be combinational.
+static uint64_t getInstanceLatency(InstanceOp inst) {
+  Operation *mod = inst.getReferencedModule();
+  if (!mod)
+    return 0;
+  if (auto latency = mod->getAttrOfType<IntegerAttr>("esi.latency"))
+    return latency.getValue().getLimitedValue();
+  return 0;
+}
+
+/// Get the number of stages (or entries, if it's a FIFO) in a buffer.
+static uint64_t getBufferStages(ChannelBuffer buffer) {
+  IntegerAttr stages = buffer.options().stages();
+  return stages ? stages.getValue().getLimitedValue() : 1;
+}
+
+/// The number of cycles a buffer adds to a channel.
+static uint64_t getBufferLatency(ChannelBuffer buffer) {
+  StringAttr kind = buffer.options().kind();
+  if (kind && kind.getValue() == "fifo")
+    return 1;
+  return getBufferStages(buffer);
+}
+
+namespace {
+/// A channel into an instance from another instance (or from a module input if
+/// `producer` is null), possibly through a chain of buffers.
+struct ChannelEdge {
+  InstanceOp producer;
+  InstanceOp consumer;
+  unsigned operandIdx;
+  /// The buffer closest to the consumer, if there is one.
+  ChannelBuffer buffer;
+  /// Total latency of the buffers on the channel.
+  uint64_t bufferLatency;
+};
+
+/// Balance the latency of reconvergent channel paths. If a module consumes
+/// tokens which took paths of different latencies, the shorter paths need
+/// enough buffering to hold the tokens which arrive early or the longer paths
+/// get backpressured and throughput drops. This computes the latest arrival
+/// time at every instance from the `esi.latency` module annotations, then
+/// pads every channel which has slack with buffer stages (or widens the buffer
+/// already on it) until it meets the target rate.
+struct ESIBufferInsertionPass
+    : public InsertESIBuffersBase<ESIBufferInsertionPass> {
+  void runOnOperation() override;
+
+private:
+  void runOnModule(RTLModuleOp mod);
+};
+} // anonymous namespace
+
+void ESIBufferInsertionPass::runOnOperation() {
+  for (auto mod : getOperation().getOps<RTLModuleOp>())
+    runOnModule(mod);
+}
+
+void ESIBufferInsertionPass::runOnModule(RTLModuleOp mod) {
+  // Gather the channels between the instances.
+  SmallVector<ChannelEdge, 16> edges;
+  SmallVector<InstanceOp, 16> instances;
+  for (auto inst : mod.getBodyBlock()->getOps<InstanceOp>()) {
+    instances.push_back(inst);
+    for (auto &operand : inst->getOpOperands()) {
+      if (!operand.get().getType().isa<ChannelPort>())
+        continue;
+      ChannelEdge edge{{}, inst, operand.getOperandNumber(), {}, 0};
+      Value v = operand.get();
+      while (auto buffer = v.getDefiningOp<ChannelBuffer>()) {
+        if (!edge.buffer)
+          edge.buffer = buffer;
+        edge.bufferLatency += getBufferLatency(buffer);
+        v = buffer.input();
+      }
+      edge.producer = v.getDefiningOp<InstanceOp>();
+      edges.push_back(edge);
+    }
+  }
+
+  // Compute the latest arrival time at each instance in topological order.
+  // Instances on channel cycles never get ordered; their latency is set by the
+  // cycle, not by the buffering, so leave them alone.
+  DenseMap<Operation *, uint64_t> arrival;
+  DenseMap<Operation *, unsigned> numPreds;
+  DenseMap<Operation *, SmallVector<ChannelEdge *, 4>> succs;
+  for (auto &edge : edges) {
+    uint64_t &consumerArrival = arrival[edge.consumer];
+    if (!edge.producer) {
+      consumerArrival = std::max(consumerArrival, edge.bufferLatency);
+      continue;
+    }
+    ++numPreds[edge.consumer];
+    succs[edge.producer].push_back(&edge);
+  }
+  SmallVector<Operation *, 16> worklist;
+  for (auto inst : instances)
+    if (numPreds[inst] == 0)
+      worklist.push_back(inst);
+  DenseSet<Operation *> ordered;
+  while (!worklist.empty()) {
+    Operation *inst = worklist.pop_back_val();
+    ordered.insert(inst);
+    uint64_t ready = arrival[inst] + getInstanceLatency(cast<InstanceOp>(inst));
+    for (ChannelEdge *edge : succs[inst]) {
+      uint64_t &consumerArrival = arrival[edge->consumer];
+      consumerArrival = std::max(consumerArrival, ready + edge->bufferLatency);
+      if (--numPreds[edge->consumer] == 0)
+        worklist.push_back(edge->consumer);
+    }
+  }
+  for (auto inst : instances)
+    if (!ordered.count(inst))
+      inst.emitRemark("instance is on a channel cycle, not buffering it");
+
+  // Lazily find the clock and reset for any buffers we create.
+  Value clk, rstn;
+  SmallVector<ModulePortInfo, 8> ports;
+  getModulePortInfo(mod, ports);
+  for (auto &port : ports) {
+    if (port.isOutput())
+      continue;
+    if (port.getName() == "clk")
+      clk = mod.getArgument(port.argNum);
+    else if (port.getName() == "rstn")
+      rstn = mod.getArgument(port.argNum);
+  }
+
+  auto *ctxt = &getContext();
+  OpBuilder builder(ctxt);
+  for (auto &edge : edges) {
+    if (!ordered.count(edge.consumer) ||
+        (edge.producer && !ordered.count(edge.producer)))
+      continue;
+    uint64_t ready = edge.bufferLatency;
+    if (edge.producer)
+      ready += arrival[edge.producer] + getInstanceLatency(edge.producer);
+    uint64_t slack = arrival[edge.consumer] - ready;
+    auto extraStages = (uint64_t)std::ceil(slack * targetRate);
+    if (extraStages == 0)
+      continue;
+
+    // Widen the existing buffer if nothing else depends on it.
+    ChannelBuffer buffer = edge.buffer;
+    if (buffer && buffer.output().hasOneUse()) {
+      uint64_t oldStages = getBufferStages(buffer);
+      ChannelBufferOptions opts = buffer.options();
+      buffer->setAttr(
+          "options",
+          ChannelBufferOptions::get(
+              builder.getI64IntegerAttr(oldStages + extraStages), opts.kind(),
+              opts.name(), ctxt));
+      buffer.emitRemark("widened buffer from ")
+          << oldStages << " to " << oldStages + extraStages
+          << " stages to absorb " << slack << " cycles of slack";
+      continue;
+    }
+
+    if (!clk || !rstn) {
+      edge.consumer.emitWarning("input ")
+          << edge.operandIdx << " has " << slack
+          << " cycles of slack but the module has no 'clk' and 'rstn' ports "
+             "to clock a buffer";
+      continue;
+    }
+    builder.setInsertionPoint(edge.consumer);
+    Value input = edge.consumer->getOperand(edge.operandIdx);
+    auto newBuffer = builder.create<ChannelBuffer>(
+        edge.consumer.getLoc(), input.getType(), clk, rstn, input,
+        ChannelBufferOptions::get(builder.getI64IntegerAttr(extraStages),
+                                  StringAttr(), StringAttr(), ctxt));
+    edge.consumer->setOperand(edge.operandIdx, newBuffer);
+    edge.consumer.emitRemark("inserted a ")
+        << extraStages << " stage buffer on input " << edge.operandIdx
+        << " to absorb " << slack << " cycles of slack";
+  }
+}
+
 //===----------------------------------------------------------------------===//
 // Lower ESI ports pass.
 //===----------------------------------------------------------------------===//
 
 namespace {
+/// How the ports of an updated module map to its new ports. It is computed once
+/// per module and shared by all its instances, which only read it.
+struct PortMapping {
+  /// The type of the module before the update.
+  FunctionType oldType;
+  /// The interface which replaces each input channel, null for other inputs.
+  SmallVector<InterfaceOp, 8> inputIfaces;
+  /// The interface which replaces each result channel, null for other results.
+  SmallVector<InterfaceOp, 4> resultIfaces;
+};
+
 /// Convert all the ESI ports on modules to some lower construct. SV interfaces
 /// for now. In the future, it may be possible to select a different format.
 struct ESIPortsPass : public LowerESIPortsBase<ESIPortsPass> {
   void runOnOperation();
 
 private:
-  bool updateFunc(RTLExternModuleOp mod);
-  void updateInstance(RTLExternModuleOp mod, InstanceOp inst);
+  bool updateFunc(RTLExternModuleOp mod, PortMapping &mapping);
+  void updateInstance(const PortMapping &mapping, InstanceOp inst);
+  void updateInstances(InstanceGraphNode *parent,
+                       const DenseMap<Operation *, PortMapping> &mappings);
   ESIRTLBuilder *build;
 };
 } // anonymous namespace
@@ -335,30 +602,64 @@ void ESIPortsPass::runOnOperation() {
   ESIRTLBuilder b(top);
   build = &b;
 
-  // Find all externmodules and try to modify them. Remember the modified ones.
-  DenseMap<StringRef, RTLExternModuleOp> modsMutated;
-  for (auto mod : top.getOps<RTLExternModuleOp>())
-    if (updateFunc(mod))
-      modsMutated[mod.getName()] = mod;
+  // Find all externmodules and try to modify them. Remember the port mapping
+  // of the modified ones. This creates all the interfaces the instances need.
+  DenseMap<Operation *, PortMapping> mappings;
+  SmallVector<RTLExternModuleOp, 8> modsMutated;
+  for (auto mod : top.getOps<RTLExternModuleOp>()) {
+    PortMapping mapping;
+    if (!updateFunc(mod, mapping))
+      continue;
+    mappings.try_emplace(mod, std::move(mapping));
+    modsMutated.push_back(mod);
+  }
+  build = nullptr;
 
-  // Find all instances and update them.
-  top.walk([&modsMutated, this](InstanceOp inst) {
-    auto mapIter = modsMutated.find(inst.moduleName());
-    if (mapIter != modsMutated.end())
-      updateInstance(mapIter->second, inst);
-  });
+  // Find the modules which instantiate the modified ones.
+  auto &instanceGraph = getAnalysis<InstanceGraph>();
+  llvm::SetVector<InstanceGraphNode *> parents;
+  for (auto mod : modsMutated)
+    for (auto *use : instanceGraph.lookup(mod)->getUses())
+      parents.insert(use->getParent());
+
+  // Update the instances of each module in one pass over its instances. The
+  // updates only create ops in the module containing the instance, so the
+  // modules can be processed in parallel.
+  if (getContext().isMultithreadingEnabled()) {
+    ParallelDiagnosticHandler diagHandler(&getContext());
+    llvm::parallelForEachN(0, parents.size(), [&](size_t i) {
+      diagHandler.setOrderIDForThread(i);
+      updateInstances(parents[i], mappings);
+      diagHandler.eraseOrderIDForThread();
+    });
+  } else {
+    for (auto *parent : parents)
+      updateInstances(parent, mappings);
+  }
+}
 
-  build = nullptr;
+/// Update the instances of the modified modules within a module.
+void ESIPortsPass::updateInstances(
+    InstanceGraphNode *parent,
+    const DenseMap<Operation *, PortMapping> &mappings) {
+  for (auto &record : parent->getInstances()) {
+    auto it = mappings.find(record.getTarget()->getModule());
+    if (it == mappings.end())
+      continue;
+    if (auto inst = dyn_cast<InstanceOp>(record.getInstance()))
+      updateInstance(it->second, inst);
+  }
 }
 
 /// Convert all input and output ChannelPorts into SV Interfaces. For inputs,
 /// just switch the type to `ModportType`. For outputs, append a `ModportType`
 /// to the inputs and remove the output channel from the results. Returns true
-/// if 'mod' was updated. Delay updating the instances to amortize the IR walk
-/// over all the module updates.
-bool ESIPortsPass::updateFunc(RTLExternModuleOp mod) {
+/// if 'mod' was updated, in which case 'mapping' describes the update. Delay
+/// updating the instances to amortize the IR walk over all the module updates.
+bool ESIPortsPass::updateFunc(RTLExternModuleOp mod, PortMapping &mapping) {
   auto *ctxt = &getContext();
   auto funcType = mod.getType();
+  mapping.oldType = funcType;
 
   bool updated = false;
 
@@ -369,6 +670,7 @@ bool ESIPortsPass::updateFunc(RTLExternModuleOp mod) {
     auto chanTy = argTy.dyn_cast<ChannelPort>();
     if (!chanTy) {
       newArgTypes.push_back(argTy);
+      mapping.inputIfaces.push_back({});
       continue;
     }
 
@@ -376,6 +678,7 @@ bool ESIPortsPass::updateFunc(RTLExternModuleOp mod) {
     // the type list.
     auto iface = build->getOrConstructInterface(chanTy);
     newArgTypes.push_back(iface.getModportType(ESIRTLBuilder::sourceStr));
+    mapping.inputIfaces.push_back(iface);
     updated = true;
   }
 
@@ -396,6 +699,7 @@ bool ESIPortsPass::updateFunc(RTLExternModuleOp mod) {
     if (!chanTy) {
       newResultTypes.push_back(resTy);
       newResultAttrs.push_back(resAttrs[resNum]);
+      mapping.resultIfaces.push_back({});
       continue;
     }
 
@@ -405,6 +709,7 @@ bool ESIPortsPass::updateFunc(RTLExternModuleOp mod) {
     ModportType sinkPort = iface.getModportType(ESIRTLBuilder::sinkStr);
     newArgTypes.push_back(sinkPort);
     argAttrs.push_back(resAttrs[resNum]);
+    mapping.resultIfaces.push_back(iface);
     updated = true;
   }
 
@@ -421,38 +726,35 @@ bool ESIPortsPass::updateFunc(RTLExternModuleOp mod) {
 
 /// Update an instance of an updated module by adding `esi.(un)wrap.iface`
 /// around the instance. Create a new instance at the end from the lists built
-/// up before.
-void ESIPortsPass::updateInstance(RTLExternModuleOp mod, InstanceOp inst) {
+/// up before. Only the port mapping of the module is used, such that the
+/// instances of different modules can be updated concurrently.
+void ESIPortsPass::updateInstance(const PortMapping &mapping, InstanceOp inst) {
   using namespace circt::sv;
   circt::ImplicitLocOpBuilder instBuilder(inst);
-  FunctionType funcTy = mod.getType();
+  FunctionType oldTy = mapping.oldType;
 
-  // op counter for error reporting purposes.
-  size_t opNum = 0;
   // List of new operands.
   SmallVector<Value, 16> newOperands;
 
   // Fill the new operand list with old plain operands and mutated ones.
-  for (auto op : inst.getOperands()) {
-    auto instChanTy = op.getType().dyn_cast<ChannelPort>();
-    if (!instChanTy) {
+  for (auto opAndNum : llvm::enumerate(inst.getOperands())) {
+    Value op = opAndNum.value();
+    size_t opNum = opAndNum.index();
+    InterfaceOp iface = opNum < mapping.inputIfaces.size()
+                            ? mapping.inputIfaces[opNum]
+                            : InterfaceOp();
+    if (!op.getType().isa<ChannelPort>() && !iface) {
       newOperands.push_back(op);
-      ++opNum;
       continue;
     }
 
-    // Get the interface from the cache, and make sure it's the same one as
-    // being used in the module.
-    auto iface = build->getOrConstructInterface(instChanTy);
-    if (iface.getModportType(ESIRTLBuilder::sourceStr) !=
-        funcTy.getInput(opNum)) {
+    // Make sure the channel is the same one as being used in the module.
+    if (!iface || op.getType() != oldTy.getInput(opNum)) {
       inst.emitOpError("ESI ChannelPort (operand #")
           << opNum << ") doesn't match module!";
-      ++opNum;
       newOperands.push_back(op);
       continue;
     }
-    ++opNum;
 
     // Build a gasket by instantiating an interface, connecting one end to an
     // `esi.unwrap.iface` and the other end to the instance.
@@ -474,26 +776,23 @@ void ESIPortsPass::updateInstance(RTLExternModuleOp mod, InstanceOp inst) {
   for (size_t resNum = 0, numRes = inst.getNumResults(); resNum < numRes;
        ++resNum) {
     Value res = inst.getResult(resNum);
-    auto instChanTy = res.getType().dyn_cast<ChannelPort>();
-    if (!instChanTy) {
+    InterfaceOp iface = resNum < mapping.resultIfaces.size()
+                            ? mapping.resultIfaces[resNum]
+                            : InterfaceOp();
+    if (!res.getType().isa<ChannelPort>() && !iface) {
       newResults.push_back(res);
       newResultTypes.push_back(res.getType());
       continue;
     }
 
-    // Get the interface from the cache, and make sure it's the same one as
-    // being used in the module.
-    auto iface = build->getOrConstructInterface(instChanTy);
-    if (iface.getModportType(ESIRTLBuilder::sinkStr) !=
-        funcTy.getInput(opNum)) {
+    // Make sure the channel is the same one as being used in the module.
+    if (!iface || res.getType() != oldTy.getResult(resNum)) {
       inst.emitOpError("ESI ChannelPort (result #")
-          << resNum << ", operand #" << opNum << ") doesn't match module!";
-      ++opNum;
+          << resNum << ") doesn't match module!";
       newResults.push_back(res);
       newResultTypes.push_back(res.getType());
       continue;
     }
-    ++opNum;
 
     // Build a gasket by instantiating an interface, connecting one end to an
     // `esi.wrap.iface` and the other end to the instance. Append it to the
@@ -530,14 +829,63 @@ void ESIPortsPass::updateInstance(RTLExternModuleOp mod, InstanceOp inst) {
 // Lower to RTL/SV conversions and pass.
 //===----------------------------------------------------------------------===//
 
+/// Replace a stage-like op (clock, reset and a channel in, a channel out) with
+/// an instance of the primitive `primitive`. Unwrap and re-wrap appropriately.
+static void replaceWithPrimitive(Operation *op, Value clk, Value rstn,
+                                 Value input, RTLExternModuleOp primitive,
+                                 StringRef defaultName,
+                                 const NamedAttrList &params,
+                                 ConversionPatternRewriter &rewriter) {
+  auto loc = op->getLoc();
+  auto chPort = op->getResult(0).getType().cast<ChannelPort>();
+
+  // Unwrap the channel. The ready signal is a Value we haven't created yet, so
+  // create a temp value and replace it later. Give this constant an odd-looking
+  // type to make debugging easier.
+  circt::BackedgeBuilder back(rewriter, loc);
+  circt::Backedge wrapReady = back.get(rewriter.getI1Type());
+  auto unwrap = rewriter.create<UnwrapValidReady>(loc, input, wrapReady);
+
+  StringRef instName = defaultName;
+  if (auto name = op->getAttrOfType<StringAttr>("name"))
+    instName = name.getValue();
+
+  // Instantiate the external module.
+  circt::Backedge instReady = back.get(rewriter.getI1Type());
+  Value operands[] = {clk, rstn, unwrap.rawOutput(), unwrap.valid(),
+                      instReady};
+  Type resultTypes[] = {rewriter.getI1Type(), chPort.getInner(),
+                        rewriter.getI1Type()};
+  auto inst = rewriter.create<InstanceOp>(
+      loc, resultTypes, instName, primitive.getName(), operands,
+      params.getDictionary(rewriter.getContext()));
+  auto instResults = inst.getResults();
+
+  // Set a_ready (from the unwrap) back edge correctly to its output from the
+  // instance.
+  wrapReady.setValue(instResults[0]);
+
+  Value x = instResults[1];
+  Value xValid = instResults[2];
+
+  // Wrap up the output of the RTL module.
+  auto wrap = rewriter.create<WrapValidReady>(loc, chPort, rewriter.getI1Type(),
+                                              x, xValid);
+  // Set the instance's x_ready backedge correctly.
+  instReady.setValue(wrap.ready());
+
+  rewriter.replaceOp(op, wrap.chanOutput());
+}
+
 namespace {
 /// Lower PipelineStage ops to an RTL implementation. Unwrap and re-wrap
 /// appropriately. Another conversion will take care merging the resulting
 /// adjacent wrap/unwrap ops.
 struct PipelineStageLowering : public OpConversionPattern<PipelineStage> {
 public:
-  PipelineStageLowering(ESIRTLBuilder &builder, MLIRContext *ctxt)
-      : OpConversionPattern(ctxt), builder(builder) {}
+  PipelineStageLowering(ESIRTLBuilder &builder, MLIRContext *ctxt,
+                        unsigned credits = 0)
+      : OpConversionPattern(ctxt), builder(builder), credits(credits) {}
   using OpConversionPattern::OpConversionPattern;
 
   LogicalResult
@@ -546,60 +894,127 @@ public:
 
 private:
   ESIRTLBuilder &builder;
+  /// If non-zero, use credit-based links with this many credits instead of
+  /// valid/ready stages.
+  unsigned credits;
 };
 } // anonymous namespace
 
 LogicalResult PipelineStageLowering::matchAndRewrite(
     PipelineStage stage, ArrayRef<Value> stageOperands,
     ConversionPatternRewriter &rewriter) const {
-  auto loc = stage.getLoc();
   auto chPort = stage.input().getType().dyn_cast<ChannelPort>();
   if (!chPort)
     return failure();
-  auto stageModule = builder.declareStage();
-
   NamedAttrList stageParams;
   size_t width = getNumBits(chPort.getInner());
   stageParams.set(builder.width, rewriter.getUI32IntegerAttr(width));
 
-  // Unwrap the channel. The ready signal is a Value we haven't created yet, so
-  // create a temp value and replace it later. Give this constant an odd-looking
-  // type to make debugging easier.
-  circt::BackedgeBuilder back(rewriter, loc);
-  circt::Backedge wrapReady = back.get(rewriter.getI1Type());
-  auto unwrap =
-      rewriter.create<UnwrapValidReady>(loc, stage.input(), wrapReady);
-
-  StringRef pipeStageName = "pipelineStage";
-  if (auto name = stage->getAttrOfType<StringAttr>("name"))
-    pipeStageName = name.getValue();
-
-  // Instantiate the "ESI_PipelineStage" external module.
-  circt::Backedge stageReady = back.get(rewriter.getI1Type());
-  Value operands[] = {stage.clk(), stage.rstn(), unwrap.rawOutput(),
-                      unwrap.valid(), stageReady};
-  Type resultTypes[] = {rewriter.getI1Type(), unwrap.rawOutput().getType(),
-                        rewriter.getI1Type()};
-  auto stageInst = rewriter.create<InstanceOp>(
-      loc, resultTypes, pipeStageName, stageModule.getName(), operands,
-      stageParams.getDictionary(rewriter.getContext()));
-  auto stageInstResults = stageInst.getResults();
+  if (credits) {
+    stageParams.set(builder.creditsId, rewriter.getUI32IntegerAttr(credits));
+    replaceWithPrimitive(stage, stage.clk(), stage.rstn(), stage.input(),
+                         builder.declareCreditLink(), "creditLink",
+                         stageParams, rewriter);
+    return success();
+  }
+
+  auto stageModule = builder.declareStage();
+  replaceWithPrimitive(stage, stage.clk(), stage.rstn(), stage.input(),
+                       stageModule, "pipelineStage", stageParams, rewriter);
+  return success();
+}
 
-  // Set a_ready (from the unwrap) back edge correctly to its output from stage.
-  wrapReady.setValue(stageInstResults[0]);
+namespace {
+/// Lower ChannelFIFO ops to an instance of the FIFO primitive, the same way
+/// pipeline stages are.
+struct ChannelFIFOLowering : public OpConversionPattern<ChannelFIFO> {
+public:
+  ChannelFIFOLowering(ESIRTLBuilder &builder, MLIRContext *ctxt)
+      : OpConversionPattern(ctxt), builder(builder) {}
+  using OpConversionPattern::OpConversionPattern;
 
-  Value x = stageInstResults[1];
-  Value xValid = stageInstResults[2];
+  LogicalResult
+  matchAndRewrite(ChannelFIFO fifo, ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const final {
+    auto chPort = fifo.input().getType().dyn_cast<ChannelPort>();
+    if (!chPort)
+      return failure();
+    auto fifoModule = builder.declareFIFO();
+
+    NamedAttrList fifoParams;
+    size_t width = getNumBits(chPort.getInner());
+    fifoParams.set(builder.width, rewriter.getUI32IntegerAttr(width));
+    fifoParams.set(builder.depth, rewriter.getUI32IntegerAttr(fifo.depth()));
+
+    replaceWithPrimitive(fifo, fifo.clk(), fifo.rstn(), fifo.input(),
+                         fifoModule, "fifo", fifoParams, rewriter);
+    return success();
+  }
 
-  // Wrap up the output of the RTL stage module.
-  auto wrap = rewriter.create<WrapValidReady>(loc, chPort, rewriter.getI1Type(),
-                                              x, xValid);
-  // Set the stages x_ready backedge correctly.
-  stageReady.setValue(wrap.ready());
+private:
+  ESIRTLBuilder &builder;
+};
+} // anonymous namespace
 
-  rewriter.replaceOp(stage, wrap.chanOutput());
+/// Lower a gearbox op to an instance of 'primitive', parameterized on both
+/// channel widths.
+static LogicalResult lowerGearbox(Operation *op, Value clk, Value rstn,
+                                  Value input, RTLExternModuleOp primitive,
+                                  StringRef defaultName, ESIRTLBuilder &builder,
+                                  ConversionPatternRewriter &rewriter) {
+  auto inPort = input.getType().dyn_cast<ChannelPort>();
+  auto outPort = op->getResult(0).getType().dyn_cast<ChannelPort>();
+  if (!inPort || !outPort)
+    return failure();
+
+  NamedAttrList params;
+  params.set(builder.inWidth,
+             rewriter.getUI32IntegerAttr(getNumBits(inPort.getInner())));
+  params.set(builder.outWidth,
+             rewriter.getUI32IntegerAttr(getNumBits(outPort.getInner())));
+  replaceWithPrimitive(op, clk, rstn, input, primitive, defaultName, params,
+                       rewriter);
   return success();
 }
+
+namespace {
+/// Lower ChannelPack ops to an instance of the pack primitive.
+struct ChannelPackLowering : public OpConversionPattern<ChannelPack> {
+public:
+  ChannelPackLowering(ESIRTLBuilder &builder, MLIRContext *ctxt)
+      : OpConversionPattern(ctxt), builder(builder) {}
+  using OpConversionPattern::OpConversionPattern;
+
+  LogicalResult
+  matchAndRewrite(ChannelPack pack, ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const final {
+    return lowerGearbox(pack, pack.clk(), pack.rstn(), pack.input(),
+                        builder.declarePack(), "pack", builder, rewriter);
+  }
+
+private:
+  ESIRTLBuilder &builder;
+};
+
+/// Lower ChannelUnpack ops to an instance of the unpack primitive.
+struct ChannelUnpackLowering : public OpConversionPattern<ChannelUnpack> {
+public:
+  ChannelUnpackLowering(ESIRTLBuilder &builder, MLIRContext *ctxt)
+      : OpConversionPattern(ctxt), builder(builder) {}
+  using OpConversionPattern::OpConversionPattern;
+
+  LogicalResult
+  matchAndRewrite(ChannelUnpack unpack, ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const final {
+    return lowerGearbox(unpack, unpack.clk(), unpack.rstn(), unpack.input(),
+                        builder.declareUnpack(), "unpack", builder, rewriter);
+  }
+
+private:
+  ESIRTLBuilder &builder;
+};
+} // anonymous namespace
+
 namespace {
 /// Eliminate back-to-back wrap-unwraps to reduce the number of ESI channels.
 struct RemoveWrapUnwrap : public OpConversionPattern<WrapValidReady> {
@@ -728,8 +1143,9 @@ namespace {
 /// gasket op.
 struct CosimLowering : public OpConversionPattern<CosimEndpoint> {
 public:
-  CosimLowering(ESIRTLBuilder &b)
-      : OpConversionPattern(b.getContext(), 1), builder(b) {}
+  CosimLowering(ESIRTLBuilder &b, unsigned maxMsgsPerPoll)
+      : OpConversionPattern(b.getContext(), 1), builder(b),
+        maxMsgsPerPoll(maxMsgsPerPoll) {}
 
   using OpConversionPattern::OpConversionPattern;
 
@@ -739,6 +1155,9 @@ public:
 
 private:
   ESIRTLBuilder &builder;
+  /// If more than one, the endpoint drains up to this many messages per DPI
+  /// call.
+  unsigned maxMsgsPerPoll;
 };
 } // anonymous namespace
 
@@ -747,6 +1166,7 @@ CosimLowering::matchAndRewrite(CosimEndpoint ep, ArrayRef<Value> operands,
                                ConversionPatternRewriter &rewriter) const {
 #ifndef CAPNP
   (void)builder;
+  (void)maxMsgsPerPoll;
   return rewriter.notifyMatchFailure(
       ep, "Cosim lowering requires the ESI capnp plugin, which was disabled.");
 #else
@@ -770,6 +1190,10 @@ CosimLowering::matchAndRewrite(CosimEndpoint ep, ArrayRef<Value> operands,
              IntegerAttr::get(ui64Type, recvTypeSchema.capnpTypeID()));
   params.set("RECVTYPE_SIZE_BITS",
              rewriter.getI64IntegerAttr(recvTypeSchema.size()));
+  // Leave the parameter at its default unless draining was requested so the
+  // module stays compatible with older Cosim_Endpoint sources.
+  if (maxMsgsPerPoll > 1)
+    params.set("MAX_MSGS_PER_POLL", rewriter.getI32IntegerAttr(maxMsgsPerPoll));
 
   // Set up the egest route to drive the EP's send ports.
   ArrayType egestBitArrayType =
@@ -805,8 +1229,9 @@ CosimLowering::matchAndRewrite(CosimEndpoint ep, ArrayRef<Value> operands,
   // Set up the injest path.
   Value recvDataFromCosim = cosimEpModule.getResult(1);
   Value recvValidFromCosim = cosimEpModule.getResult(0);
-  auto decodeData =
-      rewriter.create<CapnpDecode>(loc, ep.recv().getType(), recvDataFromCosim);
+  auto decodeData = rewriter.create<CapnpDecode>(
+      loc, ep.recv().getType().cast<ChannelPort>().getInner(),
+      recvDataFromCosim);
   WrapValidReady wrapRecv = rewriter.create<WrapValidReady>(
       loc, decodeData.decodedData(), recvValidFromCosim);
   recvReady.setValue(wrapRecv.ready());
@@ -830,15 +1255,19 @@ void ESItoRTLPass::runOnOperation() {
   pass1Target.addLegalOp<CapnpDecode, CapnpEncode>();
 
   pass1Target.addIllegalOp<WrapSVInterface, UnwrapSVInterface>();
-  pass1Target.addIllegalOp<PipelineStage>();
+  pass1Target.addIllegalOp<PipelineStage, ChannelFIFO>();
+  pass1Target.addIllegalOp<ChannelPack, ChannelUnpack>();
 
   // Add all the conversion patterns.
   ESIRTLBuilder esiBuilder(top);
   OwningRewritePatternList patterns;
-  patterns.insert<PipelineStageLowering>(esiBuilder, ctxt);
+  patterns.insert<PipelineStageLowering>(esiBuilder, ctxt, credits);
+  patterns.insert<ChannelFIFOLowering>(esiBuilder, ctxt);
+  patterns.insert<ChannelPackLowering>(esiBuilder, ctxt);
+  patterns.insert<ChannelUnpackLowering>(esiBuilder, ctxt);
   patterns.insert<WrapInterfaceLower>(ctxt);
   patterns.insert<UnwrapInterfaceLower>(ctxt);
-  patterns.insert<CosimLowering>(esiBuilder);
+  patterns.insert<CosimLowering>(esiBuilder, cosimMaxMsgsPerPoll);
 
   // Run the conversion.
   if (failed(applyPartialConversion(top, pass1Target, std::move(patterns))))
@@ -846,7 +1275,7 @@ void ESItoRTLPass::runOnOperation() {
 
   ConversionTarget pass2Target(*ctxt);
   pass2Target.addLegalDialect<RTLDialect>();
-  pass2Target.addIllegalOp<PipelineStage>();
+  pass2Target.addIllegalOp<PipelineStage, ChannelFIFO>();
 
   patterns.clear();
   patterns.insert<RemoveWrapUnwrap>(ctxt);
@@ -854,17 +1283,159 @@ void ESItoRTLPass::runOnOperation() {
     signalPassFailure();
 }
 
+//===----------------------------------------------------------------------===//
+// Lower Capnp encode/decode to RTL conversions and pass.
+//===----------------------------------------------------------------------===//
+
+#ifdef CAPNP
+/// Build the index constant to address element 'i' of an array of size 'size'.
+static Value getArrayIndex(OpBuilder &b, Location loc, size_t i, size_t size) {
+  unsigned indexWidth = std::max(1u, llvm::Log2_64_Ceil(size));
+  return b.create<rtl::ConstantOp>(loc, APInt(indexWidth, i));
+}
+
+/// Capnp encoding is only a bit permutation if the type has a fixed layout,
+/// which is currently only true of signless integers. Signed and unsigned
+/// integers would need a cast, which isn't available in RTL.
+static bool isFixedLayout(Type type, const capnp::TypeSchema &schema) {
+  return type.isSignlessInteger() && schema.isSupported();
+}
+
+namespace {
+/// Lower `CapnpEncode` to RTL. The message is a constant segment table and root
+/// pointer followed by the zero-extended value at the field offset, so the
+/// encoding is purely combinational wiring.
+struct CapnpEncodeLowering : public OpConversionPattern<CapnpEncode> {
+public:
+  using OpConversionPattern::OpConversionPattern;
+
+  LogicalResult
+  matchAndRewrite(CapnpEncode enc, ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const final {
+    auto loc = enc.getLoc();
+    Value data = operands[0];
+    capnp::TypeSchema schema(data.getType());
+    if (!isFixedLayout(data.getType(), schema))
+      return rewriter.notifyMatchFailure(
+          enc, "only signless integers can be encoded in hardware");
+    auto arrayType = enc.capnpBits().getType().cast<ArrayType>();
+    size_t msgSize = arrayType.getSize();
+    if (msgSize != schema.size())
+      return enc.emitOpError("capnp message for ")
+             << data.getType() << " is " << schema.size() << " bits, not "
+             << msgSize;
+
+    // Assemble the message as one wide integer: the headers below the field
+    // and zeros above it.
+    size_t dataWidth = data.getType().getIntOrFloatBitWidth();
+    size_t offset = schema.fieldOffset();
+    APInt header(offset, 0);
+    header.insertBits(APInt(64, schema.segmentTableWord()), 0);
+    header.insertBits(APInt(64, schema.rootPointerWord()), 64);
+    SmallVector<Value, 3> msgParts;
+    if (msgSize > offset + dataWidth)
+      msgParts.push_back(rewriter.create<rtl::ConstantOp>(
+          loc, APInt(msgSize - offset - dataWidth, 0)));
+    msgParts.push_back(data);
+    msgParts.push_back(rewriter.create<rtl::ConstantOp>(loc, header));
+    Value msg = rewriter.create<ConcatOp>(loc, msgParts);
+
+    // Now drive each array element with its message bit.
+    auto wire = rewriter.create<rtl::WireOp>(loc, arrayType);
+    Type i1 = rewriter.getI1Type();
+    for (size_t i = 0; i < msgSize; ++i) {
+      auto elem = rewriter.create<ArrayIndexOp>(
+          loc, wire, getArrayIndex(rewriter, loc, i, msgSize));
+      auto bit = rewriter.create<ExtractOp>(loc, i1, msg, i);
+      rewriter.create<rtl::ConnectOp>(loc, elem, bit);
+    }
+    rewriter.replaceOpWithNewOp<ReadInOutOp>(enc, wire);
+    return success();
+  }
+};
+
+/// Lower `CapnpDecode` to RTL by picking the value bits out of the message.
+/// This trusts the sender to use the same schema, so the headers are ignored.
+struct CapnpDecodeLowering : public OpConversionPattern<CapnpDecode> {
+public:
+  using OpConversionPattern::OpConversionPattern;
+
+  LogicalResult
+  matchAndRewrite(CapnpDecode dec, ArrayRef<Value> operands,
+                  ConversionPatternRewriter &rewriter) const final {
+    auto loc = dec.getLoc();
+    Type type = dec.decodedData().getType();
+    capnp::TypeSchema schema(type);
+    if (!isFixedLayout(type, schema))
+      return rewriter.notifyMatchFailure(
+          dec, "only signless integers can be decoded in hardware");
+    auto arrayType = operands[0].getType().cast<ArrayType>();
+    size_t msgSize = arrayType.getSize();
+    if (msgSize != schema.size())
+      return dec.emitOpError("capnp message for ")
+             << type << " is " << schema.size() << " bits, not " << msgSize;
+
+    auto wire = rewriter.create<rtl::WireOp>(loc, arrayType);
+    rewriter.create<rtl::ConnectOp>(loc, wire, operands[0]);
+
+    // Concat takes the most significant bit first.
+    size_t offset = schema.fieldOffset();
+    SmallVector<Value, 64> bits;
+    for (size_t i = offset + type.getIntOrFloatBitWidth(); i > offset; --i) {
+      auto elem = rewriter.create<ArrayIndexOp>(
+          loc, wire, getArrayIndex(rewriter, loc, i - 1, msgSize));
+      bits.push_back(rewriter.create<ReadInOutOp>(loc, elem));
+    }
+    rewriter.replaceOpWithNewOp<ConcatOp>(dec, bits);
+    return success();
+  }
+};
+} // anonymous namespace
+#endif // CAPNP
+
+namespace {
+struct ESICapnpToRTLPass : public LowerESICapnpToRTLBase<ESICapnpToRTLPass> {
+  void runOnOperation() override;
+};
+} // anonymous namespace
+
+void ESICapnpToRTLPass::runOnOperation() {
+  auto top = getOperation();
+#ifndef CAPNP
+  top.emitError("Capnp lowering requires the ESI capnp plugin, which was "
+                "disabled.");
+  signalPassFailure();
+#else
+  auto ctxt = &getContext();
+  ConversionTarget target(*ctxt);
+  target.addLegalDialect<RTLDialect>();
+  target.addIllegalOp<CapnpEncode, CapnpDecode>();
+
+  OwningRewritePatternList patterns;
+  patterns.insert<CapnpEncodeLowering>(ctxt);
+  patterns.insert<CapnpDecodeLowering>(ctxt);
+  if (failed(applyPartialConversion(top, target, std::move(patterns))))
+    signalPassFailure();
+#endif // CAPNP
+}
+
 namespace circt {
 namespace esi {
 std::unique_ptr<OperationPass<ModuleOp>> createESIPhysicalLoweringPass() {
   return std::make_unique<ESIToPhysicalPass>();
 }
+std::unique_ptr<OperationPass<ModuleOp>> createESIBufferInsertionPass() {
+  return std::make_unique<ESIBufferInsertionPass>();
+}
 std::unique_ptr<OperationPass<ModuleOp>> createESIPortLoweringPass() {
   return std::make_unique<ESIPortsPass>();
 }
 std::unique_ptr<OperationPass<ModuleOp>> createESItoRTLPass() {
   return std::make_unique<ESItoRTLPass>();
 }
+std::unique_ptr<OperationPass<ModuleOp>> createESICapnpToRTLPass() {
+  return std::make_unique<ESICapnpToRTLPass>();
+}
 
 } // namespace esi
 } // namespace circt
@@ -52,6 +52,19 @@ public:
   /// Size in bits of the capnp message.
   size_t size() const;
 
+  /// Bit offset of the encoded value within the capnp message.
+  size_t fieldOffset() const;
+
+  /// Number of bits capnp uses to store the value. This is the type width
+  /// rounded up to the next capnp integer type.
+  size_t fieldWidth() const;
+
+  /// The single-segment segment table which begins every message.
+  uint64_t segmentTableWord() const;
+
+  /// The root struct pointer, which follows the segment table.
+  uint64_t rootPointerWord() const;
+
   /// Get the capnp struct name.
   llvm::StringRef name() const;
 
@@ -63,7 +76,8 @@ public:
 
 private:
   /// The implementation of this. Separate to hide the details and avoid having
-  /// to include the capnp headers in this header.
+  /// to include the capnp headers in this header. Shared by all the
+  /// `TypeSchema`s of the same type so the schema only gets parsed once.
   std::shared_ptr<detail::TypeSchemaImpl> s;
 };
 
@@ -14,10 +14,16 @@
 
 #include "capnp/schema-parser.h"
 #include "mlir/IR/BuiltinTypes.h"
-#include "llvm/ADT/TypeSwitch.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/Support/Format.h"
+#include "llvm/Support/MathExtras.h"
 
+#include <algorithm>
+#include <mutex>
 #include <string>
+#include <vector>
 
 using namespace mlir;
 using namespace circt::esi::capnp::detail;
@@ -65,89 +71,162 @@ namespace esi {
 namespace capnp {
 namespace detail {
 /// Actual implementation of `TypeSchema` to keep all the details out of the
-/// header.
+/// header. There is one of these per type, owned by the `SchemaCache`. Since
+/// the cache outlives any particular MLIRContext, this only holds on to what
+/// it needs from the type rather than the type itself.
 struct TypeSchemaImpl {
 public:
-  TypeSchemaImpl(Type type) : type(type) {}
+  TypeSchemaImpl(Type type);
 
   /// Get the Cap'nProto schema ID for a type.
-  uint64_t capnpTypeID() const;
+  uint64_t capnpTypeID() const { return id; }
 
   bool isSupported() const;
   size_t size() const;
-  StringRef name() const;
+  size_t fieldOffset() const;
+  size_t fieldWidth() const;
+  uint64_t segmentTableWord() const;
+  uint64_t rootPointerWord() const;
+  StringRef name() const { return typeName; }
   mlir::LogicalResult write(llvm::raw_ostream &os) const;
   mlir::LogicalResult writeMetadata(llvm::raw_ostream &os) const;
 
   bool operator==(const TypeSchemaImpl &) const;
 
 private:
-  ::capnp::ParsedSchema getSchema() const;
+  friend class SchemaCache;
+
+  uint64_t computeTypeID() const;
+  std::string computeName() const;
   ::capnp::StructSchema getTypeSchema() const;
 
-  Type type;
+  /// The type as it is printed, which identifies it across contexts.
+  std::string typeStr;
+  llvm::Optional<IntegerType::SignednessSemantics> intSignedness;
+  unsigned intWidth = 0;
+  uint64_t id;
+  std::string typeName;
+  /// Set by the `SchemaCache` once the schema has been parsed.
+  ::capnp::StructSchema typeSchema;
+};
+
+/// Process-wide cache of type schemas. Writing the schema text and running the
+/// capnp parser on it is expensive, so every type gets exactly one
+/// `TypeSchemaImpl` and all the types which haven't been parsed yet are
+/// written into a single schema file and parsed together the first time any
+/// of them needs its `StructSchema`.
+class SchemaCache {
+public:
+  static SchemaCache &get() {
+    static SchemaCache cache;
+    return cache;
+  }
+
+  std::shared_ptr<TypeSchemaImpl> getImpl(Type type);
+  ::capnp::StructSchema getTypeSchema(TypeSchemaImpl *);
+
+private:
+  SchemaCache() : dir(kj::newInMemoryDirectory(kj::nullClock())) {}
+  void parsePending();
+
+  std::mutex mutex;
+  llvm::StringMap<std::shared_ptr<TypeSchemaImpl>> impls;
+  /// Types which have been requested but not yet parsed, in request order.
+  std::vector<TypeSchemaImpl *> pending;
+  /// The parser refers back to the files it parsed, so keep them alive for
+  /// as long as it is.
+  kj::Own<kj::Directory> dir;
   ::capnp::SchemaParser parser;
-  mutable llvm::Optional<uint64_t> cachedID;
-  mutable std::string cachedName;
-  mutable ::capnp::ParsedSchema rootSchema;
-  mutable ::capnp::StructSchema typeSchema;
+  size_t numFiles = 0;
 };
 } // namespace detail
 } // namespace capnp
 } // namespace esi
 } // namespace circt
 
-/// Write a valid capnp schema to memory, then parse it out of memory using the
-/// capnp library. Writing and parsing text within a single process is ugly, but
-/// this is by far the easiest way to do this. This isn't the use case for which
-/// Cap'nProto was designed.
-::capnp::ParsedSchema TypeSchemaImpl::getSchema() const {
-  if (rootSchema != ::capnp::ParsedSchema())
-    return rootSchema;
+std::shared_ptr<TypeSchemaImpl> SchemaCache::getImpl(Type type) {
+  std::string typeStr;
+  llvm::raw_string_ostream(typeStr) << type;
 
-  // Write the schema to `schemaText`.
+  std::lock_guard<std::mutex> lock(mutex);
+  auto &impl = impls[typeStr];
+  if (!impl) {
+    impl = std::make_shared<TypeSchemaImpl>(type);
+    if (impl->isSupported())
+      pending.push_back(impl.get());
+  }
+  return impl;
+}
+
+::capnp::StructSchema SchemaCache::getTypeSchema(TypeSchemaImpl *impl) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (impl->typeSchema == ::capnp::StructSchema())
+    parsePending();
+  assert(impl->typeSchema != ::capnp::StructSchema() &&
+         "A node with a matching ID should always be found.");
+  return impl->typeSchema;
+}
+
+/// Write a valid capnp schema for all the pending types to memory, then parse
+/// it out of memory using the capnp library. Writing and parsing text within a
+/// single process is ugly, but this is by far the easiest way to do this. This
+/// isn't the use case for which Cap'nProto was designed.
+void SchemaCache::parsePending() {
+  if (pending.empty())
+    return;
+
+  // Write the schema to `schemaText`. Each file needs its own ID.
   std::string schemaText;
   llvm::raw_string_ostream os(schemaText);
-  emitId(os, 0xFFFFFFFFFFFFFFFF) << ";\n";
-  auto rc = write(os);
-  assert(succeeded(rc) && "Failed schema text output.");
+  emitId(os, 0xFFFFFFFFFFFFFFFF - numFiles) << ";\n";
+  for (auto *impl : pending) {
+    auto rc = impl->write(os);
+    assert(succeeded(rc) && "Failed schema text output.");
+    (void)rc;
+  }
   os.str();
 
-  // Write `schemaText` to an in-memory filesystem then parse it. Yes, this is
+  // Write `schemaText` to the in-memory filesystem then parse it. Yes, this is
   // the only way to do this.
-  kj::Own<kj::Filesystem> fs = kj::newDiskFilesystem();
-  kj::Own<kj::Directory> dir = kj::newInMemoryDirectory(kj::nullClock());
-  kj::Path fakePath = kj::Path::parse("schema.capnp");
+  std::string fileName = "schema" + std::to_string(numFiles++) + ".capnp";
+  kj::Path fakePath = kj::Path::parse(fileName.c_str());
   { // Ensure that 'fakeFile' has flushed.
     auto fakeFile = dir->openFile(fakePath, kj::WriteMode::CREATE);
     fakeFile->writeAll(schemaText);
   }
-  rootSchema = parser.parseFromDirectory(*dir, std::move(fakePath), nullptr);
-  return rootSchema;
+  ::capnp::ParsedSchema rootSchema =
+      parser.parseFromDirectory(*dir, std::move(fakePath), nullptr);
+
+  llvm::DenseMap<uint64_t, TypeSchemaImpl *> byID;
+  for (auto *impl : pending)
+    byID[impl->capnpTypeID()] = impl;
+  for (auto schemaNode : rootSchema.getAllNested()) {
+    auto it = byID.find(schemaNode.getProto().getId());
+    if (it != byID.end())
+      it->second->typeSchema = schemaNode.asStruct();
+  }
+  pending.clear();
 }
 
-/// Find the schema corresponding to `type` and return it.
-::capnp::StructSchema TypeSchemaImpl::getTypeSchema() const {
-  if (typeSchema != ::capnp::StructSchema())
-    return typeSchema;
-  uint64_t id = capnpTypeID();
-  for (auto schemaNode : getSchema().getAllNested()) {
-    if (schemaNode.getProto().getId() == id) {
-      typeSchema = schemaNode.asStruct();
-      return typeSchema;
-    }
+TypeSchemaImpl::TypeSchemaImpl(Type type) {
+  llvm::raw_string_ostream(typeStr) << type;
+  if (auto intTy = type.dyn_cast<IntegerType>()) {
+    intSignedness = intTy.getSignedness();
+    intWidth = intTy.getWidth();
   }
-  assert(false && "A node with a matching ID should always be found.");
+  id = isSupported() ? computeTypeID() : 0;
+  typeName = computeName();
+}
+
+::capnp::StructSchema TypeSchemaImpl::getTypeSchema() const {
+  return SchemaCache::get().getTypeSchema(const_cast<TypeSchemaImpl *>(this));
 }
 
 // We compute a deterministic hash based on the type. Since llvm::hash_value
 // changes from execution to execution, we don't use it. This assumes a closed
 // type system, which is reasonable since we only support some types in the
 // Capnp schema generation anyway.
-uint64_t TypeSchemaImpl::capnpTypeID() const {
-  if (cachedID)
-    return *cachedID;
-
+uint64_t TypeSchemaImpl::computeTypeID() const {
   // We can hash up to 64 bytes with a single function call.
   char buffer[64];
   memset(buffer, 0, sizeof(buffer));
@@ -155,28 +234,22 @@ uint64_t TypeSchemaImpl::capnpTypeID() const {
   // The first byte is for the outer type.
   buffer[0] = 1; // Constant for the ChannelPort type.
 
-  TypeSwitch<Type>(type)
-      .Case([&buffer](IntegerType t) {
-        // The second byte is for the inner type.
-        buffer[1] = 1;
-        // The rest can be defined arbitrarily.
-        buffer[2] = (char)t.getSignedness();
-        *(int64_t *)&buffer[4] = t.getWidth();
-      })
-      .Default([](Type) { assert(false && "Type not yet supported"); });
+  assert(intSignedness && "Type not yet supported");
+  // The second byte is for the inner type.
+  buffer[1] = 1;
+  // The rest can be defined arbitrarily.
+  buffer[2] = (char)*intSignedness;
+  *(int64_t *)&buffer[4] = intWidth;
 
   uint64_t hash =
       llvm::hashing::detail::hash_short(buffer, 12, esiCosimSchemaVersion);
   // Capnp IDs always have a '1' high bit.
-  cachedID = hash | 0x8000000000000000;
-  return *cachedID;
+  return hash | 0x8000000000000000;
 }
 
 /// Returns true if the type is currently supported.
 bool TypeSchemaImpl::isSupported() const {
-  return llvm::TypeSwitch<::mlir::Type, bool>(type)
-      .Case<IntegerType>([](IntegerType t) { return t.getWidth() <= 64; })
-      .Default([](Type) { return false; });
+  return intSignedness && intWidth <= 64;
 }
 
 // Compute the expected size of the capnp message in bits.
@@ -188,15 +261,43 @@ size_t TypeSchemaImpl::size() const {
           structProto.getDataWordCount() + structProto.getPointerCount());
 }
 
+/// The value is always in a single field, which the schema places somewhere in
+/// the data section. The data section follows the two header words.
+size_t TypeSchemaImpl::fieldOffset() const {
+  auto field = getTypeSchema().getFields()[0];
+  return 64 * 2 + field.getProto().getSlot().getOffset() * fieldWidth();
+}
+
+/// Capnp slot offsets are in units of the field size, so this has to match
+/// the rounding `write()` does.
+size_t TypeSchemaImpl::fieldWidth() const {
+  if (intWidth == 1)
+    return 1;
+  return std::max<size_t>(8, llvm::PowerOf2Ceil(intWidth));
+}
+
+/// We only ever send single segment messages, so the segment count minus one
+/// (low 32 bits) is zero and the segment size in words (high 32 bits) is the
+/// struct plus its root pointer.
+uint64_t TypeSchemaImpl::segmentTableWord() const {
+  auto structProto = getTypeSchema().getProto().getStruct();
+  uint64_t segmentWords =
+      1 + structProto.getDataWordCount() + structProto.getPointerCount();
+  return segmentWords << 32;
+}
+
+/// A struct pointer with a zero offset, since the data section immediately
+/// follows it, and the section sizes in the upper 32 bits.
+uint64_t TypeSchemaImpl::rootPointerWord() const {
+  auto structProto = getTypeSchema().getProto().getStruct();
+  return ((uint64_t)structProto.getDataWordCount() << 32) |
+         ((uint64_t)structProto.getPointerCount() << 48);
+}
+
 /// For now, the name is just the type serialized. This works only because we
 /// only support ints.
-StringRef TypeSchemaImpl::name() const {
-  if (cachedName == "") {
-    llvm::raw_string_ostream os(cachedName);
-    os << "TY" << type;
-    cachedName = os.str();
-  }
-  return cachedName;
+std::string TypeSchemaImpl::computeName() const {
+  return "TY" + typeStr;
 }
 
 /// This function is essentially a placeholder which only supports ints. It'll
@@ -211,19 +312,18 @@ mlir::LogicalResult TypeSchemaImpl::write(llvm::raw_ostream &rawOS) const {
   os << " {\n";
   os.addIndent();
 
-  auto intTy = type.dyn_cast<IntegerType>();
-  assert(intTy &&
+  assert(intSignedness &&
          "Type not supported. Please check support first with isSupported()");
 
   // Specify the actual type, followed by the capnp field.
-  os.indent() << "# Actual type is " << type << ".\n";
+  os.indent() << "# Actual type is " << typeStr << ".\n";
   os.indent() << "i @0 :";
 
-  auto w = intTy.getWidth();
+  auto w = intWidth;
   if (w == 1) {
     os.indent() << "Bool";
   } else {
-    if (intTy.isSigned())
+    if (*intSignedness == IntegerType::Signed)
       os << "Int";
     else
       os << "UInt";
@@ -255,7 +355,7 @@ mlir::LogicalResult TypeSchemaImpl::writeMetadata(llvm::raw_ostream &os) const {
 }
 
 bool TypeSchemaImpl::operator==(const TypeSchemaImpl &that) const {
-  return type == that.type;
+  return typeStr == that.typeStr;
 }
 
 //===----------------------------------------------------------------------===//
@@ -266,7 +366,7 @@ circt::esi::capnp::TypeSchema::TypeSchema(Type type) {
   circt::esi::ChannelPort chan = type.dyn_cast<circt::esi::ChannelPort>();
   if (chan) // Unwrap the channel if it's a channel.
     type = chan.getInner();
-  s = std::make_shared<detail::TypeSchemaImpl>(type);
+  s = detail::SchemaCache::get().getImpl(type);
 }
 uint64_t circt::esi::capnp::TypeSchema::capnpTypeID() const {
   return s->capnpTypeID();
@@ -275,6 +375,18 @@ bool circt::esi::capnp::TypeSchema::isSupported() const {
   return s->isSupported();
 }
 size_t circt::esi::capnp::TypeSchema::size() const { return s->size(); }
+size_t circt::esi::capnp::TypeSchema::fieldOffset() const {
+  return s->fieldOffset();
+}
+size_t circt::esi::capnp::TypeSchema::fieldWidth() const {
+  return s->fieldWidth();
+}
+uint64_t circt::esi::capnp::TypeSchema::segmentTableWord() const {
+  return s->segmentTableWord();
+}
+uint64_t circt::esi::capnp::TypeSchema::rootPointerWord() const {
+  return s->rootPointerWord();
+}
 StringRef circt::esi::capnp::TypeSchema::name() const { return s->name(); }
 mlir::LogicalResult
 circt::esi::capnp::TypeSchema::write(llvm::raw_ostream &os) const {
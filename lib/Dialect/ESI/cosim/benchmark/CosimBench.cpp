@@ -0,0 +1,266 @@
+//===- CosimBench.cpp - Cosim throughput and latency benchmark --*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Measures the cosim transport without an RTL simulator. A synthetic simulator
+// thread polls the DPI entry points exactly like the SystemVerilog endpoint
+// does and echoes every message it gets back to the client. The client side
+// talks to the RPC server through the Cap'nProto API and reports messages per
+// second and the p50/p99 round trip latency for a range of message sizes and
+// endpoint counts.
+//
+// Usage: esi-cosim-bench [messages-per-endpoint]
+//
+// The server listens on COSIM_PORT (if set) and uses COSIM_SHM (if set), same
+// as in a real simulation.
+//
+//===----------------------------------------------------------------------===//
+
+#include "circt/Dialect/ESI/cosim/CosimDpi.capnp.h"
+#include "circt/Dialect/ESI/cosim/dpi.h"
+
+#include <capnp/ez-rpc.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+// ---- Synthetic simulator ----
+
+/// The open array handles the benchmark passes to the DPI entry points. Real
+/// simulators have their own representation; the DPI server only ever accesses
+/// it through the svdpi functions below.
+namespace {
+struct BenchArray {
+  uint8_t *data;
+  int size;
+};
+} // namespace
+
+// The svdpi functions used by the DPI server. These override the ones in the
+// MtiPli stub library, which only assert.
+int svDimensions(const svOpenArrayHandle) { return 1; }
+void *svGetArrayPtr(const svOpenArrayHandle h) {
+  return static_cast<const BenchArray *>(h)->data;
+}
+int svSizeOfArray(const svOpenArrayHandle h) {
+  return static_cast<const BenchArray *>(h)->size;
+}
+int svSize(const svOpenArrayHandle h, int) {
+  return static_cast<const BenchArray *>(h)->size;
+}
+void *svGetArrElemPtr1(const svOpenArrayHandle h, int idx) {
+  auto *arr = static_cast<const BenchArray *>(h);
+  return arr->data + idx;
+}
+
+namespace {
+/// One echoing endpoint in the synthetic simulator.
+struct SimEndpoint {
+  unsigned id;
+  std::vector<uint8_t> buffer;
+  BenchArray array;
+};
+
+/// Polls all the endpoints, the same way the RTL does every cycle, and echoes
+/// every message back to the client.
+class SimLoop {
+public:
+  void addEndpoint(unsigned id, int msgSize) {
+    SimEndpoint ep{id, std::vector<uint8_t>(msgSize), {}};
+    ep.array = {nullptr, msgSize};
+    endpoints.push_back(std::move(ep));
+  }
+
+  void start() {
+    for (auto &ep : endpoints)
+      ep.array.data = ep.buffer.data();
+    thread = std::thread(&SimLoop::loop, this);
+  }
+
+  void stop() {
+    stopped = true;
+    thread.join();
+  }
+
+private:
+  void loop() {
+    while (!stopped) {
+      for (auto &ep : endpoints) {
+        unsigned int size = ~0u;
+        if (sv2cCosimserverEpTryGet(ep.id, &ep.array, &size) != 0 || size == 0)
+          continue;
+        // Retry until there's room in the queue to the client, like the RTL
+        // does with its backpressure.
+        while (sv2cCosimserverEpTryPut(ep.id, &ep.array, size) == -5 &&
+               !stopped)
+          ;
+      }
+    }
+  }
+
+  std::vector<SimEndpoint> endpoints;
+  std::thread thread;
+  std::atomic<bool> stopped{false};
+};
+} // namespace
+
+// ---- Client ----
+
+/// Each message carries its sequence number and send time so that the latency
+/// can be computed when the echo comes back.
+struct MsgHeader {
+  uint64_t seq;
+  int64_t sentNs;
+};
+
+static int64_t nowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             Clock::now().time_since_epoch())
+      .count();
+}
+
+/// Size of a flat, single segment UntypedData message with 'payload' bytes.
+static int encodedSize(int payload) {
+  // Root pointer + struct pointer section + data rounded up to words.
+  return (2 + (payload + 7) / 8) * 8;
+}
+
+namespace {
+using Untyped = EsiDpiEndpoint<UntypedData, UntypedData>;
+
+/// Benchmark results for one configuration.
+struct Result {
+  double msgsPerSec;
+  double p50Us, p99Us;
+};
+
+/// Drive 'eps' with 'numMsgs' messages each of 'payload' bytes, keeping up to
+/// 'window' messages in flight per endpoint.
+static Result runConfig(kj::WaitScope &ws, std::vector<Untyped::Client> &eps,
+                        int payload, int numMsgs, unsigned window) {
+  std::vector<uint8_t> data(payload, 0x5a);
+  std::vector<double> latencies;
+  latencies.reserve(eps.size() * numMsgs);
+
+  auto start = Clock::now();
+  for (int sent = 0; sent < numMsgs; sent += window) {
+    unsigned batch = std::min<unsigned>(window, numMsgs - sent);
+    // Fill the window on every endpoint first so they're all busy at once.
+    for (auto &ep : eps) {
+      auto req = ep.sendBatchRequest();
+      auto msgs = req.initMsgs(batch);
+      for (unsigned i = 0; i < batch; ++i) {
+        MsgHeader hdr{(uint64_t)(sent + i), nowNs()};
+        memcpy(data.data(), &hdr, sizeof(hdr));
+        msgs[i].initMsg().setData(kj::arrayPtr(data.data(), data.size()));
+      }
+      req.send().wait(ws);
+    }
+    // Then drain the echoes.
+    for (auto &ep : eps) {
+      unsigned received = 0;
+      while (received < batch) {
+        auto req = ep.recvBatchRequest();
+        req.setMaxMsgs(batch - received);
+        req.setBlock(true);
+        req.setTimeoutMs(1000);
+        auto resps = req.send().wait(ws).getResps();
+        KJ_REQUIRE(resps.size() > 0, "Timed out waiting for echo");
+        int64_t now = nowNs();
+        for (auto env : resps) {
+          MsgHeader hdr;
+          memcpy(&hdr, env.getMsg().getData().begin(), sizeof(hdr));
+          latencies.push_back((now - hdr.sentNs) / 1000.0);
+        }
+        received += resps.size();
+      }
+    }
+  }
+  double secs = std::chrono::duration<double>(Clock::now() - start).count();
+
+  std::sort(latencies.begin(), latencies.end());
+  auto pct = [&](double p) {
+    return latencies[std::min(latencies.size() - 1,
+                              (size_t)(p * latencies.size()))];
+  };
+  return {latencies.size() / secs, pct(0.50), pct(0.99)};
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  int numMsgs = argc > 1 ? std::atoi(argv[1]) : 10000;
+  if (numMsgs <= 0) {
+    fprintf(stderr, "usage: %s [messages-per-endpoint]\n", argv[0]);
+    return 1;
+  }
+  const std::vector<int> payloads = {16, 64, 512, 4096};
+  const std::vector<unsigned> epCounts = {1, 4, 16};
+  const unsigned maxEps = epCounts.back();
+  // Stay below the endpoint queue depth so the echo never has to wait on the
+  // client.
+  const unsigned window = 32;
+
+  // Register every endpoint up front: ids are <payload index> * maxEps + n.
+  SimLoop sim;
+  for (size_t p = 0; p < payloads.size(); ++p) {
+    int size = encodedSize(payloads[p]);
+    for (unsigned e = 0; e < maxEps; ++e) {
+      unsigned id = p * maxEps + e;
+      if (sv2cCosimserverEpRegister(id, UntypedData::_capnpPrivate::typeId,
+                                    size, UntypedData::_capnpPrivate::typeId,
+                                    size) != 0) {
+        fprintf(stderr, "Could not register endpoint %u\n", id);
+        return 1;
+      }
+      sim.addEndpoint(id, size);
+    }
+  }
+  sim.start();
+
+  const char *portEnv = getenv("COSIM_PORT");
+  unsigned port = portEnv ? std::strtoul(portEnv, nullptr, 10) : 0xECD;
+  {
+    capnp::EzRpcClient client("localhost", port);
+    kj::WaitScope &ws = client.getWaitScope();
+    CosimDpiServer::Client cosim = client.getMain<CosimDpiServer>();
+    auto ifaces = cosim.listRequest().send().wait(ws).getIfaces();
+
+    printf("%8s %6s %12s %10s %10s\n", "payload", "eps", "msgs/s", "p50(us)",
+           "p99(us)");
+    for (size_t p = 0; p < payloads.size(); ++p) {
+      for (unsigned numEps : epCounts) {
+        std::vector<Untyped::Client> eps;
+        for (auto iface : ifaces) {
+          unsigned id = iface.getEndpointID();
+          if (id < p * maxEps || id >= p * maxEps + numEps)
+            continue;
+          auto req = cosim.openRequest<UntypedData, UntypedData>();
+          req.setIface(iface);
+          eps.push_back(req.send().wait(ws).getIface());
+        }
+        Result r = runConfig(ws, eps, payloads[p], numMsgs, window);
+        printf("%8d %6u %12.0f %10.1f %10.1f\n", payloads[p], numEps,
+               r.msgsPerSec, r.p50Us, r.p99Us);
+        fflush(stdout);
+        for (auto &ep : eps)
+          ep.closeRequest().send().wait(ws);
+      }
+    }
+  }
+
+  sim.stop();
+  sv2cCosimserverFinish();
+  return 0;
+}
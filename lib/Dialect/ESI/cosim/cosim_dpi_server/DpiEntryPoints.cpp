@@ -16,10 +16,12 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "circt/Dialect/ESI/cosim/MessageLog.h"
 #include "circt/Dialect/ESI/cosim/Server.h"
 #include "circt/Dialect/ESI/cosim/dpi.h"
 
 #include <algorithm>
+#include <chrono>
 #include <cstdlib>
 
 using namespace circt::esi::cosim;
@@ -27,6 +29,18 @@ using namespace circt::esi::cosim;
 static RpcServer *server = nullptr;
 static std::mutex serverMutex;
 
+/// The number of messages the simulation got from or sent to clients. Only
+/// touched by the simulation thread.
+static unsigned long long simActivity = 0;
+
+/// The current simulation time, as last reported by the simulation. Only
+/// touched by the simulation thread, as are the recorder and replayer.
+static unsigned long long simTick = 0;
+/// Records the messages the simulation exchanges, if requested.
+static std::unique_ptr<MessageRecorder> recorder;
+/// Replays recorded messages in place of the RPC server, if requested.
+static std::unique_ptr<MessageReplayer> replayer;
+
 // ---- Helper functions ----
 
 /// Get the TCP port on which to listen. Defaults to 0xECD (ESI Cosim DPI), 3789
@@ -41,6 +55,56 @@ static int findPort() {
   return std::strtoull(portEnv, nullptr, 10);
 }
 
+/// Get the number of RPC server threads. Defaults to zero, which lets the
+/// server pick one per hardware thread, up to a few.
+static unsigned findNumThreads() {
+  const char *threadsEnv = getenv("COSIM_THREADS");
+  if (threadsEnv == nullptr)
+    return 0;
+  printf("[COSIM] Using %s RPC server threads\n", threadsEnv);
+  return std::strtoul(threadsEnv, nullptr, 10);
+}
+
+/// Get the shared memory name prefix for the endpoint queues, if shared
+/// memory is requested. The prefix should start with a '/'.
+static const char *findShmPrefix() {
+  const char *shmEnv = getenv("COSIM_SHM");
+  if (shmEnv != nullptr)
+    printf("[COSIM] Sharing endpoint queues in memory objects %s-<id>\n",
+           shmEnv);
+  return shmEnv;
+}
+
+/// Open the message log to record to, if requested.
+static void openRecorder() {
+  const char *recordEnv = getenv("COSIM_RECORD");
+  if (recordEnv == nullptr)
+    return;
+  recorder = std::make_unique<MessageRecorder>();
+  if (!recorder->open(recordEnv)) {
+    fprintf(stderr, "[COSIM] Could not create message log %s\n", recordEnv);
+    recorder.reset();
+    return;
+  }
+  printf("[COSIM] Recording messages to %s\n", recordEnv);
+}
+
+/// Open the message log to replay, if requested. Return true if replaying.
+static bool openReplayer() {
+  const char *replayEnv = getenv("COSIM_REPLAY");
+  if (replayEnv == nullptr)
+    return false;
+  replayer = std::make_unique<MessageReplayer>();
+  if (!replayer->open(replayEnv)) {
+    fprintf(stderr, "[COSIM] Could not read message log %s\n", replayEnv);
+    replayer.reset();
+    return false;
+  }
+  printf("[COSIM] Replaying messages from %s, not starting the RPC server\n",
+         replayEnv);
+  return true;
+}
+
 /// Check that an array is an array of bytes and has some size.
 // NOLINTNEXTLINE(misc-misplaced-const)
 static int validateSvOpenArray(const svOpenArrayHandle data,
@@ -92,7 +156,8 @@ DPI int sv2cCosimserverEpRegister(int endpointId, long long sendTypeId,
 //   - Returns negative when call failed (e.g. EP not registered).
 //   - If no message, return 0 with dataSize == 0.
 //   - Assumes buffer is large enough to contain entire message. Fails if not
-//     large enough. (In the future, will add support for getting the message
+//     large enough, and drops the message so that the next call doesn't fail
+//     on it again. (In the future, will add support for getting the message
 //     into a fixed-size buffer over multiple calls.)
 DPI int sv2cCosimserverEpTryGet(unsigned int endpointId,
                                 // NOLINTNEXTLINE(misc-misplaced-const)
@@ -107,9 +172,10 @@ DPI int sv2cCosimserverEpTryGet(unsigned int endpointId,
     return -4;
   }
 
-  Endpoint::BlobPtr msg;
+  const uint8_t *msg;
+  size_t msgSize;
   // Poll for a message.
-  if (!ep->getMessageToSim(msg)) {
+  if (!ep->pollMessageToSim(msg, msgSize)) {
     // No message.
     *dataSize = 0;
     return 0;
@@ -133,24 +199,130 @@ DPI int sv2cCosimserverEpTryGet(unsigned int endpointId,
     return -3;
   }
   // Verify it'll fit.
-  size_t msgSize = msg->size();
   if (msgSize > *dataSize) {
     printf("ERROR: Message size too big to fit in RTL buffer\n");
+    ep->popMessageToSim();
     return -5;
   }
 
   // Copy the message data.
   size_t i;
   for (i = 0; i < msgSize; ++i) {
-    auto b = (*msg)[i];
+    auto b = msg[i];
     *(char *)svGetArrElemPtr1(data, i) = b;
   }
   // Zero out the rest of the buffer.
   for (; i < *dataSize; ++i) {
     *(char *)svGetArrElemPtr1(data, i) = 0;
   }
+  if (recorder)
+    recorder->record(simTick, endpointId, MessageDirection::ToSim, msg,
+                     msgSize);
+  // The message has been copied out, release its slot.
+  ep->popMessageToSim();
+  ++simActivity;
   // Set the output data size.
-  *dataSize = msg->size();
+  *dataSize = msgSize;
+  return 0;
+}
+
+// Attempt to recieve several messages from a client in one call.
+//   - Returns negative when call failed (e.g. EP not registered).
+//   - Packs as many whole messages as fit into 'data', back to back, and
+//     stores the size of each in 'sizes'.
+//   - 'numMsgs' is the maximum number of messages to get on input (~0 to use
+//     the size of 'sizes') and the number of messages gotten on output. If no
+//     message, return 0 with numMsgs == 0.
+//   - Fails if the next message does not fit in an empty buffer, and drops
+//     that message.
+DPI int sv2cCosimserverEpTryGetMultiple(unsigned int endpointId,
+                                        // NOLINTNEXTLINE(misc-misplaced-const)
+                                        const svOpenArrayHandle data,
+                                        // NOLINTNEXTLINE(misc-misplaced-const)
+                                        const svOpenArrayHandle sizes,
+                                        unsigned int *numMsgs) {
+  if (server == nullptr)
+    return -1;
+
+  Endpoint *ep = server->endpoints[endpointId];
+  if (!ep) {
+    fprintf(stderr, "Endpoint not found in registry!\n");
+    return -4;
+  }
+
+  const uint8_t *msg;
+  size_t msgSize;
+  // Poll for the first message before doing any validation, same as TryGet.
+  if (!ep->pollMessageToSim(msg, msgSize)) {
+    *numMsgs = 0;
+    return 0;
+  }
+
+  if (validateSvOpenArray(data, sizeof(int8_t)) != 0 ||
+      validateSvOpenArray(sizes, sizeof(int)) != 0) {
+    printf("ERROR: DPI-func=%s line=%d event=invalid-sv-array\n", __func__,
+           __LINE__);
+    return -2;
+  }
+
+  // Detect or verify the maximum number of messages.
+  unsigned int maxMsgs = svSize(sizes, 1);
+  if (*numMsgs == ~0u) {
+    *numMsgs = maxMsgs;
+  } else if (*numMsgs > maxMsgs) {
+    printf("ERROR: DPI-func=%s line %d event=invalid-count (max %u)\n",
+           __func__, __LINE__, maxMsgs);
+    return -3;
+  }
+  maxMsgs = *numMsgs;
+  size_t capacity = svSizeOfArray(data);
+  if (msgSize > capacity) {
+    printf("ERROR: Message size too big to fit in RTL buffer\n");
+    ep->popMessageToSim();
+    return -5;
+  }
+
+  size_t offset = 0;
+  unsigned int count = 0;
+  do {
+    if (offset + msgSize > capacity)
+      break;
+    for (size_t i = 0; i < msgSize; ++i)
+      *(char *)svGetArrElemPtr1(data, offset + i) = msg[i];
+    *(int *)svGetArrElemPtr1(sizes, count) = msgSize;
+    if (recorder)
+      recorder->record(simTick, endpointId, MessageDirection::ToSim, msg,
+                       msgSize);
+    ep->popMessageToSim();
+    offset += msgSize;
+    ++count;
+  } while (count < maxMsgs && ep->getMessageToSim(msg, msgSize));
+
+  *numMsgs = count;
+  simActivity += count;
+  return 0;
+}
+
+// Find the endpoints with messages from a client waiting, so that the
+// simulation crosses into the server once per cycle rather than once per
+// endpoint when the endpoints are idle.
+//   - Returns negative when call failed (e.g. server not running).
+//   - Sets bit i%32 of mask[i/32] if endpoint i has messages waiting and clears
+//     it otherwise.
+DPI int sv2cCosimserverPoll(
+    // NOLINTNEXTLINE(misc-misplaced-const)
+    const svOpenArrayHandle mask) {
+  if (server == nullptr)
+    return -1;
+
+  if (validateSvOpenArray(mask, sizeof(int)) != 0) {
+    printf("ERROR: DPI-func=%s line=%d event=invalid-sv-array\n", __func__,
+           __LINE__);
+    return -2;
+  }
+  // The validation ensures that the array has C layout.
+  server->endpoints.pollMessagesToSim(
+      static_cast<uint32_t *>(svGetArrayPtr(mask)), svSize(mask, 1));
   return 0;
 }
 
@@ -179,30 +351,105 @@ DPI int sv2cCosimserverEpTryPut(unsigned int endpointId,
     return -3;
   }
 
-  Endpoint::BlobPtr blob = std::make_shared<Endpoint::Blob>(dataSize);
-  // Copy the message data into 'blob'.
-  for (int i = 0; i < dataSize; ++i) {
-    (*blob)[i] = *(char *)svGetArrElemPtr1(data, i);
-  }
-  // Queue the blob.
   Endpoint *ep = server->endpoints[endpointId];
   if (!ep) {
     fprintf(stderr, "Endpoint not found in registry!\n");
     return -4;
   }
-  ep->pushMessageToClient(blob);
+  if ((size_t)dataSize > ep->getMaxMessageToClientSize()) {
+    printf("ERROR: DPI-func=%s line %d event=message-too-large (max %zu)\n",
+           __func__, __LINE__, ep->getMaxMessageToClientSize());
+    return -3;
+  }
+  if (replayer) {
+    // There are no clients, compare the message to the recorded one instead.
+    static std::vector<uint8_t> replayBuffer;
+    replayBuffer.resize(dataSize);
+    for (int i = 0; i < dataSize; ++i)
+      replayBuffer[i] = *(char *)svGetArrElemPtr1(data, i);
+    replayer->checkMessageToClient(simTick, endpointId, replayBuffer.data(),
+                                   dataSize);
+    if (recorder)
+      recorder->record(simTick, endpointId, MessageDirection::ToClient,
+                       replayBuffer.data(), dataSize);
+    ++simActivity;
+    return 0;
+  }
+  uint8_t *msg = ep->reserveMessageToClient();
+  if (!msg) {
+    printf("ERROR: DPI-func=%s line %d event=queue-full\n", __func__,
+           __LINE__);
+    return -5;
+  }
+  // Copy the message data directly into its queue slot and publish it.
+  for (int i = 0; i < dataSize; ++i) {
+    msg[i] = *(char *)svGetArrElemPtr1(data, i);
+  }
+  if (recorder)
+    recorder->record(simTick, endpointId, MessageDirection::ToClient, msg,
+                     dataSize);
+  ep->commitMessageToClient(dataSize);
+  ++simActivity;
   return 0;
 }
 
+// Report the current simulation time, which tags the recorded messages and
+// releases the replayed ones.
+DPI void sv2cCosimserverSetTime(long long tick) {
+  simTick = tick;
+  if (replayer && server != nullptr)
+    replayer->advance(tick, server->endpoints);
+}
+
+// Return the number of messages moved by the simulation, such that a driver
+// can tell whether the design talked to any client over some cycles.
+DPI unsigned long long cosimserverGetActivity() { return simActivity; }
+
+// Block until a client queues a message to the simulation, or the timeout
+// expires.
+//   - Return 1 if a message is queued, 0 on timeout, -1 if there is no server.
+//   - When replaying, return 1 right away as long as messages remain to be
+//     replayed, and -1 afterwards.
+DPI int cosimserverWaitForMessages(unsigned int timeoutMs) {
+  if (server == nullptr)
+    return -1;
+  // Replayed messages are released by the simulation time, keep simulating.
+  if (replayer)
+    return replayer->hasPendingMessagesToSim() ? 1 : -1;
+
+  auto &endpoints = server->endpoints;
+  uint64_t seen = endpoints.simNotifier.getGeneration();
+  auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+  while (!endpoints.hasMessagesToSim()) {
+    auto now = std::chrono::steady_clock::now();
+    if (now >= deadline)
+      return 0;
+    // Clients sharing the queues in memory don't signal, and a notification
+    // can be missed, so look at the queues again at least every millisecond.
+    auto timeout = std::min<std::chrono::microseconds>(
+        std::chrono::duration_cast<std::chrono::microseconds>(deadline - now),
+        std::chrono::milliseconds(1));
+    endpoints.simNotifier.wait(seen, timeout);
+  }
+  return 1;
+}
+
 // Teardown cosimserver (disconnects from primary server port, stops connections
 // from active clients).
 DPI void sv2cCosimserverFinish() {
   std::lock_guard<std::mutex> g(serverMutex);
   printf("[cosim] Tearing down RPC server.\n");
   if (server != nullptr) {
-    server->stop();
+    if (!replayer)
+      server->stop();
     server = nullptr;
   }
+  if (replayer) {
+    replayer->report();
+    replayer.reset();
+  }
+  recorder.reset();
 }
 
 // Start cosimserver (spawns server for RTL-initiated work, listens for
@@ -212,7 +459,11 @@ DPI int sv2cCosimserverInit() {
   if (server == nullptr) {
     printf("[cosim] Starting RPC server.\n");
     server = new RpcServer();
-    server->run(findPort());
+    if (const char *shmPrefix = findShmPrefix())
+      server->endpoints.setShmPrefix(shmPrefix);
+    openRecorder();
+    if (!openReplayer())
+      server->run(findPort(), findNumThreads());
   }
   return 0;
 }
@@ -12,11 +12,86 @@
 
 #include "circt/Dialect/ESI/cosim/Endpoint.h"
 
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
 using namespace circt::esi::cosim;
 
+EndpointRegion::EndpointRegion(const std::string &name, size_t size)
+    : addr(MAP_FAILED), size(size) {
+  if (!name.empty()) {
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd >= 0 && ftruncate(fd, size) == 0)
+      addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (fd >= 0)
+      close(fd);
+    if (addr != MAP_FAILED)
+      shmName = name;
+    else
+      fprintf(stderr,
+              "Warning: could not create shared memory %s, the endpoint "
+              "queues will not be shared.\n",
+              name.c_str());
+  }
+  // Fall back to private memory.
+  if (addr == MAP_FAILED)
+    addr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (addr == MAP_FAILED) {
+    fprintf(stderr, "Could not allocate the endpoint queues!\n");
+    abort();
+  }
+}
+
+EndpointRegion::~EndpointRegion() {
+  munmap(addr, size);
+  if (!shmName.empty())
+    shm_unlink(shmName.c_str());
+}
+
+/// Return the size of the region holding the header and both queues of an
+/// endpoint.
+static size_t getRegionSize(int sendTypeMaxSize, int recvTypeMaxSize) {
+  return EndpointRegion::headerSize +
+         MessageRing::getRegionSize(Endpoint::queueDepth,
+                                    std::max(sendTypeMaxSize, 0)) +
+         MessageRing::getRegionSize(Endpoint::queueDepth,
+                                    std::max(recvTypeMaxSize, 0));
+}
+
+/// Return the offset of the given queue in the region of an endpoint.
+static size_t getQueueOffset(bool toClient, int sendTypeMaxSize) {
+  size_t offset = EndpointRegion::headerSize;
+  if (toClient)
+    offset += MessageRing::getRegionSize(Endpoint::queueDepth,
+                                         std::max(sendTypeMaxSize, 0));
+  return offset;
+}
+
 Endpoint::Endpoint(uint64_t sendTypeId, int sendTypeMaxSize,
-                   uint64_t recvTypeId, int recvTypeMaxSize)
-    : sendTypeId(sendTypeId), recvTypeId(recvTypeId), inUse(false) {}
+                   uint64_t recvTypeId, int recvTypeMaxSize,
+                   MessageNotifier *notifier, MessageNotifier *simNotifier,
+                   const std::string &shmName)
+    : sendTypeId(sendTypeId), recvTypeId(recvTypeId), inUse(false),
+      region(shmName, getRegionSize(sendTypeMaxSize, recvTypeMaxSize)),
+      // The send type is the one of the messages from the client to the
+      // simulation, the receive type the one of the messages back.
+      toCosim(region.data() + getQueueOffset(false, sendTypeMaxSize),
+              queueDepth, std::max(sendTypeMaxSize, 0)),
+      toClient(region.data() + getQueueOffset(true, sendTypeMaxSize),
+               queueDepth, std::max(recvTypeMaxSize, 0)),
+      notifier(notifier), simNotifier(simNotifier),
+      toSimCounters(MessageRing::getNumSlots(queueDepth)),
+      toClientCounters(MessageRing::getNumSlots(queueDepth)) {
+  auto *header = reinterpret_cast<uint64_t *>(region.data());
+  header[0] = EndpointRegion::magic;
+  header[1] = EndpointRegion::version;
+  header[2] = getQueueOffset(false, sendTypeMaxSize);
+  header[3] = getQueueOffset(true, sendTypeMaxSize);
+}
 Endpoint::~Endpoint() {}
 
 bool Endpoint::setInUse() {
@@ -34,6 +109,28 @@ void Endpoint::returnForUse() {
   inUse = false;
 }
 
+void Endpoint::QueueCounters::get(const MessageRing &ring,
+                                  EndpointStats::Queue &stats) const {
+  stats.messages = messages.load(std::memory_order_relaxed);
+  stats.bytes = bytes.load(std::memory_order_relaxed);
+  // Both sides may move on between the loads.
+  uint64_t popped = ring.getNumPopped();
+  uint64_t committed = ring.getNumCommitted();
+  stats.depth = committed > popped ? committed - popped : 0;
+  stats.maxDepth = maxDepth.load(std::memory_order_relaxed);
+  stats.queuedNs = queuedNs.load(std::memory_order_relaxed);
+  stats.maxQueuedNs = maxQueuedNs.load(std::memory_order_relaxed);
+}
+
+EndpointStats Endpoint::getStats() const {
+  EndpointStats stats;
+  toSimCounters.get(toCosim, stats.toSim);
+  toClientCounters.get(toClient, stats.toClient);
+  stats.polls = polls.load(std::memory_order_relaxed);
+  stats.pollsWithData = pollsWithData.load(std::memory_order_relaxed);
+  return stats;
+}
+
 bool EndpointRegistry::registerEndpoint(int epId, uint64_t sendTypeId,
                                         int sendTypeMaxSize,
                                         uint64_t recvTypeId,
@@ -49,11 +146,58 @@ bool EndpointRegistry::registerEndpoint(int epId, uint64_t sendTypeId,
                     // Map key.
                     std::forward_as_tuple(epId),
                     // Endpoint constructor args.
-                    std::forward_as_tuple(sendTypeId, sendTypeMaxSize,
-                                          recvTypeId, recvTypeMaxSize));
+                    std::forward_as_tuple(
+                        sendTypeId, sendTypeMaxSize, recvTypeId,
+                        recvTypeMaxSize, &notifier, &simNotifier,
+                        shmPrefix.empty()
+                            ? std::string()
+                            : shmPrefix + "-" + std::to_string(epId)));
+
+  // Publish a new lookup table including the new endpoint. Map nodes never
+  // move, so the pointers stay valid.
+  auto table = std::make_unique<LookupTable>();
+  for (auto &ep : endpoints) {
+    if (ep.first < 0 || ep.first >= maxTableId)
+      continue;
+    if ((size_t)ep.first >= table->size())
+      table->resize(ep.first + 1, nullptr);
+    (*table)[ep.first] = &ep.second;
+  }
+  lookupTable.store(table.get(), std::memory_order_release);
+  tables.push_back(std::move(table));
   return true;
 }
 
+bool EndpointRegistry::hasMessagesToSim() {
+  Lock g(m);
+  for (auto &ep : endpoints)
+    if (ep.second.hasMessagesToSim())
+      return true;
+  return false;
+}
+
+void EndpointRegistry::pollMessagesToSim(uint32_t *mask, size_t numWords) {
+  std::fill(mask, mask + numWords, 0);
+  // Every ID covered by a mask of a reasonable size is in the lookup table.
+  const LookupTable *table = lookupTable.load(std::memory_order_acquire);
+  if (!table)
+    return;
+  size_t numIds = std::min(table->size(), numWords * 32);
+  for (size_t id = 0; id < numIds; ++id) {
+    Endpoint *ep = (*table)[id];
+    if (ep && ep->hasMessagesToSim())
+      mask[id / 32] |= 1u << (id % 32);
+  }
+}
+
+Endpoint *EndpointRegistry::find(int epId) {
+  Lock g(m);
+  auto it = endpoints.find(epId);
+  if (it == endpoints.end())
+    return nullptr;
+  return &it->second;
+}
+
 void EndpointRegistry::iterateEndpoints(
     std::function<void(int, const Endpoint &)> f) const {
   // This function is logically const, but modification is needed to obtain a
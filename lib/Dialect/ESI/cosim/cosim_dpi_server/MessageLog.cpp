@@ -0,0 +1,154 @@
+//===- MessageLog.cpp - Cosim message recording and replay ------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Definitions for the cosim message log recorder and replayer.
+//
+//===----------------------------------------------------------------------===//
+
+#include "circt/Dialect/ESI/cosim/MessageLog.h"
+
+#include <cstring>
+
+using namespace circt::esi::cosim;
+
+/// ----- MessageRecorder definitions.
+
+MessageRecorder::~MessageRecorder() {
+  if (file)
+    fclose(file);
+}
+
+bool MessageRecorder::open(const std::string &path) {
+  file = fopen(path.c_str(), "wb");
+  if (!file)
+    return false;
+  uint64_t m = magic;
+  uint32_t v = version;
+  return fwrite(&m, sizeof(m), 1, file) == 1 &&
+         fwrite(&v, sizeof(v), 1, file) == 1;
+}
+
+void MessageRecorder::record(uint64_t tick, unsigned endpointId,
+                             MessageDirection dir, const uint8_t *data,
+                             size_t size) {
+  uint32_t id = endpointId;
+  uint8_t d = static_cast<uint8_t>(dir);
+  uint32_t s = size;
+  fwrite(&tick, sizeof(tick), 1, file);
+  fwrite(&id, sizeof(id), 1, file);
+  fwrite(&d, sizeof(d), 1, file);
+  fwrite(&s, sizeof(s), 1, file);
+  fwrite(data, 1, size, file);
+}
+
+/// ----- MessageReplayer definitions.
+
+bool MessageReplayer::open(const std::string &path) {
+  FILE *file = fopen(path.c_str(), "rb");
+  if (!file)
+    return false;
+
+  uint64_t m;
+  uint32_t v;
+  bool ok = fread(&m, sizeof(m), 1, file) == 1 &&
+            fread(&v, sizeof(v), 1, file) == 1 &&
+            m == MessageRecorder::magic && v == MessageRecorder::version;
+  while (ok) {
+    uint64_t tick;
+    uint32_t id;
+    uint8_t dir;
+    uint32_t size;
+    if (fread(&tick, sizeof(tick), 1, file) != 1)
+      break; // End of the log.
+    Message msg;
+    msg.tick = tick;
+    ok = fread(&id, sizeof(id), 1, file) == 1 &&
+         fread(&dir, sizeof(dir), 1, file) == 1 &&
+         fread(&size, sizeof(size), 1, file) == 1 && dir <= 1;
+    if (!ok)
+      break;
+    msg.data.resize(size);
+    ok = fread(msg.data.data(), 1, size, file) == size;
+    if (!ok)
+      break;
+
+    auto &log = logs[id];
+    if (dir == static_cast<uint8_t>(MessageDirection::ToSim)) {
+      log.toSim.push_back(std::move(msg));
+      ++numPendingToSim;
+    } else {
+      log.toClient.push_back(std::move(msg));
+    }
+  }
+  fclose(file);
+  return ok;
+}
+
+void MessageReplayer::advance(uint64_t tick, EndpointRegistry &endpoints) {
+  if (numPendingToSim == 0)
+    return;
+  for (auto &idAndLog : logs) {
+    auto &toSim = idAndLog.second.toSim;
+    if (toSim.empty() || toSim.front().tick > tick)
+      continue;
+    Endpoint *ep = endpoints[idAndLog.first];
+    if (!ep)
+      continue;
+    while (!toSim.empty() && toSim.front().tick <= tick) {
+      auto &data = toSim.front().data;
+      if (data.size() > ep->getMaxMessageToSimSize()) {
+        fprintf(stderr, "[COSIM] Replayed message too large for endpoint %u\n",
+                idAndLog.first);
+      } else {
+        uint8_t *slot = ep->reserveMessageToSim();
+        // Retry once the simulation made room.
+        if (!slot)
+          break;
+        std::memcpy(slot, data.data(), data.size());
+        ep->commitMessageToSim(data.size());
+      }
+      toSim.pop_front();
+      --numPendingToSim;
+    }
+  }
+}
+
+bool MessageReplayer::checkMessageToClient(uint64_t tick, unsigned endpointId,
+                                           const uint8_t *data, size_t size) {
+  auto it = logs.find(endpointId);
+  if (it == logs.end() || it->second.toClient.empty()) {
+    if (numUnexpected++ == 0)
+      fprintf(stderr,
+              "[COSIM] Unexpected message to the client of endpoint %u at "
+              "tick %llu\n",
+              endpointId, (unsigned long long)tick);
+    return false;
+  }
+
+  auto &toClient = it->second.toClient;
+  bool match = toClient.front().data.size() == size &&
+               std::memcmp(toClient.front().data.data(), data, size) == 0;
+  if (!match && numMismatches++ == 0)
+    fprintf(stderr,
+            "[COSIM] Message to the client of endpoint %u at tick %llu "
+            "differs from the one recorded at tick %llu\n",
+            endpointId, (unsigned long long)tick,
+            (unsigned long long)toClient.front().tick);
+  toClient.pop_front();
+  return match;
+}
+
+size_t MessageReplayer::report() const {
+  size_t numMissing = 0;
+  for (auto &idAndLog : logs)
+    numMissing += idAndLog.second.toClient.size();
+  printf("[COSIM] Replay: %zu messages to the simulation not replayed, %zu "
+         "messages to the clients missing, %zu unexpected, %zu mismatching\n",
+         numPendingToSim, numMissing, numUnexpected, numMismatches);
+  return numPendingToSim + numMissing + numUnexpected + numMismatches;
+}
@@ -19,8 +19,15 @@
 
 #include "circt/Dialect/ESI/cosim/Server.h"
 #include "circt/Dialect/ESI/cosim/CosimDpi.capnp.h"
-#include <capnp/ez-rpc.h>
-#include <thread>
+#include <capnp/rpc-twoparty.h>
+#include <kj/async-io.h>
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 using namespace capnp;
 using namespace circt::esi::cosim;
@@ -34,12 +41,29 @@ class EndpointServer final
     : public EsiDpiEndpoint<capnp::AnyPointer, capnp::AnyPointer>::Server {
   /// The wrapped endpoint.
   Endpoint &endpoint;
+  /// The timer of the RPC event loop, used by blocking receives.
+  kj::Timer &timer;
   /// Signals that this endpoint has been opened by a client and hasn't been
   /// closed by said client.
   bool open;
 
+  /// Copy the message data of an incoming message to the simulation queue.
+  void pushMessage(AnyPointer::Reader msg);
+  /// Pop the oldest message to the client into the given pointer. Return false
+  /// if there is no message.
+  bool popMessage(AnyPointer::Builder dst);
+  /// Pop up to maxMsgs messages to the client into the results.
+  void popMessages(RecvBatchContext &context, uint32_t maxMsgs);
+
+  /// Return the deadline of a blocking receive with the given timeout. Zero
+  /// means no timeout.
+  kj::Maybe<kj::TimePoint> getDeadline(uint32_t timeoutMs);
+  /// Resolve to true once messages to the client are queued, or false when the
+  /// deadline is reached.
+  kj::Promise<bool> waitForMessages(kj::Maybe<kj::TimePoint> deadline);
+
 public:
-  EndpointServer(Endpoint &ep);
+  EndpointServer(Endpoint &ep, kj::Timer &timer);
   /// Release the Endpoint should the client disconnect without properly closing
   /// it.
   ~EndpointServer();
@@ -50,85 +74,171 @@ public:
   kj::Promise<void> send(SendContext);
   kj::Promise<void> recv(RecvContext);
   kj::Promise<void> close(CloseContext);
+  kj::Promise<void> sendBatch(SendBatchContext);
+  kj::Promise<void> recvBatch(RecvBatchContext);
 };
 
-/// Implements the `CosimDpiServer` interface from the RPC schema.
+/// Implements the `CosimDpiServer` interface from the RPC schema. There is one
+/// per server thread, and the endpoints it opens are serviced by that thread.
 class CosimServer final : public CosimDpiServer::Server {
   /// The registry of endpoints. The RpcServer class owns this.
   EndpointRegistry &reg;
+  /// The timer of the event loop of the server thread.
+  kj::Timer &timer;
 
 public:
-  CosimServer(EndpointRegistry &reg);
+  CosimServer(EndpointRegistry &reg, kj::Timer &timer);
 
   /// List all the registered interfaces.
   kj::Promise<void> list(ListContext ctxt);
   /// Open a specific interface, locking it in the process.
   kj::Promise<void> open(OpenContext ctxt);
+  /// Report the traffic counters of all the interfaces.
+  kj::Promise<void> stats(StatsContext ctxt);
 };
 } // anonymous namespace
 
 /// ------ EndpointServer definitions.
 
-EndpointServer::EndpointServer(Endpoint &ep) : endpoint(ep), open(true) {}
+/// The interval at which blocked receives check for new messages. The server
+/// thread wakes up as soon as the simulation queues a message, so this mostly
+/// bounds the time between that wakeup and the reply.
+static const kj::Duration recvPollInterval = 10 * kj::MICROSECONDS;
+
+EndpointServer::EndpointServer(Endpoint &ep, kj::Timer &timer)
+    : endpoint(ep), timer(timer), open(true) {}
 EndpointServer::~EndpointServer() {
   if (open)
     endpoint.returnForUse();
 }
 
-/// This is the client polling for a message. If one is available, send it.
-/// TODO: implement a blocking call with a timeout.
+bool EndpointServer::popMessage(AnyPointer::Builder dst) {
+  const uint8_t *msg;
+  size_t msgSize;
+  if (!endpoint.getMessageToClient(msg, msgSize))
+    return false;
+
+  // Release the queue slot once the message is copied into the response.
+  KJ_DEFER(endpoint.popMessageToClient());
+  KJ_REQUIRE(msgSize % 8 == 0,
+             "Response msg was malformed. Size of response was not a "
+             "multiple of 8 bytes.");
+  // Wrap the queue slot, which is word aligned, into a single segment.
+  auto segment =
+      kj::ArrayPtr<const capnp::word>((const word *)msg, msgSize / 8);
+  // Create a single-element array of segments.
+  kj::Array<kj::ArrayPtr<const capnp::word>> segments =
+      kj::heapArray({segment});
+  // Create an object which will read the segments into a message on send.
+  std::unique_ptr<SegmentArrayMessageReader> msgReader =
+      std::make_unique<SegmentArrayMessageReader>(segments);
+  // Send.
+  dst.set(msgReader->getRoot<AnyPointer>());
+  return true;
+}
+
+void EndpointServer::popMessages(RecvBatchContext &context, uint32_t maxMsgs) {
+  auto numMsgs =
+      std::min<size_t>(maxMsgs, endpoint.getNumMessagesToClient());
+  auto resps = context.getResults().initResps(numMsgs);
+  for (size_t i = 0; i < numMsgs; ++i)
+    popMessage(resps[i].getMsg());
+}
+
+kj::Maybe<kj::TimePoint> EndpointServer::getDeadline(uint32_t timeoutMs) {
+  if (timeoutMs == 0)
+    return nullptr;
+  return timer.now() + timeoutMs * kj::MILLISECONDS;
+}
+
+kj::Promise<bool>
+EndpointServer::waitForMessages(kj::Maybe<kj::TimePoint> deadline) {
+  if (endpoint.getNumMessagesToClient() > 0)
+    return true;
+  KJ_IF_MAYBE (d, deadline) {
+    if (timer.now() >= *d)
+      return false;
+  }
+  return timer.afterDelay(recvPollInterval).then([this, deadline]() {
+    return waitForMessages(deadline);
+  });
+}
+
+/// This is the client asking for a message. If one is available, send it. If
+/// blocking, wait for one in the RPC event loop, without stalling the other
+/// endpoints.
 kj::Promise<void> EndpointServer::recv(RecvContext context) {
   KJ_REQUIRE(open, "EndPoint closed already");
-  KJ_REQUIRE(!context.getParams().getBlock(),
-             "Blocking recv() not supported yet");
-
-  // Try to pop a message.
-  Endpoint::BlobPtr blob;
-  auto msgPresent = endpoint.getMessageToClient(blob);
-  context.getResults().setHasData(msgPresent);
-  if (msgPresent) {
-    KJ_REQUIRE(blob->size() % 8 == 0,
-               "Response msg was malformed. Size of response was not a "
-               "multiple of 8 bytes.");
-    // Copy the blob into a single segment.
-    auto segment =
-        kj::ArrayPtr<capnp::word>((word *)blob->data(), blob->size() / 8)
-            .asConst();
-    // Create a single-element array of segments.
-    kj::Array<kj::ArrayPtr<const capnp::word>> segments =
-        kj::heapArray({segment});
-    // Create an object which will read the segments into a message on send.
-    std::unique_ptr<SegmentArrayMessageReader> msgReader =
-        std::make_unique<SegmentArrayMessageReader>(segments);
-    // Send.
-    context.getResults().getResp().set(msgReader->getRoot<AnyPointer>());
+  auto params = context.getParams();
+  if (!params.getBlock() || endpoint.getNumMessagesToClient() > 0) {
+    auto results = context.getResults();
+    results.setHasData(popMessage(results.getResp()));
+    return kj::READY_NOW;
   }
-  return kj::READY_NOW;
+
+  return waitForMessages(getDeadline(params.getTimeoutMs()))
+      .then([this, context](bool) mutable {
+        auto results = context.getResults();
+        results.setHasData(popMessage(results.getResp()));
+      });
 }
 
-/// 'Send' is from the client perspective, so this is a message we are
-/// recieving. The only way I could figure out to copy the raw message is a
-/// double copy. I was have issues getting libkj's arrays to play nice with
-/// others.
-kj::Promise<void> EndpointServer::send(SendContext context) {
+kj::Promise<void> EndpointServer::recvBatch(RecvBatchContext context) {
   KJ_REQUIRE(open, "EndPoint closed already");
-  auto capnpMsgPointer = context.getParams().getMsg();
+  auto params = context.getParams();
+  auto maxMsgs = params.getMaxMsgs();
+  if (!params.getBlock() || endpoint.getNumMessagesToClient() > 0) {
+    popMessages(context, maxMsgs);
+    return kj::READY_NOW;
+  }
+
+  return waitForMessages(getDeadline(params.getTimeoutMs()))
+      .then([this, context, maxMsgs](bool) mutable {
+        popMessages(context, maxMsgs);
+      });
+}
+
+/// The message is built as a flat, single segment message directly in the
+/// queue slot, so it is only copied once on its way to the simulation.
+void EndpointServer::pushMessage(AnyPointer::Reader capnpMsgPointer) {
   KJ_REQUIRE(capnpMsgPointer.isStruct(),
              "Only messages can go in the 'msg' parameter");
 
-  // Copy the incoming message into a flat, single segment buffer.
-  auto msgSize = capnpMsgPointer.targetSize();
-  auto builder = std::make_unique<MallocMessageBuilder>(
-      msgSize.wordCount + 1, AllocationStrategy::FIXED_SIZE);
-  builder->setRoot(capnpMsgPointer);
-  auto segments = builder->getSegmentsForOutput();
-  KJ_ASSERT(segments.size() == 1);
-
-  // Now copy it into a blob and queue it.
-  auto fstSegmentData = segments[0].asBytes();
-  auto blob = std::make_shared<Endpoint::Blob>(fstSegmentData.begin(),
-                                               fstSegmentData.end());
-  endpoint.pushMessageToSim(blob);
+  // One extra word for the root pointer.
+  auto msgWords = capnpMsgPointer.targetSize().wordCount + 1;
+  KJ_REQUIRE(msgWords * sizeof(word) <= endpoint.getMaxMessageToSimSize(),
+             "Message is too large for the endpoint");
+  uint8_t *slot = endpoint.reserveMessageToSim();
+  KJ_REQUIRE(slot != nullptr, "Message queue to the simulation is full");
+
+  // The builder expects a zeroed first segment. Fixed-size allocation ensures
+  // that the message fits in it.
+  auto firstSegment = kj::arrayPtr(reinterpret_cast<word *>(slot), msgWords);
+  memset(slot, 0, msgWords * sizeof(word));
+  MallocMessageBuilder builder(firstSegment, AllocationStrategy::FIXED_SIZE);
+  builder.setRoot(capnpMsgPointer);
+  auto segments = builder.getSegmentsForOutput();
+  KJ_ASSERT(segments.size() == 1 &&
+            segments[0].begin() == firstSegment.begin());
+
+  // Publish the message.
+  endpoint.commitMessageToSim(segments[0].asBytes().size());
+}
+
+/// 'Send' is from the client perspective, so this is a message we are
+/// recieving.
+kj::Promise<void> EndpointServer::send(SendContext context) {
+  KJ_REQUIRE(open, "EndPoint closed already");
+  pushMessage(context.getParams().getMsg());
+  return kj::READY_NOW;
+}
+
+/// Messages of a batch are queued in order. If one of them cannot be queued,
+/// the call fails and the rest of the batch is dropped.
+kj::Promise<void> EndpointServer::sendBatch(SendBatchContext context) {
+  KJ_REQUIRE(open, "EndPoint closed already");
+  for (auto envelope : context.getParams().getMsgs())
+    pushMessage(envelope.getMsg());
   return kj::READY_NOW;
 }
 
@@ -141,7 +251,8 @@ kj::Promise<void> EndpointServer::close(CloseContext context) {
 
 /// ----- CosimServer definitions.
 
-CosimServer::CosimServer(EndpointRegistry &reg) : reg(reg) {}
+CosimServer::CosimServer(EndpointRegistry &reg, kj::Timer &timer)
+    : reg(reg), timer(timer) {}
 
 kj::Promise<void> CosimServer::list(ListContext context) {
   auto ifaces = context.getResults().initIfaces((unsigned int)reg.size());
@@ -150,6 +261,8 @@ kj::Promise<void> CosimServer::list(ListContext context) {
     ifaces[ctr].setEndpointID(id);
     ifaces[ctr].setSendTypeID(ep.getSendTypeId());
     ifaces[ctr].setRecvTypeID(ep.getRecvTypeId());
+    if (!ep.getShmName().empty())
+      ifaces[ctr].setShmName(ep.getShmName());
     ++ctr;
   });
   return kj::READY_NOW;
@@ -163,19 +276,94 @@ kj::Promise<void> CosimServer::open(OpenContext ctxt) {
   KJ_REQUIRE(gotLock, "Endpoint in use");
 
   ctxt.getResults().setIface(EsiDpiEndpoint<AnyPointer, AnyPointer>::Client(
-      kj::heap<EndpointServer>(*ep)));
+      kj::heap<EndpointServer>(*ep, timer)));
+  return kj::READY_NOW;
+}
+
+/// Copy the counters of one queue into its RPC representation.
+static void setQueueStats(EsiDpiQueueStats::Builder dst,
+                          const EndpointStats::Queue &stats) {
+  dst.setMessages(stats.messages);
+  dst.setBytes(stats.bytes);
+  dst.setDepth(stats.depth);
+  dst.setMaxDepth(stats.maxDepth);
+  dst.setQueuedNs(stats.queuedNs);
+  dst.setMaxQueuedNs(stats.maxQueuedNs);
+}
+
+kj::Promise<void> CosimServer::stats(StatsContext context) {
+  // Endpoints may be registered concurrently, so collect them under the
+  // registry lock first.
+  std::vector<std::pair<int, EndpointStats>> snapshot;
+  reg.iterateEndpoints([&](int id, const Endpoint &ep) {
+    snapshot.emplace_back(id, ep.getStats());
+  });
+  auto endpoints = context.getResults().initEndpoints(snapshot.size());
+  for (size_t i = 0, e = snapshot.size(); i < e; ++i) {
+    auto &stats = snapshot[i].second;
+    endpoints[i].setEndpointID(snapshot[i].first);
+    setQueueStats(endpoints[i].initToSim(), stats.toSim);
+    setQueueStats(endpoints[i].initToClient(), stats.toClient);
+    endpoints[i].setPolls(stats.polls);
+    endpoints[i].setPollsWithData(stats.pollsWithData);
+  }
   return kj::READY_NOW;
 }
 
 /// ----- RpcServer definitions.
 
-RpcServer::RpcServer() : mainThread(nullptr), stopSig(false) {}
+RpcServer::RpcServer() : started(false), stopSig(false) {}
 RpcServer::~RpcServer() { stop(); }
 
-void RpcServer::mainLoop(uint16_t port) {
-  capnp::EzRpcServer rpcServer(kj::heap<CosimServer>(endpoints),
-                               /* bindAddress */ "*", port);
-  auto &waitScope = rpcServer.getWaitScope();
+/// Open a TCP socket listening on the given port of all the interfaces, both
+/// IPv6 and IPv4 if possible. Return -1 on failure.
+static int openListenSocket(uint16_t port) {
+  int one = 1;
+  int fd = socket(AF_INET6, SOCK_STREAM, 0);
+  if (fd >= 0) {
+    int zero = 0;
+    setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in6 addr = {};
+    addr.sin6_family = AF_INET6;
+    addr.sin6_addr = in6addr_any;
+    addr.sin6_port = htons(port);
+    if (bind(fd, (sockaddr *)&addr, sizeof(addr)) == 0 &&
+        listen(fd, SOMAXCONN) == 0)
+      return fd;
+    close(fd);
+  }
+
+  // Fall back to IPv4 only.
+  fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (bind(fd, (sockaddr *)&addr, sizeof(addr)) == 0 &&
+      listen(fd, SOMAXCONN) == 0)
+    return fd;
+  close(fd);
+  return -1;
+}
+
+void RpcServer::serverLoop(int listenFd) {
+  auto io = kj::setupAsyncIo();
+  capnp::TwoPartyServer rpcServer(
+      kj::heap<CosimServer>(endpoints, io.provider->getTimer()));
+  // Every thread waits for connections on its own descriptor of the shared
+  // socket. The next client is accepted by whichever thread polls first, which
+  // tends to be one that isn't busy with other clients.
+  auto listener = io.lowLevelProvider->wrapListenSocketFd(
+      listenFd, kj::LowLevelAsyncIoProvider::TAKE_OWNERSHIP);
+  auto listening = rpcServer.listen(*listener).eagerlyEvaluate(
+      [](kj::Exception &&e) {
+        fprintf(stderr, "RPC server stopped listening: %s\n",
+                e.getDescription().cStr());
+      });
 
   // OK, this is uber hacky, but it unblocks me and isn't _too_ inefficient. The
   // problem is that I can't figure out how read the stop signal from libkj
@@ -187,29 +375,51 @@ void RpcServer::mainLoop(uint16_t port) {
   // pipe to deliver a shutdown signal.
   //
   // TODO: Figure out how to do this properly, if possible.
+  //
+  // Between polls, wait for a message from the simulation rather than sleeping,
+  // so that blocked receives are answered right away. Every server thread is
+  // woken up, as any of them may be servicing the endpoint.
+  uint64_t seen = endpoints.notifier.getGeneration();
   while (!stopSig) {
-    waitScope.poll();
-    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    io.waitScope.poll();
+    endpoints.notifier.wait(seen, std::chrono::milliseconds(1));
   }
 }
 
 /// Start the server if not already started.
-void RpcServer::run(uint16_t port) {
+void RpcServer::run(uint16_t port, unsigned numThreads) {
   Lock g(m);
-  if (mainThread == nullptr) {
-    mainThread = new std::thread(&RpcServer::mainLoop, this, port);
-  } else {
+  if (started) {
     fprintf(stderr, "Warning: cannot Run() RPC server more than once!");
+    return;
+  }
+  if (numThreads == 0) {
+    numThreads = std::thread::hardware_concurrency();
+    if (numThreads == 0 || numThreads > defaultMaxThreads)
+      numThreads = defaultMaxThreads;
+  }
+
+  int listenFd = openListenSocket(port);
+  if (listenFd < 0) {
+    fprintf(stderr, "Could not listen on port %u: %s\n", port,
+            strerror(errno));
+    return;
+  }
+  started = true;
+  for (unsigned i = 0; i < numThreads; ++i) {
+    int fd = i + 1 == numThreads ? listenFd : dup(listenFd);
+    threads.emplace_back(&RpcServer::serverLoop, this, fd);
   }
 }
 
-/// Signal the RPC server thread to stop. Wait for it to exit.
+/// Signal the RPC server threads to stop. Wait for them to exit.
 void RpcServer::stop() {
   Lock g(m);
-  if (mainThread == nullptr) {
+  if (!started) {
     fprintf(stderr, "RpcServer not Run()\n");
   } else if (!stopSig) {
     stopSig = true;
-    mainThread->join();
+    for (auto &thread : threads)
+      thread.join();
   }
 }
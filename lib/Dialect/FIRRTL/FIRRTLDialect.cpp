@@ -13,6 +13,10 @@
 #include "circt/Dialect/FIRRTL/FIRRTLDialect.h"
 #include "circt/Dialect/FIRRTL/FIRRTLOps.h"
 #include "mlir/IR/DialectImplementation.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/RWMutex.h"
+#include "llvm/Support/StringSaver.h"
 
 using namespace circt;
 using namespace firrtl;
@@ -94,9 +98,19 @@ struct FIRRTLOpAsmDialectInterface : public OpAsmDialectInterface {
 };
 } // end anonymous namespace
 
+/// This is the per-context cache of flattened bundle fields.  Types are
+/// uniqued, so the field list of each type only needs to be computed once.
+struct FIRRTLDialect::FlatBundleCache {
+  llvm::sys::SmartRWMutex<true> mutex;
+  DenseMap<FIRRTLType, ArrayRef<FlatBundleFieldEntry>> fields;
+  llvm::BumpPtrAllocator allocator;
+  llvm::UniqueStringSaver suffixes{allocator};
+};
+
 FIRRTLDialect::FIRRTLDialect(MLIRContext *context)
     : Dialect(getDialectNamespace(), context,
-              ::mlir::TypeID::get<FIRRTLDialect>()) {
+              ::mlir::TypeID::get<FIRRTLDialect>()),
+      flatBundleCache(std::make_unique<FlatBundleCache>()) {
 
   // Register types.
   addTypes<SIntType, UIntType, ClockType, ResetType, AsyncResetType, AnalogType,
@@ -115,6 +129,53 @@ FIRRTLDialect::FIRRTLDialect(MLIRContext *context)
 
 FIRRTLDialect::~FIRRTLDialect() {}
 
+ArrayRef<FlatBundleFieldEntry>
+FIRRTLDialect::getFlatBundleFields(FIRRTLType type) {
+  auto &cache = *flatBundleCache;
+  {
+    llvm::sys::SmartScopedReader<true> lock(cache.mutex);
+    auto it = cache.fields.find(type);
+    if (it != cache.fields.end())
+      return it->second;
+  }
+
+  // Compute the fields without holding the lock, since the element types are
+  // flattened through the cache as well.  Suffixes of nested fields are kept in
+  // temporary storage until they get interned below.
+  SmallVector<FlatBundleFieldEntry, 8> fields;
+  SmallVector<SmallString<16>, 8> suffixes;
+  if (auto flip = type.dyn_cast<FlipType>()) {
+    for (auto field : getFlatBundleFields(flip.getElementType()))
+      fields.push_back({field.type, field.suffix, !field.isOutput});
+  } else if (auto bundle = type.dyn_cast<BundleType>()) {
+    for (auto &elt : bundle.getElements()) {
+      for (auto field : getFlatBundleFields(elt.type)) {
+        suffixes.emplace_back("_");
+        suffixes.back() += elt.name.strref();
+        suffixes.back() += field.suffix;
+        fields.push_back({field.type, StringRef(), field.isOutput});
+      }
+    }
+  } else {
+    fields.push_back({type, StringRef(), false});
+  }
+
+  llvm::sys::SmartScopedWriter<true> lock(cache.mutex);
+  // Another thread may have gotten here first.
+  auto &entry = cache.fields[type];
+  if (entry.data())
+    return entry;
+
+  if (!suffixes.empty())
+    for (auto it : llvm::zip(fields, suffixes))
+      std::get<0>(it).suffix = cache.suffixes.save(std::get<1>(it));
+
+  auto *storage = cache.allocator.Allocate<FlatBundleFieldEntry>(fields.size());
+  std::uninitialized_copy(fields.begin(), fields.end(), storage);
+  entry = ArrayRef<FlatBundleFieldEntry>(storage, fields.size());
+  return entry;
+}
+
 void FIRRTLDialect::printType(Type type, DialectAsmPrinter &os) const {
   type.cast<FIRRTLType>().print(os.getStream());
 }
@@ -41,6 +41,70 @@ static inline ConstantIntMatcher m_FConstant(APInt &value) {
   return ConstantIntMatcher(value);
 }
 
+/// Return the width of the integer type `type`, or -1 if it is unknown.  Zero
+/// bit values are treated as unknown, since an APInt can't hold them.
+static int32_t getKnownWidth(Type type) {
+  auto width = type.cast<IntType>().getWidthOrSentinel();
+  return width == 0 ? -1 : width;
+}
+
+/// Return the value of the constant `attr` of FIRRTL type `type`, extended or
+/// truncated to `width` bits according to the signedness of the type.
+static APInt getExtendedConstant(IntegerAttr attr, Type type, unsigned width) {
+  if (type.cast<IntType>().isSigned())
+    return attr.getValue().sextOrTrunc(width);
+  return attr.getValue().zextOrTrunc(width);
+}
+
+/// Constant fold a binary operator whose operands are both constants.  The
+/// operands are extended to `operandWidth` bits, or the width of the result if
+/// that is -1, and combined with `calculate`.  Nothing is folded unless the
+/// operand and result widths are all known.
+static OpFoldResult constFoldFIRRTLBinaryOp(
+    Operation *op, ArrayRef<Attribute> operands,
+    function_ref<APInt(const APInt &, const APInt &)> calculate,
+    int32_t operandWidth = -1) {
+  auto lhs = operands[0].dyn_cast_or_null<IntegerAttr>();
+  auto rhs = operands[1].dyn_cast_or_null<IntegerAttr>();
+  if (!lhs || !rhs)
+    return {};
+
+  auto lhsType = op->getOperand(0).getType();
+  auto rhsType = op->getOperand(1).getType();
+  auto resultWidth = getKnownWidth(op->getResult(0).getType());
+  if (getKnownWidth(lhsType) == -1 || getKnownWidth(rhsType) == -1 ||
+      resultWidth == -1)
+    return {};
+
+  if (operandWidth == -1)
+    operandWidth = resultWidth;
+  auto result = calculate(getExtendedConstant(lhs, lhsType, operandWidth),
+                          getExtendedConstant(rhs, rhsType, operandWidth));
+  return getIntAttr(result.zextOrTrunc(resultWidth), op->getContext());
+}
+
+/// Constant fold a comparison whose operands are both constants, comparing
+/// them at the width of the wider operand.
+static OpFoldResult
+constFoldFIRRTLCompareOp(Operation *op, ArrayRef<Attribute> operands,
+                         function_ref<bool(const APInt &, const APInt &)> pred) {
+  auto width = std::max(getKnownWidth(op->getOperand(0).getType()),
+                        getKnownWidth(op->getOperand(1).getType()));
+  return constFoldFIRRTLBinaryOp(
+      op, operands,
+      [&](const APInt &a, const APInt &b) { return APInt(1, pred(a, b)); },
+      width);
+}
+
+/// Return the constant `value` as an attribute of the width of `type`, or
+/// null if that width is unknown.
+static Attribute getIntAttrOfWidth(uint64_t value, Type type) {
+  auto width = getKnownWidth(type);
+  if (width == -1)
+    return {};
+  return getIntAttr(APInt(width, value), type.getContext());
+}
+
 //===----------------------------------------------------------------------===//
 // Fold Hooks
 //===----------------------------------------------------------------------===//
@@ -80,6 +144,33 @@ OpFoldResult DivPrimOp::fold(ArrayRef<Attribute> operands) {
   return {};
 }
 
+OpFoldResult AddPrimOp::fold(ArrayRef<Attribute> operands) {
+  return constFoldFIRRTLBinaryOp(
+      *this, operands, [](const APInt &a, const APInt &b) { return a + b; });
+}
+
+OpFoldResult SubPrimOp::fold(ArrayRef<Attribute> operands) {
+  /// sub(x, x) -> 0
+  if (lhs() == rhs())
+    if (auto attr = getIntAttrOfWidth(0, getType()))
+      return attr;
+
+  return constFoldFIRRTLBinaryOp(
+      *this, operands, [](const APInt &a, const APInt &b) { return a - b; });
+}
+
+OpFoldResult MulPrimOp::fold(ArrayRef<Attribute> operands) {
+  APInt value;
+
+  /// mul(x, 0) -> 0
+  if (matchPattern(rhs(), m_FConstant(value)) && value.isNullValue())
+    if (auto attr = getIntAttrOfWidth(0, getType()))
+      return attr;
+
+  return constFoldFIRRTLBinaryOp(
+      *this, operands, [](const APInt &a, const APInt &b) { return a * b; });
+}
+
 // TODO: Move to DRR.
 OpFoldResult AndPrimOp::fold(ArrayRef<Attribute> operands) {
   APInt value;
@@ -145,6 +236,10 @@ OpFoldResult XorPrimOp::fold(ArrayRef<Attribute> operands) {
 OpFoldResult EQPrimOp::fold(ArrayRef<Attribute> operands) {
   APInt value;
 
+  /// eq(x, x) -> 1
+  if (lhs() == rhs())
+    return getIntAttr(APInt(1, 1), getContext());
+
   if (matchPattern(rhs(), m_FConstant(value))) {
     APInt lhsCst;
     // Constant fold.
@@ -170,6 +265,10 @@ OpFoldResult EQPrimOp::fold(ArrayRef<Attribute> operands) {
 OpFoldResult NEQPrimOp::fold(ArrayRef<Attribute> operands) {
   APInt value;
 
+  /// neq(x, x) -> 0
+  if (lhs() == rhs())
+    return getIntAttr(APInt(1, 0), getContext());
+
   if (matchPattern(rhs(), m_FConstant(value))) {
     APInt lhsCst;
     // Constant fold.
@@ -192,6 +291,123 @@ OpFoldResult NEQPrimOp::fold(ArrayRef<Attribute> operands) {
   return {};
 }
 
+OpFoldResult LEQPrimOp::fold(ArrayRef<Attribute> operands) {
+  bool isSigned = lhs().getType().cast<IntType>().isSigned();
+  APInt value;
+
+  /// leq(x, x) -> 1
+  if (lhs() == rhs())
+    return getIntAttr(APInt(1, 1), getContext());
+
+  /// leq(0, x) -> 1 when x is unsigned
+  if (!isSigned && matchPattern(lhs(), m_FConstant(value)) &&
+      value.isNullValue())
+    return getIntAttr(APInt(1, 1), getContext());
+
+  return constFoldFIRRTLCompareOp(
+      *this, operands, [=](const APInt &a, const APInt &b) {
+        return isSigned ? a.sle(b) : a.ule(b);
+      });
+}
+
+OpFoldResult LTPrimOp::fold(ArrayRef<Attribute> operands) {
+  bool isSigned = lhs().getType().cast<IntType>().isSigned();
+  APInt value;
+
+  /// lt(x, x) -> 0
+  if (lhs() == rhs())
+    return getIntAttr(APInt(1, 0), getContext());
+
+  /// lt(x, 0) -> 0 when x is unsigned
+  if (!isSigned && matchPattern(rhs(), m_FConstant(value)) &&
+      value.isNullValue())
+    return getIntAttr(APInt(1, 0), getContext());
+
+  return constFoldFIRRTLCompareOp(
+      *this, operands, [=](const APInt &a, const APInt &b) {
+        return isSigned ? a.slt(b) : a.ult(b);
+      });
+}
+
+OpFoldResult GEQPrimOp::fold(ArrayRef<Attribute> operands) {
+  bool isSigned = lhs().getType().cast<IntType>().isSigned();
+  APInt value;
+
+  /// geq(x, x) -> 1
+  if (lhs() == rhs())
+    return getIntAttr(APInt(1, 1), getContext());
+
+  /// geq(x, 0) -> 1 when x is unsigned
+  if (!isSigned && matchPattern(rhs(), m_FConstant(value)) &&
+      value.isNullValue())
+    return getIntAttr(APInt(1, 1), getContext());
+
+  return constFoldFIRRTLCompareOp(
+      *this, operands, [=](const APInt &a, const APInt &b) {
+        return isSigned ? a.sge(b) : a.uge(b);
+      });
+}
+
+OpFoldResult GTPrimOp::fold(ArrayRef<Attribute> operands) {
+  bool isSigned = lhs().getType().cast<IntType>().isSigned();
+  APInt value;
+
+  /// gt(x, x) -> 0
+  if (lhs() == rhs())
+    return getIntAttr(APInt(1, 0), getContext());
+
+  /// gt(0, x) -> 0 when x is unsigned
+  if (!isSigned && matchPattern(lhs(), m_FConstant(value)) &&
+      value.isNullValue())
+    return getIntAttr(APInt(1, 0), getContext());
+
+  return constFoldFIRRTLCompareOp(
+      *this, operands, [=](const APInt &a, const APInt &b) {
+        return isSigned ? a.sgt(b) : a.ugt(b);
+      });
+}
+
+OpFoldResult DShlPrimOp::fold(ArrayRef<Attribute> operands) {
+  APInt value;
+
+  /// dshl(x, 0) -> x
+  if (matchPattern(rhs(), m_FConstant(value)) && value.isNullValue() &&
+      lhs().getType() == getType())
+    return lhs();
+
+  // Constant fold.  The shift amount is not extended, so take it as is.
+  auto amount = operands[1].dyn_cast_or_null<IntegerAttr>();
+  auto resultWidth = getKnownWidth(getType());
+  if (!amount || resultWidth == -1)
+    return {};
+  return constFoldFIRRTLBinaryOp(
+      *this, operands, [&](const APInt &a, const APInt &) {
+        return a.shl(amount.getValue().getLimitedValue(resultWidth));
+      });
+}
+
+OpFoldResult DShrPrimOp::fold(ArrayRef<Attribute> operands) {
+  APInt value;
+
+  /// dshr(x, 0) -> x
+  if (matchPattern(rhs(), m_FConstant(value)) && value.isNullValue() &&
+      lhs().getType() == getType())
+    return lhs();
+
+  // Constant fold.  The shift amount may be wider than the result, so take it
+  // as is.
+  auto amount = operands[1].dyn_cast_or_null<IntegerAttr>();
+  auto resultWidth = getKnownWidth(getType());
+  if (!amount || resultWidth == -1)
+    return {};
+  bool isSigned = getType().cast<IntType>().isSigned();
+  return constFoldFIRRTLBinaryOp(
+      *this, operands, [&](const APInt &a, const APInt &) {
+        auto shift = amount.getValue().getLimitedValue(resultWidth);
+        return isSigned ? a.ashr(shift) : a.lshr(shift);
+      });
+}
+
 //===----------------------------------------------------------------------===//
 // Unary Operators
 //===----------------------------------------------------------------------===//
@@ -208,6 +424,76 @@ OpFoldResult AsUIntPrimOp::fold(ArrayRef<Attribute> operands) {
   return {};
 }
 
+OpFoldResult CvtPrimOp::fold(ArrayRef<Attribute> operands) {
+  /// cvt(x) -> x when x is signed
+  if (input().getType() == getType())
+    return input();
+
+  // Constant fold, the input is unsigned and gains a zero sign bit.
+  auto attr = operands[0].dyn_cast_or_null<IntegerAttr>();
+  auto resultWidth = getKnownWidth(getType());
+  if (attr && resultWidth != -1 && getKnownWidth(input().getType()) != -1)
+    return getIntAttr(attr.getValue().zext(resultWidth), getContext());
+  return {};
+}
+
+OpFoldResult NegPrimOp::fold(ArrayRef<Attribute> operands) {
+  auto attr = operands[0].dyn_cast_or_null<IntegerAttr>();
+  auto resultWidth = getKnownWidth(getType());
+  if (!attr || resultWidth == -1 || getKnownWidth(input().getType()) == -1)
+    return {};
+  auto value = getExtendedConstant(attr, input().getType(), resultWidth);
+  return getIntAttr(-value, getContext());
+}
+
+OpFoldResult NotPrimOp::fold(ArrayRef<Attribute> operands) {
+  /// not(not(x)) -> x
+  if (auto inner = dyn_cast_or_null<NotPrimOp>(input().getDefiningOp()))
+    if (inner.input().getType() == getType())
+      return inner.input();
+
+  auto attr = operands[0].dyn_cast_or_null<IntegerAttr>();
+  if (attr && getKnownWidth(input().getType()) != -1)
+    return getIntAttr(~attr.getValue(), getContext());
+  return {};
+}
+
+OpFoldResult AndRPrimOp::fold(ArrayRef<Attribute> operands) {
+  /// andr(x) -> 1 when x is zero bits wide
+  if (input().getType().cast<IntType>().getWidthOrSentinel() == 0)
+    return getIntAttr(APInt(1, 1), getContext());
+
+  // Constant fold, which needs the width to know how many bits to reduce.
+  auto attr = operands[0].dyn_cast_or_null<IntegerAttr>();
+  if (attr && getKnownWidth(input().getType()) != -1)
+    return getIntAttr(APInt(1, attr.getValue().isAllOnesValue()),
+                      getContext());
+  return {};
+}
+
+OpFoldResult OrRPrimOp::fold(ArrayRef<Attribute> operands) {
+  /// orr(x) -> 0 when x is zero bits wide
+  if (input().getType().cast<IntType>().getWidthOrSentinel() == 0)
+    return getIntAttr(APInt(1, 0), getContext());
+
+  auto attr = operands[0].dyn_cast_or_null<IntegerAttr>();
+  if (attr && getKnownWidth(input().getType()) != -1)
+    return getIntAttr(APInt(1, !attr.getValue().isNullValue()), getContext());
+  return {};
+}
+
+OpFoldResult XorRPrimOp::fold(ArrayRef<Attribute> operands) {
+  /// xorr(x) -> 0 when x is zero bits wide
+  if (input().getType().cast<IntType>().getWidthOrSentinel() == 0)
+    return getIntAttr(APInt(1, 0), getContext());
+
+  auto attr = operands[0].dyn_cast_or_null<IntegerAttr>();
+  if (attr && getKnownWidth(input().getType()) != -1)
+    return getIntAttr(APInt(1, attr.getValue().countPopulation() & 1),
+                      getContext());
+  return {};
+}
+
 //===----------------------------------------------------------------------===//
 // Other Operators
 //===----------------------------------------------------------------------===//
@@ -520,6 +806,15 @@ OpFoldResult AnalogInOutCastOp::fold(ArrayRef<Attribute> operands) {
   return {};
 }
 
+OpFoldResult VectorArrayCastOp::fold(ArrayRef<Attribute> operands) {
+  if (auto castInput =
+          dyn_cast_or_null<VectorArrayCastOp>(getOperand().getDefiningOp()))
+    if (castInput.getOperand().getType() == getType())
+      return castInput.getOperand();
+
+  return {};
+}
+
 OpFoldResult AsPassivePrimOp::fold(ArrayRef<Attribute> operands) {
   // If the input is already passive, then we don't need a conversion.
   if (getOperand().getType() == getType())
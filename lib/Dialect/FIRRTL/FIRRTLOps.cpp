@@ -1504,6 +1504,47 @@ static LogicalResult verifyAnalogInOutCastOp(AnalogInOutCastOp cast) {
   return success();
 }
 
+/// Return true if the passive FIRRTL type `firType` and the RTL type `rtlType`
+/// have the same shape, i.e. nested vectors and arrays of the same sizes with
+/// ground elements of the same width.
+static bool isVectorArrayCastCompatible(FIRRTLType firType, Type rtlType) {
+  if (auto vectorType = firType.dyn_cast<FVectorType>()) {
+    auto arrayType = rtlType.dyn_cast<rtl::ArrayType>();
+    return arrayType && arrayType.getSize() == vectorType.getNumElements() &&
+           isVectorArrayCastCompatible(vectorType.getElementType(),
+                                       arrayType.getElementType());
+  }
+
+  auto integerType = rtlType.dyn_cast<IntegerType>();
+  int32_t width = firType.getBitWidthOrSentinel();
+  return integerType && integerType.isSignless() && width > 0 &&
+         unsigned(width) == integerType.getWidth();
+}
+
+static LogicalResult verifyVectorArrayCastOp(VectorArrayCastOp cast) {
+  FVectorType vectorType;
+  rtl::ArrayType arrayType;
+
+  if ((vectorType = cast.getOperand().getType().dyn_cast<FVectorType>())) {
+    arrayType = cast.getType().dyn_cast<rtl::ArrayType>();
+    if (!arrayType)
+      return cast.emitError("result type must be an array type");
+  } else if ((vectorType = cast.getType().dyn_cast<FVectorType>())) {
+    arrayType = cast.getOperand().getType().dyn_cast<rtl::ArrayType>();
+    if (!arrayType)
+      return cast.emitError("operand type must be an array type");
+  } else {
+    return cast.emitError("either source or result type must be vector type");
+  }
+
+  if (!vectorType.isPassive())
+    return cast.emitError("vector type must be passive");
+  if (!isVectorArrayCastCompatible(vectorType, arrayType))
+    return cast.emitError("vector and array type must have the same shape");
+
+  return success();
+}
+
 void AsPassivePrimOp::build(OpBuilder &builder, OperationState &result,
                             Value input) {
   result.addOperands(input);
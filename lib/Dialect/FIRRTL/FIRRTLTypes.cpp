@@ -267,17 +267,8 @@ FIRRTLType FIRRTLType::getWidthlessType() {
       })
       .Case<UIntType, SIntType, AnalogType>(
           [&](auto a) { return a.get(getContext(), -1); })
-      .Case<BundleType>([&](auto a) {
-        SmallVector<BundleType::BundleElement, 4> newElements;
-        newElements.reserve(a.getElements().size());
-        for (auto elt : a.getElements())
-          newElements.push_back({elt.name, elt.type.getWidthlessType()});
-        return BundleType::get(newElements, getContext());
-      })
-      .Case<FVectorType>([](auto a) {
-        return FVectorType::get(a.getElementType().getWidthlessType(),
-                                a.getNumElements());
-      })
+      .Case<BundleType>([](BundleType a) { return a.getWidthlessType(); })
+      .Case<FVectorType>([](FVectorType a) { return a.getWidthlessType(); })
       .Default([](auto) {
         llvm_unreachable("unknown FIRRTL type");
         return FIRRTLType();
@@ -312,25 +303,16 @@ bool FIRRTLType::isResetType() {
       .Default([](Type) { return false; });
 }
 
-/// Helper to implement the equivalence logic for a pair of bundle elements.
-/// Note that the FIRRTL spec requires bundle elements to have the same
-/// orientation, but this only compares their passive types. The FIRRTL dialect
-/// differs from the spec in how it uses flip types for module output ports and
-/// canonicalizes flips in bundles, so only passive types can be compared here.
-static bool areBundleElementsEquivalent(BundleType::BundleElement destElement,
-                                        BundleType::BundleElement srcElement) {
-  if (destElement.name != srcElement.name)
-    return false;
-
-  return areTypesEquivalent(destElement.type, srcElement.type);
-}
-
 /// Returns whether the two types are equivalent. See the FIRRTL spec for the
 /// full definition of type equivalence. This predicate differs from the spec in
 /// that it only compares passive types. Because of how the FIRRTL dialect uses
 /// flip types in module ports and aggregates, this definition, unlike the spec,
 /// ignores flips.
 bool firrtl::areTypesEquivalent(FIRRTLType destType, FIRRTLType srcType) {
+  // Types are uniqued, so identical types need no structural walk.
+  if (destType == srcType)
+    return true;
+
   // Ensure we are comparing passive types.
   if (!destType.isPassive())
     destType = destType.getPassiveType();
@@ -353,27 +335,16 @@ bool firrtl::areTypesEquivalent(FIRRTLType destType, FIRRTLType srcType) {
            areTypesEquivalent(destVectorType.getElementType(),
                               srcVectorType.getElementType());
 
-  // Bundle types can be connected if they have the same size, element names,
-  // and element types.
-  auto destBundleType = destType.dyn_cast<BundleType>();
-  auto srcBundleType = srcType.dyn_cast<BundleType>();
-  if (destBundleType && srcBundleType) {
-    auto destElements = destBundleType.getElements();
-    auto srcElements = srcBundleType.getElements();
-    size_t numDestElements = destElements.size();
-    if (numDestElements != srcElements.size())
-      return false;
-
-    for (size_t i = 0; i < numDestElements; ++i) {
-      auto destElement = destElements[i];
-      auto srcElement = srcElements[i];
-      if (!areBundleElementsEquivalent(destElement, srcElement))
-        return false;
-    }
-  }
-
-  // Ground types can be connected if their passive, widthless versions
-  // are equal.
+  // Bundle types can be connected if they have the same element names and
+  // element types, ignoring widths.  Ground types can be connected if their
+  // widthless versions are equal.  Both are a comparison of the passive,
+  // widthless types, which are cached for aggregates.
+  //
+  // Note that the FIRRTL spec requires bundle elements to have the same
+  // orientation, but this only compares their passive types. The FIRRTL
+  // dialect differs from the spec in how it uses flip types for module output
+  // ports and canonicalizes flips in bundles, so only passive types can be
+  // compared here.
   return destType.getWidthlessType() == srcType.getWidthlessType();
 }
 
@@ -621,6 +592,9 @@ struct BundleTypeStorage : mlir::TypeStorage {
   /// if it contains an analog type, and can hold a pointer to a passive type if
   /// not.
   llvm::PointerIntPair<Type, 2, unsigned> passiveContainsAnalogTypeInfo;
+
+  /// The widthless version of this type, computed on first use.
+  FIRRTLType widthlessType;
 };
 
 } // namespace detail
@@ -678,6 +652,22 @@ FIRRTLType BundleType::getPassiveType() {
   return passiveType;
 }
 
+/// Return this type with widths of all ground types removed.
+FIRRTLType BundleType::getWidthlessType() {
+  auto *impl = getImpl();
+  if (impl->widthlessType)
+    return impl->widthlessType;
+
+  SmallVector<BundleType::BundleElement, 16> newElements;
+  newElements.reserve(impl->elements.size());
+  for (auto &elt : impl->elements)
+    newElements.push_back({elt.name, elt.type.getWidthlessType()});
+
+  auto widthlessType = BundleType::get(newElements, getContext());
+  impl->widthlessType = widthlessType;
+  return widthlessType;
+}
+
 /// Look up an element by name.  This returns a BundleElement with.
 auto BundleType::getElement(StringRef name) -> Optional<BundleElement> {
   for (const auto &element : getElements()) {
@@ -725,6 +715,9 @@ struct VectorTypeStorage : mlir::TypeStorage {
   /// if it contains an analog type, and can hold a pointer to a passive type if
   /// not.
   llvm::PointerIntPair<Type, 2, unsigned> passiveContainsAnalogTypeInfo;
+
+  /// The widthless version of this type, computed on first use.
+  FIRRTLType widthlessType;
 };
 
 } // namespace detail
@@ -771,3 +764,25 @@ FIRRTLType FVectorType::getPassiveType() {
   impl->passiveContainsAnalogTypeInfo.setPointer(passiveType);
   return passiveType;
 }
+
+/// Return this type with widths of all ground types removed.
+FIRRTLType FVectorType::getWidthlessType() {
+  auto *impl = getImpl();
+  if (impl->widthlessType)
+    return impl->widthlessType;
+
+  auto widthlessType =
+      FVectorType::get(getElementType().getWidthlessType(), getNumElements());
+  impl->widthlessType = widthlessType;
+  return widthlessType;
+}
+
+//===----------------------------------------------------------------------===//
+// Bundle Flattening
+//===----------------------------------------------------------------------===//
+
+ArrayRef<FlatBundleFieldEntry>
+circt::firrtl::getFlatBundleFields(FIRRTLType type) {
+  auto *dialect = static_cast<FIRRTLDialect *>(&type.getDialect());
+  return dialect->getFlatBundleFields(type);
+}
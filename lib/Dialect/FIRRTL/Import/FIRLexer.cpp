@@ -13,9 +13,14 @@
 #include "FIRLexer.h"
 #include "mlir/IR/Diagnostics.h"
 #include "llvm/ADT/StringExtras.h"
-#include "llvm/ADT/StringSwitch.h"
 #include "llvm/Support/SourceMgr.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 using namespace circt;
 using namespace firrtl;
 using namespace mlir;
@@ -26,6 +31,193 @@ using llvm::SourceMgr;
 #define isdigit(x) DO_NOT_USE_SLOW_CTYPE_FUNCTIONS
 #define isalpha(x) DO_NOT_USE_SLOW_CTYPE_FUNCTIONS
 
+//===----------------------------------------------------------------------===//
+// Character Scanning
+//===----------------------------------------------------------------------===//
+
+namespace {
+/// The classes of characters the lexer scans over, as a bit mask.
+enum CharClass : uint8_t {
+  /// [a-zA-Z0-9_$-]
+  CC_IdChar = 1,
+  /// ' ', '\t' and ','
+  CC_HorizontalWS = 2,
+  /// '\n', '\r', '\v' and '\f'
+  CC_VerticalWS = 4,
+};
+
+/// A table mapping every character to its CharClass.
+struct CharClassTable {
+  constexpr CharClassTable() : classes() {
+    for (unsigned c = 'a'; c <= 'z'; ++c)
+      classes[c] = classes[c - 'a' + 'A'] = CC_IdChar;
+    for (unsigned c = '0'; c <= '9'; ++c)
+      classes[c] = CC_IdChar;
+    classes[unsigned('_')] = classes[unsigned('$')] = classes[unsigned('-')] =
+        CC_IdChar;
+    classes[unsigned(' ')] = classes[unsigned('\t')] = classes[unsigned(',')] =
+        CC_HorizontalWS;
+    classes[unsigned('\n')] = classes[unsigned('\r')] =
+        classes[unsigned('\v')] = classes[unsigned('\f')] = CC_VerticalWS;
+  }
+  uint8_t classes[256];
+};
+} // end anonymous namespace
+
+static constexpr CharClassTable charClasses;
+
+static bool hasCharClass(char c, CharClass cc) {
+  return charClasses.classes[(unsigned char)c] & cc;
+}
+
+/// The number of bytes scanned at once by the vectorized helpers below.  The
+/// vector loops only look at whole blocks before 'end', and leave finding the
+/// exact position of the character they stop at to the scalar code.
+static constexpr unsigned blockSize = 16;
+
+#if defined(__SSE2__)
+using Block = __m128i;
+static Block loadBlock(const char *ptr) {
+  return _mm_loadu_si128((const __m128i *)ptr);
+}
+static Block splat(char c) { return _mm_set1_epi8(c); }
+static Block matchChar(Block b, char c) { return _mm_cmpeq_epi8(b, splat(c)); }
+static Block matchAny(Block a, Block b) { return _mm_or_si128(a, b); }
+/// Match the characters in [lo, lo+count).
+static Block matchRange(Block b, char lo, unsigned char count) {
+  // SSE2 only has signed compares, so bias the unsigned difference.
+  auto diff = _mm_xor_si128(_mm_sub_epi8(b, splat(lo)), splat(char(0x80)));
+  return _mm_cmplt_epi8(diff, splat(char(count ^ 0x80)));
+}
+static bool allMatch(Block b) { return _mm_movemask_epi8(b) == 0xFFFF; }
+static bool noneMatch(Block b) { return _mm_movemask_epi8(b) == 0; }
+#define FIRLEXER_HAS_BLOCKS 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+using Block = uint8x16_t;
+static Block loadBlock(const char *ptr) {
+  return vld1q_u8((const uint8_t *)ptr);
+}
+static Block matchChar(Block b, char c) {
+  return vceqq_u8(b, vdupq_n_u8((uint8_t)c));
+}
+static Block matchAny(Block a, Block b) { return vorrq_u8(a, b); }
+/// Match the characters in [lo, lo+count).
+static Block matchRange(Block b, char lo, unsigned char count) {
+  return vcltq_u8(vsubq_u8(b, vdupq_n_u8((uint8_t)lo)), vdupq_n_u8(count));
+}
+static bool allMatch(Block b) { return vminvq_u8(b) == 0xFF; }
+static bool noneMatch(Block b) { return vmaxvq_u8(b) == 0; }
+#define FIRLEXER_HAS_BLOCKS 1
+#endif
+
+/// Return the first character at or after 'ptr' that can't be part of an
+/// identifier.
+static const char *skipIdChars(const char *ptr, const char *end) {
+#ifdef FIRLEXER_HAS_BLOCKS
+  for (; ptr + blockSize <= end; ptr += blockSize) {
+    Block b = loadBlock(ptr);
+    Block isId = matchAny(
+        matchAny(matchRange(b, 'a', 26), matchRange(b, 'A', 26)),
+        matchAny(matchAny(matchRange(b, '0', 10), matchChar(b, '_')),
+                 matchAny(matchChar(b, '$'), matchChar(b, '-'))));
+    if (!allMatch(isId))
+      break;
+  }
+#endif
+  while (hasCharClass(*ptr, CC_IdChar))
+    ++ptr;
+  return ptr;
+}
+
+/// Return the first character at or after 'ptr' that isn't a space.
+static const char *skipSpaces(const char *ptr, const char *end) {
+#ifdef FIRLEXER_HAS_BLOCKS
+  for (; ptr + blockSize <= end; ptr += blockSize)
+    if (!allMatch(matchChar(loadBlock(ptr), ' ')))
+      break;
+#endif
+  while (*ptr == ' ')
+    ++ptr;
+  return ptr;
+}
+
+#ifdef FIRLEXER_HAS_BLOCKS
+static Block matchChars(Block b, char c) { return matchChar(b, c); }
+template <typename... Chars>
+static Block matchChars(Block b, char c, Chars... rest) {
+  return matchAny(matchChar(b, c), matchChars(b, rest...));
+}
+#endif
+
+static bool isAnyOf(char c, char c1) { return c == c1; }
+template <typename... Chars>
+static bool isAnyOf(char c, char c1, Chars... rest) {
+  return c == c1 || isAnyOf(c, rest...);
+}
+
+/// Return the first character at or after 'ptr' that is one of 'chars'.  One
+/// of them has to be the nul character which terminates the buffer.
+template <typename... Chars>
+static const char *findFirstOf(const char *ptr, const char *end,
+                               Chars... chars) {
+#ifdef FIRLEXER_HAS_BLOCKS
+  for (; ptr + blockSize <= end; ptr += blockSize)
+    if (!noneMatch(matchChars(loadBlock(ptr), chars...)))
+      break;
+#endif
+  while (!isAnyOf(*ptr, chars...))
+    ++ptr;
+  return ptr;
+}
+
+namespace {
+/// A hash table from the spelling of keywords to their token kind.  The hash
+/// only looks at the length and three of the characters of a spelling, which
+/// spreads the keywords well enough that looking up an identifier is a few
+/// byte loads and nearly always at most one string compare.
+class KeywordTable {
+public:
+  using Entry = std::pair<StringRef, FIRToken::Kind>;
+
+  explicit KeywordTable(ArrayRef<Entry> keywords) {
+    assert(keywords.size() < tableSize / 2 && "keyword table too small");
+    for (auto &keyword : keywords) {
+      maxLength = std::max(maxLength, keyword.first.size());
+      unsigned slot = hash(keyword.first);
+      while (!entries[slot].first.empty())
+        slot = (slot + 1) % tableSize;
+      entries[slot] = keyword;
+    }
+  }
+
+  /// Return the kind of the keyword 'spelling', or FIRToken::identifier if it
+  /// isn't a keyword.
+  FIRToken::Kind lookup(StringRef spelling) const {
+    if (spelling.size() > maxLength)
+      return FIRToken::identifier;
+    for (unsigned slot = hash(spelling); !entries[slot].first.empty();
+         slot = (slot + 1) % tableSize)
+      if (entries[slot].first == spelling)
+        return entries[slot].second;
+    return FIRToken::identifier;
+  }
+
+private:
+  static constexpr unsigned tableSize = 512;
+
+  static unsigned hash(StringRef spelling) {
+    assert(!spelling.empty() && "identifiers are never empty");
+    return (spelling.size() * 97 + (unsigned char)spelling.front() * 31 +
+            (unsigned char)spelling[spelling.size() / 2] * 7 +
+            (unsigned char)spelling.back()) %
+           tableSize;
+  }
+
+  Entry entries[tableSize];
+  size_t maxLength = 0;
+};
+} // end anonymous namespace
+
 //===----------------------------------------------------------------------===//
 // FIRToken
 //===----------------------------------------------------------------------===//
@@ -134,25 +326,75 @@ Optional<unsigned> FIRLexer::getIndentation(const FIRToken &tok) const {
   // Count the number of horizontal whitespace characters before the token.
   auto *bufStart = curBuffer.begin();
 
-  auto isHorizontalWS = [](char c) -> bool {
-    return c == ' ' || c == '\t' || c == ',';
-  };
-  auto isVerticalWS = [](char c) -> bool {
-    return c == '\n' || c == '\r' || c == '\f' || c == '\v';
-  };
-
   unsigned indent = 0;
   const auto *ptr = (const char *)tok.getSpelling().data();
-  while (ptr != bufStart && isHorizontalWS(ptr[-1]))
+  while (ptr != bufStart && hasCharClass(ptr[-1], CC_HorizontalWS))
     --ptr, ++indent;
 
   // If the character we stopped at isn't the start of line, then return none.
-  if (ptr != bufStart && !isVerticalWS(ptr[-1]))
+  if (ptr != bufStart && !hasCharClass(ptr[-1], CC_VerticalWS))
     return None;
 
   return indent;
 }
 
+/// Return the spelling of the file info specifier at the end of the statement
+/// on the current line, or an empty string if there is none.  This only scans
+/// the characters of the line, skipping over string literals and comments, and
+/// doesn't move the lexer.  If `stopAtColon` is set, only a specifier directly
+/// following the first ':' on the line is considered, which is where a 'when'
+/// puts it before a statement on the same line.
+StringRef FIRLexer::peekFileInfo(bool stopAtColon) const {
+  const char *ptr = curPtr;
+  while (true) {
+    ptr = findFirstOf(ptr, curBuffer.end(), '@', '"', ':', ';', '\0', '\n',
+                      '\v', '\f');
+    switch (*ptr++) {
+    case '"':
+      // Skip over string literals, which may contain anything.
+      while (true) {
+        ptr = findFirstOf(ptr, curBuffer.end(), '"', '\\', '\0', '\n', '\v',
+                          '\f');
+        if (*ptr == '\\') {
+          ptr += ptr[1] == '"' ? 2 : 1;
+          continue;
+        }
+        if (*ptr != '"')
+          return {};
+        ++ptr;
+        break;
+      }
+      break;
+    case ':':
+      if (!stopAtColon)
+        break;
+      ptr = skipSpaces(ptr, curBuffer.end());
+      if (*ptr != '@')
+        return {};
+      break;
+    case '@': {
+      if (*ptr != '[')
+        return {};
+      const char *tokStart = ptr - 1;
+      while (true) {
+        ptr = findFirstOf(ptr, curBuffer.end(), ']', '\\', '\0', '\n', '\v',
+                          '\f');
+        if (*ptr == '\\') {
+          ptr += ptr[1] == ']' ? 2 : 1;
+          continue;
+        }
+        if (*ptr != ']')
+          return {};
+        return StringRef(tokStart, ptr + 1 - tokStart);
+      }
+    }
+    default:
+      // Comments, the end of the line, and the end of the buffer.
+      return {};
+    }
+  }
+}
+
 //===----------------------------------------------------------------------===//
 // Lexer Implementation Methods
 //===----------------------------------------------------------------------===//
@@ -182,7 +424,9 @@ FIRToken FIRLexer::lexToken() {
     case '\n':
     case '\r':
     case ',':
-      // Handle whitespace.
+      // Handle whitespace.  Skip over runs of spaces, like indentation, at
+      // once.
+      curPtr = skipSpaces(curPtr, curBuffer.end());
       continue;
 
     case '_':
@@ -255,6 +499,8 @@ FIRToken FIRLexer::lexToken() {
 ///
 FIRToken FIRLexer::lexFileInfo(const char *tokStart) {
   while (1) {
+    curPtr = findFirstOf(curPtr, curBuffer.end(), ']', '\\', '\0', '\n', '\v',
+                         '\f');
     switch (*curPtr++) {
     case ']': // This is the end of the fileinfo literal.
       return formToken(FIRToken::fileinfo, tokStart);
@@ -289,19 +535,19 @@ FIRToken FIRLexer::lexFileInfo(const char *tokStart) {
 ///
 FIRToken FIRLexer::lexIdentifierOrKeyword(const char *tokStart) {
   // Match the rest of the identifier regex: [0-9a-zA-Z_$-]*
-  while (llvm::isAlpha(*curPtr) || llvm::isDigit(*curPtr) || *curPtr == '_' ||
-         *curPtr == '$' || *curPtr == '-')
-    ++curPtr;
+  curPtr = skipIdChars(curPtr, curBuffer.end());
 
   StringRef spelling(tokStart, curPtr - tokStart);
 
   // Check to see if this is a 'primop', which is an identifier juxtaposed with
   // a '(' character.
   if (*curPtr == '(') {
-    FIRToken::Kind kind = llvm::StringSwitch<FIRToken::Kind>(spelling)
-#define TOK_LPKEYWORD(SPELLING) .Case(#SPELLING, FIRToken::lp_##SPELLING)
+    static const std::pair<StringRef, FIRToken::Kind> lpKeywords[] = {
+#define TOK_LPKEYWORD(SPELLING) {#SPELLING, FIRToken::lp_##SPELLING},
 #include "FIRTokenKinds.def"
-                              .Default(FIRToken::identifier);
+    };
+    static const KeywordTable lpKeywordTable(lpKeywords);
+    FIRToken::Kind kind = lpKeywordTable.lookup(spelling);
     if (kind != FIRToken::identifier) {
       ++curPtr;
       return formToken(kind, tokStart);
@@ -309,17 +555,18 @@ FIRToken FIRLexer::lexIdentifierOrKeyword(const char *tokStart) {
   }
 
   // Check to see if this identifier is a keyword.
-  FIRToken::Kind kind = llvm::StringSwitch<FIRToken::Kind>(spelling)
-#define TOK_KEYWORD(SPELLING) .Case(#SPELLING, FIRToken::kw_##SPELLING)
+  static const std::pair<StringRef, FIRToken::Kind> keywords[] = {
+#define TOK_KEYWORD(SPELLING) {#SPELLING, FIRToken::kw_##SPELLING},
 #include "FIRTokenKinds.def"
-                            .Default(FIRToken::identifier);
-
-  return FIRToken(kind, spelling);
+  };
+  static const KeywordTable keywordTable(keywords);
+  return FIRToken(keywordTable.lookup(spelling), spelling);
 }
 
 /// Skip a comment line, starting with a ';' and going to end of line.
 void FIRLexer::skipComment() {
   while (true) {
+    curPtr = findFirstOf(curPtr, curBuffer.end(), '\n', '\r', '\0');
     switch (*curPtr++) {
     case '\n':
     case '\r':
@@ -344,6 +591,8 @@ void FIRLexer::skipComment() {
 ///
 FIRToken FIRLexer::lexString(const char *tokStart) {
   while (1) {
+    curPtr = findFirstOf(curPtr, curBuffer.end(), '"', '\\', '\0', '\n', '\v',
+                         '\f');
     switch (*curPtr++) {
     case '"': // This is the end of the string literal.
       return formToken(FIRToken::string, tokStart);
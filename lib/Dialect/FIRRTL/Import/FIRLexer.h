@@ -96,12 +96,20 @@ public:
 
   FIRToken lexToken();
 
+  /// Move the lexer to the specified position in the buffer, which must be the
+  /// start of a token.
+  void resetPointer(const char *newPointer) { curPtr = newPointer; }
+
   mlir::Location translateLocation(llvm::SMLoc loc);
 
   /// Return the indentation level of the specified token or None if this token
   /// is preceded by another token on the same line.
   Optional<unsigned> getIndentation(const FIRToken &tok) const;
 
+  /// Return the spelling of the file info specifier ending the rest of the
+  /// current line, without lexing it.
+  StringRef peekFileInfo(bool stopAtColon = false) const;
+
 private:
   // Helpers.
   FIRToken formToken(FIRToken::Kind kind, const char *tokStart) {
@@ -21,10 +21,14 @@
 #include "mlir/Translation.h"
 #include "llvm/ADT/ScopedHashTable.h"
 #include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/Parallel.h"
 #include "llvm/Support/SourceMgr.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <atomic>
+
 using namespace circt;
 using namespace firrtl;
 using namespace mlir;
@@ -82,6 +86,14 @@ struct GlobalFIRParserState {
   /// This is the next token that hasn't been consumed yet.
   FIRToken curToken;
 
+  /// The modules of the circuit by name, if they were all declared before
+  /// parsing the module bodies. Null if the modules are parsed one by one.
+  const llvm::StringMap<Operation *> *moduleTable = nullptr;
+
+  /// The locations decoded from @info markers, keyed on the spelling of the
+  /// marker.  The same few locators tend to be repeated all over a circuit.
+  llvm::DenseMap<StringRef, LocationAttr> infoLocCache;
+
 private:
   GlobalFIRParserState(const GlobalFIRParserState &) = delete;
   void operator=(const GlobalFIRParserState &) = delete;
@@ -135,10 +147,13 @@ struct FIRParser {
     return state.lex.translateLocation(loc);
   }
 
-  /// Parse an @info marker if present.  If so, apply the symbolic location
-  /// specified it to all of the operations listed in subOps.
-  ParseResult parseOptionalInfo(LocWithInfo &result,
-                                ArrayRef<Operation *> subOps = {});
+  /// Parse an @info marker if present, and set the symbolic location it
+  /// specifies as the location of `result`.
+  ParseResult parseOptionalInfo(LocWithInfo &result);
+
+  /// Decode the symbolic location of the @info marker with the specified
+  /// spelling, returning None if its format is unknown.
+  Optional<Location> decodeInfoLocation(StringRef spelling);
 
   //===--------------------------------------------------------------------===//
   // Token Parsing
@@ -303,32 +318,47 @@ private:
   Optional<Location> infoLoc;
 };
 
-/// Parse an @info marker if present.  If so, apply the symbolic location
-/// specified it to all of the operations listed in subOps.
+/// Parse an @info marker if present, and set the symbolic location it
+/// specifies as the location of `result`.
 ///
 /// info ::= FileInfo
 ///
-ParseResult FIRParser::parseOptionalInfo(LocWithInfo &result,
-                                         ArrayRef<Operation *> subOps) {
+ParseResult FIRParser::parseOptionalInfo(LocWithInfo &result) {
   if (getToken().isNot(FIRToken::fileinfo))
     return success();
 
   auto loc = getToken().getLoc();
+  auto spelling = getTokenSpelling();
+  consumeToken(FIRToken::fileinfo);
 
   // See if we can parse this token into a File/Line/Column record.  If not,
   // just ignore it with a warning.
-  auto unknownFormat = [&]() -> ParseResult {
+  auto infoLoc = decodeInfoLocation(spelling);
+  if (!infoLoc.hasValue()) {
     mlir::emitWarning(translateLocation(loc),
                       "ignoring unknown @ info record format");
     return success();
-  };
+  }
 
-  auto spelling = getTokenSpelling();
-  consumeToken(FIRToken::fileinfo);
+  // If info locators are ignored, don't actually apply them.  We still do all
+  // the verification though.
+  if (!state.options.ignoreInfoLocators)
+    result.setInfoLocation(infoLoc.getValue());
+  return success();
+}
+
+/// Decode the symbolic location of the @info marker with the specified
+/// spelling, returning None if its format is unknown.
+Optional<Location> FIRParser::decodeInfoLocation(StringRef spelling) {
+  // Use the location decoded from this marker if we've seen it before.
+  auto cached = state.infoLocCache.find(spelling);
+  if (cached != state.infoLocCache.end())
+    return Location(cached->second);
+  auto fullSpelling = spelling;
 
   // The spelling of the token looks something like "@[Decoupled.scala 221:8]".
   if (!spelling.startswith("@[") || !spelling.endswith("]"))
-    return unknownFormat();
+    return None;
 
   spelling = spelling.drop_front(2).drop_back(1);
 
@@ -361,12 +391,7 @@ ParseResult FIRParser::parseOptionalInfo(LocWithInfo &result,
   unsigned lineNo = 0, columnNo = 0;
   StringRef filename = decodeLocator(spelling, lineNo, columnNo);
   if (filename.empty())
-    return unknownFormat();
-
-  // If info locators are ignored, don't actually apply them.  We still do all
-  // the verification above though.
-  if (state.options.ignoreInfoLocators)
-    return success();
+    return None;
 
   // Compound locators will be combined with spaces, like:
   //  @[Foo.scala 123:4 Bar.scala 309:14]
@@ -407,14 +432,8 @@ ParseResult FIRParser::parseOptionalInfo(LocWithInfo &result,
     std::reverse(extraLocs.begin(), extraLocs.end());
     resultLoc = FusedLoc::get(extraLocs, getContext());
   }
-  result.setInfoLocation(resultLoc);
-
-  // Now that we have a symbolic location, apply it to any subOps specified.
-  for (auto *op : subOps) {
-    op->setLoc(resultLoc);
-  }
-
-  return success();
+  state.infoLocCache.try_emplace(fullSpelling, resultLoc);
+  return resultLoc;
 }
 
 //===--------------------------------------------------------------------===//
@@ -727,13 +746,16 @@ namespace {
 /// manipulation helpers.
 class FIRScopedParser : public FIRParser {
 public:
+  /// The tables are keyed by the spelling of the names, which lives in the
+  /// source buffer (or the context, for names taken from attributes), so that
+  /// declaring and referring to a name doesn't unique it in the context.
   using SymbolTable =
-      llvm::ScopedHashTable<Identifier, std::pair<SMLoc, Value>,
-                            DenseMapInfo<Identifier>, llvm::BumpPtrAllocator>;
+      llvm::ScopedHashTable<StringRef, std::pair<SMLoc, Value>,
+                            DenseMapInfo<StringRef>, llvm::BumpPtrAllocator>;
   using MemoryScopeTable =
-      llvm::ScopedHashTable<Identifier,
+      llvm::ScopedHashTable<StringRef,
                             std::pair<SymbolTable::ScopeTy *, Operation *>,
-                            DenseMapInfo<Identifier>, llvm::BumpPtrAllocator>;
+                            DenseMapInfo<StringRef>, llvm::BumpPtrAllocator>;
 
   FIRScopedParser(GlobalFIRParserState &state, SymbolTable &symbolTable,
                   MemoryScopeTable &memoryScopeTable)
@@ -766,8 +788,7 @@ ParseResult FIRScopedParser::addSymbolEntry(StringRef name, Value value,
   // TODO(firrtl spec): Should we support name shadowing?  This will reject
   // cases where we try to define a new wire in a conditional where an outer
   // name defined the same name.
-  auto nameId = Identifier::get(name, getContext());
-  auto prev = symbolTable.lookup(nameId);
+  auto prev = symbolTable.lookup(name);
   if (prev.first.isValid()) {
     emitError(loc, "redefinition of name '" + name.str() + "'")
             .attachNote(translateLocation(prev.first))
@@ -775,7 +796,7 @@ ParseResult FIRScopedParser::addSymbolEntry(StringRef name, Value value,
     return failure();
   }
 
-  symbolTable.insert(nameId, {loc, value});
+  symbolTable.insert(name, {loc, value});
   return success();
 }
 
@@ -783,7 +804,7 @@ ParseResult FIRScopedParser::addSymbolEntry(StringRef name, Value value,
 /// name is unknown.
 ParseResult FIRScopedParser::lookupSymbolEntry(Value &result, StringRef name,
                                                SMLoc loc) {
-  auto prev = symbolTable.lookup(Identifier::get(name, getContext()));
+  auto prev = symbolTable.lookup(name);
   if (!prev.first.isValid())
     return emitError(loc, "use of unknown declaration '" + name.str() + "'"),
            failure();
@@ -828,22 +849,32 @@ struct FIRStmtParser : public FIRScopedParser {
   ParseResult parseSimpleStmtBlock(unsigned indent);
 
 private:
-  using SubOpVector = SmallVectorImpl<Operation *>;
+  /// Look ahead for the @info marker of the statement starting at the current
+  /// token.  The marker comes at the end of the statement, but the operations
+  /// created for its subexpressions should have its location.
+  void peekStatementInfo(bool stopAtColon = false);
+
+  /// Return the location of an operation created for a subexpression at `loc`
+  /// of the current statement.
+  Location getExpLocation(SMLoc loc) {
+    if (stmtInfoLoc.hasValue())
+      return stmtInfoLoc.getValue();
+    return translateLocation(loc);
+  }
 
   /// Return the input operand if it has passive type, otherwise convert to
   /// a passive-typed value and return that.
   Value convertToPassive(Value input, Location loc);
 
   // Exp Parsing
-  ParseResult parseExp(Value &result, SubOpVector &subOps,
-                       const Twine &message);
+  ParseResult parseExp(Value &result, const Twine &message);
 
-  ParseResult parseOptionalExpPostscript(Value &result, SubOpVector &subOps);
-  ParseResult parsePostFixFieldId(Value &result, SubOpVector &subOps);
-  ParseResult parsePostFixIntSubscript(Value &result, SubOpVector &subOps);
-  ParseResult parsePostFixDynamicSubscript(Value &result, SubOpVector &subOps);
-  ParseResult parsePrimExp(Value &result, SubOpVector &subOps);
-  ParseResult parseIntegerLiteralExp(Value &result, SubOpVector &subOps);
+  ParseResult parseOptionalExpPostscript(Value &result);
+  ParseResult parsePostFixFieldId(Value &result);
+  ParseResult parsePostFixIntSubscript(Value &result);
+  ParseResult parsePostFixDynamicSubscript(Value &result);
+  ParseResult parsePrimExp(Value &result);
+  ParseResult parseIntegerLiteralExp(Value &result);
 
   Optional<ParseResult> parseExpWithLeadingKeyword(StringRef keyword,
                                                    const LocWithInfo &info);
@@ -858,7 +889,7 @@ private:
   ParseResult parseAssume();
   ParseResult parseCover();
   ParseResult parseWhen(unsigned whenIndent);
-  ParseResult parseLeadingExpStmt(Value lhs, SubOpVector &subOps);
+  ParseResult parseLeadingExpStmt(Value lhs);
 
   // Declarations
   ParseResult parseInstance();
@@ -874,10 +905,27 @@ private:
 
   // Extra information maintained across a module.
   FIRModuleContext &moduleContext;
+
+  /// The location of the @info marker of the statement being parsed, if it was
+  /// found by peekStatementInfo.
+  Optional<Location> stmtInfoLoc;
 };
 
 } // end anonymous namespace
 
+/// Look ahead for the @info marker of the statement starting at the current
+/// token.  Markers which aren't found this way, like the ones of statements
+/// spanning multiple lines, still apply to the statement itself but not to its
+/// subexpressions.
+void FIRStmtParser::peekStatementInfo(bool stopAtColon) {
+  stmtInfoLoc = None;
+  if (getState().options.ignoreInfoLocators)
+    return;
+  auto spelling = getState().lex.peekFileInfo(stopAtColon);
+  if (!spelling.empty())
+    stmtInfoLoc = decodeInfoLocation(spelling);
+}
+
 /// Return the input operand if it has passive type, otherwise convert to
 /// a passive-typed value and return that.
 Value FIRStmtParser::convertToPassive(Value input, Location loc) {
@@ -902,20 +950,19 @@ Value FIRStmtParser::convertToPassive(Value input, Location loc) {
 /// XX   ::= exp '.' DoubleLit // TODO Workaround for #470
 ///      ::= exp '[' exp ']'
 ///
-ParseResult FIRStmtParser::parseExp(Value &result, SubOpVector &subOps,
-                                    const Twine &message) {
+ParseResult FIRStmtParser::parseExp(Value &result, const Twine &message) {
   switch (getToken().getKind()) {
 
     // Handle all the primitive ops: primop exp* intLit*  ')'
 #define TOK_LPKEYWORD(SPELLING) case FIRToken::lp_##SPELLING:
 #include "FIRTokenKinds.def"
-    if (parsePrimExp(result, subOps))
+    if (parsePrimExp(result))
       return failure();
     break;
 
   case FIRToken::kw_UInt:
   case FIRToken::kw_SInt:
-    if (parseIntegerLiteralExp(result, subOps))
+    if (parseIntegerLiteralExp(result))
       return failure();
     break;
 
@@ -931,7 +978,7 @@ ParseResult FIRStmtParser::parseExp(Value &result, SubOpVector &subOps,
   }
   }
 
-  return parseOptionalExpPostscript(result, subOps);
+  return parseOptionalExpPostscript(result);
 }
 
 /// Parse the postfix productions of expression after the leading expression
@@ -941,14 +988,13 @@ ParseResult FIRStmtParser::parseExp(Value &result, SubOpVector &subOps,
 ///      ::= exp '[' intLit ']'
 /// XX   ::= exp '.' DoubleLit // TODO Workaround for #470
 ///      ::= exp '[' exp ']'
-ParseResult FIRStmtParser::parseOptionalExpPostscript(Value &result,
-                                                      SubOpVector &subOps) {
+ParseResult FIRStmtParser::parseOptionalExpPostscript(Value &result) {
 
   // Handle postfix expressions.
   while (1) {
     // Subfield: exp ::= exp '.' fieldId
     if (consumeIf(FIRToken::period)) {
-      if (parsePostFixFieldId(result, subOps))
+      if (parsePostFixFieldId(result))
         return failure();
 
       continue;
@@ -957,11 +1003,11 @@ ParseResult FIRStmtParser::parseOptionalExpPostscript(Value &result,
     // Subindex: exp ::= exp '[' intLit ']' | exp '[' exp ']'
     if (consumeIf(FIRToken::l_square)) {
       if (getToken().isAny(FIRToken::integer, FIRToken::string)) {
-        if (parsePostFixIntSubscript(result, subOps))
+        if (parsePostFixIntSubscript(result))
           return failure();
         continue;
       }
-      if (parsePostFixDynamicSubscript(result, subOps))
+      if (parsePostFixDynamicSubscript(result))
         return failure();
 
       continue;
@@ -975,8 +1021,7 @@ ParseResult FIRStmtParser::parseOptionalExpPostscript(Value &result,
 ///
 /// The "exp '.'" part of the production has already been parsed.
 ///
-ParseResult FIRStmtParser::parsePostFixFieldId(Value &result,
-                                               SubOpVector &subOps) {
+ParseResult FIRStmtParser::parsePostFixFieldId(Value &result) {
   auto loc = getToken().getLoc();
   StringRef fieldName;
   if (parseFieldId(fieldName, "expected field name"))
@@ -991,10 +1036,8 @@ ParseResult FIRStmtParser::parsePostFixFieldId(Value &result,
     return failure();
 
   // Create the result operation.
-  auto op =
-      builder.create<SubfieldOp>(translateLocation(loc), resultType, result,
-                                 builder.getStringAttr(fieldName));
-  subOps.push_back(op);
+  auto op = builder.create<SubfieldOp>(getExpLocation(loc), resultType, result,
+                                      builder.getStringAttr(fieldName));
   result = op.getResult();
   return success();
 }
@@ -1003,8 +1046,7 @@ ParseResult FIRStmtParser::parsePostFixFieldId(Value &result,
 ///
 /// The "exp '['" part of the production has already been parsed.
 ///
-ParseResult FIRStmtParser::parsePostFixIntSubscript(Value &result,
-                                                    SubOpVector &subOps) {
+ParseResult FIRStmtParser::parsePostFixIntSubscript(Value &result) {
   auto indexLoc = getToken().getLoc();
   int32_t indexNo;
   if (parseIntLit(indexNo, "expected index") ||
@@ -1024,9 +1066,8 @@ ParseResult FIRStmtParser::parsePostFixIntSubscript(Value &result,
 
   // Create the result operation.
   auto op =
-      builder.create<SubindexOp>(translateLocation(indexLoc), resultType,
-                                 result, builder.getI32IntegerAttr(indexNo));
-  subOps.push_back(op);
+      builder.create<SubindexOp>(getExpLocation(indexLoc), resultType, result,
+                                 builder.getI32IntegerAttr(indexNo));
   result = op.getResult();
   return success();
 }
@@ -1035,11 +1076,10 @@ ParseResult FIRStmtParser::parsePostFixIntSubscript(Value &result,
 ///
 /// The "exp '['" part of the production has already been parsed.
 ///
-ParseResult FIRStmtParser::parsePostFixDynamicSubscript(Value &result,
-                                                        SubOpVector &subOps) {
+ParseResult FIRStmtParser::parsePostFixDynamicSubscript(Value &result) {
   auto indexLoc = getToken().getLoc();
   Value index;
-  if (parseExp(index, subOps, "expected subscript index expression") ||
+  if (parseExp(index, "expected subscript index expression") ||
       parseToken(FIRToken::r_square, "expected ']' in subscript"))
     return failure();
 
@@ -1057,15 +1097,14 @@ ParseResult FIRStmtParser::parsePostFixDynamicSubscript(Value &result,
     return failure();
 
   // Create the result operation.
-  auto op = builder.create<SubaccessOp>(translateLocation(indexLoc), resultType,
+  auto op = builder.create<SubaccessOp>(getExpLocation(indexLoc), resultType,
                                         result, index);
-  subOps.push_back(op);
   result = op.getResult();
   return success();
 }
 
 /// prim ::= primop exp* intLit*  ')'
-ParseResult FIRStmtParser::parsePrimExp(Value &result, SubOpVector &subOps) {
+ParseResult FIRStmtParser::parsePrimExp(Value &result) {
   auto kind = getToken().getKind();
   auto loc = getToken().getLoc();
   consumeToken();
@@ -1087,8 +1126,7 @@ ParseResult FIRStmtParser::parsePrimExp(Value &result, SubOpVector &subOps) {
           return emitError("expected more integer constants"), failure();
 
         Value operand;
-        if (parseExp(operand, subOps,
-                     "expected expression in primitive operand"))
+        if (parseExp(operand, "expected expression in primitive operand"))
           return failure();
 
         // If the operand contains a flip, strip it out with an asPassive op.
@@ -1142,21 +1180,19 @@ ParseResult FIRStmtParser::parsePrimExp(Value &result, SubOpVector &subOps) {
         CLASS::getResultType(opTypes, integers, translateLocation(loc));       \
     if (!resultTy)                                                             \
       return failure();                                                        \
-    result = builder.create<CLASS>(translateLocation(loc), resultTy,           \
+    result = builder.create<CLASS>(getExpLocation(loc), resultTy,              \
                                    ValueRange(operands), attrs);               \
     break;                                                                     \
   }
 #include "FIRTokenKinds.def"
   }
 
-  subOps.push_back(result.getDefiningOp());
   return success();
 }
 
 /// integer-literal-exp ::= 'UInt' optional-width '(' intLit ')'
 ///                     ::= 'SInt' optional-width '(' intLit ')'
-ParseResult FIRStmtParser::parseIntegerLiteralExp(Value &result,
-                                                  SubOpVector &subOps) {
+ParseResult FIRStmtParser::parseIntegerLiteralExp(Value &result) {
   bool isSigned = getToken().is(FIRToken::kw_SInt);
   auto loc = getToken().getLoc();
   consumeToken();
@@ -1227,9 +1263,8 @@ ParseResult FIRStmtParser::parseIntegerLiteralExp(Value &result,
     }
   }
 
-  auto op = builder.create<ConstantOp>(translateLocation(loc), type, value);
+  auto op = builder.create<ConstantOp>(getExpLocation(loc), type, value);
   entry = op;
-  subOps.push_back(op);
   result = op;
 
   if (savedIP.isSet())
@@ -1272,12 +1307,11 @@ FIRStmtParser::parseExpWithLeadingKeyword(StringRef keyword,
   }
 
   Value lhs;
-  SmallVector<Operation *, 8> subOps;
   if (lookupSymbolEntry(lhs, keyword, info.getFIRLoc()) ||
-      parseOptionalExpPostscript(lhs, subOps))
+      parseOptionalExpPostscript(lhs))
     return ParseResult(failure());
 
-  return parseLeadingExpStmt(lhs, subOps);
+  return parseLeadingExpStmt(lhs);
 }
 //===-----------------------------
 // FIRStmtParser Statement Parsing
@@ -1318,6 +1352,10 @@ ParseResult FIRStmtParser::parseSimpleStmtBlock(unsigned indent) {
 ///      ::= register
 ///
 ParseResult FIRStmtParser::parseSimpleStmt(unsigned stmtIndent) {
+  // The info of a 'when' comes right after its condition, and may be followed
+  // by a statement on the same line.
+  peekStatementInfo(getToken().is(FIRToken::kw_when));
+
   switch (getToken().getKind()) {
   // Statements.
   case FIRToken::kw_attach:
@@ -1347,10 +1385,9 @@ ParseResult FIRStmtParser::parseSimpleStmt(unsigned stmtIndent) {
   default: {
     // Statement productions that start with an expression.
     Value lhs;
-    SmallVector<Operation *, 8> subOps;
-    if (parseExp(lhs, subOps, "unexpected token in module"))
+    if (parseExp(lhs, "unexpected token in module"))
       return failure();
-    return parseLeadingExpStmt(lhs, subOps);
+    return parseLeadingExpStmt(lhs);
   }
 
     // Declarations
@@ -1385,15 +1422,14 @@ ParseResult FIRStmtParser::parseAttach() {
   if (parseToken(FIRToken::l_paren, "expected '(' after attach"))
     return failure();
 
-  SmallVector<Operation *, 8> subOps;
   SmallVector<Value, 4> operands;
   do {
     operands.push_back({});
-    if (parseExp(operands.back(), subOps, "expected operand in attach"))
+    if (parseExp(operands.back(), "expected operand in attach"))
       return failure();
   } while (!consumeIf(FIRToken::r_paren));
 
-  if (parseOptionalInfo(info, subOps))
+  if (parseOptionalInfo(info))
     return failure();
 
   builder.create<AttachOp>(info.getLoc(), operands);
@@ -1417,17 +1453,16 @@ ParseResult FIRStmtParser::parseMemPort(MemDirAttr direction) {
   StringAttr resultValue;
   StringRef memName;
   Value memory, indexExp, clock;
-  SmallVector<Operation *, 8> subOps;
   if (parseToken(FIRToken::kw_mport, "expected 'mport' in memory port") ||
       parseId(resultValue, "expected result name") ||
       parseToken(FIRToken::equal, "expected '=' in memory port") ||
       parseId(memName, "expected memory name") ||
       lookupSymbolEntry(memory, memName, info.getFIRLoc()) ||
       parseToken(FIRToken::l_square, "expected '[' in memory port") ||
-      parseExp(indexExp, subOps, "expected index expression") ||
+      parseExp(indexExp, "expected index expression") ||
       parseToken(FIRToken::r_square, "expected ']' in memory port") ||
-      parseExp(clock, subOps, "expected clock expression") ||
-      parseOptionalInfo(info, subOps))
+      parseExp(clock, "expected clock expression") ||
+      parseOptionalInfo(info))
     return failure();
 
   auto memVType = memory.getType().dyn_cast<FVectorType>();
@@ -1464,14 +1499,12 @@ ParseResult FIRStmtParser::parseMemPort(MemDirAttr direction) {
   // hacky workaround just in this case.
   if (mdirIndent.hasValue() && nextIndent.hasValue() &&
       mdirIndent.getValue() > nextIndent.getValue()) {
-    auto memNameId = Identifier::get(memName, getContext());
-
     // To make this even more gross, we have no efficient way to figure out
     // what scope a value lives in our scoped hash table.  We keep a shadow
     // table to track this.
-    auto scopeAndOperation = memoryScopeTable.lookup(memNameId);
+    auto scopeAndOperation = memoryScopeTable.lookup(memName);
     if (!scopeAndOperation.first) {
-      emitError(info.getFIRLoc(), "unknown memory '") << memNameId << "'";
+      emitError(info.getFIRLoc(), "unknown memory '") << memName << "'";
       return failure();
     }
 
@@ -1488,8 +1521,7 @@ ParseResult FIRStmtParser::parseMemPort(MemDirAttr direction) {
 
       // Inject this the wire's name into the same scope as the memory.
       symbolTable.insertIntoScope(
-          scopeAndOperation.first,
-          Identifier::get(resultValue.getValue(), getContext()),
+          scopeAndOperation.first, resultValue.getValue(),
           {info.getFIRLoc(), wireHack});
       return success();
     }
@@ -1503,12 +1535,10 @@ ParseResult FIRStmtParser::parsePrintf() {
   LocWithInfo info(getToken().getLoc(), this);
   consumeToken(FIRToken::lp_printf);
 
-  SmallVector<Operation *, 8> subOps;
-
   Value clock, condition;
   StringRef formatString;
-  if (parseExp(clock, subOps, "expected clock expression in printf") ||
-      parseExp(condition, subOps, "expected condition in printf") ||
+  if (parseExp(clock, "expected clock expression in printf") ||
+      parseExp(condition, "expected condition in printf") ||
       parseGetSpelling(formatString) ||
       parseToken(FIRToken::string, "expected format string in printf"))
     return failure();
@@ -1516,11 +1546,11 @@ ParseResult FIRStmtParser::parsePrintf() {
   SmallVector<Value, 4> operands;
   while (!consumeIf(FIRToken::r_paren)) {
     operands.push_back({});
-    if (parseExp(operands.back(), subOps, "expected operand in printf"))
+    if (parseExp(operands.back(), "expected operand in printf"))
       return failure();
   }
 
-  if (parseOptionalInfo(info, subOps))
+  if (parseOptionalInfo(info))
     return failure();
 
   auto formatStrUnescaped = FIRToken::getStringValue(formatString);
@@ -1551,15 +1581,13 @@ ParseResult FIRStmtParser::parseStop() {
   LocWithInfo info(getToken().getLoc(), this);
   consumeToken(FIRToken::lp_stop);
 
-  SmallVector<Operation *, 8> subOps;
-
   Value clock, condition;
   int32_t exitCode;
-  if (parseExp(clock, subOps, "expected clock expression in 'stop'") ||
-      parseExp(condition, subOps, "expected condition in 'stop'") ||
+  if (parseExp(clock, "expected clock expression in 'stop'") ||
+      parseExp(condition, "expected condition in 'stop'") ||
       parseIntLit(exitCode, "expected exit code in 'stop'") ||
       parseToken(FIRToken::r_paren, "expected ')' in 'stop'") ||
-      parseOptionalInfo(info, subOps))
+      parseOptionalInfo(info))
     return failure();
 
   builder.create<StopOp>(info.getLoc(), clock, condition,
@@ -1572,17 +1600,15 @@ ParseResult FIRStmtParser::parseAssert() {
   LocWithInfo info(getToken().getLoc(), this);
   consumeToken(FIRToken::lp_assert);
 
-  SmallVector<Operation *, 8> subOps;
-
   Value clock, predicate, enable;
   StringRef message;
-  if (parseExp(clock, subOps, "expected clock expression in 'assert'") ||
-      parseExp(predicate, subOps, "expected predicate in 'assert'") ||
-      parseExp(enable, subOps, "expected enable in 'assert'") ||
+  if (parseExp(clock, "expected clock expression in 'assert'") ||
+      parseExp(predicate, "expected predicate in 'assert'") ||
+      parseExp(enable, "expected enable in 'assert'") ||
       parseGetSpelling(message) ||
       parseToken(FIRToken::string, "expected message in 'assert'") ||
       parseToken(FIRToken::r_paren, "expected ')' in 'assert'") ||
-      parseOptionalInfo(info, subOps))
+      parseOptionalInfo(info))
     return failure();
 
   auto messageUnescaped = FIRToken::getStringValue(message);
@@ -1596,17 +1622,15 @@ ParseResult FIRStmtParser::parseAssume() {
   LocWithInfo info(getToken().getLoc(), this);
   consumeToken(FIRToken::lp_assume);
 
-  SmallVector<Operation *, 8> subOps;
-
   Value clock, predicate, enable;
   StringRef message;
-  if (parseExp(clock, subOps, "expected clock expression in 'assume'") ||
-      parseExp(predicate, subOps, "expected predicate in 'assume'") ||
-      parseExp(enable, subOps, "expected enable in 'assume'") ||
+  if (parseExp(clock, "expected clock expression in 'assume'") ||
+      parseExp(predicate, "expected predicate in 'assume'") ||
+      parseExp(enable, "expected enable in 'assume'") ||
       parseGetSpelling(message) ||
       parseToken(FIRToken::string, "expected message in 'assume'") ||
       parseToken(FIRToken::r_paren, "expected ')' in 'assume'") ||
-      parseOptionalInfo(info, subOps))
+      parseOptionalInfo(info))
     return failure();
 
   auto messageUnescaped = FIRToken::getStringValue(message);
@@ -1620,17 +1644,15 @@ ParseResult FIRStmtParser::parseCover() {
   LocWithInfo info(getToken().getLoc(), this);
   consumeToken(FIRToken::lp_cover);
 
-  SmallVector<Operation *, 8> subOps;
-
   Value clock, predicate, enable;
   StringRef message;
-  if (parseExp(clock, subOps, "expected clock expression in 'cover'") ||
-      parseExp(predicate, subOps, "expected predicate in 'cover'") ||
-      parseExp(enable, subOps, "expected enable in 'cover'") ||
+  if (parseExp(clock, "expected clock expression in 'cover'") ||
+      parseExp(predicate, "expected predicate in 'cover'") ||
+      parseExp(enable, "expected enable in 'cover'") ||
       parseGetSpelling(message) ||
       parseToken(FIRToken::string, "expected message in 'cover'") ||
       parseToken(FIRToken::r_paren, "expected ')' in 'cover'") ||
-      parseOptionalInfo(info, subOps))
+      parseOptionalInfo(info))
     return failure();
 
   auto messageUnescaped = FIRToken::getStringValue(message);
@@ -1651,10 +1673,9 @@ ParseResult FIRStmtParser::parseWhen(unsigned whenIndent) {
     return isExpr.getValue();
 
   Value condition;
-  SmallVector<Operation *, 8> subOps;
-  if (parseExp(condition, subOps, "expected condition in 'when'") ||
+  if (parseExp(condition, "expected condition in 'when'") ||
       parseToken(FIRToken::colon, "expected ':' in when") ||
-      parseOptionalInfo(info, subOps))
+      parseOptionalInfo(info))
     return failure();
 
   condition = convertToPassive(condition, info.getLoc());
@@ -1728,14 +1749,14 @@ ParseResult FIRStmtParser::parseWhen(unsigned whenIndent) {
 /// leading-exp-stmt ::= exp '<=' exp info?
 ///                  ::= exp '<-' exp info?
 ///                  ::= exp 'is' 'invalid' info?
-ParseResult FIRStmtParser::parseLeadingExpStmt(Value lhs, SubOpVector &subOps) {
+ParseResult FIRStmtParser::parseLeadingExpStmt(Value lhs) {
   // Figure out which kind of statement it is.
   LocWithInfo info(getToken().getLoc(), this);
 
   // If 'is' grammar is special.
   if (consumeIf(FIRToken::kw_is)) {
     if (parseToken(FIRToken::kw_invalid, "expected 'invalid'") ||
-        parseOptionalInfo(info, subOps))
+        parseOptionalInfo(info))
       return failure();
 
     // The FIRRTL specification describes Invalidates as a statement with
@@ -1760,8 +1781,8 @@ ParseResult FIRStmtParser::parseLeadingExpStmt(Value lhs, SubOpVector &subOps) {
   consumeToken();
 
   Value rhs;
-  if (parseExp(rhs, subOps, "unexpected token in statement") ||
-      parseOptionalInfo(info, subOps))
+  if (parseExp(rhs, "unexpected token in statement") ||
+      parseOptionalInfo(info))
     return failure();
 
   if (kind == FIRToken::less_equal)
@@ -1793,10 +1814,16 @@ ParseResult FIRStmtParser::parseInstance() {
       parseId(moduleName, "expected module name") || parseOptionalInfo(info))
     return failure();
 
-  // Look up the module that is being referenced.
-  auto circuit =
-      builder.getBlock()->getParentOp()->getParentOfType<CircuitOp>();
-  auto referencedModule = circuit.lookupSymbol(moduleName);
+  // Look up the module that is being referenced.  If the module bodies are
+  // being parsed concurrently, all the modules were declared up front.
+  Operation *referencedModule = nullptr;
+  if (auto *moduleTable = getState().moduleTable) {
+    referencedModule = moduleTable->lookup(moduleName);
+  } else {
+    auto circuit =
+        builder.getBlock()->getParentOp()->getParentOfType<CircuitOp>();
+    referencedModule = circuit.lookupSymbol(moduleName);
+  }
   if (!referencedModule) {
     emitError(info.getFIRLoc(),
               "use of undefined module name '" + moduleName + "' in instance");
@@ -1845,7 +1872,7 @@ ParseResult FIRStmtParser::parseCMem() {
 
   // Remember that this memory is in this symbol table scope.
   // TODO(chisel bug): This should be removed along with memoryScopeTable.
-  memoryScopeTable.insert(Identifier::get(id.getValue(), getContext()),
+  memoryScopeTable.insert(id.getValue(),
                           {symbolTable.getCurScope(), result.getOperation()});
 
   return addSymbolEntry(id.getValue(), result, info.getFIRLoc());
@@ -1877,7 +1904,7 @@ ParseResult FIRStmtParser::parseSMem() {
 
   // Remember that this memory is in this symbol table scope.
   // TODO(chisel bug): This should be removed along with memoryScopeTable.
-  memoryScopeTable.insert(Identifier::get(id.getValue(), getContext()),
+  memoryScopeTable.insert(id.getValue(),
                           {symbolTable.getCurScope(), result.getOperation()});
 
   return addSymbolEntry(id.getValue(), result, info.getFIRLoc());
@@ -2002,7 +2029,7 @@ ParseResult FIRStmtParser::parseMem(unsigned memIndent) {
 
   // Remember that this memory is in this symbol table scope.
   // TODO(chisel bug): This should be removed along with memoryScopeTable.
-  memoryScopeTable.insert(Identifier::get(id.getValue(), getContext()),
+  memoryScopeTable.insert(id.getValue(),
                           {symbolTable.getCurScope(), result.getOperation()});
 
   return addSymbolEntry(id.getValue(), result, info.getFIRLoc());
@@ -2021,11 +2048,10 @@ ParseResult FIRStmtParser::parseNode() {
 
   StringAttr id;
   Value initializer;
-  SmallVector<Operation *, 8> subOps;
   if (parseId(id, "expected node name") ||
       parseToken(FIRToken::equal, "expected '=' in node") ||
-      parseExp(initializer, subOps, "expected expression for node") ||
-      parseOptionalInfo(info, subOps))
+      parseExp(initializer, "expected expression for node") ||
+      parseOptionalInfo(info))
     return failure();
 
   // Error out in the following conditions:
@@ -2110,14 +2136,13 @@ ParseResult FIRStmtParser::parseRegister(unsigned regIndent) {
   StringAttr id;
   FIRRTLType type;
   Value clock;
-  SmallVector<Operation *, 8> subOps;
 
   // TODO(firrtl spec): info? should come after the clock expression before
   // the 'with'.
   if (parseId(id, "expected reg name") ||
       parseToken(FIRToken::colon, "expected ':' in reg") ||
       parseType(type, "expected reg type") ||
-      parseExp(clock, subOps, "expected expression for register clock"))
+      parseExp(clock, "expected expression for register clock"))
     return failure();
   clock = convertToPassive(clock, clock.getLoc());
 
@@ -2127,6 +2152,9 @@ ParseResult FIRStmtParser::parseRegister(unsigned regIndent) {
     if (parseToken(FIRToken::colon, "expected ':' in reg"))
       return failure();
 
+    // The reset specifier and the info usually come on the next line.
+    peekStatementInfo();
+
     // TODO(firrtl spec): Simplify the grammar for register reset logic.
     // Why allow multiple ambiguous parentheses?  Why rely on indentation at
     // all?
@@ -2139,11 +2167,10 @@ ParseResult FIRStmtParser::parseRegister(unsigned regIndent) {
       if (!hasExtraLParen)
         return emitError("expected indented reset specifier in reg"), failure();
 
-    SmallVector<Operation *, 8> subOps;
     if (parseToken(FIRToken::kw_reset, "expected 'reset' in reg") ||
         parseToken(FIRToken::equal_greater, "expected => in reset specifier") ||
         parseToken(FIRToken::l_paren, "expected '(' in reset specifier") ||
-        parseExp(resetSignal, subOps, "expected expression for reset signal"))
+        parseExp(resetSignal, "expected expression for reset signal"))
       return failure();
     resetSignal = convertToPassive(resetSignal, resetSignal.getLoc());
 
@@ -2155,13 +2182,13 @@ ParseResult FIRStmtParser::parseRegister(unsigned regIndent) {
     if (getTokenSpelling() == id.getValue()) {
       consumeToken();
       if (parseToken(FIRToken::r_paren, "expected ')' in reset specifier") ||
-          parseOptionalInfo(info, subOps))
+          parseOptionalInfo(info))
         return failure();
       resetSignal = Value();
     } else {
-      if (parseExp(resetValue, subOps, "expected expression for reset value") ||
+      if (parseExp(resetValue, "expected expression for reset value") ||
           parseToken(FIRToken::r_paren, "expected ')' in reset specifier") ||
-          parseOptionalInfo(info, subOps))
+          parseOptionalInfo(info))
         return failure();
       resetValue = convertToPassive(resetValue, resetValue.getLoc());
     }
@@ -2173,7 +2200,7 @@ ParseResult FIRStmtParser::parseRegister(unsigned regIndent) {
 
   // Finally, handle the last info if present, providing location info for the
   // clock expression.
-  if (parseOptionalInfo(info, subOps))
+  if (parseOptionalInfo(info))
     return failure();
 
   Value result;
@@ -2198,11 +2225,20 @@ struct FIRModuleParser : public FIRScopedParser {
       : FIRScopedParser(state, symbolTable, memoryScopeTable), circuit(circuit),
         firstScope(symbolTable), firstMemoryScope(memoryScopeTable) {}
 
+  using PortInfoAndLoc = std::pair<ModulePortInfo, SMLoc>;
+
   ParseResult parseExtModule(unsigned indent);
   ParseResult parseModule(unsigned indent);
 
+  /// Parse the name and ports of a module and create it, leaving the lexer at
+  /// the start of its body.
+  ParseResult parseModuleHeader(unsigned indent, FModuleOp &fmodule,
+                                SmallVectorImpl<PortInfoAndLoc> &ports);
+  /// Parse the body of a module created by parseModuleHeader.
+  ParseResult parseModuleBody(FModuleOp fmodule,
+                              ArrayRef<PortInfoAndLoc> ports, unsigned indent);
+
 private:
-  using PortInfoAndLoc = std::pair<ModulePortInfo, SMLoc>;
   ParseResult parsePortList(SmallVectorImpl<PortInfoAndLoc> &result,
                             unsigned indent);
 
@@ -2358,29 +2394,42 @@ ParseResult FIRModuleParser::parseExtModule(unsigned indent) {
 /// DEDENT
 ///
 ParseResult FIRModuleParser::parseModule(unsigned indent) {
+  FModuleOp fmodule;
+  SmallVector<PortInfoAndLoc, 4> portListAndLoc;
+  return failure(parseModuleHeader(indent, fmodule, portListAndLoc) ||
+                 parseModuleBody(fmodule, portListAndLoc, indent));
+}
+
+ParseResult
+FIRModuleParser::parseModuleHeader(unsigned indent, FModuleOp &fmodule,
+                                   SmallVectorImpl<PortInfoAndLoc> &ports) {
   LocWithInfo info(getToken().getLoc(), this);
   StringAttr name;
-  SmallVector<PortInfoAndLoc, 4> portListAndLoc;
 
   consumeToken(FIRToken::kw_module);
   if (parseId(name, "expected module name") ||
       parseToken(FIRToken::colon, "expected ':' in module definition") ||
-      parseOptionalInfo(info) || parsePortList(portListAndLoc, indent))
+      parseOptionalInfo(info) || parsePortList(ports, indent))
     return failure();
 
   auto builder = circuit.getBodyBuilder();
 
   // Create the module.
   SmallVector<ModulePortInfo, 4> portList;
-  portList.reserve(portListAndLoc.size());
-  for (auto &elt : portListAndLoc)
+  portList.reserve(ports.size());
+  for (auto &elt : ports)
     portList.push_back(elt.first);
-  auto fmodule = builder.create<FModuleOp>(info.getLoc(), name, portList);
+  fmodule = builder.create<FModuleOp>(info.getLoc(), name, portList);
+  return success();
+}
 
+ParseResult FIRModuleParser::parseModuleBody(FModuleOp fmodule,
+                                             ArrayRef<PortInfoAndLoc> ports,
+                                             unsigned indent) {
   // Install all of the ports into the symbol table, associated with their
   // block arguments.
   auto argIt = fmodule.args_begin();
-  for (auto &entry : portListAndLoc) {
+  for (auto &entry : ports) {
     if (addSymbolEntry(entry.first.getName(), *argIt, entry.second))
       return failure();
     ++argIt;
@@ -2405,24 +2454,102 @@ struct FIRCircuitParser : public FIRParser {
       : FIRParser(state), mlirModule(mlirModule) {}
 
   ParseResult parseCircuit();
+  ParseResult parseCircuitStreaming(
+      function_ref<LogicalResult(ModuleOp, StringRef)> processModule);
 
 private:
+  /// A module declared before its body is parsed.  External modules have no
+  /// body to parse.
+  struct ModuleDecl {
+    Operation *op;
+    SmallVector<FIRModuleParser::PortInfoAndLoc, 4> ports;
+    const char *bodyStart = nullptr;
+  };
+
+  ParseResult parseCircuitHeader(unsigned &circuitIndent, StringAttr &name,
+                                 Location &loc);
+  Optional<unsigned>
+  findModuleStarts(unsigned circuitIndent,
+                   SmallVectorImpl<const char *> &moduleStarts);
+  ParseResult declareModules(CircuitOp circuit, unsigned moduleIndent,
+                             ArrayRef<const char *> moduleStarts,
+                             SmallVectorImpl<ModuleDecl> &decls);
+  ParseResult parseModulesInParallel(CircuitOp circuit, unsigned moduleIndent,
+                                     ArrayRef<const char *> moduleStarts);
+
+  /// Move the lexer to the token starting at 'ptr'.
+  void resetToken(const char *ptr) {
+    getState().lex.resetPointer(ptr);
+    getState().curToken = getState().lex.lexToken();
+  }
+
+  /// Return true if the current token ends the body of a module.
+  bool isEndOfModule() const {
+    return getToken().isAny(FIRToken::eof, FIRToken::kw_module,
+                            FIRToken::kw_extmodule);
+  }
+
   ModuleOp mlirModule;
 };
 
 } // end anonymous namespace
 
-/// file ::= circuit
-/// circuit ::= 'circuit' id ':' info? INDENT module* DEDENT EOF
-///
-ParseResult FIRCircuitParser::parseCircuit() {
+/// Find the start of every module in 'buffer', the part of a circuit that
+/// follows its header.  Modules start on their own line at 'moduleIndent' and
+/// everything in them is indented more, and neither strings nor info markers
+/// can span lines, so only the start of each line needs to be looked at.
+/// Return failure if something else shows up at the module level, leaving the
+/// regular parser to diagnose it.
+static LogicalResult splitModules(StringRef buffer, unsigned moduleIndent,
+                                  SmallVectorImpl<const char *> &moduleStarts) {
+  auto startsWithKeyword = [](StringRef line, StringRef keyword) {
+    if (!line.startswith(keyword))
+      return false;
+    if (line.size() == keyword.size())
+      return true;
+    char next = line[keyword.size()];
+    return !llvm::isAlnum(next) && next != '_' && next != '$' && next != '-';
+  };
+
+  while (!buffer.empty()) {
+    size_t lineEnd = buffer.find_first_of("\n\r\v\f");
+    StringRef line = buffer.take_front(lineEnd);
+    buffer = buffer.drop_front(std::min(lineEnd + 1, buffer.size()));
+
+    // Skip blank lines, comments, and the contents of modules.
+    size_t indent = line.find_first_not_of(" \t,");
+    if (indent == StringRef::npos || line[indent] == ';' ||
+        indent > moduleIndent)
+      continue;
+
+    line = line.drop_front(indent);
+    if (indent != moduleIndent || !(startsWithKeyword(line, "module") ||
+                                    startsWithKeyword(line, "extmodule")))
+      return failure();
+    moduleStarts.push_back(line.data());
+  }
+  return success();
+}
+
+/// Map the name of every module in 'circuit' to the module.
+static void buildModuleTable(CircuitOp circuit,
+                             llvm::StringMap<Operation *> &moduleTable) {
+  for (auto &op : *circuit.getBody())
+    if (auto name =
+            op.getAttrOfType<StringAttr>(SymbolTable::getSymbolAttrName()))
+      moduleTable.try_emplace(name.getValue(), &op);
+}
+
+/// circuit ::= 'circuit' id ':' info?
+ParseResult FIRCircuitParser::parseCircuitHeader(unsigned &circuitIndent,
+                                                 StringAttr &name,
+                                                 Location &loc) {
   auto indent = getIndentation();
   if (!indent.hasValue())
     return emitError("'circuit' must be first token on its line"), failure();
-  unsigned circuitIndent = indent.getValue();
+  circuitIndent = indent.getValue();
 
   LocWithInfo info(getToken().getLoc(), this);
-  StringAttr name;
 
   // A file must contain a top level `circuit` definition.
   if (parseToken(FIRToken::kw_circuit,
@@ -2432,9 +2559,134 @@ ParseResult FIRCircuitParser::parseCircuit() {
       parseOptionalInfo(info))
     return failure();
 
+  loc = info.getLoc();
+  return success();
+}
+
+/// Split the modules following the circuit header, returning their indentation
+/// and filling in where each of them starts.  Return None if the modules can't
+/// be told apart by just looking at the start of the lines.
+Optional<unsigned> FIRCircuitParser::findModuleStarts(
+    unsigned circuitIndent, SmallVectorImpl<const char *> &moduleStarts) {
+  if (!getToken().isAny(FIRToken::kw_module, FIRToken::kw_extmodule))
+    return None;
+  auto moduleIndent = getIndentation();
+  if (!moduleIndent.hasValue() || moduleIndent.getValue() <= circuitIndent)
+    return None;
+
+  // Scan from the start of the line of the first module.
+  StringRef buffer =
+      getSourceMgr().getMemoryBuffer(getSourceMgr().getMainFileID())
+          ->getBuffer();
+  const char *lineStart =
+      getToken().getLoc().getPointer() - moduleIndent.getValue();
+  buffer = buffer.drop_front(lineStart - buffer.begin());
+
+  if (failed(splitModules(buffer, moduleIndent.getValue(), moduleStarts))) {
+    moduleStarts.clear();
+    return None;
+  }
+  return moduleIndent;
+}
+
+/// Declare the modules starting at 'moduleStarts' in 'circuit'.  Only the
+/// names and ports of the modules are parsed, recording where their bodies
+/// start.  External modules have no body, so they are parsed entirely here.
+ParseResult
+FIRCircuitParser::declareModules(CircuitOp circuit, unsigned moduleIndent,
+                                 ArrayRef<const char *> moduleStarts,
+                                 SmallVectorImpl<ModuleDecl> &decls) {
+  for (auto *start : moduleStarts) {
+    resetToken(start);
+
+    FIRModuleParser mp(getState(), circuit);
+    decls.emplace_back();
+    auto &decl = decls.back();
+    if (getToken().is(FIRToken::kw_extmodule)) {
+      if (mp.parseExtModule(moduleIndent))
+        return failure();
+      if (!isEndOfModule())
+        return emitError("unexpected token in circuit"), failure();
+      decl.op = &circuit.getBody()->back();
+      // Skip over the implicit terminator.
+      if (isa<DoneOp>(decl.op))
+        decl.op = decl.op->getPrevNode();
+      continue;
+    }
+
+    FModuleOp fmodule;
+    if (mp.parseModuleHeader(moduleIndent, fmodule, decl.ports))
+      return failure();
+    decl.op = fmodule;
+    decl.bodyStart = getToken().getLoc().getPointer();
+  }
+  return success();
+}
+
+/// Parse the modules starting at 'moduleStarts'.  All the modules are declared
+/// first, so that instances can refer to modules further down in the file,
+/// then their bodies are parsed concurrently, each with its own lexer.
+ParseResult
+FIRCircuitParser::parseModulesInParallel(CircuitOp circuit,
+                                         unsigned moduleIndent,
+                                         ArrayRef<const char *> moduleStarts) {
+  SmallVector<ModuleDecl, 0> decls;
+  if (declareModules(circuit, moduleIndent, moduleStarts, decls))
+    return failure();
+  llvm::erase_if(decls, [](ModuleDecl &decl) { return !decl.bodyStart; });
+
+  llvm::StringMap<Operation *> moduleTable;
+  buildModuleTable(circuit, moduleTable);
+
+  // Parse the bodies, keeping the diagnostics in the order of the modules.
+  auto &state = getState();
+  ParallelDiagnosticHandler diagHandler(getContext());
+  std::atomic<bool> failed(false);
+  llvm::parallelForEachN(0, decls.size(), [&](size_t i) {
+    diagHandler.setOrderIDForThread(i);
+    GlobalFIRParserState bodyState(getSourceMgr(), getContext(),
+                                   state.options);
+    bodyState.moduleTable = &moduleTable;
+    bodyState.lex.resetPointer(decls[i].bodyStart);
+    bodyState.curToken = bodyState.lex.lexToken();
+
+    FIRModuleParser mp(bodyState, circuit);
+    if (mp.parseModuleBody(cast<FModuleOp>(decls[i].op), decls[i].ports,
+                           moduleIndent) ||
+        bodyState.curToken.is(FIRToken::error))
+      failed = true;
+    else if (bodyState.curToken.isNot(FIRToken::eof, FIRToken::kw_module,
+                                      FIRToken::kw_extmodule))
+      mp.emitError("unexpected token in circuit"), failed = true;
+    diagHandler.eraseOrderIDForThread();
+  });
+  return failure(failed);
+}
+
+/// file ::= circuit
+/// circuit ::= 'circuit' id ':' info? INDENT module* DEDENT EOF
+///
+ParseResult FIRCircuitParser::parseCircuit() {
+  unsigned circuitIndent;
+  StringAttr name;
+  Location loc = mlirModule.getLoc();
+  if (parseCircuitHeader(circuitIndent, name, loc))
+    return failure();
+
   // Create the top-level circuit op in the MLIR module.
   OpBuilder b(mlirModule.getBodyRegion());
-  auto circuit = b.create<CircuitOp>(info.getLoc(), name);
+  auto circuit = b.create<CircuitOp>(loc, name);
+
+  // If requested, split the circuit into modules and parse them concurrently.
+  // Fall back to parsing them one by one if the file doesn't split cleanly,
+  // which also takes care of reporting the problem.
+  if (getState().options.parseModulesInParallel &&
+      getContext()->isMultithreadingEnabled()) {
+    SmallVector<const char *, 0> moduleStarts;
+    if (auto moduleIndent = findModuleStarts(circuitIndent, moduleStarts))
+      return parseModulesInParallel(circuit, moduleIndent.getValue(),
+                                    moduleStarts);
+  }
 
   // Parse any contained modules.
   while (true) {
@@ -2473,6 +2725,87 @@ ParseResult FIRCircuitParser::parseCircuit() {
   }
 }
 
+/// Parse the circuit one module at a time.  All the modules are declared in
+/// 'mlirModule' up front, then each module is parsed into its own MLIR module,
+/// along with declarations of the modules it instantiates, and handed over to
+/// 'processModule'.  Only the declarations outlive the call.
+ParseResult FIRCircuitParser::parseCircuitStreaming(
+    function_ref<LogicalResult(ModuleOp, StringRef)> processModule) {
+  const char *fileStart = getToken().getLoc().getPointer();
+  unsigned circuitIndent;
+  StringAttr name;
+  Location loc = mlirModule.getLoc();
+  if (parseCircuitHeader(circuitIndent, name, loc))
+    return failure();
+
+  // If the modules can't be split, parse the whole circuit at once.
+  SmallVector<const char *, 0> moduleStarts;
+  auto moduleIndent = findModuleStarts(circuitIndent, moduleStarts);
+  if (!moduleIndent) {
+    resetToken(fileStart);
+    OwningModuleRef whole(ModuleOp::create(mlirModule.getLoc()));
+    if (FIRCircuitParser(getState(), *whole).parseCircuit() ||
+        failed(verify(*whole)))
+      return failure();
+    return failure(failed(processModule(*whole, {})));
+  }
+
+  OpBuilder b(mlirModule.getBodyRegion());
+  auto circuit = b.create<CircuitOp>(loc, name);
+  SmallVector<ModuleDecl, 0> decls;
+  if (declareModules(circuit, moduleIndent.getValue(), moduleStarts, decls))
+    return failure();
+
+  llvm::StringMap<Operation *> moduleTable;
+  buildModuleTable(circuit, moduleTable);
+  getState().moduleTable = &moduleTable;
+
+  for (auto &decl : decls) {
+    OwningModuleRef chunk(ModuleOp::create(mlirModule.getLoc()));
+    OpBuilder chunkBuilder(chunk->getBodyRegion());
+    auto chunkCircuit = chunkBuilder.create<CircuitOp>(loc, name);
+    auto builder = chunkCircuit.getBodyBuilder();
+    auto *op = builder.clone(*decl.op);
+
+    if (decl.bodyStart) {
+      auto fmodule = cast<FModuleOp>(op);
+      resetToken(decl.bodyStart);
+      FIRModuleParser mp(getState(), chunkCircuit);
+      if (mp.parseModuleBody(fmodule, decl.ports, moduleIndent.getValue()) ||
+          getToken().is(FIRToken::error))
+        return failure();
+      if (!isEndOfModule())
+        return emitError("unexpected token in circuit"), failure();
+
+      // Declare the modules this one instantiates as external modules.
+      SmallPtrSet<Operation *, 8> declared;
+      fmodule.walk([&](InstanceOp instance) {
+        auto *target = moduleTable.lookup(instance.moduleName());
+        if (!target || target == decl.op || !declared.insert(target).second)
+          return;
+        if (isa<FExtModuleOp>(target)) {
+          builder.clone(*target);
+          return;
+        }
+        SmallVector<ModulePortInfo, 4> ports;
+        getModulePortInfo(target, ports);
+        builder.create<FExtModuleOp>(
+            target->getLoc(),
+            target->getAttrOfType<StringAttr>(SymbolTable::getSymbolAttrName()),
+            ports);
+      });
+    }
+
+    if (failed(verify(*chunk)))
+      return failure();
+    auto moduleName =
+        op->getAttrOfType<StringAttr>(SymbolTable::getSymbolAttrName());
+    if (failed(processModule(*chunk, moduleName.getValue())))
+      return failure();
+  }
+  return success();
+}
+
 //===----------------------------------------------------------------------===//
 // Driver
 //===----------------------------------------------------------------------===//
@@ -2502,6 +2835,43 @@ OwningModuleRef circt::firrtl::importFIRRTL(SourceMgr &sourceMgr,
   return module;
 }
 
+// Parse the specified .fir file one module at a time.
+LogicalResult circt::firrtl::importFIRRTLStreaming(
+    SourceMgr &sourceMgr, MLIRContext *context,
+    function_ref<LogicalResult(ModuleOp, StringRef)> processModule,
+    FIRParserOptions options) {
+  auto sourceBuf = sourceMgr.getMemoryBuffer(sourceMgr.getMainFileID());
+
+  context->loadDialect<FIRRTLDialect>();
+
+  // This holds the declarations of all the modules.
+  OwningModuleRef declarations(ModuleOp::create(
+      FileLineColLoc::get(sourceBuf->getBufferIdentifier(), /*line=*/0,
+                          /*column=*/0, context)));
+
+  // Parse the modules one at a time, so don't parse them in parallel.
+  options.parseModulesInParallel = false;
+  GlobalFIRParserState state(sourceMgr, context, options);
+  return failure(
+      FIRCircuitParser(state, *declarations).parseCircuitStreaming(
+          processModule));
+}
+
+// Lex the specified .fir file, counting the tokens.
+Optional<size_t> circt::firrtl::lexFIRRTL(SourceMgr &sourceMgr,
+                                          MLIRContext *context) {
+  FIRLexer lexer(sourceMgr, context);
+  size_t numTokens = 0;
+  while (true) {
+    auto token = lexer.lexToken();
+    if (token.is(FIRToken::error))
+      return None;
+    if (token.is(FIRToken::eof))
+      return numTokens;
+    ++numTokens;
+  }
+}
+
 void circt::firrtl::registerFromFIRRTLTranslation() {
   static TranslateToMLIRRegistration fromFIR(
       "parse-fir", [](llvm::SourceMgr &sourceMgr, MLIRContext *context) {
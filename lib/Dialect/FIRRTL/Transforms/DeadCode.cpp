@@ -0,0 +1,266 @@
+//===- DeadCode.cpp - Remove dead modules and ports -------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//===----------------------------------------------------------------------===//
+//
+// This file implements a circuit level pass which removes the modules that
+// can't be reached from the main module, and the ports of the remaining modules
+// that carry no information: inputs which are never read, outputs which no
+// instance reads, and ports which are always driven by the same constant.  The
+// constant is pushed across the instance boundary before the port is removed.
+//
+// Ports are only removed from modules whose instances are all accessed through
+// subfields.  The main module keeps its ports, since they are the interface of
+// the circuit.  Removing a port can leave others dead, so ports are removed
+// until nothing changes.
+//
+//===----------------------------------------------------------------------===//
+
+#include "./PassDetails.h"
+#include "circt/Dialect/FIRRTL/FIRRTLOps.h"
+#include "circt/Dialect/FIRRTL/Passes.h"
+#include "circt/Support/InstanceGraph.h"
+#include "mlir/Interfaces/SideEffectInterfaces.h"
+#include "llvm/ADT/DenseSet.h"
+
+using namespace circt;
+using namespace firrtl;
+
+/// Erase `ops`, and then anything which only they used and which has no side
+/// effects.
+static void eraseWithDeadOperands(ArrayRef<Operation *> ops) {
+  SmallVector<Operation *, 16> worklist;
+  DenseSet<Operation *> erased;
+  auto erase = [&](Operation *op) {
+    for (auto operand : op->getOperands())
+      if (auto *def = operand.getDefiningOp())
+        worklist.push_back(def);
+    erased.insert(op);
+    op->erase();
+  };
+
+  for (auto *op : ops)
+    erase(op);
+  while (!worklist.empty()) {
+    auto *op = worklist.pop_back_val();
+    if (!erased.count(op) && isOpTriviallyDead(op))
+      erase(op);
+  }
+}
+
+/// If `value` is only used as the destination of connects, add them to
+/// `connects` and return true.
+static bool collectDrivers(Value value, SmallVectorImpl<Operation *> &connects) {
+  for (auto *user : value.getUsers()) {
+    if (!isa<ConnectOp, PartialConnectOp>(user) || user->getOperand(0) != value)
+      return false;
+    connects.push_back(user);
+  }
+  return true;
+}
+
+/// If `value` has a single driver, which is a connect of a constant in `block`,
+/// return the constant.
+static ConstantOp getConstantDriver(Value value, Block *block) {
+  if (!value.hasOneUse())
+    return {};
+  auto connect = dyn_cast<ConnectOp>(*value.getUsers().begin());
+  if (!connect || connect.dest() != value || connect->getBlock() != block)
+    return {};
+  return connect.src().getDefiningOp<ConstantOp>();
+}
+
+namespace {
+struct DeadCodePass : public DeadCodeBase<DeadCodePass> {
+  void runOnOperation() override;
+
+private:
+  bool removeDeadPorts(FModuleOp module);
+
+  /// The instances of each module which can be reached from the main module.
+  DenseMap<Operation *, SmallVector<InstanceOp, 4>> instances;
+};
+} // end anonymous namespace
+
+/// Remove the ports of `module` which carry no information, and return true if
+/// there were any.
+bool DeadCodePass::removeDeadPorts(FModuleOp module) {
+  auto &moduleInstances = instances[module];
+
+  // The subfields of each instance, by port name.  Leave the module alone if
+  // any instance is used in another way.
+  llvm::StringMap<SmallVector<SubfieldOp, 4>> subfields;
+  for (auto instance : moduleInstances) {
+    for (auto *user : instance.getResult().getUsers()) {
+      auto subfield = dyn_cast<SubfieldOp>(user);
+      if (!subfield)
+        return false;
+      subfields[subfield.fieldname()].push_back(subfield);
+    }
+  }
+
+  SmallVector<ModulePortInfo, 8> ports;
+  module.getPortInfo(ports);
+  auto *body = module.getBodyBlock();
+
+  SmallVector<unsigned, 4> deadPorts;
+  SmallVector<Operation *, 16> deadOps;
+  for (unsigned portIdx = 0, e = ports.size(); portIdx != e; ++portIdx) {
+    auto &port = ports[portIdx];
+    if (port.getName().empty() || port.isInOut())
+      continue;
+    auto arg = body->getArgument(portIdx);
+    auto &portSubfields = subfields[port.getName()];
+
+    if (port.isInput()) {
+      // An input is dead if no instance drives it with anything but connects.
+      SmallVector<Operation *, 4> drivers;
+      if (!llvm::all_of(portSubfields, [&](SubfieldOp subfield) {
+            return collectDrivers(subfield.getResult(), drivers);
+          }))
+        continue;
+
+      // If every instance drives the input with the same constant, use that
+      // constant in the module instead.
+      if (!arg.use_empty()) {
+        ConstantOp constant;
+        bool isConstant = !portSubfields.empty();
+        for (auto subfield : portSubfields) {
+          auto driver = getConstantDriver(subfield.getResult(),
+                                          subfield.input().getParentBlock());
+          if (!driver || driver.getType() != port.type ||
+              (constant && constant.valueAttr() != driver.valueAttr())) {
+            isConstant = false;
+            break;
+          }
+          constant = driver;
+        }
+        if (!isConstant)
+          continue;
+        auto builder = OpBuilder::atBlockBegin(body);
+        auto newConstant = builder.create<ConstantOp>(
+            constant.getLoc(), constant.getType(), constant.valueAttr());
+        arg.replaceAllUsesWith(newConstant.getResult());
+      }
+
+      deadOps.append(drivers.begin(), drivers.end());
+    } else {
+      // An output is dead if no instance reads it, and if every instance reads
+      // the same constant, the instances can use that constant instead.
+      SmallVector<Operation *, 4> drivers;
+      if (!collectDrivers(arg, drivers))
+        continue;
+      bool isRead = llvm::any_of(portSubfields, [](SubfieldOp subfield) {
+        return !subfield->use_empty();
+      });
+      if (isRead) {
+        auto constant = getConstantDriver(arg, body);
+        if (!constant || !llvm::all_of(portSubfields, [&](SubfieldOp subfield) {
+              return subfield.getType() == constant.getType();
+            }))
+          continue;
+        for (auto subfield : portSubfields) {
+          OpBuilder builder(subfield);
+          auto newConstant = builder.create<ConstantOp>(
+              constant.getLoc(), constant.getType(), constant.valueAttr());
+          subfield.getResult().replaceAllUsesWith(newConstant.getResult());
+        }
+      }
+
+      deadOps.append(drivers.begin(), drivers.end());
+    }
+
+    for (auto subfield : portSubfields)
+      deadOps.push_back(subfield);
+    deadPorts.push_back(portIdx);
+  }
+
+  if (deadPorts.empty())
+    return false;
+
+  // Erase the connects before the subfields they drive.
+  std::stable_partition(deadOps.begin(), deadOps.end(),
+                        [](Operation *op) { return !isa<SubfieldOp>(op); });
+  eraseWithDeadOperands(deadOps);
+  module.eraseArguments(deadPorts);
+
+  // Rebuild the instances with the remaining ports, the same way the parser
+  // builds them.
+  ports.clear();
+  module.getPortInfo(ports);
+  SmallVector<BundleType::BundleElement, 8> elements;
+  for (auto &port : ports)
+    elements.push_back({Identifier::get(port.getName(), &getContext()),
+                        FlipType::get(port.type)});
+  auto resultType = BundleType::get(elements, &getContext());
+  for (auto &instance : moduleInstances) {
+    OpBuilder builder(instance);
+    auto newInstance = builder.create<InstanceOp>(
+        instance.getLoc(), ArrayRef<Type>(resultType), ValueRange(),
+        instance->getAttrs());
+    instance.replaceAllUsesWith(newInstance.getResult());
+    instance.erase();
+    instance = newInstance;
+  }
+  return true;
+}
+
+void DeadCodePass::runOnOperation() {
+  auto circuit = getOperation();
+  auto &instanceGraph = getAnalysis<InstanceGraph>();
+
+  // Find the modules which can be reached from the main module, and their
+  // instances.
+  auto *mainNode = instanceGraph.lookup(circuit.name());
+  if (!mainNode) {
+    markAllAnalysesPreserved();
+    return;
+  }
+  auto *main = mainNode->getModule();
+  SmallVector<InstanceGraphNode *, 16> worklist{mainNode};
+  DenseSet<Operation *> reachable{main};
+  SmallVector<FModuleOp, 16> modules;
+  while (!worklist.empty()) {
+    auto *node = worklist.pop_back_val();
+    auto module = dyn_cast<FModuleOp>(node->getModule());
+    if (!module)
+      continue;
+    modules.push_back(module);
+    for (auto &record : node->getInstances()) {
+      auto instance = dyn_cast<InstanceOp>(record.getInstance());
+      if (!instance)
+        continue;
+      auto *referenced = record.getTarget()->getModule();
+      instances[referenced].push_back(instance);
+      if (reachable.insert(referenced).second)
+        worklist.push_back(record.getTarget());
+    }
+  }
+
+  bool changed = false;
+  for (auto &op : llvm::make_early_inc_range(*circuit.getBody())) {
+    if (isa<FModuleOp, FExtModuleOp>(op) && !reachable.count(&op)) {
+      op.erase();
+      changed = true;
+    }
+  }
+
+  // Remove the dead ports of everything but the main module.
+  for (bool removedPorts = true; removedPorts;) {
+    removedPorts = false;
+    for (auto module : modules)
+      if (module.getOperation() != main)
+        removedPorts |= removeDeadPorts(module);
+    changed |= removedPorts;
+  }
+
+  instances.clear();
+  if (!changed)
+    markAllAnalysesPreserved();
+}
+
+std::unique_ptr<mlir::Pass> circt::firrtl::createDeadCodePass() {
+  return std::make_unique<DeadCodePass>();
+}
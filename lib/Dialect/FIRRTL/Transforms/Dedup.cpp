@@ -0,0 +1,227 @@
+//===- Dedup.cpp - Merge structurally identical modules ---------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//===----------------------------------------------------------------------===//
+//
+// This file implements a circuit level pass which merges the modules that are
+// identical except for their name, the names of their declarations and their
+// locations.  The instances of a merged module are pointed at the module it is
+// merged into, and it is erased.
+//
+// Modules are visited bottom-up, so that the instances inside a module are
+// updated before it is compared.  Two modules which only differ in which of
+// two identical modules they instantiate are then merged as well.
+//
+//===----------------------------------------------------------------------===//
+
+#include "./PassDetails.h"
+#include "circt/Dialect/FIRRTL/FIRRTLOps.h"
+#include "circt/Dialect/FIRRTL/Passes.h"
+#include "circt/Support/InstanceGraph.h"
+#include "mlir/IR/SymbolTable.h"
+#include "llvm/ADT/Hashing.h"
+#include <unordered_map>
+
+using namespace circt;
+using namespace firrtl;
+
+/// Return true if the attribute is ignored when comparing modules.  The names
+/// of declarations don't change what a module does.
+static bool isIgnoredAttr(NamedAttribute attr) {
+  return attr.first == "name";
+}
+
+/// Return true if the attribute of the module operation itself is ignored.
+static bool isIgnoredModuleAttr(NamedAttribute attr) {
+  return attr.first == SymbolTable::getSymbolAttrName();
+}
+
+namespace {
+/// A module flattened into the list of its blocks and operations, with its
+/// values numbered in the order they are defined.  Two modules are identical if
+/// their lists match, with operands compared by number.
+struct ModuleShape {
+  explicit ModuleShape(FModuleOp module);
+
+  bool operator==(const ModuleShape &other) const;
+
+  FModuleOp module;
+  llvm::hash_code hash = 0;
+
+private:
+  void addRegion(Region &region);
+  void addBlock(Block &block);
+  void addOperation(Operation &op);
+
+  SmallVector<PointerUnion<Block *, Operation *>, 0> items;
+  DenseMap<Value, unsigned> valueIds;
+};
+} // end anonymous namespace
+
+ModuleShape::ModuleShape(FModuleOp module) : module(module) {
+  for (auto attr : module->getAttrs())
+    if (!isIgnoredModuleAttr(attr))
+      hash = llvm::hash_combine(hash, attr.first, attr.second);
+  addRegion(module.getBody());
+}
+
+void ModuleShape::addRegion(Region &region) {
+  hash = llvm::hash_combine(hash, region.getBlocks().size());
+  for (auto &block : region)
+    addBlock(block);
+}
+
+void ModuleShape::addBlock(Block &block) {
+  items.push_back(&block);
+  hash = llvm::hash_combine(hash, block.getNumArguments(),
+                            block.getOperations().size());
+  for (auto arg : block.getArguments()) {
+    valueIds.insert({arg, valueIds.size()});
+    hash = llvm::hash_combine(hash, arg.getType());
+  }
+  for (auto &op : block)
+    addOperation(op);
+}
+
+void ModuleShape::addOperation(Operation &op) {
+  items.push_back(&op);
+  hash = llvm::hash_combine(hash, op.getName().getAsOpaquePointer(),
+                            op.getNumOperands(), op.getNumRegions());
+  for (auto result : op.getResults()) {
+    valueIds.insert({result, valueIds.size()});
+    hash = llvm::hash_combine(hash, result.getType());
+  }
+  for (auto attr : op.getAttrs())
+    if (!isIgnoredAttr(attr))
+      hash = llvm::hash_combine(hash, attr.first, attr.second);
+  for (auto &region : op.getRegions())
+    addRegion(region);
+}
+
+/// Compare the operands of two operations by the numbers of the values.  Values
+/// can be used before they are defined in a graph region, so this can only be
+/// done once both modules are numbered.
+static bool areOperandsEquivalent(const DenseMap<Value, unsigned> &lhsIds,
+                                  ValueRange lhs,
+                                  const DenseMap<Value, unsigned> &rhsIds,
+                                  ValueRange rhs) {
+  for (auto pair : llvm::zip(lhs, rhs)) {
+    auto lhsIt = lhsIds.find(std::get<0>(pair));
+    auto rhsIt = rhsIds.find(std::get<1>(pair));
+    if (lhsIt == lhsIds.end() || rhsIt == rhsIds.end() ||
+        lhsIt->second != rhsIt->second)
+      return false;
+  }
+  return true;
+}
+
+bool ModuleShape::operator==(const ModuleShape &other) const {
+  if (hash != other.hash || items.size() != other.items.size())
+    return false;
+
+  auto filterAttrs = [](ArrayRef<NamedAttribute> attrs, auto isIgnored) {
+    SmallVector<NamedAttribute, 4> result;
+    for (auto attr : attrs)
+      if (!isIgnored(attr))
+        result.push_back(attr);
+    return result;
+  };
+  if (filterAttrs(module->getAttrs(), isIgnoredModuleAttr) !=
+      filterAttrs(other.module->getAttrs(), isIgnoredModuleAttr))
+    return false;
+
+  for (auto pair : llvm::zip(items, other.items)) {
+    auto lhs = std::get<0>(pair), rhs = std::get<1>(pair);
+    if (lhs.is<Block *>() != rhs.is<Block *>())
+      return false;
+
+    if (auto *lhsBlock = lhs.dyn_cast<Block *>()) {
+      auto *rhsBlock = rhs.get<Block *>();
+      if (lhsBlock->getOperations().size() !=
+              rhsBlock->getOperations().size() ||
+          lhsBlock->getArgumentTypes() != rhsBlock->getArgumentTypes())
+        return false;
+      continue;
+    }
+
+    auto *lhsOp = lhs.get<Operation *>(), *rhsOp = rhs.get<Operation *>();
+    if (lhsOp->getName() != rhsOp->getName() ||
+        lhsOp->getNumOperands() != rhsOp->getNumOperands() ||
+        lhsOp->getNumRegions() != rhsOp->getNumRegions() ||
+        lhsOp->getResultTypes() != rhsOp->getResultTypes() ||
+        filterAttrs(lhsOp->getAttrs(), isIgnoredAttr) !=
+            filterAttrs(rhsOp->getAttrs(), isIgnoredAttr))
+      return false;
+    for (auto regions : llvm::zip(lhsOp->getRegions(), rhsOp->getRegions()))
+      if (std::get<0>(regions).getBlocks().size() !=
+          std::get<1>(regions).getBlocks().size())
+        return false;
+    if (!areOperandsEquivalent(valueIds, lhsOp->getOperands(), other.valueIds,
+                               rhsOp->getOperands()))
+      return false;
+  }
+  return true;
+}
+
+namespace {
+struct DedupPass : public DedupBase<DedupPass> {
+  void runOnOperation() override;
+};
+} // end anonymous namespace
+
+void DedupPass::runOnOperation() {
+  auto circuit = getOperation();
+  auto &instanceGraph = getAnalysis<InstanceGraph>();
+
+  // The modules kept so far, by hash, and the module each merged module is
+  // replaced with.
+  std::unordered_map<size_t, SmallVector<std::unique_ptr<ModuleShape>, 1>>
+      shapes;
+  DenseMap<Operation *, FModuleOp> replacements;
+
+  for (auto *node : instanceGraph.getPostOrder()) {
+    auto module = dyn_cast<FModuleOp>(node->getModule());
+    if (!module)
+      continue;
+
+    // Point the instances at the modules they were merged into.
+    for (auto &record : node->getInstances()) {
+      auto instance = dyn_cast<InstanceOp>(record.getInstance());
+      auto it = replacements.find(record.getTarget()->getModule());
+      if (instance && it != replacements.end())
+        instance->setAttr(
+            "moduleName",
+            FlatSymbolRefAttr::get(it->second.getName(), &getContext()));
+    }
+
+    // The main module is the interface of the circuit and stays as it is.
+    if (module.getName() == circuit.name())
+      continue;
+
+    auto shape = std::make_unique<ModuleShape>(module);
+    auto &candidates = shapes[shape->hash];
+    auto it = llvm::find_if(candidates, [&](auto &candidate) {
+      return *candidate == *shape;
+    });
+    if (it != candidates.end())
+      replacements[module] = (*it)->module;
+    else
+      candidates.push_back(std::move(shape));
+  }
+
+  if (replacements.empty()) {
+    markAllAnalysesPreserved();
+    return;
+  }
+
+  // Nothing refers to the merged modules anymore.
+  shapes.clear();
+  for (auto &replacement : replacements)
+    replacement.first->erase();
+}
+
+std::unique_ptr<mlir::Pass> circt::firrtl::createDedupPass() {
+  return std::make_unique<DedupPass>();
+}
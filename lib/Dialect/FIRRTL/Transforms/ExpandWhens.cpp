@@ -0,0 +1,387 @@
+//===- ExpandWhens.cpp - Lower firrtl.when to multiplexers ------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//===----------------------------------------------------------------------===//
+//
+// This file implements the resolution of the last connect semantics of FIRRTL,
+// removing all the firrtl.when operations of a module.  Declarations and
+// expressions inside a when are moved in front of it, the conditions of the
+// printf, stop and verification statements inside it are combined with its
+// condition, and the connects inside it become multiplexers.  In the end, every
+// destination is driven by exactly one connect, at the end of the module.
+//
+// The module is processed in a single traversal.  Every destination gets a
+// dense index, and its current driver is kept in a vector with an undo log, so
+// that a when only costs as much as the connects inside it.  A destination
+// connected several times in a branch only gets a multiplexer for its last
+// connect, and one connected in one branch only keeps its previous driver in
+// the other, so nested whens don't build chains of redundant multiplexers.
+//
+// This works on ground type destinations, which subfields and subindices of
+// aggregates are resolved to.  Aggregate connects are only allowed outside of
+// whens, where they are left alone.
+//
+//===----------------------------------------------------------------------===//
+
+#include "./PassDetails.h"
+#include "circt/Dialect/FIRRTL/FIRRTLOps.h"
+#include "circt/Dialect/FIRRTL/FIRRTLTypes.h"
+#include "circt/Dialect/FIRRTL/Passes.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/ScopeExit.h"
+#include "llvm/ADT/TypeSwitch.h"
+
+using namespace circt;
+using namespace firrtl;
+
+/// Return true if `value` is invalid, which lets it be replaced by any other
+/// value.
+static bool isInvalid(Value value) {
+  return value && value.getDefiningOp<InvalidValuePrimOp>();
+}
+
+namespace {
+/// A destination of connects.  Subfields and subindices of an aggregate get
+/// their own destination, with the aggregate as their parent.
+struct Sink {
+  /// A value referring to the destination, the one of its first connect.
+  Value dest;
+  /// The index of the parent aggregate, or ~0U for the root of a declaration.
+  unsigned parent;
+  /// The destination is, or is part of, a register, which keeps its value
+  /// when it isn't connected.
+  bool isRegister = false;
+  /// The destination has been connected with a ground type connect.
+  bool isConnected = false;
+  /// One of the connects was a partial connect.
+  bool isPartial = false;
+  /// The destination is an aggregate connected as a whole.
+  bool isWholeConnected = false;
+};
+
+struct ExpandWhensPass : public ExpandWhensBase<ExpandWhensPass> {
+  void runOnOperation() override;
+
+private:
+  unsigned getSinkIndex(Value dest);
+  LogicalResult processBlock(Block &block, Value condition);
+  LogicalResult processConnect(Operation *op, Value dest, Value src,
+                               bool isPartial, Value condition);
+  LogicalResult processWhen(WhenOp when, Value condition);
+  void setDriver(unsigned sink, Value value);
+  void collectChanges(unsigned mark,
+                      SmallVectorImpl<std::pair<unsigned, Value>> &changes);
+  Value getPassiveValue(OpBuilder &builder, Location loc, Value value);
+
+  /// All the destinations, and how to find them from their values.
+  SmallVector<Sink, 16> sinks;
+  DenseMap<Value, unsigned> sinksByValue;
+  DenseMap<std::pair<unsigned, Attribute>, unsigned> sinksByElement;
+
+  /// The ground type destinations in the order they are first connected.
+  SmallVector<unsigned, 16> connectedSinks;
+
+  /// The current driver of each destination, and the previous drivers of the
+  /// destinations changed in the enclosing whens.
+  SmallVector<Value, 16> drivers;
+  SmallVector<std::pair<unsigned, Value>, 16> undoLog;
+};
+} // end anonymous namespace
+
+/// Return the index of the destination `dest` refers to, or ~0U if it can't be
+/// determined statically.
+unsigned ExpandWhensPass::getSinkIndex(Value dest) {
+  auto it = sinksByValue.find(dest);
+  if (it != sinksByValue.end())
+    return it->second;
+
+  auto addSink = [&](unsigned parent) {
+    sinks.push_back({dest, parent});
+    drivers.push_back({});
+    if (parent != ~0U)
+      sinks.back().isRegister = sinks[parent].isRegister;
+    else if (auto *op = dest.getDefiningOp())
+      sinks.back().isRegister = isa<RegOp, RegResetOp>(op);
+    return sinks.size() - 1;
+  };
+
+  // Elements of aggregates are identified by the index of their parent and
+  // their field name or index, whichever value refers to them.
+  unsigned index;
+  Attribute element;
+  Value parentValue;
+  if (auto subfield = dest.getDefiningOp<SubfieldOp>()) {
+    parentValue = subfield.input();
+    element = subfield.fieldnameAttr();
+  } else if (auto subindex = dest.getDefiningOp<SubindexOp>()) {
+    parentValue = subindex.input();
+    element = subindex.indexAttr();
+  } else if (dest.getDefiningOp<SubaccessOp>()) {
+    return ~0U;
+  }
+
+  if (parentValue) {
+    auto parent = getSinkIndex(parentValue);
+    if (parent == ~0U)
+      return ~0U;
+    auto elementIt = sinksByElement.find({parent, element});
+    if (elementIt != sinksByElement.end()) {
+      index = elementIt->second;
+    } else {
+      index = addSink(parent);
+      sinksByElement[{parent, element}] = index;
+    }
+  } else {
+    index = addSink(~0U);
+  }
+  sinksByValue[dest] = index;
+  return index;
+}
+
+void ExpandWhensPass::setDriver(unsigned sink, Value value) {
+  undoLog.push_back({sink, drivers[sink]});
+  drivers[sink] = value;
+}
+
+/// Collect the final driver of each destination changed since `mark` into
+/// `changes`, and restore their drivers from before.
+void ExpandWhensPass::collectChanges(
+    unsigned mark, SmallVectorImpl<std::pair<unsigned, Value>> &changes) {
+  DenseSet<unsigned> seen;
+  for (auto &entry : llvm::make_range(undoLog.begin() + mark, undoLog.end()))
+    if (seen.insert(entry.first).second)
+      changes.push_back({entry.first, drivers[entry.first]});
+  while (undoLog.size() != mark) {
+    auto entry = undoLog.pop_back_val();
+    drivers[entry.first] = entry.second;
+  }
+}
+
+/// Multiplexers only take passive values, read the flipped ones through
+/// asPassive.
+Value ExpandWhensPass::getPassiveValue(OpBuilder &builder, Location loc,
+                                       Value value) {
+  if (value.getType().cast<FIRRTLType>().isPassive())
+    return value;
+  return builder.create<AsPassivePrimOp>(loc, value);
+}
+
+LogicalResult ExpandWhensPass::processConnect(Operation *op, Value dest,
+                                              Value src, bool isPartial,
+                                              Value condition) {
+  auto destType = dest.getType().cast<FIRRTLType>().getPassiveType();
+  auto sink = getSinkIndex(dest);
+  if (sink == ~0U)
+    return op->emitError("cannot resolve a connect to a dynamically indexed "
+                         "destination, remove the subaccesses first");
+
+  // Aggregate connects are left alone, which is only right if they aren't
+  // conditional.
+  if (destType.isa<BundleType, FVectorType>()) {
+    if (condition)
+      return op->emitError("aggregate connects inside of a firrtl.when are not "
+                           "supported, lower the types first");
+    sinks[sink].isWholeConnected = true;
+    return success();
+  }
+
+  auto &info = sinks[sink];
+  if (!info.isConnected) {
+    info.isConnected = true;
+    connectedSinks.push_back(sink);
+  }
+  info.isPartial |= isPartial;
+  setDriver(sink, src);
+  op->erase();
+  return success();
+}
+
+LogicalResult ExpandWhensPass::processBlock(Block &block, Value condition) {
+  for (auto &op : llvm::make_early_inc_range(block)) {
+    auto result =
+        TypeSwitch<Operation *, LogicalResult>(&op)
+            .Case<ConnectOp, PartialConnectOp>([&](auto connect) {
+              return processConnect(connect, connect.dest(), connect.src(),
+                                    isa<PartialConnectOp>(connect), condition);
+            })
+            .Case<WhenOp>(
+                [&](WhenOp when) { return processWhen(when, condition); })
+            .Case<PrintFOp, StopOp>([&](auto stmt) {
+              if (condition) {
+                OpBuilder builder(stmt);
+                stmt.condMutable().assign(builder.create<AndPrimOp>(
+                    stmt.getLoc(), stmt.cond().getType(), condition,
+                    stmt.cond()));
+              }
+              return success();
+            })
+            .Case<AssertOp, AssumeOp, CoverOp>([&](auto stmt) {
+              if (condition) {
+                OpBuilder builder(stmt);
+                stmt.enableMutable().assign(builder.create<AndPrimOp>(
+                    stmt.getLoc(), stmt.enable().getType(), condition,
+                    stmt.enable()));
+              }
+              return success();
+            })
+            .Default([](Operation *) { return success(); });
+    if (failed(result))
+      return failure();
+  }
+  return success();
+}
+
+LogicalResult ExpandWhensPass::processWhen(WhenOp when, Value condition) {
+  OpBuilder builder(when);
+  auto loc = when.getLoc();
+  auto cond = when.condition();
+  auto boolType = cond.getType();
+
+  // Process each branch with its own drivers, starting from the ones before the
+  // when, and remember what changed.
+  auto mark = undoLog.size();
+  Value thenCond =
+      condition ? builder.create<AndPrimOp>(loc, boolType, condition, cond)
+                : cond;
+  if (failed(processBlock(when.thenRegion().front(), thenCond)))
+    return failure();
+  SmallVector<std::pair<unsigned, Value>, 8> thenChanges;
+  collectChanges(mark, thenChanges);
+
+  SmallVector<std::pair<unsigned, Value>, 8> elseChanges;
+  if (when.hasElseRegion()) {
+    Value elseCond = builder.create<NotPrimOp>(loc, boolType, cond);
+    if (condition)
+      elseCond = builder.create<AndPrimOp>(loc, boolType, condition, elseCond);
+    if (failed(processBlock(when.elseRegion().front(), elseCond)))
+      return failure();
+    collectChanges(mark, elseChanges);
+  }
+
+  // Everything left in the branches is unconditional, move it in front of the
+  // when.
+  auto *parentBlock = when->getBlock();
+  auto hoist = [&](Region &region) {
+    auto &ops = region.front().getOperations();
+    parentBlock->getOperations().splice(Block::iterator(when), ops, ops.begin(),
+                                        std::prev(ops.end()));
+  };
+  hoist(when.thenRegion());
+  if (when.hasElseRegion())
+    hoist(when.elseRegion());
+
+  // Merge the drivers of the branches.  A branch which doesn't connect a
+  // destination keeps its previous driver, if there is one, or the register
+  // value for registers.
+  auto getPrevious = [&](unsigned sink) -> Value {
+    if (auto driver = drivers[sink])
+      return driver;
+    if (sinks[sink].isRegister)
+      return sinks[sink].dest;
+    return {};
+  };
+  auto merge = [&](unsigned sink, Value thenValue, Value elseValue) -> bool {
+    bool thenMissing = !thenValue || isInvalid(thenValue);
+    bool elseMissing = !elseValue || isInvalid(elseValue);
+    Value result;
+    if (thenMissing && elseMissing)
+      result = thenValue ? thenValue : elseValue;
+    else if (thenMissing || thenValue == elseValue)
+      result = elseValue;
+    else if (elseMissing)
+      result = thenValue;
+    else {
+      thenValue = getPassiveValue(builder, loc, thenValue);
+      elseValue = getPassiveValue(builder, loc, elseValue);
+      auto resultType = MuxPrimOp::getResultType(
+          boolType.cast<FIRRTLType>(), thenValue.getType().cast<FIRRTLType>(),
+          elseValue.getType().cast<FIRRTLType>(), loc);
+      if (!resultType)
+        return false;
+      result = builder.create<MuxPrimOp>(loc, resultType, cond, thenValue,
+                                         elseValue);
+    }
+    if (result && result != drivers[sink])
+      setDriver(sink, result);
+    return true;
+  };
+
+  DenseMap<unsigned, Value> elseValues(elseChanges.begin(), elseChanges.end());
+  for (auto &change : thenChanges) {
+    auto it = elseValues.find(change.first);
+    Value elseValue;
+    if (it != elseValues.end()) {
+      elseValue = it->second;
+      elseValues.erase(it);
+    } else {
+      elseValue = getPrevious(change.first);
+    }
+    if (!merge(change.first, change.second, elseValue))
+      return failure();
+  }
+  for (auto &change : elseChanges)
+    if (elseValues.count(change.first) &&
+        !merge(change.first, getPrevious(change.first), change.second))
+      return failure();
+
+  when.erase();
+  return success();
+}
+
+void ExpandWhensPass::runOnOperation() {
+  auto module = getOperation();
+  auto *body = module.getBodyBlock();
+
+  // Modules without whens already have the semantics of a single connect.
+  bool hasWhens = llvm::any_of(body->getOperations(),
+                               [](Operation &op) { return isa<WhenOp>(op); });
+  if (!hasWhens) {
+    markAllAnalysesPreserved();
+    return;
+  }
+
+  auto cleanup = llvm::make_scope_exit([&] {
+    sinks.clear();
+    sinksByValue.clear();
+    sinksByElement.clear();
+    connectedSinks.clear();
+    drivers.clear();
+    undoLog.clear();
+  });
+
+  if (failed(processBlock(*body, {})))
+    return signalPassFailure();
+
+  // The elements of an aggregate connected as a whole can't also be connected
+  // one by one, since the connects would no longer be in order.
+  for (auto sink : connectedSinks) {
+    for (auto parent = sinks[sink].parent; parent != ~0U;
+         parent = sinks[parent].parent) {
+      if (sinks[parent].isWholeConnected) {
+        mlir::emitError(sinks[sink].dest.getLoc(),
+                        "cannot mix aggregate connects and connects to its "
+                        "elements, lower the types first");
+        return signalPassFailure();
+      }
+    }
+  }
+
+  // Connect every destination to its final driver, at the end of the module.
+  auto builder = OpBuilder::atBlockTerminator(body);
+  for (auto sink : connectedSinks) {
+    auto &info = sinks[sink];
+    auto driver = drivers[sink];
+    if (!driver)
+      continue;
+    if (info.isPartial)
+      builder.create<PartialConnectOp>(info.dest.getLoc(), info.dest, driver);
+    else
+      builder.create<ConnectOp>(info.dest.getLoc(), info.dest, driver);
+  }
+}
+
+std::unique_ptr<mlir::Pass> circt::firrtl::createExpandWhensPass() {
+  return std::make_unique<ExpandWhensPass>();
+}
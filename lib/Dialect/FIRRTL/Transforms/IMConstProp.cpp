@@ -0,0 +1,485 @@
+//===- IMConstProp.cpp - Inter-module constant propagation ------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//===----------------------------------------------------------------------===//
+//
+// This file implements a sparse conditional constant propagation over a whole
+// circuit.  Each integer value of the modules reachable from the main module is
+// given a lattice value: unknown, a constant, or overdefined.  Connects merge
+// the value of their source into their destination, which is a wire, a
+// register, a port or the port of an instance.  The ports of an instance share
+// the lattice value of the ports of the module it instantiates, merged over all
+// its instances, so constants flow into and out of the modules.
+//
+// A destination may be connected several times, under when conditions or not.
+// Its value is always one of the values connected to it, or the previous value
+// of a register, so merging all of them is sound.  A register without a reset
+// is undefined until it is first written, and takes the value connected to it.
+// Values which are still unknown once nothing changes depend on a cycle, like a
+// counter register, and are marked overdefined until everything is settled.
+//
+// The values found to be constant are then replaced by constants, and the
+// wires, registers and operations left unused are removed.  The ports are left
+// alone, -firrtl-dead-code removes the ones which no longer carry anything.
+//
+//===----------------------------------------------------------------------===//
+
+#include "./PassDetails.h"
+#include "circt/Dialect/FIRRTL/FIRRTLOps.h"
+#include "circt/Dialect/FIRRTL/Passes.h"
+#include "circt/Support/InstanceGraph.h"
+#include "mlir/Interfaces/SideEffectInterfaces.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/Support/Parallel.h"
+
+using namespace circt;
+using namespace firrtl;
+
+/// Return the width of the values of `type` tracked by the analysis, which are
+/// the integers of known, nonzero width, or -1 if they are not tracked.
+static int32_t getTrackedWidth(Type type) {
+  auto firType = type.dyn_cast<FIRRTLType>();
+  auto intType =
+      firType ? firType.getPassiveType().dyn_cast<IntType>() : IntType();
+  if (!intType)
+    return -1;
+  auto width = intType.getWidthOrSentinel();
+  return width == 0 ? -1 : width;
+}
+
+namespace {
+/// The state of a value in the analysis: not known yet, always the same
+/// constant, or overdefined.  A value only ever moves down this order.
+class LatticeValue {
+public:
+  enum Kind { Unknown, Constant, Overdefined };
+
+  LatticeValue() = default;
+  static LatticeValue getConstant(const APInt &value) {
+    LatticeValue result;
+    result.kind = Constant;
+    result.value = value;
+    return result;
+  }
+  static LatticeValue getOverdefined() {
+    LatticeValue result;
+    result.kind = Overdefined;
+    return result;
+  }
+
+  bool isUnknown() const { return kind == Unknown; }
+  bool isConstant() const { return kind == Constant; }
+  bool isOverdefined() const { return kind == Overdefined; }
+  const APInt &getValue() const {
+    assert(isConstant() && "not a constant");
+    return value;
+  }
+
+  /// Merge `other` into this value, and return true if it changed.  Constants
+  /// must have the same width.
+  bool mergeIn(const LatticeValue &other) {
+    if (kind == Overdefined || other.kind == Unknown)
+      return false;
+    if (kind == Unknown) {
+      *this = other;
+      return true;
+    }
+    if (other.kind == Constant && value == other.value)
+      return false;
+    kind = Overdefined;
+    value = APInt();
+    return true;
+  }
+
+private:
+  Kind kind = Unknown;
+  APInt value;
+};
+
+struct IMConstPropPass : public IMConstPropBase<IMConstPropPass> {
+  void runOnOperation() override;
+
+private:
+  LatticeValue getLatticeValue(Value value) const {
+    return latticeValues.lookup(value);
+  }
+  void mergeLatticeValue(Value value, const LatticeValue &source);
+  void mergeExtendedValue(Value value, Value source);
+  void markOverdefined(Value value) {
+    mergeLatticeValue(value, LatticeValue::getOverdefined());
+  }
+
+  void markModuleExecutable(FModuleOp module, bool isMain);
+  void visitInstance(InstanceOp instance);
+  void visitConnect(ConnectOp connect);
+  void visitOperation(Operation *op);
+  void rewriteModule(FModuleOp module);
+
+  InstanceGraph *instanceGraph = nullptr;
+  DenseMap<Value, LatticeValue> latticeValues;
+  DenseSet<Operation *> executableModules;
+
+  /// The values whose lattice value changed, and whose users must be visited
+  /// again.
+  SmallVector<Value, 64> changedValues;
+
+  /// The wires, registers and ports which are driven by connects.
+  SmallVector<Value, 64> storage;
+
+  /// The port of the instantiated module of each subfield of an instance, and
+  /// the subfields of every port.
+  DenseMap<Value, Value> subfieldPorts;
+  DenseMap<Value, SmallVector<Value, 4>> portSubfields;
+};
+} // end anonymous namespace
+
+/// Merge `source` into the lattice value of `value`, and schedule its users to
+/// be visited again if it changed.  Values which aren't tracked can only be
+/// overdefined.
+void IMConstPropPass::mergeLatticeValue(Value value,
+                                        const LatticeValue &source) {
+  auto merged = source;
+  if (merged.isConstant() && getTrackedWidth(value.getType()) !=
+                                 int32_t(merged.getValue().getBitWidth()))
+    merged = LatticeValue::getOverdefined();
+  if (latticeValues[value].mergeIn(merged))
+    changedValues.push_back(value);
+}
+
+/// Merge the lattice value of `source` into that of `value`, extending a
+/// constant to the width of `value` according to the signedness of `source`,
+/// as a connect does.
+void IMConstPropPass::mergeExtendedValue(Value value, Value source) {
+  auto lattice = getLatticeValue(source);
+  auto width = getTrackedWidth(value.getType());
+  if (lattice.isConstant() && width != -1) {
+    auto type = source.getType().cast<FIRRTLType>().getPassiveType();
+    lattice = LatticeValue::getConstant(
+        type.cast<IntType>().isSigned()
+            ? lattice.getValue().sextOrTrunc(width)
+            : lattice.getValue().zextOrTrunc(width));
+  }
+  mergeLatticeValue(value, lattice);
+}
+
+/// Start analyzing `module`, whose inputs are driven by its instances, or by
+/// the outside world for the main module.
+void IMConstPropPass::markModuleExecutable(FModuleOp module, bool isMain) {
+  if (!executableModules.insert(module).second)
+    return;
+
+  SmallVector<ModulePortInfo, 8> ports;
+  module.getPortInfo(ports);
+  for (auto portAndArg : llvm::zip(ports, module.getArguments())) {
+    auto &port = std::get<0>(portAndArg);
+    auto arg = std::get<1>(portAndArg);
+    if (getTrackedWidth(arg.getType()) == -1 || port.isInOut() ||
+        (isMain && port.isInput()))
+      markOverdefined(arg);
+    else
+      storage.push_back(arg);
+  }
+
+  module.getBodyBlock()->walk([&](Operation *op) {
+    if (isa<WireOp, RegOp, RegResetOp>(op))
+      storage.push_back(op->getResult(0));
+    visitOperation(op);
+  });
+}
+
+/// Bind the subfields of `instance` to the ports of the module it instantiates,
+/// and start analyzing that module.
+void IMConstPropPass::visitInstance(InstanceOp instance) {
+  auto module = dyn_cast_or_null<FModuleOp>(
+      instanceGraph->getReferencedModule(instance));
+
+  // Nothing is known about the outputs of an external module.
+  if (!module) {
+    for (auto *user : instance.getResult().getUsers())
+      if (isa<SubfieldOp>(user))
+        markOverdefined(user->getResult(0));
+    return;
+  }
+  markModuleExecutable(module, /*isMain=*/false);
+
+  SmallVector<ModulePortInfo, 8> ports;
+  module.getPortInfo(ports);
+  llvm::StringMap<unsigned> portIndices;
+  for (unsigned i = 0, e = ports.size(); i != e; ++i)
+    portIndices[ports[i].getName()] = i;
+
+  for (auto *user : instance.getResult().getUsers()) {
+    auto subfield = dyn_cast<SubfieldOp>(user);
+    auto it = subfield ? portIndices.find(subfield.fieldname())
+                       : portIndices.end();
+    if (it == portIndices.end()) {
+      // The instance is used as a whole, its inputs could be driven by
+      // anything.
+      for (auto portAndArg : llvm::zip(ports, module.getArguments()))
+        if (std::get<0>(portAndArg).isInput())
+          markOverdefined(std::get<1>(portAndArg));
+      for (auto result : user->getResults())
+        markOverdefined(result);
+      continue;
+    }
+
+    auto arg = module.getArgument(it->second);
+    subfieldPorts[subfield] = arg;
+    portSubfields[arg].push_back(subfield);
+    mergeLatticeValue(subfield, getLatticeValue(arg));
+  }
+}
+
+/// Merge the value of the source of `connect` into its destination.
+void IMConstPropPass::visitConnect(ConnectOp connect) {
+  // The ports of an instance are driven through the ports of the module.
+  Value dest = connect.dest();
+  if (auto port = subfieldPorts.lookup(dest))
+    dest = port;
+  else if (!dest.isa<BlockArgument>() &&
+           !dest.getDefiningOp<WireOp>() && !dest.getDefiningOp<RegOp>() &&
+           !dest.getDefiningOp<RegResetOp>())
+    return;
+
+  mergeExtendedValue(dest, connect.src());
+}
+
+/// Compute the lattice value of the results of `op` from its operands.
+void IMConstPropPass::visitOperation(Operation *op) {
+  if (auto constant = dyn_cast<ConstantOp>(op)) {
+    mergeLatticeValue(constant, LatticeValue::getConstant(constant.value()));
+    return;
+  }
+  if (auto connect = dyn_cast<ConnectOp>(op))
+    return visitConnect(connect);
+  if (auto instance = dyn_cast<InstanceOp>(op))
+    return visitInstance(instance);
+
+  // Wires and registers are driven by connects, a register with a reset also
+  // by its reset value.
+  if (isa<WireOp, RegOp, RegResetOp>(op)) {
+    auto result = op->getResult(0);
+    if (getTrackedWidth(result.getType()) == -1) {
+      markOverdefined(result);
+      return;
+    }
+    if (auto reg = dyn_cast<RegResetOp>(op))
+      mergeExtendedValue(result, reg.resetValue());
+    return;
+  }
+
+  // The subfields of instances follow the ports of the instantiated module.
+  if (auto subfield = dyn_cast<SubfieldOp>(op))
+    if (subfield.input().getDefiningOp<InstanceOp>())
+      return;
+
+  // Anything driven in another way than a connect can't be tracked.
+  if (auto connect = dyn_cast<PartialConnectOp>(op)) {
+    auto dest = connect.dest();
+    markOverdefined(subfieldPorts.lookup(dest) ? subfieldPorts.lookup(dest)
+                                               : dest);
+    return;
+  }
+  if (auto asNonPassive = dyn_cast<AsNonPassivePrimOp>(op)) {
+    auto input = asNonPassive.input();
+    markOverdefined(subfieldPorts.lookup(input) ? subfieldPorts.lookup(input)
+                                                : input);
+    markOverdefined(asNonPassive);
+    return;
+  }
+
+  // Reading an output port or a node doesn't change its value.
+  if (isa<AsPassivePrimOp, NodeOp>(op)) {
+    mergeLatticeValue(op->getResult(0), getLatticeValue(op->getOperand(0)));
+    return;
+  }
+
+  // A multiplexer with a known select signal forwards one of its operands.
+  if (auto mux = dyn_cast<MuxPrimOp>(op)) {
+    auto sel = getLatticeValue(mux.sel());
+    if (sel.isConstant()) {
+      mergeExtendedValue(mux, sel.getValue().isNullValue() ? mux.low()
+                                                           : mux.high());
+      return;
+    }
+  }
+
+  if (op->getNumResults() == 0)
+    return;
+  if (op->getNumRegions() != 0 || !MemoryEffectOpInterface::hasNoEffect(op)) {
+    for (auto result : op->getResults())
+      markOverdefined(result);
+    return;
+  }
+
+  // Fold the operation once all its operands are known.  Overdefined operands
+  // are passed as null, the folder may still find a constant.
+  SmallVector<Attribute, 4> operands;
+  for (auto operand : op->getOperands()) {
+    auto lattice = getLatticeValue(operand);
+    if (lattice.isUnknown())
+      return;
+    if (lattice.isOverdefined()) {
+      operands.push_back({});
+      continue;
+    }
+    auto &value = lattice.getValue();
+    operands.push_back(IntegerAttr::get(
+        IntegerType::get(op->getContext(), value.getBitWidth()), value));
+  }
+
+  SmallVector<OpFoldResult, 4> foldResults;
+  if (failed(op->fold(operands, foldResults)) || foldResults.empty()) {
+    for (auto result : op->getResults())
+      markOverdefined(result);
+    return;
+  }
+  for (auto resultAndFold : llvm::zip(op->getResults(), foldResults)) {
+    auto result = std::get<0>(resultAndFold);
+    auto foldResult = std::get<1>(resultAndFold);
+    if (auto value = foldResult.dyn_cast<Value>()) {
+      mergeLatticeValue(result, getLatticeValue(value));
+      continue;
+    }
+    auto attr = foldResult.get<Attribute>().dyn_cast_or_null<IntegerAttr>();
+    mergeLatticeValue(result, attr ? LatticeValue::getConstant(attr.getValue())
+                                   : LatticeValue::getOverdefined());
+  }
+}
+
+/// Replace the values of `module` found to be constant by constants, and
+/// remove what is left unused.
+void IMConstPropPass::rewriteModule(FModuleOp module) {
+  auto *body = module.getBodyBlock();
+
+  // Materialize each constant once, at the start of the module, reusing the
+  // constants already there.
+  DenseMap<Attribute, Value> constants;
+  SmallVector<ConstantOp, 8> existing(body->getOps<ConstantOp>());
+  for (auto constant : llvm::reverse(existing)) {
+    constant->moveBefore(body, body->begin());
+    constants.try_emplace(constant.valueAttr(), constant);
+  }
+  auto builder = OpBuilder::atBlockBegin(body);
+  if (!existing.empty())
+    builder.setInsertionPointAfter(existing.back());
+  auto getConstant = [&](Value value) -> Value {
+    auto type = value.getType().dyn_cast<IntType>();
+    auto lattice = getLatticeValue(value);
+    if (!type || !lattice.isConstant())
+      return {};
+    auto signedness =
+        type.isSigned() ? IntegerType::Signed : IntegerType::Unsigned;
+    auto attr = builder.getIntegerAttr(
+        IntegerType::get(builder.getContext(), type.getWidthOrSentinel(),
+                         signedness),
+        lattice.getValue());
+    auto &constant = constants[attr];
+    if (!constant)
+      constant = builder.create<ConstantOp>(value.getLoc(), type, attr);
+    return constant;
+  };
+
+  for (auto arg : module.getArguments())
+    if (auto constant = getConstant(arg))
+      arg.replaceAllUsesWith(constant);
+
+  // Visit the users before the operations they use, so that these are erased
+  // once they are left unused.
+  SmallVector<Operation *, 64> ops;
+  body->walk([&](Operation *op) { ops.push_back(op); });
+  for (auto *op : llvm::reverse(ops)) {
+    if (isa<ConstantOp>(op)) {
+      if (op->use_empty())
+        op->erase();
+      continue;
+    }
+
+    // A constant wire or register is removed along with its connects, which
+    // come after it.
+    if (isa<WireOp, RegOp, RegResetOp>(op)) {
+      auto constant = getConstant(op->getResult(0));
+      if (!constant)
+        continue;
+      SmallVector<Operation *, 4> connects;
+      for (auto &use :
+           llvm::make_early_inc_range(op->getResult(0).getUses())) {
+        if (isa<ConnectOp>(use.getOwner()) && use.getOperandNumber() == 0)
+          connects.push_back(use.getOwner());
+        else
+          use.set(constant);
+      }
+      for (auto *connect : connects)
+        connect->erase();
+      op->erase();
+      continue;
+    }
+
+    for (auto result : op->getResults())
+      if (auto constant = getConstant(result))
+        result.replaceAllUsesWith(constant);
+    if (isOpTriviallyDead(op))
+      op->erase();
+  }
+}
+
+void IMConstPropPass::runOnOperation() {
+  auto circuit = getOperation();
+  instanceGraph = &getAnalysis<InstanceGraph>();
+
+  auto *mainNode = instanceGraph->lookup(circuit.name());
+  auto main = mainNode ? dyn_cast<FModuleOp>(mainNode->getModule()) : nullptr;
+  if (!main) {
+    markAllAnalysesPreserved();
+    return;
+  }
+
+  // Propagate the lattice values until nothing changes.  The wires, registers
+  // and ports still unknown then are driven through a cycle: mark them
+  // overdefined, and propagate that.
+  markModuleExecutable(main, /*isMain=*/true);
+  for (;;) {
+    while (!changedValues.empty()) {
+      auto value = changedValues.pop_back_val();
+      for (auto *user : value.getUsers())
+        visitOperation(user);
+      auto it = portSubfields.find(value);
+      if (it != portSubfields.end())
+        for (auto subfield : it->second)
+          mergeLatticeValue(subfield, getLatticeValue(value));
+    }
+
+    for (auto value : storage)
+      if (getLatticeValue(value).isUnknown())
+        markOverdefined(value);
+    if (changedValues.empty())
+      break;
+  }
+
+  // Each module only touches its own body, so they can be rewritten in
+  // parallel.
+  SmallVector<FModuleOp, 0> modules;
+  for (auto module : circuit.getBody()->getOps<FModuleOp>())
+    if (executableModules.count(module))
+      modules.push_back(module);
+  if (getContext().isMultithreadingEnabled()) {
+    llvm::parallelForEachN(0, modules.size(),
+                           [&](size_t i) { rewriteModule(modules[i]); });
+  } else {
+    for (auto module : modules)
+      rewriteModule(module);
+  }
+
+  latticeValues.clear();
+  executableModules.clear();
+  storage.clear();
+  subfieldPorts.clear();
+  portSubfields.clear();
+  markAnalysesPreserved<InstanceGraph>();
+}
+
+std::unique_ptr<mlir::Pass> circt::firrtl::createIMConstPropPass() {
+  return std::make_unique<IMConstPropPass>();
+}
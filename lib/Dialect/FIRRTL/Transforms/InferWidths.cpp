@@ -0,0 +1,657 @@
+//===- InferWidths.cpp - Infer width of types -------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//===----------------------------------------------------------------------===//
+//
+// This file implements inference of the widths of FIRRTL integer and analog
+// types which were left unspecified in the source.
+//
+// Every ground type in the circuit gets a width variable.  Values which refer
+// to part of another value (subfields, subindexes, nodes, instance ports, ...)
+// share the variables of what they refer to, so each module port, wire,
+// register and expression has one set of variables for the whole circuit.
+// Connects constrain the destination to be at least as wide as the source, and
+// the width of each primitive operation is a function of its operands, given by
+// its getResultType().  The constraint graph is solved one strongly connected
+// component at a time, in dependence order, so acyclic logic is visited once.
+//
+//===----------------------------------------------------------------------===//
+
+#include "./PassDetails.h"
+#include "circt/Dialect/FIRRTL/FIRRTLOps.h"
+#include "circt/Dialect/FIRRTL/FIRRTLTypes.h"
+#include "circt/Dialect/FIRRTL/Passes.h"
+#include "llvm/ADT/TypeSwitch.h"
+
+using namespace circt;
+using namespace firrtl;
+
+/// Widths beyond this are considered a failure to converge.
+static constexpr int32_t kMaxWidth = 1 << 20;
+
+/// Return the number of ground types in `type`.  The elements of a vector all
+/// have the same type, so they share their widths and count once.
+static unsigned getNumLeaves(FIRRTLType type) {
+  return TypeSwitch<FIRRTLType, unsigned>(type)
+      .Case<FlipType>([](FlipType type) {
+        return getNumLeaves(type.getElementType());
+      })
+      .Case<BundleType>([](BundleType type) {
+        unsigned numLeaves = 0;
+        for (auto &element : type.getElements())
+          numLeaves += getNumLeaves(element.type);
+        return numLeaves;
+      })
+      .Case<FVectorType>([](FVectorType type) {
+        return getNumLeaves(type.getElementType());
+      })
+      .Default([](FIRRTLType) { return 1; });
+}
+
+/// Call `fn` on each ground type in `type`, in order.
+static void forEachLeaf(FIRRTLType type,
+                        llvm::function_ref<void(FIRRTLType)> fn) {
+  TypeSwitch<FIRRTLType>(type)
+      .Case<FlipType>([&](FlipType type) {
+        forEachLeaf(type.getElementType(), fn);
+      })
+      .Case<BundleType>([&](BundleType type) {
+        for (auto &element : type.getElements())
+          forEachLeaf(element.type, fn);
+      })
+      .Case<FVectorType>([&](FVectorType type) {
+        forEachLeaf(type.getElementType(), fn);
+      })
+      .Default([&](FIRRTLType type) { fn(type); });
+}
+
+/// Return true if `type` has an integer or analog type without a width.
+static bool hasUninferredWidth(Type type) {
+  auto firrtlType = type.dyn_cast<FIRRTLType>();
+  if (!firrtlType)
+    return false;
+  bool result = false;
+  forEachLeaf(firrtlType, [&](FIRRTLType leaf) {
+    result |= leaf.getBitWidthOrSentinel() == -1;
+  });
+  return result;
+}
+
+/// Call `fn` for each pair of ground types which are connected by a connect or
+/// partial connect of `src` to `dest`.  Bundle fields are matched by name, so
+/// this works for both.  The leaves are identified by their index relative to
+/// `destLeaf` and `srcLeaf`, and `flip` is set if the data flows from the
+/// destination to the source.
+static void
+forEachConnectedLeaf(FIRRTLType dest, FIRRTLType src, unsigned destLeaf,
+                     unsigned srcLeaf, bool flip,
+                     llvm::function_ref<void(unsigned, unsigned, bool)> fn) {
+  if (auto flipType = dest.dyn_cast<FlipType>())
+    return forEachConnectedLeaf(flipType.getElementType(), src, destLeaf,
+                                srcLeaf, !flip, fn);
+  if (auto flipType = src.dyn_cast<FlipType>())
+    return forEachConnectedLeaf(dest, flipType.getElementType(), destLeaf,
+                                srcLeaf, flip, fn);
+
+  if (auto destBundle = dest.dyn_cast<BundleType>()) {
+    auto srcBundle = src.dyn_cast<BundleType>();
+    if (!srcBundle)
+      return;
+    unsigned destOffset = 0;
+    for (auto &destElt : destBundle.getElements()) {
+      unsigned srcOffset = 0;
+      for (auto &srcElt : srcBundle.getElements()) {
+        if (srcElt.name == destElt.name) {
+          forEachConnectedLeaf(destElt.type, srcElt.type,
+                               destLeaf + destOffset, srcLeaf + srcOffset,
+                               flip, fn);
+          break;
+        }
+        srcOffset += getNumLeaves(srcElt.type);
+      }
+      destOffset += getNumLeaves(destElt.type);
+    }
+    return;
+  }
+
+  if (auto destVector = dest.dyn_cast<FVectorType>()) {
+    if (auto srcVector = src.dyn_cast<FVectorType>())
+      forEachConnectedLeaf(destVector.getElementType(),
+                           srcVector.getElementType(), destLeaf, srcLeaf, flip,
+                           fn);
+    return;
+  }
+
+  fn(destLeaf, srcLeaf, flip);
+}
+
+/// Compute the result type of the primitive operation `op` for the specified
+/// operand types, or return null if it isn't a primitive.
+static FIRRTLType inferResultType(Operation *op,
+                                  ArrayRef<FIRRTLType> operandTypes) {
+  auto loc = op->getLoc();
+  return TypeSwitch<Operation *, FIRRTLType>(op)
+      .Case<AddPrimOp, SubPrimOp, MulPrimOp, DivPrimOp, RemPrimOp, AndPrimOp,
+            OrPrimOp, XorPrimOp, LEQPrimOp, LTPrimOp, GEQPrimOp, GTPrimOp,
+            EQPrimOp, NEQPrimOp, CatPrimOp, DShlPrimOp, DShlwPrimOp,
+            DShrPrimOp>([&](auto op) {
+        return decltype(op)::getResultType(operandTypes[0], operandTypes[1],
+                                           loc);
+      })
+      .Case<AsSIntPrimOp, AsUIntPrimOp, AsAsyncResetPrimOp, AsClockPrimOp,
+            CvtPrimOp, NegPrimOp, NotPrimOp, AndRPrimOp, OrRPrimOp,
+            XorRPrimOp>([&](auto op) {
+        return decltype(op)::getResultType(operandTypes[0], loc);
+      })
+      .Case<BitsPrimOp>([&](BitsPrimOp op) {
+        return BitsPrimOp::getResultType(operandTypes[0], op.hi(), op.lo(),
+                                         loc);
+      })
+      .Case<HeadPrimOp, PadPrimOp, ShlPrimOp, ShrPrimOp, TailPrimOp>(
+          [&](auto op) {
+            return decltype(op)::getResultType(operandTypes[0], op.amount(),
+                                               loc);
+          })
+      .Default([](Operation *) { return FIRRTLType(); });
+}
+
+//===----------------------------------------------------------------------===//
+// Pass Infrastructure
+//===----------------------------------------------------------------------===//
+
+namespace {
+/// The width of one ground type in the circuit.
+struct WidthVar {
+  enum Kind {
+    /// The width was given in the source.
+    Fixed,
+    /// The width is the largest of the widths of `deps`.
+    Max,
+    /// The width is computed by the primitive `expr` from the widths of its
+    /// operands, `deps`.
+    Expr
+  };
+
+  WidthVar(Kind kind, int32_t width, Operation *expr)
+      : kind(kind), width(width), expr(expr) {}
+
+  Kind kind;
+  /// The width, or -1 if it isn't known yet.
+  int32_t width;
+  Operation *expr;
+  SmallVector<unsigned, 2> deps;
+};
+
+struct InferWidthsPass : public InferWidthsBase<InferWidthsPass> {
+  void runOnOperation() override;
+
+private:
+  unsigned allocate(FIRRTLType type, Operation *expr = nullptr,
+                    bool isExpr = false);
+  unsigned getLeaf(Value value);
+  void addLeafDeps(Value value, SmallVectorImpl<unsigned> &deps);
+  void addConstraints(Operation *op);
+  void addMaxDep(unsigned var, unsigned dep);
+
+  LogicalResult solve();
+  bool evaluate(unsigned var, bool unknownAsZero = false);
+  FIRRTLType getSolvedType(FIRRTLType type, unsigned &leaf,
+                           bool unknownAsZero = false);
+
+  LogicalResult updatePorts(Operation *module, FunctionType type);
+
+  /// All the width variables in the circuit.
+  std::vector<WidthVar> vars;
+  /// The first variable of each value. The rest follow in order.
+  DenseMap<Value, unsigned> leaves;
+  /// The first variable of the ports of each module.
+  DenseMap<Operation *, unsigned> portLeaves;
+};
+} // end anonymous namespace
+
+/// Allocate consecutive variables for the ground types in `type`. Unknown
+/// widths are computed by `expr` if `isExpr`, and are the max of their
+/// constraints otherwise.
+unsigned InferWidthsPass::allocate(FIRRTLType type, Operation *expr,
+                                   bool isExpr) {
+  unsigned first = vars.size();
+  forEachLeaf(type, [&](FIRRTLType leaf) {
+    int32_t width = leaf.getBitWidthOrSentinel();
+    if (width >= 0)
+      vars.emplace_back(WidthVar::Fixed, width, nullptr);
+    else if (width == -1)
+      vars.emplace_back(isExpr ? WidthVar::Expr : WidthVar::Max, -1, expr);
+    else
+      // A malformed type; it will be reported by the verifier.
+      vars.emplace_back(WidthVar::Fixed, 0, nullptr);
+  });
+  return first;
+}
+
+/// Return the first variable of `value`, allocating variables for it if
+/// needed.  References to part of another value share its variables.
+unsigned InferWidthsPass::getLeaf(Value value) {
+  auto it = leaves.find(value);
+  if (it != leaves.end())
+    return it->second;
+
+  // Block arguments are module ports, allocated up front.
+  auto *op = value.getDefiningOp();
+  auto type = value.getType().cast<FIRRTLType>();
+  unsigned leaf =
+      TypeSwitch<Operation *, unsigned>(op)
+          .Case<SubfieldOp>([&](SubfieldOp op) {
+            auto input = op.input().getType().cast<FIRRTLType>();
+            if (auto flipType = input.dyn_cast<FlipType>())
+              input = flipType.getElementType();
+            unsigned offset = 0;
+            for (auto &element : input.cast<BundleType>().getElements()) {
+              if (element.name == op.fieldname())
+                break;
+              offset += getNumLeaves(element.type);
+            }
+            return getLeaf(op.input()) + offset;
+          })
+          .Case<SubindexOp, SubaccessOp, NodeOp, AsPassivePrimOp,
+                AsNonPassivePrimOp>(
+              [&](auto op) { return getLeaf(op.input()); })
+          .Case<ValidIfPrimOp>(
+              [&](ValidIfPrimOp op) { return getLeaf(op.rhs()); })
+          .Case<InstanceOp>([&](InstanceOp op) {
+            auto it = portLeaves.find(op.getReferencedModule());
+            if (it != portLeaves.end())
+              return it->second;
+            return allocate(type);
+          })
+          .Case<ConstantOp>([&](ConstantOp op) {
+            auto intType = type.cast<IntType>();
+            if (intType.hasWidth())
+              return allocate(type);
+            // An unsized literal is as wide as its value needs.
+            APInt value = op.value();
+            int32_t width = intType.isSigned()
+                                ? value.getMinSignedBits()
+                                : std::max(1u, value.getActiveBits());
+            vars.emplace_back(WidthVar::Fixed, width, nullptr);
+            return unsigned(vars.size() - 1);
+          })
+          .Case<WireOp, RegOp, RegResetOp, InvalidValuePrimOp, MuxPrimOp,
+                MemOp, CMemOp, SMemOp, MemoryPortOp>(
+              [&](Operation *op) { return allocate(type, op); })
+          .Default([&](Operation *op) {
+            return allocate(type, op, /*isExpr=*/op->getNumResults() == 1);
+          });
+  leaves[value] = leaf;
+  return leaf;
+}
+
+/// Add all the variables of `value` to `deps`.
+void InferWidthsPass::addLeafDeps(Value value,
+                                  SmallVectorImpl<unsigned> &deps) {
+  auto type = value.getType().dyn_cast<FIRRTLType>();
+  if (!type)
+    return;
+  unsigned first = getLeaf(value);
+  for (unsigned i = 0, e = getNumLeaves(type); i != e; ++i)
+    deps.push_back(first + i);
+}
+
+/// Record that `var` is at least as wide as `dep`.
+void InferWidthsPass::addMaxDep(unsigned var, unsigned dep) {
+  if (vars[var].kind == WidthVar::Max)
+    vars[var].deps.push_back(dep);
+}
+
+/// Add the constraints imposed by `op`.
+void InferWidthsPass::addConstraints(Operation *op) {
+  auto connect = [&](Value dest, Value src) {
+    auto destType = dest.getType().cast<FIRRTLType>();
+    auto srcType = src.getType().cast<FIRRTLType>();
+    // An invalid value takes on the width of whatever it's connected to,
+    // rather than constraining it.
+    bool isInvalid = src.getDefiningOp<InvalidValuePrimOp>();
+    unsigned destLeaf = getLeaf(dest), srcLeaf = getLeaf(src);
+    if (auto flipType = destType.dyn_cast<FlipType>())
+      destType = flipType.getElementType();
+    if (auto flipType = srcType.dyn_cast<FlipType>())
+      srcType = flipType.getElementType();
+    forEachConnectedLeaf(destType, srcType, destLeaf, srcLeaf, /*flip=*/false,
+                         [&](unsigned destVar, unsigned srcVar, bool flip) {
+                           if (flip || isInvalid)
+                             addMaxDep(srcVar, destVar);
+                           else
+                             addMaxDep(destVar, srcVar);
+                         });
+  };
+
+  TypeSwitch<Operation *>(op)
+      .Case<ConnectOp, PartialConnectOp>(
+          [&](auto op) { connect(op.dest(), op.src()); })
+      .Case<RegResetOp>([&](RegResetOp op) {
+        connect(op.getResult(), op.resetValue());
+      })
+      .Case<MuxPrimOp>([&](MuxPrimOp op) {
+        connect(op.getResult(), op.high());
+        connect(op.getResult(), op.low());
+      })
+      .Case<AttachOp>([&](AttachOp op) {
+        // Attached analog values all have the same width.
+        auto operands = op.getOperands();
+        for (unsigned i = 1, e = operands.size(); i < e; ++i) {
+          unsigned lhs = getLeaf(operands[i - 1]), rhs = getLeaf(operands[i]);
+          addMaxDep(lhs, rhs);
+          addMaxDep(rhs, lhs);
+        }
+      })
+      .Default([&](Operation *op) {
+        if (op->getNumResults() != 1 ||
+            !op->getResult(0).getType().isa<FIRRTLType>())
+          return;
+        unsigned leaf = getLeaf(op->getResult(0));
+        if (vars[leaf].kind != WidthVar::Expr || vars[leaf].expr != op)
+          return;
+        for (auto operand : op->getOperands())
+          addLeafDeps(operand, vars[leaf].deps);
+      });
+}
+
+/// Recompute the width of `var` from its dependences. Returns true if it grew.
+/// Unknown operand widths are taken to be zero if `unknownAsZero`, which gives
+/// the members of a cycle something to start from.
+bool InferWidthsPass::evaluate(unsigned var, bool unknownAsZero) {
+  auto &widthVar = vars[var];
+  int32_t width = -1;
+  switch (widthVar.kind) {
+  case WidthVar::Fixed:
+    return false;
+  case WidthVar::Max:
+    for (auto dep : widthVar.deps)
+      width = std::max(width, vars[dep].width);
+    break;
+  case WidthVar::Expr: {
+    SmallVector<FIRRTLType, 3> operandTypes;
+    for (auto operand : widthVar.expr->getOperands()) {
+      auto type = operand.getType().dyn_cast<FIRRTLType>();
+      if (!type)
+        return false;
+      unsigned leaf = getLeaf(operand);
+      operandTypes.push_back(getSolvedType(type, leaf, unknownAsZero));
+      if (hasUninferredWidth(operandTypes.back()))
+        return false;
+    }
+    if (auto type = inferResultType(widthVar.expr, operandTypes))
+      width = type.getBitWidthOrSentinel();
+    break;
+  }
+  }
+
+  if (width <= widthVar.width)
+    return false;
+  widthVar.width = width;
+  return true;
+}
+
+/// Solve the constraints, visiting the strongly connected components of the
+/// dependence graph in an order where each one comes after the ones it depends
+/// on (Tarjan's algorithm, without recursion since the graph can be deep).
+LogicalResult InferWidthsPass::solve() {
+  const unsigned unvisited = ~0U;
+  std::vector<unsigned> index(vars.size(), unvisited), lowLink(vars.size());
+  std::vector<bool> onStack(vars.size());
+  SmallVector<unsigned, 32> stack;
+  SmallVector<std::pair<unsigned, unsigned>, 32> callStack;
+  SmallVector<unsigned, 8> component;
+  unsigned nextIndex = 0;
+
+  auto visit = [&](unsigned var) {
+    index[var] = lowLink[var] = nextIndex++;
+    stack.push_back(var);
+    onStack[var] = true;
+    callStack.push_back({var, 0});
+  };
+
+  for (unsigned root = 0, e = vars.size(); root != e; ++root) {
+    if (index[root] != unvisited)
+      continue;
+    visit(root);
+    while (!callStack.empty()) {
+      unsigned var = callStack.back().first;
+      unsigned depIdx = callStack.back().second;
+      auto &deps = vars[var].deps;
+      if (depIdx < deps.size()) {
+        ++callStack.back().second;
+        unsigned dep = deps[depIdx];
+        if (index[dep] == unvisited)
+          visit(dep);
+        else if (onStack[dep])
+          lowLink[var] = std::min(lowLink[var], index[dep]);
+        continue;
+      }
+
+      callStack.pop_back();
+      if (!callStack.empty()) {
+        unsigned parent = callStack.back().first;
+        lowLink[parent] = std::min(lowLink[parent], lowLink[var]);
+      }
+      if (lowLink[var] != index[var])
+        continue;
+
+      component.clear();
+      unsigned member;
+      do {
+        member = stack.pop_back_val();
+        onStack[member] = false;
+        component.push_back(member);
+      } while (member != var);
+
+      // Everything this component depends on is solved. A single variable
+      // which doesn't depend on itself is computed once; a cycle is iterated
+      // until it reaches a fixed point, which it must do within a number of
+      // rounds proportional to its size unless something in it grows
+      // unboundedly. The widths in a cycle which are still unknown start out
+      // as zero, or no member would ever get a width.
+      bool isCycle =
+          component.size() > 1 || llvm::is_contained(vars[var].deps, var);
+      bool changed = true, tooWide = false;
+      for (unsigned round = 0, rounds = 2 * component.size() + 2;
+           changed && !tooWide && round != rounds; ++round) {
+        changed = false;
+        for (auto member : component) {
+          changed |= evaluate(member, isCycle);
+          tooWide |= vars[member].width > kMaxWidth;
+        }
+      }
+      if (changed) {
+        // Report an expression of the cycle, which is what makes the widths
+        // grow; connections only propagate them.
+        unsigned culprit = var;
+        for (auto member : component)
+          if (vars[member].kind == WidthVar::Expr &&
+              (vars[culprit].kind != WidthVar::Expr || member < culprit))
+            culprit = member;
+        auto *op = vars[culprit].expr;
+        auto diag = op ? op->emitError() : getOperation().emitError();
+        diag << "width inference does not converge: a cycle of connections "
+                "requires an ever increasing width";
+        return failure();
+      }
+    }
+  }
+  return success();
+}
+
+/// Return `type` with the solved widths of the variables starting at `leaf`,
+/// and advance `leaf` past them. Unknown widths are zero if `unknownAsZero`.
+FIRRTLType InferWidthsPass::getSolvedType(FIRRTLType type, unsigned &leaf,
+                                          bool unknownAsZero) {
+  auto *context = type.getContext();
+  return TypeSwitch<FIRRTLType, FIRRTLType>(type)
+      .Case<FlipType>([&](FlipType type) {
+        return FlipType::get(
+            getSolvedType(type.getElementType(), leaf, unknownAsZero));
+      })
+      .Case<BundleType>([&](BundleType type) {
+        SmallVector<BundleType::BundleElement, 8> elements;
+        for (auto &element : type.getElements())
+          elements.emplace_back(
+              element.name, getSolvedType(element.type, leaf, unknownAsZero));
+        return BundleType::get(elements, context);
+      })
+      .Case<FVectorType>([&](FVectorType type) {
+        return FVectorType::get(
+            getSolvedType(type.getElementType(), leaf, unknownAsZero),
+            type.getNumElements());
+      })
+      .Case<IntType>([&](IntType type) -> FIRRTLType {
+        int32_t width = vars[leaf++].width;
+        if (unknownAsZero)
+          width = std::max(width, 0);
+        return IntType::get(context, type.isSigned(), width);
+      })
+      .Case<AnalogType>([&](AnalogType type) -> FIRRTLType {
+        int32_t width = vars[leaf++].width;
+        if (unknownAsZero)
+          width = std::max(width, 0);
+        return AnalogType::get(context, width);
+      })
+      .Default([&](FIRRTLType type) {
+        ++leaf;
+        return type;
+      });
+}
+
+/// Update the port types of `module` to the solved widths. Returns failure if
+/// some of them are unconstrained.
+LogicalResult InferWidthsPass::updatePorts(Operation *module,
+                                           FunctionType type) {
+  unsigned leaf = portLeaves[module];
+  SmallVector<Type, 8> inputs;
+  for (auto input : type.getInputs()) {
+    auto newType = getSolvedType(input.cast<FIRRTLType>(), leaf);
+    if (hasUninferredWidth(newType))
+      return module->emitError("uninferred width: port type ")
+             << input << " is unconstrained";
+    inputs.push_back(newType);
+  }
+
+  auto newType = FunctionType::get(module->getContext(), inputs, {});
+  if (auto fmodule = dyn_cast<FModuleOp>(module)) {
+    for (auto arg : fmodule.getArguments())
+      arg.setType(inputs[arg.getArgNumber()]);
+    fmodule.setType(newType);
+  } else {
+    cast<FExtModuleOp>(module).setType(newType);
+  }
+  return success();
+}
+
+void InferWidthsPass::runOnOperation() {
+  auto circuit = getOperation();
+
+  // Most circuits have all their widths, there's nothing to do for those.
+  auto hasUninferredValue = [](Operation *op) {
+    return llvm::any_of(op->getResultTypes(), hasUninferredWidth);
+  };
+  bool anyUninferred = false;
+  circuit.walk([&](Operation *op) {
+    if (anyUninferred)
+      return;
+    if (auto module = dyn_cast<FModuleOp>(op))
+      anyUninferred = llvm::any_of(module.getType().getInputs(),
+                                   hasUninferredWidth);
+    else if (auto module = dyn_cast<FExtModuleOp>(op))
+      anyUninferred = llvm::any_of(module.getType().getInputs(),
+                                   hasUninferredWidth);
+    else
+      anyUninferred = hasUninferredValue(op);
+  });
+  if (!anyUninferred) {
+    markAllAnalysesPreserved();
+    return;
+  }
+
+  // Allocate the ports first, so that instances can share them.
+  SmallVector<FModuleOp, 16> modules;
+  for (auto &op : *circuit.getBody()) {
+    FunctionType type;
+    if (auto module = dyn_cast<FModuleOp>(op)) {
+      modules.push_back(module);
+      type = module.getType();
+    } else if (auto module = dyn_cast<FExtModuleOp>(op)) {
+      type = module.getType();
+    } else {
+      continue;
+    }
+    portLeaves[&op] = vars.size();
+    for (auto input : type.getInputs())
+      allocate(input.cast<FIRRTLType>());
+  }
+  for (auto module : modules) {
+    unsigned leaf = portLeaves[module];
+    for (auto arg : module.getArguments()) {
+      leaves[arg] = leaf;
+      leaf += getNumLeaves(arg.getType().cast<FIRRTLType>());
+    }
+  }
+
+  // Build the constraint graph and solve it.
+  for (auto module : modules)
+    module.walk([&](Operation *op) { addConstraints(op); });
+  if (failed(solve()))
+    return signalPassFailure();
+
+  // Replace the uninferred types, reporting anything which is unconstrained.
+  bool failedToInfer = false;
+  auto updateType = [&](Value value) {
+    auto type = value.getType().dyn_cast<FIRRTLType>();
+    if (!type || !hasUninferredWidth(type))
+      return;
+    unsigned leaf = getLeaf(value);
+    auto newType = getSolvedType(type, leaf);
+    if (hasUninferredWidth(newType)) {
+      mlir::emitError(value.getLoc(), "uninferred width: type ")
+          << type << " is unconstrained";
+      failedToInfer = true;
+      return;
+    }
+    value.setType(newType);
+
+    // Keep the value of unsized constants consistent with their type.
+    if (auto constant = value.getDefiningOp<ConstantOp>()) {
+      auto intType = newType.cast<IntType>();
+      unsigned width = intType.getWidthOrSentinel();
+      APInt cst = intType.isSigned() ? constant.value().sextOrTrunc(width)
+                                     : constant.value().zextOrTrunc(width);
+      auto attrType = IntegerType::get(
+          constant.getContext(), width,
+          intType.isSigned() ? IntegerType::Signed : IntegerType::Unsigned);
+      constant->setAttr("value", IntegerAttr::get(attrType, cst));
+    }
+  };
+
+  for (auto &op : *circuit.getBody()) {
+    if (auto module = dyn_cast<FModuleOp>(op)) {
+      if (llvm::any_of(module.getType().getInputs(), hasUninferredWidth))
+        failedToInfer |= failed(updatePorts(module, module.getType()));
+      module.walk([&](Operation *op) {
+        for (auto result : op->getResults())
+          updateType(result);
+      });
+    } else if (auto module = dyn_cast<FExtModuleOp>(op)) {
+      if (llvm::any_of(module.getType().getInputs(), hasUninferredWidth))
+        failedToInfer |= failed(updatePorts(module, module.getType()));
+    }
+  }
+
+  vars.clear();
+  leaves.clear();
+  portLeaves.clear();
+  if (failedToInfer)
+    signalPassFailure();
+}
+
+std::unique_ptr<mlir::Pass> circt::firrtl::createInferWidthsPass() {
+  return std::make_unique<InferWidthsPass>();
+}
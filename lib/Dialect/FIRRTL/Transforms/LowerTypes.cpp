@@ -19,50 +19,6 @@
 using namespace circt;
 using namespace firrtl;
 
-namespace {
-// This represents a flattened bundle field element.
-struct FlatBundleFieldEntry {
-  // This is the underlying ground type of the field.
-  FIRRTLType type;
-  // This is a suffix to add to the field name to make it unique.
-  std::string suffix;
-  // This indicates whether the field was flipped to be an output.
-  bool isOutput;
-
-  // Helper to determine if a fully flattened type needs to be flipped.
-  FIRRTLType getPortType() { return isOutput ? FlipType::get(type) : type; }
-};
-} // end anonymous namespace
-
-// Convert a nested bundle of fields into a flat list of fields.  This is used
-// when working with instances and mems to flatten them.
-static void flattenBundleTypes(FIRRTLType type, StringRef suffixSoFar,
-                               bool isFlipped,
-                               SmallVectorImpl<FlatBundleFieldEntry> &results) {
-  if (auto flip = type.dyn_cast<FlipType>())
-    return flattenBundleTypes(flip.getElementType(), suffixSoFar, !isFlipped,
-                              results);
-
-  // In the base case we record this field.
-  auto bundle = type.dyn_cast<BundleType>();
-  if (!bundle) {
-    results.push_back({type, suffixSoFar.str(), isFlipped});
-    return;
-  }
-
-  SmallString<16> tmpSuffix(suffixSoFar);
-
-  // Otherwise, we have a bundle type.  Break it down.
-  for (auto &elt : bundle.getElements()) {
-    // Construct the suffix to pass down.
-    tmpSuffix.resize(suffixSoFar.size());
-    tmpSuffix.push_back('_');
-    tmpSuffix.append(elt.name.strref());
-    // Recursively process subelements.
-    flattenBundleTypes(elt.type, tmpSuffix, isFlipped, results);
-  }
-}
-
 // Helper to peel off the outer most flip type from a bundle that has all flips
 // canonicalized to the outer level, or just return the bundle directly. For any
 // other type, returns null.
@@ -167,10 +123,7 @@ void FIRRTLTypesLowering::lowerArg(BlockArgument arg, FIRRTLType type) {
   unsigned argNumber = arg.getArgNumber();
 
   // Flatten any bundle types.
-  SmallVector<FlatBundleFieldEntry, 8> fieldTypes;
-  flattenBundleTypes(type, "", false, fieldTypes);
-
-  for (auto field : fieldTypes) {
+  for (auto field : getFlatBundleFields(type)) {
     // Create new block arguments.
     auto type = field.getPortType();
     auto newValue = addArg(type, argNumber, field.suffix);
@@ -178,7 +131,7 @@ void FIRRTLTypesLowering::lowerArg(BlockArgument arg, FIRRTLType type) {
     // If this field was flattened from a bundle.
     if (!field.suffix.empty()) {
       // Remove field separator prefix for consitency with the rest of the pass.
-      auto fieldName = StringRef(field.suffix).drop_front(1);
+      auto fieldName = field.suffix.drop_front(1);
 
       // Map the flattened suffix for the original bundle to the new value.
       setBundleLowering(arg, fieldName, newValue);
@@ -213,12 +166,13 @@ void FIRRTLTypesLowering::visitDecl(InstanceOp op) {
   SmallVector<BundleType::BundleElement, 8> bundleElements;
   for (auto element : originalBundleType.getElements()) {
     // Flatten any nested bundle types the usual way.
-    SmallVector<FlatBundleFieldEntry, 8> fieldTypes;
-    flattenBundleTypes(element.type, element.name, isFlip, fieldTypes);
-
-    for (auto field : fieldTypes) {
+    for (auto field : getFlatBundleFields(element.type)) {
       // Store the flat type for the new bundle type.
-      auto flatName = builder->getIdentifier(field.suffix);
+      SmallString<16> name(element.name.strref());
+      name += field.suffix;
+      auto flatName = builder->getIdentifier(name);
+      if (isFlip)
+        field.isOutput = !field.isOutput;
       auto flatType = field.getPortType();
       auto newElement = BundleType::BundleElement{flatName, flatType};
       bundleElements.push_back(newElement);
@@ -260,20 +214,17 @@ void FIRRTLTypesLowering::visitExpr(SubfieldOp op) {
   FIRRTLType resultType = op.getType();
 
   // Flatten any nested bundle types the usual way.
-  SmallVector<FlatBundleFieldEntry, 8> fieldTypes;
-  flattenBundleTypes(resultType, fieldname, false, fieldTypes);
-
-  for (auto field : fieldTypes) {
+  SmallString<16> flatField(fieldname);
+  for (auto field : getFlatBundleFields(resultType)) {
     // Look up the mapping for this suffix.
-    auto newValue = getBundleLowering(input, field.suffix);
-
-    // The prefix is the field name and possibly field separator.
-    auto prefixSize = fieldname.size();
-    if (field.suffix.size() > fieldname.size())
-      prefixSize += 1;
-
-    // Get the remaining field suffix by removing the prefix.
-    auto partialSuffix = StringRef(field.suffix).drop_front(prefixSize);
+    flatField.resize(fieldname.size());
+    flatField += field.suffix;
+    auto newValue = getBundleLowering(input, flatField);
+
+    // Get the remaining field suffix by removing the field separator.
+    auto partialSuffix = field.suffix;
+    if (!partialSuffix.empty())
+      partialSuffix = partialSuffix.drop_front(1);
 
     // If we are at the leaf of a bundle.
     if (partialSuffix.empty())
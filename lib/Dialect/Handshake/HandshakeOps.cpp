@@ -68,9 +68,124 @@ void ForkOp::build(OpBuilder &builder, OperationState &result, Value operand,
   bool isControl = operand.getType().isa<NoneType>() ? true : false;
   result.addAttribute("control", builder.getBoolAttr(isControl));
 }
+
+namespace {
+/// Replace the forks fed by the outputs of a fork with more outputs of that
+/// fork.  A tree of forks hands a token to all its leaves, like a single fork
+/// with an output per leaf.
+struct FlattenForkTreePattern : public OpRewritePattern<ForkOp> {
+  using OpRewritePattern<ForkOp>::OpRewritePattern;
+
+  LogicalResult matchAndRewrite(ForkOp fork,
+                                PatternRewriter &rewriter) const override {
+    SmallVector<ForkOp, 4> children;
+    unsigned numOutputs = 0;
+    for (auto result : fork.getResults()) {
+      ForkOp child;
+      if (result.hasOneUse())
+        child = dyn_cast<ForkOp>(*result.getUsers().begin());
+      children.push_back(child);
+      numOutputs += child ? child.getNumResults() : 1;
+    }
+    if (llvm::none_of(children, [](ForkOp child) { return bool(child); }))
+      return failure();
+
+    auto newFork =
+        rewriter.create<ForkOp>(fork.getLoc(), fork.getOperand(), numOutputs);
+
+    // The outputs feeding a child fork are left unused.
+    SmallVector<Value, 8> replacements;
+    auto newResults = newFork.getResults();
+    for (auto child : children) {
+      if (!child) {
+        replacements.push_back(newResults.front());
+        newResults = newResults.drop_front();
+        continue;
+      }
+      rewriter.replaceOp(child, newResults.take_front(child.getNumResults()));
+      newResults = newResults.drop_front(child.getNumResults());
+      replacements.push_back(newFork.getResult(0));
+    }
+    rewriter.replaceOp(fork, replacements);
+    return success();
+  }
+};
+
+/// Remove the outputs of a fork which are discarded by a sink.  A fork whose
+/// outputs are all discarded is replaced by a sink.
+struct SinkUnusedForkOutputsPattern : public OpRewritePattern<ForkOp> {
+  using OpRewritePattern<ForkOp>::OpRewritePattern;
+
+  LogicalResult matchAndRewrite(ForkOp fork,
+                                PatternRewriter &rewriter) const override {
+    auto isDiscarded = [](Value result) {
+      return result.use_empty() ||
+             (result.hasOneUse() && isa<SinkOp>(*result.getUsers().begin()));
+    };
+    unsigned numLive = llvm::count_if(
+        fork.getResults(), [&](Value result) { return !isDiscarded(result); });
+    if (numLive == fork.getNumResults())
+      return failure();
+
+    for (auto result : fork.getResults())
+      if (isDiscarded(result))
+        for (auto *sink : llvm::make_early_inc_range(result.getUsers()))
+          rewriter.eraseOp(sink);
+
+    if (numLive == 0) {
+      rewriter.create<SinkOp>(fork.getLoc(), fork.getOperand());
+      rewriter.eraseOp(fork);
+      return success();
+    }
+
+    auto newFork =
+        rewriter.create<ForkOp>(fork.getLoc(), fork.getOperand(), numLive);
+    SmallVector<Value, 8> replacements;
+    unsigned nextResult = 0;
+    for (auto result : fork.getResults())
+      replacements.push_back(result.use_empty()
+                                 ? newFork.getResult(0)
+                                 : newFork.getResult(nextResult++));
+    rewriter.replaceOp(fork, replacements);
+    return success();
+  }
+};
+} // end anonymous namespace
+
 void handshake::ForkOp::getCanonicalizationPatterns(
     OwningRewritePatternList &results, MLIRContext *context) {
-  results.insert<circt::handshake::EliminateSimpleForksPattern>(context);
+  results.insert<circt::handshake::EliminateSimpleForksPattern,
+                 FlattenForkTreePattern, SinkUnusedForkOutputsPattern>(
+      context);
+}
+
+namespace {
+/// Merge a buffer into the buffer of the same kind feeding it.  A chain of
+/// buffers holds as many tokens as a single buffer with all their slots.
+struct MergeBuffersPattern : public OpRewritePattern<BufferOp> {
+  using OpRewritePattern<BufferOp>::OpRewritePattern;
+
+  LogicalResult matchAndRewrite(BufferOp buffer,
+                                PatternRewriter &rewriter) const override {
+    auto producer = buffer->getOperand(0).getDefiningOp<BufferOp>();
+    if (!producer || !producer->hasOneUse() ||
+        producer.isSequential() != buffer.isSequential())
+      return failure();
+
+    unsigned slots = producer.getNumSlots().getZExtValue() +
+                     buffer.getNumSlots().getZExtValue();
+    rewriter.replaceOpWithNewOp<BufferOp>(
+        buffer, buffer.getType(), producer->getOperand(0),
+        buffer.isSequential(), buffer.isControl(), slots);
+    rewriter.eraseOp(producer);
+    return success();
+  }
+};
+} // end anonymous namespace
+
+void handshake::BufferOp::getCanonicalizationPatterns(
+    OwningRewritePatternList &results, MLIRContext *context) {
+  results.insert<MergeBuffersPattern>(context);
 }
 
 void LazyForkOp::build(OpBuilder &builder, OperationState &result,
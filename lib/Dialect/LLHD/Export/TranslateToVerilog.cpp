@@ -14,22 +14,35 @@
 #include "circt/Dialect/LLHD/IR/LLHDOps.h"
 #include "mlir/Dialect/StandardOps/IR/Ops.h"
 #include "mlir/IR/BuiltinOps.h"
+#include "mlir/IR/Diagnostics.h"
 #include "mlir/IR/Visitors.h"
 #include "mlir/Support/LogicalResult.h"
 #include "mlir/Translation.h"
-#include "llvm/ADT/Twine.h"
-#include "llvm/Support/FormattedStream.h"
+#include "llvm/Support/Parallel.h"
 
 using namespace mlir;
 using namespace circt;
 
 namespace {
 
+/// The name of an SSA value, `_` followed by its number.
+struct VariableName {
+  unsigned number;
+};
+
+raw_ostream &operator<<(raw_ostream &os, VariableName name) {
+  return os << '_' << name.number;
+}
+
+/// Prints a single entity as a Verilog module. The instances are numbered from
+/// the given first number, such that the entities can be printed separately
+/// and still get module-wide unique instance names.
 class VerilogPrinter {
 public:
-  VerilogPrinter(llvm::formatted_raw_ostream &output) : out(output) {}
+  VerilogPrinter(raw_ostream &output, unsigned firstInstance = 0)
+      : instCount(firstInstance), out(output) {}
 
-  LogicalResult printModule(ModuleOp op);
+  LogicalResult printEntity(llhd::EntityOp entity);
   LogicalResult printOperation(Operation *op, unsigned indentAmount = 0);
 
 private:
@@ -41,60 +54,49 @@ private:
   LogicalResult printSignedBinaryOp(Operation *op, StringRef opSymbol,
                                     unsigned indentAmount = 0);
 
-  /// Prints a SSA value. In case no mapping to a name exists yet, a new one is
-  /// added.
-  Twine getVariableName(Value value);
-
-  Twine getNewInstantiationName() {
-    return Twine("inst_") + Twine(instCount++);
-  }
+  /// Returns the name of a SSA value. In case no mapping to a name exists yet,
+  /// a new one is added.
+  VariableName getVariableName(Value value);
 
   /// Adds an alias for an existing SSA value. In case doesn't exist, it just
   /// adds the alias as a new value.
   void addAliasVariable(Value alias, Value existing);
 
-  unsigned instCount = 0;
-  llvm::formatted_raw_ostream &out;
+  unsigned instCount;
+  raw_ostream &out;
   unsigned nextValueNum = 0;
   DenseMap<Value, unsigned> mapValueToName;
   DenseMap<Value, unsigned> timeValueMap;
 };
 
-LogicalResult VerilogPrinter::printModule(ModuleOp module) {
-  WalkResult result = module.walk([this](llhd::EntityOp entity) -> WalkResult {
-    // An EntityOp always has a single block
-    Block &entryBlock = entity.body().front();
-
-    // Print the module signature
-    out << "module _" << entity.getName();
-    if (!entryBlock.args_empty()) {
-      out << "(";
-      for (unsigned int i = 0, e = entryBlock.getNumArguments(); i < e; ++i) {
-        out << (i > 0 ? ", " : "") << (i < entity.ins() ? "input " : "output ");
-        printType(entryBlock.getArgument(i).getType());
-        out << " " << getVariableName(entryBlock.getArgument(i));
-      }
-      out << ")";
+LogicalResult VerilogPrinter::printEntity(llhd::EntityOp entity) {
+  // An EntityOp always has a single block
+  Block &entryBlock = entity.body().front();
+
+  // Print the module signature
+  out << "module _" << entity.getName();
+  if (!entryBlock.args_empty()) {
+    out << "(";
+    for (unsigned int i = 0, e = entryBlock.getNumArguments(); i < e; ++i) {
+      out << (i > 0 ? ", " : "") << (i < entity.ins() ? "input " : "output ");
+      printType(entryBlock.getArgument(i).getType());
+      out << " " << getVariableName(entryBlock.getArgument(i));
     }
-    out << ";\n";
+    out << ")";
+  }
+  out << ";\n";
 
-    // Print the operations within the entity
-    for (auto iter = entryBlock.begin();
-         iter != entryBlock.end() && !dyn_cast<llhd::TerminatorOp>(iter);
-         ++iter) {
-      if (failed(printOperation(&(*iter), 4))) {
-        return emitError(iter->getLoc(), "Operation not supported!");
-      }
+  // Print the operations within the entity
+  for (auto iter = entryBlock.begin();
+       iter != entryBlock.end() && !dyn_cast<llhd::TerminatorOp>(iter);
+       ++iter) {
+    if (failed(printOperation(&(*iter), 4))) {
+      return emitError(iter->getLoc(), "Operation not supported!");
     }
+  }
 
-    out << "endmodule\n";
-    // Reset variable name counter as variables only have to be unique within a
-    // module
-    nextValueNum = 0;
-    return WalkResult::advance();
-  });
-  // if printing of a single operation failed, fail the whole translation
-  return failure(result.wasInterrupted());
+  out << "endmodule\n";
+  return success();
 }
 
 LogicalResult VerilogPrinter::printBinaryOp(Operation *inst, StringRef opSymbol,
@@ -110,7 +112,7 @@ LogicalResult VerilogPrinter::printBinaryOp(Operation *inst, StringRef opSymbol,
   }
 
   // Print the operation
-  out.PadToColumn(indentAmount);
+  out.indent(indentAmount);
   out << "wire ";
   if (failed(printType(inst->getResult(0).getType())))
     return failure();
@@ -144,7 +146,7 @@ LogicalResult VerilogPrinter::printSignedBinaryOp(Operation *inst,
   }
 
   // Print the operation
-  out.PadToColumn(indentAmount);
+  out.indent(indentAmount);
   out << "wire ";
   if (failed(printType(inst->getResult(0).getType())))
     return failure();
@@ -167,7 +169,7 @@ LogicalResult VerilogPrinter::printUnaryOp(Operation *inst, StringRef opSymbol,
   }
 
   // Print the operation
-  out.PadToColumn(indentAmount);
+  out.indent(indentAmount);
   out << "wire ";
   if (failed(printType(inst->getResult(0).getType())))
     return failure();
@@ -181,7 +183,7 @@ LogicalResult VerilogPrinter::printOperation(Operation *inst,
   if (auto op = dyn_cast<llhd::ConstOp>(inst)) {
     if (IntegerAttr intAttr = op.value().dyn_cast<IntegerAttr>()) {
       // Integer constant
-      out.PadToColumn(indentAmount);
+      out.indent(indentAmount);
       out << "wire ";
       if (failed(printType(inst->getResult(0).getType())))
         return failure();
@@ -206,7 +208,7 @@ LogicalResult VerilogPrinter::printOperation(Operation *inst,
     return failure();
   }
   if (auto op = dyn_cast<llhd::SigOp>(inst)) {
-    out.PadToColumn(indentAmount);
+    out.indent(indentAmount);
     out << "var ";
     if (failed(printType(inst->getResult(0).getType())))
       return failure();
@@ -220,7 +222,7 @@ LogicalResult VerilogPrinter::printOperation(Operation *inst,
     return success();
   }
   if (auto op = dyn_cast<llhd::DrvOp>(inst)) {
-    out.PadToColumn(indentAmount);
+    out.indent(indentAmount);
     out << "assign " << getVariableName(op.signal()) << " = #("
         << timeValueMap.lookup(op.time()) << "ns) ";
     if (op.enable()) {
@@ -250,19 +252,19 @@ LogicalResult VerilogPrinter::printOperation(Operation *inst,
         inst->getOperand(1).getType().getIntOrFloatBitWidth();
     unsigned combinedWidth = baseWidth + hiddenWidth;
 
-    out.PadToColumn(indentAmount);
+    out.indent(indentAmount);
     out << "wire [" << (combinedWidth - 1) << ":0] "
         << getVariableName(inst->getResult(0)) << "tmp0 = {"
         << getVariableName(inst->getOperand(0)) << ", "
         << getVariableName(inst->getOperand(1)) << "};\n";
 
-    out.PadToColumn(indentAmount);
+    out.indent(indentAmount);
     out << "wire [" << (combinedWidth - 1) << ":0] "
         << getVariableName(inst->getResult(0))
         << "tmp1 = " << getVariableName(inst->getResult(0)) << "tmp0 << "
         << getVariableName(inst->getOperand(2)) << ";\n";
 
-    out.PadToColumn(indentAmount);
+    out.indent(indentAmount);
     out << "wire ";
     if (failed(printType(inst->getResult(0).getType())))
       return failure();
@@ -278,19 +280,19 @@ LogicalResult VerilogPrinter::printOperation(Operation *inst,
         inst->getOperand(1).getType().getIntOrFloatBitWidth();
     unsigned combinedWidth = baseWidth + hiddenWidth;
 
-    out.PadToColumn(indentAmount);
+    out.indent(indentAmount);
     out << "wire [" << (combinedWidth - 1) << ":0] "
         << getVariableName(inst->getResult(0)) << "tmp0 = {"
         << getVariableName(inst->getOperand(1)) << ", "
         << getVariableName(inst->getOperand(0)) << "};\n";
 
-    out.PadToColumn(indentAmount);
+    out.indent(indentAmount);
     out << "wire [" << (combinedWidth - 1) << ":0] "
         << getVariableName(inst->getResult(0))
         << "tmp1 = " << getVariableName(inst->getResult(0)) << "tmp0 << "
         << getVariableName(inst->getOperand(2)) << ";\n";
 
-    out.PadToColumn(indentAmount);
+    out.indent(indentAmount);
     out << "wire ";
     if (failed(printType(inst->getResult(0).getType())))
       return failure();
@@ -356,8 +358,8 @@ LogicalResult VerilogPrinter::printOperation(Operation *inst,
     return failure();
   }
   if (auto op = dyn_cast<llhd::InstOp>(inst)) {
-    out.PadToColumn(indentAmount);
-    out << "_" << op.callee() << " " << getNewInstantiationName();
+    out.indent(indentAmount);
+    out << "_" << op.callee() << " inst_" << instCount++;
     if (op.inputs().size() > 0 || op.outputs().size() > 0)
       out << " (";
     unsigned counter = 0;
@@ -393,12 +395,11 @@ LogicalResult VerilogPrinter::printType(Type type) {
   return failure();
 }
 
-Twine VerilogPrinter::getVariableName(Value value) {
-  if (!mapValueToName.count(value)) {
-    mapValueToName.insert(std::make_pair(value, nextValueNum));
+VariableName VerilogPrinter::getVariableName(Value value) {
+  auto it = mapValueToName.try_emplace(value, nextValueNum);
+  if (it.second)
     nextValueNum++;
-  }
-  return Twine("_") + Twine(mapValueToName.lookup(value));
+  return {it.first->second};
 }
 
 void VerilogPrinter::addAliasVariable(Value alias, Value existing) {
@@ -414,9 +415,46 @@ void VerilogPrinter::addAliasVariable(Value alias, Value existing) {
 } // anonymous namespace
 
 LogicalResult circt::llhd::exportVerilog(ModuleOp module, raw_ostream &os) {
-  llvm::formatted_raw_ostream out(os);
-  VerilogPrinter printer(out);
-  return printer.printModule(module);
+  // Variables only have to be unique within a module, but the instances are
+  // numbered across all of them, in order.
+  SmallVector<llhd::EntityOp, 8> entities;
+  SmallVector<unsigned, 8> firstInstances;
+  unsigned numInstances = 0;
+  module.walk([&](llhd::EntityOp entity) {
+    entities.push_back(entity);
+    firstInstances.push_back(numInstances);
+    auto insts = entity.body().front().getOps<llhd::InstOp>();
+    numInstances += std::distance(insts.begin(), insts.end());
+  });
+
+  if (!module.getContext()->isMultithreadingEnabled()) {
+    for (size_t i = 0, e = entities.size(); i < e; ++i)
+      if (failed(VerilogPrinter(os, firstInstances[i])
+                     .printEntity(entities[i])))
+        return failure();
+    return success();
+  }
+
+  // Print every entity into its own buffer on the thread pool, then print the
+  // buffers in order, up to the first entity which failed.
+  std::vector<std::string> buffers(entities.size());
+  std::vector<char> entityFailed(entities.size(), false);
+  ParallelDiagnosticHandler diagHandler(module.getContext());
+  llvm::parallelForEachN(0, entities.size(), [&](size_t i) {
+    diagHandler.setOrderIDForThread(i);
+    llvm::raw_string_ostream entityOS(buffers[i]);
+    entityFailed[i] = failed(
+        VerilogPrinter(entityOS, firstInstances[i]).printEntity(entities[i]));
+    entityOS.flush();
+    diagHandler.eraseOrderIDForThread();
+  });
+
+  for (size_t i = 0, e = entities.size(); i < e; ++i) {
+    os << buffers[i];
+    if (entityFailed[i])
+      return failure();
+  }
+  return success();
 }
 
 void circt::llhd::registerToVerilogTranslation() {
@@ -524,6 +524,49 @@ OpFoldResult llhd::ExtractSliceOp::fold(ArrayRef<Attribute> operands) {
   return nullptr;
 }
 
+//===----------------------------------------------------------------------===//
+// InsertSliceOp
+//===----------------------------------------------------------------------===//
+
+OpFoldResult llhd::InsertSliceOp::fold(ArrayRef<Attribute> operands) {
+  uint64_t insertStart = startAttr().getInt();
+
+  // llhd.insert_slice(target, slice, 0) with sliceWidth==targetWidth => slice
+  if (insertStart == 0 && getSliceSize() == getTargetSize())
+    return slice();
+
+  // llhd.insert_slice(target, llhd.extract_slice(target, a), a) => target
+  if (auto extOp = slice().getDefiningOp<llhd::ExtractSliceOp>())
+    if (extOp.target() == target() &&
+        extOp.startAttr().getInt() == (int64_t)insertStart)
+      return target();
+
+  // llhd.insert_slice(llhd.insert_slice(target, slice, a), slice2, b)
+  //   with b <= a && a + sliceWidth <= b + slice2Width
+  //   => llhd.insert_slice(target, slice2, b)
+  if (auto insertOp = target().getDefiningOp<llhd::InsertSliceOp>()) {
+    uint64_t innerStart = insertOp.startAttr().getInt();
+    if (insertStart <= innerStart &&
+        innerStart + insertOp.getSliceSize() <= insertStart + getSliceSize()) {
+      targetMutable().assign(insertOp.target());
+      return result();
+    }
+  }
+
+  if (!operands[0] || !operands[1])
+    return nullptr;
+
+  auto targetAttr = operands[0].dyn_cast<IntegerAttr>();
+  auto sliceAttr = operands[1].dyn_cast<IntegerAttr>();
+  if (targetAttr && sliceAttr) {
+    APInt value = targetAttr.getValue();
+    value.insertBits(sliceAttr.getValue(), insertStart);
+    return IntegerAttr::get(result().getType(), value);
+  }
+
+  return nullptr;
+}
+
 //===----------------------------------------------------------------------===//
 // DrvOp
 //===----------------------------------------------------------------------===//
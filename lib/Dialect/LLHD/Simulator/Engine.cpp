@@ -12,28 +12,500 @@
 
 #include "State.h"
 #include "Trace.h"
+#include "signals-runtime-wrappers.h"
 
 #include "circt/Conversion/LLHDToLLVM/LLHDToLLVM.h"
 #include "circt/Dialect/LLHD/Simulator/Engine.h"
+#include "circt/Dialect/LLHD/Simulator/Transport.h"
+#include "circt/Support/InstanceGraph.h"
 
 #include "mlir/ExecutionEngine/ExecutionEngine.h"
+#include "mlir/ExecutionEngine/OptUtils.h"
 #include "mlir/IR/Builders.h"
+#include "mlir/Target/LLVMIR.h"
 
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SHA1.h"
 #include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <mutex>
 
 using namespace mlir;
 using namespace circt::llhd::sim;
 
+/// Return the path of the cached object for the given module, root and
+/// optimization level in the cache directory. The key also covers the build of
+/// the simulator and the host the object is generated for, such that objects
+/// of an other build, LLVM version or host are not reused.
+static std::string getJITCachePath(ModuleOp module, StringRef root,
+                                   unsigned optLevel, StringRef cacheDir) {
+  std::string key;
+  llvm::raw_string_ostream os(key);
+  module.print(os);
+  os << "\nroot: " << root << "\nopt: " << optLevel;
+  os << "\nllvm: " << LLVM_VERSION_STRING << "\ntriple: "
+     << llvm::sys::getProcessTriple()
+     << "\ncpu: " << llvm::sys::getHostCPUName();
+  // Identify the simulator build by its executable, whose runtime library the
+  // cached objects call into.
+  auto tool = llvm::sys::fs::getMainExecutable(
+      nullptr, reinterpret_cast<void *>(&getJITCachePath));
+  llvm::sys::fs::file_status status;
+  if (!llvm::sys::fs::status(tool, status))
+    os << "\ntool: " << tool << " " << status.getSize() << " "
+       << status.getLastModificationTime().time_since_epoch().count();
+  auto digest = llvm::SHA1::hash(llvm::arrayRefFromStringRef(os.str()));
+
+  SmallString<128> path(cacheDir);
+  llvm::sys::path::append(path, llvm::toHex(digest, /*LowerCase=*/true) + ".o");
+  return path.str().str();
+}
+
+/// Create a JIT from a previously compiled object file. The runtime library
+/// symbols are resolved from the current process.
+static llvm::Expected<std::unique_ptr<llvm::orc::LLJIT>>
+loadCachedObject(StringRef path) {
+  auto buffer = llvm::MemoryBuffer::getFile(path);
+  if (!buffer)
+    return llvm::errorCodeToError(buffer.getError());
+
+  auto jit = llvm::orc::LLJITBuilder().create();
+  if (!jit)
+    return jit.takeError();
+
+  auto generator =
+      llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+          (*jit)->getDataLayout().getGlobalPrefix());
+  if (!generator)
+    return generator.takeError();
+  (*jit)->getMainJITDylib().addGenerator(std::move(*generator));
+
+  if (auto err = (*jit)->addObjectFile(std::move(*buffer)))
+    return std::move(err);
+  return std::move(*jit);
+}
+
+/// Add the packed interface of every function defined in the module, i.e. a
+/// `_mlir_<name>` function taking an array of pointers to the arguments, the
+/// way mlir::ExecutionEngine does.
+static void packFunctionArguments(llvm::Module *module) {
+  auto &ctx = module->getContext();
+  llvm::IRBuilder<> builder(ctx);
+  SmallVector<llvm::Function *, 16> functions;
+  for (auto &func : module->getFunctionList())
+    if (!func.isDeclaration())
+      functions.push_back(&func);
+
+  for (auto *func : functions) {
+    auto *packedType = llvm::FunctionType::get(
+        builder.getVoidTy(), builder.getInt8PtrTy()->getPointerTo(),
+        /*isVarArg=*/false);
+    auto *packed =
+        llvm::Function::Create(packedType, llvm::GlobalValue::ExternalLinkage,
+                               "_mlir_" + func->getName(), module);
+    builder.SetInsertPoint(llvm::BasicBlock::Create(ctx, "entry", packed));
+
+    // Load each argument through the pointer stored at its index.
+    llvm::Value *argList = packed->arg_begin();
+    SmallVector<llvm::Value *, 8> args;
+    for (auto &indexedArg : llvm::enumerate(func->args())) {
+      auto *argIndex = builder.getInt64(indexedArg.index());
+      auto *argPtrPtr = builder.CreateGEP(argList, argIndex);
+      auto *argPtr = builder.CreateLoad(argPtrPtr);
+      auto *argType = indexedArg.value().getType();
+      argPtr = builder.CreateBitCast(argPtr, argType->getPointerTo());
+      args.push_back(builder.CreateLoad(argPtr));
+    }
+    auto *result = builder.CreateCall(func, args);
+
+    // The result, if any, is stored at the index following the arguments.
+    if (!result->getType()->isVoidTy()) {
+      auto *retIndex = builder.getInt64(func->arg_size());
+      auto *retPtrPtr = builder.CreateGEP(argList, retIndex);
+      auto *retPtr = builder.CreateLoad(retPtrPtr);
+      retPtr = builder.CreateBitCast(retPtr, result->getType()->getPointerTo());
+      builder.CreateStore(result, retPtr);
+    }
+    builder.CreateRetVoid();
+  }
+}
+
+/// Translate the lowered module to LLVM IR for the given JIT, including the
+/// packed interfaces of its functions.
+static llvm::Expected<std::unique_ptr<llvm::Module>>
+translateForJIT(ModuleOp module, llvm::LLVMContext &ctx,
+                llvm::orc::LLJIT &jit) {
+  auto llvmModule = mlir::translateModuleToLLVMIR(module, ctx);
+  if (!llvmModule)
+    return llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                   "failed to translate the module");
+  llvmModule->setDataLayout(jit.getDataLayout());
+  llvmModule->setTargetTriple(jit.getTargetTriple().str());
+  packFunctionArguments(llvmModule.get());
+  return std::move(llvmModule);
+}
+
+/// Create a JIT compiling each function of the lowered module on its first
+/// call, on up to the given number of compile threads. The runtime library
+/// symbols are resolved from the current process.
+static llvm::Expected<std::unique_ptr<llvm::orc::LLJIT>>
+createLazyJIT(ModuleOp module, unsigned optLevel, unsigned compileThreads) {
+  auto jit = llvm::orc::LLLazyJITBuilder()
+                 .setNumCompileThreads(compileThreads)
+                 .create();
+  if (!jit)
+    return jit.takeError();
+
+  auto generator =
+      llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+          (*jit)->getDataLayout().getGlobalPrefix());
+  if (!generator)
+    return generator.takeError();
+  (*jit)->getMainJITDylib().addGenerator(std::move(*generator));
+
+  auto ctx = std::make_unique<llvm::LLVMContext>();
+  auto llvmModule = translateForJIT(module, *ctx, **jit);
+  if (!llvmModule)
+    return llvmModule.takeError();
+
+  // Optimize every partition of the module right before it gets compiled.
+  auto transformer = mlir::makeOptimizingTransformer(optLevel, 0, nullptr);
+  (*jit)->getIRTransformLayer().setTransform(
+      [transformer](llvm::orc::ThreadSafeModule tsm,
+                    const llvm::orc::MaterializationResponsibility &)
+          -> llvm::Expected<llvm::orc::ThreadSafeModule> {
+        if (auto err = tsm.withModuleDo(
+                [&](llvm::Module &module) { return transformer(&module); }))
+          return std::move(err);
+        return std::move(tsm);
+      });
+
+  if (auto err = (*jit)->addLazyIRModule(llvm::orc::ThreadSafeModule(
+          std::move(*llvmModule), std::move(ctx))))
+    return std::move(err);
+  return std::unique_ptr<llvm::orc::LLJIT>(std::move(*jit));
+}
+
+/// Return the real time of the given delay in picoseconds, or None if it is
+/// not a constant time or has an unknown unit.
+static Optional<uint64_t> getConstantPicoseconds(Value delay) {
+  static const llvm::StringMap<uint64_t> exponents = {
+      {"s", 12}, {"ms", 9}, {"us", 6}, {"ns", 3}, {"ps", 0}};
+  auto constOp = delay.getDefiningOp<ConstOp>();
+  auto time = constOp ? constOp.value().dyn_cast<TimeAttr>() : TimeAttr();
+  if (!time || !exponents.count(time.getTimeUnit()))
+    return llvm::None;
+  return static_cast<uint64_t>(
+             std::pow(10, exponents.lookup(time.getTimeUnit()))) *
+         time.getTime();
+}
+
+/// Return the minimum real-time delay of all the drives of the module in
+/// picoseconds, or zero if some drive is not delayed by any real time or has a
+/// delay which is not a constant.
+static uint64_t getDriveLookahead(ModuleOp module) {
+  Optional<uint64_t> lookahead;
+  auto addDelay = [&](Value delay) {
+    uint64_t ps = getConstantPicoseconds(delay).getValueOr(0);
+    lookahead = std::min(lookahead.getValueOr(ps), ps);
+  };
+  module.walk([&](Operation *op) {
+    if (auto drv = dyn_cast<DrvOp>(op))
+      addDelay(drv.time());
+    else if (auto reg = dyn_cast<RegOp>(op))
+      for (auto delay : reg.delays())
+        addDelay(delay);
+  });
+  return lookahead.getValueOr(0);
+}
+
+namespace {
+/// An update of a range of bits of a signal value.
+struct BitUpdate {
+  uint64_t offset;
+  uint64_t width;
+  const uint64_t *data;
+};
+} // namespace
+
+/// Apply the updates to a signal value of the given size in bytes. Only the
+/// words of the value covered by the updates are staged in the scratch buffer,
+/// updated and compared, such that updating one element of a large array
+/// signal does not touch the rest of it. Returns the updated byte range of the
+/// value if it changed, an empty range otherwise.
+static std::pair<uint64_t, uint64_t>
+applyBitUpdates(uint8_t *value, uint64_t sigSize, ArrayRef<BitUpdate> updates,
+                SmallVectorImpl<uint64_t> &scratch) {
+  // Updates are clipped to the signal, those starting past its end are
+  // dropped.
+  const uint64_t sigWidth = sigSize * 8;
+  auto clipWidth = [&](const BitUpdate &update) -> uint64_t {
+    if (update.offset >= sigWidth)
+      return 0;
+    return std::min<uint64_t>(update.width, sigWidth - update.offset);
+  };
+  uint64_t low = sigWidth, high = 0;
+  for (auto &update : updates) {
+    if (clipWidth(update) == 0)
+      continue;
+    low = std::min(low, update.offset);
+    high = std::max(high, update.offset + clipWidth(update));
+  }
+  if (low >= high)
+    return std::make_pair(0, 0);
+
+  // Signal windows fitting in one word are handled in a register.
+  const uint64_t firstWord = low / 64;
+  const uint64_t numWords = llvm::divideCeil(high, 64) - firstWord;
+  const uint64_t begin = firstWord * 8;
+  const uint64_t end = std::min(sigSize, begin + numWords * 8);
+  uint64_t word = 0;
+  uint64_t *buff = &word;
+  if (numWords > 1) {
+    scratch.assign(numWords, 0);
+    buff = scratch.data();
+  }
+  std::memcpy(buff, value + begin, end - begin);
+  for (auto &update : updates)
+    if (uint64_t width = clipWidth(update))
+      insertBits(buff, update.offset - firstWord * 64, update.data, width);
+
+  if (std::memcmp(value + begin, buff, end - begin) == 0)
+    return std::make_pair(0, 0);
+  std::memcpy(value + begin, buff, end - begin);
+  return std::make_pair(begin, end);
+}
+
+namespace circt {
+namespace llhd {
+namespace sim {
+/// Statistics recorded while simulating in profiling mode.
+struct Profile {
+  struct InstanceStats {
+    uint64_t activations = 0;
+    std::chrono::nanoseconds time{0};
+  };
+  struct SignalStats {
+    // The number of drives applied to the signal.
+    uint64_t drives = 0;
+    // The number of drives that changed the signal value.
+    uint64_t changes = 0;
+  };
+  /// Running maximum and sum of a per-step quantity.
+  struct StepStats {
+    void add(uint64_t value) {
+      max = std::max(max, value);
+      sum += value;
+    }
+    uint64_t max = 0;
+    uint64_t sum = 0;
+  };
+
+  std::vector<InstanceStats> instances;
+  std::vector<SignalStats> signals;
+  uint64_t steps = 0;
+  // The events (drives and scheduled wakeups) of each popped slot.
+  StepStats events;
+  // The instances run in each step.
+  StepStats wakeups;
+  // The pending slots in the queue at each step.
+  StepStats pendingSlots;
+};
+
+/// The background recompilation of the hot units in tiered mode. Every unit is
+/// first compiled without optimizations by the lazy JIT. Once an instance of a
+/// unit has run often enough, the unit and the functions it calls are cloned
+/// from a copy of the lowered module, optimized and compiled into their own
+/// JITDylib on a background thread. The other symbols resolve to the first
+/// tier. The engine swaps in the optimized units between two steps.
+struct TierUp {
+  TierUp(llvm::orc::LLJIT &jit, unsigned optLevel)
+      : jit(jit), ctx(std::make_unique<llvm::LLVMContext>()),
+        transformer(mlir::makeOptimizingTransformer(optLevel, 0, nullptr)),
+        pool(llvm::hardware_concurrency(1)) {}
+
+  /// Recompile the given unit in the background, unless already requested.
+  /// Can be called from any simulation thread.
+  void request(StringRef unit) {
+    std::lock_guard<std::mutex> guard(mutex);
+    if (!requested.insert(unit).second)
+      return;
+    pool.async([this, name = unit.str()] { compile(name); });
+  }
+
+  /// Compile an optimized copy of the given unit and queue it to be swapped
+  /// in. On failure, the unit keeps running unoptimized.
+  void compile(const std::string &unit) {
+    auto packedName = "_mlir_" + unit;
+    std::unique_ptr<llvm::Module> clone;
+    {
+      auto lock = ctx.getLock();
+      auto *packed = source->getFunction(packedName);
+      if (!packed)
+        return;
+
+      // Keep the functions reachable from the unit and the constants they use.
+      llvm::SmallPtrSet<const llvm::GlobalValue *, 16> keep;
+      SmallVector<const llvm::GlobalValue *, 16> worklist({packed});
+      while (!worklist.empty()) {
+        auto *value = worklist.pop_back_val();
+        if (!keep.insert(value).second)
+          continue;
+        auto *func = dyn_cast<llvm::Function>(value);
+        if (!func)
+          continue;
+        for (auto &inst : llvm::instructions(func))
+          for (auto *operand : inst.operand_values()) {
+            auto *stripped = operand->stripPointerCasts();
+            if (auto *callee = dyn_cast<llvm::Function>(stripped)) {
+              if (!callee->isDeclaration())
+                worklist.push_back(callee);
+              continue;
+            }
+            auto *global = dyn_cast<llvm::GlobalVariable>(stripped);
+            if (global && global->isConstant() && global->hasInitializer())
+              worklist.push_back(global);
+          }
+      }
+
+      llvm::ValueToValueMapTy mapping;
+      clone = llvm::CloneModule(
+          *source, mapping,
+          [&](const llvm::GlobalValue *value) { return keep.count(value); });
+      if (auto err = transformer(clone.get())) {
+        llvm::consumeError(std::move(err));
+        return;
+      }
+    }
+
+    auto dylib = jit.createJITDylib("tier-up." + unit);
+    if (!dylib) {
+      llvm::consumeError(dylib.takeError());
+      return;
+    }
+    dylib->addToLinkOrder(jit.getMainJITDylib());
+    if (auto err = jit.addIRModule(
+            *dylib, llvm::orc::ThreadSafeModule(std::move(clone), ctx))) {
+      llvm::consumeError(std::move(err));
+      return;
+    }
+    // The lookup forces the compilation.
+    auto symbol = jit.lookup(*dylib, packedName);
+    if (!symbol) {
+      llvm::consumeError(symbol.takeError());
+      return;
+    }
+
+    std::lock_guard<std::mutex> guard(mutex);
+    ready.emplace_back(
+        unit, reinterpret_cast<void (*)(void **)>(symbol->getAddress()));
+    hasReady = true;
+  }
+
+  /// Point the instances of the recompiled units to their optimized code. Must
+  /// not be called while instances run.
+  void swap(std::vector<Instance> &instances) {
+    if (!hasReady)
+      return;
+    std::lock_guard<std::mutex> guard(mutex);
+    for (auto &unit : ready)
+      for (auto &inst : instances)
+        if (inst.unit == unit.first)
+          inst.unitFPtr = unit.second;
+    ready.clear();
+    hasReady = false;
+  }
+
+  llvm::orc::LLJIT &jit;
+  // The copy of the lowered module the hot units are cloned from.
+  llvm::orc::ThreadSafeContext ctx;
+  std::unique_ptr<llvm::Module> source;
+  std::function<llvm::Error(llvm::Module *)> transformer;
+
+  std::mutex mutex;
+  llvm::StringSet<> requested;
+  std::vector<std::pair<std::string, void (*)(void **)>> ready;
+  std::atomic<bool> hasReady{false};
+  // Declared last, such that the pending compilations finish first on
+  // destruction.
+  llvm::ThreadPool pool;
+};
+
+/// The state of a simulation run kept between its steps.
+struct SimulationRun {
+  SimulationRun(std::unique_ptr<State> const &state, llvm::raw_ostream &out,
+                TraceMode mode, ArrayRef<std::string> filters, int maxDepth)
+      : trace(state, out, mode, filters, maxDepth) {}
+
+  Trace trace;
+  // The instances to run in the current step.
+  WakeupSet wakeupQueue;
+  // Scratch buffer used to apply the changes to signals wider than one word,
+  // and the changes of the current signal.
+  SmallVector<uint64_t, 8> scratch;
+  SmallVector<BitUpdate, 4> updates;
+  // The woken up instances which are not levelized, in levelized mode.
+  SmallVector<unsigned, 8> eventDriven;
+};
+} // namespace sim
+} // namespace llhd
+} // namespace circt
+
 Engine::Engine(
     llvm::raw_ostream &out, ModuleOp module,
     llvm::function_ref<mlir::LogicalResult(mlir::ModuleOp)> mlirTransformer,
     llvm::function_ref<llvm::Error(llvm::Module *)> llvmTransformer,
-    std::string root, int mode)
-    : out(out), root(root), traceMode(mode) {
+    std::string root, int mode, unsigned threads, StringRef jitCacheDir,
+    unsigned optLevel, bool levelize, bool lazy, unsigned tierUpThreshold)
+    : out(out), root(root), traceMode(mode), threads(threads),
+      tierUpThreshold(tierUpThreshold) {
   state = std::make_unique<State>();
   state->root = root + '.' + root;
 
+  llvm::InitializeNativeTarget();
+  llvm::InitializeNativeTargetAsmPrinter();
+
+  // Look for a previously compiled object of the same design.
+  std::string cachePath;
+  if (!jitCacheDir.empty())
+    cachePath = getJITCachePath(module, root, optLevel, jitCacheDir);
+
   buildLayout(module);
+  if (levelize)
+    buildLevelizedSchedule(module);
+  lookahead = getDriveLookahead(module);
+  findClockUnits(module);
+
+  this->module = module;
+
+  if (!cachePath.empty() && llvm::sys::fs::exists(cachePath)) {
+    auto maybeJit = loadCachedObject(cachePath);
+    if (maybeJit) {
+      cachedEngine = std::move(*maybeJit);
+      return;
+    }
+    llvm::errs() << "failed to load the cached JIT object " << cachePath
+                 << ": " << llvm::toString(maybeJit.takeError()) << "\n";
+  }
 
   auto rootEntity = module.lookupSymbol<EntityOp>(root);
 
@@ -49,175 +521,1412 @@ Engine::Engine(
     exit(EXIT_FAILURE);
   }
 
-  this->module = module;
+  // The lazy JIT compiles the units on their first invocation, such that the
+  // units never run are never compiled. The compiled code is not cached.
+  // In tiered mode, the units start unoptimized and the hot ones are
+  // recompiled at the requested optimization level.
+  if (lazy || tierUpThreshold) {
+    auto maybeJit = createLazyJIT(module, tierUpThreshold ? 0 : optLevel,
+                                  std::max(threads, 1u));
+    if (!maybeJit) {
+      llvm::errs() << "failed to create the lazy JIT: "
+                   << llvm::toString(maybeJit.takeError()) << "\n";
+      exit(EXIT_FAILURE);
+    }
+    cachedEngine = std::move(*maybeJit);
+    if (!tierUpThreshold)
+      return;
+
+    tierUp = std::make_unique<TierUp>(*cachedEngine, optLevel);
+    auto lock = tierUp->ctx.getLock();
+    auto source =
+        translateForJIT(module, *tierUp->ctx.getContext(), *cachedEngine);
+    if (!source) {
+      llvm::errs() << "failed to set up the tiered compilation: "
+                   << llvm::toString(source.takeError()) << "\n";
+      exit(EXIT_FAILURE);
+    }
+    tierUp->source = std::move(*source);
+    return;
+  }
 
-  llvm::InitializeNativeTarget();
-  llvm::InitializeNativeTargetAsmPrinter();
   auto maybeEngine =
       mlir::ExecutionEngine::create(this->module, nullptr, llvmTransformer);
   assert(maybeEngine && "failed to create JIT");
   engine = std::move(*maybeEngine);
+
+  if (!cachePath.empty()) {
+    // Force code generation and store the resulting object in the cache.
+    if (auto err = engine->lookup("llhd_init").takeError()) {
+      llvm::consumeError(std::move(err));
+      return;
+    }
+    if (auto ec = llvm::sys::fs::create_directories(jitCacheDir)) {
+      llvm::errs() << "failed to create the JIT cache directory "
+                   << jitCacheDir << ": " << ec.message() << "\n";
+      return;
+    }
+    // Write the object to a temporary file and rename it into place, such
+    // that a concurrent or interrupted run never leaves a truncated entry.
+    SmallString<128> tempPath;
+    if (llvm::sys::fs::createUniqueFile(cachePath + ".tmp-%%%%%%%%",
+                                        tempPath))
+      return;
+    engine->dumpToObjectFile(tempPath);
+    uint64_t size = 0;
+    if (llvm::sys::fs::file_size(tempPath, size) || size == 0 ||
+        llvm::sys::fs::rename(tempPath, cachePath))
+      llvm::sys::fs::remove(tempPath);
+  }
 }
 
-Engine::~Engine() = default;
+Engine::Engine(Engine &parent, llvm::raw_ostream &out)
+    : out(out), root(parent.root), state(parent.state->cloneLayout()),
+      module(parent.module), traceMode(parent.traceMode),
+      traceFilters(parent.traceFilters), traceMaxDepth(parent.traceMaxDepth),
+      threads(1), levelOrder(parent.levelOrder),
+      isLevelized(parent.isLevelized), batchEntities(parent.batchEntities),
+      nativeClocks(parent.nativeClocks), clockUnits(parent.clockUnits),
+      parent(&parent) {}
+
+Engine::~Engine() { finish(); }
 
 void Engine::dumpStateLayout() { state->dumpLayout(); }
 
 void Engine::dumpStateSignalTriggers() { state->dumpSignalTriggers(); }
 
+llvm::Expected<void (*)(void **)> Engine::lookup(StringRef name) {
+  // The engines of a batch only use the functions resolved by their parent
+  // before the batch started, such that they never access the JIT.
+  if (parent) {
+    auto it = parent->symbols.find(name);
+    if (it == parent->symbols.end())
+      return llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                     "unresolved symbol " + name);
+    return it->second;
+  }
+
+  if (engine)
+    return engine->lookup(name);
+
+  // Look up the packed interface generated by the ExecutionEngine.
+  auto symbol = cachedEngine->lookup(("_mlir_" + name).str());
+  if (!symbol)
+    return symbol.takeError();
+  return reinterpret_cast<void (*)(void **)>(symbol->getAddress());
+}
+
 int Engine::simulate(int n, uint64_t maxTime) {
-  assert(engine && "engine not found");
+  assert((engine || cachedEngine || parent) && "engine not found");
   assert(state && "state not found");
 
-  auto tm = static_cast<TraceMode>(traceMode);
-  Trace trace(state, out, tm);
-
-  SmallVector<void *, 1> arg({&state});
-  // Initialize tbe simulation state.
-  auto invocationResult = engine->invoke("llhd_init", arg);
-  if (invocationResult) {
-    llvm::errs() << "Failed invocation of llhd_init: " << invocationResult;
+  watchStopped = false;
+  if (failed(start()))
     return -1;
+
+  // The time window the local slots are run in before synchronizing with the
+  // other processes, in distributed mode.
+  int windows = 0;
+  Time windowStart;
+  auto isInWindow = [&](const Time &time) {
+    if (lookahead)
+      return time.time < windowStart.time + lookahead;
+    return time == windowStart;
+  };
+
+  int cycle = 0;
+  while (true) {
+    // Queue the external drives due before the next step.
+    if (failed(injectStimulus()))
+      return -1;
+
+    // Once all the local slots of the window ran, exchange the drives with
+    // the other processes and agree on the next window. The stop conditions
+    // are evaluated on the global time, such that all the processes stop
+    // together.
+    if (transport && (windows == 0 || watchStopped ||
+                      state->queue.events == 0 ||
+                      !isInWindow(state->queue.top().time))) {
+      Optional<Time> next;
+      if (failed(synchronize(watchStopped, next)))
+        return -1;
+      if (!next || (n > 0 && windows >= n) ||
+          (maxTime > 0 && next->time > maxTime))
+        break;
+      windowStart = *next;
+      ++windows;
+      continue;
+    }
+
+    if (state->queue.events == 0)
+      break;
+
+    // Interrupt the simulation if a stop condition is met.
+    if (!transport && ((n > 0 && cycle >= n) ||
+                       (maxTime > 0 && state->queue.top().time.time > maxTime)))
+      break;
+
+    if (failed(runSlot()))
+      return -1;
+    ++cycle;
+    if (watchStopped && !transport)
+      break;
   }
 
-  if (traceMode >= 0) {
+  finish();
+
+  if (!parent)
+    llvm::errs() << "Finished at " << state->time.dump() << " (" << cycle
+                 << " cycles)\n";
+  return 0;
+}
+
+LogicalResult Engine::start() {
+  if (run)
+    return success();
+  if (failed(initialize()))
+    return failure();
+
+  auto tm = static_cast<TraceMode>(traceMode);
+  run = std::make_unique<SimulationRun>(state, out, tm, traceFilters,
+                                        traceMaxDepth);
+  if (transport)
+    run->trace.restrictTo(isLocalSignal);
+
+  tracing = traceMode >= 0 && !traceDeferred;
+  if (tracing) {
     // Add changes for all the signals' initial values.
     for (size_t i = 0, e = state->signals.size(); i < e; ++i) {
-      trace.addChange(i);
+      run->trace.addChange(i);
     }
   }
 
-  // Add a dummy event to get the simulation started.
-  state->queue.push_back(Slot(Time()));
-  ++state->queue.events;
-
   // Keep track of the instances that need to wakeup.
-  llvm::SmallVector<unsigned, 8> wakeupQueue;
-
-  // Add all instances to the wakeup queue for the first run and add the jitted
-  // function pointers to all of the instances to make them readily available.
-  for (size_t i = 0, e = state->instances.size(); i < e; ++i) {
-    wakeupQueue.push_back(i);
-    auto &inst = state->instances[i];
-    auto expectedFPtr = engine->lookup(inst.unit);
+  run->wakeupQueue.resize(state->instances.size());
+
+  // Add a dummy event to get the simulation started and add all instances to
+  // the wakeup queue for the first run. Runs continuing from an earlier one or
+  // from a restored checkpoint pick up the pending queue instead.
+  if (!started) {
+    state->queue.getOrCreateSlot(Time());
+    for (size_t i = 0, e = state->instances.size(); i < e; ++i)
+      if (isLocalInstance.empty() || isLocalInstance[i])
+        run->wakeupQueue.insert(i);
+    started = true;
+  }
+
+  // Spawn the worker threads if running in parallel mode.
+  if (threads > 1 && !pool)
+    pool = std::make_unique<llvm::ThreadPool>(
+        llvm::hardware_concurrency(threads));
+  if (driveBuffers.empty())
+    driveBuffers.resize(pool ? threads + 1 : 1);
+  if (tierUp)
+    activations.resize(state->instances.size());
+  return success();
+}
+
+void Engine::finish() {
+  if (!run)
+    return;
+  setThreadDriveBuffer(nullptr);
+
+  if (tracing) {
+    // Flush any remainign changes
+    run->trace.flush(/*force=*/true);
+  }
+  run.reset();
+}
+
+LogicalResult Engine::runSlot() {
+  auto &trace = run->trace;
+  auto &wakeupQueue = run->wakeupQueue;
+  auto &scratch = run->scratch;
+  auto &updates = run->updates;
+  auto &eventDriven = run->eventDriven;
+  setThreadDriveBuffer(&driveBuffers[0]);
+
+  const auto &pop = state->queue.top();
+
+  // Update the simulation time.
+  state->time = pop.time;
+
+  // Swap in the units recompiled since the last step.
+  if (tierUp)
+    tierUp->swap(state->instances);
+
+  if (tracing)
+    trace.flush();
+
+  if (profile) {
+    ++profile->steps;
+    profile->events.add(pop.changes.size() + pop.scheduled.size());
+    profile->pendingSlots.add(state->queue.size());
+  }
+
+  // Process signal changes.
+  size_t i = 0, e = pop.changes.size();
+  while (i < e) {
+    const auto sigIndex = pop.changes[i].first;
+    const auto &signals = state->signalTable;
+    auto *value = signals.getValue(sigIndex);
+    const uint64_t sigSize = signals.sizes[sigIndex];
+
+    // Gather the changes until we reach the next signal.
+    updates.clear();
+    while (i < e && pop.changes[i].first == sigIndex) {
+      const auto &change = pop.buffers[pop.changes[i].second];
+      updates.push_back({static_cast<uint64_t>(change.bitOffset),
+                         change.width, pop.getData(change)});
+
+      if (profile)
+        ++profile->signals[sigIndex].drives;
+      ++i;
+    }
+
+    // Apply the signal update, and skip if the updated signal value is equal
+    // to the initial value.
+    auto changed = applyBitUpdates(value, sigSize, updates, scratch);
+    if (changed.first == changed.second)
+      continue;
+    if (profile)
+      ++profile->signals[sigIndex].changes;
+
+    // Add sensitive instances.
+    wakeupTriggered(sigIndex, wakeupQueue);
+
+    // Dump the updated signal elements.
+    if (tracing)
+      trace.addChange(sigIndex, changed.first, changed.second);
+    if (!isWatched.empty() && isWatched[sigIndex])
+      checkWatchpoints(sigIndex, trace);
+  }
+
+  // Add scheduled process resumes to the wakeup queue.
+  for (auto inst : pop.scheduled) {
+    if (state->time == state->instances[inst].expectedWakeup)
+      wakeupQueue.insert(inst);
+  }
+
+  state->queue.pop();
+
+  // Run the levelized instances first, then the ones they and the popped
+  // slot woke up.
+  if (!levelOrder.empty()) {
+    runLevelized(wakeupQueue, trace);
+    eventDriven.clear();
+    for (auto i : wakeupQueue.getSorted())
+      if (!isLevelized[i])
+        eventDriven.push_back(i);
+  }
+
+  // Run the instances present in the wakeup queue.
+  ArrayRef<unsigned> wakeups = eventDriven;
+  if (levelOrder.empty())
+    wakeups = wakeupQueue.getSorted();
+  if (profile)
+    profile->wakeups.add(wakeupQueue.size());
+  if (pool && wakeups.size() > 1) {
+    runParallel(wakeups);
+  } else if (!batchFPtrs.empty() && !profile) {
+    runBatched(wakeups);
+  } else {
+    for (auto i : wakeups)
+      runInstance(i, driveBuffers[0]);
+    flushThreadDriveBuffer(state.get());
+  }
+
+  // Clear wakeup queue.
+  wakeupQueue.clear();
+
+  // Take the actions of the watchpoints hit during the step.
+  for (auto &path : pendingCheckpoints)
+    if (failed(checkpoint(path)))
+      return failure();
+  pendingCheckpoints.clear();
+  return success();
+}
+
+LogicalResult Engine::stepDelta() {
+  assert(!transport && "distributed simulations can't be stepped");
+  if (failed(start()) || failed(injectStimulus()))
+    return failure();
+  if (state->queue.events == 0)
+    return success();
+  return runSlot();
+}
+
+LogicalResult Engine::runUntil(uint64_t time) {
+  assert(!transport && "distributed simulations can't be stepped");
+  watchStopped = false;
+  if (failed(start()))
+    return failure();
+  while (!watchStopped) {
+    if (failed(injectStimulus()))
+      return failure();
+    if (state->queue.events == 0 || state->queue.top().time.time > time)
+      break;
+    if (failed(runSlot()))
+      return failure();
+  }
+  return success();
+}
+
+bool Engine::hasPendingEvents() const {
+  return !started || state->queue.events > 0 || hasPendingStimulus;
+}
+
+uint64_t Engine::getTime() const { return state->time.time; }
+
+ArrayRef<uint8_t> Engine::peek(unsigned signal) const {
+  assert(initialized && "the design has to be initialized first");
+  const auto &signals = state->signalTable;
+  return ArrayRef<uint8_t>(signals.getValue(signal), signals.sizes[signal]);
+}
+
+void Engine::poke(unsigned signal, ArrayRef<uint8_t> value) {
+  assert(initialized && "the design has to be initialized first");
+  const uint64_t sigSize = state->signalTable.sizes[signal];
+  SmallVector<uint8_t, 8> bytes(value.begin(), value.end());
+  bytes.resize(sigSize, 0);
+
+  // Join the pending slot of the current time, e.g. the initial slot, or
+  // drive in the next delta step.
+  Time time;
+  if (started && !(state->queue.events > 0 &&
+                   state->queue.top().time == state->time))
+    time = Time(state->time.time, state->time.delta + 1, 0);
+  state->queue.insertOrUpdate(time, signal, 0, bytes.data(), sigSize * 8);
+}
+
+void Engine::onChange(unsigned signal, ChangeCallback callback) {
+  hasChangeCallbacks.resize(state->signals.size());
+  hasChangeCallbacks[signal] = true;
+  changeCallbacks.push_back({signal, std::move(callback)});
+}
+
+LogicalResult Engine::initialize() {
+  if (initialized)
+    return success();
+
+  SmallVector<void *, 1> arg({&state});
+  // Initialize tbe simulation state.
+  auto initFPtr = lookup("llhd_init");
+  if (!initFPtr) {
+    llvm::errs() << "Failed invocation of llhd_init: "
+                 << llvm::toString(initFPtr.takeError()) << "\n";
+    return failure();
+  }
+  (*initFPtr)(arg.data());
+  state->packSignalValues();
+
+  // Add the jitted function pointers to all of the instances to make them
+  // readily available.
+  for (auto &inst : state->instances) {
+    auto expectedFPtr = lookup(inst.unit);
     if (!expectedFPtr) {
       llvm::errs() << "Could not lookup " << inst.unit << "!\n";
-      return -1;
+      return failure();
     }
     inst.unitFPtr = *expectedFPtr;
   }
 
-  int cycle = 0;
-  while (state->queue.events > 0) {
-    const auto &pop = state->queue.top();
-
-    // Interrupt the simulation if a stop condition is met.
-    if ((n > 0 && cycle >= n) || (maxTime > 0 && pop.time.time > maxTime)) {
-      break;
+  // Run the instances of the clock processes natively.
+  if (nativeClocks && !clockUnits.empty()) {
+    clockOf.assign(state->instances.size(), nullptr);
+    for (size_t i = 0, e = state->instances.size(); i < e; ++i) {
+      auto &inst = state->instances[i];
+      auto it = clockUnits.find(inst.unit);
+      if (!inst.isEntity && it != clockUnits.end())
+        clockOf[i] = &it->second;
     }
+  }
 
-    // Update the simulation time.
-    state->time = pop.time;
-
-    if (traceMode >= 0)
-      trace.flush();
-
-    // Process signal changes.
-    size_t i = 0, e = pop.changesSize;
-    while (i < e) {
-      const auto sigIndex = pop.changes[i].first;
-      const auto &curr = state->signals[sigIndex];
-      APInt buff(
-          curr.size * 8,
-          llvm::makeArrayRef(reinterpret_cast<uint64_t *>(curr.value.get()),
-                             llvm::divideCeil(curr.size, 8)));
-
-      // Apply the changes to the buffer until we reach the next signal.
-      while (i < e && pop.changes[i].first == sigIndex) {
-        const auto &change = pop.buffers[pop.changes[i].second];
-        const auto offset = change.first;
-        const auto &drive = change.second;
-        if (drive.getBitWidth() < buff.getBitWidth())
-          buff.insertBits(drive, offset);
-        else
-          buff = drive;
-
-        ++i;
+  // Look up the batched function of each entity unit. The tiered units are
+  // swapped per instance, so they are never batched.
+  if (batchEntities && threads == 1 && !tierUp) {
+    llvm::StringMap<int> unitBatches;
+    batchOf.assign(state->instances.size(), -1);
+    for (size_t i = 0, e = state->instances.size(); i < e; ++i) {
+      auto &inst = state->instances[i];
+      if (!inst.isEntity)
+        continue;
+      auto it = unitBatches.find(inst.unit);
+      if (it == unitBatches.end()) {
+        int index = -1;
+        auto expectedFPtr = lookup(inst.unit + "_batch");
+        if (expectedFPtr) {
+          index = batchFPtrs.size();
+          batchFPtrs.push_back(*expectedFPtr);
+        } else {
+          llvm::consumeError(expectedFPtr.takeError());
+        }
+        it = unitBatches.insert({inst.unit, index}).first;
       }
+      batchOf[i] = it->second;
+    }
+    batches.resize(batchFPtrs.size());
+  }
+
+  initialized = true;
+  return success();
+}
+
+LogicalResult Engine::applyStimulus(StringRef path) {
+  if (failed(initialize()))
+    return failure();
+
+  auto buffer = llvm::MemoryBuffer::getFile(path);
+  if (!buffer) {
+    llvm::errs() << "Could not open stimulus " << path << ": "
+                 << buffer.getError().message() << "\n";
+    return failure();
+  }
+
+  // Every line holds a hierarchical signal name and a hexadecimal value.
+  // Empty lines and lines starting with '#' are ignored.
+  SmallVector<StringRef, 16> lines;
+  (*buffer)->getBuffer().split(lines, '\n');
+  for (size_t i = 0, e = lines.size(); i < e; ++i) {
+    auto line = lines[i].trim();
+    if (line.empty() || line.startswith("#"))
+      continue;
+
+    auto fields = line.split(' ');
+    auto name = fields.first;
+    auto hex = fields.second.trim();
+    hex.consume_front("0x");
+    if (hex.empty() || !llvm::all_of(hex, llvm::isHexDigit)) {
+      llvm::errs() << path << ":" << i + 1 << ": invalid value for " << name
+                   << "\n";
+      return failure();
+    }
+    llvm::APInt value(hex.size() * 4, hex, 16);
+    if (!state->setSignalValue(name, value)) {
+      llvm::errs() << path << ":" << i + 1 << ": unknown signal " << name
+                   << "\n";
+      return failure();
+    }
+  }
+  return success();
+}
+
+int Engine::lookupSignal(StringRef path) { return state->findSignal(path); }
+
+void Engine::setStimulusSource(std::function<bool(StimulusDrive &)> next) {
+  stimulusSource = std::move(next);
+  hasPendingStimulus = stimulusSource && stimulusSource(pendingStimulus);
+}
+
+LogicalResult Engine::streamStimulus(StringRef path) {
+  auto file = std::make_shared<std::ifstream>(path.str(), std::ios::binary);
+  if (!*file) {
+    llvm::errs() << "Could not open stimulus stream " << path << "\n";
+    return failure();
+  }
+
+  // All the numbers are stored in little-endian order.
+  auto read32 = [file](uint32_t &value) {
+    char bytes[4];
+    if (!file->read(bytes, sizeof(bytes)))
+      return false;
+    value = llvm::support::endian::read32le(bytes);
+    return true;
+  };
+  auto read64 = [file](uint64_t &value) {
+    char bytes[8];
+    if (!file->read(bytes, sizeof(bytes)))
+      return false;
+    value = llvm::support::endian::read64le(bytes);
+    return true;
+  };
 
-      // Skip if the updated signal value is equal to the initial value.
-      if (std::memcmp(curr.value.get(), buff.getRawData(), curr.size) == 0)
+  // Resolve the names of the driven signals up front.
+  char magic[8];
+  uint32_t numSignals;
+  if (!file->read(magic, sizeof(magic)) ||
+      std::memcmp(magic, "LLHDSTIM", sizeof(magic)) != 0 ||
+      !read32(numSignals)) {
+    llvm::errs() << path << ": not a stimulus stream\n";
+    return failure();
+  }
+  std::vector<unsigned> signals;
+  for (uint32_t i = 0; i < numSignals; ++i) {
+    uint32_t length;
+    std::string name;
+    if (read32(length)) {
+      name.resize(length);
+      file->read(&name[0], length);
+    }
+    if (!*file) {
+      llvm::errs() << path << ": truncated signal list\n";
+      return failure();
+    }
+    int index = state->findSignal(name);
+    if (index < 0) {
+      llvm::errs() << path << ": unknown signal " << name << "\n";
+      return failure();
+    }
+    signals.push_back(index);
+  }
+
+  // Read one drive at a time, as the simulation asks for it.
+  std::string name = path.str();
+  // A malformed drive ends the stream too, but as an error.
+  setStimulusSource([this, file, read32, read64, signals = std::move(signals),
+                     name](StimulusDrive &drive) {
+    auto error = [&](const Twine &message) {
+      llvm::errs() << name << ": " << message << "\n";
+      setStimulusError();
+      return false;
+    };
+    uint64_t time;
+    uint32_t signal, size;
+    if (!read64(time)) {
+      // A clean end of the file is the end of the stream.
+      if (file->gcount() == 0)
+        return false;
+      return error("truncated drive");
+    }
+    if (!read32(signal) || !read32(size))
+      return error("truncated drive");
+    if (signal >= signals.size())
+      return error("invalid signal number " + Twine(signal));
+    drive.time = time;
+    drive.signal = signals[signal];
+    drive.value.resize(size);
+    if (!file->read(reinterpret_cast<char *>(drive.value.data()), size))
+      return error("truncated drive");
+    return true;
+  });
+  return success();
+}
+
+LogicalResult Engine::injectStimulus() {
+  if (stimulusError)
+    return failure();
+  while (hasPendingStimulus) {
+    Time time(pendingStimulus.time, 0, 0);
+    if (state->queue.events > 0 && state->queue.top().time < time)
+      return success();
+    if (time < state->time) {
+      llvm::errs() << "external drive at " << pendingStimulus.time
+                   << "ps is out of order\n";
+      return failure();
+    }
+    if (pendingStimulus.signal >= state->signals.size()) {
+      llvm::errs() << "external drive of unknown signal "
+                   << pendingStimulus.signal << "\n";
+      return failure();
+    }
+
+    // Zero-extend or truncate the value to the signal size. Every process of
+    // a distributed simulation reads the stimulus, don't export it.
+    const uint64_t sigSize = state->signalTable.sizes[pendingStimulus.signal];
+    auto &value = pendingStimulus.value;
+    value.resize(sigSize, 0);
+    auto *exported = state->queue.exports;
+    state->queue.exports = nullptr;
+    state->queue.insertOrUpdate(time, pendingStimulus.signal, 0, value.data(),
+                                sigSize * 8);
+    state->queue.exports = exported;
+    hasPendingStimulus = stimulusSource(pendingStimulus);
+  }
+  return failure(stimulusError);
+}
+
+int Engine::simulateDistributed(Transport &transport, int n,
+                                uint64_t maxTime) {
+  assert(!started && "the distributed simulation has to start from scratch");
+  // The levelized instances apply their delta drives in place, without going
+  // through the queue the exported drives are captured in.
+  if (!levelOrder.empty()) {
+    llvm::errs() << "levelized scheduling is not supported in distributed "
+                    "simulation\n";
+    return -1;
+  }
+  partitionInstances(transport);
+  this->transport = &transport;
+  return simulate(n, maxTime);
+}
+
+int Engine::simulateBatch(ArrayRef<std::string> stimuli, int n,
+                          uint64_t maxTime, unsigned jobs) {
+  // Resolve all the functions used by the runs up front.
+  SmallVector<StringRef, 8> names({"llhd_init"});
+  for (auto &inst : state->instances)
+    names.push_back(inst.unit);
+  for (auto name : names) {
+    if (symbols.count(name))
+      continue;
+    auto fptr = lookup(name);
+    if (!fptr) {
+      llvm::errs() << "Could not lookup " << name << ": "
+                   << llvm::toString(fptr.takeError()) << "\n";
+      return -1;
+    }
+    symbols[name] = *fptr;
+  }
+
+  // The batched functions are optional, the runs fall back to running the
+  // instances one by one.
+  if (batchEntities) {
+    for (auto &inst : state->instances) {
+      auto name = inst.unit + "_batch";
+      if (!inst.isEntity || symbols.count(name))
         continue;
+      if (auto fptr = lookup(name))
+        symbols[name] = *fptr;
+      else
+        llvm::consumeError(fptr.takeError());
+    }
+  }
 
-      // Apply the signal update.
-      std::memcpy(curr.value.get(), buff.getRawData(), curr.size);
-
-      // Add sensitive instances.
-      for (auto inst : curr.triggers) {
-        // Skip if the process is not currently sensible to the signal.
-        if (!state->instances[inst].isEntity) {
-          const auto &sensList = state->instances[inst].sensitivityList;
-          auto it = std::find_if(sensList.begin(), sensList.end(),
-                                 [sigIndex](const SignalDetail &sig) {
-                                   return sig.globalIndex == sigIndex;
-                                 });
-          if (sensList.end() != it &&
-              state->instances[inst].procState->senses[it - sensList.begin()] ==
-                  0)
-            continue;
-
-          // Invalidate scheduled wakeup
-          state->instances[inst].expectedWakeup = Time();
-        }
-        wakeupQueue.push_back(inst);
+  // Run every stimulus in its own engine, writing its trace next to the
+  // stimulus file.
+  std::vector<std::string> results(stimuli.size());
+  std::atomic<bool> failedRun(false);
+  llvm::ThreadPool batchPool(llvm::hardware_concurrency(jobs));
+  for (size_t i = 0, e = stimuli.size(); i < e; ++i) {
+    batchPool.async([&, i] {
+      auto tracePath = stimuli[i] + ".trace";
+      std::error_code ec;
+      llvm::raw_fd_ostream os(tracePath, ec, llvm::sys::fs::OF_None);
+      llvm::raw_string_ostream result(results[i]);
+      if (ec) {
+        result << "Could not open " << tracePath << ": " << ec.message();
+        failedRun = true;
+        return;
       }
 
-      // Dump the updated signal.
-      if (traceMode >= 0)
-        trace.addChange(sigIndex);
-    }
+      Engine run(*this, os);
+      if (failed(run.applyStimulus(stimuli[i])) ||
+          run.simulate(n, maxTime) != 0) {
+        result << "Failed to simulate " << stimuli[i];
+        failedRun = true;
+        return;
+      }
+      result << stimuli[i] << ": finished at " << run.state->time.dump();
+    });
+  }
+  batchPool.wait();
+
+  for (auto &result : results)
+    llvm::errs() << result << "\n";
+  return failedRun ? -1 : 0;
+}
+
+LogicalResult Engine::checkpoint(StringRef path) {
+  if (failed(initialize()))
+    return failure();
 
-    // Add scheduled process resumes to the wakeup queue.
-    for (auto inst : pop.scheduled) {
-      if (state->time == state->instances[inst].expectedWakeup)
-        wakeupQueue.push_back(inst);
+  std::error_code ec;
+  llvm::raw_fd_ostream os(path, ec, llvm::sys::fs::OF_None);
+  if (ec) {
+    llvm::errs() << "Could not open checkpoint " << path << ": "
+                 << ec.message() << "\n";
+    return failure();
+  }
+  state->writeCheckpoint(os);
+  return success();
+}
+
+LogicalResult Engine::setTraceFilters(ArrayRef<std::string> filters,
+                                      int maxDepth) {
+  for (auto &filter : filters) {
+    SmallVector<llvm::GlobPattern, 8> patterns;
+    if (auto err = Trace::parseFilter(filter, patterns)) {
+      llvm::errs() << "invalid trace filter '" << filter
+                   << "': " << llvm::toString(std::move(err)) << "\n";
+      return failure();
     }
+  }
+  traceFilters.assign(filters.begin(), filters.end());
+  traceMaxDepth = maxDepth;
+  return success();
+}
 
-    state->queue.pop();
+LogicalResult Engine::restore(StringRef path) {
+  if (failed(initialize()))
+    return failure();
 
-    std::sort(wakeupQueue.begin(), wakeupQueue.end());
-    wakeupQueue.erase(std::unique(wakeupQueue.begin(), wakeupQueue.end()),
-                      wakeupQueue.end());
+  auto buffer = llvm::MemoryBuffer::getFile(path, /*FileSize=*/-1,
+                                            /*RequiresNullTerminator=*/false);
+  if (!buffer) {
+    llvm::errs() << "Could not open checkpoint " << path << ": "
+                 << buffer.getError().message() << "\n";
+    return failure();
+  }
+  if (auto err = state->readCheckpoint((*buffer)->getBuffer())) {
+    llvm::errs() << "Could not restore checkpoint " << path << ": "
+                 << llvm::toString(std::move(err)) << "\n";
+    return failure();
+  }
+
+  // The restored queue replaces the initial wakeup of all the instances.
+  started = true;
+  return success();
+}
+
+void Engine::runInstance(unsigned i, DriveBuffer &drives) {
+  // The clock processes run no compiled code, and are not profiled.
+  if (!clockOf.empty() && clockOf[i]) {
+    runClock(i, *clockOf[i]);
+    return;
+  }
 
-    // Run the instances present in the wakeup queue.
-    for (auto i : wakeupQueue) {
+  auto &inst = state->instances[i];
+  auto signalTable = inst.sensitivityList.data();
+  auto drivesPtr = &drives;
+
+  // Gather the instance arguments for unit invocation. The drive buffer is
+  // ignored by units lowered without inlined drives.
+  SmallVector<void *, 4> args;
+  if (inst.isEntity)
+    args.assign({&state, &inst.entityState, &signalTable, &drivesPtr});
+  else {
+    args.assign({&state, &inst.procState, &signalTable, &drivesPtr});
+  }
+  // Recompile the unit once the instance gets hot.
+  if (tierUp && ++activations[i] == tierUpThreshold)
+    tierUp->request(inst.unit);
+  // Run the unit.
+  if (!profile) {
+    (*inst.unitFPtr)(args.data());
+    return;
+  }
+  // Each instance is run by one thread at a time, so its statistics can be
+  // updated without synchronization.
+  auto start = std::chrono::steady_clock::now();
+  (*inst.unitFPtr)(args.data());
+  auto &stats = profile->instances[i];
+  ++stats.activations;
+  stats.time += std::chrono::steady_clock::now() - start;
+}
+
+void Engine::findClockUnits(ModuleOp module) {
+  auto getDelay = [](Value delay, uint64_t (&result)[3]) {
+    auto ps = getConstantPicoseconds(delay);
+    if (!ps)
+      return false;
+    auto time = delay.getDefiningOp<ConstOp>().value().cast<TimeAttr>();
+    result[0] = *ps;
+    result[1] = time.getDelta();
+    result[2] = time.getEps();
+    // The runtime takes the delays as ints.
+    return *ps <= uint64_t(std::numeric_limits<int>::max());
+  };
+
+  for (auto proc : module.getOps<ProcOp>()) {
+    // The process has a single bit output signal and no inputs.
+    if (proc.ins() != 0 || proc.getNumArguments() != 1)
+      continue;
+    Value signal = proc.getArgument(0);
+    auto sigType = signal.getType().dyn_cast<SigType>();
+    if (!sigType || !sigType.getUnderlyingType().isSignlessInteger(1))
+      continue;
+
+    // The entry block branches to the loop, which is the only other block.
+    auto &blocks = proc.getBody().getBlocks();
+    if (blocks.size() != 2)
+      continue;
+    Block *loop = &blocks.back();
+    auto *entry = blocks.front().getTerminator();
+    if (entry->getNumSuccessors() != 1 || entry->getSuccessor(0) != loop ||
+        entry->getNumOperands() != 0 || loop->getNumArguments() != 0 ||
+        !llvm::all_of(blocks.front().without_terminator(),
+                      [](Operation &op) { return isa<ConstOp>(op); }))
+      continue;
+
+    // The loop drives the negation of the probed signal and waits.
+    SmallVector<Operation *, 3> body;
+    for (auto &op : loop->without_terminator())
+      if (!isa<ConstOp>(op))
+        body.push_back(&op);
+    if (body.size() != 3)
+      continue;
+    auto prb = dyn_cast<PrbOp>(body[0]);
+    auto negation = dyn_cast<NotOp>(body[1]);
+    auto drv = dyn_cast<DrvOp>(body[2]);
+    auto wait = dyn_cast<WaitOp>(loop->getTerminator());
+    if (!prb || !negation || !drv || !wait || prb.signal() != signal ||
+        negation->getOperand(0) != prb.getResult() || drv.signal() != signal ||
+        drv.value() != negation.getResult() || drv.enable() ||
+        !wait.obs().empty() || !wait.destOps().empty() ||
+        wait.dest() != loop || !wait.time())
+      continue;
+
+    ClockUnit clock;
+    if (!getDelay(drv.time(), clock.driveDelay) ||
+        !getDelay(wait.time(), clock.waitDelay) ||
+        llvm::all_of(clock.waitDelay, [](uint64_t d) { return d == 0; }))
+      continue;
+    clockUnits[proc.getName()] = clock;
+  }
+}
+
+void Engine::runClock(unsigned i, const ClockUnit &clock) {
+  auto &inst = state->instances[i];
+  auto &detail = inst.sensitivityList[0];
+
+  // The drive and the wakeup go through the runtime functions called by the
+  // compiled processes, which order them with the other drives and defer them
+  // on the worker threads.
+  uint8_t bit = (detail.value[detail.offset / 8] >> (detail.offset % 8)) & 1;
+  uint8_t negated = bit ^ 1;
+  driveSignal(state.get(), &detail, &negated, 1, clock.driveDelay[0],
+              clock.driveDelay[1], clock.driveDelay[2]);
+  // Like the wait of the process, stop observing the signal.
+  inst.procState->senses[detail.instIndex] = false;
+  llhdSuspend(state.get(), inst.procState, clock.waitDelay[0],
+              clock.waitDelay[1], clock.waitDelay[2]);
+}
+
+void Engine::runBatched(ArrayRef<unsigned> wakeups) {
+  SmallVector<unsigned, 8> order;
+  for (auto i : wakeups) {
+    int batch = batchOf[i];
+    if (batch < 0) {
+      runInstance(i, driveBuffers[0]);
+      continue;
+    }
+    if (batches[batch].empty())
+      order.push_back(batch);
+    batches[batch].push_back(i);
+  }
+
+  auto drivesPtr = &driveBuffers[0];
+  for (auto batch : order) {
+    auto &instances = batches[batch];
+    if (instances.size() == 1) {
+      runInstance(instances[0], driveBuffers[0]);
+      instances.clear();
+      continue;
+    }
+
+    batchStates.clear();
+    batchTables.clear();
+    for (auto i : instances) {
       auto &inst = state->instances[i];
-      auto signalTable = inst.sensitivityList.data();
-
-      // Gather the instance arguments for unit invocation.
-      SmallVector<void *, 3> args;
-      if (inst.isEntity)
-        args.assign({&state, &inst.entityState, &signalTable});
-      else {
-        args.assign({&state, &inst.procState, &signalTable});
+      batchStates.push_back(inst.entityState);
+      batchTables.push_back(inst.sensitivityList.data());
+    }
+    uint64_t count = instances.size();
+    auto states = batchStates.data();
+    auto tables = batchTables.data();
+    void *args[] = {&state, &count, &states, &tables, &drivesPtr};
+    batchFPtrs[batch](args);
+    instances.clear();
+  }
+  flushThreadDriveBuffer(state.get());
+}
+
+void Engine::enableProfiling() {
+  profile = std::make_unique<Profile>();
+  profile->instances.resize(state->instances.size());
+  profile->signals.resize(state->signals.size());
+}
+
+void Engine::dumpProfile(llvm::raw_ostream &os) {
+  assert(profile && "profiling is not enabled");
+  auto mean = [&](const Profile::StepStats &stats) {
+    return profile->steps ? (double)stats.sum / profile->steps : 0.0;
+  };
+  auto stepStats = [&](llvm::json::OStream &j, StringRef name,
+                       const Profile::StepStats &stats) {
+    j.attributeObject(name, [&] {
+      j.attribute("mean", mean(stats));
+      j.attribute("max", (int64_t)stats.max);
+    });
+  };
+
+  llvm::json::OStream j(os, /*IndentSize=*/2);
+  j.object([&] {
+    j.attribute("steps", (int64_t)profile->steps);
+    stepStats(j, "eventsPerStep", profile->events);
+    stepStats(j, "wakeupsPerStep", profile->wakeups);
+    stepStats(j, "pendingSlots", profile->pendingSlots);
+    j.attributeArray("instances", [&] {
+      for (size_t i = 0, e = state->instances.size(); i < e; ++i) {
+        auto &inst = state->instances[i];
+        auto &stats = profile->instances[i];
+        j.object([&] {
+          j.attribute("path", inst.path);
+          j.attribute("unit", inst.unit);
+          j.attribute("activations", (int64_t)stats.activations);
+          j.attribute("timeNs", (int64_t)stats.time.count());
+        });
+      }
+    });
+    j.attributeArray("signals", [&] {
+      for (size_t i = 0, e = state->signals.size(); i < e; ++i) {
+        auto &sig = state->signals[i];
+        auto &stats = profile->signals[i];
+        j.object([&] {
+          j.attribute("name", sig.owner + "/" + sig.name);
+          j.attribute("drives", (int64_t)stats.drives);
+          j.attribute("changes", (int64_t)stats.changes);
+        });
       }
-      // Run the unit.
-      (*inst.unitFPtr)(args.data());
+    });
+  });
+  os << "\n";
+}
+
+void Engine::runParallel(ArrayRef<unsigned> wakeupQueue) {
+  // Split the wakeup queue in contiguous chunks, a few per thread, such that
+  // idle workers can pick up the remaining chunks of slower ones.
+  size_t chunkSize = llvm::divideCeil(wakeupQueue.size(), threads * 4);
+  size_t numChunks = llvm::divideCeil(wakeupQueue.size(), chunkSize);
+  if (eventBuffers.size() < numChunks)
+    eventBuffers.resize(numChunks);
+
+  std::atomic<size_t> nextChunk(0);
+  for (unsigned t = 0; t < threads; ++t) {
+    pool->async([&, t] {
+      auto &drives = driveBuffers[t + 1];
+      setThreadDriveBuffer(&drives);
+      for (size_t c = nextChunk++; c < numChunks; c = nextChunk++) {
+        // Record the events of the instances in this chunk in its own buffer.
+        setThreadEventBuffer(&eventBuffers[c]);
+        auto end = std::min((c + 1) * chunkSize, wakeupQueue.size());
+        for (size_t i = c * chunkSize; i < end; ++i)
+          runInstance(wakeupQueue[i], drives);
+        flushThreadDriveBuffer(state.get());
+        setThreadEventBuffer(nullptr);
+      }
+      setThreadDriveBuffer(nullptr);
+    });
+  }
+  pool->wait();
+
+  // Commit the recorded events in chunk order. As the chunks are contiguous
+  // ranges of the wakeup queue, this reproduces the sequential insertion order.
+  for (size_t c = 0; c < numChunks; ++c) {
+    state->commitEvents(eventBuffers[c]);
+    eventBuffers[c].clear();
+  }
+}
+
+LogicalResult Engine::addWatchpoint(
+    StringRef signal, std::function<bool(const uint8_t *, uint64_t)> predicate,
+    WatchAction action, StringRef checkpointPath) {
+  int index = state->findSignal(signal);
+  if (index < 0) {
+    llvm::errs() << "Cannot watch unknown signal " << signal << "\n";
+    return failure();
+  }
+  isWatched.resize(state->signals.size());
+  isWatched[index] = true;
+  if (action == WatchAction::trace)
+    traceDeferred = true;
+  watchpoints.push_back({signal.str(), static_cast<unsigned>(index),
+                         std::move(predicate), action, checkpointPath.str()});
+  return success();
+}
+
+void Engine::checkWatchpoints(unsigned sigIndex, Trace &trace) {
+  const auto &signals = state->signalTable;
+  for (auto &watch : watchpoints) {
+    if (watch.hit || watch.signal != sigIndex ||
+        !watch.predicate(signals.getValue(sigIndex), signals.sizes[sigIndex]))
+      continue;
+    watch.hit = true;
+    llvm::errs() << "Watchpoint on " << watch.name << " hit at "
+                 << state->time.dump() << "\n";
+
+    switch (watch.action) {
+    case WatchAction::stop:
+      watchStopped = true;
+      break;
+    case WatchAction::checkpoint:
+      pendingCheckpoints.push_back(watch.checkpointPath);
+      break;
+    case WatchAction::trace:
+      // Dump the current value of every signal, including this change.
+      traceDeferred = false;
+      if (tracing || traceMode < 0)
+        break;
+      tracing = true;
+      for (size_t i = 0, e = state->signals.size(); i < e; ++i)
+        trace.addChange(i);
+      break;
     }
+  }
+}
 
-    // Clear wakeup queue.
-    wakeupQueue.clear();
-    ++cycle;
+void Engine::wakeupTriggered(unsigned sigIndex, WakeupSet &wakeupQueue) {
+  const auto &signals = state->signalTable;
+  if (!hasChangeCallbacks.empty() && hasChangeCallbacks[sigIndex]) {
+    ArrayRef<uint8_t> value(signals.getValue(sigIndex),
+                            signals.sizes[sigIndex]);
+    for (auto &callback : changeCallbacks)
+      if (callback.first == sigIndex)
+        callback.second(sigIndex, value);
   }
 
-  if (traceMode >= 0) {
-    // Flush any remainign changes
-    trace.flush(/*force=*/true);
+  auto triggers = signals.getTriggers(sigIndex);
+  auto triggerSenses = signals.getTriggerSenses(sigIndex);
+  for (size_t t = 0, te = triggers.size(); t < te; ++t) {
+    auto inst = triggers[t];
+    // Skip if the process is not currently sensible to the signal.
+    if (!state->instances[inst].isEntity) {
+      if (state->instances[inst].procState->senses[triggerSenses[t]] == 0)
+        continue;
+
+      // Invalidate scheduled wakeup
+      state->instances[inst].expectedWakeup = Time();
+    }
+    // Other processes run the instances of other partitions.
+    if (!isLocalInstance.empty() && !isLocalInstance[inst])
+      continue;
+    wakeupQueue.insert(inst);
   }
+}
 
-  llvm::errs() << "Finished at " << state->time.dump() << " (" << cycle
-               << " cycles)\n";
-  return 0;
+void Engine::partitionInstances(Transport &transport) {
+  const auto &instances = state->instances;
+  unsigned numProcs = transport.getSize();
+
+  // Group the instances by the subtree below the root they belong to, e.g.
+  // `root/a/b` belongs to `root/a`. The root instance is a group on its own.
+  llvm::StringMap<unsigned> subtrees;
+  std::vector<unsigned> subtreeOf(instances.size());
+  std::vector<unsigned> subtreeSize;
+  for (size_t i = 0, e = instances.size(); i < e; ++i) {
+    StringRef path = instances[i].path;
+    auto key = path.take_front(path.find('/', path.find('/') + 1));
+    auto it = subtrees.try_emplace(key, subtreeSize.size());
+    if (it.second)
+      subtreeSize.push_back(0);
+    subtreeOf[i] = it.first->second;
+    ++subtreeSize[subtreeOf[i]];
+  }
+
+  // Process 0 runs the root, the other subtrees go to the least loaded
+  // process, largest first.
+  std::vector<unsigned> procOf(subtreeSize.size(), 0);
+  std::vector<uint64_t> load(numProcs, 0);
+  unsigned rootSubtree = subtrees.lookup(root);
+  load[0] = subtreeSize[rootSubtree];
+  std::vector<unsigned> order;
+  for (unsigned i = 0, e = subtreeSize.size(); i < e; ++i)
+    if (i != rootSubtree)
+      order.push_back(i);
+  std::stable_sort(order.begin(), order.end(), [&](unsigned a, unsigned b) {
+    return subtreeSize[a] > subtreeSize[b];
+  });
+  for (auto subtree : order) {
+    auto proc = std::min_element(load.begin(), load.end()) - load.begin();
+    procOf[subtree] = proc;
+    load[proc] += subtreeSize[subtree];
+  }
+
+  // A signal is owned by the instance defining it, which lists it after its
+  // arguments, and shared if instances of several processes use it.
+  unsigned rank = transport.getRank();
+  isLocalInstance.assign(instances.size(), false);
+  isLocalSignal.assign(state->signals.size(), false);
+  std::vector<int> userProc(state->signals.size(), -1);
+  llvm::BitVector shared(state->signals.size());
+  for (size_t i = 0, e = instances.size(); i < e; ++i) {
+    unsigned proc = procOf[subtreeOf[i]];
+    isLocalInstance[i] = proc == rank;
+    const auto &senses = instances[i].sensitivityList;
+    for (size_t j = 0, je = senses.size(); j < je; ++j) {
+      auto sig = senses[j].globalIndex;
+      if (j >= instances[i].nArgs)
+        isLocalSignal[sig] = isLocalInstance[i];
+      if (userProc[sig] < 0)
+        userProc[sig] = proc;
+      else if (userProc[sig] != static_cast<int>(proc))
+        shared.set(sig);
+    }
+  }
+
+  exports = std::make_unique<EventBuffer>();
+  state->queue.exports = exports.get();
+  state->queue.exportedSignals = std::move(shared);
+}
+
+LogicalResult Engine::synchronize(bool stop, Optional<Time> &next) {
+  using namespace llvm::support::endian;
+
+  // Encode the stop flag, the next local slot and the exported drives. The
+  // numbers are little-endian, for processes running on different hosts.
+  SmallVector<uint8_t, 256> message;
+  auto write32 = [&](uint32_t value) {
+    uint8_t bytes[4];
+    write32le(bytes, value);
+    message.append(bytes, bytes + sizeof(bytes));
+  };
+  auto write64 = [&](uint64_t value) {
+    uint8_t bytes[8];
+    write64le(bytes, value);
+    message.append(bytes, bytes + sizeof(bytes));
+  };
+  auto writeTime = [&](const Time &time) {
+    write64(time.time);
+    write64(time.delta);
+    write64(time.eps);
+  };
+  bool hasNext = state->queue.events > 0;
+  message.push_back(stop);
+  message.push_back(hasNext);
+  writeTime(hasNext ? state->queue.top().time : Time());
+  write64(exports->drives.size());
+  for (const auto &drive : exports->drives) {
+    writeTime(drive.time);
+    write32(drive.index);
+    write32(drive.bitOffset);
+    write32(drive.width);
+    auto *bytes = exports->bytes.data() + drive.bytesOffset;
+    message.append(bytes, bytes + llvm::divideCeil(drive.width, 8));
+  }
+  exports->clear();
+
+  // Exchange the messages with one peer at a time, in rank order. The lower
+  // rank of each pair sends first.
+  unsigned rank = transport->getRank();
+  std::vector<std::vector<uint8_t>> received(transport->getSize());
+  for (unsigned peer = 0, e = transport->getSize(); peer < e; ++peer) {
+    if (peer == rank)
+      continue;
+    bool sendFirst = rank < peer;
+    if ((sendFirst && failed(transport->send(peer, message))) ||
+        failed(transport->receive(peer, received[peer])) ||
+        (!sendFirst && failed(transport->send(peer, message)))) {
+      llvm::errs() << "lost the connection to process " << peer << "\n";
+      return failure();
+    }
+  }
+
+  // Queue the drives of the other processes, without exporting them again,
+  // and find the earliest pending slot.
+  next = llvm::None;
+  if (hasNext)
+    next = state->queue.top().time;
+  state->queue.exports = nullptr;
+  for (unsigned peer = 0, e = transport->getSize(); peer < e; ++peer) {
+    if (peer == rank)
+      continue;
+    ArrayRef<uint8_t> data = received[peer];
+    auto take = [&](size_t size) -> const uint8_t * {
+      if (data.size() < size)
+        return nullptr;
+      auto *bytes = data.data();
+      data = data.drop_front(size);
+      return bytes;
+    };
+    auto malformed = [&] {
+      state->queue.exports = exports.get();
+      llvm::errs() << "malformed message from process " << peer << "\n";
+      return failure();
+    };
+
+    auto *header = take(2 + 4 * 8);
+    if (!header)
+      return malformed();
+    stop |= header[0] != 0;
+    Time peerNext(read64le(header + 2), read64le(header + 10),
+                  read64le(header + 18));
+    if (header[1] && (!next || peerNext < *next))
+      next = peerNext;
+
+    for (uint64_t i = 0, numDrives = read64le(header + 26); i < numDrives;
+         ++i) {
+      auto *fields = take(3 * 8 + 3 * 4);
+      if (!fields)
+        return malformed();
+      Time time(read64le(fields), read64le(fields + 8), read64le(fields + 16));
+      uint32_t index = read32le(fields + 24);
+      int32_t bitOffset = read32le(fields + 28);
+      uint32_t width = read32le(fields + 32);
+      auto *bytes = take(llvm::divideCeil(width, 8));
+      if (!bytes || index >= state->signals.size())
+        return malformed();
+      state->queue.insertOrUpdate(time, index, bitOffset,
+                                  const_cast<uint8_t *>(bytes), width);
+    }
+  }
+  state->queue.exports = exports.get();
+
+  if (stop)
+    next = llvm::None;
+  return success();
+}
+
+void Engine::runLevelized(WakeupSet &wakeupQueue, Trace &trace) {
+  const auto &signals = state->signalTable;
+  EventBuffer events;
+  SmallVector<uint64_t, 8> scratch, src;
+
+  for (auto inst : levelOrder) {
+    if (!wakeupQueue.contains(inst))
+      continue;
+
+    // Capture the drives of the instance.
+    setThreadEventBuffer(&events);
+    runInstance(inst, driveBuffers[0]);
+    flushThreadDriveBuffer(state.get());
+    setThreadEventBuffer(nullptr);
+
+    for (const auto &drive : events.drives) {
+      auto *bytes = events.bytes.data() + drive.bytesOffset;
+      // Only delta drives are applied in place, anything later is left to the
+      // queue.
+      if (drive.time.time != state->time.time ||
+          drive.time.eps != state->time.eps) {
+        state->queue.insertOrUpdate(drive.time, drive.index, drive.bitOffset,
+                                    const_cast<uint8_t *>(bytes), drive.width);
+        continue;
+      }
+
+      auto *value = signals.getValue(drive.index);
+      const uint64_t sigSize = signals.sizes[drive.index];
+      src.assign(llvm::divideCeil(drive.width, 64), 0);
+      std::memcpy(src.data(), bytes, llvm::divideCeil(drive.width, 8));
+      BitUpdate update = {static_cast<uint64_t>(drive.bitOffset), drive.width,
+                          src.data()};
+      if (profile)
+        ++profile->signals[drive.index].drives;
+
+      auto changed = applyBitUpdates(value, sigSize, update, scratch);
+      if (changed.first == changed.second)
+        continue;
+      if (profile)
+        ++profile->signals[drive.index].changes;
+
+      // The triggered levelized instances come later in the order.
+      wakeupTriggered(drive.index, wakeupQueue);
+      if (tracing)
+        trace.addChange(drive.index, changed.first, changed.second);
+      if (!isWatched.empty() && isWatched[drive.index])
+        checkWatchpoints(drive.index, trace);
+    }
+    for (const auto &wakeup : events.wakeups) {
+      state->queue.insertOrUpdate(wakeup.first, wakeup.second);
+      state->instances[wakeup.second].expectedWakeup = wakeup.first;
+    }
+    events.clear();
+  }
+}
+
+void Engine::buildLevelizedSchedule(ModuleOp module) {
+  auto &instances = state->instances;
+  size_t numInstances = instances.size();
+
+  // Find the signals driven and read by each instance, as global signal
+  // indexes, and whether the instance is combinational.
+  std::vector<SmallVector<unsigned, 4>> drives(numInstances);
+  std::vector<SmallVector<unsigned, 4>> reads(numInstances);
+  isLevelized.assign(numInstances, false);
+  for (size_t i = 0; i < numInstances; ++i) {
+    auto &inst = instances[i];
+    if (!inst.isEntity)
+      continue;
+    auto entity = module.lookupSymbol<EntityOp>(inst.unit);
+    if (!entity)
+      continue;
+
+    // The sensitivity list holds the arguments followed by the signals
+    // defined in the entity, in order.
+    DenseMap<Operation *, unsigned> sigIndices;
+    entity.walk([&](SigOp sig) {
+      sigIndices.insert({sig, entity.getNumArguments() + sigIndices.size()});
+    });
+    if (inst.sensitivityList.size() !=
+        entity.getNumArguments() + sigIndices.size())
+      continue;
+
+    auto getDrivenIndex = [&](Value signal) -> Optional<unsigned> {
+      while (auto *op = signal.getDefiningOp()) {
+        if (!isa<ExtractSliceOp, DynExtractSliceOp, ExtractElementOp,
+                 DynExtractElementOp>(op)) {
+          auto it = sigIndices.find(op);
+          if (it == sigIndices.end())
+            return llvm::None;
+          return it->second;
+        }
+        signal = op->getOperand(0);
+      }
+      auto arg = signal.cast<BlockArgument>();
+      if (arg.getOwner()->getParentOp() != entity)
+        return llvm::None;
+      return arg.getArgNumber();
+    };
+
+    // Outputs are in the sensitivity list too, but only the inputs of an
+    // instance make it depend on their drivers.
+    for (unsigned arg = 0, e = entity.ins(); arg != e; ++arg)
+      reads[i].push_back(inst.sensitivityList[arg].globalIndex);
+    llvm::sort(reads[i]);
+
+    bool combinational = true;
+    entity.walk([&](Operation *op) {
+      if (isa<RegOp>(op)) {
+        combinational = false;
+        return WalkResult::interrupt();
+      }
+      auto drv = dyn_cast<DrvOp>(op);
+      if (!drv)
+        return WalkResult::advance();
+      auto delay = drv.time().getDefiningOp<ConstOp>();
+      auto time = delay ? delay.value().dyn_cast<TimeAttr>() : TimeAttr();
+      auto index = getDrivenIndex(drv.signal());
+      if (!time || time.getTime() != 0 || time.getEps() != 0 || !index) {
+        combinational = false;
+        return WalkResult::interrupt();
+      }
+      drives[i].push_back(inst.sensitivityList[*index].globalIndex);
+      return WalkResult::advance();
+    });
+    isLevelized[i] = combinational;
+  }
+
+  // Sort the combinational instances topologically, along the edges from the
+  // instances driving a signal to the other ones reading it as an input.
+  std::vector<unsigned> numInputs(numInstances, 0);
+  std::vector<SmallVector<unsigned, 4>> successors(numInstances);
+  SmallVector<unsigned, 4> selfLoops;
+  for (size_t i = 0; i < numInstances; ++i) {
+    if (!isLevelized[i])
+      continue;
+    llvm::sort(drives[i]);
+    drives[i].erase(std::unique(drives[i].begin(), drives[i].end()),
+                    drives[i].end());
+    for (auto sig : drives[i]) {
+      for (auto succ : state->signalTable.getTriggers(sig)) {
+        if (!isLevelized[succ] ||
+            !std::binary_search(reads[succ].begin(), reads[succ].end(), sig))
+          continue;
+        // An instance reading what it drives is a loop of its own.
+        if (succ == i) {
+          selfLoops.push_back(i);
+          continue;
+        }
+        successors[i].push_back(succ);
+        ++numInputs[succ];
+      }
+    }
+  }
+
+  for (auto i : selfLoops)
+    isLevelized[i] = false;
+
+  levelOrder.clear();
+  for (size_t i = 0; i < numInstances; ++i)
+    if (isLevelized[i] && numInputs[i] == 0)
+      levelOrder.push_back(i);
+  for (size_t next = 0; next < levelOrder.size(); ++next)
+    for (auto succ : successors[levelOrder[next]])
+      if (--numInputs[succ] == 0)
+        levelOrder.push_back(succ);
+
+  // Whatever is left is on, or behind, a combinational loop.
+  for (size_t i = 0; i < numInstances; ++i)
+    if (numInputs[i] != 0)
+      isLevelized[i] = false;
 }
 
 void Engine::buildLayout(ModuleOp module) {
@@ -232,7 +1941,8 @@ void Engine::buildLayout(ModuleOp module) {
   rootInst.path = root;
 
   // Recursively walk the units starting at root.
-  walkEntity(rootEntity, rootInst);
+  InstanceGraph instanceGraph(module);
+  walkEntity(rootEntity, rootInst, instanceGraph);
 
   // The root is always an instance.
   rootInst.isEntity = true;
@@ -240,15 +1950,11 @@ void Engine::buildLayout(ModuleOp module) {
   state->instances.push_back(std::move(rootInst));
 
   // Add triggers to signals.
-  for (size_t i = 0, e = state->instances.size(); i < e; ++i) {
-    auto &inst = state->instances[i];
-    for (auto trigger : inst.sensitivityList) {
-      state->signals[trigger.globalIndex].triggers.push_back(i);
-    }
-  }
+  state->buildTriggerTable();
 }
 
-void Engine::walkEntity(EntityOp entity, Instance &child) {
+void Engine::walkEntity(EntityOp entity, Instance &child,
+                        const InstanceGraph &instanceGraph) {
   entity.walk([&](Operation *op) {
     assert(op);
 
@@ -264,8 +1970,7 @@ void Engine::walkEntity(EntityOp entity, Instance &child) {
       // Skip self-recursion.
       if (inst.callee() == child.name)
         return;
-      if (auto e =
-              op->getParentOfType<ModuleOp>().lookupSymbol(inst.callee())) {
+      if (auto *e = instanceGraph.getReferencedModule(inst)) {
         Instance newChild(child.unit + '.' + inst.name().str());
         newChild.unit = inst.callee().str();
         newChild.nArgs = inst.getNumOperands();
@@ -305,7 +2010,7 @@ void Engine::walkEntity(EntityOp entity, Instance &child) {
         // define new signals or instances.
         if (auto ent = dyn_cast<EntityOp>(e)) {
           newChild.isEntity = true;
-          walkEntity(ent, newChild);
+          walkEntity(ent, newChild, instanceGraph);
         } else {
           newChild.isEntity = false;
         }
@@ -16,6 +16,9 @@
 #include "llvm/Support/Format.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
 #include <string>
 
 using namespace llvm;
@@ -66,7 +69,7 @@ Signal::Signal(std::string name, std::string owner, uint8_t *value,
 bool Signal::operator==(const Signal &rhs) const {
   if (owner != rhs.owner || name != rhs.name || size != rhs.size)
     return false;
-  return std::memcmp(value.get(), rhs.value.get(), size);
+  return std::memcmp(value, rhs.value, size);
 }
 
 bool Signal::operator<(const Signal &rhs) const {
@@ -82,15 +85,16 @@ std::string Signal::dump() {
   raw_string_ostream ss(ret);
   ss << "0x";
   for (int i = size - 1; i >= 0; --i) {
-    ss << format_hex_no_prefix(static_cast<int>(value.get()[i]), 2);
+    ss << format_hex_no_prefix(static_cast<int>(value[i]), 2);
   }
   return ss.str();
 }
 
 std::string Signal::dump(unsigned elemIndex) {
-  assert(elements.size() > 0 && "the signal type has to be tuple or array!");
-  auto elemSize = elements[elemIndex].second;
-  auto ptr = value.get() + elements[elemIndex].first;
+  assert(getNumElements() > 0 && "the signal type has to be tuple or array!");
+  auto elem = getElement(elemIndex);
+  auto elemSize = elem.second;
+  auto ptr = value + elem.first;
   std::string ret;
   raw_string_ostream ss(ret);
   ss << "0x";
@@ -99,6 +103,28 @@ std::string Signal::dump(unsigned elemIndex) {
   }
   return ret;
 }
+std::pair<size_t, size_t> Signal::getElementRange(uint64_t begin,
+                                                  uint64_t end) const {
+  if (arraySize) {
+    auto first = std::min<uint64_t>(begin / arrayElementSize, arraySize);
+    auto last = std::min<uint64_t>(
+        llvm::divideCeil(end, arrayElementSize), arraySize);
+    return std::make_pair(first, last);
+  }
+  // Struct elements are few, scan them.
+  size_t first = elements.size(), last = 0;
+  for (size_t i = 0, e = elements.size(); i < e; ++i) {
+    if (elements[i].first >= end ||
+        elements[i].first + elements[i].second <= begin)
+      continue;
+    first = std::min(first, i);
+    last = i + 1;
+  }
+  if (first > last)
+    first = last;
+  return std::make_pair(first, last);
+}
+
 //===----------------------------------------------------------------------===//
 // Slot
 //===----------------------------------------------------------------------===//
@@ -109,123 +135,155 @@ bool Slot::operator>(const Slot &rhs) const { return rhs.time < time; }
 
 void Slot::insertChange(int index, int bitOffset, uint8_t *bytes,
                         unsigned width) {
-  // Get the amount of 64 bit words required to store the value in an APInt.
-  auto size = llvm::divideCeil(width, 64);
-
-  if (changesSize >= buffers.size()) {
-    // Create a new change buffer if we don't have any unused one available for
-    // reuse.
-    buffers.push_back(std::make_pair(
-        bitOffset,
-        APInt(width, makeArrayRef(reinterpret_cast<uint64_t *>(bytes), size))));
-  } else {
-    // Reuse the first available buffer.
-    buffers[changesSize] = std::make_pair(
-        bitOffset,
-        APInt(width, makeArrayRef(reinterpret_cast<uint64_t *>(bytes), size)));
-  }
+  // Copy the driven value to zero-initialized words at the end of the arena.
+  auto wordOffset = arena.size();
+  arena.resize(wordOffset + llvm::divideCeil(width, 64), 0);
+  std::memcpy(arena.data() + wordOffset, bytes, llvm::divideCeil(width, 8));
 
   // Map the signal index to the change buffer so we can retrieve
   // it after sorting.
-  changes.push_back(std::make_pair(index, changesSize));
-  ++changesSize;
+  changes.push_back(std::make_pair(index, buffers.size()));
+  buffers.push_back(ChangeBuffer({bitOffset, width, (unsigned)wordOffset}));
 }
 
 void Slot::insertChange(unsigned inst) { scheduled.push_back(inst); }
 
+void Slot::clear() {
+  changes.clear();
+  buffers.clear();
+  arena.clear();
+  scheduled.clear();
+}
+
+void circt::llhd::sim::insertBits(uint64_t *dst, uint64_t bitOffset,
+                                  const uint64_t *src, unsigned width) {
+  // Insert one source word at a time. Each word covers at most two words of
+  // the destination.
+  for (unsigned i = 0, e = llvm::divideCeil(width, 64); i < e; ++i) {
+    unsigned chunkWidth = std::min(64U, width - i * 64);
+    uint64_t mask = chunkWidth == 64 ? ~0ULL : (1ULL << chunkWidth) - 1;
+    uint64_t chunk = src[i] & mask;
+    uint64_t pos = bitOffset + i * 64;
+    uint64_t *word = dst + pos / 64;
+    unsigned shift = pos % 64;
+
+    word[0] = (word[0] & ~(mask << shift)) | (chunk << shift);
+    if (shift + chunkWidth > 64)
+      word[1] = (word[1] & ~(mask >> (64 - shift))) | (chunk >> (64 - shift));
+  }
+}
+
 //===----------------------------------------------------------------------===//
 // UpdateQueue
 //===----------------------------------------------------------------------===//
 void UpdateQueue::insertOrUpdate(Time time, int index, int bitOffset,
                                  uint8_t *bytes, unsigned width) {
+  exportDrive(time, index, bitOffset, bytes, width);
   auto &slot = getOrCreateSlot(time);
   slot.insertChange(index, bitOffset, bytes, width);
 }
 
+void UpdateQueue::exportDrive(Time time, unsigned index, int bitOffset,
+                              uint8_t *bytes, unsigned width) {
+  if (exports && exportedSignals.test(index))
+    exports->insertDrive(time, index, bitOffset, bytes, width);
+}
+
 void UpdateQueue::insertOrUpdate(Time time, unsigned inst) {
   auto &slot = getOrCreateSlot(time);
   slot.insertChange(inst);
 }
 
-Slot &UpdateQueue::getOrCreateSlot(Time time) {
-  auto &top = begin()[topSlot];
-
-  // Directly add to top slot.
-  if (!top.unused && time == top.time) {
-    return top;
-  }
+/// Return a comparator ordering slot indexes such that the heap algorithms
+/// keep the slot with the earliest time at the front.
+static auto slotHeapOrder(const SmallVectorImpl<Slot> &slots) {
+  return [&slots](unsigned lhs, unsigned rhs) {
+    return slots[lhs] > slots[rhs];
+  };
+}
 
-  // We need to search through the queue for an existing slot only if we're
-  // spawning an event later than the top slot. Adding to an existing slot
-  // scheduled earlier than the top slot should never happens, as then it should
-  // be the top.
-  if (events > 0 && top.time < time) {
-    for (size_t i = 0, e = size(); i < e; ++i) {
-      if (time == begin()[i].time) {
-        return begin()[i];
-      }
-    }
-  }
+Slot &UpdateQueue::getOrCreateSlot(Time time) {
+  // Directly return the pending slot registered for the given time, if any.
+  auto it = slotMap.find(time);
+  if (it != slotMap.end())
+    return slots[it->second];
 
-  // Spawn new event using an existing slot.
+  unsigned index;
   if (!unused.empty()) {
-    auto firstUnused = unused.pop_back_val();
-    auto &newSlot = begin()[firstUnused];
+    // Spawn new event using an existing slot.
+    index = unused.pop_back_val();
+    auto &newSlot = slots[index];
     newSlot.unused = false;
     newSlot.time = time;
-
-    // Update the top of the queue either if it is currently unused or the new
-    // timestamp is earlier than it.
-    if (top.unused || time < top.time)
-      topSlot = firstUnused;
-
-    ++events;
-    return newSlot;
+  } else {
+    // We do not have pre-allocated slots available, generate a new one.
+    index = slots.size();
+    slots.push_back(Slot(time));
   }
 
-  // We do not have pre-allocated slots available, generate a new one.
-  push_back(Slot(time));
-
-  // Update the top of the queue either if it is currently unused or the new
-  // timestamp is earlier than it.
-  if (top.unused || time < top.time)
-    topSlot = size() - 1;
+  // Register the slot and restore the heap ordering.
+  slotMap.insert(std::make_pair(time, index));
+  heap.push_back(index);
+  std::push_heap(heap.begin(), heap.end(), slotHeapOrder(slots));
 
   ++events;
-  return back();
+  return slots[index];
+}
+
+void UpdateQueue::getPendingSlots(
+    SmallVectorImpl<const Slot *> &result) const {
+  for (auto index : heap)
+    result.push_back(&slots[index]);
 }
 
 const Slot &UpdateQueue::top() {
-  assert(topSlot < size() && "top is pointing out of bounds!");
+  assert(!heap.empty() && "the event queue is empty!");
 
   // Sort the changes of the top slot such that all changes to the same signal
   // are in succession.
-  auto &top = begin()[topSlot];
-  llvm::sort(top.changes.begin(), top.changes.begin() + top.changesSize);
+  auto &top = slots[heap.front()];
+  llvm::sort(top.changes);
   return top;
 }
 
 void UpdateQueue::pop() {
+  assert(!heap.empty() && "the event queue is empty!");
+
+  // Remove the current top from the heap. This also makes the next earliest
+  // slot the new top of the queue.
+  std::pop_heap(heap.begin(), heap.end(), slotHeapOrder(slots));
+  auto topSlot = heap.pop_back_val();
+
   // Reset internal structures and decrease the event counter.
-  auto &curr = begin()[topSlot];
+  auto &curr = slots[topSlot];
+  slotMap.erase(curr.time);
   curr.unused = true;
-  curr.changesSize = 0;
-  curr.scheduled.clear();
-  curr.changes.clear();
+  curr.clear();
   curr.time = Time();
   --events;
 
   // Add to unused slots list for easy retrieval.
   unused.push_back(topSlot);
+}
+
+//===----------------------------------------------------------------------===//
+// EventBuffer
+//===----------------------------------------------------------------------===//
 
-  // Update the current top of the queue.
-  topSlot = std::distance(
-      begin(),
-      std::min_element(begin(), end(), [](const auto &a, const auto &b) {
-        // a is "smaller" than b if either a's timestamp is earlier than b's, or
-        // b is unused (i.e. b has no actual meaning).
-        return !a.unused && (a < b || b.unused);
-      }));
+void EventBuffer::insertDrive(Time time, unsigned index, int bitOffset,
+                              uint8_t *value, unsigned width) {
+  drives.push_back(Drive({time, index, bitOffset, width, bytes.size()}));
+  bytes.append(value, value + llvm::divideCeil(width, 8));
+}
+
+void EventBuffer::insertWakeup(Time time, unsigned inst) {
+  wakeups.push_back(std::make_pair(time, inst));
+}
+
+void EventBuffer::clear() {
+  drives.clear();
+  wakeups.clear();
+  bytes.clear();
 }
 
 //===----------------------------------------------------------------------===//
@@ -233,10 +291,13 @@ void UpdateQueue::pop() {
 //===----------------------------------------------------------------------===//
 
 State::~State() {
-  for (auto &inst : instances) {
-    if (inst.procState) {
-      std::free(inst.procState->senses);
-    }
+  // The instance states are released with the instance arena. Only the signal
+  // values remain to be freed.
+  instanceArena.Reset();
+  // The signal values are owned by the signal table once packed.
+  if (!signalTable.arena) {
+    for (auto &sig : signals)
+      std::free(sig.value);
   }
 }
 
@@ -253,6 +314,45 @@ void State::pushQueue(Time t, unsigned inst) {
   instances[inst].expectedWakeup = newTime;
 }
 
+void State::commitEvents(const EventBuffer &buffer) {
+  for (const auto &drive : buffer.drives) {
+    // The queue only reads from the driven bytes.
+    auto bytes = const_cast<uint8_t *>(buffer.bytes.data() + drive.bytesOffset);
+    queue.insertOrUpdate(drive.time, drive.index, drive.bitOffset, bytes,
+                         drive.width);
+  }
+  for (const auto &wakeup : buffer.wakeups) {
+    queue.insertOrUpdate(wakeup.first, wakeup.second);
+    instances[wakeup.second].expectedWakeup = wakeup.first;
+  }
+}
+
+void State::commitDrives(DriveBuffer &drives, EventBuffer *deferred) {
+  // Consecutive drives usually share their time, only look up the slot when
+  // it changes.
+  Slot *slot = nullptr;
+  for (uint64_t i = 0; i < drives.size; ++i) {
+    auto &entry = drives.entries[i];
+    auto *detail = entry.signal;
+    int bitOffset =
+        (detail->value - signalTable.getValue(detail->globalIndex)) * 8 +
+        detail->offset;
+    auto driveTime = time + Time(entry.time, entry.delta, entry.eps);
+    auto *bytes = reinterpret_cast<uint8_t *>(&entry.value);
+    if (deferred) {
+      deferred->insertDrive(driveTime, detail->globalIndex, bitOffset, bytes,
+                            entry.width);
+      continue;
+    }
+    queue.exportDrive(driveTime, detail->globalIndex, bitOffset, bytes,
+                      entry.width);
+    if (!slot || !(slot->time == driveTime))
+      slot = &queue.getOrCreateSlot(driveTime);
+    slot->insertChange(detail->globalIndex, bitOffset, bytes, entry.width);
+  }
+  drives.size = 0;
+}
+
 llvm::SmallVectorTemplateCommon<Instance>::iterator
 State::getInstanceIterator(std::string instName) {
   auto it =
@@ -269,44 +369,450 @@ int State::addSignal(std::string name, std::string owner) {
   return signals.size() - 1;
 }
 
-void State::addProcPtr(std::string name, ProcState *procStatePtr) {
+void State::addProcPtr(std::string name, ProcState *procStatePtr,
+                       uint64_t size) {
   auto it = getInstanceIterator(name);
 
   // Store instance index in process state.
   procStatePtr->inst = it - instances.begin();
-  (*it).procState = std::unique_ptr<ProcState>(procStatePtr);
+  (*it).procState = procStatePtr;
+  (*it).procStateSize = size;
 }
 
 int State::addSignalData(int index, std::string owner, uint8_t *value,
-                         uint64_t size) {
+                         uint64_t size, uint64_t width) {
   auto it = getInstanceIterator(owner);
 
   uint64_t globalIdx = (*it).sensitivityList[index + (*it).nArgs].globalIndex;
   auto &sig = signals[globalIdx];
 
   // Add pointer and size to global signal table entry.
-  sig.value = std::unique_ptr<uint8_t>(value);
+  sig.value = value;
   sig.size = size;
+  sig.width = width;
 
   // Add the value pointer to the signal detail struct for each instance this
   // signal appears in.
-  for (auto inst : signals[globalIdx].triggers) {
+  for (auto inst : signalTable.getTriggers(globalIdx)) {
     for (auto &detail : instances[inst].sensitivityList) {
       if (detail.globalIndex == globalIdx) {
-        detail.value = sig.value.get();
+        detail.value = sig.value;
       }
     }
   }
   return globalIdx;
 }
 
-void State::addSignalElement(unsigned index, unsigned offset, unsigned size) {
+uint8_t *State::allocInstanceState(uint64_t size) {
+  auto *ptr = static_cast<uint8_t *>(
+      instanceArena.Allocate(size, llvm::Align(alignof(std::max_align_t))));
+  std::memset(ptr, 0, size);
+  return ptr;
+}
+
+void State::addSignalElement(unsigned index, unsigned offset, unsigned size,
+                             unsigned width) {
   signals[index].elements.push_back(std::make_pair(offset, size));
+  signals[index].elementWidths.push_back(width);
+}
+
+void State::addSignalArray(unsigned index, unsigned elementSize,
+                           unsigned numElements, unsigned elementWidth) {
+  auto &sig = signals[index];
+  sig.arraySize = numElements;
+  sig.arrayElementSize = elementSize;
+  sig.arrayElementWidth = elementWidth;
+}
+
+void State::buildTriggerTable() {
+  // Collect the first position of each signal in each sensitivity list.
+  SmallVector<std::pair<unsigned, unsigned>, 0> senses;
+  SmallVector<unsigned, 0> sensesSignal;
+  auto &table = signalTable;
+  table.triggerBegin.assign(signals.size() + 1, 0);
+  for (size_t i = 0, e = instances.size(); i < e; ++i) {
+    SmallDenseMap<uint64_t, unsigned, 8> firstSense;
+    auto &list = instances[i].sensitivityList;
+    for (size_t j = 0, je = list.size(); j < je; ++j) {
+      auto globalIndex = list[j].globalIndex;
+      auto it = firstSense.insert(std::make_pair(globalIndex, j)).first;
+      senses.push_back(std::make_pair(i, it->second));
+      sensesSignal.push_back(globalIndex);
+      ++table.triggerBegin[globalIndex + 1];
+    }
+  }
+
+  // Scatter the triggers to the rows of their signals. Each row keeps the
+  // triggers in ascending instance order.
+  for (size_t i = 0, e = signals.size(); i < e; ++i)
+    table.triggerBegin[i + 1] += table.triggerBegin[i];
+  SmallVector<unsigned, 0> next(table.triggerBegin.begin(),
+                                table.triggerBegin.end() - 1);
+  table.triggerInsts.resize(senses.size());
+  table.triggerSenses.resize(senses.size());
+  for (size_t i = 0, e = senses.size(); i < e; ++i) {
+    auto pos = next[sensesSignal[i]]++;
+    table.triggerInsts[pos] = senses[i].first;
+    table.triggerSenses[pos] = senses[i].second;
+  }
+}
+
+std::unique_ptr<State> State::cloneLayout() const {
+  assert(!signalTable.arena && "cannot clone an initialized state");
+  auto clone = std::make_unique<State>();
+  clone->root = root;
+  for (auto &inst : instances) {
+    Instance newInst(inst.name);
+    newInst.path = inst.path;
+    newInst.unit = inst.unit;
+    newInst.isEntity = inst.isEntity;
+    newInst.nArgs = inst.nArgs;
+    newInst.sensitivityList = inst.sensitivityList;
+    clone->instances.push_back(std::move(newInst));
+  }
+  for (auto &sig : signals)
+    clone->signals.push_back(Signal(sig.name, sig.owner));
+  clone->signalTable.triggerBegin = signalTable.triggerBegin;
+  clone->signalTable.triggerInsts = signalTable.triggerInsts;
+  clone->signalTable.triggerSenses = signalTable.triggerSenses;
+  return clone;
+}
+
+int State::findSignal(StringRef name) {
+  auto split = name.rsplit('/');
+  for (size_t i = 0, e = signals.size(); i < e; ++i) {
+    auto &sig = signals[i];
+    if (sig.name != split.second)
+      continue;
+    auto it = getInstanceIterator(sig.owner);
+    if ((*it).path == split.first)
+      return i;
+  }
+  return -1;
+}
+
+bool State::setSignalValue(StringRef name, const APInt &value) {
+  int index = findSignal(name);
+  if (index < 0)
+    return false;
+
+  auto &sig = signals[index];
+  if (sig.size == 0)
+    return true;
+
+  // Copy the value bytes, truncated or zero-extended to the signal size.
+  auto bits = value.zextOrTrunc(sig.size * 8);
+  for (uint64_t i = 0; i < sig.size; ++i)
+    sig.value[i] = bits.extractBitsAsZExtValue(8, i * 8);
+  return true;
+}
+
+void State::packSignalValues() {
+  assert(!signalTable.arena && "signal values already packed");
+  auto &table = signalTable;
+
+  // Reserve twice the size of every value, as the lowered code relies on the
+  // extra space when shifting signals, rounded up to whole words.
+  uint64_t arenaSize = 0;
+  table.sizes.resize(signals.size());
+  table.offsets.resize(signals.size());
+  for (size_t i = 0, e = signals.size(); i < e; ++i) {
+    table.sizes[i] = signals[i].size;
+    table.offsets[i] = arenaSize;
+    arenaSize += alignTo(2 * signals[i].size, sizeof(uint64_t));
+  }
+  table.arena.reset(new uint64_t[arenaSize / sizeof(uint64_t)]());
+
+  // Update the signal details to the new value locations, keeping their byte
+  // offset in the signal.
+  for (auto &inst : instances) {
+    for (auto &detail : inst.sensitivityList) {
+      if (!detail.value)
+        continue;
+      auto &sig = signals[detail.globalIndex];
+      detail.value = table.getValue(detail.globalIndex) +
+                     (detail.value - sig.value);
+    }
+  }
+
+  // Move the values to the arena.
+  for (size_t i = 0, e = signals.size(); i < e; ++i) {
+    auto &sig = signals[i];
+    auto *value = table.getValue(i);
+    if (sig.value) {
+      std::memcpy(value, sig.value, sig.size);
+      std::free(sig.value);
+    }
+    sig.value = value;
+  }
+}
+
+//===----------------------------------------------------------------------===//
+// Checkpointing
+//===----------------------------------------------------------------------===//
+
+// Checkpoints start with a magic string and a format version, followed by
+// fixed-width fields in host byte order. They are only meant to be read back
+// by the same simulator build, for the same design.
+static constexpr char checkpointMagic[8] = {'L', 'L', 'H', 'D',
+                                            'C', 'K', 'P', 'T'};
+static constexpr uint32_t checkpointVersion = 2;
+
+/// The persisted values of a process start after its fixed fields.
+static constexpr size_t procValuesOffset = offsetof(ProcState, resumeState);
+
+template <typename T>
+static void writeField(raw_ostream &out, const T &value) {
+  out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+static void writeTime(raw_ostream &out, const Time &time) {
+  writeField(out, time.time);
+  writeField(out, time.delta);
+  writeField(out, time.eps);
+}
+
+namespace {
+/// Sequential reader over the checkpoint data. Every read fails once the end
+/// of the data is reached.
+struct CheckpointReader {
+  CheckpointReader(StringRef data) : data(data) {}
+
+  bool readBytes(void *dst, size_t size) {
+    if (data.size() < size)
+      return false;
+    std::memcpy(dst, data.data(), size);
+    data = data.drop_front(size);
+    return true;
+  }
+
+  template <typename T>
+  bool read(T &value) {
+    return readBytes(&value, sizeof(T));
+  }
+
+  bool read(Time &time) {
+    return read(time.time) && read(time.delta) && read(time.eps);
+  }
+
+  StringRef data;
+};
+} // namespace
+
+void State::writeCheckpoint(raw_ostream &out) const {
+  out.write(checkpointMagic, sizeof(checkpointMagic));
+  writeField(out, checkpointVersion);
+  writeTime(out, time);
+
+  // Signal values.
+  writeField<uint64_t>(out, signals.size());
+  for (auto &sig : signals) {
+    writeField<uint64_t>(out, sig.size);
+    out.write(reinterpret_cast<const char *>(sig.value), sig.size);
+  }
+
+  // Instance states. Processes are written position independently: the block
+  // to resume at, the senses and the persisted values, where the value
+  // pointers of persisted signals are made relative to the signal they point
+  // into. Zero stands for a signal which wasn't persisted yet.
+  writeField<uint64_t>(out, instances.size());
+  for (auto &inst : instances) {
+    writeField<uint8_t>(out, inst.isEntity);
+    writeTime(out, inst.expectedWakeup);
+    if (inst.isEntity) {
+      uint64_t size = inst.entityState ? inst.entityStateSize : 0;
+      writeField(out, size);
+      out.write(reinterpret_cast<const char *>(inst.entityState), size);
+      continue;
+    }
+    uint64_t size = inst.procState ? inst.procStateSize : 0;
+    writeField(out, size);
+    if (!size)
+      continue;
+    writeField<int32_t>(out, inst.procState->resume);
+    writeField<uint64_t>(out, inst.nArgs);
+    out.write(reinterpret_cast<const char *>(inst.procState->senses),
+              inst.nArgs);
+    auto *begin = reinterpret_cast<const uint8_t *>(inst.procState);
+    SmallVector<uint8_t, 64> values(begin + procValuesOffset, begin + size);
+    for (auto offset : inst.procSignalOffsets) {
+      SignalDetail detail;
+      std::memcpy(&detail, begin + offset, sizeof(detail));
+      uintptr_t relative = 0;
+      if (detail.value && detail.globalIndex < signals.size()) {
+        auto &sig = signals[detail.globalIndex];
+        if (detail.value >= sig.value && detail.value <= sig.value + sig.size)
+          relative = detail.value - sig.value + 1;
+      }
+      std::memcpy(values.data() + offset - procValuesOffset +
+                      offsetof(SignalDetail, value),
+                  &relative, sizeof(relative));
+    }
+    out.write(reinterpret_cast<const char *>(values.data()), values.size());
+  }
+
+  // Pending queue slots.
+  SmallVector<const Slot *, 8> pending;
+  queue.getPendingSlots(pending);
+  writeField<uint64_t>(out, pending.size());
+  for (auto *slot : pending) {
+    writeTime(out, slot->time);
+    writeField<uint64_t>(out, slot->changes.size());
+    for (auto &change : slot->changes) {
+      auto &buffer = slot->buffers[change.second];
+      writeField<uint32_t>(out, change.first);
+      writeField<int32_t>(out, buffer.bitOffset);
+      writeField<uint32_t>(out, buffer.width);
+      out.write(reinterpret_cast<const char *>(slot->getData(buffer)),
+                divideCeil(buffer.width, 64) * sizeof(uint64_t));
+    }
+    writeField<uint64_t>(out, slot->scheduled.size());
+    for (auto inst : slot->scheduled)
+      writeField<uint32_t>(out, inst);
+  }
+}
+
+Error State::readCheckpoint(StringRef data) {
+  CheckpointReader reader(data);
+  auto truncated = [] {
+    return createStringError(inconvertibleErrorCode(),
+                             "truncated checkpoint");
+  };
+  auto mismatch = [](const Twine &what) {
+    return createStringError(inconvertibleErrorCode(),
+                             "checkpoint does not match the design: " + what);
+  };
+
+  char magic[sizeof(checkpointMagic)];
+  uint32_t version;
+  if (!reader.readBytes(magic, sizeof(magic)) || !reader.read(version) ||
+      std::memcmp(magic, checkpointMagic, sizeof(magic)) != 0)
+    return createStringError(inconvertibleErrorCode(), "not a checkpoint");
+  if (version != checkpointVersion)
+    return createStringError(inconvertibleErrorCode(),
+                             "unsupported checkpoint version " +
+                                 Twine(version));
+
+  Time newTime;
+  if (!reader.read(newTime))
+    return truncated();
+
+  // Signal values.
+  uint64_t numSignals;
+  if (!reader.read(numSignals))
+    return truncated();
+  if (numSignals != signals.size())
+    return mismatch("signal count");
+  for (auto &sig : signals) {
+    uint64_t size;
+    if (!reader.read(size))
+      return truncated();
+    if (size != sig.size)
+      return mismatch("size of signal " + sig.name);
+    if (!reader.readBytes(sig.value, size))
+      return truncated();
+  }
+
+  // Instance states.
+  uint64_t numInstances;
+  if (!reader.read(numInstances))
+    return truncated();
+  if (numInstances != instances.size())
+    return mismatch("instance count");
+  for (auto &inst : instances) {
+    uint8_t isEntity;
+    uint64_t size;
+    if (!reader.read(isEntity) || !reader.read(inst.expectedWakeup) ||
+        !reader.read(size))
+      return truncated();
+    if (isEntity != inst.isEntity)
+      return mismatch("kind of instance " + inst.name);
+    if (inst.isEntity) {
+      if (size != (inst.entityState ? inst.entityStateSize : 0))
+        return mismatch("state size of instance " + inst.name);
+      if (!reader.readBytes(inst.entityState, size))
+        return truncated();
+      continue;
+    }
+    if (size != (inst.procState ? inst.procStateSize : 0))
+      return mismatch("state size of instance " + inst.name);
+    if (!size)
+      continue;
+    int32_t resume;
+    uint64_t nArgs;
+    if (!reader.read(resume) || !reader.read(nArgs))
+      return truncated();
+    if (nArgs != inst.nArgs)
+      return mismatch("argument count of instance " + inst.name);
+    auto *begin = reinterpret_cast<uint8_t *>(inst.procState);
+    if (!reader.readBytes(inst.procState->senses, nArgs) ||
+        !reader.readBytes(begin + procValuesOffset, size - procValuesOffset))
+      return truncated();
+    inst.procState->resume = resume;
+    for (auto offset : inst.procSignalOffsets) {
+      SignalDetail detail;
+      std::memcpy(&detail, begin + offset, sizeof(detail));
+      uintptr_t relative;
+      std::memcpy(&relative, &detail.value, sizeof(relative));
+      if (relative == 0) {
+        detail.value = nullptr;
+      } else {
+        if (detail.globalIndex >= signals.size() ||
+            relative - 1 > signals[detail.globalIndex].size)
+          return mismatch("persisted signal of instance " + inst.name);
+        detail.value = signals[detail.globalIndex].value + relative - 1;
+      }
+      std::memcpy(begin + offset, &detail, sizeof(detail));
+    }
+  }
+
+  // Replace the pending queue slots.
+  while (!queue.empty())
+    queue.pop();
+  uint64_t numSlots;
+  if (!reader.read(numSlots))
+    return truncated();
+  SmallVector<uint64_t, 4> words;
+  for (uint64_t i = 0; i < numSlots; ++i) {
+    Time slotTime;
+    uint64_t numChanges;
+    if (!reader.read(slotTime) || !reader.read(numChanges))
+      return truncated();
+    auto &slot = queue.getOrCreateSlot(slotTime);
+    for (uint64_t j = 0; j < numChanges; ++j) {
+      uint32_t index, width;
+      int32_t bitOffset;
+      if (!reader.read(index) || !reader.read(bitOffset) ||
+          !reader.read(width))
+        return truncated();
+      if (index >= signals.size())
+        return mismatch("signal index " + Twine(index));
+      words.resize(divideCeil(width, 64));
+      if (!reader.readBytes(words.data(), words.size() * sizeof(uint64_t)))
+        return truncated();
+      slot.insertChange(index, bitOffset,
+                        reinterpret_cast<uint8_t *>(words.data()), width);
+    }
+    uint64_t numScheduled;
+    if (!reader.read(numScheduled))
+      return truncated();
+    for (uint64_t j = 0; j < numScheduled; ++j) {
+      uint32_t inst;
+      if (!reader.read(inst))
+        return truncated();
+      if (inst >= instances.size())
+        return mismatch("instance index " + Twine(inst));
+      slot.insertChange(inst);
+    }
+  }
+
+  time = newTime;
+  return Error::success();
 }
 
 void State::dumpSignal(llvm::raw_ostream &out, int index) {
   auto &sig = signals[index];
-  for (auto inst : sig.triggers) {
+  for (auto inst : signalTable.getTriggers(index)) {
     out << time.dump() << "  " << instances[inst].path << "/" << sig.name
         << "  " << sig.dump() << "\n";
   }
@@ -331,7 +837,7 @@ void State::dumpSignalTriggers() {
   llvm::errs() << "::------------- Signal information -------------::\n";
   for (size_t i = 0, e = signals.size(); i < e; ++i) {
     llvm::errs() << signals[i].owner << "/" << signals[i].name << " triggers: ";
-    for (auto trig : signals[i].triggers) {
+    for (auto trig : signalTable.getTriggers(i)) {
       llvm::errs() << trig << " ";
     }
     llvm::errs() << "\n";
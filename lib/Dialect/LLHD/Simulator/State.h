@@ -15,8 +15,14 @@
 #define CIRCT_DIALECT_LLHD_SIMULATOR_STATE_H
 
 #include "llvm/ADT/APInt.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringMap.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/Error.h"
 
 #include <map>
 #include <queue>
@@ -49,9 +55,9 @@ struct Time {
   /// Get the stored time in a printable format.
   std::string dump();
 
-  uint64_t time;
-  uint64_t delta;
-  uint64_t eps;
+  uint64_t time = 0;
+  uint64_t delta = 0;
+  uint64_t eps = 0;
 
 private:
 };
@@ -93,17 +99,104 @@ struct Signal {
   /// format.
   std::string dump(unsigned);
 
+  /// Return the number of elements of an array or struct signal, zero for
+  /// other signals.
+  size_t getNumElements() const {
+    return arraySize ? arraySize : elements.size();
+  }
+
+  /// Return the byte offset and size of the i-th element.
+  std::pair<unsigned, unsigned> getElement(unsigned i) const {
+    if (arraySize)
+      return std::make_pair(i * arrayElementSize, arrayElementSize);
+    return elements[i];
+  }
+
+  /// Return the width in bits of the i-th element. Elements which are not
+  /// integers span all the bits of their bytes.
+  uint64_t getElementWidth(unsigned i) const {
+    if (arraySize)
+      return arrayElementWidth ? arrayElementWidth : arrayElementSize * 8;
+    return elementWidths[i] ? elementWidths[i] : elements[i].second * 8;
+  }
+
+  /// Return the width in bits of the signal value.
+  uint64_t getWidth() const { return width ? width : size * 8; }
+
+  /// Return the half-open range of the elements overlapping the given byte
+  /// range of the value. Constant time for array signals.
+  std::pair<size_t, size_t> getElementRange(uint64_t begin,
+                                            uint64_t end) const;
+
   std::string name;
   std::string owner;
-  // The list of instances this signal triggers.
-  std::vector<unsigned> triggers;
   uint64_t size;
-  std::unique_ptr<uint8_t> value;
+  // The width in bits of an integer signal, zero for other signals.
+  uint64_t width = 0;
+  // The signal value. Points into the value arena of the signal table once
+  // the signal values are packed.
+  uint8_t *value;
+  // The offset and size of each element of a struct signal, and the width in
+  // bits of the integer elements, zero for the others.
   std::vector<std::pair<unsigned, unsigned>> elements;
+  std::vector<unsigned> elementWidths;
+  // The number of elements, the element size and the integer element width of
+  // an array signal, whose layout is implied by them.
+  uint64_t arraySize = 0;
+  uint64_t arrayElementSize = 0;
+  uint64_t arrayElementWidth = 0;
+};
+
+/// Structure-of-arrays storage of the signal data accessed when applying
+/// signal changes. All the signal values live in one contiguous arena, and the
+/// instances triggered by each signal are stored in compressed sparse row
+/// form. Cold data, such as names and owners, stays in the `Signal` entries.
+struct SignalTable {
+  /// Return the value of the i-th signal.
+  uint8_t *getValue(unsigned i) const {
+    return reinterpret_cast<uint8_t *>(arena.get()) + offsets[i];
+  }
+
+  /// Return the instances triggered by the i-th signal.
+  llvm::ArrayRef<unsigned> getTriggers(unsigned i) const {
+    return llvm::makeArrayRef(triggerInsts)
+        .slice(triggerBegin[i], triggerBegin[i + 1] - triggerBegin[i]);
+  }
+
+  /// Return, for each instance triggered by the i-th signal, the position of
+  /// the signal in the instance's sensitivity list.
+  llvm::ArrayRef<unsigned> getTriggerSenses(unsigned i) const {
+    return llvm::makeArrayRef(triggerSenses)
+        .slice(triggerBegin[i], triggerBegin[i + 1] - triggerBegin[i]);
+  }
+
+  // The size in bytes of each signal value.
+  llvm::SmallVector<uint64_t, 0> sizes;
+  // The byte offset of each signal value in the arena.
+  llvm::SmallVector<uint64_t, 0> offsets;
+  // The storage of all the signal values, word aligned.
+  std::unique_ptr<uint64_t[]> arena;
+  // Start of the triggers of each signal, with one trailing end entry.
+  llvm::SmallVector<unsigned, 0> triggerBegin;
+  llvm::SmallVector<unsigned, 0> triggerInsts;
+  llvm::SmallVector<unsigned, 0> triggerSenses;
 };
 
+/// Insert the lowest width bits of src into dst, starting at the given bit
+/// offset. Both buffers are interpreted as little-endian sequences of 64-bit
+/// words, and the bits of dst outside of the inserted range are preserved.
+void insertBits(uint64_t *dst, uint64_t bitOffset, const uint64_t *src,
+                unsigned width);
+
 /// The simulator's internal representation of one queue slot.
 struct Slot {
+  /// A signal change buffer, referring to a range of words in the slot's arena.
+  struct ChangeBuffer {
+    int bitOffset;
+    unsigned width;
+    unsigned wordOffset;
+  };
+
   /// Create a new empty slot.
   Slot(Time time) : time(time) {}
 
@@ -119,13 +212,23 @@ struct Slot {
   /// Insert a scheduled process wakeup.
   void insertChange(unsigned inst);
 
+  /// Get the driven value of a change buffer.
+  const uint64_t *getData(const ChangeBuffer &buffer) const {
+    return arena.data() + buffer.wordOffset;
+  }
+
+  /// Remove all the changes and scheduled wakeups, keeping the allocated
+  /// storage for reuse.
+  void clear();
+
   // A map from signal indexes to change buffers. Makes it easy to sort the
   // changes such that we can process one signal at a time.
   llvm::SmallVector<std::pair<unsigned, unsigned>, 32> changes;
   // Buffers for the signal changes.
-  llvm::SmallVector<std::pair<unsigned, llvm::APInt>, 32> buffers;
-  // The number of used change buffers in the slot.
-  size_t changesSize = 0;
+  llvm::SmallVector<ChangeBuffer, 32> buffers;
+  // Storage for the driven values of all the change buffers. Reset when the
+  // slot is popped, but never shrunk, so that reused slots do not allocate.
+  llvm::SmallVector<uint64_t, 32> arena;
 
   // Processes with scheduled wakeup.
   llvm::SmallVector<unsigned, 4> scheduled;
@@ -133,10 +236,21 @@ struct Slot {
   bool unused = false;
 };
 
-/// This is equivalent to and std::priorityQueue<Slot> ordered using the greater
-/// operator, which adds an insertion method to add changes to a slot.
-class UpdateQueue : public llvm::SmallVector<Slot, 8> {
-  unsigned topSlot = 0;
+struct EventBuffer;
+
+/// The simulator's event queue. Slots are allocated from a pool and recycled
+/// through the `unused` list once popped. Pending slots are indexed by their
+/// time in a hash map, such that adding a change to an existing slot takes
+/// constant time, and ordered in a binary min-heap, such that the earliest slot
+/// is always available at the front.
+class UpdateQueue {
+  // The pool of allocated slots, both pending and unused.
+  llvm::SmallVector<Slot, 8> slots;
+  // Indexes of the pending slots, kept as a min-heap ordered by slot time.
+  llvm::SmallVector<unsigned, 8> heap;
+  // Map from the time of each pending slot to its index in the pool.
+  llvm::DenseMap<Time, unsigned> slotMap;
+  // Indexes of the slots available for reuse.
   llvm::SmallVector<unsigned, 4> unused;
 
 public:
@@ -163,7 +277,85 @@ public:
   /// unused and resets its internal structures such that they can be reused.
   void pop();
 
+  /// Return true if there are no pending slots in the queue.
+  bool empty() const { return heap.empty(); }
+
+  /// Return the number of pending slots in the queue.
+  size_t size() const { return heap.size(); }
+
+  /// Collect the pending slots, in no particular order.
+  void getPendingSlots(llvm::SmallVectorImpl<const Slot *> &result) const;
+
+  /// Record the drive in the exports buffer if the signal is exported.
+  void exportDrive(Time time, unsigned index, int bitOffset, uint8_t *bytes,
+                   unsigned width);
+
   unsigned events = 0;
+  // If set, the drives of the signals set in `exportedSignals` are also
+  // recorded in this buffer, to be forwarded to the other processes of a
+  // distributed simulation.
+  EventBuffer *exports = nullptr;
+  llvm::BitVector exportedSignals;
+};
+
+/// Buffer of queue insertions issued by units running on a worker thread. The
+/// insertions are recorded in issue order and later committed to the queue by
+/// the main thread, such that parallel runs produce the same queue contents as
+/// sequential ones.
+struct EventBuffer {
+  /// A deferred signal drive. The driven value is copied to the byte buffer
+  /// at the given offset, as the original storage does not outlive the unit
+  /// invocation.
+  struct Drive {
+    Time time;
+    unsigned index;
+    int bitOffset;
+    unsigned width;
+    size_t bytesOffset;
+  };
+
+  /// Record a signal drive.
+  void insertDrive(Time time, unsigned index, int bitOffset, uint8_t *bytes,
+                   unsigned width);
+
+  /// Record a scheduled instance wakeup.
+  void insertWakeup(Time time, unsigned inst);
+
+  /// Remove all the recorded insertions, keeping the allocated storage.
+  void clear();
+
+  llvm::SmallVector<Drive, 8> drives;
+  llvm::SmallVector<std::pair<Time, unsigned>, 4> wakeups;
+  llvm::SmallVector<uint8_t, 64> bytes;
+};
+
+/// Buffer the lowered units append their inlined drives to. The layout of the
+/// entries and of the first three members is known to the LLHD to LLVM
+/// lowering. The drives are committed in bulk once the units ran, and before
+/// any drive going through the runtime library, such that the issue order of
+/// all the drives is preserved.
+struct DriveBuffer {
+  /// A buffered drive of a value of at most 64 bits.
+  struct Entry {
+    SignalDetail *signal;
+    uint64_t value;
+    uint64_t width;
+    uint64_t time;
+    uint64_t delta;
+    uint64_t eps;
+  };
+
+  /// Create an empty buffer holding up to the given number of drives.
+  explicit DriveBuffer(uint64_t capacity = 1024)
+      : entries(new Entry[capacity]), size(0), capacity(capacity),
+        storage(entries) {}
+
+  Entry *entries;
+  uint64_t size;
+  uint64_t capacity;
+
+private:
+  std::unique_ptr<Entry[]> storage;
 };
 
 /// State structure for process persistence across suspension.
@@ -191,13 +383,59 @@ struct Instance {
   size_t nArgs = 0;
   // The arguments and signals of this instance.
   llvm::SmallVector<SignalDetail, 0> sensitivityList;
-  std::unique_ptr<ProcState> procState;
-  std::unique_ptr<uint8_t> entityState;
+  // The process or entity state, allocated in the state's instance arena.
+  ProcState *procState = nullptr;
+  uint8_t *entityState = nullptr;
+  // The size in bytes of the process or entity state.
+  uint64_t procStateSize = 0;
+  uint64_t entityStateSize = 0;
+  // The byte offsets of the signals persisted in the process state.
+  llvm::SmallVector<uint64_t, 0> procSignalOffsets;
   Time expectedWakeup;
   // A pointer to the base unit jitted function.
   void (*unitFPtr)(void **);
 };
 
+/// The set of instances to wake up in the current delta step. Membership is
+/// tracked in a bit vector, such that insertion is constant time and
+/// duplicate-free, while the members are also kept in a dense list for fast
+/// iteration.
+class WakeupSet {
+  llvm::BitVector isScheduled;
+  llvm::SmallVector<unsigned, 8> list;
+
+public:
+  /// Resize the set to hold the given number of instances.
+  void resize(size_t numInstances) { isScheduled.resize(numInstances); }
+
+  /// Add an instance to the set, if not already present.
+  void insert(unsigned inst) {
+    if (isScheduled.test(inst))
+      return;
+    isScheduled.set(inst);
+    list.push_back(inst);
+  }
+
+  /// Return true if the instance is in the set.
+  bool contains(unsigned inst) const { return isScheduled.test(inst); }
+
+  /// Return the members of the set, sorted in ascending instance order.
+  llvm::ArrayRef<unsigned> getSorted() {
+    llvm::sort(list);
+    return list;
+  }
+
+  /// Remove all the members of the set.
+  void clear() {
+    for (auto inst : list)
+      isScheduled.reset(inst);
+    list.clear();
+  }
+
+  bool empty() const { return list.empty(); }
+  size_t size() const { return list.size(); }
+};
+
 /// The simulator's state. It contains the current simulation time, signal
 /// values and the event queue.
 struct State {
@@ -214,6 +452,15 @@ struct State {
   /// Push a new scheduled wakeup event in the event queue.
   void pushQueue(Time time, unsigned inst);
 
+  /// Commit the insertions recorded in an event buffer to the event queue, in
+  /// the order they were recorded.
+  void commitEvents(const EventBuffer &buffer);
+
+  /// Commit the drives of a drive buffer, in the order they were appended, to
+  /// the given event buffer if any, else to the event queue. The drive buffer
+  /// is left empty.
+  void commitDrives(DriveBuffer &drives, EventBuffer *deferred = nullptr);
+
   /// Find an instance in the instances list by name and return an
   /// iterator for it.
   llvm::SmallVectorTemplateCommon<Instance>::iterator
@@ -223,12 +470,58 @@ struct State {
   int addSignal(std::string name, std::string owner);
 
   int addSignalData(int index, std::string owner, uint8_t *value,
-                    uint64_t size);
-
-  void addSignalElement(unsigned, unsigned, unsigned);
-
-  /// Add a pointer to the process persistence state to a process instance.
-  void addProcPtr(std::string name, ProcState *procStatePtr);
+                    uint64_t size, uint64_t width);
+
+  void addSignalElement(unsigned, unsigned, unsigned, unsigned);
+
+  /// Set the layout of an array signal with the given number of elements of
+  /// the given size in bytes and width in bits, zero if not an integer.
+  void addSignalArray(unsigned index, unsigned elementSize,
+                      unsigned numElements, unsigned elementWidth);
+
+  /// Build the trigger lists of the signal table from the sensitivity lists of
+  /// all the instances. If a signal appears more than once in the same
+  /// sensitivity list, its first position is used.
+  void buildTriggerTable();
+
+  /// Return a new state with the same instance and signal layout, before the
+  /// design initialization. Has to be called before initializing this state.
+  std::unique_ptr<State> cloneLayout() const;
+
+  /// Return the index of the signal with the given hierarchical name, i.e. the
+  /// path of its owning instance followed by '/' and the signal name, or -1 if
+  /// no such signal exists.
+  int findSignal(llvm::StringRef name);
+
+  /// Set the value of the signal with the given hierarchical name, i.e. the
+  /// path of its owning instance followed by '/' and the signal name. Returns
+  /// false if no such signal exists.
+  bool setSignalValue(llvm::StringRef name, const llvm::APInt &value);
+
+  /// Move the signal values allocated by the design initialization to the
+  /// value arena of the signal table, and update the signal details of all the
+  /// instances to point into it.
+  void packSignalValues();
+
+  /// Add a pointer to the process persistence state of the given size to a
+  /// process instance.
+  void addProcPtr(std::string name, ProcState *procStatePtr, uint64_t size);
+
+  /// Allocate zero-initialized memory for the state of an instance. The
+  /// instance states are allocated in order from one arena, such that they are
+  /// laid out contiguously, and released together with the state.
+  uint8_t *allocInstanceState(uint64_t size);
+
+  /// Write a binary checkpoint of the simulation state to the out stream. This
+  /// covers the current time, the signal values, the pending queue slots, and
+  /// the process and entity states of all the instances.
+  void writeCheckpoint(llvm::raw_ostream &out) const;
+
+  /// Restore the simulation state from a checkpoint previously written by
+  /// `writeCheckpoint`. The state has to be initialized with the same design
+  /// the checkpoint was taken from. Pending queue slots are replaced by the
+  /// checkpointed ones.
+  llvm::Error readCheckpoint(llvm::StringRef data);
 
   /// Dump a signal to the out stream. One entry is added for every instance
   /// the signal appears in.
@@ -244,11 +537,33 @@ struct State {
   std::string root;
   llvm::SmallVector<Instance, 0> instances;
   llvm::SmallVector<Signal, 0> signals;
+  SignalTable signalTable;
   UpdateQueue queue;
+  // The arena holding the entity and process states, in instance order.
+  llvm::BumpPtrAllocator instanceArena;
 };
 
 } // namespace sim
 } // namespace llhd
 } // namespace circt
 
+namespace llvm {
+template <>
+struct DenseMapInfo<circt::llhd::sim::Time> {
+  static circt::llhd::sim::Time getEmptyKey() {
+    return circt::llhd::sim::Time(~0ULL, ~0ULL, ~0ULL);
+  }
+  static circt::llhd::sim::Time getTombstoneKey() {
+    return circt::llhd::sim::Time(~0ULL - 1, ~0ULL, ~0ULL);
+  }
+  static unsigned getHashValue(const circt::llhd::sim::Time &t) {
+    return llvm::hash_combine(t.time, t.delta, t.eps);
+  }
+  static bool isEqual(const circt::llhd::sim::Time &lhs,
+                      const circt::llhd::sim::Time &rhs) {
+    return lhs == rhs;
+  }
+};
+} // namespace llvm
+
 #endif // CIRCT_DIALECT_LLHD_SIMULATOR_STATE_H
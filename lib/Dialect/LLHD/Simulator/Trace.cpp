@@ -13,6 +13,9 @@
 
 #include "Trace.h"
 
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/GlobPattern.h"
 #include "llvm/Support/raw_ostream.h"
 
 #include <regex>
@@ -20,19 +23,135 @@
 using namespace circt::llhd::sim;
 
 Trace::Trace(std::unique_ptr<State> const &state, llvm::raw_ostream &out,
-             TraceMode mode)
-    : out(out), state(state), mode(mode) {
+             TraceMode mode, llvm::ArrayRef<std::string> filters, int maxDepth)
+    : out(out), state(state), mode(mode), currentTime(state->time) {
   auto root = state->root;
+  std::regex defaultName("(sig)?[0-9]*");
   for (auto &sig : state->signals) {
-    if (mode != full && mode != merged && sig.owner != root) {
+    if (mode != full && mode != merged && mode != vcd && sig.owner != root) {
       isTraced.push_back(false);
-    } else if (mode == namedOnly &&
-               std::regex_match(sig.name, std::regex("(sig)?[0-9]*"))) {
+    } else if (mode == namedOnly && std::regex_match(sig.name, defaultName)) {
       isTraced.push_back(false);
     } else {
       isTraced.push_back(true);
     }
   }
+  if (!filters.empty() || maxDepth >= 0)
+    applyFilters(filters, maxDepth);
+  if (mode == vcd)
+    vcdDirtyRanges.resize(state->signals.size(), std::make_pair(0, 0));
+}
+
+//===----------------------------------------------------------------------===//
+// Signal filtering
+//===----------------------------------------------------------------------===//
+
+namespace {
+/// A trie over the instance hierarchy. Each node represents one instance and
+/// holds the signals visible in it, such that the filters only have to visit
+/// the parts of the hierarchy they can match.
+struct InstanceTrie {
+  struct Node {
+    llvm::StringMap<unsigned> children;
+    llvm::SmallVector<std::pair<llvm::StringRef, unsigned>, 4> signals;
+    int depth;
+  };
+
+  /// Build the trie from the instance paths and signal triggers of a state.
+  InstanceTrie(const State &state) {
+    nodes.push_back(Node({{}, {}, -1}));
+    std::vector<unsigned> instNodes;
+    for (auto &inst : state.instances) {
+      llvm::SmallVector<llvm::StringRef, 8> path;
+      llvm::StringRef(inst.path).split(path, '/');
+      unsigned node = 0;
+      for (auto name : path) {
+        auto it = nodes[node].children.insert(
+            std::make_pair(name, (unsigned)nodes.size()));
+        if (it.second)
+          nodes.push_back(Node({{}, {}, nodes[node].depth + 1}));
+        node = it.first->second;
+      }
+      instNodes.push_back(node);
+    }
+    for (size_t i = 0, e = state.signals.size(); i < e; ++i)
+      for (auto inst : state.signalTable.getTriggers(i))
+        nodes[instNodes[inst]].signals.push_back(
+            std::make_pair(llvm::StringRef(state.signals[i].name), i));
+  }
+
+  /// Mark the signals matched by the given filter components, starting at the
+  /// given node, and not deeper than maxDepth.
+  void match(unsigned node, llvm::ArrayRef<llvm::GlobPattern> filter,
+             int maxDepth, std::vector<bool> &matched) {
+    auto &n = nodes[node];
+    if (maxDepth >= 0 && n.depth > maxDepth)
+      return;
+    if (filter.size() == 1) {
+      for (auto &sig : n.signals)
+        if (filter.front().match(sig.first))
+          matched[sig.second] = true;
+      return;
+    }
+    for (auto &child : n.children)
+      if (filter.front().match(child.getKey()))
+        match(child.getValue(), filter.drop_front(), maxDepth, matched);
+  }
+
+  /// Mark all the signals appearing in instances up to maxDepth.
+  void matchDepth(int maxDepth, std::vector<bool> &matched) {
+    for (auto &n : nodes)
+      if (n.depth >= 0 && n.depth <= maxDepth)
+        for (auto &sig : n.signals)
+          matched[sig.second] = true;
+  }
+
+  std::vector<Node> nodes;
+};
+} // namespace
+
+llvm::Error
+Trace::parseFilter(llvm::StringRef filter,
+                   llvm::SmallVectorImpl<llvm::GlobPattern> &patterns) {
+  llvm::SmallVector<llvm::StringRef, 8> parts;
+  filter.split(parts, '/');
+  if (parts.size() < 2)
+    return llvm::createStringError(
+        llvm::inconvertibleErrorCode(),
+        "expected an instance path and a signal name");
+  for (auto part : parts) {
+    auto pattern = llvm::GlobPattern::create(part);
+    if (!pattern)
+      return pattern.takeError();
+    patterns.push_back(std::move(*pattern));
+  }
+  return llvm::Error::success();
+}
+
+void Trace::applyFilters(llvm::ArrayRef<std::string> filters, int maxDepth) {
+  InstanceTrie trie(*state);
+  std::vector<bool> matched(state->signals.size(), false);
+
+  if (filters.empty())
+    trie.matchDepth(maxDepth, matched);
+
+  // The filters were checked when they were set on the engine.
+  for (auto &filter : filters) {
+    llvm::SmallVector<llvm::GlobPattern, 8> patterns;
+    if (auto err = parseFilter(filter, patterns)) {
+      llvm::consumeError(std::move(err));
+      continue;
+    }
+    trie.match(0, patterns, maxDepth, matched);
+  }
+
+  for (size_t i = 0, e = isTraced.size(); i < e; ++i)
+    isTraced[i] = isTraced[i] && matched[i];
+}
+
+void Trace::restrictTo(const std::vector<bool> &mask) {
+  for (size_t i = 0, e = isTraced.size(); i < e; ++i)
+    isTraced[i] = isTraced[i] && mask[i];
 }
 
 //===----------------------------------------------------------------------===//
@@ -65,11 +184,13 @@ void Trace::pushChange(unsigned inst, unsigned sigIndex, int elem = -1) {
   }
 }
 
-void Trace::pushAllChanges(unsigned inst, unsigned sigIndex) {
+void Trace::pushAllChanges(unsigned inst, unsigned sigIndex, uint64_t begin,
+                           uint64_t end) {
   auto &sig = state->signals[sigIndex];
-  if (sig.elements.size() > 0) {
-    // Push changes for all signal elements.
-    for (size_t i = 0, e = sig.elements.size(); i < e; ++i) {
+  if (sig.getNumElements() > 0) {
+    // Push changes for the signal elements in the changed range.
+    auto range = sig.getElementRange(begin, end);
+    for (size_t i = range.first; i < range.second; ++i) {
       pushChange(inst, sigIndex, i);
     }
   } else {
@@ -78,29 +199,44 @@ void Trace::pushAllChanges(unsigned inst, unsigned sigIndex) {
   }
 }
 
-void Trace::addChange(unsigned sigIndex) {
+void Trace::addChange(unsigned sigIndex, uint64_t begin, uint64_t end) {
+  if (mode == vcd) {
+    // Only record which bytes of the signals changed, the values are diffed at
+    // flush time.
+    if (!isTraced[sigIndex])
+      return;
+    auto &range = vcdDirtyRanges[sigIndex];
+    if (range.first >= range.second) {
+      range = std::make_pair(begin, end);
+      vcdDirty.push_back(sigIndex);
+      return;
+    }
+    range.first = std::min(range.first, begin);
+    range.second = std::max(range.second, end);
+    return;
+  }
   currentTime = state->time;
   if (isTraced[sigIndex]) {
     if (mode == full) {
-      auto &sig = state->signals[sigIndex];
       // Add a change for each connected instance.
-      for (auto inst : sig.triggers) {
-        pushAllChanges(inst, sigIndex);
+      for (auto inst : state->signalTable.getTriggers(sigIndex)) {
+        pushAllChanges(inst, sigIndex, begin, end);
       }
     } else if (mode == reduced) {
       // The root is always the last instance in the instances list.
-      pushAllChanges(state->instances.size() - 1, sigIndex);
+      pushAllChanges(state->instances.size() - 1, sigIndex, begin, end);
     } else if (mode == merged || mode == mergedReduce || mode == namedOnly) {
-      addChangeMerged(sigIndex);
+      addChangeMerged(sigIndex, begin, end);
     }
   }
 }
 
-void Trace::addChangeMerged(unsigned sigIndex) {
+void Trace::addChangeMerged(unsigned sigIndex, uint64_t begin, uint64_t end) {
   auto &sig = state->signals[sigIndex];
-  if (sig.elements.size() > 0) {
-    // Add a change for all sub-elements
-    for (size_t i = 0, e = sig.elements.size(); i < e; ++i) {
+  if (sig.getNumElements() > 0) {
+    // Add a change for the sub-elements in the changed range.
+    auto range = sig.getElementRange(begin, end);
+    for (size_t i = range.first; i < range.second; ++i) {
       auto valueDump = sig.dump(i);
       mergedChanges[std::make_pair(sigIndex, i)] = valueDump;
     }
@@ -124,7 +260,9 @@ void Trace::sortChanges() {
 }
 
 void Trace::flush(bool force) {
-  if (mode == full || mode == reduced)
+  if (mode == vcd)
+    flushVCD(force);
+  else if (mode == full || mode == reduced)
     flushFull();
   else if (mode == merged || mode == mergedReduce || mode == namedOnly)
     if (state->time.time > currentTime.time || force)
@@ -148,12 +286,11 @@ void Trace::flushMerged() {
   for (auto elem : mergedChanges) {
     auto sigIndex = elem.first.first;
     auto sigElem = elem.first.second;
-    auto &sig = state->signals[sigIndex];
     auto change = elem.second;
 
     if (mode == merged) {
       // Add the changes for all connected instances.
-      for (auto inst : sig.triggers) {
+      for (auto inst : state->signalTable.getTriggers(sigIndex)) {
         pushChange(inst, sigIndex, sigElem);
       }
     } else {
@@ -174,3 +311,139 @@ void Trace::flushMerged() {
     changes.clear();
   }
 }
+
+//===----------------------------------------------------------------------===//
+// VCD format
+//===----------------------------------------------------------------------===//
+
+/// Return the VCD identifier code for the given index, using the printable
+/// ASCII characters as digits.
+static std::string getVCDIdentifier(unsigned index) {
+  std::string id;
+  do {
+    id.push_back('!' + index % 94);
+    index /= 94;
+  } while (index > 0);
+  return id;
+}
+
+void Trace::dumpVCDHeader() {
+  // Intern one identifier per signal element. Every instance a signal appears
+  // in refers to the same identifier, such that each value change is dumped
+  // only once.
+  vcdElements.resize(state->signals.size());
+  unsigned numIds = 0;
+  for (size_t i = 0, e = state->signals.size(); i < e; ++i) {
+    if (!isTraced[i])
+      continue;
+    auto &sig = state->signals[i];
+    auto addElement = [&](unsigned size, unsigned width) {
+      vcdElements[i].push_back(VCDElement({getVCDIdentifier(numIds++),
+                                           (unsigned)vcdValues.size(), size,
+                                           width}));
+      vcdValues.resize(vcdValues.size() + size);
+    };
+    if (sig.getNumElements() == 0)
+      addElement(sig.size, sig.getWidth());
+    for (size_t j = 0, e = sig.getNumElements(); j < e; ++j)
+      addElement(sig.getElement(j).second, sig.getElementWidth(j));
+  }
+
+  // Gather the variable declarations of each instance, sorted by path.
+  std::vector<std::pair<std::string, unsigned>> decls;
+  for (size_t i = 0, e = state->signals.size(); i < e; ++i) {
+    if (!isTraced[i])
+      continue;
+    for (auto inst : state->signalTable.getTriggers(i))
+      decls.push_back(std::make_pair(state->instances[inst].path, i));
+  }
+  std::stable_sort(decls.begin(), decls.end(),
+                   [](const std::pair<std::string, unsigned> &lhs,
+                      const std::pair<std::string, unsigned> &rhs) {
+                     return lhs.first < rhs.first;
+                   });
+
+  out << "$timescale 1ps $end\n";
+
+  // Open and close scopes as the instance paths change.
+  llvm::SmallVector<llvm::StringRef, 8> openScopes;
+  for (auto &decl : decls) {
+    llvm::SmallVector<llvm::StringRef, 8> scopes;
+    llvm::StringRef(decl.first).split(scopes, '/');
+
+    size_t common = 0;
+    while (common < openScopes.size() && common < scopes.size() &&
+           openScopes[common] == scopes[common])
+      ++common;
+    for (size_t i = common, e = openScopes.size(); i < e; ++i)
+      out << "$upscope $end\n";
+    openScopes.resize(common);
+    for (size_t i = common, e = scopes.size(); i < e; ++i) {
+      out << "$scope module " << scopes[i] << " $end\n";
+      openScopes.push_back(scopes[i]);
+    }
+
+    auto &sig = state->signals[decl.second];
+    auto &elements = vcdElements[decl.second];
+    if (sig.getNumElements() == 0) {
+      out << "$var wire " << elements[0].width << " " << elements[0].id << " "
+          << sig.name << " $end\n";
+      continue;
+    }
+    for (size_t i = 0, e = elements.size(); i < e; ++i)
+      out << "$var wire " << elements[i].width << " " << elements[i].id
+          << " " << sig.name << "[" << i << "] $end\n";
+  }
+  for (size_t i = 0, e = openScopes.size(); i < e; ++i)
+    out << "$upscope $end\n";
+  out << "$enddefinitions $end\n";
+}
+
+void Trace::flushVCD(bool force) {
+  // VCD has no notion of delta steps, only dump the values reached at the end
+  // of each real-time step.
+  if (state->time.time == currentTime.time && !force)
+    return;
+
+  bool dumpAll = !vcdHeaderDumped;
+  if (dumpAll) {
+    dumpVCDHeader();
+    vcdHeaderDumped = true;
+  }
+
+  // Diff the current value of each changed element against its last dumped
+  // value, and dump it if it differs.
+  llvm::sort(vcdDirty);
+  bool timeDumped = false;
+  for (auto sigIndex : vcdDirty) {
+    auto &sig = state->signals[sigIndex];
+    auto &elements = vcdElements[sigIndex];
+    // Only diff the elements in the changed range, unless dumping everything.
+    std::pair<size_t, size_t> range(0, elements.size());
+    if (!dumpAll && sig.getNumElements() > 0)
+      range = sig.getElementRange(vcdDirtyRanges[sigIndex].first,
+                                  vcdDirtyRanges[sigIndex].second);
+    vcdDirtyRanges[sigIndex] = std::make_pair(0, 0);
+    for (size_t i = range.first; i < range.second; ++i) {
+      auto &elem = elements[i];
+      const uint8_t *value =
+          sig.value +
+          (sig.getNumElements() == 0 ? 0 : sig.getElement(i).first);
+      uint8_t *last = vcdValues.data() + elem.offset;
+      if (!dumpAll && std::memcmp(value, last, elem.size) == 0)
+        continue;
+      std::memcpy(last, value, elem.size);
+
+      if (!timeDumped) {
+        out << "#" << currentTime.time << "\n";
+        timeDumped = true;
+      }
+      out << 'b';
+      for (int bit = elem.width - 1; bit >= 0; --bit)
+        out << (((value[bit / 8] >> (bit % 8)) & 1) ? '1' : '0');
+      out << ' ' << elem.id << '\n';
+    }
+  }
+  vcdDirty.clear();
+  currentTime = state->time;
+}
@@ -19,6 +19,12 @@
 
 #include "State.h"
 
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/GlobPattern.h"
+
+#include <limits>
 #include <map>
 #include <vector>
 
@@ -30,7 +36,7 @@ namespace circt {
 namespace llhd {
 namespace sim {
 
-enum TraceMode { full, reduced, merged, mergedReduce, namedOnly };
+enum TraceMode { full, reduced, merged, mergedReduce, namedOnly, vcd };
 
 class Trace {
   llvm::raw_ostream &out;
@@ -46,14 +52,41 @@ class Trace {
   // Buffer of last dumped change for each signal.
   std::map<std::pair<std::string, int>, std::string> lastValue;
 
+  /// A traced signal element in the VCD format, with its interned identifier
+  /// code, the offset of its last dumped value in the VCD value buffer, and its
+  /// size in bytes and width in bits.
+  struct VCDElement {
+    std::string id;
+    unsigned offset;
+    unsigned size;
+    unsigned width;
+  };
+  // The elements of each signal, or one element for non-structured signals.
+  std::vector<std::vector<VCDElement>> vcdElements;
+  // All the last dumped values, stored contiguously.
+  std::vector<uint8_t> vcdValues;
+  // The byte range of each signal changed since the last flush, empty if it
+  // did not change, and the list of the changed signals.
+  std::vector<std::pair<uint64_t, uint64_t>> vcdDirtyRanges;
+  std::vector<unsigned> vcdDirty;
+  bool vcdHeaderDumped = false;
+
+  /// Intern the VCD identifiers of all the signals and dump the VCD header,
+  /// including the scopes and variable declarations.
+  void dumpVCDHeader();
+  /// Flush the value changes to the output stream in VCD format.
+  void flushVCD(bool force);
+
   /// Push one change to the changes vector.
   void pushChange(unsigned inst, unsigned sigIndex, int elem);
-  /// Push one change for each element of a signal if it is of a structured
-  /// type, or the full signal otherwise.
-  void pushAllChanges(unsigned inst, unsigned sigIndex);
+  /// Push one change for each element of a signal overlapping the given byte
+  /// range if it is of a structured type, or the full signal otherwise.
+  void pushAllChanges(unsigned inst, unsigned sigIndex, uint64_t begin,
+                      uint64_t end);
 
-  /// Add a merged change to the change buffer.
-  void addChangeMerged(unsigned);
+  /// Add a merged change for the elements overlapping the given byte range to
+  /// the change buffer.
+  void addChangeMerged(unsigned sigIndex, uint64_t begin, uint64_t end);
 
   /// Sorts the changes buffer lexicographically wrt. the hierarchical paths.
   void sortChanges();
@@ -63,12 +96,39 @@ class Trace {
   // Flush the changes buffer to the output stream with merged format.
   void flushMerged();
 
+  /// Restrict tracing to the signals matching at least one of the given
+  /// hierarchical glob filters, and owned by instances at most maxDepth levels
+  /// below the root.
+  void applyFilters(llvm::ArrayRef<std::string> filters, int maxDepth);
+
 public:
+  /// Create a new trace. If filters are given, only the signals whose
+  /// hierarchical path in some instance matches one of the filters are traced.
+  /// Filters are '/'-separated lists of glob patterns, one per hierarchy level,
+  /// with the last one matching the signal name (e.g. "root/core/*/pc"). If
+  /// maxDepth is non-negative, only the signals appearing in instances at most
+  /// maxDepth levels below the root are traced.
   Trace(std::unique_ptr<State> const &state, llvm::raw_ostream &out,
-        TraceMode mode);
+        TraceMode mode, llvm::ArrayRef<std::string> filters = {},
+        int maxDepth = -1);
+
+  /// Compile a trace filter into the glob patterns of its hierarchy levels.
+  /// Fails if a pattern is malformed, or if the filter does not have at least
+  /// one instance level and the signal name.
+  static llvm::Error
+  parseFilter(llvm::StringRef filter,
+              llvm::SmallVectorImpl<llvm::GlobPattern> &patterns);
+
+  /// Only trace the signals set in the given mask, e.g. the signals owned by
+  /// the instances run by this process in a distributed simulation. Has to be
+  /// called before any change is added.
+  void restrictTo(const std::vector<bool> &mask);
 
-  /// Add a value change to the trace changes buffer.
-  void addChange(unsigned);
+  /// Add a value change to the trace changes buffer. Only the elements of a
+  /// structured signal overlapping the given byte range of its value are
+  /// considered changed.
+  void addChange(unsigned sigIndex, uint64_t begin = 0,
+                 uint64_t end = std::numeric_limits<uint64_t>::max());
 
   /// Flush the changes buffer to the output stream. The flush can be forced for
   /// merged changes, flushing even if the next real-time step has not been
@@ -0,0 +1,324 @@
+//===- Transport.cpp - Distributed simulation transport ---------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the socket based transports of the distributed LLHD
+// simulation.
+//
+//===----------------------------------------------------------------------===//
+
+#include "circt/Dialect/LLHD/Simulator/Transport.h"
+
+#include "llvm/ADT/Twine.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/Errno.h"
+
+#include <chrono>
+#include <thread>
+
+#ifdef LLVM_ON_UNIX
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using namespace mlir;
+using namespace circt::llhd::sim;
+
+Transport::~Transport() = default;
+
+#ifdef LLVM_ON_UNIX
+
+/// Return an error for the failure of the last system call.
+static llvm::Error makeSystemError(const llvm::Twine &what) {
+  return llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                 what + ": " + llvm::sys::StrError());
+}
+
+/// Write all the given bytes, resuming after partial writes and interrupts.
+static bool writeAll(int fd, const uint8_t *data, size_t size) {
+  while (size) {
+    ssize_t n = ::write(fd, data, size);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+/// Read exactly the given number of bytes, resuming after partial reads and
+/// interrupts. Fails at the end of the stream.
+static bool readAll(int fd, uint8_t *data, size_t size) {
+  while (size) {
+    ssize_t n = ::read(fd, data, size);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+namespace {
+/// A transport over one connected stream socket per peer. Every message is
+/// preceded by its size, as a 64-bit little-endian integer.
+class SocketTransport : public Transport {
+public:
+  SocketTransport(unsigned rank, std::vector<int> sockets,
+                  std::vector<pid_t> children = {})
+      : rank(rank), sockets(std::move(sockets)),
+        children(std::move(children)) {}
+
+  ~SocketTransport() override { (void)close(); }
+
+  unsigned getRank() const override { return rank; }
+
+  unsigned getSize() const override { return sockets.size(); }
+
+  LogicalResult send(unsigned peer, llvm::ArrayRef<uint8_t> message) override {
+    uint8_t header[8];
+    llvm::support::endian::write64le(header, message.size());
+    return success(writeAll(sockets[peer], header, sizeof(header)) &&
+                   writeAll(sockets[peer], message.data(), message.size()));
+  }
+
+  LogicalResult receive(unsigned peer, std::vector<uint8_t> &message) override {
+    uint8_t header[8];
+    if (!readAll(sockets[peer], header, sizeof(header)))
+      return failure();
+    message.resize(llvm::support::endian::read64le(header));
+    return success(readAll(sockets[peer], message.data(), message.size()));
+  }
+
+  LogicalResult close() override {
+    for (auto &fd : sockets) {
+      if (fd >= 0)
+        ::close(fd);
+      fd = -1;
+    }
+
+    bool allExited = true;
+    for (auto pid : children) {
+      int status;
+      pid_t result;
+      do {
+        result = ::waitpid(pid, &status, 0);
+      } while (result < 0 && errno == EINTR);
+      allExited &= result == pid && WIFEXITED(status) &&
+                   WEXITSTATUS(status) == 0;
+    }
+    children.clear();
+    return success(allExited);
+  }
+
+private:
+  unsigned rank;
+  // The socket connected to each peer, -1 for this process.
+  std::vector<int> sockets;
+  // The processes forked by this one.
+  std::vector<pid_t> children;
+};
+} // namespace
+
+/// Close all the valid sockets of the list.
+static void closeAll(llvm::ArrayRef<int> sockets) {
+  for (auto fd : sockets)
+    if (fd >= 0)
+      ::close(fd);
+}
+
+llvm::Expected<std::unique_ptr<Transport>>
+circt::llhd::sim::forkLocalTransport(unsigned size) {
+  // Connect every pair of processes up front, the forked processes then keep
+  // their own ends.
+  std::vector<std::vector<int>> ends(size, std::vector<int>(size, -1));
+  auto closeEnds = [&] {
+    for (auto &row : ends)
+      closeAll(row);
+  };
+  for (unsigned i = 0; i < size; ++i) {
+    for (unsigned j = i + 1; j < size; ++j) {
+      int fds[2];
+      if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        auto err = makeSystemError("cannot create a local socket");
+        closeEnds();
+        return std::move(err);
+      }
+      ends[i][j] = fds[0];
+      ends[j][i] = fds[1];
+    }
+  }
+
+  unsigned rank = 0;
+  std::vector<pid_t> children;
+  for (unsigned r = 1; r < size; ++r) {
+    pid_t pid = ::fork();
+    if (pid < 0) {
+      // The processes forked so far see their connections close and fail.
+      auto err = makeSystemError("cannot fork");
+      closeEnds();
+      return std::move(err);
+    }
+    if (pid == 0) {
+      rank = r;
+      children.clear();
+      break;
+    }
+    children.push_back(pid);
+  }
+
+  // Only keep the ends of this process.
+  for (unsigned r = 0; r < size; ++r)
+    if (r != rank)
+      closeAll(ends[r]);
+  return std::make_unique<SocketTransport>(rank, std::move(ends[rank]),
+                                           std::move(children));
+}
+
+/// Resolve the given `host:port` endpoint and open a TCP socket for it, bound
+/// and listening if listen is set, connected otherwise. Returns -1 on failure.
+static int openSocket(llvm::StringRef endpoint, bool listen) {
+  auto hostAndPort = endpoint.rsplit(':');
+  std::string host = hostAndPort.first.str();
+  std::string port = hostAndPort.second.str();
+
+  addrinfo hints = {};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = listen ? AI_PASSIVE : 0;
+  addrinfo *addrs;
+  if (::getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(),
+                    &hints, &addrs) != 0)
+    return -1;
+
+  int fd = -1;
+  for (auto *addr = addrs; addr; addr = addr->ai_next) {
+    fd = ::socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+    if (fd < 0)
+      continue;
+    if (listen) {
+      int one = 1;
+      ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+      if (::bind(fd, addr->ai_addr, addr->ai_addrlen) == 0 &&
+          ::listen(fd, SOMAXCONN) == 0)
+        break;
+    } else if (::connect(fd, addr->ai_addr, addr->ai_addrlen) == 0) {
+      break;
+    }
+    ::close(fd);
+    fd = -1;
+  }
+  ::freeaddrinfo(addrs);
+  return fd;
+}
+
+llvm::Expected<std::unique_ptr<Transport>>
+circt::llhd::sim::connectSocketTransport(unsigned rank,
+                                         llvm::ArrayRef<std::string> endpoints,
+                                         unsigned timeout) {
+  unsigned size = endpoints.size();
+  if (rank >= size)
+    return llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                   "rank %u out of range", rank);
+
+  std::vector<int> sockets(size, -1);
+  int listener = -1;
+  auto fail = [&](llvm::Error err) {
+    closeAll(sockets);
+    if (listener >= 0)
+      ::close(listener);
+    return err;
+  };
+
+  // Only the higher ranks connect to this process.
+  if (rank + 1 < size) {
+    listener = openSocket(endpoints[rank], /*listen=*/true);
+    if (listener < 0)
+      return fail(makeSystemError("cannot listen on " + endpoints[rank]));
+  }
+
+  // Connect to the lower ranks, which may not be listening yet, and tell them
+  // who we are.
+  auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(timeout);
+  for (unsigned peer = 0; peer < rank; ++peer) {
+    int fd;
+    while ((fd = openSocket(endpoints[peer], /*listen=*/false)) < 0) {
+      if (std::chrono::steady_clock::now() > deadline)
+        return fail(makeSystemError("cannot connect to " + endpoints[peer]));
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    sockets[peer] = fd;
+    uint8_t id[4];
+    llvm::support::endian::write32le(id, rank);
+    if (!writeAll(fd, id, sizeof(id)))
+      return fail(makeSystemError("cannot connect to " + endpoints[peer]));
+  }
+
+  // Accept the higher ranks, in any order.
+  for (unsigned i = rank + 1; i < size; ++i) {
+    int fd;
+    do {
+      fd = ::accept(listener, nullptr, nullptr);
+    } while (fd < 0 && errno == EINTR);
+    uint8_t id[4];
+    if (fd < 0 || !readAll(fd, id, sizeof(id))) {
+      auto err =
+          makeSystemError("cannot accept a connection on " + endpoints[rank]);
+      if (fd >= 0)
+        ::close(fd);
+      return fail(std::move(err));
+    }
+    unsigned peer = llvm::support::endian::read32le(id);
+    if (peer <= rank || peer >= size || sockets[peer] >= 0) {
+      ::close(fd);
+      return fail(llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                          "unexpected connection from rank %u",
+                                          peer));
+    }
+    sockets[peer] = fd;
+  }
+  if (listener >= 0)
+    ::close(listener);
+
+  // The messages are small and exchanged in lock step, don't delay them.
+  for (auto fd : sockets) {
+    if (fd < 0)
+      continue;
+    int one = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+  return std::make_unique<SocketTransport>(rank, std::move(sockets));
+}
+
+#else
+
+llvm::Expected<std::unique_ptr<Transport>>
+circt::llhd::sim::forkLocalTransport(unsigned size) {
+  return llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                 "local processes are not supported on this "
+                                 "platform");
+}
+
+llvm::Expected<std::unique_ptr<Transport>>
+circt::llhd::sim::connectSocketTransport(unsigned rank,
+                                         llvm::ArrayRef<std::string> endpoints,
+                                         unsigned timeout) {
+  return llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                 "sockets are not supported on this platform");
+}
+
+#endif
@@ -18,54 +18,93 @@
 using namespace llvm;
 using namespace circt::llhd::sim;
 
+/// The event buffer insertions are deferred to on the current thread, if any.
+static thread_local EventBuffer *deferredEvents = nullptr;
+
+/// The drive buffer of the units running on the current thread, if any.
+static thread_local DriveBuffer *inlinedDrives = nullptr;
+
+void circt::llhd::sim::setThreadEventBuffer(EventBuffer *buffer) {
+  deferredEvents = buffer;
+}
+
+void circt::llhd::sim::setThreadDriveBuffer(DriveBuffer *buffer) {
+  inlinedDrives = buffer;
+}
+
+void circt::llhd::sim::flushThreadDriveBuffer(State *state) {
+  if (inlinedDrives && inlinedDrives->size)
+    state->commitDrives(*inlinedDrives, deferredEvents);
+}
+
 //===----------------------------------------------------------------------===//
 // Runtime interface
 //===----------------------------------------------------------------------===//
 
 int allocSignal(State *state, int index, char *owner, uint8_t *value,
-                int64_t size) {
+                int64_t size, int64_t width) {
   assert(state && "alloc_signal: state not found");
   std::string sOwner(owner);
 
-  return state->addSignalData(index, sOwner, value, size);
+  return state->addSignalData(index, sOwner, value, size, width);
 }
 
 void addSigArrayElements(State *state, unsigned index, unsigned size,
-                         unsigned numElements) {
-  for (size_t i = 0; i < numElements; ++i)
-    state->addSignalElement(index, size * i, size);
+                         unsigned numElements, unsigned width) {
+  state->addSignalArray(index, size, numElements, width);
 }
 
 void addSigStructElement(State *state, unsigned index, unsigned offset,
-                         unsigned size) {
-  state->addSignalElement(index, offset, size);
+                         unsigned size, unsigned width) {
+  state->addSignalElement(index, offset, size, width);
+}
+
+uint8_t *allocInstanceState(State *state, uint64_t size) {
+  assert(state && "alloc_instance_state: state not found");
+  return state->allocInstanceState(size);
 }
 
-void allocProc(State *state, char *owner, ProcState *procState) {
+void allocProc(State *state, char *owner, ProcState *procState,
+               uint64_t size) {
   assert(state && "alloc_proc: state not found");
   std::string sOwner(owner);
-  state->addProcPtr(sOwner, procState);
+  state->addProcPtr(sOwner, procState, size);
 }
 
-void allocEntity(State *state, char *owner, uint8_t *entityState) {
+void addProcSignal(State *state, ProcState *procState, uint64_t offset) {
+  assert(state && "add_proc_signal: state not found");
+  state->instances[procState->inst].procSignalOffsets.push_back(offset);
+}
+
+void allocEntity(State *state, char *owner, uint8_t *entityState,
+                 uint64_t size) {
   assert(state && "alloc_entity: state not found");
   auto it = state->getInstanceIterator(owner);
-  (*it).entityState = std::unique_ptr<uint8_t>(entityState);
+  (*it).entityState = entityState;
+  (*it).entityStateSize = size;
 }
 
 void driveSignal(State *state, SignalDetail *detail, uint8_t *value,
                  uint64_t width, int time, int delta, int eps) {
   assert(state && "drive_signal: state not found");
 
+  // Keep the drives appended to the drive buffer before this one in order.
+  flushThreadDriveBuffer(state);
+
   auto globalIndex = detail->globalIndex;
   auto offset = detail->offset;
 
   int bitOffset =
-      (detail->value - state->signals[globalIndex].value.get()) * 8 + offset;
+      (detail->value - state->signalTable.getValue(globalIndex)) * 8 + offset;
 
-  // Spawn a new event.
-  state->queue.insertOrUpdate(state->time + Time(time, delta, eps), globalIndex,
-                              bitOffset, value, width);
+  // Spawn a new event, or defer it if running in parallel.
+  auto driveTime = state->time + Time(time, delta, eps);
+  if (deferredEvents) {
+    deferredEvents->insertDrive(driveTime, globalIndex, bitOffset, value,
+                                width);
+    return;
+  }
+  state->queue.insertOrUpdate(driveTime, globalIndex, bitOffset, value, width);
 }
 
 void llhdSuspend(State *state, ProcState *procState, int time, int delta,
@@ -73,6 +112,10 @@ void llhdSuspend(State *state, ProcState *procState, int time, int delta,
   // Add a new scheduled wake up if a time is specified.
   if (time || delta || eps) {
     Time sTime(time, delta, eps);
+    if (deferredEvents) {
+      deferredEvents->insertWakeup(state->time + sTime, procState->inst);
+      return;
+    }
     state->pushQueue(sTime, procState->inst);
   }
 }
@@ -15,34 +15,68 @@
 
 #include "State.h"
 
+namespace circt {
+namespace llhd {
+namespace sim {
+
+/// Set the event buffer of the calling thread. While set, drives and process
+/// suspensions issued by the units running on this thread are recorded in the
+/// buffer instead of being pushed to the state's queue. Pass nullptr to go back
+/// to direct queue insertion.
+void setThreadEventBuffer(EventBuffer *buffer);
+
+/// Set the drive buffer the units running on the calling thread append their
+/// inlined drives to. While set, the buffered drives are committed before any
+/// drive going through the runtime library. Pass nullptr to unset it.
+void setThreadDriveBuffer(DriveBuffer *buffer);
+
+/// Commit the drives buffered on the calling thread, to the thread's event
+/// buffer if set, else to the state's queue.
+void flushThreadDriveBuffer(State *state);
+
+} // namespace sim
+} // namespace llhd
+} // namespace circt
+
 extern "C" {
 
 //===----------------------------------------------------------------------===//
 // Runtime interfaces
 //===----------------------------------------------------------------------===//
 
-/// Allocate a new signal. The index of the new signal in the state's list of
+/// Allocate a new signal. The width is the one in bits of an integer signal,
+/// zero for other signals. The index of the new signal in the state's list of
 /// signals is returned.
 int allocSignal(circt::llhd::sim::State *state, int index, char *owner,
-                uint8_t *value, int64_t size);
+                uint8_t *value, int64_t size, int64_t width);
 
-/// Add offset and size information for the elements of an array signal.
+/// Add offset, size and width information for the elements of an array signal.
 void addSigArrayElements(circt::llhd::sim::State *state, unsigned index,
-                         unsigned size, unsigned numElements);
+                         unsigned size, unsigned numElements, unsigned width);
 
-/// Add offset and size information for one element of a struct signal. Elements
-/// are assumed to be added (by calling this function) in sequential order, from
-/// first to last.
+/// Add offset, size and width information for one element of a struct signal.
+/// Elements are assumed to be added (by calling this function) in sequential
+/// order, from first to last.
 void addSigStructElement(circt::llhd::sim::State *state, unsigned index,
-                         unsigned offset, unsigned size);
+                         unsigned offset, unsigned size, unsigned width);
+
+/// Allocate zero-initialized memory for the state of an entity or process
+/// instance. The memory is owned by the simulation state.
+uint8_t *allocInstanceState(circt::llhd::sim::State *state, uint64_t size);
 
-/// Add allocated constructs to a process instance.
+/// Add allocated constructs to a process instance. The size is the one of the
+/// whole process state, including the persistence area.
 void allocProc(circt::llhd::sim::State *state, char *owner,
-               circt::llhd::sim::ProcState *procState);
+               circt::llhd::sim::ProcState *procState, uint64_t size);
+
+/// Record that the process state holds a persisted signal at the given byte
+/// offset. Its value pointer is relocated when a checkpoint is restored.
+void addProcSignal(circt::llhd::sim::State *state,
+                   circt::llhd::sim::ProcState *procState, uint64_t offset);
 
-/// Add allocated entity state to the given instance.
+/// Add allocated entity state of the given size to the given instance.
 void allocEntity(circt::llhd::sim::State *state, char *owner,
-                 uint8_t *entityState);
+                 uint8_t *entityState, uint64_t size);
 
 /// Drive a value onto a signal.
 void driveSignal(circt::llhd::sim::State *state,
@@ -0,0 +1,95 @@
+//===- EntityInliningPass.cpp - Implement Entity Inlining Pass ------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Implement pass to flatten the entity hierarchy by inlining instantiated
+// entities into their parents.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetails.h"
+#include "circt/Dialect/LLHD/IR/LLHDOps.h"
+#include "circt/Dialect/LLHD/Transforms/Passes.h"
+#include "mlir/IR/BlockAndValueMapping.h"
+#include "mlir/IR/SymbolTable.h"
+
+using namespace mlir;
+using namespace circt;
+
+namespace {
+
+struct EntityInliningPass
+    : public llhd::EntityInliningBase<EntityInliningPass> {
+  void runOnOperation() override;
+
+private:
+  void flatten(llhd::EntityOp entity);
+
+  SymbolTable *symbolTable;
+  // The entities being flattened (false) or already flattened (true).
+  DenseMap<Operation *, bool> flattened;
+};
+} // namespace
+
+/// Replace an instance with a copy of the body of the entity it instantiates.
+/// The signals and instances of the entity are prefixed with the instance
+/// name, such that their hierarchical names are unchanged.
+static void inlineInstance(llhd::InstOp inst, llhd::EntityOp callee) {
+  OpBuilder builder(inst);
+  BlockAndValueMapping mapping;
+  mapping.map(callee.getArguments(), inst.getOperands());
+
+  auto prefixName = [&](Operation *op, StringRef name) {
+    op->setAttr("name",
+               builder.getStringAttr((inst.name() + "/" + name).str()));
+  };
+  for (auto &op : callee.getBodyBlock()->without_terminator()) {
+    auto *clone = builder.clone(op, mapping);
+    if (auto sig = dyn_cast<llhd::SigOp>(clone))
+      prefixName(sig, sig.name());
+    else if (auto child = dyn_cast<llhd::InstOp>(clone))
+      prefixName(child, child.name());
+  }
+  inst.erase();
+}
+
+/// Inline all the entities instantiated by the given one, after flattening
+/// them first. Instances of processes, and recursive instances, are kept.
+void EntityInliningPass::flatten(llhd::EntityOp entity) {
+  flattened[entity] = false;
+
+  SmallVector<llhd::InstOp, 4> insts;
+  entity.walk([&](llhd::InstOp inst) { insts.push_back(inst); });
+  for (auto inst : insts) {
+    auto callee = symbolTable->lookup<llhd::EntityOp>(inst.callee());
+    if (!callee)
+      continue;
+    auto it = flattened.find(callee);
+    if (it == flattened.end())
+      flatten(callee);
+    else if (!it->second)
+      continue;
+    inlineInstance(inst, callee);
+  }
+
+  flattened[entity] = true;
+}
+
+void EntityInliningPass::runOnOperation() {
+  SymbolTable table(getOperation());
+  symbolTable = &table;
+  flattened.clear();
+
+  for (auto entity : getOperation().getOps<llhd::EntityOp>())
+    if (!flattened.count(entity))
+      flatten(entity);
+}
+
+std::unique_ptr<OperationPass<ModuleOp>>
+circt::llhd::createEntityInliningPass() {
+  return std::make_unique<EntityInliningPass>();
+}
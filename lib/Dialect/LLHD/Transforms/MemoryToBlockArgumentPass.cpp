@@ -28,35 +28,54 @@ struct MemoryToBlockArgumentPass
 
 } // anonymous namespace
 
-/// Add the dominance fontier blocks of 'frontierOf' to the 'df' set
-static void getDominanceFrontier(Block *frontierOf, Operation *op,
-                                 std::set<Block *> &df) {
-  DominanceInfo dom(op);
-  for (Block &block : op->getRegion(0).getBlocks()) {
-    for (Block *pred : block.getPredecessors()) {
-      if (dom.dominates(frontierOf, pred) &&
-          !dom.properlyDominates(frontierOf, &block) &&
-          block.getOps<llhd::VarOp>().empty()) {
-        df.insert(&block);
-      }
-    }
+namespace {
+/// Lazily computes and caches the dominance frontier of the blocks in a
+/// region. Neither the CFG nor the placement of the variables changes while
+/// the pass runs, so the frontiers can be shared by all promoted variables.
+class DominanceFrontiers {
+public:
+  DominanceFrontiers(Region &region, DominanceInfo &dom)
+      : region(region), dom(dom) {}
+
+  /// Return the dominance fontier blocks of 'frontierOf'.
+  ArrayRef<Block *> get(Block *frontierOf);
+
+private:
+  Region &region;
+  DominanceInfo &dom;
+  DenseMap<Block *, SmallVector<Block *, 4>> frontiers;
+};
+} // anonymous namespace
+
+ArrayRef<Block *> DominanceFrontiers::get(Block *frontierOf) {
+  auto it = frontiers.find(frontierOf);
+  if (it != frontiers.end())
+    return it->second;
+
+  SmallVector<Block *, 4> df;
+  for (Block &block : region.getBlocks()) {
+    if (!block.getOps<llhd::VarOp>().empty() ||
+        dom.properlyDominates(frontierOf, &block))
+      continue;
+    if (llvm::any_of(block.getPredecessors(), [&](Block *pred) {
+          return dom.dominates(frontierOf, pred);
+        }))
+      df.push_back(&block);
   }
+  return frontiers[frontierOf] = std::move(df);
 }
 
 /// Add the blocks in the closure of the dominance fontier relation of all the
 /// block in 'initialSet' to 'closure'
-static void getDFClosure(SmallVectorImpl<Block *> &initialSet, Operation *op,
+static void getDFClosure(SmallVectorImpl<Block *> &initialSet,
+                         DominanceFrontiers &frontiers,
                          std::set<Block *> &closure) {
-  unsigned numElements;
-  for (Block *block : initialSet) {
-    getDominanceFrontier(block, op, closure);
+  SmallVector<Block *, 16> worklist(initialSet.begin(), initialSet.end());
+  while (!worklist.empty()) {
+    for (Block *block : frontiers.get(worklist.pop_back_val()))
+      if (closure.insert(block).second)
+        worklist.push_back(block);
   }
-  do {
-    numElements = closure.size();
-    for (Block *block : closure) {
-      getDominanceFrontier(block, op, closure);
-    }
-  } while (numElements < closure.size());
 }
 
 /// Add a block argument to a given terminator. Only 'std.br', 'std.cond_br' and
@@ -90,8 +109,16 @@ void MemoryToBlockArgumentPass::runOnOperation() {
       return WalkResult::interrupt();
     return WalkResult::advance();
   });
-  if (result.wasInterrupted())
+  if (result.wasInterrupted()) {
+    markAllAnalysesPreserved();
     return;
+  }
+
+  // Only block arguments, loads and stores are added below, the block structure
+  // stays the same.
+  markAnalysesPreserved<DominanceInfo>();
+  DominanceFrontiers frontiers(operation->getRegion(0),
+                               getAnalysis<DominanceInfo>());
 
   // Get all variables defined in the body of this operation
   // Note that variables that are passed as a function argument are not
@@ -128,7 +155,7 @@ void MemoryToBlockArgumentPass::runOnOperation() {
 
     // Calculate initial set of join points
     std::set<Block *> joinPoints;
-    getDFClosure(defBlocks, operation, joinPoints);
+    getDFClosure(defBlocks, frontiers, joinPoints);
 
     for (Block *jp : joinPoints) {
       // Add a block argument for the variable at each join point
@@ -0,0 +1,118 @@
+//===- SignalForwardingPass.cpp - Implement Signal Forwarding Pass --------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Implement pass to merge redundant signal probes and remove the signals which
+// are never observed.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PassDetails.h"
+#include "TemporalRegions.h"
+#include "circt/Dialect/LLHD/IR/LLHDOps.h"
+#include "circt/Dialect/LLHD/Transforms/Passes.h"
+#include "mlir/IR/Dominance.h"
+
+using namespace mlir;
+using namespace circt;
+
+namespace {
+struct SignalForwardingPass
+    : public llhd::SignalForwardingBase<SignalForwardingPass> {
+  SignalForwardingPass() = default;
+  SignalForwardingPass(bool removeDeadSignals) {
+    this->removeDeadSignals = removeDeadSignals;
+  }
+
+  void runOnOperation() override;
+};
+} // namespace
+
+/// Replace the probes of the given unit by an earlier probe of the same
+/// signal, which dominates them and is in the same temporal region. The blocks
+/// are visited in order, such that the first probe of a region is usually
+/// kept.
+static void mergeProbes(Operation *unit) {
+  DominanceInfo dom(unit);
+  Optional<llhd::TemporalRegionAnalysis> trAnalysis;
+  if (isa<llhd::ProcOp>(unit))
+    trAnalysis.emplace(unit);
+
+  // The kept probes of each signal and temporal region.
+  DenseMap<std::pair<Value, int>, SmallVector<llhd::PrbOp, 2>> kept;
+  for (auto &block : unit->getRegion(0)) {
+    // Unreachable blocks have no temporal region.
+    if (!dom.isReachableFromEntry(&block))
+      continue;
+    int tr = trAnalysis ? trAnalysis->getBlockTR(&block) : 0;
+    for (auto prb : llvm::make_early_inc_range(block.getOps<llhd::PrbOp>())) {
+      auto &probes = kept[{prb.signal(), tr}];
+      auto it = llvm::find_if(probes, [&](llhd::PrbOp other) {
+        return dom.properlyDominates(other.getOperation(), prb);
+      });
+      if (it == probes.end()) {
+        probes.push_back(prb);
+        continue;
+      }
+      prb.replaceAllUsesWith(it->result());
+      prb.erase();
+    }
+  }
+}
+
+/// Collect the drives of the given signal and of the subsignals extracted from
+/// it, as well as the subsignals. Returns false if the signal is used in any
+/// other way.
+static bool collectDrivesOnly(Value signal, SmallVectorImpl<Operation *> &ops) {
+  for (auto *user : signal.getUsers()) {
+    if (auto drv = dyn_cast<llhd::DrvOp>(user)) {
+      if (drv.signal() != signal)
+        return false;
+      ops.push_back(drv);
+      continue;
+    }
+    if (!isa<llhd::ExtractSliceOp, llhd::DynExtractSliceOp,
+             llhd::ExtractElementOp, llhd::DynExtractElementOp>(user) ||
+        user->getOperand(0) != signal)
+      return false;
+    if (!collectDrivesOnly(user->getResult(0), ops))
+      return false;
+    ops.push_back(user);
+  }
+  return true;
+}
+
+/// Remove the signals of the given entity which are only driven, along with
+/// their drives.
+static void removeDrivenOnlySignals(llhd::EntityOp entity) {
+  for (auto sig : llvm::make_early_inc_range(
+           entity.getBodyBlock()->getOps<llhd::SigOp>())) {
+    SmallVector<Operation *, 8> ops;
+    if (!collectDrivesOnly(sig, ops))
+      continue;
+    // The users of each subsignal come before the subsignal.
+    for (auto *op : ops)
+      op->erase();
+    sig.erase();
+  }
+}
+
+void SignalForwardingPass::runOnOperation() {
+  for (auto &op : *getOperation().getBody()) {
+    if (!isa<llhd::EntityOp, llhd::ProcOp>(op))
+      continue;
+    mergeProbes(&op);
+    if (removeDeadSignals)
+      if (auto entity = dyn_cast<llhd::EntityOp>(op))
+        removeDrivenOnlySignals(entity);
+  }
+}
+
+std::unique_ptr<OperationPass<ModuleOp>>
+circt::llhd::createSignalForwardingPass(bool removeDeadSignals) {
+  return std::make_unique<SignalForwardingPass>(removeDeadSignals);
+}
@@ -35,7 +35,7 @@ static bool anyPredecessorHasWait(Block *block) {
 static bool allPredecessorTRsKnown(Block *block,
                                    SmallPtrSetImpl<Block *> &known) {
   return std::all_of(block->pred_begin(), block->pred_end(), [&](Block *pred) {
-    return std::find(known.begin(), known.end(), pred) != known.end();
+    return known.count(pred);
   });
 }
 
@@ -104,9 +104,8 @@ void llhd::TemporalRegionAnalysis::recalculate(Operation *operation) {
     } else {
       int tr = blockMap[*block->pred_begin()];
       blockMap.insert(std::make_pair(block, tr));
+      // Every block is processed exactly once, so it can't be in the TR yet.
       trMap[tr].push_back(block);
-      trMap[tr].erase(std::unique(trMap[tr].begin(), trMap[tr].end()),
-                      trMap[tr].end());
     }
   }
 
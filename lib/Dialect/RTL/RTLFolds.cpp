@@ -13,6 +13,7 @@
 #include "circt/Dialect/RTL/RTLOps.h"
 #include "mlir/IR/Matchers.h"
 #include "mlir/IR/PatternMatch.h"
+#include "llvm/ADT/DenseMap.h"
 
 using namespace circt;
 using namespace rtl;
@@ -72,6 +73,106 @@ static bool tryFlatteningOperands(Op op, PatternRewriter &rewriter) {
   return false;
 }
 
+namespace {
+/// How `tryCanonicalizingTree` treats repeated operands.
+enum class DuplicateOperands {
+  Keep,       // add(x, x) stays as is.
+  Idempotent, // and(x, x) -> and(x)
+  Cancel      // xor(x, x) -> xor()
+};
+} // end anonymous namespace
+
+/// Rewrite the whole tree of single-use `Op`s rooted at `op` in one shot:
+/// flatten it into a single op, combine all of its constants with `combine`
+/// (dropping the result if it's `identity`, or replacing the whole tree with
+/// it if it's `annihilator`), and handle repeated operands per `duplicates`.
+/// Any remaining constant is last. Returns true if `op` was rewritten.
+///
+/// Example: and(a, and(b, c1, a), c2) -> and(a, b, c3) where c3 = c1 & c2
+///
+/// Nested reduction trees from FIRRTL lowering would otherwise need a greedy
+/// driver iteration per level and per constant.
+template <typename Op, typename CombineFn>
+static bool tryCanonicalizingTree(Op op, PatternRewriter &rewriter,
+                                  const APInt &identity,
+                                  Optional<APInt> annihilator,
+                                  DuplicateOperands duplicates,
+                                  CombineFn combine) {
+  // Collect the leaves of the tree in operand order. Use a worklist rather
+  // than recursion since these trees can be very deep.
+  SmallVector<Value, 8> leaves;
+  auto inputs = op.inputs();
+  SmallVector<Value, 16> worklist(inputs.rbegin(), inputs.rend());
+  bool changed = false;
+  while (!worklist.empty()) {
+    Value value = worklist.pop_back_val();
+    auto nested = value.getDefiningOp<Op>();
+    // Don't duplicate logic.
+    if (nested && value.hasOneUse()) {
+      auto nestedInputs = nested.inputs();
+      worklist.append(nestedInputs.rbegin(), nestedInputs.rend());
+      changed = true;
+      continue;
+    }
+    leaves.push_back(value);
+  }
+
+  // Combine the constants.
+  APInt cst = identity;
+  SmallVector<Value, 8> operands;
+  unsigned numConstants = 0;
+  for (auto leaf : leaves) {
+    APInt value;
+    if (!matchPattern(leaf, m_RConstant(value))) {
+      operands.push_back(leaf);
+      continue;
+    }
+    combine(cst, value);
+    ++numConstants;
+  }
+  if (annihilator && cst == *annihilator) {
+    rewriter.replaceOpWithNewOp<ConstantOp>(op, cst);
+    return true;
+  }
+  if (numConstants > 1 || (numConstants == 1 && cst == identity))
+    changed = true;
+  else if (numConstants == 1 && !matchPattern(leaves.back(), m_Constant()))
+    changed = true;
+
+  // Deal with repeated operands.
+  if (duplicates != DuplicateOperands::Keep) {
+    llvm::SmallDenseMap<Value, unsigned, 8> counts;
+    for (auto operand : operands)
+      ++counts[operand];
+    SmallVector<Value, 8> unique;
+    for (auto operand : operands) {
+      auto it = counts.find(operand);
+      if (it == counts.end())
+        continue;
+      if (duplicates == DuplicateOperands::Idempotent || it->second % 2)
+        unique.push_back(operand);
+      counts.erase(it);
+    }
+    if (unique.size() != operands.size()) {
+      changed = true;
+      operands = std::move(unique);
+    }
+  }
+
+  if (!changed)
+    return false;
+
+  if (cst != identity)
+    operands.push_back(rewriter.create<ConstantOp>(op.getLoc(), cst));
+  if (operands.empty())
+    rewriter.replaceOpWithNewOp<ConstantOp>(op, identity);
+  else if (operands.size() == 1)
+    rewriter.replaceOp(op, operands[0]);
+  else
+    rewriter.replaceOpWithNewOp<Op>(op, op.getType(), operands);
+  return true;
+}
+
 //===----------------------------------------------------------------------===//
 // ConstantOp
 //===----------------------------------------------------------------------===//
@@ -144,29 +245,31 @@ OpFoldResult ExtractOp::fold(ArrayRef<Attribute> constants) {
 //===----------------------------------------------------------------------===//
 
 // Reduce all operands to a single value by applying the `calculate` function.
-// This will fail if any of the operands are not constant.
-template <class AttrElementT,
-          class ElementValueT = typename AttrElementT::ValueType,
-          class CalculationT =
-              function_ref<ElementValueT(ElementValueT, ElementValueT)>>
+// This will fail if any of the operands are not constant.  Values of up to 64
+// bits, which dominate real designs, are combined as native integers and only
+// wider ones as APInts, so `calculate` has to accept both.
+template <class CalculationT>
 static Attribute constFoldVariadicOp(ArrayRef<Attribute> operands,
                                      const CalculationT &calculate) {
-  if (!operands.size())
+  if (operands.empty() ||
+      llvm::any_of(operands, [](Attribute attr) { return !attr; }))
     return {};
 
-  if (!operands[0])
-    return {};
-
-  ElementValueT accum = operands[0].cast<AttrElementT>().getValue();
-  for (auto i = operands.begin() + 1, end = operands.end(); i != end; ++i) {
-    auto attr = *i;
-    if (!attr)
-      return {};
-
-    auto typedAttr = attr.cast<AttrElementT>();
-    calculate(accum, typedAttr.getValue());
+  auto type = operands[0].getType().cast<IntegerType>();
+  auto width = type.getWidth();
+  if (width <= 64) {
+    uint64_t accum =
+        operands[0].cast<IntegerAttr>().getValue().getZExtValue();
+    for (auto attr : operands.drop_front())
+      calculate(accum, attr.cast<IntegerAttr>().getValue().getZExtValue());
+    // The APInt drops the bits which overflowed the width.
+    return IntegerAttr::get(type, APInt(width, accum));
   }
-  return AttrElementT::get(operands[0].getType(), accum);
+
+  APInt accum = operands[0].cast<IntegerAttr>().getValue();
+  for (auto attr : operands.drop_front())
+    calculate(accum, attr.cast<IntegerAttr>().getValue());
+  return IntegerAttr::get(type, accum);
 }
 
 OpFoldResult AndOp::fold(ArrayRef<Attribute> constants) {
@@ -187,8 +290,8 @@ OpFoldResult AndOp::fold(ArrayRef<Attribute> constants) {
     return inputs()[0];
 
   // Constant fold
-  return constFoldVariadicOp<IntegerAttr>(
-      constants, [](APInt &a, const APInt &b) { a &= b; });
+  return constFoldVariadicOp(constants,
+                             [](auto &a, const auto &b) { a &= b; });
 }
 
 void AndOp::getCanonicalizationPatterns(OwningRewritePatternList &results,
@@ -201,6 +304,13 @@ void AndOp::getCanonicalizationPatterns(OwningRewritePatternList &results,
       auto size = inputs.size();
       assert(size > 1 && "expected 2 or more operands");
 
+      // Flatten the tree, combine its constants and remove repeated operands.
+      auto width = op.getType().getWidth();
+      if (tryCanonicalizingTree(op, rewriter, APInt::getAllOnesValue(width),
+                                APInt(width, 0), DuplicateOperands::Idempotent,
+                                [](APInt &a, const APInt &b) { a &= b; }))
+        return success();
+
       APInt value, value2;
 
       // and(..., '1) -> and(...) -- identity
@@ -229,10 +339,6 @@ void AndOp::getCanonicalizationPatterns(OwningRewritePatternList &results,
         rewriter.replaceOpWithNewOp<AndOp>(op, op.getType(), newOperands);
         return success();
       }
-      // and(x, and(...)) -> and(x, ...) -- flatten
-      if (tryFlatteningOperands(op, rewriter))
-        return success();
-
       /// TODO: and(..., x, not(x)) -> and(..., 0) -- complement
       return failure();
     }
@@ -258,8 +364,8 @@ OpFoldResult OrOp::fold(ArrayRef<Attribute> constants) {
     return inputs()[0];
 
   // Constant fold
-  return constFoldVariadicOp<IntegerAttr>(
-      constants, [](APInt &a, const APInt &b) { a |= b; });
+  return constFoldVariadicOp(constants,
+                             [](auto &a, const auto &b) { a |= b; });
 }
 
 void OrOp::getCanonicalizationPatterns(OwningRewritePatternList &results,
@@ -272,6 +378,14 @@ void OrOp::getCanonicalizationPatterns(OwningRewritePatternList &results,
       auto size = inputs.size();
       assert(size > 1 && "expected 2 or more operands");
 
+      // Flatten the tree, combine its constants and remove repeated operands.
+      auto width = op.getType().getWidth();
+      if (tryCanonicalizingTree(op, rewriter, APInt(width, 0),
+                                APInt::getAllOnesValue(width),
+                                DuplicateOperands::Idempotent,
+                                [](APInt &a, const APInt &b) { a |= b; }))
+        return success();
+
       APInt value, value2;
 
       // or(..., 0) -> or(...) -- identity
@@ -298,10 +412,6 @@ void OrOp::getCanonicalizationPatterns(OwningRewritePatternList &results,
         return success();
       }
 
-      // or(x, or(...)) -> or(x, ...) -- flatten
-      if (tryFlatteningOperands(op, rewriter))
-        return success();
-
       /// TODO: or(..., x, not(x)) -> or(..., '1) -- complement
       return failure();
     }
@@ -321,8 +431,8 @@ OpFoldResult XorOp::fold(ArrayRef<Attribute> constants) {
     return IntegerAttr::get(getType(), 0);
 
   // Constant fold
-  return constFoldVariadicOp<IntegerAttr>(
-      constants, [](APInt &a, const APInt &b) { a ^= b; });
+  return constFoldVariadicOp(constants,
+                             [](auto &a, const auto &b) { a ^= b; });
 }
 
 void XorOp::getCanonicalizationPatterns(OwningRewritePatternList &results,
@@ -335,6 +445,13 @@ void XorOp::getCanonicalizationPatterns(OwningRewritePatternList &results,
       auto size = inputs.size();
       assert(size > 1 && "expected 2 or more operands");
 
+      // Flatten the tree, combine its constants and cancel repeated operands.
+      auto width = op.getType().getWidth();
+      if (tryCanonicalizingTree(op, rewriter, APInt(width, 0), llvm::None,
+                                DuplicateOperands::Cancel,
+                                [](APInt &a, const APInt &b) { a ^= b; }))
+        return success();
+
       APInt value, value2;
 
       // xor(..., 0) -> xor(...) -- identity
@@ -365,10 +482,6 @@ void XorOp::getCanonicalizationPatterns(OwningRewritePatternList &results,
         return success();
       }
 
-      // xor(x, xor(...)) -> xor(x, ...) -- flatten
-      if (tryFlatteningOperands(op, rewriter))
-        return success();
-
       /// TODO: xor(..., '1) -> not(xor(...))
       /// TODO: xor(..., x, not(x)) -> xor(..., '1)
       return failure();
@@ -393,8 +506,8 @@ OpFoldResult AddOp::fold(ArrayRef<Attribute> constants) {
     return inputs()[0];
 
   // Constant fold
-  return constFoldVariadicOp<IntegerAttr>(
-      constants, [](APInt &a, const APInt &b) { a += b; });
+  return constFoldVariadicOp(constants,
+                             [](auto &a, const auto &b) { a += b; });
 }
 
 void AddOp::getCanonicalizationPatterns(OwningRewritePatternList &results,
@@ -407,6 +520,13 @@ void AddOp::getCanonicalizationPatterns(OwningRewritePatternList &results,
       auto size = inputs.size();
       assert(size > 1 && "expected 2 or more operands");
 
+      // Flatten the tree and combine its constants.
+      auto width = op.getType().getWidth();
+      if (tryCanonicalizingTree(op, rewriter, APInt(width, 0), llvm::None,
+                                DuplicateOperands::Keep,
+                                [](APInt &a, const APInt &b) { a += b; }))
+        return success();
+
       APInt value, value2;
 
       // add(..., 0) -> add(...) -- identity
@@ -475,10 +595,6 @@ void AddOp::getCanonicalizationPatterns(OwningRewritePatternList &results,
         return success();
       }
 
-      // add(x, add(...)) -> add(x, ...) -- flatten
-      if (tryFlatteningOperands(op, rewriter))
-        return success();
-
       return failure();
     }
   };
@@ -505,8 +621,8 @@ OpFoldResult MulOp::fold(ArrayRef<Attribute> constants) {
   }
 
   // Constant fold
-  return constFoldVariadicOp<IntegerAttr>(
-      constants, [](APInt &a, const APInt &b) { a *= b; });
+  return constFoldVariadicOp(constants,
+                             [](auto &a, const auto &b) { a *= b; });
 }
 
 void MulOp::getCanonicalizationPatterns(OwningRewritePatternList &results,
@@ -0,0 +1,356 @@
+//===- DemandedBits.cpp - Bit-level dead logic elimination ------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//===----------------------------------------------------------------------===//
+//
+// This file implements a demanded bits / known bits simplification of RTL
+// modules.  The bits of each value which can affect the outputs of the module
+// are computed backwards, and the bits which are known to be constant are
+// computed forwards.  Then:
+//  - values with no demanded bits, or only known demanded bits, are replaced
+//    with constants,
+//  - arithmetic, bitwise and mux operations are narrowed to the highest
+//    demanded bit,
+//  - extracts are looked through concats and other extracts, so that only the
+//    bit ranges that are used stay live.
+//
+//===----------------------------------------------------------------------===//
+
+#include "./PassDetails.h"
+#include "circt/Dialect/RTL/Passes.h"
+#include "circt/Dialect/RTL/RTLDialect.h"
+#include "mlir/Interfaces/SideEffectInterfaces.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/TypeSwitch.h"
+#include "llvm/Support/KnownBits.h"
+
+using namespace circt;
+using namespace rtl;
+using llvm::KnownBits;
+using llvm::TypeSwitch;
+
+/// Return the bit width of `value`, or zero if it isn't an integer.
+static unsigned getWidth(Value value) {
+  if (auto type = value.getType().dyn_cast<IntegerType>())
+    return type.getWidth();
+  return 0;
+}
+
+/// Return true if `op` is pure RTL logic producing a single integer.
+static bool isPureRTLLogic(Operation *op) {
+  return isa_and_nonnull<RTLDialect>(op->getDialect()) &&
+         op->getNumRegions() == 0 && op->getNumResults() == 1 &&
+         getWidth(op->getResult(0)) &&
+         MemoryEffectOpInterface::hasNoEffect(op);
+}
+
+/// Return the bit position of the least significant bit of operand `index` of
+/// `op` in its result. The first operand is the most significant.
+static unsigned getConcatOffset(ConcatOp op, unsigned index) {
+  unsigned offset = 0;
+  for (auto operand : op.getOperands().drop_front(index + 1))
+    offset += getWidth(operand);
+  return offset;
+}
+
+/// Find the simplest existing value whose bits [lowBit, lowBit+width) are the
+/// bits [lowBit, lowBit+width) of `value`, looking through concats and
+/// extracts. `lowBit` is updated to be relative to the returned value.
+static Value lookThroughExtract(Value value, unsigned &lowBit, unsigned width) {
+  while (lowBit != 0 || getWidth(value) != width) {
+    if (auto extract = value.getDefiningOp<ExtractOp>()) {
+      lowBit += extract.lowBit();
+      value = extract.input();
+      continue;
+    }
+    auto concat = value.getDefiningOp<ConcatOp>();
+    if (!concat)
+      break;
+    // Only look through the concat if the range is within one operand.
+    bool found = false;
+    for (unsigned i = 0, e = concat.getNumOperands(); i != e; ++i) {
+      unsigned offset = getConcatOffset(concat, i);
+      Value operand = concat.getOperand(i);
+      if (lowBit >= offset && lowBit + width <= offset + getWidth(operand)) {
+        lowBit -= offset;
+        value = operand;
+        found = true;
+        break;
+      }
+    }
+    if (!found)
+      break;
+  }
+  return value;
+}
+
+/// Build the bits [lowBit, lowBit+width) of `value`, reusing existing logic
+/// where possible.
+static Value buildExtract(OpBuilder &builder, Location loc, Value value,
+                          unsigned lowBit, unsigned width) {
+  value = lookThroughExtract(value, lowBit, width);
+  if (lowBit == 0 && getWidth(value) == width)
+    return value;
+  if (auto cst = value.getDefiningOp<ConstantOp>())
+    return builder.create<ConstantOp>(
+        loc, cst.getValue().lshr(lowBit).trunc(width));
+  return builder.create<ExtractOp>(loc, builder.getIntegerType(width), value,
+                                   lowBit);
+}
+
+//===----------------------------------------------------------------------===//
+// Pass Infrastructure
+//===----------------------------------------------------------------------===//
+
+namespace {
+struct RTLDemandedBitsPass : public RTLDemandedBitsBase<RTLDemandedBitsPass> {
+  void runOnOperation() override;
+
+private:
+  KnownBits getKnownBits(Value value);
+  void computeKnownBits(Operation *op);
+  APInt getDemandedBits(Value value);
+  APInt getOperandDemandedBits(Operation *op, unsigned index);
+  bool simplify(Operation *op);
+
+  DenseMap<Value, KnownBits> knownBits;
+  DenseMap<Value, APInt> demandedBits;
+};
+} // end anonymous namespace
+
+KnownBits RTLDemandedBitsPass::getKnownBits(Value value) {
+  auto it = knownBits.find(value);
+  if (it != knownBits.end())
+    return it->second;
+  return KnownBits(getWidth(value));
+}
+
+/// Compute the known bits of the result of `op` from its operands. Operands
+/// which are defined later in the module are treated as unknown.
+void RTLDemandedBitsPass::computeKnownBits(Operation *op) {
+  if (!isPureRTLLogic(op))
+    return;
+  Value result = op->getResult(0);
+  KnownBits known(getWidth(result));
+
+  auto combine = [&](auto fn) {
+    known = getKnownBits(op->getOperand(0));
+    for (auto operand : op->getOperands().drop_front())
+      fn(getKnownBits(operand));
+  };
+
+  bool handled = true;
+  TypeSwitch<Operation *>(op)
+      .Case<ConstantOp>([&](auto op) {
+        known.One = op.getValue();
+        known.Zero = ~known.One;
+      })
+      .Case<AndOp>([&](auto) {
+        combine([&](const KnownBits &rhs) {
+          known.Zero |= rhs.Zero;
+          known.One &= rhs.One;
+        });
+      })
+      .Case<OrOp>([&](auto) {
+        combine([&](const KnownBits &rhs) {
+          known.Zero &= rhs.Zero;
+          known.One |= rhs.One;
+        });
+      })
+      .Case<XorOp>([&](auto) {
+        combine([&](const KnownBits &rhs) {
+          APInt zero = (known.Zero & rhs.Zero) | (known.One & rhs.One);
+          known.One = (known.Zero & rhs.One) | (known.One & rhs.Zero);
+          known.Zero = zero;
+        });
+      })
+      .Case<MuxOp>([&](MuxOp op) {
+        auto lhs = getKnownBits(op.trueValue());
+        auto rhs = getKnownBits(op.falseValue());
+        known.Zero = lhs.Zero & rhs.Zero;
+        known.One = lhs.One & rhs.One;
+      })
+      .Case<ConcatOp>([&](ConcatOp op) {
+        for (unsigned i = 0, e = op.getNumOperands(); i != e; ++i) {
+          auto operand = getKnownBits(op.getOperand(i));
+          unsigned offset = getConcatOffset(op, i);
+          known.Zero.insertBits(operand.Zero, offset);
+          known.One.insertBits(operand.One, offset);
+        }
+      })
+      .Case<ExtractOp>([&](ExtractOp op) {
+        auto input = getKnownBits(op.input());
+        unsigned width = known.getBitWidth();
+        known.Zero = input.Zero.extractBits(width, op.lowBit());
+        known.One = input.One.extractBits(width, op.lowBit());
+      })
+      .Default([&](auto) { handled = false; });
+
+  if (handled && !known.isUnknown())
+    knownBits[result] = known;
+}
+
+APInt RTLDemandedBitsPass::getDemandedBits(Value value) {
+  auto it = demandedBits.find(value);
+  if (it != demandedBits.end())
+    return it->second;
+  return APInt(getWidth(value), 0);
+}
+
+/// Return the bits of operand `index` of `op` which are needed to compute the
+/// demanded bits of its result.
+APInt RTLDemandedBitsPass::getOperandDemandedBits(Operation *op,
+                                                  unsigned index) {
+  unsigned width = getWidth(op->getOperand(index));
+  auto resultDemanded = [&]() { return getDemandedBits(op->getResult(0)); };
+
+  return TypeSwitch<Operation *, APInt>(op)
+      .Case<ExtractOp>([&](ExtractOp op) {
+        return resultDemanded().zext(width).shl(op.lowBit());
+      })
+      .Case<ConcatOp>([&](ConcatOp op) {
+        return resultDemanded().extractBits(width, getConcatOffset(op, index));
+      })
+      .Case<AndOp, OrOp, XorOp>([&](auto) { return resultDemanded(); })
+      .Case<MuxOp>([&](auto) {
+        APInt demanded = resultDemanded();
+        if (index != 0)
+          return demanded;
+        return demanded.isNullValue() ? APInt(1, 0) : APInt(1, 1);
+      })
+      // Carries only propagate upwards.
+      .Case<AddOp, SubOp, MulOp>([&](auto) {
+        return APInt::getLowBitsSet(width, resultDemanded().getActiveBits());
+      })
+      .Default([&](auto) { return APInt::getAllOnesValue(width); });
+}
+
+/// Replace `op` with simpler logic computing its demanded bits. Returns true
+/// if `op` was replaced.
+bool RTLDemandedBitsPass::simplify(Operation *op) {
+  if (!isPureRTLLogic(op) || isa<ConstantOp>(op))
+    return false;
+  Value result = op->getResult(0);
+  if (result.use_empty())
+    return false;
+
+  unsigned width = getWidth(result);
+  APInt demanded = getDemandedBits(result);
+  KnownBits known = getKnownBits(result);
+  OpBuilder builder(op);
+
+  // If none of the unknown bits are demanded, this is a constant.
+  if ((demanded & ~(known.Zero | known.One)).isNullValue()) {
+    Value cst = builder.create<ConstantOp>(op->getLoc(), known.One);
+    result.replaceAllUsesWith(cst);
+    op->erase();
+    return true;
+  }
+
+  // Otherwise, narrow the operation to the highest demanded bit and pad it
+  // with zeros.
+  unsigned narrowWidth = demanded.getActiveBits();
+  if (narrowWidth == width ||
+      !isa<AddOp, SubOp, MulOp, AndOp, OrOp, XorOp, MuxOp>(op))
+    return false;
+
+  SmallVector<Value, 4> operands;
+  for (auto operand : op->getOperands()) {
+    if (getWidth(operand) == width)
+      operand = buildExtract(builder, op->getLoc(), operand, 0, narrowWidth);
+    operands.push_back(operand);
+  }
+  OperationState state(op->getLoc(), op->getName());
+  state.addOperands(operands);
+  state.addTypes(builder.getIntegerType(narrowWidth));
+  state.addAttributes(op->getAttrs());
+  Value narrow = builder.createOperation(state)->getResult(0);
+
+  Value padding = builder.create<ConstantOp>(
+      op->getLoc(), APInt(width - narrowWidth, 0));
+  Value replacement = builder.create<ConcatOp>(op->getLoc(), padding, narrow);
+  result.replaceAllUsesWith(replacement);
+  op->erase();
+  return true;
+}
+
+void RTLDemandedBitsPass::runOnOperation() {
+  SmallVector<Operation *, 64> ops;
+  getOperation().walk([&](Operation *op) { ops.push_back(op); });
+
+  // Known bits flow forwards. Values in the graph region can be used before
+  // they're defined; those are conservatively unknown.
+  knownBits.clear();
+  for (auto *op : ops)
+    computeKnownBits(op);
+
+  // Demanded bits flow backwards, and only ever grow, so iterate to a fixed
+  // point in case the module has forward references.
+  demandedBits.clear();
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (auto *op : llvm::reverse(ops)) {
+      for (unsigned i = 0, e = op->getNumOperands(); i != e; ++i) {
+        Value operand = op->getOperand(i);
+        if (!getWidth(operand))
+          continue;
+        APInt demanded = getOperandDemandedBits(op, i);
+        if (demanded.isNullValue())
+          continue;
+        auto it = demandedBits.try_emplace(operand, getWidth(operand), 0);
+        APInt &current = it.first->second;
+        if (demanded.isSubsetOf(current))
+          continue;
+        current |= demanded;
+        changed = true;
+      }
+    }
+  }
+
+  bool simplified = false;
+  for (auto *op : ops)
+    simplified |= simplify(op);
+
+  // Look through concats and extracts so that unused bit ranges become dead.
+  SmallVector<ExtractOp, 16> extracts;
+  getOperation().walk([&](ExtractOp op) { extracts.push_back(op); });
+  for (auto op : extracts) {
+    unsigned lowBit = op.lowBit();
+    unsigned width = getWidth(op.getResult());
+    if (lookThroughExtract(op.input(), lowBit, width) == op.input())
+      continue;
+    OpBuilder builder(op);
+    op.replaceAllUsesWith(buildExtract(builder, op.getLoc(), op.input(),
+                                       op.lowBit(), width));
+    op.erase();
+    simplified = true;
+  }
+
+  // Remove the logic which is now dead.
+  SmallVector<Operation *, 64> worklist;
+  getOperation().walk([&](Operation *op) {
+    if (isPureRTLLogic(op) && op->use_empty())
+      worklist.push_back(op);
+  });
+  while (!worklist.empty()) {
+    auto *op = worklist.pop_back_val();
+    for (auto operand : op->getOperands())
+      if (auto *def = operand.getDefiningOp())
+        if (isPureRTLLogic(def) && def != op && operand.hasOneUse())
+          worklist.push_back(def);
+    op->erase();
+    simplified = true;
+  }
+
+  knownBits.clear();
+  demandedBits.clear();
+  if (!simplified)
+    markAllAnalysesPreserved();
+}
+
+std::unique_ptr<mlir::Pass> circt::rtl::createRTLDemandedBitsPass() {
+  return std::make_unique<RTLDemandedBitsPass>();
+}
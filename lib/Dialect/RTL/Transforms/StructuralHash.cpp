@@ -0,0 +1,156 @@
+//===- StructuralHash.cpp - Merge equivalent RTL logic ----------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//===----------------------------------------------------------------------===//
+//
+// This file implements structural hashing of RTL combinational logic: every
+// side effect free RTL operation is keyed on its name, attributes, result types
+// and operands (as a multiset for commutative operations), and operations with
+// the same key are merged.
+//
+//===----------------------------------------------------------------------===//
+
+#include "./PassDetails.h"
+#include "circt/Dialect/RTL/RTLDialect.h"
+#include "circt/Dialect/RTL/Passes.h"
+#include "mlir/Interfaces/SideEffectInterfaces.h"
+#include "llvm/ADT/DenseMap.h"
+
+using namespace circt;
+using namespace rtl;
+
+/// Return the operands of `op` the way they're compared: commutative operations
+/// have them sorted so that operand order doesn't matter.
+static void getKeyOperands(Operation *op, SmallVectorImpl<Value> &operands) {
+  operands.append(op->operand_begin(), op->operand_end());
+  if (!op->hasTrait<OpTrait::IsCommutative>())
+    return;
+  llvm::sort(operands, [](Value lhs, Value rhs) {
+    return lhs.getAsOpaquePointer() < rhs.getAsOpaquePointer();
+  });
+}
+
+namespace {
+/// DenseMap traits which consider two operations equal if they compute the
+/// same function of the same values.
+struct StructuralInfo : public llvm::DenseMapInfo<Operation *> {
+  static unsigned getHashValue(const Operation *opC) {
+    auto *op = const_cast<Operation *>(opC);
+    SmallVector<Value, 4> operands;
+    getKeyOperands(op, operands);
+    return llvm::hash_combine(
+        op->getName(), op->getAttrDictionary(),
+        llvm::hash_combine_range(op->result_type_begin(),
+                                 op->result_type_end()),
+        llvm::hash_combine_range(operands.begin(), operands.end()));
+  }
+
+  static bool isEqual(const Operation *lhsC, const Operation *rhsC) {
+    auto *lhs = const_cast<Operation *>(lhsC);
+    auto *rhs = const_cast<Operation *>(rhsC);
+    if (lhs == rhs)
+      return true;
+    if (lhs == getTombstoneKey() || lhs == getEmptyKey() ||
+        rhs == getTombstoneKey() || rhs == getEmptyKey())
+      return false;
+    if (lhs->getName() != rhs->getName() ||
+        lhs->getAttrDictionary() != rhs->getAttrDictionary() ||
+        lhs->getNumOperands() != rhs->getNumOperands() ||
+        !std::equal(lhs->result_type_begin(), lhs->result_type_end(),
+                    rhs->result_type_begin(), rhs->result_type_end()))
+      return false;
+    SmallVector<Value, 4> lhsOperands, rhsOperands;
+    getKeyOperands(lhs, lhsOperands);
+    getKeyOperands(rhs, rhsOperands);
+    return lhsOperands == rhsOperands;
+  }
+};
+} // end anonymous namespace
+
+//===----------------------------------------------------------------------===//
+// Pass Infrastructure
+//===----------------------------------------------------------------------===//
+
+namespace {
+struct RTLStructuralHashPass
+    : public RTLStructuralHashBase<RTLStructuralHashPass> {
+  void runOnOperation() override;
+
+private:
+  bool hashOnce();
+};
+} // end anonymous namespace
+
+/// Return true if `op` is pure RTL logic which can be merged.
+static bool isHashable(Operation *op) {
+  return isa_and_nonnull<RTLDialect>(op->getDialect()) &&
+         op->getNumRegions() == 0 && op->getNumResults() > 0 &&
+         MemoryEffectOpInterface::hasNoEffect(op);
+}
+
+/// Merge each hashable operation in the module into the first equivalent one
+/// that is visible from it. Returns true if anything changed.
+bool RTLStructuralHashPass::hashOnce() {
+  Region *moduleBody = &getOperation().body();
+
+  SmallVector<Operation *, 64> ops;
+  getOperation().walk([&](Operation *op) {
+    if (isHashable(op))
+      ops.push_back(op);
+  });
+
+  // The operations are keys of the maps, so they're only replaced once the
+  // scan is done. Reads of an inout value depend on when they happen, so they
+  // are only merged within a region, never across procedural blocks.
+  using LeaderMap = llvm::DenseMap<Operation *, Operation *, StructuralInfo>;
+  LeaderMap leaders;
+  llvm::DenseMap<Region *, LeaderMap> readLeaders;
+  SmallVector<std::pair<Operation *, Operation *>, 16> replacements;
+  for (auto *op : ops) {
+    auto &map =
+        isa<ReadInOutOp>(op) ? readLeaders[op->getParentRegion()] : leaders;
+    auto it = map.try_emplace(op, op);
+    if (it.second)
+      continue;
+    Operation *leader = it.first->second;
+
+    // The leader is visible from `op` if it's in the same or an enclosing
+    // region: the walk visits it first, so it dominates in SSACFG regions, and
+    // the module body is a graph region.
+    if (leader->getParentRegion()->isAncestor(op->getParentRegion())) {
+      replacements.push_back({op, leader});
+      continue;
+    }
+
+    // Otherwise, hoist the merge point to `op` if it's in the module body,
+    // which every nested region can see.
+    if (op->getParentRegion() == moduleBody) {
+      replacements.push_back({leader, op});
+      it.first->second = op;
+    }
+  }
+
+  for (auto &replacement : replacements) {
+    replacement.first->replaceAllUsesWith(replacement.second);
+    replacement.first->erase();
+  }
+  return !replacements.empty();
+}
+
+void RTLStructuralHashPass::runOnOperation() {
+  // Operands may be defined after their users in the module's graph region, so
+  // merging one operation can make earlier ones equivalent. Rehash until
+  // nothing changes; in practice once or twice.
+  bool changed = false;
+  while (hashOnce())
+    changed = true;
+
+  if (!changed)
+    markAllAnalysesPreserved();
+}
+
+std::unique_ptr<mlir::Pass> circt::rtl::createRTLStructuralHashPass() {
+  return std::make_unique<RTLStructuralHashPass>();
+}
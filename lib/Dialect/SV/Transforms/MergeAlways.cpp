@@ -0,0 +1,136 @@
+//===- MergeAlways.cpp - Merge always blocks of a clock domain --*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//===----------------------------------------------------------------------===//
+//
+// This file merges the sv.always blocks of a module which share a sensitivity
+// list, and the sv.if blocks which share a condition within them.  The FIRRTL
+// lowering produces one always block per register, which simulators would
+// otherwise schedule as as many processes.
+//
+//===----------------------------------------------------------------------===//
+
+#include "./PassDetails.h"
+#include "circt/Dialect/SV/Passes.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+
+using namespace circt;
+using namespace sv;
+
+using DestSet = llvm::SmallDenseSet<Value, 8>;
+
+/// Move the operations of `from` to the end of `to`, leaving both terminators
+/// in place.
+static void moveBody(Block *from, Block *to) {
+  to->getOperations().splice(to->getTerminator()->getIterator(),
+                             from->getOperations(), from->begin(),
+                             from->getTerminator()->getIterator());
+}
+
+/// Add the destinations of the non-blocking assignments in `op` to `dests`.
+/// Returns false if `op` does anything else than such assignments, possibly
+/// nested in `sv.if` blocks.
+static bool getAssignedDests(Operation *op, DestSet &dests) {
+  auto result = op->walk([&](Operation *nested) {
+    if (auto assign = dyn_cast<PAssignOp>(nested)) {
+      dests.insert(assign.dest());
+      return WalkResult::advance();
+    }
+    if (isa<IfOp, YieldOp>(nested))
+      return WalkResult::advance();
+    return WalkResult::interrupt();
+  });
+  return !result.wasInterrupted();
+}
+
+/// Merge each `sv.if` without an else block in `body` into an earlier one with
+/// the same condition.  An `sv.if` only moves across non-blocking assignments
+/// to other destinations, so that the assignments to each destination stay in
+/// order.  Returns true if anything changed.
+static bool mergeIfs(Block *body) {
+  struct Target {
+    IfOp op;
+    /// The destinations assigned after the target.
+    DestSet assignedSince;
+  };
+  llvm::SmallDenseMap<Value, Target, 4> targets;
+
+  bool changed = false;
+  for (auto &op : llvm::make_early_inc_range(body->without_terminator())) {
+    DestSet dests;
+    if (!getAssignedDests(&op, dests)) {
+      targets.clear();
+      continue;
+    }
+
+    // The condition of an if without an else block, which can be merged.
+    Value cond;
+    auto ifOp = dyn_cast<IfOp>(op);
+    if (ifOp && !ifOp.hasElse())
+      cond = ifOp.cond();
+
+    if (cond) {
+      auto it = targets.find(cond);
+      if (it != targets.end() &&
+          llvm::none_of(dests, [&](Value dest) {
+            return it->second.assignedSince.count(dest);
+          })) {
+        moveBody(ifOp.getThenBlock(), it->second.op.getThenBlock());
+        ifOp.erase();
+        changed = true;
+      } else {
+        // Later ifs are merged into this one rather than across it.
+        targets[cond] = Target{ifOp, {}};
+      }
+    }
+
+    // The assignments now follow every other target.
+    for (auto &target : targets)
+      if (target.first != cond)
+        target.second.assignedSince.insert(dests.begin(), dests.end());
+  }
+  return changed;
+}
+
+namespace {
+struct SVMergeAlwaysPass : public SVMergeAlwaysBase<SVMergeAlwaysPass> {
+  void runOnOperation() override;
+};
+} // end anonymous namespace
+
+void SVMergeAlwaysPass::runOnOperation() {
+  // Move each always block into the first one with the same sensitivity list.
+  // The module body is a graph region, so the operands of the moved blocks
+  // are visible from their new position.
+  SmallVector<AlwaysOp, 4> leaders;
+  bool changed = false;
+  for (auto &op : llvm::make_early_inc_range(*getOperation().getBodyBlock())) {
+    auto always = dyn_cast<AlwaysOp>(op);
+    if (!always)
+      continue;
+    auto leader = llvm::find_if(leaders, [&](AlwaysOp other) {
+      return other.events() == always.events() &&
+             llvm::equal(other.clocks(), always.clocks());
+    });
+    if (leader == leaders.end()) {
+      leaders.push_back(always);
+      continue;
+    }
+    moveBody(always.getBodyBlock(), leader->getBodyBlock());
+    always.erase();
+    changed = true;
+  }
+
+  for (auto leader : leaders)
+    changed |= mergeIfs(leader.getBodyBlock());
+
+  if (!changed)
+    markAllAnalysesPreserved();
+}
+
+std::unique_ptr<mlir::Pass> circt::sv::createSVMergeAlwaysPass() {
+  return std::make_unique<SVMergeAlwaysPass>();
+}
@@ -0,0 +1,537 @@
+//===- Retime.cpp - Move registers across combinational logic ---*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//===----------------------------------------------------------------------===//
+//
+// This file implements a greedy retiming of the registers of an rtl.module.
+// The delay of the combinational logic is estimated with a per-operation
+// model, and registers are moved one step at a time across the operation at
+// the end (backward) or at the start (forward) of the critical path, as long
+// as this makes every path through the moved registers shorter than the
+// critical path.
+//
+// A register is an `sv.reg` assigned by `sv.passign`s in `sv.always` blocks,
+// which is only read through `rtl.read_inout`:
+//  - its next value is assigned directly in the always block, or under an
+//    `sv.if` enable,
+//  - it may be reset by an assignment under `sv.if %reset`, the next value
+//    then being assigned under `sv.if (%reset ^ 1)`,
+//  - it may have a random initial value for simulation, assigned with an
+//    `sv.bpassign` of an `sv.textual_value` in an initial block.
+// Registers moved forward are merged into one register whose reset value is
+// computed from theirs.  Registers with a reset aren't moved backward, since
+// this would require inverting the logic they are moved across.  Registers
+// created by a move get a random initial value if the moved ones have one.
+//
+//===----------------------------------------------------------------------===//
+
+#include "./PassDetails.h"
+#include "circt/Dialect/SV/Passes.h"
+#include "mlir/IR/BlockAndValueMapping.h"
+#include "mlir/Interfaces/SideEffectInterfaces.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/TypeSwitch.h"
+#include "llvm/Support/MathExtras.h"
+
+using namespace circt;
+using namespace sv;
+using llvm::TypeSwitch;
+
+/// Return true if `op` is side effect free RTL logic with a single result,
+/// which is evaluated combinationally.
+static bool isCombinational(Operation *op) {
+  return isa_and_nonnull<rtl::RTLDialect>(op->getDialect()) &&
+         !isa<rtl::ReadInOutOp>(op) && op->getNumRegions() == 0 &&
+         op->getNumResults() == 1 && MemoryEffectOpInterface::hasNoEffect(op);
+}
+
+/// Return the estimated delay of the combinational operation `op`, in the unit
+/// of a gate.  Wiring is free, bitwise logic costs a gate, and arithmetic is
+/// logarithmic in the width of its operands as with a carry-lookahead adder.
+static unsigned getDelay(Operation *op) {
+  unsigned width = 1;
+  if (op->getNumOperands())
+    if (auto type = op->getOperand(0).getType().dyn_cast<IntegerType>())
+      width = type.getWidth();
+  unsigned logWidth = llvm::Log2_32_Ceil(std::max(width, 1U));
+
+  return TypeSwitch<Operation *, unsigned>(op)
+      .Case<rtl::ConstantOp, rtl::ExtractOp, rtl::ConcatOp, rtl::SExtOp,
+            rtl::ArrayIndexOp, rtl::ArraySliceOp>([](auto) { return 0; })
+      .Case<rtl::AndOp, rtl::OrOp, rtl::XorOp>([&](auto) {
+        return std::max(llvm::Log2_32_Ceil(op->getNumOperands()), 1U);
+      })
+      .Case<rtl::MuxOp>([](auto) { return 1; })
+      .Case<rtl::AndROp, rtl::OrROp, rtl::XorROp>(
+          [&](auto) { return std::max(logWidth, 1U); })
+      .Case<rtl::AddOp, rtl::SubOp, rtl::ICmpOp, rtl::ShlOp, rtl::ShrUOp,
+            rtl::ShrSOp>([&](auto) { return logWidth + 1; })
+      .Case<rtl::MulOp>([&](auto) { return 2 * (logWidth + 1); })
+      .Case<rtl::DivUOp, rtl::DivSOp, rtl::ModUOp, rtl::ModSOp>(
+          [&](auto) { return std::max(width, 1U) * (logWidth + 1); })
+      .Default([](auto) { return 1; });
+}
+
+/// Return true if `cond` is `signal ^ 1`.
+static bool isNotOf(Value cond, Value signal) {
+  auto xorOp = cond.getDefiningOp<rtl::XorOp>();
+  if (!xorOp || xorOp.getNumOperands() != 2)
+    return false;
+  for (unsigned i = 0; i != 2; ++i) {
+    auto one = xorOp.getOperand(1 - i).getDefiningOp<rtl::ConstantOp>();
+    if (xorOp.getOperand(i) == signal && one && one.getValue().isAllOnesValue())
+      return true;
+  }
+  return false;
+}
+
+/// Erase `op`, and the `sv.if`, `sv.ifdef`, `sv.always` and `sv.initial`
+/// blocks it leaves empty.
+static void eraseAndCleanup(Operation *op) {
+  auto *parent = op->getParentOp();
+  op->erase();
+  while (isa<IfOp, IfDefOp, AlwaysOp, InitialOp>(parent) &&
+         llvm::all_of(parent->getRegions(), [](Region &region) {
+           return region.empty() || llvm::hasSingleElement(region.front());
+         })) {
+    op = parent;
+    parent = op->getParentOp();
+    op->erase();
+  }
+}
+
+namespace {
+/// The assignments and reads of a register which can be retimed.
+struct RegisterInfo {
+  RegOp reg;
+  /// The assignment of the next value.
+  PAssignOp next;
+  /// The assignment of the reset value, if any.
+  PAssignOp reset;
+  /// The random initial value, if any.
+  BPAssignOp init;
+  SmallVector<rtl::ReadInOutOp, 2> reads;
+
+  AlwaysOp getAlways() { return next->getParentOfType<AlwaysOp>(); }
+
+  /// The condition the next value is assigned under, other than the reset.
+  Value getEnable() {
+    auto ifOp = dyn_cast<IfOp>(next->getParentOp());
+    return ifOp && !reset ? ifOp.cond() : Value();
+  }
+
+  Value getResetSignal() {
+    return reset ? cast<IfOp>(reset->getParentOp()).cond() : Value();
+  }
+
+  /// Return true if this register is clocked, enabled, reset and initialized
+  /// like `other`.
+  bool isCompatibleWith(RegisterInfo &other) {
+    auto always = getAlways(), otherAlways = other.getAlways();
+    return always.events() == otherAlways.events() &&
+           llvm::equal(always.clocks(), otherAlways.clocks()) &&
+           getEnable() == other.getEnable() &&
+           getResetSignal() == other.getResetSignal() && !init == !other.init;
+  }
+
+  /// Return the assignments and reads of `reg`, or None if it isn't a
+  /// register which can be retimed.
+  static Optional<RegisterInfo> get(RegOp reg);
+};
+} // end anonymous namespace
+
+/// Return the always block `assign` is in, directly or under an `sv.if`
+/// without an else block, or null if it is anywhere else.
+static AlwaysOp getEnclosingAlways(PAssignOp assign) {
+  auto *parent = assign->getParentOp();
+  if (auto ifOp = dyn_cast<IfOp>(parent)) {
+    if (ifOp.hasElse())
+      return {};
+    parent = ifOp->getParentOp();
+  }
+  return dyn_cast<AlwaysOp>(parent);
+}
+
+Optional<RegisterInfo> RegisterInfo::get(RegOp reg) {
+  if (!rtl::getInOutElementType(reg.getType()).isa<IntegerType>())
+    return None;
+
+  RegisterInfo info;
+  info.reg = reg;
+  SmallVector<PAssignOp, 2> assigns;
+  for (auto *user : reg->getUsers()) {
+    if (auto read = dyn_cast<rtl::ReadInOutOp>(user)) {
+      info.reads.push_back(read);
+      continue;
+    }
+    if (auto assign = dyn_cast<PAssignOp>(user)) {
+      if (assign.dest() != reg || !getEnclosingAlways(assign))
+        return None;
+      assigns.push_back(assign);
+      continue;
+    }
+    auto init = dyn_cast<BPAssignOp>(user);
+    if (!init || info.init || init.dest() != reg ||
+        !init.src().getDefiningOp<TextualValueOp>() ||
+        !init->getParentOfType<InitialOp>())
+      return None;
+    info.init = init;
+  }
+
+  if (assigns.size() == 1) {
+    info.next = assigns[0];
+    return info;
+  }
+  if (assigns.size() != 2)
+    return None;
+
+  // A reset assignment under `sv.if %reset` and a next value assignment under
+  // `sv.if (%reset ^ 1)`, in order or not.
+  auto if0 = dyn_cast<IfOp>(assigns[0]->getParentOp());
+  auto if1 = dyn_cast<IfOp>(assigns[1]->getParentOp());
+  if (!if0 || !if1)
+    return None;
+  if (isNotOf(if1.cond(), if0.cond())) {
+    info.reset = assigns[0];
+    info.next = assigns[1];
+  } else if (isNotOf(if0.cond(), if1.cond())) {
+    info.reset = assigns[1];
+    info.next = assigns[0];
+  } else {
+    return None;
+  }
+
+  // Both must be triggered by the same events, an asynchronous reset being
+  // one of them.
+  auto always = info.getAlways();
+  auto resetAlways = info.reset->getParentOfType<AlwaysOp>();
+  if (always.events() != resetAlways.events() ||
+      !llvm::equal(always.clocks(), resetAlways.clocks()))
+    return None;
+  return info;
+}
+
+namespace {
+/// The longest combinational paths arriving at and departing from each value
+/// of a module.  Paths start at the ports, register outputs and constants,
+/// and end at the ports, register inputs and side effects.
+class TimingInfo {
+public:
+  unsigned getArrival(Value value);
+  unsigned getDeparture(Value value);
+
+  /// Return the delay of the longest path through `value`.
+  unsigned getPathDelay(Value value) {
+    return getArrival(value) + getDeparture(value);
+  }
+
+private:
+  DenseMap<Value, unsigned> arrivals, departures;
+};
+} // end anonymous namespace
+
+unsigned TimingInfo::getArrival(Value value) {
+  auto it = arrivals.find(value);
+  if (it != arrivals.end())
+    return it->second;
+
+  // A combinational cycle is broken where it is entered.
+  arrivals[value] = 0;
+  auto *op = value.getDefiningOp();
+  if (!op || !isCombinational(op))
+    return 0;
+  unsigned arrival = 0;
+  for (auto operand : op->getOperands())
+    arrival = std::max(arrival, getArrival(operand));
+  return arrivals[value] = arrival + getDelay(op);
+}
+
+unsigned TimingInfo::getDeparture(Value value) {
+  auto it = departures.find(value);
+  if (it != departures.end())
+    return it->second;
+
+  departures[value] = 0;
+  unsigned departure = 0;
+  for (auto *user : value.getUsers())
+    if (isCombinational(user))
+      departure = std::max(departure, getDelay(user) +
+                                          getDeparture(user->getResult(0)));
+  return departures[value] = departure;
+}
+
+namespace {
+/// A register move, and the delay of the longest path it changes.
+struct Move {
+  Operation *op = nullptr;
+  bool forward = false;
+  unsigned delay = ~0U;
+};
+
+struct SVRetimePass : public SVRetimeBase<SVRetimePass> {
+  void runOnOperation() override;
+
+private:
+  /// Return the delay of the longest path through the module.
+  unsigned getCriticalDelay(TimingInfo &timing);
+
+  /// Return the registers read by the operands of `op`, or false if they
+  /// can't be moved forward across it.
+  bool getForwardRegisters(Operation *op, SmallVectorImpl<RegisterInfo> &regs);
+
+  void moveForward(Operation *op, MutableArrayRef<RegisterInfo> regs);
+  void moveBackward(RegisterInfo &reg);
+
+  /// Return the name of a register created by moving `reg`.
+  StringAttr getRetimedName(RegOp reg);
+
+  DenseMap<Operation *, Optional<RegisterInfo>> registers;
+};
+} // end anonymous namespace
+
+unsigned SVRetimePass::getCriticalDelay(TimingInfo &timing) {
+  auto module = getOperation();
+  unsigned delay = 0;
+  for (auto arg : module.getArguments())
+    delay = std::max(delay, timing.getPathDelay(arg));
+  module.walk([&](Operation *op) {
+    for (auto result : op->getResults())
+      delay = std::max(delay, timing.getPathDelay(result));
+  });
+  return delay;
+}
+
+bool SVRetimePass::getForwardRegisters(Operation *op,
+                                       SmallVectorImpl<RegisterInfo> &regs) {
+  auto *body = getOperation().getBodyBlock();
+  for (auto operand : op->getOperands()) {
+    if (operand.getDefiningOp<rtl::ConstantOp>())
+      continue;
+    auto read = operand.getDefiningOp<rtl::ReadInOutOp>();
+    auto reg = read ? read.input().getDefiningOp<RegOp>() : RegOp();
+    if (!reg)
+      return false;
+    auto &info = registers[reg];
+    if (!info)
+      return false;
+    if (llvm::any_of(regs, [&](RegisterInfo &other) {
+          return other.reg == reg;
+        }))
+      continue;
+
+    // The register is replaced, so `op` must be its only reader, and its
+    // inputs must be visible from `op`.
+    if (!info->isCompatibleWith(regs.empty() ? *info : regs.front()) ||
+        llvm::any_of(info->reads,
+                     [&](rtl::ReadInOutOp read) {
+                       return llvm::any_of(read->getUsers(), [&](auto *user) {
+                         return user != op;
+                       });
+                     }) ||
+        info->next.src().getParentBlock() != body ||
+        (info->reset && info->reset.src().getParentBlock() != body))
+      return false;
+    regs.push_back(*info);
+  }
+  return !regs.empty();
+}
+
+StringAttr SVRetimePass::getRetimedName(RegOp reg) {
+  auto name = reg->getAttrOfType<StringAttr>("name");
+  if (!name)
+    return {};
+  return StringAttr::get((name.getValue() + "_retimed").str(), &getContext());
+}
+
+/// Assign a new random initial value to `reg` like `init` does, at the
+/// insertion point of `builder`.
+static void cloneInit(OpBuilder &builder, BPAssignOp init, Value reg) {
+  auto text = init.src().getDefiningOp<TextualValueOp>();
+  auto value = builder.create<TextualValueOp>(
+      init.getLoc(), rtl::getInOutElementType(reg.getType()),
+      text.stringAttr());
+  builder.create<BPAssignOp>(init.getLoc(), reg, value);
+}
+
+/// Erase `reg` and all its assignments, once its reads are unused.
+static void eraseRegister(RegisterInfo &reg) {
+  for (auto read : reg.reads)
+    read.erase();
+  eraseAndCleanup(reg.next);
+  if (reg.reset)
+    eraseAndCleanup(reg.reset);
+  if (reg.init) {
+    auto text = reg.init.src().getDefiningOp();
+    eraseAndCleanup(reg.init);
+    if (text->use_empty())
+      text->erase();
+  }
+  reg.reg.erase();
+}
+
+/// Replace the registers read by `op` with a register of its result.
+void SVRetimePass::moveForward(Operation *op,
+                               MutableArrayRef<RegisterInfo> regs) {
+  auto &first = regs.front();
+  OpBuilder builder(op);
+  auto type = op->getResult(0).getType();
+  auto reg =
+      builder.create<RegOp>(op->getLoc(), type, getRetimedName(first.reg));
+
+  // Compute the next value and the reset value of the new register with
+  // copies of `op`.
+  auto cloneWith = [&](function_ref<Value(RegisterInfo &)> getInput) {
+    BlockAndValueMapping mapping;
+    for (auto &info : regs)
+      for (auto read : info.reads)
+        mapping.map(read.getResult(), getInput(info));
+    builder.setInsertionPoint(op);
+    return builder.clone(*op, mapping)->getResult(0);
+  };
+  auto next = cloneWith([](RegisterInfo &info) { return info.next.src(); });
+  builder.setInsertionPointAfter(first.next);
+  builder.create<PAssignOp>(first.next.getLoc(), reg, next);
+  if (first.reset) {
+    auto reset =
+        cloneWith([](RegisterInfo &info) { return info.reset.src(); });
+    builder.setInsertionPointAfter(first.reset);
+    builder.create<PAssignOp>(first.reset.getLoc(), reg, reset);
+  }
+  if (first.init) {
+    builder.setInsertionPointAfter(first.init);
+    cloneInit(builder, first.init, reg);
+  }
+
+  builder.setInsertionPoint(op);
+  auto read = builder.create<rtl::ReadInOutOp>(op->getLoc(), reg);
+  op->getResult(0).replaceAllUsesWith(read);
+  op->erase();
+  for (auto &info : regs)
+    eraseRegister(info);
+}
+
+/// Replace `reg` with registers of the inputs of the operation computing its
+/// next value.
+void SVRetimePass::moveBackward(RegisterInfo &reg) {
+  auto *op = reg.next.src().getDefiningOp();
+  OpBuilder builder(op);
+  OpBuilder assignBuilder(reg.next);
+  assignBuilder.setInsertionPointAfter(reg.next);
+  OpBuilder initBuilder(&getContext());
+  if (reg.init)
+    initBuilder.setInsertionPointAfter(reg.init);
+
+  BlockAndValueMapping mapping;
+  for (auto operand : op->getOperands()) {
+    if (mapping.contains(operand) || operand.getDefiningOp<rtl::ConstantOp>())
+      continue;
+    auto input = builder.create<RegOp>(op->getLoc(), operand.getType(),
+                                       getRetimedName(reg.reg));
+    mapping.map(operand,
+                builder.create<rtl::ReadInOutOp>(op->getLoc(), input));
+    assignBuilder.create<PAssignOp>(reg.next.getLoc(), input, operand);
+    if (reg.init)
+      cloneInit(initBuilder, reg.init, input);
+  }
+
+  auto *newOp = builder.clone(*op, mapping);
+  for (auto read : reg.reads)
+    read.replaceAllUsesWith(newOp->getResult(0));
+  eraseRegister(reg);
+  op->erase();
+}
+
+void SVRetimePass::runOnOperation() {
+  auto *body = getOperation().getBodyBlock();
+
+  // Every move shortens a critical path, give up after as many moves as there
+  // are operations to bound the run time on designs which don't converge.
+  size_t maxMoves = body->getOperations().size();
+  bool changed = false;
+  for (size_t numMoves = 0; numMoves != maxMoves; ++numMoves) {
+    TimingInfo timing;
+    unsigned criticalDelay = getCriticalDelay(timing);
+    if (criticalDelay <= targetDelay)
+      break;
+
+    registers.clear();
+    getOperation().walk(
+        [&](RegOp reg) { registers[reg] = RegisterInfo::get(reg); });
+
+    // Pick the move which leaves the shortest paths through the moved
+    // registers, among those which make them all shorter than the critical
+    // path.
+    Move best;
+    for (auto &op : *body) {
+      if (!isCombinational(&op))
+        continue;
+      unsigned delay = getDelay(&op);
+      auto result = op.getResult(0);
+
+      // Move the registers feeding `op` to its output: the paths from them
+      // lose `op`, the paths to them gain it.
+      SmallVector<RegisterInfo, 4> regs;
+      if (result.getType().isa<IntegerType>() &&
+          timing.getPathDelay(result) == criticalDelay &&
+          getForwardRegisters(&op, regs)) {
+        unsigned newDelay = timing.getDeparture(result);
+        for (auto &info : regs) {
+          newDelay =
+              std::max(newDelay, timing.getArrival(info.next.src()) + delay);
+          if (info.reset)
+            newDelay = std::max(newDelay,
+                                timing.getArrival(info.reset.src()) + delay);
+        }
+        if (newDelay < std::min(criticalDelay, best.delay))
+          best = {&op, true, newDelay};
+      }
+
+      // Move the register `op` feeds to its inputs: the paths to it lose
+      // `op`, the paths from it gain it.
+      if (!result.hasOneUse() ||
+          timing.getArrival(result) != criticalDelay ||
+          llvm::all_of(op.getOperands(),
+                       [](Value operand) {
+                         return operand.getDefiningOp<rtl::ConstantOp>();
+                       }) ||
+          llvm::any_of(op.getOperands(), [](Value operand) {
+            return !operand.getType().isa<IntegerType>();
+          }))
+        continue;
+      auto assign = dyn_cast<PAssignOp>(*result.getUsers().begin());
+      auto reg = assign ? assign.dest().getDefiningOp<RegOp>() : RegOp();
+      if (!reg || !registers[reg] || registers[reg]->next != assign ||
+          registers[reg]->reset)
+        continue;
+      unsigned newDelay = 0;
+      for (auto operand : op.getOperands())
+        newDelay = std::max(newDelay, timing.getArrival(operand));
+      for (auto read : registers[reg]->reads)
+        newDelay =
+            std::max(newDelay, delay + timing.getDeparture(read.getResult()));
+      if (newDelay < std::min(criticalDelay, best.delay))
+        best = {reg, false, newDelay};
+    }
+    if (!best.op)
+      break;
+
+    if (best.forward) {
+      SmallVector<RegisterInfo, 4> regs;
+      getForwardRegisters(best.op, regs);
+      moveForward(best.op, regs);
+    } else {
+      moveBackward(*registers[best.op]);
+    }
+    changed = true;
+  }
+
+  registers.clear();
+  if (!changed)
+    markAllAnalysesPreserved();
+}
+
+std::unique_ptr<mlir::Pass> circt::sv::createSVRetimePass() {
+  return std::make_unique<SVRetimePass>();
+}
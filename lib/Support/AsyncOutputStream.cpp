@@ -0,0 +1,88 @@
+//===- AsyncOutputStream.cpp - Output stream with a writer thread ---------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements an output stream with a writer thread.
+//
+//===----------------------------------------------------------------------===//
+
+#include "circt/Support/AsyncOutputStream.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace circt;
+
+AsyncOutputStream::AsyncOutputStream(llvm::raw_ostream &target,
+                                     size_t chunkSize, size_t maxPendingChunks)
+    : target(target), chunkSize(chunkSize),
+      maxPendingChunks(std::max<size_t>(maxPendingChunks, 1)) {
+  // The target only receives whole chunks, so it doesn't need a buffer.
+  target.SetUnbuffered();
+  chunk.reserve(chunkSize);
+  writer = std::thread([this] { writeChunks(); });
+}
+
+AsyncOutputStream::~AsyncOutputStream() {
+  flush();
+  if (!chunk.empty())
+    submitChunk();
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    done = true;
+  }
+  pendingChanged.notify_all();
+  writer.join();
+  target.flush();
+}
+
+void AsyncOutputStream::write_impl(const char *ptr, size_t size) {
+  pos += size;
+  while (size) {
+    size_t count = std::min(size, chunkSize - chunk.size());
+    chunk.insert(chunk.end(), ptr, ptr + count);
+    ptr += count;
+    size -= count;
+    if (chunk.size() == chunkSize)
+      submitChunk();
+  }
+}
+
+void AsyncOutputStream::submitChunk() {
+  std::unique_lock<std::mutex> lock(mutex);
+  pendingChanged.wait(lock, [&] { return pending.size() < maxPendingChunks; });
+  pending.push_back(std::move(chunk));
+  if (freeChunks.empty()) {
+    chunk = std::vector<char>();
+    chunk.reserve(chunkSize);
+  } else {
+    chunk = std::move(freeChunks.back());
+    freeChunks.pop_back();
+  }
+  lock.unlock();
+  pendingChanged.notify_all();
+}
+
+void AsyncOutputStream::writeChunks() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    pendingChanged.wait(lock, [&] { return done || !pending.empty(); });
+    if (pending.empty())
+      return;
+
+    // Write the chunk without holding the lock, so that the next one can be
+    // filled meanwhile.
+    std::vector<char> writing = std::move(pending.front());
+    lock.unlock();
+    target.write(writing.data(), writing.size());
+    writing.clear();
+    lock.lock();
+
+    pending.pop_front();
+    freeChunks.push_back(std::move(writing));
+    pendingChanged.notify_all();
+  }
+}
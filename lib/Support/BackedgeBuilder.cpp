@@ -13,23 +13,28 @@
 #include "circt/Support/BackedgeBuilder.h"
 
 #include "mlir/IR/PatternMatch.h"
+#include <algorithm>
 
 using namespace circt;
 using namespace mlir;
 
-Backedge::Backedge(mlir::Operation *op) : value(op->getResult(0)) {}
+/// The number of results of the first placeholder op of a type, and the most
+/// any placeholder op gets.  Each new placeholder op of a type gets twice as
+/// many results as the previous one.
+static constexpr unsigned minPoolSize = 2;
+static constexpr unsigned maxPoolSize = 64;
+
+Backedge::Backedge(mlir::Value placeholder) : value(placeholder) {}
 
 void Backedge::setValue(mlir::Value newValue) {
   assert(value.getType() == newValue.getType());
-  for (auto &use : value.getUses())
-    use.set(newValue);
+  value.replaceAllUsesWith(newValue);
   value = newValue;
 }
 
 BackedgeBuilder::~BackedgeBuilder() {
   for (Operation *op : edges) {
-    auto users = op->getUsers();
-    assert(users.empty() && "Backedge still in use");
+    assert(op->use_empty() && "Backedge still in use");
     rewriter.eraseOp(op);
   }
 }
@@ -40,9 +45,16 @@ BackedgeBuilder::BackedgeBuilder(PatternRewriter &rewriter, Location loc)
     : rewriter(rewriter), loc(loc) {}
 
 Backedge BackedgeBuilder::get(Type t) {
-  OperationState s(loc, "TemporaryBackedge");
-  s.addTypes(t);
-  auto op = rewriter.createOperation(s);
-  edges.push_back(op);
-  return Backedge(op);
+  auto &pool = pools[t];
+  if (!pool.op || pool.nextResult == pool.op->getNumResults()) {
+    unsigned size = minPoolSize;
+    if (pool.op)
+      size = std::min(pool.op->getNumResults() * 2, maxPoolSize);
+    OperationState s(loc, "TemporaryBackedge");
+    s.addTypes(SmallVector<Type, minPoolSize>(size, t));
+    pool.op = rewriter.createOperation(s);
+    pool.nextResult = 0;
+    edges.push_back(pool.op);
+  }
+  return Backedge(pool.op->getResult(pool.nextResult++));
 }
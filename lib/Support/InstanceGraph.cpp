@@ -0,0 +1,114 @@
+//===- InstanceGraph.cpp - Module instantiation graph ---------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the instance graph analysis.
+//
+//===----------------------------------------------------------------------===//
+
+#include "circt/Support/InstanceGraph.h"
+#include "mlir/IR/BuiltinAttributes.h"
+#include "mlir/IR/MLIRContext.h"
+#include "mlir/IR/Operation.h"
+#include "mlir/IR/SymbolTable.h"
+#include "llvm/Support/Parallel.h"
+
+using namespace circt;
+using namespace mlir;
+
+InstanceGraph::InstanceGraph(Operation *operation) {
+  // Every operation of the symbol table defining a symbol is a module.
+  for (auto &op : operation->getRegion(0).front()) {
+    auto name = op.getAttrOfType<StringAttr>(SymbolTable::getSymbolAttrName());
+    if (!name)
+      continue;
+    nodes.push_back(std::make_unique<InstanceGraphNode>(&op));
+    nodesByName[name.getValue()] = nodes.back().get();
+    nodesByModule[&op] = nodes.back().get();
+  }
+
+  // Find the instances inside each module.  Each walk only touches its own
+  // node, so the modules can be walked in parallel.
+  auto findInstances = [&](InstanceGraphNode *node) {
+    node->module->walk([&](Operation *op) {
+      if (op == node->module)
+        return;
+      for (auto attr : op->getAttrs()) {
+        auto symbol = attr.second.dyn_cast<FlatSymbolRefAttr>();
+        if (!symbol)
+          continue;
+        if (auto *target = lookup(symbol.getValue())) {
+          node->instances.emplace_back(op, node, target);
+          break;
+        }
+      }
+    });
+  };
+  if (operation->getContext()->isMultithreadingEnabled()) {
+    llvm::parallelForEach(nodes.begin(), nodes.end(),
+                          [&](auto &node) { findInstances(node.get()); });
+  } else {
+    for (auto &node : nodes)
+      findInstances(node.get());
+  }
+
+  // Now that the instance lists don't change anymore, link up the uses.
+  for (auto &node : nodes) {
+    for (auto &record : node->instances) {
+      instanceRecords[record.instance] = &record;
+      record.target->uses.push_back(&record);
+    }
+  }
+
+  // Compute the post order with an iterative depth first search, so that deep
+  // hierarchies don't overflow the stack.
+  DenseSet<InstanceGraphNode *> visited;
+  SmallVector<std::pair<InstanceGraphNode *, InstanceRecord *>, 16> stack;
+  postOrder.reserve(nodes.size());
+  for (auto &node : nodes) {
+    if (!visited.insert(node.get()).second)
+      continue;
+    stack.push_back({node.get(), node->instances.begin()});
+    while (!stack.empty()) {
+      auto &entry = stack.back();
+      if (entry.second == entry.first->instances.end()) {
+        postOrder.push_back(entry.first);
+        stack.pop_back();
+        continue;
+      }
+      auto *target = (entry.second++)->target;
+      if (visited.insert(target).second)
+        stack.push_back({target, target->instances.begin()});
+    }
+  }
+}
+
+InstanceGraphNode *InstanceGraph::lookup(StringRef name) const {
+  return nodesByName.lookup(name);
+}
+
+InstanceGraphNode *InstanceGraph::lookup(Operation *module) const {
+  return nodesByModule.lookup(module);
+}
+
+InstanceRecord *InstanceGraph::lookupInstance(Operation *instance) const {
+  return instanceRecords.lookup(instance);
+}
+
+Operation *InstanceGraph::getReferencedModule(Operation *instance) const {
+  auto *record = lookupInstance(instance);
+  return record ? record->target->module : nullptr;
+}
+
+void InstanceGraph::replaceInstance(Operation *oldInstance,
+                                    Operation *newInstance) {
+  auto *record = instanceRecords.lookup(oldInstance);
+  assert(record && "replacing an instance which isn't in the graph");
+  instanceRecords.erase(oldInstance);
+  record->instance = newInstance;
+  instanceRecords[newInstance] = record;
+}
@@ -0,0 +1,257 @@
+//===- MemoryStats.cpp - Per-pass memory usage reporting ------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the memory usage report of the CIRCT tools.
+//
+//===----------------------------------------------------------------------===//
+
+#include "circt/Support/MemoryStats.h"
+#include "mlir/IR/Operation.h"
+#include "mlir/Pass/PassInstrumentation.h"
+#include "mlir/Pass/PassManager.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/Process.h"
+#include <algorithm>
+#include <cstdio>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+using namespace circt;
+using namespace mlir;
+
+//===----------------------------------------------------------------------===//
+// MemorySnapshot
+//===----------------------------------------------------------------------===//
+
+/// Return the resident set size of the process, or zero if unknown.
+static uint64_t getRSS() {
+#if defined(__linux__)
+  // The second field is the resident size, in pages.
+  FILE *statm = fopen("/proc/self/statm", "r");
+  if (!statm)
+    return 0;
+  unsigned long long size = 0, resident = 0;
+  int numRead = fscanf(statm, "%llu %llu", &size, &resident);
+  fclose(statm);
+  if (numRead != 2)
+    return 0;
+  return resident * llvm::sys::Process::getPageSizeEstimate();
+#else
+  return 0;
+#endif
+}
+
+/// Return the peak resident set size of the process, or zero if unknown.
+static uint64_t getPeakRSS() {
+#if defined(__unix__) || defined(__APPLE__)
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+#if defined(__APPLE__)
+  return usage.ru_maxrss;
+#else
+  // Linux and the BSDs report kilobytes.
+  return uint64_t(usage.ru_maxrss) * 1024;
+#endif
+#else
+  return 0;
+#endif
+}
+
+MemorySnapshot MemorySnapshot::take(Operation *op, bool countUniqued) {
+  MemorySnapshot snapshot;
+  snapshot.rss = getRSS();
+  snapshot.peakRSS = getPeakRSS();
+  snapshot.mallocBytes = llvm::sys::Process::GetMallocUsage();
+  if (!op)
+    return snapshot;
+
+  if (!countUniqued) {
+    op->walk([&](Operation *) { ++snapshot.numOps; });
+    return snapshot;
+  }
+
+  // MLIR doesn't expose how many types and attributes its context uniqued, so
+  // count the distinct ones the IR refers to directly.
+  llvm::DenseSet<Type> types;
+  llvm::DenseSet<Attribute> attrs;
+  op->walk([&](Operation *op) {
+    ++snapshot.numOps;
+    types.insert(op->result_type_begin(), op->result_type_end());
+    for (auto &region : op->getRegions())
+      for (auto &block : region)
+        for (auto arg : block.getArguments())
+          types.insert(arg.getType());
+    for (auto attr : op->getAttrs())
+      attrs.insert(attr.second);
+  });
+  snapshot.numTypes = types.size();
+  snapshot.numAttrs = attrs.size();
+  return snapshot;
+}
+
+//===----------------------------------------------------------------------===//
+// MemoryStats
+//===----------------------------------------------------------------------===//
+
+void MemoryStats::addPhase(StringRef phase, const MemorySnapshot &before,
+                           const MemorySnapshot &after) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = phaseIndex.try_emplace(phase, phases.size());
+  if (it.second) {
+    phases.emplace_back();
+    phases.back().name = phase.str();
+  }
+  auto &entry = phases[it.first->second];
+  ++entry.runs;
+  entry.rssDelta += int64_t(after.rss) - int64_t(before.rss);
+  entry.mallocDelta += int64_t(after.mallocBytes) - int64_t(before.mallocBytes);
+  entry.opsDelta += int64_t(after.numOps) - int64_t(before.numOps);
+  entry.peakRSS = std::max(entry.peakRSS, after.peakRSS);
+  entry.numOps = after.numOps;
+  entry.numTypes = after.numTypes;
+  entry.numAttrs = after.numAttrs;
+}
+
+/// Format a signed number of bytes in megabytes.
+static std::string formatMB(int64_t bytes) {
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "%+.1f", bytes / (1024.0 * 1024.0));
+  return buffer;
+}
+
+void MemoryStats::print(raw_ostream &os, bool json) const {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (json) {
+    llvm::json::OStream out(os, 2);
+    out.object([&] {
+      out.attributeArray("phases", [&] {
+        for (auto &phase : phases)
+          out.object([&] {
+            out.attribute("name", phase.name);
+            out.attribute("runs", int64_t(phase.runs));
+            out.attribute("rss.delta", phase.rssDelta);
+            out.attribute("rss.peak", int64_t(phase.peakRSS));
+            out.attribute("malloc.delta", phase.mallocDelta);
+            out.attribute("ops.delta", phase.opsDelta);
+            out.attribute("ops", int64_t(phase.numOps));
+            out.attribute("types", int64_t(phase.numTypes));
+            out.attribute("attributes", int64_t(phase.numAttrs));
+          });
+      });
+    });
+    os << "\n";
+    return;
+  }
+
+  os << "===" << std::string(73, '-') << "===\n";
+  os << "                         Memory Usage Report\n";
+  os << "===" << std::string(73, '-') << "===\n";
+  os << "  RSS (MB)  Peak (MB)  Malloc (MB)      Ops  Ops Delta   Types  Attrs"
+        "  Phase\n";
+  for (auto &phase : phases)
+    os << llvm::format("  %8s  %9.1f  %11s  %7llu  %9lld  %6llu  %5llu  ",
+                       formatMB(phase.rssDelta).c_str(),
+                       phase.peakRSS / (1024.0 * 1024.0),
+                       formatMB(phase.mallocDelta).c_str(),
+                       (unsigned long long)phase.numOps,
+                       (long long)phase.opsDelta,
+                       (unsigned long long)phase.numTypes,
+                       (unsigned long long)phase.numAttrs)
+       << phase.name << "\n";
+}
+
+//===----------------------------------------------------------------------===//
+// Pass instrumentation
+//===----------------------------------------------------------------------===//
+
+namespace {
+struct MemoryStatsOptions {
+  llvm::cl::opt<bool> enabled{
+      "memory-stats",
+      llvm::cl::desc("report the memory used by the process and the size of "
+                     "the IR before and after each pass on stderr"),
+      llvm::cl::init(false)};
+
+  enum FormatKind { Text, JSON };
+  llvm::cl::opt<FormatKind> format{
+      "memory-stats-format",
+      llvm::cl::desc("Specify the format of the -memory-stats report:"),
+      llvm::cl::values(clEnumValN(Text, "text", "a human readable report"),
+                       clEnumValN(JSON, "json", "a JSON report")),
+      llvm::cl::init(Text)};
+};
+
+/// Records the memory used by each pass as a phase of its own, and prints the
+/// report once the pass manager is done with it. A pass nested on many
+/// operations only counts the IR of the operation it runs on.
+class MemoryStatsInstrumentation : public PassInstrumentation {
+public:
+  explicit MemoryStatsInstrumentation(bool json) : json(json) {}
+  ~MemoryStatsInstrumentation() override { stats.print(llvm::errs(), json); }
+
+  void runBeforePass(Pass *pass, Operation *op) override {
+    auto snapshot = MemorySnapshot::take(op);
+    std::lock_guard<std::mutex> lock(mutex);
+    snapshots[{pass, op}] = snapshot;
+  }
+  void runAfterPass(Pass *pass, Operation *op) override { stop(pass, op); }
+  void runAfterPassFailed(Pass *pass, Operation *op) override {
+    stop(pass, op);
+  }
+
+  MemoryStats &getStats() { return stats; }
+
+private:
+  void stop(Pass *pass, Operation *op) {
+    MemorySnapshot before;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      auto it = snapshots.find({pass, op});
+      if (it == snapshots.end())
+        return;
+      before = it->second;
+      snapshots.erase(it);
+    }
+    stats.addPhase(("pass: " + pass->getName()).str(), before,
+                   MemorySnapshot::take(op));
+  }
+
+  MemoryStats stats;
+  bool json;
+  std::mutex mutex;
+  llvm::DenseMap<std::pair<Pass *, Operation *>, MemorySnapshot> snapshots;
+};
+} // end anonymous namespace
+
+static llvm::ManagedStatic<MemoryStatsOptions> options;
+
+void circt::registerMemoryStatsCLOptions() {
+  // Make sure that the options struct has been constructed.
+  *options;
+}
+
+bool circt::isMemoryStatsEnabled() {
+  return options.isConstructed() && options->enabled;
+}
+
+MemoryStats *circt::applyMemoryStatsCLOptions(PassManager &pm) {
+  if (!isMemoryStatsEnabled())
+    return nullptr;
+  auto instrumentation = std::make_unique<MemoryStatsInstrumentation>(
+      options->format == MemoryStatsOptions::JSON);
+  auto *stats = &instrumentation->getStats();
+  pm.addInstrumentation(std::move(instrumentation));
+  return stats;
+}
@@ -0,0 +1,809 @@
+//===- BinaryIR.cpp - Binary IR serialization -----------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements a compact binary format for MLIR modules.  A file is
+// laid out as:
+//
+//   magic, version
+//   strings:   count, (length, bytes)*
+//   dialects:  count, string*
+//   types:     count, string*            -- the printed form of each type
+//   attrs:     count, string*            -- the printed form of each attribute
+//   locations: count, location*
+//   values:    count
+//   the top level operation
+//
+// All integers are ULEB128 encoded and everything after the string table
+// refers to the tables by index.  Types and attributes are only parsed the
+// first time they are used, so a design with a handful of distinct types pays
+// for parsing each of them once instead of once per use.
+//
+// An operation is encoded as its name, location, result types, operands,
+// successors, attributes and regions.  Values are numbered in the order they
+// are defined, which is the order the reader sees them. An operand that refers
+// to a value defined later, as happens in graph regions and across blocks, is
+// flagged and carries its type so the reader can stand in a placeholder.
+//
+//===----------------------------------------------------------------------===//
+
+#include "circt/Translation/BinaryIR.h"
+#include "circt/Dialect/FIRRTL/FIRRTLDialect.h"
+#include "circt/Dialect/RTL/RTLDialect.h"
+#include "circt/Dialect/SV/SVDialect.h"
+#include "mlir/IR/BuiltinOps.h"
+#include "mlir/IR/Diagnostics.h"
+#include "mlir/IR/Location.h"
+#include "mlir/Parser.h"
+#include "mlir/Support/LogicalResult.h"
+#include "mlir/Translation.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/LEB128.h"
+#include "llvm/Support/SourceMgr.h"
+
+using namespace mlir;
+using namespace circt;
+
+/// Every binary IR file starts with these bytes.  The leading byte is not valid
+/// in textual MLIR, so the two formats can't be confused.
+static const char binaryIRMagic[] = "\x89" "CIRCTIR";
+static constexpr size_t binaryIRMagicSize = sizeof(binaryIRMagic) - 1;
+
+/// Bump this whenever the encoding changes.
+static constexpr uint64_t binaryIRVersion = 1;
+
+namespace {
+/// The kinds of location in the location table.
+enum LocationKind : uint8_t {
+  UnknownLocKind,
+  FileLineColLocKind,
+  NameLocKind,
+  CallSiteLocKind,
+  FusedLocKind,
+};
+} // end anonymous namespace
+
+bool circt::isBinaryIR(StringRef buffer) {
+  return buffer.startswith(StringRef(binaryIRMagic, binaryIRMagicSize));
+}
+
+//===----------------------------------------------------------------------===//
+// Writer
+//===----------------------------------------------------------------------===//
+
+namespace {
+class BinaryIRWriter {
+public:
+  void write(Operation *topOp, raw_ostream &os);
+
+private:
+  void numberValues(Operation *op);
+  void writeOperation(Operation *op);
+  void writeRegion(Region &region);
+  void writeOperand(Value value);
+
+  unsigned getStringID(StringRef string);
+  unsigned getTypeID(Type type);
+  unsigned getAttrID(Attribute attr);
+  unsigned getLocID(Location loc);
+  void addDialect(StringRef name);
+
+  void emitInt(std::string &buffer, uint64_t value) {
+    llvm::raw_string_ostream os(buffer);
+    encodeULEB128(value, os);
+  }
+  void emitInt(uint64_t value) { emitInt(body, value); }
+
+  /// The interned strings, in the order they were first used.
+  llvm::StringMap<unsigned> strings;
+  SmallVector<StringRef, 64> stringList;
+
+  /// The string ID of each dialect which is used, besides the builtin one.
+  llvm::StringMap<unsigned> dialects;
+
+  /// The interned types and attributes, and the string ID of their printed
+  /// form.
+  DenseMap<Type, unsigned> types;
+  SmallVector<unsigned, 32> typeStrings;
+  DenseMap<Attribute, unsigned> attrs;
+  SmallVector<unsigned, 32> attrStrings;
+
+  /// The interned locations.  A location is encoded after the ones it refers
+  /// to, so the reader can build the table front to back.
+  DenseMap<Location, unsigned> locs;
+  std::string locTable;
+  unsigned numLocs = 0;
+
+  /// The number of each value, and how many have been defined so far.
+  DenseMap<Value, unsigned> valueIDs;
+  unsigned numDefinedValues = 0;
+
+  /// The encoded top level operation.
+  std::string body;
+};
+} // end anonymous namespace
+
+unsigned BinaryIRWriter::getStringID(StringRef string) {
+  auto it = strings.try_emplace(string, stringList.size());
+  if (it.second)
+    stringList.push_back(it.first->getKey());
+  return it.first->second;
+}
+
+void BinaryIRWriter::addDialect(StringRef name) {
+  if (!name.empty())
+    dialects.try_emplace(name, getStringID(name));
+}
+
+unsigned BinaryIRWriter::getTypeID(Type type) {
+  auto it = types.find(type);
+  if (it != types.end())
+    return it->second;
+
+  addDialect(type.getDialect().getNamespace());
+  std::string text;
+  llvm::raw_string_ostream os(text);
+  type.print(os);
+  typeStrings.push_back(getStringID(os.str()));
+  return types[type] = typeStrings.size() - 1;
+}
+
+unsigned BinaryIRWriter::getAttrID(Attribute attr) {
+  auto it = attrs.find(attr);
+  if (it != attrs.end())
+    return it->second;
+
+  addDialect(attr.getDialect().getNamespace());
+  std::string text;
+  llvm::raw_string_ostream os(text);
+  attr.print(os);
+  attrStrings.push_back(getStringID(os.str()));
+  return attrs[attr] = attrStrings.size() - 1;
+}
+
+unsigned BinaryIRWriter::getLocID(Location loc) {
+  auto it = locs.find(loc);
+  if (it != locs.end())
+    return it->second;
+
+  // Opaque locations only make sense in the process that created them, keep
+  // their fallback instead.
+  if (auto opaque = loc.dyn_cast<OpaqueLoc>())
+    return locs[loc] = getLocID(opaque.getFallbackLocation());
+
+  // Intern everything this location refers to before encoding it.
+  std::string encoded;
+  if (auto fileLoc = loc.dyn_cast<FileLineColLoc>()) {
+    encoded.push_back(FileLineColLocKind);
+    emitInt(encoded, getStringID(fileLoc.getFilename()));
+    emitInt(encoded, fileLoc.getLine());
+    emitInt(encoded, fileLoc.getColumn());
+  } else if (auto nameLoc = loc.dyn_cast<NameLoc>()) {
+    auto name = getStringID(nameLoc.getName());
+    auto child = getLocID(nameLoc.getChildLoc());
+    encoded.push_back(NameLocKind);
+    emitInt(encoded, name);
+    emitInt(encoded, child);
+  } else if (auto callLoc = loc.dyn_cast<CallSiteLoc>()) {
+    auto callee = getLocID(callLoc.getCallee());
+    auto caller = getLocID(callLoc.getCaller());
+    encoded.push_back(CallSiteLocKind);
+    emitInt(encoded, callee);
+    emitInt(encoded, caller);
+  } else if (auto fusedLoc = loc.dyn_cast<FusedLoc>()) {
+    SmallVector<unsigned, 4> children;
+    for (auto child : fusedLoc.getLocations())
+      children.push_back(getLocID(child));
+    // The metadata is stored off by one, zero means there is none.
+    unsigned metadata = 0;
+    if (auto attr = fusedLoc.getMetadata())
+      metadata = getAttrID(attr) + 1;
+    encoded.push_back(FusedLocKind);
+    emitInt(encoded, children.size());
+    for (auto child : children)
+      emitInt(encoded, child);
+    emitInt(encoded, metadata);
+  } else {
+    encoded.push_back(UnknownLocKind);
+  }
+
+  locTable += encoded;
+  return locs[loc] = numLocs++;
+}
+
+/// Number the values defined by `op` and everything nested in it, in the
+/// order writeOperation defines them.
+void BinaryIRWriter::numberValues(Operation *op) {
+  for (auto result : op->getResults())
+    valueIDs.try_emplace(result, valueIDs.size());
+  for (auto &region : op->getRegions()) {
+    for (auto &block : region)
+      for (auto arg : block.getArguments())
+        valueIDs.try_emplace(arg, valueIDs.size());
+    for (auto &block : region)
+      for (auto &nested : block)
+        numberValues(&nested);
+  }
+}
+
+void BinaryIRWriter::writeOperand(Value value) {
+  // Values are defined in the order they are numbered, so anything at or past
+  // the count defined so far is a forward reference.
+  unsigned id = valueIDs.lookup(value);
+  bool isForward = id >= numDefinedValues;
+  emitInt((uint64_t(id) << 1) | isForward);
+  if (isForward)
+    emitInt(getTypeID(value.getType()));
+}
+
+void BinaryIRWriter::writeOperation(Operation *op) {
+  auto name = op->getName().getStringRef();
+  if (name.contains('.'))
+    addDialect(name.split('.').first);
+  emitInt(getStringID(name));
+  emitInt(getLocID(op->getLoc()));
+
+  emitInt(op->getNumResults());
+  for (auto type : op->getResultTypes())
+    emitInt(getTypeID(type));
+
+  emitInt(op->getNumOperands());
+  for (auto operand : op->getOperands())
+    writeOperand(operand);
+  numDefinedValues += op->getNumResults();
+
+  // Successors are always blocks of the region holding the operation.
+  emitInt(op->getNumSuccessors());
+  for (auto *successor : op->getSuccessors()) {
+    auto &blocks = successor->getParent()->getBlocks();
+    emitInt(std::distance(blocks.begin(), successor->getIterator()));
+  }
+
+  auto attributes = op->getAttrs();
+  emitInt(attributes.size());
+  for (auto attr : attributes) {
+    emitInt(getStringID(attr.first.strref()));
+    emitInt(getAttrID(attr.second));
+  }
+
+  emitInt(op->getNumRegions());
+  for (auto &region : op->getRegions())
+    writeRegion(region);
+}
+
+void BinaryIRWriter::writeRegion(Region &region) {
+  // Emit all the block arguments up front, so that branches can refer to any
+  // block in the region.
+  emitInt(std::distance(region.begin(), region.end()));
+  for (auto &block : region) {
+    emitInt(block.getNumArguments());
+    for (auto arg : block.getArguments())
+      emitInt(getTypeID(arg.getType()));
+    numDefinedValues += block.getNumArguments();
+  }
+
+  for (auto &block : region) {
+    emitInt(block.getOperations().size());
+    for (auto &op : block)
+      writeOperation(&op);
+  }
+}
+
+void BinaryIRWriter::write(Operation *topOp, raw_ostream &os) {
+  numberValues(topOp);
+  writeOperation(topOp);
+
+  os.write(binaryIRMagic, binaryIRMagicSize);
+  encodeULEB128(binaryIRVersion, os);
+
+  encodeULEB128(stringList.size(), os);
+  for (auto string : stringList) {
+    encodeULEB128(string.size(), os);
+    os << string;
+  }
+
+  encodeULEB128(dialects.size(), os);
+  for (auto &dialect : dialects)
+    encodeULEB128(dialect.second, os);
+
+  encodeULEB128(typeStrings.size(), os);
+  for (auto string : typeStrings)
+    encodeULEB128(string, os);
+
+  encodeULEB128(attrStrings.size(), os);
+  for (auto string : attrStrings)
+    encodeULEB128(string, os);
+
+  encodeULEB128(numLocs, os);
+  os << locTable;
+
+  encodeULEB128(valueIDs.size(), os);
+  os << body;
+}
+
+LogicalResult circt::writeBinaryIR(ModuleOp module, raw_ostream &os) {
+  BinaryIRWriter().write(module, os);
+  return success();
+}
+
+//===----------------------------------------------------------------------===//
+// Reader
+//===----------------------------------------------------------------------===//
+
+namespace {
+class BinaryIRReader {
+public:
+  BinaryIRReader(StringRef buffer, Location fileLoc)
+      : ptr(buffer.bytes_begin()), end(buffer.bytes_end()), fileLoc(fileLoc),
+        context(fileLoc.getContext()) {}
+  ~BinaryIRReader();
+
+  Operation *read();
+
+private:
+  InFlightDiagnostic emitError() {
+    return mlir::emitError(fileLoc, "malformed binary IR: ");
+  }
+
+  bool readInt(uint64_t &value);
+  bool readIndex(uint64_t &value, size_t size, StringRef what);
+  bool readString(StringRef &string);
+  bool readType(Type &type);
+  bool readAttribute(Attribute &attr);
+  bool readLocation(Location &loc);
+  bool readLocationTable();
+  bool readOperand(Value &value);
+  bool defineValue(Value value);
+  Operation *readOperation(ArrayRef<Block *> regionBlocks);
+  bool readRegion(Region &region);
+
+  const uint8_t *ptr, *end;
+  Location fileLoc;
+  MLIRContext *context;
+
+  SmallVector<StringRef, 64> strings;
+
+  /// The string ID of each type and attribute, and the parsed entity once it
+  /// has been used.
+  SmallVector<uint64_t, 32> typeStrings, attrStrings;
+  SmallVector<Type, 32> types;
+  SmallVector<Attribute, 32> attrs;
+  SmallVector<Location, 32> locs;
+
+  /// Every value by number, and a placeholder for each one which has been used
+  /// but not defined yet.
+  std::vector<Value> values;
+  unsigned numDefinedValues = 0;
+  DenseMap<unsigned, Operation *> forwardRefs;
+};
+} // end anonymous namespace
+
+BinaryIRReader::~BinaryIRReader() {
+  // Anything left here is only used by IR which has already been destroyed.
+  for (auto entry : forwardRefs) {
+    entry.second->dropAllUses();
+    entry.second->destroy();
+  }
+}
+
+bool BinaryIRReader::readInt(uint64_t &value) {
+  unsigned size = 0;
+  const char *error = nullptr;
+  value = llvm::decodeULEB128(ptr, &size, end, &error);
+  if (error) {
+    emitError() << error;
+    return false;
+  }
+  ptr += size;
+  return true;
+}
+
+bool BinaryIRReader::readIndex(uint64_t &value, size_t size, StringRef what) {
+  if (!readInt(value))
+    return false;
+  if (value < size)
+    return true;
+  emitError() << what << " index " << value << " out of range";
+  return false;
+}
+
+bool BinaryIRReader::readString(StringRef &string) {
+  uint64_t id;
+  if (!readIndex(id, strings.size(), "string"))
+    return false;
+  string = strings[id];
+  return true;
+}
+
+bool BinaryIRReader::readType(Type &type) {
+  uint64_t id;
+  if (!readIndex(id, types.size(), "type"))
+    return false;
+  if (!types[id])
+    types[id] = parseType(strings[typeStrings[id]], context);
+  type = types[id];
+  return bool(type);
+}
+
+bool BinaryIRReader::readAttribute(Attribute &attr) {
+  uint64_t id;
+  if (!readIndex(id, attrs.size(), "attribute"))
+    return false;
+  if (!attrs[id])
+    attrs[id] = parseAttribute(strings[attrStrings[id]], context);
+  attr = attrs[id];
+  return bool(attr);
+}
+
+bool BinaryIRReader::readLocation(Location &loc) {
+  uint64_t id;
+  if (!readIndex(id, locs.size(), "location"))
+    return false;
+  loc = locs[id];
+  return true;
+}
+
+bool BinaryIRReader::readLocationTable() {
+  uint64_t numLocs;
+  if (!readInt(numLocs))
+    return false;
+
+  for (uint64_t i = 0; i != numLocs; ++i) {
+    if (ptr == end) {
+      emitError() << "unexpected end of location table";
+      return false;
+    }
+
+    StringRef string;
+    uint64_t line, column, numChildren, metadataID;
+    Location first = fileLoc, second = fileLoc;
+    switch (*ptr++) {
+    case UnknownLocKind:
+      locs.push_back(UnknownLoc::get(context));
+      break;
+    case FileLineColLocKind:
+      if (!readString(string) || !readInt(line) || !readInt(column))
+        return false;
+      locs.push_back(FileLineColLoc::get(string, line, column, context));
+      break;
+    case NameLocKind:
+      if (!readString(string) || !readLocation(first))
+        return false;
+      locs.push_back(NameLoc::get(Identifier::get(string, context), first));
+      break;
+    case CallSiteLocKind:
+      if (!readLocation(first) || !readLocation(second))
+        return false;
+      locs.push_back(CallSiteLoc::get(first, second));
+      break;
+    case FusedLocKind: {
+      SmallVector<Location, 4> children;
+      if (!readInt(numChildren))
+        return false;
+      for (uint64_t child = 0; child != numChildren; ++child) {
+        if (!readLocation(first))
+          return false;
+        children.push_back(first);
+      }
+      Attribute metadata;
+      if (!readInt(metadataID))
+        return false;
+      if (metadataID) {
+        if (metadataID > attrs.size()) {
+          emitError() << "attribute index out of range";
+          return false;
+        }
+        if (!attrs[metadataID - 1])
+          attrs[metadataID - 1] =
+              parseAttribute(strings[attrStrings[metadataID - 1]], context);
+        if (!(metadata = attrs[metadataID - 1]))
+          return false;
+      }
+      locs.push_back(FusedLoc::get(children, metadata, context));
+      break;
+    }
+    default:
+      emitError() << "unknown location kind";
+      return false;
+    }
+  }
+  return true;
+}
+
+bool BinaryIRReader::defineValue(Value value) {
+  unsigned id = numDefinedValues++;
+  if (id >= values.size()) {
+    emitError() << "more values than declared";
+    return false;
+  }
+  values[id] = value;
+
+  auto it = forwardRefs.find(id);
+  if (it == forwardRefs.end())
+    return true;
+  Operation *placeholder = it->second;
+  forwardRefs.erase(it);
+  if (placeholder->getResult(0).getType() != value.getType()) {
+    emitError() << "value " << id << " used with a different type";
+    placeholder->dropAllUses();
+    placeholder->destroy();
+    return false;
+  }
+  placeholder->getResult(0).replaceAllUsesWith(value);
+  placeholder->destroy();
+  return true;
+}
+
+bool BinaryIRReader::readOperand(Value &value) {
+  uint64_t encoded;
+  if (!readInt(encoded))
+    return false;
+  uint64_t id = encoded >> 1;
+  if (id >= values.size()) {
+    emitError() << "value index " << id << " out of range";
+    return false;
+  }
+
+  if (!(encoded & 1)) {
+    value = values[id];
+    if (value)
+      return true;
+    emitError() << "use of undefined value " << id;
+    return false;
+  }
+
+  // This is a forward reference, stand in a placeholder until the value is
+  // defined.
+  Type type;
+  if (!readType(type))
+    return false;
+  if (values[id]) {
+    value = values[id];
+    return true;
+  }
+  auto *&placeholder = forwardRefs[id];
+  if (!placeholder) {
+    OperationState state(fileLoc, "placeholder");
+    state.addTypes(type);
+    placeholder = Operation::create(state);
+  }
+  value = placeholder->getResult(0);
+  return true;
+}
+
+Operation *BinaryIRReader::readOperation(ArrayRef<Block *> regionBlocks) {
+  StringRef name;
+  Location loc = fileLoc;
+  if (!readString(name) || !readLocation(loc))
+    return nullptr;
+  OperationState state(loc, name);
+
+  uint64_t numResults, numOperands, numSuccessors, numAttrs, numRegions;
+  if (!readInt(numResults))
+    return nullptr;
+  for (uint64_t i = 0; i != numResults; ++i) {
+    Type type;
+    if (!readType(type))
+      return nullptr;
+    state.addTypes(type);
+  }
+
+  if (!readInt(numOperands))
+    return nullptr;
+  for (uint64_t i = 0; i != numOperands; ++i) {
+    Value operand;
+    if (!readOperand(operand))
+      return nullptr;
+    state.addOperands(operand);
+  }
+
+  if (!readInt(numSuccessors))
+    return nullptr;
+  for (uint64_t i = 0; i != numSuccessors; ++i) {
+    uint64_t blockID;
+    if (!readIndex(blockID, regionBlocks.size(), "block"))
+      return nullptr;
+    state.addSuccessors(regionBlocks[blockID]);
+  }
+
+  if (!readInt(numAttrs))
+    return nullptr;
+  for (uint64_t i = 0; i != numAttrs; ++i) {
+    StringRef attrName;
+    Attribute attr;
+    if (!readString(attrName) || !readAttribute(attr))
+      return nullptr;
+    state.addAttribute(attrName, attr);
+  }
+
+  if (!readInt(numRegions))
+    return nullptr;
+  for (uint64_t i = 0; i != numRegions; ++i)
+    state.addRegion();
+
+  Operation *op = Operation::create(state);
+  for (auto result : op->getResults()) {
+    if (!defineValue(result)) {
+      op->destroy();
+      return nullptr;
+    }
+  }
+  for (auto &region : op->getRegions()) {
+    if (!readRegion(region)) {
+      op->destroy();
+      return nullptr;
+    }
+  }
+  return op;
+}
+
+bool BinaryIRReader::readRegion(Region &region) {
+  uint64_t numBlocks;
+  if (!readInt(numBlocks))
+    return false;
+
+  SmallVector<Block *, 4> blocks;
+  for (uint64_t i = 0; i != numBlocks; ++i) {
+    auto *block = new Block();
+    region.push_back(block);
+    blocks.push_back(block);
+
+    uint64_t numArgs;
+    if (!readInt(numArgs))
+      return false;
+    for (uint64_t arg = 0; arg != numArgs; ++arg) {
+      Type type;
+      if (!readType(type) || !defineValue(block->addArgument(type)))
+        return false;
+    }
+  }
+
+  for (auto *block : blocks) {
+    uint64_t numOps;
+    if (!readInt(numOps))
+      return false;
+    for (uint64_t i = 0; i != numOps; ++i) {
+      auto *op = readOperation(blocks);
+      if (!op)
+        return false;
+      block->push_back(op);
+    }
+  }
+  return true;
+}
+
+Operation *BinaryIRReader::read() {
+  if (size_t(end - ptr) < binaryIRMagicSize ||
+      !isBinaryIR(StringRef((const char *)ptr, binaryIRMagicSize))) {
+    emitError() << "missing magic number";
+    return nullptr;
+  }
+  ptr += binaryIRMagicSize;
+
+  uint64_t version;
+  if (!readInt(version))
+    return nullptr;
+  if (version != binaryIRVersion) {
+    emitError() << "unsupported version " << version;
+    return nullptr;
+  }
+
+  uint64_t numStrings;
+  if (!readInt(numStrings))
+    return nullptr;
+  for (uint64_t i = 0; i != numStrings; ++i) {
+    uint64_t size;
+    if (!readInt(size))
+      return nullptr;
+    if (size > uint64_t(end - ptr)) {
+      emitError() << "unexpected end of string table";
+      return nullptr;
+    }
+    strings.push_back(StringRef((const char *)ptr, size));
+    ptr += size;
+  }
+
+  // Load the dialects before parsing anything which might belong to them.
+  uint64_t numDialects;
+  if (!readInt(numDialects))
+    return nullptr;
+  for (uint64_t i = 0; i != numDialects; ++i) {
+    StringRef dialect;
+    if (!readString(dialect))
+      return nullptr;
+    if (!context->getOrLoadDialect(dialect) &&
+        !context->allowsUnregisteredDialects()) {
+      emitError() << "dialect '" << dialect << "' is not registered";
+      return nullptr;
+    }
+  }
+
+  auto readStringTable = [&](SmallVectorImpl<uint64_t> &table) {
+    uint64_t size;
+    if (!readInt(size))
+      return false;
+    for (uint64_t i = 0; i != size; ++i) {
+      table.push_back(0);
+      if (!readIndex(table.back(), strings.size(), "string"))
+        return false;
+    }
+    return true;
+  };
+  if (!readStringTable(typeStrings) || !readStringTable(attrStrings))
+    return nullptr;
+  types.resize(typeStrings.size());
+  attrs.resize(attrStrings.size());
+
+  if (!readLocationTable())
+    return nullptr;
+
+  uint64_t numValues;
+  if (!readInt(numValues))
+    return nullptr;
+  values.resize(numValues);
+
+  Operation *op = readOperation({});
+  if (!op)
+    return nullptr;
+  if (!forwardRefs.empty()) {
+    emitError() << "use of undefined value " << forwardRefs.begin()->first;
+    op->destroy();
+    return nullptr;
+  }
+  if (ptr != end) {
+    emitError() << "unexpected data after the top level operation";
+    op->destroy();
+    return nullptr;
+  }
+  return op;
+}
+
+OwningModuleRef circt::readBinaryIR(llvm::SourceMgr &sourceMgr,
+                                    MLIRContext *context) {
+  auto *buffer = sourceMgr.getMemoryBuffer(sourceMgr.getMainFileID());
+  auto fileLoc = FileLineColLoc::get(buffer->getBufferIdentifier(),
+                                     /*line=*/0, /*column=*/0, context);
+
+  Operation *op = BinaryIRReader(buffer->getBuffer(), fileLoc).read();
+  if (!op)
+    return {};
+  auto module = dyn_cast<ModuleOp>(op);
+  if (!module) {
+    op->emitError("binary IR must hold a module");
+    op->destroy();
+    return {};
+  }
+  if (failed(verify(module))) {
+    module.erase();
+    return {};
+  }
+  return module;
+}
+
+//===----------------------------------------------------------------------===//
+// Translation Registration
+//===----------------------------------------------------------------------===//
+
+void circt::registerBinaryIRTranslations() {
+  static TranslateFromMLIRRegistration toBinary(
+      "emit-binary",
+      [](ModuleOp module, raw_ostream &os) {
+        return writeBinaryIR(module, os);
+      },
+      [](DialectRegistry &registry) {
+        registry.insert<firrtl::FIRRTLDialect, rtl::RTLDialect,
+                        sv::SVDialect>();
+      });
+
+  static TranslateToMLIRRegistration fromBinary(
+      "parse-binary", [](llvm::SourceMgr &sourceMgr, MLIRContext *context) {
+        context->loadDialect<firrtl::FIRRTLDialect, rtl::RTLDialect,
+                             sv::SVDialect>();
+        return readBinaryIR(sourceMgr, context);
+      });
+}
@@ -0,0 +1,882 @@
+//===- ExportCXXSim.cpp - C++ simulation model emitter --------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file emits RTL modules as C++ structs which simulate them, skipping the
+// round trip through Verilog and a Verilog simulator.  Each module becomes:
+//
+//   struct Counter {
+//     uint8_t clock = 0;       // one member per port
+//     ...
+//     void eval();             // settle, then apply clock edges until stable
+//     void evalComb();         // the combinational logic, levelized
+//     bool evalSeq();          // the always blocks, true if a register changed
+//     uint8_t count = 0;       // registers, wires, instances, values
+//     ...
+//   };
+//
+// Every value lives in the smallest native unsigned integer holding it, with
+// the bits above its width kept at zero, so only integers of up to 64 bits are
+// supported.  The always blocks only run on clock edges, and their non-blocking
+// assignments are committed once every block has run.  `sv.ifdef` and
+// `sv.initial` blocks are skipped: in lowered designs they only guard the
+// random initialization and debug output meant for Verilog simulators, and the
+// model starts out with every register at zero.
+//
+//===----------------------------------------------------------------------===//
+
+#include "circt/Translation/ExportCXXSim.h"
+#include "circt/Dialect/RTL/RTLDialect.h"
+#include "circt/Dialect/RTL/RTLOps.h"
+#include "circt/Dialect/SV/SVDialect.h"
+#include "circt/Dialect/SV/SVOps.h"
+#include "mlir/IR/BuiltinOps.h"
+#include "mlir/Support/LogicalResult.h"
+#include "mlir/Translation.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/ADT/TypeSwitch.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace circt;
+using namespace rtl;
+using namespace sv;
+
+/// The support functions shared by all the generated structs.  The signed
+/// operations take the width of their operands to sign extend them.  Division
+/// by zero yields zero, where a Verilog simulator would produce X.
+static const char *prelude = R"(#include <cstdint>
+
+namespace circt_sim {
+inline int64_t sext(uint64_t value, unsigned width) {
+  uint64_t sign = uint64_t(1) << (width - 1);
+  return int64_t((value ^ sign) - sign);
+}
+inline uint64_t divu(uint64_t a, uint64_t b) { return b ? a / b : 0; }
+inline uint64_t modu(uint64_t a, uint64_t b) { return b ? a % b : 0; }
+inline uint64_t divs(uint64_t a, uint64_t b, unsigned width) {
+  int64_t sa = sext(a, width), sb = sext(b, width);
+  if (sb == 0)
+    return 0;
+  if (sb == -1)
+    return uint64_t(0) - uint64_t(sa);
+  return uint64_t(sa / sb);
+}
+inline uint64_t mods(uint64_t a, uint64_t b, unsigned width) {
+  int64_t sa = sext(a, width), sb = sext(b, width);
+  if (sb == 0 || sb == -1)
+    return 0;
+  return uint64_t(sa % sb);
+}
+inline uint64_t shl(uint64_t a, uint64_t b, unsigned width) {
+  return b >= width ? 0 : a << b;
+}
+inline uint64_t shru(uint64_t a, uint64_t b, unsigned width) {
+  return b >= width ? 0 : a >> b;
+}
+inline uint64_t shrs(uint64_t a, uint64_t b, unsigned width) {
+  return uint64_t(sext(a, width) >> (b >= width ? width - 1 : b));
+}
+inline bool parity(uint64_t value) {
+  for (unsigned shift = 32; shift; shift /= 2)
+    value ^= value >> shift;
+  return value & 1;
+}
+} // namespace circt_sim
+)";
+
+/// Return the width of `type` if it is an integer the model can hold in a
+/// native integer, or zero otherwise.
+static unsigned getSimWidth(Type type) {
+  auto intType = type.dyn_cast<IntegerType>();
+  if (!intType || intType.getWidth() == 0 || intType.getWidth() > 64)
+    return 0;
+  return intType.getWidth();
+}
+
+/// Return the C++ type holding an integer of `width` bits.
+static StringRef getCType(unsigned width) {
+  if (width <= 8)
+    return "uint8_t";
+  if (width <= 16)
+    return "uint16_t";
+  if (width <= 32)
+    return "uint32_t";
+  return "uint64_t";
+}
+
+static std::string getLiteral(uint64_t value) {
+  if (value < 10)
+    return std::to_string(value);
+  return "0x" + llvm::utohexstr(value) + "ull";
+}
+
+static std::string getMask(unsigned width) {
+  return getLiteral(width == 64 ? ~uint64_t(0) : (uint64_t(1) << width) - 1);
+}
+
+static LogicalResult checkType(Operation *op, Type type) {
+  if (getSimWidth(type))
+    return success();
+  return op->emitError("has type ")
+         << type
+         << " which the C++ simulation model doesn't support, only integers of "
+            "up to 64 bits are";
+}
+
+namespace {
+/// The identifiers used in one C++ scope.
+class NameTable {
+public:
+  NameTable() {
+    // The keywords which could plausibly be the name of a signal, and the
+    // methods of the generated structs.
+    static const char *const reserved[] = {
+        "and",    "auto",     "bool",     "break",   "case",    "char",
+        "class",  "const",    "default",  "delete",  "do",      "double",
+        "else",   "enum",     "eval",     "evalComb", "evalSeq", "export",
+        "false",  "float",    "for",      "goto",    "if",      "import",
+        "int",    "long",     "module",   "new",     "not",     "operator",
+        "or",     "private",  "public",   "register", "return", "short",
+        "signed", "static",   "struct",   "switch",  "this",    "true",
+        "union",  "unsigned", "void",     "while",   "xor"};
+    for (const char *name : reserved)
+      used.insert(name);
+  }
+
+  /// Return a unique identifier based on `hint`.
+  std::string add(StringRef hint) {
+    std::string name;
+    for (char c : hint)
+      name += llvm::isAlnum(c) ? c : '_';
+    if (name.empty() || llvm::isDigit(name[0]))
+      name = "_" + name;
+    if (used.insert(name).second)
+      return name;
+    for (unsigned i = 0;; ++i) {
+      auto candidate = name + "_" + std::to_string(i);
+      if (used.insert(candidate).second)
+        return candidate;
+    }
+  }
+
+private:
+  llvm::StringSet<> used;
+};
+
+/// What a parent module needs to know about the struct of a module to
+/// instantiate it.
+struct ModuleInfo {
+  std::string structName;
+  SmallVector<std::string, 4> inputNames;
+  SmallVector<std::string, 4> outputNames;
+  /// The struct members, starting out with the ports.
+  NameTable names;
+};
+
+/// This emits the struct simulating one module, and the definitions of its
+/// methods.
+class ModuleEmitter {
+public:
+  ModuleEmitter(RTLModuleOp module, ModuleInfo &info,
+                const llvm::DenseMap<Operation *, ModuleInfo *> &moduleInfos,
+                raw_ostream &os)
+      : module(module), info(info), moduleInfos(moduleInfos), os(os),
+        names(info.names) {}
+
+  LogicalResult emit();
+
+private:
+  LogicalResult prepare();
+  LogicalResult levelize();
+  void getDependencies(Operation *op, SmallVectorImpl<Operation *> &deps);
+
+  std::string getValue(Value value);
+  LogicalResult getExpr(Operation *op, std::string &expr);
+
+  void emitStruct();
+  LogicalResult emitComb();
+  LogicalResult emitSeq();
+  LogicalResult emitStatements(Block *block, unsigned indent);
+
+  RTLModuleOp module;
+  ModuleInfo &info;
+  const llvm::DenseMap<Operation *, ModuleInfo *> &moduleInfos;
+  raw_ostream &os;
+  NameTable names;
+
+  /// The C++ expression of each value.  This is the name of a member for the
+  /// values at the top level of the module, and of a local for those nested in
+  /// always blocks.
+  llvm::DenseMap<Value, std::string> valueNames;
+
+  /// The registers and wires, in the order they are declared.
+  SmallVector<Value, 8> storage;
+  /// The continuous assignments to each register or wire.
+  llvm::DenseMap<Value, SmallVector<Operation *, 1>> connects;
+  /// The local holding the next value of each register assigned by a
+  /// non-blocking assignment.
+  llvm::DenseMap<Value, std::string> nextNames;
+  SmallVector<Value, 8> assignedRegs;
+
+  /// The top level operations which are part of the combinational logic, in
+  /// levelized order.
+  SmallVector<Operation *, 32> combOps;
+  SmallVector<AlwaysOp, 4> alwaysOps;
+  SmallVector<InstanceOp, 4> instances;
+  llvm::DenseMap<Operation *, std::string> instanceNames;
+  /// The member holding the value of each clock at the last evaluation.
+  llvm::DenseMap<Value, std::string> prevNames;
+  SmallVector<Value, 4> clocks;
+};
+} // end anonymous namespace
+
+//===----------------------------------------------------------------------===//
+// Preparation
+//===----------------------------------------------------------------------===//
+
+/// Return true if `op` is evaluated by `evalComb()`.
+static bool isCombNode(Operation *op) {
+  return !isa<AlwaysOp, IfDefOp, InitialOp, RegOp, WireOp, ConstantOp>(op);
+}
+
+LogicalResult ModuleEmitter::prepare() {
+  Block *body = module.getBodyBlock();
+  for (auto arg : body->getArguments())
+    valueNames[arg] = info.inputNames[arg.getArgNumber()];
+
+  for (auto &op : *body) {
+    if (isa<RegOp, WireOp>(op)) {
+      Value result = op.getResult(0);
+      if (failed(checkType(
+              &op, result.getType().cast<InOutType>().getElementType())))
+        return failure();
+      auto name = op.getAttrOfType<StringAttr>("name");
+      valueNames[result] = names.add(name ? name.getValue() : "_");
+      storage.push_back(result);
+      continue;
+    }
+    if (auto connect = dyn_cast<ConnectOp>(op)) {
+      connects[connect.dest()].push_back(&op);
+      continue;
+    }
+    if (auto always = dyn_cast<AlwaysOp>(op))
+      alwaysOps.push_back(always);
+  }
+
+  // Name the results of the other operations.  Those reading a register or
+  // wire, or the output of an instance, refer to it directly.
+  for (auto &op : *body) {
+    if (!isCombNode(&op))
+      continue;
+    if (auto read = dyn_cast<ReadInOutOp>(op)) {
+      auto it = valueNames.find(read.input());
+      if (it == valueNames.end() || !read.input().getDefiningOp() ||
+          !isa<RegOp, WireOp>(read.input().getDefiningOp()))
+        return op.emitError("reads a value which isn't a register or wire, "
+                            "which the C++ simulation model doesn't support");
+      valueNames[read.result()] = it->second;
+      continue;
+    }
+    if (auto instance = dyn_cast<InstanceOp>(op)) {
+      auto *child = instance.getReferencedModule();
+      auto it = moduleInfos.find(child);
+      if (it == moduleInfos.end())
+        return op.emitError("instantiates a module which the C++ simulation "
+                            "model doesn't define");
+      auto instName = names.add(instance.instanceName());
+      instanceNames[&op] = instName;
+      for (auto result : llvm::enumerate(op.getResults()))
+        valueNames[result.value()] =
+            instName + "." + it->second->outputNames[result.index()];
+      instances.push_back(instance);
+      continue;
+    }
+    for (auto result : op.getResults()) {
+      if (failed(checkType(&op, result.getType())))
+        return failure();
+      valueNames[result] = names.add("_" + std::to_string(valueNames.size()));
+    }
+  }
+
+  // Each clock keeps its value at the last evaluation to detect its edges, and
+  // each register assigned in an always block gets a local for its next value.
+  for (auto always : alwaysOps) {
+    for (auto clock : always.clocks()) {
+      if (prevNames.count(clock))
+        continue;
+      auto name = valueNames.lookup(clock);
+      prevNames[clock] = names.add((name.empty() ? "clock" : name) + "_prev");
+      clocks.push_back(clock);
+    }
+    always.walk([&](PAssignOp assign) {
+      auto *reg = assign.dest().getDefiningOp();
+      if (!reg || !isa<RegOp>(reg) || nextNames.count(assign.dest()))
+        return;
+      nextNames[assign.dest()] = names.add(valueNames[assign.dest()] + "_next");
+      assignedRegs.push_back(assign.dest());
+    });
+  }
+
+  return levelize();
+}
+
+void ModuleEmitter::getDependencies(Operation *op,
+                                    SmallVectorImpl<Operation *> &deps) {
+  Block *body = module.getBodyBlock();
+  for (auto operand : op->getOperands()) {
+    auto *def = operand.getDefiningOp();
+    if (def && def->getBlock() == body && isCombNode(def))
+      deps.push_back(def);
+  }
+  // A read of a wire follows the continuous assignments to it.
+  if (auto read = dyn_cast<ReadInOutOp>(op)) {
+    auto it = connects.find(read.input());
+    if (it != connects.end())
+      deps.append(it->second.begin(), it->second.end());
+  }
+}
+
+/// Sort the combinational operations such that each comes after the operations
+/// computing its operands, which is a depth first search of their operands.
+LogicalResult ModuleEmitter::levelize() {
+  enum State { Visiting, Done };
+  llvm::DenseMap<Operation *, State> states;
+
+  struct Entry {
+    Operation *op;
+    SmallVector<Operation *, 4> deps;
+    unsigned next = 0;
+  };
+  SmallVector<Entry, 16> stack;
+
+  for (auto &root : *module.getBodyBlock()) {
+    if (!isCombNode(&root) || states.count(&root))
+      continue;
+    states[&root] = Visiting;
+    stack.push_back({&root, {}});
+    getDependencies(&root, stack.back().deps);
+
+    while (!stack.empty()) {
+      auto &top = stack.back();
+      if (top.next == top.deps.size()) {
+        states[top.op] = Done;
+        combOps.push_back(top.op);
+        stack.pop_back();
+        continue;
+      }
+      auto *dep = top.deps[top.next++];
+      auto it = states.find(dep);
+      if (it != states.end()) {
+        if (it->second == Done)
+          continue;
+        return dep->emitError("is part of a combinational loop, which the "
+                              "C++ simulation model doesn't support");
+      }
+      states[dep] = Visiting;
+      stack.push_back({dep, {}});
+      getDependencies(dep, stack.back().deps);
+    }
+  }
+  return success();
+}
+
+//===----------------------------------------------------------------------===//
+// Expressions
+//===----------------------------------------------------------------------===//
+
+std::string ModuleEmitter::getValue(Value value) {
+  if (auto constant = value.getDefiningOp<ConstantOp>())
+    return getLiteral(constant.value().getZExtValue());
+  return valueNames.lookup(value);
+}
+
+/// Compute the C++ expression for the result of the combinational operation
+/// `op`.
+LogicalResult ModuleEmitter::getExpr(Operation *op, std::string &expr) {
+  if (!isCombinatorial(op) || op->getNumResults() != 1)
+    return op->emitError("isn't supported by the C++ simulation model");
+  for (auto type : op->getOperandTypes())
+    if (failed(checkType(op, type)))
+      return failure();
+  if (failed(checkType(op, op->getResult(0).getType())))
+    return failure();
+
+  unsigned width = getSimWidth(op->getResult(0).getType());
+  auto operand = [&](unsigned i) { return getValue(op->getOperand(i)); };
+  auto operandWidth = [&](unsigned i) {
+    return std::to_string(getSimWidth(op->getOperand(i).getType()));
+  };
+  auto masked = [&](const std::string &value) {
+    return width == 64 ? value : "(" + value + ") & " + getMask(width);
+  };
+  // The operands joined by `separator`, computed in 64 bits.
+  auto join = [&](StringRef separator) {
+    std::string result = "uint64_t(" + operand(0) + ")";
+    for (unsigned i = 1, e = op->getNumOperands(); i != e; ++i)
+      result += separator.str() + operand(i);
+    return result;
+  };
+  auto call = [&](StringRef function, bool passWidth) {
+    std::string result = "circt_sim::" + function.str() + "(" + operand(0) +
+                         ", " + operand(1);
+    if (passWidth)
+      result += ", " + operandWidth(0);
+    return result + ")";
+  };
+
+  return TypeSwitch<Operation *, LogicalResult>(op)
+      .Case<AddOp>([&](auto) {
+        expr = masked(join(" + "));
+        return success();
+      })
+      .Case<SubOp>([&](auto) {
+        expr = masked(join(" - "));
+        return success();
+      })
+      .Case<MulOp>([&](auto) {
+        expr = masked(join(" * "));
+        return success();
+      })
+      .Case<AndOp>([&](auto) {
+        expr = join(" & ");
+        return success();
+      })
+      .Case<OrOp>([&](auto) {
+        expr = join(" | ");
+        return success();
+      })
+      .Case<XorOp>([&](auto) {
+        expr = join(" ^ ");
+        return success();
+      })
+      .Case<DivUOp>([&](auto) {
+        expr = call("divu", false);
+        return success();
+      })
+      .Case<ModUOp>([&](auto) {
+        expr = call("modu", false);
+        return success();
+      })
+      .Case<DivSOp>([&](auto) {
+        expr = masked(call("divs", true));
+        return success();
+      })
+      .Case<ModSOp>([&](auto) {
+        expr = masked(call("mods", true));
+        return success();
+      })
+      .Case<ShlOp>([&](auto) {
+        expr = masked(call("shl", true));
+        return success();
+      })
+      .Case<ShrUOp>([&](auto) {
+        expr = call("shru", true);
+        return success();
+      })
+      .Case<ShrSOp>([&](auto) {
+        expr = masked(call("shrs", true));
+        return success();
+      })
+      .Case<ICmpOp>([&](ICmpOp cmp) {
+        StringRef predicate;
+        bool isSigned = false;
+        switch (cmp.predicate()) {
+        case ICmpPredicate::eq:
+          predicate = "==";
+          break;
+        case ICmpPredicate::ne:
+          predicate = "!=";
+          break;
+        case ICmpPredicate::slt:
+          isSigned = true;
+          LLVM_FALLTHROUGH;
+        case ICmpPredicate::ult:
+          predicate = "<";
+          break;
+        case ICmpPredicate::sle:
+          isSigned = true;
+          LLVM_FALLTHROUGH;
+        case ICmpPredicate::ule:
+          predicate = "<=";
+          break;
+        case ICmpPredicate::sgt:
+          isSigned = true;
+          LLVM_FALLTHROUGH;
+        case ICmpPredicate::ugt:
+          predicate = ">";
+          break;
+        case ICmpPredicate::sge:
+          isSigned = true;
+          LLVM_FALLTHROUGH;
+        case ICmpPredicate::uge:
+          predicate = ">=";
+          break;
+        }
+        auto side = [&](unsigned i) {
+          if (!isSigned)
+            return operand(i);
+          return "circt_sim::sext(" + operand(i) + ", " + operandWidth(0) +
+                 ")";
+        };
+        expr = side(0) + " " + predicate.str() + " " + side(1);
+        return success();
+      })
+      .Case<AndROp>([&](auto) {
+        expr = operand(0) + " == " +
+               getMask(getSimWidth(op->getOperand(0).getType()));
+        return success();
+      })
+      .Case<OrROp>([&](auto) {
+        expr = operand(0) + " != 0";
+        return success();
+      })
+      .Case<XorROp>([&](auto) {
+        expr = "circt_sim::parity(" + operand(0) + ")";
+        return success();
+      })
+      .Case<SExtOp>([&](auto) {
+        expr = masked("uint64_t(circt_sim::sext(" + operand(0) + ", " +
+                      operandWidth(0) + "))");
+        return success();
+      })
+      .Case<ExtractOp>([&](ExtractOp extract) {
+        unsigned lowBit = extract.lowBit();
+        expr = operand(0);
+        if (lowBit)
+          expr = "uint64_t(" + expr + ") >> " + std::to_string(lowBit);
+        // The bits above the extracted ones are only there if it doesn't
+        // extend to the top of the input.
+        if (lowBit + width < getSimWidth(extract.input().getType()))
+          expr = masked(expr);
+        return success();
+      })
+      .Case<ConcatOp>([&](auto) {
+        unsigned shift = width;
+        for (unsigned i = 0, e = op->getNumOperands(); i != e; ++i) {
+          shift -= getSimWidth(op->getOperand(i).getType());
+          if (i)
+            expr += " | ";
+          if (shift)
+            expr += "(uint64_t(" + operand(i) + ") << " +
+                    std::to_string(shift) + ")";
+          else
+            expr += operand(i);
+        }
+        return success();
+      })
+      .Case<MuxOp>([&](auto) {
+        expr = operand(0) + " ? " + operand(1) + " : " + operand(2);
+        return success();
+      })
+      .Default([&](auto) {
+        return op->emitError("isn't supported by the C++ simulation model");
+      });
+}
+
+//===----------------------------------------------------------------------===//
+// Emission
+//===----------------------------------------------------------------------===//
+
+void ModuleEmitter::emitStruct() {
+  SmallVector<ModulePortInfo, 8> ports;
+  getModulePortInfo(module, ports);
+
+  os << "\nstruct " << info.structName << " {\n";
+  os << "  // Ports.\n";
+  for (auto &port : ports) {
+    auto &name = port.isOutput() ? info.outputNames[port.argNum]
+                                 : info.inputNames[port.argNum];
+    os << "  " << getCType(getSimWidth(port.type)) << " " << name
+       << " = 0;\n";
+  }
+
+  os << "\n  /// Settle the combinational logic, then apply clock edges until "
+        "the\n"
+     << "  /// design is stable.\n"
+     << "  void eval() {\n"
+     << "    evalComb();\n"
+     << "    while (evalSeq())\n"
+     << "      evalComb();\n"
+     << "  }\n"
+     << "  void evalComb();\n"
+     << "  bool evalSeq();\n";
+
+  auto emitMember = [&](Type type, StringRef name) {
+    os << "  " << getCType(getSimWidth(type)) << " " << name << " = 0;\n";
+  };
+
+  if (!storage.empty()) {
+    os << "\n  // Registers and wires.\n";
+    for (auto value : storage)
+      emitMember(value.getType().cast<InOutType>().getElementType(),
+                 valueNames[value]);
+  }
+
+  if (!instances.empty()) {
+    os << "\n  // Instances.\n";
+    for (auto instance : instances)
+      os << "  "
+         << moduleInfos.lookup(instance.getReferencedModule())->structName
+         << " " << instanceNames[instance] << ";\n";
+  }
+
+  bool hasValues = false;
+  for (auto *op : combOps) {
+    if (isa<ReadInOutOp, InstanceOp, ConnectOp, OutputOp>(op))
+      continue;
+    if (!hasValues)
+      os << "\n  // Values.\n";
+    hasValues = true;
+    for (auto result : op->getResults())
+      emitMember(result.getType(), valueNames[result]);
+  }
+
+  if (!clocks.empty()) {
+    os << "\n  // The clocks at the last evaluation.\n";
+    for (auto clock : clocks)
+      emitMember(clock.getType(), prevNames[clock]);
+  }
+  os << "};\n";
+}
+
+LogicalResult ModuleEmitter::emitComb() {
+  os << "\ninline void " << info.structName << "::evalComb() {\n";
+  for (auto *op : combOps) {
+    if (isa<ReadInOutOp>(op))
+      continue;
+
+    if (auto connect = dyn_cast<ConnectOp>(op)) {
+      if (!valueNames.count(connect.dest()))
+        return op->emitError("assigns a value which isn't a register or wire, "
+                             "which the C++ simulation model doesn't support");
+      os << "  " << valueNames[connect.dest()] << " = "
+         << getValue(connect.src()) << ";\n";
+      continue;
+    }
+
+    if (auto instance = dyn_cast<InstanceOp>(op)) {
+      auto *child = moduleInfos.lookup(instance.getReferencedModule());
+      auto &instName = instanceNames[op];
+      for (auto operand : llvm::enumerate(instance.inputs()))
+        os << "  " << instName << "." << child->inputNames[operand.index()]
+           << " = " << getValue(operand.value()) << ";\n";
+      os << "  " << instName << ".evalComb();\n";
+      continue;
+    }
+
+    if (auto output = dyn_cast<OutputOp>(op)) {
+      for (auto operand : llvm::enumerate(output.getOperands()))
+        os << "  " << info.outputNames[operand.index()] << " = "
+           << getValue(operand.value()) << ";\n";
+      continue;
+    }
+
+    std::string expr;
+    if (failed(getExpr(op, expr)))
+      return failure();
+    os << "  " << valueNames[op->getResult(0)] << " = " << expr << ";\n";
+  }
+  os << "}\n";
+  return success();
+}
+
+LogicalResult ModuleEmitter::emitStatements(Block *block, unsigned indent) {
+  for (auto &op : *block) {
+    // Simulation-only initialization and debug output, see the top of the
+    // file.
+    if (isa<YieldOp, IfDefOp, InitialOp, ConstantOp>(op))
+      continue;
+
+    if (auto ifOp = dyn_cast<IfOp>(op)) {
+      os.indent(indent) << "if (" << getValue(ifOp.cond()) << ") {\n";
+      if (failed(emitStatements(ifOp.getThenBlock(), indent + 2)))
+        return failure();
+      if (ifOp.hasElse()) {
+        os.indent(indent) << "} else {\n";
+        if (failed(emitStatements(ifOp.getElseBlock(), indent + 2)))
+          return failure();
+      }
+      os.indent(indent) << "}\n";
+      continue;
+    }
+
+    if (auto assign = dyn_cast<PAssignOp>(op)) {
+      auto it = nextNames.find(assign.dest());
+      if (it == nextNames.end())
+        return op.emitError("assigns a value which isn't a register, which "
+                            "the C++ simulation model doesn't support");
+      os.indent(indent) << it->second << " = " << getValue(assign.src())
+                        << ";\n";
+      continue;
+    }
+
+    if (auto read = dyn_cast<ReadInOutOp>(op)) {
+      auto it = valueNames.find(read.input());
+      if (it == valueNames.end())
+        return op.emitError("reads a value which isn't a register or wire, "
+                            "which the C++ simulation model doesn't support");
+      valueNames[read.result()] = it->second;
+      continue;
+    }
+
+    // Values computed within the block are held in locals.
+    std::string expr;
+    if (failed(getExpr(&op, expr)))
+      return failure();
+    Value result = op.getResult(0);
+    auto name = names.add("_" + std::to_string(valueNames.size()));
+    valueNames[result] = name;
+    os.indent(indent) << "const " << getCType(getSimWidth(result.getType()))
+                      << " " << name << " = " << expr << ";\n";
+  }
+  return success();
+}
+
+LogicalResult ModuleEmitter::emitSeq() {
+  os << "\ninline bool " << info.structName << "::evalSeq() {\n";
+  auto changed = names.add("changed");
+  os << "  bool " << changed << " = false;\n";
+  for (auto instance : instances)
+    os << "  " << changed << " |= " << instanceNames[instance]
+       << ".evalSeq();\n";
+
+  // Decide which always blocks fire before updating the clocks, as several
+  // blocks may be sensitive to the same one.
+  SmallVector<std::string, 4> fireNames;
+  for (auto always : alwaysOps) {
+    fireNames.push_back(names.add("fire"));
+    os << "  const bool " << fireNames.back() << " = ";
+    for (size_t i = 0, e = always.getNumConditions(); i != e; ++i) {
+      auto condition = always.getCondition(i);
+      auto clock = getValue(condition.value);
+      auto &prev = prevNames[condition.value];
+      if (i)
+        os << " || ";
+      switch (condition.event) {
+      case EventControl::AtPosEdge:
+        os << "(" << clock << " && !" << prev << ")";
+        break;
+      case EventControl::AtNegEdge:
+        os << "(!" << clock << " && " << prev << ")";
+        break;
+      case EventControl::AtEdge:
+        os << "(" << clock << " != " << prev << ")";
+        break;
+      }
+    }
+    os << ";\n";
+  }
+  for (auto clock : clocks)
+    os << "  " << prevNames[clock] << " = " << getValue(clock) << ";\n";
+
+  // The non-blocking assignments of all blocks see the registers as they were
+  // before any of them ran.
+  for (auto reg : assignedRegs) {
+    auto type = reg.getType().cast<InOutType>().getElementType();
+    os << "  " << getCType(getSimWidth(type)) << " " << nextNames[reg] << " = "
+       << valueNames[reg] << ";\n";
+  }
+
+  for (auto always : llvm::enumerate(alwaysOps)) {
+    os << "  if (" << fireNames[always.index()] << ") {\n";
+    if (failed(emitStatements(always.value().getBodyBlock(), 4)))
+      return failure();
+    os << "  }\n";
+  }
+
+  for (auto reg : assignedRegs) {
+    auto &name = valueNames[reg];
+    os << "  if (" << nextNames[reg] << " != " << name << ") {\n"
+       << "    " << name << " = " << nextNames[reg] << ";\n"
+       << "    " << changed << " = true;\n"
+       << "  }\n";
+  }
+  os << "  return " << changed << ";\n}\n";
+  return success();
+}
+
+LogicalResult ModuleEmitter::emit() {
+  if (failed(prepare()))
+    return failure();
+  emitStruct();
+  if (failed(emitComb()) || failed(emitSeq()))
+    return failure();
+  return success();
+}
+
+//===----------------------------------------------------------------------===//
+// Entry Points
+//===----------------------------------------------------------------------===//
+
+LogicalResult circt::exportCXXSim(ModuleOp module, raw_ostream &os) {
+  // Name the structs and their ports up front, so that modules can refer to
+  // those they instantiate.
+  SmallVector<std::unique_ptr<ModuleInfo>, 8> infos;
+  llvm::DenseMap<Operation *, ModuleInfo *> moduleInfos;
+  NameTable structNames;
+  for (auto rtlModule : module.getOps<RTLModuleOp>()) {
+    infos.push_back(std::make_unique<ModuleInfo>());
+    auto &info = *infos.back();
+    moduleInfos[rtlModule] = &info;
+    info.structName = structNames.add(rtlModule.getName());
+
+    SmallVector<ModulePortInfo, 8> ports;
+    getModulePortInfo(rtlModule, ports);
+    auto type = getModuleType(rtlModule);
+    info.inputNames.resize(type.getNumInputs());
+    info.outputNames.resize(type.getNumResults());
+    for (auto &port : ports) {
+      if (failed(checkType(rtlModule, port.type)))
+        return failure();
+      auto name = info.names.add(port.getName());
+      if (port.isOutput())
+        info.outputNames[port.argNum] = name;
+      else
+        info.inputNames[port.argNum] = name;
+    }
+  }
+
+  // Emit the modules after those they instantiate, which C++ needs to know the
+  // size of the instance members.
+  llvm::DenseMap<Operation *, bool> emitted;
+  std::function<LogicalResult(RTLModuleOp)> emitModule =
+      [&](RTLModuleOp rtlModule) -> LogicalResult {
+    auto it = emitted.try_emplace(rtlModule, false);
+    if (!it.second) {
+      if (it.first->second)
+        return success();
+      return rtlModule.emitError("instantiates itself");
+    }
+    for (auto instance : rtlModule.getBodyBlock()->getOps<InstanceOp>())
+      if (auto child =
+              dyn_cast_or_null<RTLModuleOp>(instance.getReferencedModule()))
+        if (failed(emitModule(child)))
+          return failure();
+    emitted[rtlModule] = true;
+    return ModuleEmitter(rtlModule, *moduleInfos[rtlModule], moduleInfos, os)
+        .emit();
+  };
+
+  os << "// Generated by circt-translate -emit-cxx-sim.\n\n" << prelude;
+  for (auto rtlModule : module.getOps<RTLModuleOp>())
+    if (failed(emitModule(rtlModule)))
+      return failure();
+  return success();
+}
+
+void circt::registerToCXXSimTranslation() {
+  TranslateFromMLIRRegistration toCXXSim(
+      "emit-cxx-sim",
+      [](ModuleOp module, raw_ostream &os) {
+        return exportCXXSim(module, os);
+      },
+      [](DialectRegistry &registry) {
+        registry.insert<RTLDialect, SVDialect>();
+      });
+}
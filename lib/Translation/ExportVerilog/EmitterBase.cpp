@@ -0,0 +1,36 @@
+//===- EmitterBase.cpp - Shared Verilog emitter helpers -------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This implements the helpers shared by the RTL and FIRRTL Verilog emitters
+// that don't live in the header.
+//
+//===----------------------------------------------------------------------===//
+
+#include "ExportVerilogInternals.h"
+
+using namespace circt;
+using namespace ExportVerilog;
+
+unsigned ExportVerilog::getPrintedIntWidth(unsigned value) {
+  // Fast path the common case.
+  if (value < 10)
+    return 1;
+  if (value < 100)
+    return 2;
+  if (value < 1000)
+    return 3;
+
+  // Compute the size in the general case.
+  unsigned size = 4;
+  value /= 1000;
+  while (value >= 10) {
+    ++size;
+    value /= 10;
+  }
+  return size;
+}
@@ -11,6 +11,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "circt/Translation/ExportVerilog.h"
+#include "ExportVerilogInternals.h"
 #include "circt/Dialect/RTL/RTLOps.h"
 #include "circt/Dialect/RTL/RTLTypes.h"
 #include "circt/Dialect/RTL/RTLVisitors.h"
@@ -18,27 +19,24 @@
 #include "circt/Dialect/SV/SVVisitors.h"
 #include "circt/Support/LLVM.h"
 #include "mlir/IR/BuiltinOps.h"
+#include "mlir/Support/FileUtilities.h"
 #include "mlir/Translation.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/StringSet.h"
 #include "llvm/ADT/TypeSwitch.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Parallel.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/ToolOutputFile.h"
 #include "llvm/Support/raw_ostream.h"
 
 using namespace circt;
 using namespace mlir;
 using namespace rtl;
 using namespace sv;
-
-/// Should we emit wire decls in a block at the top of a module, or inline?
-static constexpr bool emitInlineWireDecls = true;
-
-/// This is the preferred source width for the generated Verilog.
-static constexpr size_t preferredSourceWidth = 120;
-
-/// This is a set accessed through getReservedWords() that contains all of the
-/// Verilog names and other identifiers we need to avoid because of name
-/// conflicts.
-static llvm::ManagedStatic<StringSet<>> reservedWordCache;
+using namespace ExportVerilog;
 
 //===----------------------------------------------------------------------===//
 // Helper routines
@@ -70,27 +68,6 @@ static int getBitWidthOrSentinel(Type type) {
       .Default([](Type) { return -1; });
 }
 
-/// Given an integer value, return the number of characters it will take to
-/// print its base-10 value.
-static unsigned getPrintedIntWidth(unsigned value) {
-  // Fast path the common case.
-  if (value < 10)
-    return 1;
-  if (value < 100)
-    return 2;
-  if (value < 1000)
-    return 3;
-
-  // Compute the size in the general case.
-  unsigned size = 4;
-  value /= 1000;
-  while (value >= 10) {
-    ++size;
-    value /= 10;
-  }
-  return size;
-}
-
 /// Emit a type's packed dimensions, returning the number of characters
 /// emitted.
 static size_t emitTypeDims(Type type, Location loc, raw_ostream &os) {
@@ -167,125 +144,30 @@ static bool isNoopCast(Operation *op) {
   return false;
 }
 
-namespace {
-/// This enum keeps track of the precedence level of various binary operators,
-/// where a lower number binds tighter.
-enum VerilogPrecedence {
-  // Normal precedence levels.
-  Symbol,          // Atomic symbol like "foo"
-  Unary,           // Unary operators like ~foo
-  Multiply,        // * , / , %
-  Addition,        // + , -
-  Shift,           // << , >>
-  Comparison,      // > , >= , < , <=
-  Equality,        // == , !=
-  And,             // &
-  Xor,             // ^ , ^~
-  Or,              // |
-  AndShortCircuit, // &&
-  Conditional,     // ? :
-
-  LowestPrecedence,  // Sentinel which is always the lowest precedence.
-  ForceEmitMultiUse, // Sentinel saying to recursively emit a multi-used expr.
-};
-} // end anonymous namespace
-
-/// Return a StringSet that contains all of the reserved names (e.g. Verilog
-/// keywords) that we need to avoid for fear of name conflicts.
-static const StringSet<> &getReservedWords() {
-  auto &set = *reservedWordCache;
-  if (set.empty()) {
-    static const char *const reservedWords[] = {
-#include "ReservedWords.def"
-    };
-    for (auto *word : reservedWords)
-      set.insert(word);
-  }
-  return set;
-}
-
-//===----------------------------------------------------------------------===//
-// VerilogEmitter
-//===----------------------------------------------------------------------===//
-
-namespace {
-/// This class maintains the mutable state that cross-cuts and is shared by the
-/// various emitters.
-class VerilogEmitterState {
-public:
-  explicit VerilogEmitterState(raw_ostream &os) : os(os) {}
-
-  /// The stream to emit to.
-  raw_ostream &os;
-
-  bool encounteredError = false;
-  unsigned currentIndent = 0;
-
-private:
-  VerilogEmitterState(const VerilogEmitterState &) = delete;
-  void operator=(const VerilogEmitterState &) = delete;
-};
-} // namespace
-
-namespace {
-
-/// This is the base class for all of the Verilog Emitter components.
-class VerilogEmitterBase {
-public:
-  explicit VerilogEmitterBase(VerilogEmitterState &state)
-      : state(state), os(state.os) {}
-
-  InFlightDiagnostic emitError(Operation *op, const Twine &message) {
-    state.encounteredError = true;
-    return op->emitError(message);
-  }
-
-  InFlightDiagnostic emitOpError(Operation *op, const Twine &message) {
-    state.encounteredError = true;
-    return op->emitOpError(message);
-  }
-
-  raw_ostream &indent() { return os.indent(state.currentIndent); }
-
-  void addIndent() { state.currentIndent += 2; }
-  void reduceIndent() { state.currentIndent -= 2; }
-
-  // All of the mutable state we are maintaining.
-  VerilogEmitterState &state;
-
-  /// The stream to emit to.
-  raw_ostream &os;
-
-private:
-  VerilogEmitterBase(const VerilogEmitterBase &) = delete;
-  void operator=(const VerilogEmitterBase &) = delete;
-};
-
-} // end anonymous namespace
-
 //===----------------------------------------------------------------------===//
 // ModuleEmitter
 //===----------------------------------------------------------------------===//
 
 namespace {
 
-class ModuleEmitter : public VerilogEmitterBase,
+/// The operations that a single emitted line of Verilog came from.  This is
+/// only used to print the location comment at the end of the line, so it is a
+/// plain list: duplicates are fine since the locations are uniqued when they
+/// are printed.
+using OpLocList = SmallVector<Operation *, 8>;
+
+class ModuleEmitter : public ModuleEmitterBase,
                       public rtl::StmtVisitor<ModuleEmitter, LogicalResult>,
                       public sv::Visitor<ModuleEmitter, LogicalResult> {
 
 public:
   explicit ModuleEmitter(VerilogEmitterState &state)
-      : VerilogEmitterBase(state) {}
+      : ModuleEmitterBase(state) {}
 
   void emitRTLModule(RTLModuleOp module);
   void emitRTLExternModule(RTLExternModuleOp module);
-  void emitExpression(Value exp, SmallPtrSet<Operation *, 8> &emittedExprs,
-                      bool forceRootExpr = false);
-
-  /// Emit the specified expression and return it as a string.
-  std::string
-  emitExpressionToString(Value exp, SmallPtrSet<Operation *, 8> &emittedExprs,
-                         VerilogPrecedence precedence = LowestPrecedence);
+  void emitExpression(Value exp, OpLocList &emittedExprs,
+                      VerilogPrecedence precedence = LowestPrecedence);
 
   // Statements.
   void emitStatementExpression(Operation *op);
@@ -326,218 +208,20 @@ public:
   void emitOperation(Operation *op);
 
   void collectNamesEmitDecls(Block &block);
-  StringRef addName(Value value, StringRef name);
-  StringRef addName(Value value, StringAttr nameAttr) {
-    return addName(value, nameAttr ? nameAttr.getValue() : "");
-  }
-
-  StringRef getName(Value value) {
-    auto *entry = nameTable[value];
-    assert(entry && "value expected a name but doesn't have one");
-    return entry->getKey();
-  }
-
-  /// Return the location information as a (potentially empty) string.
-  std::string getLocationInfoAsString(const SmallPtrSet<Operation *, 8> &ops);
+  unsigned getInlineExpressionSize(Operation *op);
 
-  /// If we have location information for any of the specified operations,
-  /// aggregate it together and print a pretty comment specifying where the
-  /// operations came from.  In any case, print a newline.
-  void emitLocationInfoAndNewLine(const SmallPtrSet<Operation *, 8> &ops);
+  /// The number of operations printed by each expression when it is emitted
+  /// inline, see getInlineExpressionSize.
+  DenseMap<Operation *, unsigned> inlineExpressionSizes;
 
-  llvm::StringSet<> usedNames;
-  llvm::DenseMap<Value, llvm::StringMapEntry<llvm::NoneType> *> nameTable;
-  size_t nextGeneratedNameID = 0;
-
-  /// This set keeps track of all of the expression nodes that need to be
-  /// emitted as standalone wire declarations.  This can happen because they are
-  /// multiply-used or because the user requires a name to reference.
-  SmallPtrSet<Operation *, 16> outOfLineExpressions;
+  /// The buffer that expressions are built up in before they are printed.  It
+  /// is reused for every expression in the module, so that emitting an
+  /// expression does not allocate once the buffer has grown.
+  SmallString<256> exprBuffer;
 };
 
 } // end anonymous namespace
 
-/// Add the specified name to the name table, auto-uniquing the name if
-/// required.  If the name is empty, then this creates a unique temp name.
-StringRef ModuleEmitter::addName(Value value, StringRef name) {
-  if (name.empty())
-    name = "_T";
-
-  // Check to see if this name is valid.  The first character cannot be a
-  // number of other weird thing.  If it is, start with an underscore.
-  if (!isalpha(name.front()) && name.front() != '_') {
-    SmallString<16> tmpName("_");
-    tmpName += name;
-    return addName(value, tmpName);
-  }
-
-  auto isValidVerilogCharacter = [](char ch) -> bool {
-    return isalpha(ch) || isdigit(ch) || ch == '_';
-  };
-
-  // Check to see if the name consists of all-valid identifiers.  If not, we
-  // need to escape them.
-  for (char ch : name) {
-    if (isValidVerilogCharacter(ch))
-      continue;
-
-    // Otherwise, we need to escape it.
-    SmallString<16> tmpName;
-    for (char ch : name) {
-      if (isValidVerilogCharacter(ch))
-        tmpName += ch;
-      else if (ch == ' ')
-        tmpName += '_';
-      else {
-        tmpName += llvm::utohexstr((unsigned char)ch);
-      }
-    }
-    return addName(value, tmpName);
-  }
-
-  // Get the list of reserved words we need to avoid.  We could prepopulate this
-  // into the used words cache, but it is large and immutable, so we just query
-  // it when needed.
-  auto &reservedWords = getReservedWords();
-
-  // Check to see if this name is available - if so, use it.
-  if (!reservedWords.count(name)) {
-    auto insertResult = usedNames.insert(name);
-    if (insertResult.second) {
-      nameTable[value] = &*insertResult.first;
-      return insertResult.first->getKey();
-    }
-  }
-
-  // If not, we need to auto-unique it.
-  SmallVector<char, 16> nameBuffer(name.begin(), name.end());
-  nameBuffer.push_back('_');
-  auto baseSize = nameBuffer.size();
-
-  // Try until we find something that works.
-  while (1) {
-    auto suffix = llvm::utostr(nextGeneratedNameID++);
-    nameBuffer.append(suffix.begin(), suffix.end());
-    name = StringRef(nameBuffer.data(), nameBuffer.size());
-
-    if (!reservedWords.count(name)) {
-      auto insertResult = usedNames.insert(name);
-      if (insertResult.second) {
-        nameTable[value] = &*insertResult.first;
-        return insertResult.first->getKey();
-      }
-    }
-
-    // Chop off the suffix and try again.
-    nameBuffer.resize(baseSize);
-  }
-}
-
-/// Return the location information as a (potentially empty) string.
-std::string
-ModuleEmitter::getLocationInfoAsString(const SmallPtrSet<Operation *, 8> &ops) {
-  std::string resultStr;
-  llvm::raw_string_ostream sstr(resultStr);
-
-  // Multiple operations may come from the same location or may not have useful
-  // location info.  Unique it now.
-  SmallPtrSet<Attribute, 8> locations;
-  for (auto *op : ops) {
-    if (auto loc = op->getLoc().dyn_cast<FileLineColLoc>())
-      locations.insert(loc);
-  }
-
-  auto printLoc = [&](FileLineColLoc loc) {
-    sstr << loc.getFilename();
-    if (auto line = loc.getLine()) {
-      sstr << ':' << line;
-      if (auto col = loc.getColumn())
-        sstr << ':' << col;
-    }
-  };
-
-  switch (locations.size()) {
-  case 1:
-    printLoc((*locations.begin()).cast<FileLineColLoc>());
-    LLVM_FALLTHROUGH;
-  case 0:
-    return sstr.str();
-  default:
-    break;
-  }
-
-  // Sort the entries.
-  SmallVector<FileLineColLoc, 8> locVector;
-  locVector.reserve(locations.size());
-  for (auto loc : locations)
-    locVector.push_back(loc.cast<FileLineColLoc>());
-
-  llvm::array_pod_sort(
-      locVector.begin(), locVector.end(),
-      [](const FileLineColLoc *lhs, const FileLineColLoc *rhs) -> int {
-        if (auto fn = lhs->getFilename().compare(rhs->getFilename()))
-          return fn;
-        if (lhs->getLine() != rhs->getLine())
-          return lhs->getLine() < rhs->getLine() ? -1 : 1;
-        return lhs->getColumn() < rhs->getColumn() ? -1 : 1;
-      });
-
-  // The entries are sorted by filename, line, col.  Try to merge together
-  // entries to reduce verbosity on the column info.
-  StringRef lastFileName;
-  for (size_t i = 0, e = locVector.size(); i != e;) {
-    if (i != 0)
-      sstr << ", ";
-
-    // Print the filename if it changed.
-    auto first = locVector[i];
-    if (first.getFilename() != lastFileName) {
-      lastFileName = first.getFilename();
-      sstr << lastFileName;
-    }
-
-    // Scan for entires with the same file/line.
-    size_t end = i + 1;
-    while (end != e && first.getFilename() == locVector[end].getFilename() &&
-           first.getLine() == locVector[end].getLine())
-      ++end;
-
-    // If we have one entry, print it normally.
-    if (end == i + 1) {
-      if (auto line = first.getLine()) {
-        sstr << ':' << line;
-        if (auto col = first.getColumn())
-          sstr << ':' << col;
-      }
-      ++i;
-      continue;
-    }
-
-    // Otherwise print a brace enclosed list.
-    sstr << ':' << first.getLine() << ":{";
-    while (i != end) {
-      sstr << locVector[i++].getColumn();
-
-      if (i != end)
-        sstr << ',';
-    }
-    sstr << '}';
-  }
-
-  return sstr.str();
-}
-
-/// If we have location information for any of the specified operations,
-/// aggregate it together and print a pretty comment specifying where the
-/// operations came from.  In any case, print a newline.
-void ModuleEmitter::emitLocationInfoAndNewLine(
-    const SmallPtrSet<Operation *, 8> &ops) {
-  auto locInfo = getLocationInfoAsString(ops);
-  if (!locInfo.empty())
-    os << "\t// " << locInfo;
-  os << '\n';
-}
-
 //===----------------------------------------------------------------------===//
 // Expression Emission
 //===----------------------------------------------------------------------===//
@@ -571,19 +255,19 @@ namespace {
 /// constraints that depend on the behavior of the child nodes.  To handle this,
 /// we emit the characters to a SmallVector which allows us to emit a bunch of
 /// stuff, then pre-insert parentheses and other things if we find out that it
-/// was needed later.
+/// was needed later.  The SmallVector is the module emitter's expression
+/// buffer, so it is only allocated once per module.
 class ExprEmitter : public CombinatorialVisitor<ExprEmitter, SubExprInfo>,
                     public Visitor<ExprEmitter, SubExprInfo> {
 public:
   /// Create an ExprEmitter for the specified module emitter, and keeping track
-  /// of any emitted expressions in the specified set.
-  ExprEmitter(ModuleEmitter &emitter, SmallPtrSet<Operation *, 8> &emittedExprs)
-      : emitter(emitter), emittedExprs(emittedExprs), os(resultBuffer) {}
+  /// of any emitted expressions in the specified list.
+  ExprEmitter(ModuleEmitter &emitter, OpLocList &emittedExprs)
+      : emitter(emitter), emittedExprs(emittedExprs),
+        resultBuffer(emitter.exprBuffer), os(resultBuffer) {}
 
-  void emitExpression(Value exp, bool forceRootExpr, raw_ostream &os);
-
-  /// Emit the specified expression and return it as a string.
-  std::string emitExpressionToString(Value exp, VerilogPrecedence precedence);
+  void emitExpression(Value exp, VerilogPrecedence precedence,
+                      raw_ostream &outOS);
 
   /// Do a best-effort job of looking through noop cast operations.
   Value lookThroughNoopCasts(Value value) {
@@ -696,31 +380,27 @@ private:
   /// it without a correctness problem.
   SubExprSignRequirement signPreference = NoRequirement;
 
-  SmallPtrSet<Operation *, 8> &emittedExprs;
-  SmallString<128> resultBuffer;
+  OpLocList &emittedExprs;
+  SmallVectorImpl<char> &resultBuffer;
   llvm::raw_svector_ostream os;
 };
 } // end anonymous namespace
 
 /// Emit the specified value as an expression.  If this is an inline-emitted
 /// expression, we emit that expression, otherwise we emit a reference to the
-/// already computed name.  If 'forceRootExpr' is true, then this emits an
-/// expression even if we typically don't do it inline.
+/// already computed name.  If 'precedence' is ForceEmitMultiUse, then this
+/// emits an expression even if we typically don't do it inline.
 ///
-void ExprEmitter::emitExpression(Value exp, bool forceRootExpr,
-                                 raw_ostream &os) {
-  // Emit the expression.
-  emitSubExpr(exp, forceRootExpr ? ForceEmitMultiUse : LowestPrecedence);
+void ExprEmitter::emitExpression(Value exp, VerilogPrecedence precedence,
+                                 raw_ostream &outOS) {
+  // Emit the expression after anything already in the shared buffer.
+  size_t bufferStart = resultBuffer.size();
+  emitSubExpr(exp, precedence);
 
   // Once the expression is done, we can emit the result to the stream.
-  os << resultBuffer;
-}
-
-/// Emit the specified expression and return it as a string.
-std::string ExprEmitter::emitExpressionToString(Value exp,
-                                                VerilogPrecedence precedence) {
-  emitSubExpr(exp, precedence);
-  return std::string(resultBuffer.begin(), resultBuffer.end());
+  outOS << StringRef(resultBuffer.data() + bufferStart,
+                     resultBuffer.size() - bufferStart);
+  resultBuffer.resize(bufferStart);
 }
 
 SubExprInfo ExprEmitter::emitBinary(Operation *op, VerilogPrecedence prec,
@@ -832,7 +512,7 @@ SubExprInfo ExprEmitter::emitSubExpr(Value exp,
   }
 
   // Remember that we emitted this.
-  emittedExprs.insert(exp.getDefiningOp());
+  emittedExprs.push_back(exp.getDefiningOp());
   return expInfo;
 }
 
@@ -925,12 +605,12 @@ SubExprInfo ExprEmitter::visitComb(ExtractOp op) {
 }
 
 SubExprInfo ExprEmitter::visitSV(GetModportOp op) {
-  os << emitter.getName(op.iface()) + "." + op.field();
+  os << emitter.getName(op.iface()) << '.' << op.field();
   return {Unary, IsUnsigned};
 }
 
 SubExprInfo ExprEmitter::visitSV(ReadInterfaceSignalOp op) {
-  os << emitter.getName(op.iface()) + "." + op.signalName();
+  os << emitter.getName(op.iface()) << '.' << op.signalName();
   return {Unary, IsUnsigned};
 }
 
@@ -1016,22 +696,12 @@ SubExprInfo ExprEmitter::visitUnhandledExpr(Operation *op) {
 
 /// Emit the specified value as an expression.  If this is an inline-emitted
 /// expression, we emit that expression, otherwise we emit a reference to the
-/// already computed name.  If 'forceRootExpr' is true, then this emits an
-/// expression even if we typically don't do it inline.
+/// already computed name.  If 'precedence' is ForceEmitMultiUse, then this
+/// emits an expression even if we typically don't do it inline.
 ///
-void ModuleEmitter::emitExpression(Value exp,
-                                   SmallPtrSet<Operation *, 8> &emittedExprs,
-                                   bool forceRootExpr) {
-  ExprEmitter(*this, emittedExprs).emitExpression(exp, forceRootExpr, os);
-}
-
-/// Emit the specified expression and return it as a string.
-std::string
-ModuleEmitter::emitExpressionToString(Value exp,
-                                      SmallPtrSet<Operation *, 8> &emittedExprs,
-                                      VerilogPrecedence precedence) {
-  return ExprEmitter(*this, emittedExprs)
-      .emitExpressionToString(exp, precedence);
+void ModuleEmitter::emitExpression(Value exp, OpLocList &emittedExprs,
+                                   VerilogPrecedence precedence) {
+  ExprEmitter(*this, emittedExprs).emitExpression(exp, precedence, os);
 }
 
 void ModuleEmitter::emitStatementExpression(Operation *op) {
@@ -1048,21 +718,23 @@ void ModuleEmitter::emitStatementExpression(Operation *op) {
   } else {
     indent() << "assign " << getName(op->getResult(0)) << " = ";
   }
-  SmallPtrSet<Operation *, 8> emittedExprs;
-  emitExpression(op->getResult(0), emittedExprs, /*forceRootExpr=*/true);
+  // The statement's own location comes first, it is the primary one.
+  OpLocList emittedExprs;
+  emittedExprs.push_back(op);
+  emitExpression(op->getResult(0), emittedExprs, ForceEmitMultiUse);
   os << ';';
   emitLocationInfoAndNewLine(emittedExprs);
 }
 
 void ModuleEmitter::visitMerge(MergeOp op) {
-  SmallPtrSet<Operation *, 8> ops;
+  OpLocList ops;
 
   // Emit "a = rtl.merge x, y, z" as:
   //   assign a = x;
   //   assign a = y;
   //   assign a = z;
   for (auto operand : op.getOperands()) {
-    ops.insert(op);
+    ops.push_back(op);
     indent() << "assign " << getName(op) << " = ";
     emitExpression(operand, ops);
     os << ';';
@@ -1072,8 +744,8 @@ void ModuleEmitter::visitMerge(MergeOp op) {
 }
 
 LogicalResult ModuleEmitter::visitStmt(ConnectOp op) {
-  SmallPtrSet<Operation *, 8> ops;
-  ops.insert(op);
+  OpLocList ops;
+  ops.push_back(op);
 
   indent() << "assign ";
   emitExpression(op.dest(), ops);
@@ -1085,8 +757,8 @@ LogicalResult ModuleEmitter::visitStmt(ConnectOp op) {
 }
 
 LogicalResult ModuleEmitter::visitSV(BPAssignOp op) {
-  SmallPtrSet<Operation *, 8> ops;
-  ops.insert(op);
+  OpLocList ops;
+  ops.push_back(op);
 
   indent();
   emitExpression(op.dest(), ops);
@@ -1098,8 +770,8 @@ LogicalResult ModuleEmitter::visitSV(BPAssignOp op) {
 }
 
 LogicalResult ModuleEmitter::visitSV(PAssignOp op) {
-  SmallPtrSet<Operation *, 8> ops;
-  ops.insert(op);
+  OpLocList ops;
+  ops.push_back(op);
 
   indent();
   emitExpression(op.dest(), ops);
@@ -1111,8 +783,8 @@ LogicalResult ModuleEmitter::visitSV(PAssignOp op) {
 }
 
 LogicalResult ModuleEmitter::visitSV(AliasOp op) {
-  SmallPtrSet<Operation *, 8> ops;
-  ops.insert(op);
+  OpLocList ops;
+  ops.push_back(op);
 
   indent() << "alias ";
   llvm::interleave(
@@ -1125,7 +797,7 @@ LogicalResult ModuleEmitter::visitSV(AliasOp op) {
 /// For OutputOp we put "assign" statements at the end of the Verilog module to
 /// assign the module outputs to intermediate wires.
 LogicalResult ModuleEmitter::visitStmt(OutputOp op) {
-  SmallPtrSet<Operation *, 8> ops;
+  OpLocList ops;
 
   SmallVector<ModulePortInfo, 8> ports;
   RTLModuleOp parent = op->getParentOfType<RTLModuleOp>();
@@ -1135,7 +807,7 @@ LogicalResult ModuleEmitter::visitStmt(OutputOp op) {
     if (!port.isOutput())
       continue;
     ops.clear();
-    ops.insert(op);
+    ops.push_back(op);
     indent();
     if (isZeroBitType(port.type))
       os << "// Zero width: ";
@@ -1149,15 +821,16 @@ LogicalResult ModuleEmitter::visitStmt(OutputOp op) {
 }
 
 LogicalResult ModuleEmitter::visitSV(FWriteOp op) {
-  SmallPtrSet<Operation *, 8> ops;
-  ops.insert(op);
+  OpLocList ops;
+  ops.push_back(op);
 
   indent() << "$fwrite(32'h80000002, \"";
   os.write_escaped(op.string());
   os << '"';
 
   for (auto operand : op.operands()) {
-    os << ", " << emitExpressionToString(operand, ops);
+    os << ", ";
+    emitExpression(operand, ops);
   }
   os << ");";
   emitLocationInfoAndNewLine(ops);
@@ -1165,16 +838,16 @@ LogicalResult ModuleEmitter::visitSV(FWriteOp op) {
 }
 
 LogicalResult ModuleEmitter::visitSV(FatalOp op) {
-  SmallPtrSet<Operation *, 8> ops;
-  ops.insert(op);
+  OpLocList ops;
+  ops.push_back(op);
   indent() << "$fatal;";
   emitLocationInfoAndNewLine(ops);
   return success();
 }
 
 LogicalResult ModuleEmitter::visitSV(VerbatimOp op) {
-  SmallPtrSet<Operation *, 8> ops;
-  ops.insert(op);
+  OpLocList ops;
+  ops.push_back(op);
 
   // Drop an extraneous \n off the end of the string if present.
   StringRef string = op.string();
@@ -1245,7 +918,7 @@ LogicalResult ModuleEmitter::visitSV(VerbatimOp op) {
         os << line.take_front(start - 2);
 
         // Emit the operand.
-        os << emitExpressionToString(op.operands()[operandNo], ops);
+        emitExpression(op.operands()[operandNo], ops);
 
         // Forget about the part we emitted.
         line = line.drop_front(next);
@@ -1267,33 +940,39 @@ LogicalResult ModuleEmitter::visitSV(VerbatimOp op) {
 }
 
 LogicalResult ModuleEmitter::visitSV(FinishOp op) {
-  SmallPtrSet<Operation *, 8> ops;
-  ops.insert(op);
+  OpLocList ops;
+  ops.push_back(op);
   indent() << "$finish;";
   emitLocationInfoAndNewLine(ops);
   return success();
 }
 
 LogicalResult ModuleEmitter::visitSV(AssertOp op) {
-  SmallPtrSet<Operation *, 8> ops;
-  ops.insert(op);
-  indent() << "assert(" << emitExpressionToString(op.predicate(), ops) << ");";
+  OpLocList ops;
+  ops.push_back(op);
+  indent() << "assert(";
+  emitExpression(op.predicate(), ops);
+  os << ");";
   emitLocationInfoAndNewLine(ops);
   return success();
 }
 
 LogicalResult ModuleEmitter::visitSV(AssumeOp op) {
-  SmallPtrSet<Operation *, 8> ops;
-  ops.insert(op);
-  indent() << "assume(" << emitExpressionToString(op.property(), ops) << ");";
+  OpLocList ops;
+  ops.push_back(op);
+  indent() << "assume(";
+  emitExpression(op.property(), ops);
+  os << ");";
   emitLocationInfoAndNewLine(ops);
   return success();
 }
 
 LogicalResult ModuleEmitter::visitSV(CoverOp op) {
-  SmallPtrSet<Operation *, 8> ops;
-  ops.insert(op);
-  indent() << "cover(" << emitExpressionToString(op.property(), ops) << ");";
+  OpLocList ops;
+  ops.push_back(op);
+  indent() << "cover(";
+  emitExpression(op.property(), ops);
+  os << ");";
   emitLocationInfoAndNewLine(ops);
   return success();
 }
@@ -1306,8 +985,8 @@ LogicalResult ModuleEmitter::visitSV(IfDefOp op) {
   else
     indent() << "`ifdef " << cond;
 
-  SmallPtrSet<Operation *, 8> ops;
-  ops.insert(op);
+  OpLocList ops;
+  ops.push_back(op);
   emitLocationInfoAndNewLine(ops);
 
   addIndent();
@@ -1332,7 +1011,7 @@ LogicalResult ModuleEmitter::visitSV(IfDefOp op) {
 /// if multiLineComment is non-null, the string is included in a comment after
 /// the 'end' to make it easier to associate.
 static void emitBeginEndRegion(Block *block,
-                               SmallPtrSet<Operation *, 8> &locationOps,
+                               OpLocList &locationOps,
                                ModuleEmitter &emitter,
                                StringRef multiLineComment = StringRef()) {
   auto isSingleVerilogStatement = [&](Operation &op) {
@@ -1365,10 +1044,12 @@ static void emitBeginEndRegion(Block *block,
 }
 
 LogicalResult ModuleEmitter::visitSV(IfOp op) {
-  SmallPtrSet<Operation *, 8> ops;
-  ops.insert(op);
+  OpLocList ops;
+  ops.push_back(op);
 
-  indent() << "if (" << emitExpressionToString(op.cond(), ops) << ')';
+  indent() << "if (";
+  emitExpression(op.cond(), ops);
+  os << ')';
   emitBeginEndRegion(op.getThenBlock(), ops, *this);
   if (op.hasElse()) {
     indent() << "else";
@@ -1378,12 +1059,12 @@ LogicalResult ModuleEmitter::visitSV(IfOp op) {
 }
 
 LogicalResult ModuleEmitter::visitSV(AlwaysOp op) {
-  SmallPtrSet<Operation *, 8> ops;
-  ops.insert(op);
+  OpLocList ops;
+  ops.push_back(op);
 
   auto printEvent = [&](AlwaysOp::Condition cond) {
-    os << stringifyEventControl(cond.event) << ' '
-       << emitExpressionToString(cond.value, ops);
+    os << stringifyEventControl(cond.event) << ' ';
+    emitExpression(cond.value, ops);
   };
 
   switch (op.getNumConditions()) {
@@ -1428,8 +1109,8 @@ LogicalResult ModuleEmitter::visitSV(AlwaysOp op) {
 }
 
 LogicalResult ModuleEmitter::visitSV(InitialOp op) {
-  SmallPtrSet<Operation *, 8> ops;
-  ops.insert(op);
+  OpLocList ops;
+  ops.push_back(op);
 
   indent() << "initial";
   emitBeginEndRegion(op.getBodyBlock(), ops, *this, "initial");
@@ -1437,8 +1118,8 @@ LogicalResult ModuleEmitter::visitSV(InitialOp op) {
 }
 
 LogicalResult ModuleEmitter::visitStmt(InstanceOp op) {
-  SmallPtrSet<Operation *, 8> ops;
-  ops.insert(op);
+  OpLocList ops;
+  ops.push_back(op);
 
   auto *moduleOp = op.getReferencedModule();
   assert(moduleOp && "Invalid IR");
@@ -1557,11 +1238,11 @@ LogicalResult ModuleEmitter::visitSV(InterfaceModportOp op) {
 }
 
 LogicalResult ModuleEmitter::visitSV(AssignInterfaceSignalOp op) {
-  SmallPtrSet<Operation *, 8> emitted;
+  OpLocList emitted;
   indent() << "assign ";
-  emitExpression(op.iface(), emitted, /*forceRootExpr=*/true);
+  emitExpression(op.iface(), emitted, ForceEmitMultiUse);
   os << "." << op.signalName() << " = ";
-  emitExpression(op.rhs(), emitted, /*forceRootExpr=*/true);
+  emitExpression(op.rhs(), emitted, ForceEmitMultiUse);
   os << ";\n";
   return success();
 }
@@ -1645,6 +1326,28 @@ static bool isExpressionEmittedInline(Operation *op) {
   return op->getResult(0).hasOneUse();
 }
 
+/// Return the number of operations that are printed when the specified
+/// expression is emitted inline, counting the operands that are emitted inline
+/// along with it.  Operands which haven't been given a wire yet are counted as
+/// inline, so this can only overestimate.
+unsigned ModuleEmitter::getInlineExpressionSize(Operation *op) {
+  auto it = inlineExpressionSizes.find(op);
+  if (it != inlineExpressionSizes.end())
+    return it->second;
+
+  // Expressions can be cyclic in a graph region, count each only once.
+  inlineExpressionSizes[op] = 1;
+  unsigned size = 1;
+  for (auto operand : op->getOperands()) {
+    auto *operandOp = operand.getDefiningOp();
+    if (operandOp && isVerilogExpression(operandOp) &&
+        !outOfLineExpressions.count(operandOp))
+      size += getInlineExpressionSize(operandOp);
+  }
+  inlineExpressionSizes[op] = size;
+  return size;
+}
+
 // Print out the array subscripts after a wire/port declaration.
 static void printArraySubscripts(Type type, raw_ostream &os) {
   if (auto inout = type.dyn_cast<InOutType>())
@@ -1683,6 +1386,11 @@ void ModuleEmitter::collectNamesEmitDecls(Block &block) {
 
   SmallString<32> nameTmp;
 
+  // The number of expressions emitted out of line, and the number that would
+  // be without duplicating cheap multiply used expressions into their users.
+  uint64_t numExpressionWires = 0, numExpressionWiresWithoutInlining = 0;
+  unsigned maxInlineSize = state.options.maxInlineExpressionSize;
+
   // Loop over all of the results of all of the ops.  Anything that defines a
   // value needs to be noticed.
   for (auto &op : block) {
@@ -1695,22 +1403,31 @@ void ModuleEmitter::collectNamesEmitDecls(Block &block) {
         // If this expression is dead, or can be emitted inline, ignore it.
         if (result.use_empty() || isExpressionEmittedInline(&op))
           continue;
+        ++numExpressionWiresWithoutInlining;
+
+        // Multiply used expressions that are small enough are duplicated into
+        // each of their users instead of getting a wire.
+        if (maxInlineSize && !isExpressionUnableToInline(&op) &&
+            getInlineExpressionSize(&op) <= maxInlineSize)
+          continue;
 
         // Remember that this expression should be emitted out of line.
         outOfLineExpressions.insert(&op);
+        ++numExpressionWires;
       }
 
       // Otherwise, it must be an expression or a declaration like a
       // RegOp/WireOp.  Remember and unique the name for this operation.
       if (auto instance = dyn_cast<InstanceOp>(&op)) {
         // The name for an instance result is custom.
-        nameTmp = instance.instanceName().str() + "_";
+        nameTmp = instance.instanceName();
+        nameTmp += '_';
         unsigned resultNumber = result.getResultNumber();
         auto resultName = instance.getResultName(resultNumber);
         if (resultName)
-          nameTmp += resultName.getValue().str();
+          nameTmp += resultName.getValue();
         else
-          nameTmp += std::to_string(resultNumber);
+          llvm::raw_svector_ostream(nameTmp) << resultNumber;
         addName(result, nameTmp);
       } else {
         addName(result, op.getAttrOfType<StringAttr>("name"));
@@ -1738,13 +1455,19 @@ void ModuleEmitter::collectNamesEmitDecls(Block &block) {
     }
   }
 
-  SmallPtrSet<Operation *, 8> ops;
+  if (auto *statistics = state.options.statistics) {
+    statistics->numExpressionWires += numExpressionWires;
+    statistics->numExpressionWiresWithoutInlining +=
+        numExpressionWiresWithoutInlining;
+  }
+
+  OpLocList ops;
 
   // Okay, now that we have measured the things to emit, emit the things.
   for (const auto &record : valuesToEmit) {
     auto *decl = record.value.getDefiningOp();
     ops.clear();
-    ops.insert(decl);
+    ops.push_back(decl);
 
     // Emit the leading word, like 'wire' or 'reg'.
     auto type = record.value.getType();
@@ -1821,7 +1544,7 @@ void ModuleEmitter::emitRTLModule(RTLModuleOp module) {
       name = "<<NO-NAME-FOUND>>";
     }
     if (port.isOutput())
-      usedNames.insert(name);
+      names.reserveName(name);
     else
       addName(module.getArgument(port.argNum), name);
   }
@@ -1941,32 +1664,159 @@ public:
       : VerilogEmitterBase(state) {}
 
   void emit(ModuleOp module);
+  void emitInParallel(ModuleOp module);
+
+  static void emitTopLevelOp(VerilogEmitterState &state, Operation &op);
 };
 
 } // end anonymous namespace
 
+/// Emit a single operation that lives at the top level of the MLIR module.
+void MLIRModuleEmitter::emitTopLevelOp(VerilogEmitterState &state,
+                                       Operation &op) {
+  state.locationPrinter.resetLastLocationInfo();
+  if (auto module = dyn_cast<RTLModuleOp>(op))
+    ModuleEmitter(state).emitRTLModule(module);
+  else if (auto module = dyn_cast<RTLExternModuleOp>(op))
+    ModuleEmitter(state).emitRTLExternModule(module);
+  else if (isa<InterfaceOp>(op) || isa<VerbatimOp>(op) || isa<IfDefOp>(op))
+    ModuleEmitter(state).emitOperation(&op);
+  else if (!isa<ModuleTerminatorOp>(op))
+    op.emitError("unknown operation");
+}
+
 void MLIRModuleEmitter::emit(ModuleOp module) {
-  for (auto &op : *module.getBody()) {
-    if (auto module = dyn_cast<RTLModuleOp>(op))
-      ModuleEmitter(state).emitRTLModule(module);
-    else if (auto module = dyn_cast<RTLExternModuleOp>(op))
-      ModuleEmitter(state).emitRTLExternModule(module);
-    else if (isa<InterfaceOp>(op) || isa<VerbatimOp>(op) || isa<IfDefOp>(op))
-      ModuleEmitter(state).emitOperation(&op);
-    else if (!isa<ModuleTerminatorOp>(op))
-      op.emitError("unknown operation");
-  }
+  for (auto &op : *module.getBody())
+    emitTopLevelOp(state, op);
+}
+
+/// Emit every top-level operation into its own buffer on the thread pool, then
+/// print the buffers in the original order.  The output is identical to
+/// emit().
+void MLIRModuleEmitter::emitInParallel(ModuleOp module) {
+  SmallVector<Operation *> ops;
+  for (auto &op : *module.getBody())
+    ops.push_back(&op);
+
+  std::vector<std::string> buffers(ops.size());
+  std::atomic<bool> encounteredError(false);
+  ParallelDiagnosticHandler diagHandler(module.getContext());
+  llvm::parallelForEachN(0, ops.size(), [&](size_t i) {
+    diagHandler.setOrderIDForThread(i);
+    llvm::raw_string_ostream moduleOS(buffers[i]);
+    VerilogEmitterState moduleState(moduleOS, state.options);
+    emitTopLevelOp(moduleState, *ops[i]);
+    moduleOS.flush();
+    if (moduleState.encounteredError)
+      encounteredError = true;
+    diagHandler.eraseOrderIDForThread();
+  });
+
+  for (auto &buffer : buffers)
+    os << buffer;
+  if (encounteredError)
+    state.encounteredError = true;
 }
 
 LogicalResult circt::exportVerilog(ModuleOp module, llvm::raw_ostream &os) {
-  VerilogEmitterState state(os);
-  MLIRModuleEmitter(state).emit(module);
+  return exportVerilog(module, os, ExportVerilogOptions());
+}
+
+LogicalResult circt::exportVerilog(ModuleOp module, llvm::raw_ostream &os,
+                                   const ExportVerilogOptions &options) {
+  VerilogEmitterState state(os, options);
+  if (options.emitInParallel && module.getContext()->isMultithreadingEnabled())
+    MLIRModuleEmitter(state).emitInParallel(module);
+  else
+    MLIRModuleEmitter(state).emit(module);
   return failure(state.encounteredError);
 }
 
+//===----------------------------------------------------------------------===//
+// Split File Emission
+//===----------------------------------------------------------------------===//
+
+/// Write `contents` to `path`, unless the file already holds exactly that
+/// text.  Leaving unchanged files alone keeps their timestamps, so downstream
+/// tools driven by timestamps only reprocess the modules that changed.
+static LogicalResult writeFileIfChanged(Operation *op, StringRef path,
+                                        StringRef contents) {
+  if (auto existing = llvm::MemoryBuffer::getFile(path)) {
+    auto oldText = (*existing)->getBuffer();
+    if (oldText.size() == contents.size() &&
+        llvm::MD5::hash(llvm::arrayRefFromStringRef(oldText)) ==
+            llvm::MD5::hash(llvm::arrayRefFromStringRef(contents)))
+      return success();
+  }
+
+  std::string errorMessage;
+  auto output = openOutputFile(path, &errorMessage);
+  if (!output)
+    return op->emitError(errorMessage);
+  output->os() << contents;
+  output->keep();
+  return success();
+}
+
+LogicalResult circt::exportSplitVerilog(ModuleOp module, StringRef dirname,
+                                        const ExportVerilogOptions &options) {
+  if (auto error = llvm::sys::fs::create_directories(dirname))
+    return module.emitError("cannot create output directory '")
+           << dirname << "': " << error.message();
+
+  // Modules and interfaces get a file each.  Everything else, e.g. verbatim
+  // text and ifdefs, is file level boilerplate that is replicated at the top
+  // of every file.  External modules are defined elsewhere.
+  SmallVector<Operation *> fileOps, replicatedOps;
+  for (auto &op : *module.getBody()) {
+    if (isa<RTLModuleOp, InterfaceOp>(op))
+      fileOps.push_back(&op);
+    else if (isa<VerbatimOp, IfDefOp>(op))
+      replicatedOps.push_back(&op);
+    else if (!isa<RTLExternModuleOp, ModuleTerminatorOp>(op))
+      return op.emitError("unknown operation");
+  }
+
+  bool encounteredError = false;
+  std::string fileList;
+  for (auto *op : fileOps) {
+    std::string contents;
+    llvm::raw_string_ostream os(contents);
+    VerilogEmitterState state(os, options);
+    for (auto *replicated : replicatedOps)
+      MLIRModuleEmitter::emitTopLevelOp(state, *replicated);
+    MLIRModuleEmitter::emitTopLevelOp(state, *op);
+    os.flush();
+    if (state.encounteredError) {
+      encounteredError = true;
+      continue;
+    }
+
+    auto name =
+        op->getAttrOfType<StringAttr>(SymbolTable::getSymbolAttrName());
+    std::string fileName = (name.getValue() + ".sv").str();
+    SmallString<128> path(dirname);
+    llvm::sys::path::append(path, fileName);
+    if (failed(writeFileIfChanged(op, path, contents)))
+      encounteredError = true;
+    fileList += fileName + "\n";
+  }
+  if (encounteredError)
+    return failure();
+
+  // The filelist names the files in the order the modules were defined.
+  SmallString<128> fileListPath(dirname);
+  llvm::sys::path::append(fileListPath, "filelist.f");
+  return writeFileIfChanged(module, fileListPath, fileList);
+}
+
 void circt::registerToVerilogTranslation() {
   TranslateFromMLIRRegistration toVerilog(
-      "emit-verilog", exportVerilog, [](DialectRegistry &registry) {
+      "emit-verilog",
+      [](ModuleOp module, raw_ostream &os) {
+        return exportVerilog(module, os);
+      },
+      [](DialectRegistry &registry) {
         registry.insert<RTLDialect, SVDialect>();
       });
 }
@@ -11,6 +11,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "circt/Translation/ExportVerilog.h"
+#include "ExportVerilogInternals.h"
 // clang-format don't reorder #includes!
 #include "circt/Dialect/FIRRTL/FIRRTLVisitors.h"
 #include "circt/Support/LLVM.h"
@@ -24,17 +25,7 @@
 using namespace circt;
 using namespace firrtl;
 using namespace mlir;
-
-/// Should we emit wire decls in a block at the top of a module, or inline?
-static constexpr bool emitInlineWireDecls = true;
-
-/// This is the preferred source width for the generated Verilog.
-static constexpr size_t preferredSourceWidth = 120;
-
-/// This is a set accessed through getReservedWords() that contains all of the
-/// Verilog names and other identifiers we need to avoid because of name
-/// conflicts.
-static llvm::ManagedStatic<StringSet<>> reservedWordCache;
+using namespace ExportVerilog;
 
 //===----------------------------------------------------------------------===//
 // Helper routines
@@ -82,22 +73,6 @@ static T getTypeOf(Value v) {
   return v.getType().cast<T>();
 }
 
-/// Given an integer value, return the number of characters it will take to
-/// print its base-10 value.
-static unsigned getPrintedIntWidth(unsigned value) {
-  if (value < 10)
-    return 1;
-  if (value < 100)
-    return 2;
-  if (value < 1000)
-    return 3;
-
-  SmallVector<char, 8> spelling;
-  llvm::raw_svector_ostream stream(spelling);
-  stream << value;
-  return stream.str().size();
-}
-
 /// Return true if this is a noop cast that will emit with no syntax.
 static bool isNoopCast(Operation *op) {
   // These are always noop casts.
@@ -120,8 +95,9 @@ static bool isNoopCast(Operation *op) {
 }
 
 namespace {
-/// This represents a flattened bundle field element.
-struct FlatBundleFieldEntry {
+/// This represents a flattened bundle field element.  Unlike the FIRRTL
+/// dialect's FlatBundleFieldEntry, this also works on non-FIRRTL types.
+struct FlatFieldEntry {
   /// This is the underlying ground type of the field.
   Type type;
   /// This is a suffix to add to the field name to make it unique.
@@ -134,7 +110,7 @@ struct FlatBundleFieldEntry {
 /// Convert a nested bundle of fields into a flat list of fields.  This is used
 /// when working with instances and mems to flatten them.
 static void flattenBundleTypes(Type type, StringRef suffixSoFar, bool isFlipped,
-                               SmallVectorImpl<FlatBundleFieldEntry> &results) {
+                               SmallVectorImpl<FlatFieldEntry> &results) {
   if (auto flip = type.dyn_cast<FlipType>())
     return flattenBundleTypes(flip.getElementType(), suffixSoFar, !isFlipped,
                               results);
@@ -159,138 +135,17 @@ static void flattenBundleTypes(Type type, StringRef suffixSoFar, bool isFlipped,
   }
 }
 
-namespace {
-/// This enum keeps track of the precedence level of various binary operators,
-/// where a lower number binds tighter.
-enum VerilogPrecedence {
-  // Normal precedence levels.
-  Symbol,          // Atomic symbol like "foo"
-  Unary,           // Unary operators like ~foo
-  Multiply,        // * , / , %
-  Addition,        // + , -
-  Shift,           // << , >>
-  Comparison,      // > , >= , < , <=
-  Equality,        // == , !=
-  And,             // &
-  Xor,             // ^ , ^~
-  Or,              // |
-  AndShortCircuit, // &&
-  Conditional,     // ? :
-
-  LowestPrecedence,  // Sentinel which is always the lowest precedence.
-  ForceEmitMultiUse, // Sentinel saying to recursively emit a multi-used expr.
-};
-} // end anonymous namespace
-
-/// Return a StringSet that contains all of the reserved names (e.g. Verilog
-/// keywords) that we need to avoid for fear of name conflicts.
-static const StringSet<> &getReservedWords() {
-  auto &set = *reservedWordCache;
-  if (set.empty()) {
-    static const char *const reservedWords[] = {
-#include "ReservedWords.def"
-    };
-    for (auto *word : reservedWords)
-      set.insert(word);
-  }
-  return set;
-}
-
-//===----------------------------------------------------------------------===//
-// VerilogEmitter
-//===----------------------------------------------------------------------===//
-
-namespace {
-/// This class maintains the mutable state that cross-cuts and is shared by the
-/// various emitters.
-class VerilogEmitterState {
-public:
-  explicit VerilogEmitterState(raw_ostream &os) : os(os) {}
-
-  /// The stream to emit to.
-  raw_ostream &os;
-
-  bool encounteredError = false;
-  unsigned currentIndent = 0;
-
-private:
-  VerilogEmitterState(const VerilogEmitterState &) = delete;
-  void operator=(const VerilogEmitterState &) = delete;
-};
-} // namespace
-
-namespace {
-
-/// This is the base class for all of the Verilog Emitter components.
-class VerilogEmitterBase {
-public:
-  explicit VerilogEmitterBase(VerilogEmitterState &state)
-      : state(state), os(state.os) {}
-
-  InFlightDiagnostic emitError(Operation *op, const Twine &message) {
-    state.encounteredError = true;
-    return op->emitError(message);
-  }
-
-  InFlightDiagnostic emitOpError(Operation *op, const Twine &message) {
-    state.encounteredError = true;
-    return op->emitOpError(message);
-  }
-
-  raw_ostream &indent() { return os.indent(state.currentIndent); }
-
-  void addIndent() { state.currentIndent += 2; }
-  void reduceIndent() { state.currentIndent -= 2; }
-
-  /// Emit the verilog type for the specified ground type, padding the text to
-  /// the specified number of characters.
-  void emitTypePaddedToWidth(Type type, size_t padToWidth, Operation *op);
-
-  // All of the mutable state we are maintaining.
-  VerilogEmitterState &state;
-
-  /// The stream to emit to.
-  raw_ostream &os;
-
-private:
-  VerilogEmitterBase(const VerilogEmitterBase &) = delete;
-  void operator=(const VerilogEmitterBase &) = delete;
-};
-
-} // end anonymous namespace
-
-void VerilogEmitterBase::emitTypePaddedToWidth(Type type, size_t padToWidth,
-                                               Operation *op) {
-  int bitWidth = getBitWidthOrSentinel(type);
-  assert(bitWidth != 0 && "Shouldn't emit zero bit declarations");
-
-  if (bitWidth == -1) {
-    emitError(op, "value has an unsupported verilog type ") << type;
-    os << "<<invalid type>>";
-    return;
-  }
-
-  size_t emittedWidth = 0;
-  if (bitWidth != 1) {
-    os << '[' << (bitWidth - 1) << ":0]";
-    emittedWidth = getPrintedIntWidth(bitWidth - 1) + 4;
-  }
-
-  if (emittedWidth < padToWidth)
-    os.indent(padToWidth - emittedWidth);
-}
-
 //===----------------------------------------------------------------------===//
 // ModuleEmitter
 //===----------------------------------------------------------------------===//
 
 namespace {
 
-class ModuleEmitter : public VerilogEmitterBase {
+class ModuleEmitter : public ModuleEmitterBase {
 
 public:
   explicit ModuleEmitter(VerilogEmitterState &state)
-      : VerilogEmitterBase(state) {}
+      : ModuleEmitterBase(state) {}
 
   void emitFModule(FModuleOp module);
   void emitExpression(Value exp, SmallPtrSet<Operation *, 8> &emittedExprs,
@@ -315,25 +170,14 @@ public:
   void emitOperation(Operation *op);
 
   void collectNamesEmitDecls(Block &block);
-  StringRef addName(Value value, StringRef name);
-  StringRef addName(Value value, StringAttr nameAttr) {
-    return addName(value, nameAttr ? nameAttr.getValue() : "");
-  }
 
-  StringRef getName(Value value) {
-    auto *entry = nameTable[value];
-    assert(entry && "value expected a name but doesn't have one");
-    return entry->getKey();
-  }
+  /// Emit the verilog type for the specified ground type, padding the text to
+  /// the specified number of characters.
+  void emitTypePaddedToWidth(Type type, size_t padToWidth, Operation *op);
 
   /// Return the location information as a (potentially empty) string.
   std::string getLocationInfoAsString(const SmallPtrSet<Operation *, 8> &ops);
 
-  /// If we have location information for any of the specified operations,
-  /// aggregate it together and print a pretty comment specifying where the
-  /// operations came from.  In any case, print a newline.
-  void emitLocationInfoAndNewLine(const SmallPtrSet<Operation *, 8> &ops);
-
   // Conditional statement handling.
 
   enum class ConditionalStmtKind {
@@ -426,15 +270,6 @@ public:
   // Per module states.
   std::vector<ConditionalStatement> conditionalStmts;
 
-  llvm::StringSet<> usedNames;
-  llvm::DenseMap<Value, llvm::StringMapEntry<llvm::NoneType> *> nameTable;
-  size_t nextGeneratedNameID = 0;
-
-  /// This set keeps track of all of the expression nodes that need to be
-  /// emitted as standalone wire declarations.  This can happen because they are
-  /// multiply-used or because the user requires a name to reference.
-  SmallPtrSet<Operation *, 16> outOfLineExpressions;
-
   // This is set to true after the first RANDOMIZE prolog has been emitted in
   // this module to the initial block.
   bool emittedRandomProlog = false;
@@ -443,185 +278,31 @@ public:
 
 } // end anonymous namespace
 
-/// Add the specified name to the name table, auto-uniquing the name if
-/// required.  If the name is empty, then this creates a unique temp name.
-StringRef ModuleEmitter::addName(Value value, StringRef name) {
-  if (name.empty())
-    name = "_T";
-
-  // Check to see if this name is valid.  The first character cannot be a
-  // number of other weird thing.  If it is, start with an underscore.
-  if (!isalpha(name.front()) && name.front() != '_') {
-    SmallString<16> tmpName("_");
-    tmpName += name;
-    return addName(value, tmpName);
-  }
-
-  auto isValidVerilogCharacter = [](char ch) -> bool {
-    return isalpha(ch) || isdigit(ch) || ch == '_';
-  };
-
-  // Check to see if the name consists of all-valid identifiers.  If not, we
-  // need to escape them.
-  for (char ch : name) {
-    if (isValidVerilogCharacter(ch))
-      continue;
+void ModuleEmitter::emitTypePaddedToWidth(Type type, size_t padToWidth,
+                                          Operation *op) {
+  int bitWidth = getBitWidthOrSentinel(type);
+  assert(bitWidth != 0 && "Shouldn't emit zero bit declarations");
 
-    // Otherwise, we need to escape it.
-    SmallString<16> tmpName;
-    for (char ch : name) {
-      if (isValidVerilogCharacter(ch))
-        tmpName += ch;
-      else if (ch == ' ')
-        tmpName += '_';
-      else {
-        tmpName += llvm::utohexstr((unsigned char)ch);
-      }
-    }
-    return addName(value, tmpName);
+  if (bitWidth == -1) {
+    emitError(op, "value has an unsupported verilog type ") << type;
+    os << "<<invalid type>>";
+    return;
   }
 
-  // Get the list of reserved words we need to avoid.  We could prepopulate this
-  // into the used words cache, but it is large and immutable, so we just query
-  // it when needed.
-  auto &reservedWords = getReservedWords();
-
-  // Check to see if this name is available - if so, use it.
-  if (!reservedWords.count(name)) {
-    auto insertResult = usedNames.insert(name);
-    if (insertResult.second) {
-      nameTable[value] = &*insertResult.first;
-      return insertResult.first->getKey();
-    }
+  size_t emittedWidth = 0;
+  if (bitWidth != 1) {
+    os << '[' << (bitWidth - 1) << ":0]";
+    emittedWidth = getPrintedIntWidth(bitWidth - 1) + 4;
   }
 
-  // If not, we need to auto-unique it.
-  SmallVector<char, 16> nameBuffer(name.begin(), name.end());
-  nameBuffer.push_back('_');
-  auto baseSize = nameBuffer.size();
-
-  // Try until we find something that works.
-  while (1) {
-    auto suffix = llvm::utostr(nextGeneratedNameID++);
-    nameBuffer.append(suffix.begin(), suffix.end());
-    name = StringRef(nameBuffer.data(), nameBuffer.size());
-
-    if (!reservedWords.count(name)) {
-      auto insertResult = usedNames.insert(name);
-      if (insertResult.second) {
-        nameTable[value] = &*insertResult.first;
-        return insertResult.first->getKey();
-      }
-    }
-
-    // Chop off the suffix and try again.
-    nameBuffer.resize(baseSize);
-  }
+  if (emittedWidth < padToWidth)
+    os.indent(padToWidth - emittedWidth);
 }
 
 /// Return the location information as a (potentially empty) string.
 std::string
 ModuleEmitter::getLocationInfoAsString(const SmallPtrSet<Operation *, 8> &ops) {
-  std::string resultStr;
-  llvm::raw_string_ostream sstr(resultStr);
-
-  // Multiple operations may come from the same location or may not have useful
-  // location info.  Unique it now.
-  SmallPtrSet<Attribute, 8> locations;
-  for (auto *op : ops) {
-    if (auto loc = op->getLoc().dyn_cast<FileLineColLoc>())
-      locations.insert(loc);
-  }
-
-  auto printLoc = [&](FileLineColLoc loc) {
-    sstr << loc.getFilename();
-    if (auto line = loc.getLine()) {
-      sstr << ':' << line;
-      if (auto col = loc.getColumn())
-        sstr << ':' << col;
-    }
-  };
-
-  switch (locations.size()) {
-  case 1:
-    printLoc((*locations.begin()).cast<FileLineColLoc>());
-    LLVM_FALLTHROUGH;
-  case 0:
-    return sstr.str();
-  default:
-    break;
-  }
-
-  // Sort the entries.
-  SmallVector<FileLineColLoc, 8> locVector;
-  locVector.reserve(locations.size());
-  for (auto loc : locations)
-    locVector.push_back(loc.cast<FileLineColLoc>());
-
-  llvm::array_pod_sort(
-      locVector.begin(), locVector.end(),
-      [](const FileLineColLoc *lhs, const FileLineColLoc *rhs) -> int {
-        if (auto fn = lhs->getFilename().compare(rhs->getFilename()))
-          return fn;
-        if (lhs->getLine() != rhs->getLine())
-          return lhs->getLine() < rhs->getLine() ? -1 : 1;
-        return lhs->getColumn() < rhs->getColumn() ? -1 : 1;
-      });
-
-  // The entries are sorted by filename, line, col.  Try to merge together
-  // entries to reduce verbosity on the column info.
-  StringRef lastFileName;
-  for (size_t i = 0, e = locVector.size(); i != e;) {
-    if (i != 0)
-      sstr << ", ";
-
-    // Print the filename if it changed.
-    auto first = locVector[i];
-    if (first.getFilename() != lastFileName) {
-      lastFileName = first.getFilename();
-      sstr << lastFileName;
-    }
-
-    // Scan for entires with the same file/line.
-    size_t end = i + 1;
-    while (end != e && first.getFilename() == locVector[end].getFilename() &&
-           first.getLine() == locVector[end].getLine())
-      ++end;
-
-    // If we have one entry, print it normally.
-    if (end == i + 1) {
-      if (auto line = first.getLine()) {
-        sstr << ':' << line;
-        if (auto col = first.getColumn())
-          sstr << ':' << col;
-      }
-      ++i;
-      continue;
-    }
-
-    // Otherwise print a brace enclosed list.
-    sstr << ':' << first.getLine() << ":{";
-    while (i != end) {
-      sstr << locVector[i++].getColumn();
-
-      if (i != end)
-        sstr << ',';
-    }
-    sstr << '}';
-  }
-
-  return sstr.str();
-}
-
-/// If we have location information for any of the specified operations,
-/// aggregate it together and print a pretty comment specifying where the
-/// operations came from.  In any case, print a newline.
-void ModuleEmitter::emitLocationInfoAndNewLine(
-    const SmallPtrSet<Operation *, 8> &ops) {
-  auto locInfo = getLocationInfoAsString(ops);
-  if (!locInfo.empty())
-    os << "\t// " << locInfo;
-  os << '\n';
+  return state.locationPrinter.getLocationInfo(ops).str();
 }
 
 //===----------------------------------------------------------------------===//
@@ -1449,7 +1130,7 @@ void ModuleEmitter::emitDecl(InstanceOp op) {
   os << ' ' << instanceName << " (";
   emitLocationInfoAndNewLine(ops);
 
-  SmallVector<FlatBundleFieldEntry, 8> fieldTypes;
+  SmallVector<FlatFieldEntry, 8> fieldTypes;
   flattenBundleTypes(op.getResult().getType().cast<FIRRTLType>(), "", false,
                      fieldTypes);
   for (auto &elt : fieldTypes) {
@@ -1521,7 +1202,7 @@ void ModuleEmitter::emitDecl(MemOp op) {
 
   // Aggregate mems may declare multiple reg's.  We need to random initialize
   // them all.
-  SmallVector<FlatBundleFieldEntry, 8> fieldTypes;
+  SmallVector<FlatFieldEntry, 8> fieldTypes;
   if (auto dataType = op.getDataTypeOrNull())
     flattenBundleTypes(dataType, "", false, fieldTypes);
 
@@ -1733,7 +1414,7 @@ void ModuleEmitter::collectNamesEmitDecls(Block &block) {
     return "wire";
   };
 
-  SmallVector<FlatBundleFieldEntry, 8> fieldTypes;
+  SmallVector<FlatFieldEntry, 8> fieldTypes;
   SmallVector<Operation *, 16> declsToEmit;
   bool rtlInstanceDeclaredWires = false;
   for (auto &op : block) {
@@ -2260,7 +1941,9 @@ void CircuitEmitter::emitMLIRModule(ModuleOp module) {
 
 LogicalResult circt::exportFIRRTLToVerilog(ModuleOp module,
                                            llvm::raw_ostream &os) {
-  VerilogEmitterState state(os);
+  // The FIRRTL emitter always uses the default options.
+  ExportVerilogOptions options;
+  VerilogEmitterState state(os, options);
   CircuitEmitter(state).emitMLIRModule(module);
   return failure(state.encounteredError);
 }
@@ -0,0 +1,248 @@
+//===- ExportVerilogInternals.h - Shared Verilog emitter helpers -*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the helpers shared by the RTL and FIRRTL Verilog
+// emitters.
+//
+//===----------------------------------------------------------------------===//
+
+// NOLINTNEXTLINE(llvm-header-guard)
+#ifndef TRANSLATION_EXPORTVERILOG_EXPORTVERILOGINTERNALS_H
+#define TRANSLATION_EXPORTVERILOG_EXPORTVERILOGINTERNALS_H
+
+#include "circt/Support/LLVM.h"
+#include "circt/Translation/ExportVerilog.h"
+#include "mlir/IR/BuiltinAttributes.h"
+#include "mlir/IR/Location.h"
+#include "mlir/IR/Operation.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/Support/StringSaver.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace circt {
+namespace ExportVerilog {
+
+/// Should we emit wire decls in a block at the top of a module, or inline?
+static constexpr bool emitInlineWireDecls = true;
+
+/// This is the preferred source width for the generated Verilog.
+static constexpr size_t preferredSourceWidth = 120;
+
+/// Return a StringSet that contains all of the reserved names (e.g. Verilog
+/// keywords) that we need to avoid for fear of name conflicts.
+const llvm::StringSet<> &getReservedWords();
+
+/// Turn `name` into a legal Verilog identifier in a single pass.  If it is
+/// already legal it is returned as is, otherwise the legalized name is built in
+/// `buffer`.  An empty name becomes "_T".
+StringRef legalizeName(StringRef name, SmallVectorImpl<char> &buffer);
+
+/// This hands out the names used within a single Verilog module.  Every name
+/// is legalized and made unique against the names already in use and the
+/// reserved words.  Colliding names get a numeric suffix, where each base name
+/// keeps its own suffix counter, so assigning N names costs O(N) overall.
+class NameUniquer {
+public:
+  using NameEntry = llvm::StringMapEntry<llvm::NoneType>;
+
+  /// Legalize and unique `name`.  The returned entry lives as long as the
+  /// uniquer.
+  NameEntry *getUniqueName(StringRef name);
+
+  /// Mark `name` as used without legalizing or uniquing it, e.g. for port
+  /// names that must be printed verbatim.
+  void reserveName(StringRef name) { usedNames.insert(name); }
+
+private:
+  llvm::StringSet<> usedNames;
+
+  /// The next suffix to try for each base name that has collided before.
+  llvm::StringMap<size_t> nextSuffix;
+};
+
+/// This renders the location comments printed at the end of the emitted
+/// statements.  A statement is built from one or more operations, each of
+/// which may carry a FusedLoc with many file locations, so rendering is done
+/// once per distinct location and cached for the rest of the emission.
+class LocationInfoPrinter {
+public:
+  explicit LocationInfoPrinter(const ExportVerilogOptions &options)
+      : options(options), saver(allocator) {}
+
+  /// Return the location comment text for the given operations, without the
+  /// leading "// ".  This is empty if there is nothing to print, which
+  /// includes a repeat of the previous comment if those are omitted.  The
+  /// result is valid until the next call.
+  template <typename OpRange>
+  StringRef getLocationInfo(const OpRange &ops) {
+    SmallVector<Location, 8> locs;
+    for (auto *op : ops)
+      locs.push_back(op->getLoc());
+    return getLocationInfo(locs);
+  }
+  StringRef getLocationInfo(ArrayRef<Location> locs);
+
+  /// Forget the previous comment, such that the first statement of the next
+  /// top-level operation always gets its location.  Top-level operations are
+  /// emitted independently when that is done in parallel, this keeps the
+  /// serial output the same.
+  void resetLastLocationInfo() { lastLocationInfo.clear(); }
+
+private:
+  /// Render the file locations in `locs` into `buffer`.
+  void render(ArrayRef<Location> locs, SmallVectorImpl<char> &buffer);
+
+  const ExportVerilogOptions &options;
+
+  /// The rendered comment for statements that come from a single location.
+  llvm::DenseMap<Location, StringRef> cache;
+  llvm::BumpPtrAllocator allocator;
+  llvm::StringSaver saver;
+
+  /// Scratch space for statements that come from several distinct locations.
+  SmallString<64> scratch;
+
+  /// The comment printed on the previous line.
+  SmallString<64> lastLocationInfo;
+};
+
+/// Given an integer value, return the number of characters it will take to
+/// print its base-10 value.
+unsigned getPrintedIntWidth(unsigned value);
+
+/// This enum keeps track of the precedence level of various binary operators,
+/// where a lower number binds tighter.
+enum VerilogPrecedence {
+  // Normal precedence levels.
+  Symbol,          // Atomic symbol like "foo"
+  Unary,           // Unary operators like ~foo
+  Multiply,        // * , / , %
+  Addition,        // + , -
+  Shift,           // << , >>
+  Comparison,      // > , >= , < , <=
+  Equality,        // == , !=
+  And,             // &
+  Xor,             // ^ , ^~
+  Or,              // |
+  AndShortCircuit, // &&
+  Conditional,     // ? :
+
+  LowestPrecedence,  // Sentinel which is always the lowest precedence.
+  ForceEmitMultiUse, // Sentinel saying to recursively emit a multi-used expr.
+};
+
+/// This class maintains the mutable state that cross-cuts and is shared by the
+/// various emitters.  When modules are emitted in parallel, each module gets
+/// its own state, so the indent and error flag are never shared across
+/// threads.
+class VerilogEmitterState {
+public:
+  VerilogEmitterState(raw_ostream &os, const ExportVerilogOptions &options)
+      : os(os), options(options), locationPrinter(options) {}
+
+  /// The stream to emit to.
+  raw_ostream &os;
+
+  const ExportVerilogOptions &options;
+
+  /// This renders and caches the location comments.
+  LocationInfoPrinter locationPrinter;
+
+  bool encounteredError = false;
+  unsigned currentIndent = 0;
+
+private:
+  VerilogEmitterState(const VerilogEmitterState &) = delete;
+  void operator=(const VerilogEmitterState &) = delete;
+};
+
+/// This is the base class for all of the Verilog Emitter components.
+class VerilogEmitterBase {
+public:
+  explicit VerilogEmitterBase(VerilogEmitterState &state)
+      : state(state), os(state.os) {}
+
+  InFlightDiagnostic emitError(Operation *op, const Twine &message) {
+    state.encounteredError = true;
+    return op->emitError(message);
+  }
+
+  InFlightDiagnostic emitOpError(Operation *op, const Twine &message) {
+    state.encounteredError = true;
+    return op->emitOpError(message);
+  }
+
+  raw_ostream &indent() { return os.indent(state.currentIndent); }
+
+  void addIndent() { state.currentIndent += 2; }
+  void reduceIndent() { state.currentIndent -= 2; }
+
+  // All of the mutable state we are maintaining.
+  VerilogEmitterState &state;
+
+  /// The stream to emit to.
+  raw_ostream &os;
+
+private:
+  VerilogEmitterBase(const VerilogEmitterBase &) = delete;
+  void operator=(const VerilogEmitterBase &) = delete;
+};
+
+/// This is the base class of the emitters of a single module.  It holds the
+/// names of the values in the module and the expressions that get their own
+/// declaration.
+class ModuleEmitterBase : public VerilogEmitterBase {
+public:
+  explicit ModuleEmitterBase(VerilogEmitterState &state)
+      : VerilogEmitterBase(state) {}
+
+  /// Add the specified name to the name table, auto-uniquing the name if
+  /// required.  If the name is empty, then this creates a unique temp name.
+  StringRef addName(Value value, StringRef name) {
+    auto *entry = names.getUniqueName(name);
+    nameTable[value] = entry;
+    return entry->getKey();
+  }
+  StringRef addName(Value value, StringAttr nameAttr) {
+    return addName(value, nameAttr ? nameAttr.getValue() : "");
+  }
+
+  StringRef getName(Value value) {
+    auto *entry = nameTable[value];
+    assert(entry && "value expected a name but doesn't have one");
+    return entry->getKey();
+  }
+
+  /// If we have location information for any of the specified operations,
+  /// aggregate it together and print a pretty comment specifying where the
+  /// operations came from.  In any case, print a newline.
+  template <typename OpRange>
+  void emitLocationInfoAndNewLine(const OpRange &ops) {
+    auto locInfo = state.locationPrinter.getLocationInfo(ops);
+    if (!locInfo.empty())
+      os << "\t// " << locInfo;
+    os << '\n';
+  }
+
+  NameUniquer names;
+  llvm::DenseMap<Value, NameUniquer::NameEntry *> nameTable;
+
+  /// This set keeps track of all of the expression nodes that need to be
+  /// emitted as standalone wire declarations.  This can happen because they are
+  /// multiply-used or because the user requires a name to reference.
+  SmallPtrSet<Operation *, 16> outOfLineExpressions;
+};
+
+} // namespace ExportVerilog
+} // namespace circt
+
+#endif // TRANSLATION_EXPORTVERILOG_EXPORTVERILOGINTERNALS_H
@@ -0,0 +1,104 @@
+//===- LegalizeNames.cpp - Verilog name legalization ----------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This implements the name legalization and uniquing that is shared by the
+// RTL and FIRRTL Verilog emitters.
+//
+//===----------------------------------------------------------------------===//
+
+#include "ExportVerilogInternals.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace circt;
+using namespace ExportVerilog;
+
+const llvm::StringSet<> &ExportVerilog::getReservedWords() {
+  // Function local statics are initialized exactly once, even when modules
+  // are emitted on several threads.
+  static const llvm::StringSet<> reservedWords = [] {
+    static const char *const words[] = {
+#include "ReservedWords.def"
+    };
+    llvm::StringSet<> set;
+    for (auto *word : words)
+      set.insert(word);
+    return set;
+  }();
+  return reservedWords;
+}
+
+static bool isValidVerilogCharacter(char ch) {
+  return isalpha(ch) || isdigit(ch) || ch == '_';
+}
+
+StringRef ExportVerilog::legalizeName(StringRef name,
+                                      SmallVectorImpl<char> &buffer) {
+  if (name.empty())
+    return "_T";
+
+  // The first character cannot be a number or other weird thing.  If it is,
+  // start with an underscore.
+  bool validStart = isalpha(name.front()) || name.front() == '_';
+  if (validStart && llvm::all_of(name, isValidVerilogCharacter))
+    return name;
+
+  // Otherwise escape the invalid characters: spaces become underscores and
+  // everything else its hex value.
+  buffer.clear();
+  if (!validStart)
+    buffer.push_back('_');
+  for (char ch : name) {
+    if (isValidVerilogCharacter(ch)) {
+      buffer.push_back(ch);
+    } else if (ch == ' ') {
+      buffer.push_back('_');
+    } else {
+      unsigned char value = ch;
+      if (value >= 16)
+        buffer.push_back(llvm::hexdigit(value >> 4));
+      buffer.push_back(llvm::hexdigit(value & 15));
+    }
+  }
+  return StringRef(buffer.data(), buffer.size());
+}
+
+NameUniquer::NameEntry *NameUniquer::getUniqueName(StringRef name) {
+  SmallString<16> legalName;
+  name = legalizeName(name, legalName);
+
+  // Get the list of reserved words we need to avoid.  We could prepopulate this
+  // into the used words cache, but it is large and immutable, so we just query
+  // it when needed.
+  auto &reservedWords = getReservedWords();
+
+  // Check to see if this name is available - if so, use it.
+  if (!reservedWords.count(name)) {
+    auto insertResult = usedNames.insert(name);
+    if (insertResult.second)
+      return &*insertResult.first;
+  }
+
+  // If not, we need to auto-unique it.  Pick up where the last collision on
+  // this name left off, so we don't retry suffixes that are known to be taken.
+  size_t &suffix = nextSuffix[name];
+  SmallString<32> nameBuffer(name);
+  nameBuffer.push_back('_');
+  auto baseSize = nameBuffer.size();
+  while (1) {
+    nameBuffer.resize(baseSize);
+    llvm::raw_svector_ostream(nameBuffer) << suffix++;
+
+    if (!reservedWords.count(nameBuffer)) {
+      auto insertResult = usedNames.insert(nameBuffer);
+      if (insertResult.second)
+        return &*insertResult.first;
+    }
+  }
+}
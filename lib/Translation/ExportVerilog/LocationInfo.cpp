@@ -0,0 +1,132 @@
+//===- LocationInfo.cpp - Verilog location comments -----------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This implements the rendering of the location comments that the Verilog
+// emitters print at the end of each statement.
+//
+//===----------------------------------------------------------------------===//
+
+#include "ExportVerilogInternals.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace circt;
+using namespace ExportVerilog;
+using namespace mlir;
+
+/// Append the file locations in `loc` to `result`, looking through FusedLocs.
+static void collectFileLocs(Location loc,
+                            SmallVectorImpl<FileLineColLoc> &result) {
+  if (auto fileLoc = loc.dyn_cast<FileLineColLoc>()) {
+    result.push_back(fileLoc);
+  } else if (auto fusedLoc = loc.dyn_cast<FusedLoc>()) {
+    for (auto subLoc : fusedLoc.getLocations())
+      collectFileLocs(subLoc, result);
+  }
+}
+
+StringRef LocationInfoPrinter::getLocationInfo(ArrayRef<Location> locs) {
+  if (locs.empty())
+    return {};
+
+  // The first operation is the statement itself, the rest are the expressions
+  // that were inlined into it.
+  if (options.primaryLocationOnly)
+    locs = locs.take_front();
+
+  // Most statements come from just one location, render that once.
+  StringRef result;
+  if (llvm::all_of(locs, [&](Location loc) { return loc == locs.front(); })) {
+    auto it = cache.find(locs.front());
+    if (it == cache.end()) {
+      render(locs.front(), scratch);
+      it = cache.try_emplace(locs.front(), saver.save(StringRef(scratch)))
+               .first;
+    }
+    result = it->second;
+  } else {
+    render(locs, scratch);
+    result = scratch;
+  }
+
+  if (options.omitRepeatedLocationInfo) {
+    if (result == lastLocationInfo)
+      return {};
+    lastLocationInfo = result;
+  }
+  return result;
+}
+
+void LocationInfoPrinter::render(ArrayRef<Location> locs,
+                                 SmallVectorImpl<char> &buffer) {
+  buffer.clear();
+  llvm::raw_svector_ostream sstr(buffer);
+
+  SmallVector<FileLineColLoc, 8> locVector;
+  for (auto loc : locs)
+    collectFileLocs(loc, locVector);
+  if (options.primaryLocationOnly && locVector.size() > 1)
+    locVector.resize(1);
+
+  // Multiple operations may come from the same location.  Sort the entries
+  // and unique them.
+  llvm::array_pod_sort(
+      locVector.begin(), locVector.end(),
+      [](const FileLineColLoc *lhs, const FileLineColLoc *rhs) -> int {
+        if (auto fn = lhs->getFilename().compare(rhs->getFilename()))
+          return fn;
+        if (lhs->getLine() != rhs->getLine())
+          return lhs->getLine() < rhs->getLine() ? -1 : 1;
+        if (lhs->getColumn() != rhs->getColumn())
+          return lhs->getColumn() < rhs->getColumn() ? -1 : 1;
+        return 0;
+      });
+  locVector.erase(std::unique(locVector.begin(), locVector.end()),
+                  locVector.end());
+
+  // The entries are sorted by filename, line, col.  Try to merge together
+  // entries to reduce verbosity on the column info.
+  StringRef lastFileName;
+  for (size_t i = 0, e = locVector.size(); i != e;) {
+    if (i != 0)
+      sstr << ", ";
+
+    // Print the filename if it changed.
+    auto first = locVector[i];
+    if (first.getFilename() != lastFileName) {
+      lastFileName = first.getFilename();
+      sstr << lastFileName;
+    }
+
+    // Scan for entires with the same file/line.
+    size_t end = i + 1;
+    while (end != e && first.getFilename() == locVector[end].getFilename() &&
+           first.getLine() == locVector[end].getLine())
+      ++end;
+
+    // If we have one entry, print it normally.
+    if (end == i + 1) {
+      if (auto line = first.getLine()) {
+        sstr << ':' << line;
+        if (auto col = first.getColumn())
+          sstr << ':' << col;
+      }
+      ++i;
+      continue;
+    }
+
+    // Otherwise print a brace enclosed list.
+    sstr << ':' << first.getLine() << ":{";
+    while (i != end) {
+      sstr << locVector[i++].getColumn();
+
+      if (i != end)
+        sstr << ',';
+    }
+    sstr << '}';
+  }
+}
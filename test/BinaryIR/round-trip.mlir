@@ -0,0 +1,26 @@
+// RUN: circt-translate -emit-binary %s | circt-translate -parse-binary -mlir-print-debuginfo | FileCheck %s
+// RUN: circt-opt -emit-binary %s | circt-opt -mlir-print-debuginfo | FileCheck %s
+// RUN: circt-opt -emit-binary %s -o %t.mlirbc
+// RUN: firtool %t.mlirbc -mlir -mlir-print-debuginfo | FileCheck %s
+// RUN: firtool %t.mlirbc -emit-binary | circt-opt -mlir-print-debuginfo | FileCheck %s
+
+// CHECK-LABEL: firrtl.circuit "Top"
+firrtl.circuit "Top" {
+  // CHECK: firrtl.module @Top(%in: !firrtl.uint<8>, %out: !firrtl.flip<uint<8>>)
+  firrtl.module @Top(%in : !firrtl.uint<8>, %out : !firrtl.flip<uint<8>>) {
+    // CHECK-NEXT: firrtl.connect %out, %in : !firrtl.flip<uint<8>>, !firrtl.uint<8> loc("Top.fir":4:5)
+    firrtl.connect %out, %in : !firrtl.flip<uint<8>>, !firrtl.uint<8> loc("Top.fir":4:5)
+  }
+}
+
+// Values used before they are defined are read back through a placeholder.
+
+// CHECK-LABEL: rtl.module @forward(%a: i8) -> (%b: i8)
+rtl.module @forward(%a: i8) -> (%b: i8) {
+  // CHECK-NEXT: %0 = rtl.add %a, %1 : i8 loc(fused["a.fir":1:2, "b.fir":3:4])
+  %0 = rtl.add %a, %1 : i8 loc(fused["a.fir":1:2, "b.fir":3:4])
+  // CHECK-NEXT: %1 = rtl.add %a, %a : i8 loc("sum"("a.fir":1:2))
+  %1 = rtl.add %a, %a : i8 loc("sum"("a.fir":1:2))
+  // CHECK-NEXT: rtl.output %0 : i8
+  rtl.output %0 : i8
+}
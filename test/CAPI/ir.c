@@ -11,10 +11,15 @@
  */
 
 #include "mlir-c/IR.h"
+#include "circt-c/ExportVerilog.h"
+#include "circt-c/FIRRTLDialect.h"
+#include "circt-c/Passes.h"
 #include "circt-c/RTLDialect.h"
+#include "circt-c/SVDialect.h"
 #include "mlir-c/AffineExpr.h"
 #include "mlir-c/AffineMap.h"
 #include "mlir-c/Diagnostics.h"
+#include "mlir-c/Pass.h"
 #include "mlir-c/Registration.h"
 
 #include <assert.h>
@@ -59,6 +64,62 @@ int registerOnlyRTL() {
   return 0;
 }
 
+/// A buffer collecting the output of a string callback.
+typedef struct {
+  char data[1024];
+  size_t length;
+} OutputBuffer;
+
+static void appendToBuffer(MlirStringRef str, void *userData) {
+  OutputBuffer *buffer = (OutputBuffer *)userData;
+  size_t length = str.length;
+  if (length > sizeof(buffer->data) - 1 - buffer->length)
+    length = sizeof(buffer->data) - 1 - buffer->length;
+  memcpy(buffer->data + buffer->length, str.data, length);
+  buffer->length += length;
+  buffer->data[buffer->length] = 0;
+}
+
+int lowerFIRRTLInProcess() {
+  MlirContext ctx = mlirContextCreate();
+  mlirContextRegisterFIRRTLDialect(ctx);
+  mlirContextRegisterRTLDialect(ctx);
+  mlirContextRegisterSVDialect(ctx);
+  mlirRegisterCIRCTPasses();
+
+  const char *fir = "circuit Top :\n"
+                    "  module Top :\n"
+                    "    input a : UInt<4>\n"
+                    "    output b : UInt<4>\n"
+                    "    b <= a\n";
+  MlirModule module =
+      mlirFIRRTLImportFIRBuffer(ctx, mlirStringRefCreateFromCString(fir),
+                                mlirStringRefCreateFromCString("Top.fir"));
+  if (mlirModuleIsNull(module))
+    return 1;
+
+  MlirPassManager pm = mlirPassManagerCreate(ctx);
+  MlirStringRef pipeline = mlirStringRefCreateFromCString(
+      "lower-firrtl-to-rtl-module,rtl.module(lower-firrtl-to-rtl)");
+  if (mlirLogicalResultIsFailure(
+          mlirParsePassPipeline(mlirPassManagerGetAsOpPassManager(pm),
+                                pipeline)))
+    return 2;
+  if (mlirLogicalResultIsFailure(mlirPassManagerRun(pm, module)))
+    return 3;
+
+  OutputBuffer verilog = {{0}, 0};
+  if (mlirLogicalResultIsFailure(
+          mlirExportVerilog(module, appendToBuffer, &verilog)))
+    return 4;
+  fprintf(stderr, "%s", verilog.data);
+
+  mlirPassManagerDestroy(pm);
+  mlirModuleDestroy(module);
+  mlirContextDestroy(ctx);
+  return 0;
+}
+
 int main() {
   fprintf(stderr, "@registration\n");
   int errcode = registerOnlyRTL();
@@ -68,5 +129,16 @@ int main() {
   // CHECK: 0
   // clang-format on
 
+  fprintf(stderr, "@lowering\n");
+  errcode = lowerFIRRTLInProcess();
+  fprintf(stderr, "%d\n", errcode);
+  // clang-format off
+  // CHECK-LABEL: @lowering
+  // CHECK: module Top(
+  // CHECK: assign b = a;
+  // CHECK: endmodule
+  // CHECK: {{^0$}}
+  // clang-format on
+
   return 0;
 }
@@ -0,0 +1,75 @@
+// RUN: circt-opt -lower-firrtl-to-rtl='init-mode=seeded' %s | FileCheck %s --check-prefix=SEEDED
+// RUN: circt-opt -lower-firrtl-to-rtl='init-mode=zero' %s | FileCheck %s --check-prefix=ZERO
+// RUN: circt-opt -lower-firrtl-to-rtl='mem-init-files=true' %s | FileCheck %s --check-prefix=FILES
+// RUN: circt-opt -lower-firrtl-to-rtl='init-mode=bogus' %s -verify-diagnostics
+
+module attributes {firrtl.mainModule = "Init"} {
+  // expected-error @+1 {{unknown init-mode 'bogus'}}
+  rtl.module @Init(%clock: i1, %reset: i1) {
+    %0 = firrtl.stdIntCast %clock : (i1) -> !firrtl.clock
+    %1 = firrtl.stdIntCast %reset : (i1) -> !firrtl.uint<1>
+    %c0_ui8 = firrtl.constant(0 : ui8) : !firrtl.uint<8>
+    %a = firrtl.reg %0 {name = "a"} : (!firrtl.clock) -> !firrtl.uint<4>
+    %b = firrtl.regreset %0, %1, %c0_ui8 {name = "b"} : (!firrtl.clock, !firrtl.uint<1>, !firrtl.uint<8>) -> !firrtl.uint<8>
+    %m = firrtl.mem "Undefined" {depth = 12 : i64, name = "m", readLatency = 0 : i32, writeLatency = 1 : i32} : !firrtl.bundle<read: bundle<addr: flip<uint<4>>, en: flip<uint<1>>, clk: flip<clock>, data: sint<42>>>
+    rtl.output
+  }
+}
+
+// All of the state is initialized by one initial block at the end of the
+// module.
+
+// SEEDED-LABEL: rtl.module @Init
+// SEEDED-NOT:   sv.initial
+// SEEDED:       sv.ifdef "!SYNTHESIS"  {
+// SEEDED-NEXT:    sv.initial  {
+// SEEDED-NEXT:      sv.verbatim "integer _init_seed;"
+// SEEDED-NEXT:      sv.verbatim "`INIT_RANDOM_PROLOG_"
+// SEEDED-NEXT:      sv.ifdef "INIT_SEED"  {
+// SEEDED-NEXT:        sv.verbatim "_init_seed = `INIT_SEED ^ 32'd{{[0-9]+}};"
+// SEEDED-NEXT:      } else  {
+// SEEDED-NEXT:        sv.verbatim "_init_seed = 32'd{{[0-9]+}};"
+// SEEDED-NEXT:      }
+// SEEDED-NEXT:      sv.ifdef "RANDOMIZE_REG_INIT"  {
+// SEEDED-NEXT:        [[A:%.+]] = sv.textual_value "$random(_init_seed)" : i4
+// SEEDED-NEXT:        sv.bpassign %a, [[A]] : i4
+// SEEDED-NEXT:        %true = rtl.constant(true) : i1
+// SEEDED-NEXT:        [[NORESET:%.+]] = rtl.xor %reset, %true : i1
+// SEEDED-NEXT:        sv.if [[NORESET]]  {
+// SEEDED-NEXT:          [[B:%.+]] = sv.textual_value "$random(_init_seed)" : i8
+// SEEDED-NEXT:          sv.bpassign %b, [[B]] : i8
+// SEEDED-NEXT:        }
+// SEEDED-NEXT:      }
+// SEEDED-NEXT:      sv.ifdef "RANDOMIZE_MEM_INIT"  {
+// SEEDED-NEXT:        sv.verbatim "integer {{.*}}_initvar < 12{{.*}} = $random(_init_seed);"(%m)
+// SEEDED-NEXT:      }
+// SEEDED-NEXT:    }
+// SEEDED-NEXT:  }
+// SEEDED-NEXT:  rtl.output
+
+// ZERO-LABEL: rtl.module @Init
+// ZERO-NOT:   sv.initial
+// ZERO:       sv.ifdef "!SYNTHESIS"  {
+// ZERO-NEXT:    sv.initial  {
+// ZERO-NEXT:      [[A:%.+]] = sv.textual_value "'0" : i4
+// ZERO-NEXT:      sv.bpassign %a, [[A]] : i4
+// ZERO:           sv.if
+// ZERO-NEXT:        [[B:%.+]] = sv.textual_value "'0" : i8
+// ZERO-NEXT:        sv.bpassign %b, [[B]] : i8
+// ZERO-NEXT:      }
+// ZERO-NEXT:      sv.verbatim "integer {{.*}}_initvar < 12{{.*}} = '0;"(%m)
+// ZERO-NEXT:    }
+// ZERO-NEXT:  }
+// ZERO-NEXT:  rtl.output
+
+// Registers keep their own random initializer, memories are loaded from files.
+
+// FILES-LABEL: rtl.module @Init
+// FILES:         sv.textual_value "`RANDOM" : i4
+// FILES:         sv.textual_value "`RANDOM" : i8
+// FILES:       sv.ifdef "!SYNTHESIS"  {
+// FILES-NEXT:    sv.initial  {
+// FILES-NEXT:      sv.verbatim "$readmemh(\22m.hex\22, {{[{][{]0[}][}]}});"(%m)
+// FILES-NEXT:    }
+// FILES-NEXT:  }
+// FILES-NEXT:  rtl.output
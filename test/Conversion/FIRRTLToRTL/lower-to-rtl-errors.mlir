@@ -0,0 +1,14 @@
+// RUN: circt-opt -lower-firrtl-to-rtl %s -verify-diagnostics
+
+module attributes {firrtl.mainModule = "DynamicWireWrite"} {
+  rtl.module @DynamicWireWrite(%a: i4, %idx: i1) {
+    %0 = firrtl.stdIntCast %a : (i4) -> !firrtl.uint<4>
+    %1 = firrtl.stdIntCast %idx : (i1) -> !firrtl.uint<1>
+    %w = firrtl.wire : !firrtl.vector<uint<4>, 2>
+    %2 = firrtl.subaccess %w[%1] : !firrtl.vector<uint<4>, 2>, !firrtl.uint<1>
+    // expected-error @+2 {{LowerToRTL couldn't handle this operation}}
+    // expected-error @+1 {{cannot lower a connect to a dynamically indexed vector which isn't a register}}
+    firrtl.connect %2, %0 : !firrtl.uint<4>, !firrtl.uint<4>
+    rtl.output
+  }
+}
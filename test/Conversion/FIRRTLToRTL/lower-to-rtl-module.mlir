@@ -317,4 +317,26 @@ firrtl.circuit "Simple" {
     // CHECK: [[OUTAC:%.+]] = firrtl.stdIntCast [[OUTA]] : (!firrtl.uint<4>) -> i4
     // CHECK: rtl.output [[OUTAC]] : i4
   }
+
+  // Unnamed wires driven by a single connect are replaced by their driver.
+  // CHECK-LABEL: rtl.module @ForwardWires
+  firrtl.module @ForwardWires(%a: !firrtl.uint<3>, %b: !firrtl.uint<4>,
+                              %out: !firrtl.flip<uint<4>>,
+                              %out2: !firrtl.flip<uint<4>>) {
+    // CHECK-NOT: firrtl.wire : !firrtl.uint<4>
+    // CHECK: [[A:%.+]] = firrtl.stdIntCast %a
+    // CHECK: [[B:%.+]] = firrtl.stdIntCast %b
+    // CHECK: [[PAD:%.+]] = firrtl.pad [[A]], 4
+    // CHECK: [[XOR:%.+]] = firrtl.xor [[PAD]], [[B]]
+    %0 = firrtl.wire : !firrtl.uint<4>
+    %1 = firrtl.xor %0, %b : (!firrtl.uint<4>, !firrtl.uint<4>) -> !firrtl.uint<4>
+    firrtl.connect %0, %a : !firrtl.uint<4>, !firrtl.uint<3>
+    firrtl.connect %out, %1 : !firrtl.flip<uint<4>>, !firrtl.uint<4>
+
+    // Named wires are kept.
+    // CHECK: %w = firrtl.wire {name = "w"} : !firrtl.uint<4>
+    %w = firrtl.wire {name = "w"} : !firrtl.uint<4>
+    firrtl.connect %w, %b : !firrtl.uint<4>, !firrtl.uint<4>
+    firrtl.connect %out2, %w : !firrtl.flip<uint<4>>, !firrtl.uint<4>
+  }
 }
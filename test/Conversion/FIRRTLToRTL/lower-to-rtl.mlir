@@ -75,10 +75,10 @@ module attributes {firrtl.mainModule = "Simple"} {
     // CHECK-NEXT: = rtl.wire : !rtl.inout<i2>
     firrtl.wire : !firrtl.uint<2>
 
-    // CHECK-NEXT: = firrtl.wire : !firrtl.vector<uint<1>, 13>
+    // CHECK-NEXT: = rtl.wire : !rtl.inout<array<13xi1>>
     %_t_2 = firrtl.wire : !firrtl.vector<uint<1>, 13>
 
-    // CHECK-NEXT: = firrtl.wire : !firrtl.vector<uint<2>, 13>
+    // CHECK-NEXT: = rtl.wire : !rtl.inout<array<13xi2>>
     %_t_3 = firrtl.wire : !firrtl.vector<uint<2>, 13>
 
     // CHECK-NEXT: = rtl.extract [[CONCAT1]] from 3 : (i8) -> i5
@@ -829,4 +829,110 @@ module attributes {firrtl.mainModule = "Simple"} {
     %3 = firrtl.pad %2, 23 : (!firrtl.uint<0>) -> !firrtl.uint<23>
     %4 = firrtl.stdIntCast %3 : (!firrtl.uint<23>) -> i23
     rtl.output %4 : i23
-  }}
+  }
+
+  // The address of a read port is pipelined for the read latency.
+  // CHECK-LABEL: rtl.module @MemReadLatency(
+  // CHECK:      %_M_read_addr_pipe_0 = sv.reg : !rtl.inout<i4>
+  // CHECK-NEXT: %_M_read_addr_pipe_1 = sv.reg : !rtl.inout<i4>
+  // CHECK-NEXT: sv.always posedge %{{.+}}  {
+  // CHECK-NEXT:   sv.if %{{.+}}  {
+  // CHECK-NEXT:     sv.passign %_M_read_addr_pipe_0, %{{.+}} : i4
+  // CHECK-NEXT:   }
+  // CHECK-NEXT:   [[PIPE0:%.+]] = rtl.read_inout %_M_read_addr_pipe_0
+  // CHECK-NEXT:   sv.passign %_M_read_addr_pipe_1, [[PIPE0]] : i4
+  // CHECK-NEXT: }
+  // CHECK-NEXT: [[PIPE1:%.+]] = rtl.read_inout %_M_read_addr_pipe_1
+  // CHECK-NEXT: [[SLOT:%.+]] = rtl.arrayindex %_M{{\[}}[[PIPE1]]{{\]}}
+  // CHECK-NEXT: [[DATA:%.+]] = rtl.read_inout [[SLOT]]
+  // CHECK-NEXT: rtl.connect %_M_read_data, [[DATA]] : i8
+  rtl.module @MemReadLatency(%clock: i1, %en: i1, %addr: i4) -> (%result: i8) {
+    %0 = firrtl.stdIntCast %clock : (i1) -> !firrtl.clock
+    %1 = firrtl.stdIntCast %en : (i1) -> !firrtl.uint<1>
+    %2 = firrtl.stdIntCast %addr : (i4) -> !firrtl.uint<4>
+    %_M = firrtl.mem "Undefined" {depth = 16 : i64, name = "_M", readLatency = 2 : i32, writeLatency = 1 : i32} : !firrtl.bundle<read: bundle<addr: flip<uint<4>>, en: flip<uint<1>>, clk: flip<clock>, data: sint<8>>>
+    %3 = firrtl.subfield %_M("read") : (!firrtl.bundle<read: bundle<addr: flip<uint<4>>, en: flip<uint<1>>, clk: flip<clock>, data: sint<8>>>) -> !firrtl.bundle<addr: flip<uint<4>>, en: flip<uint<1>>, clk: flip<clock>, data: sint<8>>
+    %4 = firrtl.subfield %3("addr") : (!firrtl.bundle<addr: flip<uint<4>>, en: flip<uint<1>>, clk: flip<clock>, data: sint<8>>) -> !firrtl.flip<uint<4>>
+    firrtl.connect %4, %2 : !firrtl.flip<uint<4>>, !firrtl.uint<4>
+    %5 = firrtl.subfield %3("en") : (!firrtl.bundle<addr: flip<uint<4>>, en: flip<uint<1>>, clk: flip<clock>, data: sint<8>>) -> !firrtl.flip<uint<1>>
+    firrtl.connect %5, %1 : !firrtl.flip<uint<1>>, !firrtl.uint<1>
+    %6 = firrtl.subfield %3("clk") : (!firrtl.bundle<addr: flip<uint<4>>, en: flip<uint<1>>, clk: flip<clock>, data: sint<8>>) -> !firrtl.flip<clock>
+    firrtl.connect %6, %0 : !firrtl.flip<clock>, !firrtl.clock
+    %7 = firrtl.subfield %3("data") : (!firrtl.bundle<addr: flip<uint<4>>, en: flip<uint<1>>, clk: flip<clock>, data: sint<8>>) -> !firrtl.sint<8>
+    %8 = firrtl.stdIntCast %7 : (!firrtl.sint<8>) -> i8
+    rtl.output %8 : i8
+  }
+
+  // All signals of a write port are delayed by the extra write latency.
+  // CHECK-LABEL: rtl.module @MemWriteLatency(
+  // CHECK:      %_M_write_en_pipe_0 = sv.reg : !rtl.inout<i1>
+  // CHECK-NEXT: %_M_write_en_pipe_1 = sv.reg : !rtl.inout<i1>
+  // CHECK-NEXT: sv.always posedge [[CLK:%.+]]  {
+  // CHECK-NEXT:   sv.passign %_M_write_en_pipe_0, %{{.+}} : i1
+  // CHECK-NEXT:   [[EN0:%.+]] = rtl.read_inout %_M_write_en_pipe_0
+  // CHECK-NEXT:   sv.passign %_M_write_en_pipe_1, [[EN0]] : i1
+  // CHECK-NEXT: }
+  // CHECK-NEXT: [[EN:%.+]] = rtl.read_inout %_M_write_en_pipe_1
+  // CHECK:      %_M_write_mask_pipe_1 = sv.reg : !rtl.inout<i1>
+  // CHECK:      [[MASK:%.+]] = rtl.read_inout %_M_write_mask_pipe_1
+  // CHECK:      %_M_write_data_pipe_1 = sv.reg : !rtl.inout<i8>
+  // CHECK:      [[DATA:%.+]] = rtl.read_inout %_M_write_data_pipe_1
+  // CHECK:      %_M_write_addr_pipe_1 = sv.reg : !rtl.inout<i4>
+  // CHECK:      [[ADDR:%.+]] = rtl.read_inout %_M_write_addr_pipe_1
+  // CHECK-NEXT: sv.always posedge [[CLK]]  {
+  // CHECK-NEXT:   [[COND:%.+]] = rtl.and [[EN]], [[MASK]] : i1
+  // CHECK-NEXT:   sv.if [[COND]]  {
+  // CHECK-NEXT:     [[SLOT:%.+]] = rtl.arrayindex %_M{{\[}}[[ADDR]]{{\]}}
+  // CHECK-NEXT:     sv.bpassign [[SLOT]], [[DATA]] : i8
+  rtl.module @MemWriteLatency(%clock: i1, %en: i1, %addr: i4, %data: i8) {
+    %0 = firrtl.stdIntCast %clock : (i1) -> !firrtl.clock
+    %1 = firrtl.stdIntCast %en : (i1) -> !firrtl.uint<1>
+    %2 = firrtl.stdIntCast %addr : (i4) -> !firrtl.uint<4>
+    %3 = firrtl.stdIntCast %data : (i8) -> !firrtl.sint<8>
+    %c1_ui1 = firrtl.constant(1 : ui1) : !firrtl.uint<1>
+    %_M = firrtl.mem "Undefined" {depth = 16 : i64, name = "_M", readLatency = 0 : i32, writeLatency = 3 : i32} : !firrtl.bundle<write: flip<bundle<addr: uint<4>, en: uint<1>, clk: clock, data: sint<8>, mask: uint<1>>>>
+    %4 = firrtl.subfield %_M("write") : (!firrtl.bundle<write: flip<bundle<addr: uint<4>, en: uint<1>, clk: clock, data: sint<8>, mask: uint<1>>>>) -> !firrtl.flip<bundle<addr: uint<4>, en: uint<1>, clk: clock, data: sint<8>, mask: uint<1>>>
+    %5 = firrtl.subfield %4("addr") : (!firrtl.flip<bundle<addr: uint<4>, en: uint<1>, clk: clock, data: sint<8>, mask: uint<1>>>) -> !firrtl.flip<uint<4>>
+    firrtl.connect %5, %2 : !firrtl.flip<uint<4>>, !firrtl.uint<4>
+    %6 = firrtl.subfield %4("en") : (!firrtl.flip<bundle<addr: uint<4>, en: uint<1>, clk: clock, data: sint<8>, mask: uint<1>>>) -> !firrtl.flip<uint<1>>
+    firrtl.connect %6, %1 : !firrtl.flip<uint<1>>, !firrtl.uint<1>
+    %7 = firrtl.subfield %4("clk") : (!firrtl.flip<bundle<addr: uint<4>, en: uint<1>, clk: clock, data: sint<8>, mask: uint<1>>>) -> !firrtl.flip<clock>
+    firrtl.connect %7, %0 : !firrtl.flip<clock>, !firrtl.clock
+    %8 = firrtl.subfield %4("data") : (!firrtl.flip<bundle<addr: uint<4>, en: uint<1>, clk: clock, data: sint<8>, mask: uint<1>>>) -> !firrtl.flip<sint<8>>
+    firrtl.connect %8, %3 : !firrtl.flip<sint<8>>, !firrtl.sint<8>
+    %9 = firrtl.subfield %4("mask") : (!firrtl.flip<bundle<addr: uint<4>, en: uint<1>, clk: clock, data: sint<8>, mask: uint<1>>>) -> !firrtl.flip<uint<1>>
+    firrtl.connect %9, %c1_ui1 : !firrtl.flip<uint<1>>, !firrtl.uint<1>
+    rtl.output
+  }
+
+  // Memories tagged with a macro are lowered to an instance of it.
+  rtl.externmodule @_M_ext(%R0_addr: i4, %R0_en: i1, %R0_clk: i1) -> (%R0_data: i8)
+
+  // CHECK-LABEL: rtl.module @MemMacro(
+  // CHECK-NOT:  sv.reg
+  // CHECK:      %_M_read_addr = rtl.wire : !rtl.inout<i4>
+  // CHECK-NEXT: [[ADDR:%.+]] = rtl.read_inout %_M_read_addr
+  // CHECK-NEXT: %_M_read_en = rtl.wire : !rtl.inout<i1>
+  // CHECK-NEXT: [[EN:%.+]] = rtl.read_inout %_M_read_en
+  // CHECK-NEXT: %_M_read_clk = rtl.wire : !rtl.inout<i1>
+  // CHECK-NEXT: [[CLK:%.+]] = rtl.read_inout %_M_read_clk
+  // CHECK-NEXT: %_M_read_data = rtl.wire : !rtl.inout<i8>
+  // CHECK-NEXT: [[DATA:%.+]] = rtl.instance "_M" @_M_ext([[ADDR]], [[EN]], [[CLK]]) : (i4, i1, i1) -> i8
+  // CHECK-NEXT: rtl.connect %_M_read_data, [[DATA]] : i8
+  rtl.module @MemMacro(%clock: i1, %en: i1, %addr: i4) -> (%result: i8) {
+    %0 = firrtl.stdIntCast %clock : (i1) -> !firrtl.clock
+    %1 = firrtl.stdIntCast %en : (i1) -> !firrtl.uint<1>
+    %2 = firrtl.stdIntCast %addr : (i4) -> !firrtl.uint<4>
+    %_M = firrtl.mem "Undefined" {depth = 16 : i64, firrtl.memMacro = @_M_ext, name = "_M", readLatency = 1 : i32, writeLatency = 1 : i32} : !firrtl.bundle<read: bundle<addr: flip<uint<4>>, en: flip<uint<1>>, clk: flip<clock>, data: sint<8>>>
+    %3 = firrtl.subfield %_M("read") : (!firrtl.bundle<read: bundle<addr: flip<uint<4>>, en: flip<uint<1>>, clk: flip<clock>, data: sint<8>>>) -> !firrtl.bundle<addr: flip<uint<4>>, en: flip<uint<1>>, clk: flip<clock>, data: sint<8>>
+    %4 = firrtl.subfield %3("addr") : (!firrtl.bundle<addr: flip<uint<4>>, en: flip<uint<1>>, clk: flip<clock>, data: sint<8>>) -> !firrtl.flip<uint<4>>
+    firrtl.connect %4, %2 : !firrtl.flip<uint<4>>, !firrtl.uint<4>
+    %5 = firrtl.subfield %3("en") : (!firrtl.bundle<addr: flip<uint<4>>, en: flip<uint<1>>, clk: flip<clock>, data: sint<8>>) -> !firrtl.flip<uint<1>>
+    firrtl.connect %5, %1 : !firrtl.flip<uint<1>>, !firrtl.uint<1>
+    %6 = firrtl.subfield %3("clk") : (!firrtl.bundle<addr: flip<uint<4>>, en: flip<uint<1>>, clk: flip<clock>, data: sint<8>>) -> !firrtl.flip<clock>
+    firrtl.connect %6, %0 : !firrtl.flip<clock>, !firrtl.clock
+    %7 = firrtl.subfield %3("data") : (!firrtl.bundle<addr: flip<uint<4>>, en: flip<uint<1>>, clk: flip<clock>, data: sint<8>>) -> !firrtl.sint<8>
+    %8 = firrtl.stdIntCast %7 : (!firrtl.sint<8>) -> i8
+    rtl.output %8 : i8
+  }
+}
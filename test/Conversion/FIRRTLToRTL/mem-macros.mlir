@@ -0,0 +1,28 @@
+// RUN: circt-opt -lower-firrtl-to-rtl-module='mem-macro-threshold=128 mem-macro-conf=%t.conf' %s | FileCheck %s
+// RUN: FileCheck --check-prefix=CONF %s < %t.conf
+
+// Memories with the same configuration share a macro, named after the first.
+// CHECK-LABEL: rtl.externmodule @big_ext(%R0_addr: i5, %R0_en: i1, %R0_clk: i1, %W0_addr: i5, %W0_en: i1, %W0_clk: i1, %W0_data: i8, %W0_mask: i1) -> (%R0_data: i8)
+// CHECK-NOT: rtl.externmodule
+
+// CONF: name big_ext depth 32 width 8 ports read,mwrite mask_gran 8
+// CONF-NOT: name
+
+firrtl.circuit "Top" {
+  // CHECK-LABEL: rtl.module @Top()
+  firrtl.module @Top() {
+    // CHECK: %big = firrtl.mem "Undefined" {depth = 32 : i64, firrtl.memMacro = @big_ext, name = "big"
+    %big = firrtl.mem "Undefined" {depth = 32 : i64, name = "big", readLatency = 1 : i32, writeLatency = 1 : i32} : !firrtl.bundle<read: bundle<addr: flip<uint<5>>, en: flip<uint<1>>, clk: flip<clock>, data: sint<8>>, write: flip<bundle<addr: uint<5>, en: uint<1>, clk: clock, data: sint<8>, mask: uint<1>>>>
+
+    // CHECK: %other = firrtl.mem "Undefined" {depth = 32 : i64, firrtl.memMacro = @big_ext, name = "other"
+    %other = firrtl.mem "Undefined" {depth = 32 : i64, name = "other", readLatency = 1 : i32, writeLatency = 1 : i32} : !firrtl.bundle<read: bundle<addr: flip<uint<5>>, en: flip<uint<1>>, clk: flip<clock>, data: sint<8>>, write: flip<bundle<addr: uint<5>, en: uint<1>, clk: clock, data: sint<8>, mask: uint<1>>>>
+
+    // Memories below the threshold stay registers.
+    // CHECK: %small = firrtl.mem "Undefined" {depth = 8 : i64, name = "small"
+    %small = firrtl.mem "Undefined" {depth = 8 : i64, name = "small", readLatency = 1 : i32, writeLatency = 1 : i32} : !firrtl.bundle<read: bundle<addr: flip<uint<3>>, en: flip<uint<1>>, clk: flip<clock>, data: sint<8>>>
+
+    // So do memories with a combinational read.
+    // CHECK: %comb = firrtl.mem "Undefined" {depth = 32 : i64, name = "comb"
+    %comb = firrtl.mem "Undefined" {depth = 32 : i64, name = "comb", readLatency = 0 : i32, writeLatency = 1 : i32} : !firrtl.bundle<read: bundle<addr: flip<uint<5>>, en: flip<uint<1>>, clk: flip<clock>, data: sint<8>>>
+  }
+}
@@ -0,0 +1,63 @@
+// RUN: circt-opt -lower-firrtl-to-rtl-module -lower-firrtl-to-rtl %s | FileCheck %s
+
+// Passive vectors of ground types are kept as RTL arrays instead of being
+// scalarized.
+firrtl.circuit "Vectors" {
+
+  // CHECK-LABEL: rtl.module @Vectors(%in: !rtl.array<4xi8>, %idx: i2, %clock: i1) -> (%out: !rtl.array<4xi8>, %elt: i8, %dyn: i8, %regOut: !rtl.array<4xi8>) {
+  firrtl.module @Vectors(%in: !firrtl.vector<uint<8>, 4>, %idx: !firrtl.uint<2>,
+                         %clock: !firrtl.clock,
+                         %out: !firrtl.flip<vector<uint<8>, 4>>,
+                         %elt: !firrtl.flip<uint<8>>,
+                         %dyn: !firrtl.flip<uint<8>>,
+                         %regOut: !firrtl.flip<vector<uint<8>, 4>>) {
+    firrtl.connect %out, %in : !firrtl.flip<vector<uint<8>, 4>>, !firrtl.vector<uint<8>, 4>
+
+    // Input ports are put in a wire once, to be indexed.
+    // CHECK:      [[IN:%.+]] = rtl.wire : !rtl.inout<array<4xi8>>
+    // CHECK-NEXT: rtl.connect [[IN]], %in : !rtl.array<4xi8>
+    // CHECK:      [[ELT:%.+]] = rtl.arrayindex [[IN]]{{\[}}%c-2_i2{{\]}}
+    // CHECK-NEXT: [[ELTVAL:%.+]] = rtl.read_inout [[ELT]] : !rtl.inout<i8>
+    %0 = firrtl.subindex %in[2] : !firrtl.vector<uint<8>, 4>
+    firrtl.connect %elt, %0 : !firrtl.flip<uint<8>>, !firrtl.uint<8>
+
+    // CHECK-NEXT: [[DYN:%.+]] = rtl.arrayindex [[IN]]{{\[}}%idx{{\]}}
+    // CHECK-NEXT: [[DYNVAL:%.+]] = rtl.read_inout [[DYN]] : !rtl.inout<i8>
+    %1 = firrtl.subaccess %in[%idx] : !firrtl.vector<uint<8>, 4>, !firrtl.uint<2>
+    firrtl.connect %dyn, %1 : !firrtl.flip<uint<8>>, !firrtl.uint<8>
+
+    // Registers can be written through a dynamic index.
+    // CHECK:      %r = sv.reg : !rtl.inout<array<4xi8>>
+    // CHECK:      [[REGELT:%.+]] = rtl.arrayindex %r{{\[}}%idx{{\]}}
+    // CHECK-NEXT: sv.always posedge %clock {
+    // CHECK-NEXT:   sv.passign [[REGELT]], [[ELTVAL]] : i8
+    // CHECK-NEXT: }
+    %r = firrtl.reg %clock {name = "r"} : (!firrtl.clock) -> !firrtl.vector<uint<8>, 4>
+    %2 = firrtl.subaccess %r[%idx] : !firrtl.vector<uint<8>, 4>, !firrtl.uint<2>
+    firrtl.connect %2, %0 : !firrtl.uint<8>, !firrtl.uint<8>
+    firrtl.connect %regOut, %r : !firrtl.flip<vector<uint<8>, 4>>, !firrtl.vector<uint<8>, 4>
+
+    // CHECK:      [[REG:%.+]] = rtl.read_inout %r : !rtl.inout<array<4xi8>>
+    // CHECK-NEXT: rtl.output %in, [[ELTVAL]], [[DYNVAL]], [[REG]] : !rtl.array<4xi8>, i8, i8, !rtl.array<4xi8>
+  }
+
+  // CHECK-LABEL: rtl.module @VectorWire(%a: i4, %b: i4) -> (%c: !rtl.array<2xi4>) {
+  firrtl.module @VectorWire(%a: !firrtl.uint<4>, %b: !firrtl.uint<4>,
+                            %c: !firrtl.flip<vector<uint<4>, 2>>) {
+    // CHECK-NEXT: %w = rtl.wire : !rtl.inout<array<2xi4>>
+    // CHECK-NEXT: %false = rtl.constant(false) : i1
+    // CHECK-NEXT: [[W0:%.+]] = rtl.arrayindex %w[%false]
+    // CHECK-NEXT: %true = rtl.constant(true) : i1
+    // CHECK-NEXT: [[W1:%.+]] = rtl.arrayindex %w[%true]
+    // CHECK-NEXT: rtl.connect [[W0]], %a : i4
+    // CHECK-NEXT: rtl.connect [[W1]], %b : i4
+    %w = firrtl.wire {name = "w"} : !firrtl.vector<uint<4>, 2>
+    %0 = firrtl.subindex %w[0] : !firrtl.vector<uint<4>, 2>
+    %1 = firrtl.subindex %w[1] : !firrtl.vector<uint<4>, 2>
+    firrtl.connect %0, %a : !firrtl.uint<4>, !firrtl.uint<4>
+    firrtl.connect %1, %b : !firrtl.uint<4>, !firrtl.uint<4>
+    firrtl.connect %c, %w : !firrtl.flip<vector<uint<4>, 2>>, !firrtl.vector<uint<4>, 2>
+    // CHECK-NEXT: [[W:%.+]] = rtl.read_inout %w : !rtl.inout<array<2xi4>>
+    // CHECK-NEXT: rtl.output [[W]] : !rtl.array<2xi4>
+  }
+}
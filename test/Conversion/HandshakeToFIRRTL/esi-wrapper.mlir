@@ -0,0 +1,24 @@
+// RUN: circt-opt -handshake-esi-wrapper %s | FileCheck %s
+// RUN: circt-opt -handshake-esi-wrapper=modules=other -verify-diagnostics %s
+
+// The top-module of 'handshake.func @add(%arg0: i32, %arg1: none, ...) ->
+// (i32, none)', after lowering it to RTL.
+
+// CHECK-LABEL: rtl.module @add_esi(%arg0: !esi.channel<i32>, %arg1: !esi.channel<i1>, %clock: i1, %reset: i1) -> (%arg2: !esi.channel<i32>, %arg3: !esi.channel<i1>) {
+// CHECK-NEXT:    [[IN0:%[0-9]+]]:2 = esi.unwrap.vr %arg0, %add.arg0_ready : i32
+// CHECK-NEXT:    [[IN1:%[0-9]+]]:2 = esi.unwrap.vr %arg1, %add.arg1_ready : i1
+// CHECK-NEXT:    %add.arg0_ready, %add.arg1_ready, %add.arg2_valid, %add.arg2_data, %add.arg3_valid = rtl.instance "add" @add([[IN0]]#1, [[IN0]]#0, [[IN1]]#1, [[OUT2:%[0-9]+]]#1, [[OUT3:%[0-9]+]]#1, %clock, %reset)
+// CHECK-NEXT:    [[OUT2]]:2 = esi.wrap.vr %add.arg2_data, %add.arg2_valid : i32
+// CHECK-NEXT:    [[ZERO:%.+]] = rtl.constant
+// CHECK-NEXT:    [[OUT3]]:2 = esi.wrap.vr [[ZERO]], %add.arg3_valid : i1
+// CHECK-NEXT:    rtl.output [[OUT2]]#0, [[OUT3]]#0
+rtl.module @add(%arg0_valid: i1, %arg0_data: i32, %arg1_valid: i1, %arg2_ready: i1, %arg3_ready: i1, %clock: i1, %reset: i1) -> (%arg0_ready: i1, %arg1_ready: i1, %arg2_valid: i1, %arg2_data: i32, %arg3_valid: i1) {
+  rtl.output %arg2_ready, %arg3_ready, %arg0_valid, %arg0_data, %arg1_valid : i1, i1, i1, i32, i1
+}
+
+// Modules with other ports are only wrapped on request.
+// CHECK-NOT: @other_esi
+// expected-error @+1 {{port 'a' is not part of a handshake channel}}
+rtl.module @other(%a: i1) -> (%b: i1) {
+  rtl.output %a : i1
+}
@@ -0,0 +1,76 @@
+// RUN: circt-opt -lower-handshake-to-firrtl='mem-read-latency=2 mem-banks=2' %s | FileCheck %s
+
+// CHECK-LABEL: firrtl.module @handshake_memory_3ins_3outs
+// CHECK: %[[ST_DATA_VALID:.+]] = firrtl.subfield %arg0("valid")
+// CHECK: %[[ST_ADDR_VALID:.+]] = firrtl.subfield %arg1("valid")
+// CHECK: %[[LD_ADDR_VALID:.+]] = firrtl.subfield %arg2("valid")
+// CHECK: %[[LD_ADDR_DATA:.+]] = firrtl.subfield %arg2("data")
+// CHECK: %[[LD_DATA_VALID:.+]] = firrtl.subfield %arg3("valid")
+// CHECK: %[[LD_DATA_READY:.+]] = firrtl.subfield %arg3("ready")
+// CHECK: %[[LD_DATA_DATA:.+]] = firrtl.subfield %arg3("data")
+
+// Each bank holds half of the elements.
+// CHECK: %[[BANK0:.+]] = firrtl.mem "Old" {depth = 4 : i64, name = "mem0_bank0", readLatency = 0 : i32, writeLatency = 1 : i32} : !firrtl.bundle<load0: bundle<addr: flip<uint<2>>
+// CHECK: %[[BANK1:.+]] = firrtl.mem "Old" {depth = 4 : i64, name = "mem0_bank1", readLatency = 0 : i32, writeLatency = 1 : i32}
+
+// The banks are indexed by the address without its lowest bit, and only
+// enabled if the lowest bit selects them.
+// CHECK: %[[BANK0_LOAD:.+]] = firrtl.subfield %[[BANK0]]("load0")
+// CHECK: %[[BANK0_ADDR:.+]] = firrtl.subfield %[[BANK0_LOAD]]("addr")
+// CHECK: %[[BANK0_ADDR_BITS:.+]] = firrtl.bits %[[LD_ADDR_DATA]] 2 to 1 : (!firrtl.uint<64>) -> !firrtl.uint<2>
+// CHECK: firrtl.connect %[[BANK0_ADDR]], %[[BANK0_ADDR_BITS]]
+// CHECK: %[[BANK0_DATA:.+]] = firrtl.subfield %[[BANK0_LOAD]]("data")
+// CHECK: %[[BANK0_EN:.+]] = firrtl.subfield %[[BANK0_LOAD]]("en")
+// CHECK: %[[BANK0_INDEX:.+]] = firrtl.bits %[[LD_ADDR_DATA]] 0 to 0
+// CHECK: %[[BANK0_CONST:.+]] = firrtl.constant(0 : ui1)
+// CHECK: %[[BANK0_SEL:.+]] = firrtl.eq %[[BANK0_INDEX]], %[[BANK0_CONST]]
+// CHECK: %[[BANK0_VALID:.+]] = firrtl.and %[[LD_ADDR_VALID]], %[[BANK0_SEL]]
+// CHECK: firrtl.connect %[[BANK0_EN]], %[[BANK0_VALID]]
+// CHECK: %[[BANK1_LOAD:.+]] = firrtl.subfield %[[BANK1]]("load0")
+// CHECK: %[[BANK1_DATA:.+]] = firrtl.subfield %[[BANK1_LOAD]]("data")
+
+// The load data is selected from the bank the address falls into.
+// CHECK: %[[DATA_INDEX:.+]] = firrtl.bits %[[LD_ADDR_DATA]] 0 to 0
+// CHECK: %[[DATA_SEL:.+]] = firrtl.bits %[[DATA_INDEX]] 0 to 0
+// CHECK: %[[MEM_DATA:.+]] = firrtl.mux(%[[DATA_SEL]], %[[BANK1_DATA]], %[[BANK0_DATA]])
+
+// The load is issued into a two stage pipeline in front of the load data.
+// CHECK: %issueValid = firrtl.wire : !firrtl.uint<1>
+// CHECK: %issueReady = firrtl.wire : !firrtl.uint<1>
+// CHECK: %stageValid0 = firrtl.regreset
+// CHECK: %stageData0 = firrtl.reg %clock {{.*}}-> !firrtl.uint<8>
+// CHECK: %stageValid1 = firrtl.regreset
+// CHECK: %stageData1 = firrtl.reg %clock {{.*}}-> !firrtl.uint<8>
+// CHECK: %[[NOT_VALID1:.+]] = firrtl.not %stageValid1
+// CHECK: %[[READY1:.+]] = firrtl.or %[[NOT_VALID1]], %[[LD_DATA_READY]]
+// CHECK: %[[NOT_VALID0:.+]] = firrtl.not %stageValid0
+// CHECK: %[[READY0:.+]] = firrtl.or %[[NOT_VALID0]], %[[READY1]]
+// CHECK: firrtl.connect %issueReady, %[[READY0]]
+// CHECK: %[[VALID0_MUX:.+]] = firrtl.mux(%[[READY0]], %issueValid, %stageValid0)
+// CHECK: firrtl.connect %stageValid0, %[[VALID0_MUX]]
+// CHECK: %[[DATA0_MUX:.+]] = firrtl.mux(%[[READY0]], %[[MEM_DATA]], %stageData0)
+// CHECK: firrtl.connect %stageData0, %[[DATA0_MUX]]
+// CHECK: %[[VALID1_MUX:.+]] = firrtl.mux(%[[READY1]], %stageValid0, %stageValid1)
+// CHECK: firrtl.connect %stageValid1, %[[VALID1_MUX]]
+// CHECK: %[[DATA1_MUX:.+]] = firrtl.mux(%[[READY1]], %stageData0, %stageData1)
+// CHECK: firrtl.connect %stageData1, %[[DATA1_MUX]]
+// CHECK: firrtl.connect %[[LD_DATA_VALID]], %stageValid1
+// CHECK: firrtl.connect %[[LD_DATA_DATA]], %stageData1
+
+// Stores write to every bank, but only the selected one is enabled.
+// CHECK: %[[BANK0_STORE:.+]] = firrtl.subfield %[[BANK0]]("store0")
+// CHECK: %[[BANK1_STORE:.+]] = firrtl.subfield %[[BANK1]]("store0")
+// CHECK: %[[WRITE_VALID:.+]] = firrtl.and %[[ST_ADDR_VALID]], %[[ST_DATA_VALID]]
+// CHECK: %[[BANK0_WRITE_VALID:.+]] = firrtl.and %[[WRITE_VALID]]
+// CHECK: %[[BANK0_STORE_EN:.+]] = firrtl.subfield %[[BANK0_STORE]]("en")
+// CHECK: firrtl.connect %[[BANK0_STORE_EN]], %[[BANK0_WRITE_VALID]]
+// CHECK: %[[BANK1_WRITE_VALID:.+]] = firrtl.and %[[WRITE_VALID]]
+// CHECK: %[[BANK1_STORE_EN:.+]] = firrtl.subfield %[[BANK1_STORE]]("en")
+// CHECK: firrtl.connect %[[BANK1_STORE_EN]], %[[BANK1_WRITE_VALID]]
+
+// CHECK-LABEL: firrtl.module @main
+handshake.func @main(%arg0: i8, %arg1: index, %arg2: index, ...) -> (i8, none, none) {
+  %0:3 = "handshake.memory"(%arg0, %arg1, %arg2) {id = 0 : i32, ld_count = 1 : i32, lsq = false, st_count = 1 : i32, type = memref<8xi8>} : (i8, index, index) -> (i8, none, none)
+
+  handshake.return %0#0, %0#1, %0#2: i8, none, none
+}
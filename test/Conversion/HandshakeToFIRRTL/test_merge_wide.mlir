@@ -0,0 +1,43 @@
+// RUN: circt-opt -lower-handshake-to-firrtl %s | FileCheck %s
+
+// Merges of more than four inputs select the result data with an AND-OR
+// reduction instead of a chain of muxes.
+
+// CHECK-LABEL: firrtl.module @handshake_merge_5ins_1outs(
+// CHECK:   %[[ARG0_DATA:.+]] = firrtl.subfield %arg0("data")
+// CHECK:   %[[ARG1_DATA:.+]] = firrtl.subfield %arg1("data")
+// CHECK:   %[[ARG2_DATA:.+]] = firrtl.subfield %arg2("data")
+// CHECK:   %[[ARG3_DATA:.+]] = firrtl.subfield %arg3("data")
+// CHECK:   %[[ARG4_DATA:.+]] = firrtl.subfield %arg4("data")
+// CHECK:   %[[RESULT_DATA:.+]] = firrtl.subfield %arg5("data")
+// CHECK:   %win = firrtl.wire : !firrtl.uint<5>
+
+// Every input is masked by its select bit.
+// CHECK:   %[[ZERO:.+]] = firrtl.constant(0 : ui64)
+// CHECK:   %[[BITS0:.+]] = firrtl.bits %win 0 to 0
+// CHECK:   %[[MASKED0:.+]] = firrtl.mux(%[[BITS0]], %[[ARG0_DATA]], %[[ZERO]])
+// CHECK:   %[[BITS1:.+]] = firrtl.bits %win 1 to 1
+// CHECK:   %[[MASKED1:.+]] = firrtl.mux(%[[BITS1]], %[[ARG1_DATA]], %[[ZERO]])
+// CHECK:   %[[BITS2:.+]] = firrtl.bits %win 2 to 2
+// CHECK:   %[[MASKED2:.+]] = firrtl.mux(%[[BITS2]], %[[ARG2_DATA]], %[[ZERO]])
+// CHECK:   %[[BITS3:.+]] = firrtl.bits %win 3 to 3
+// CHECK:   %[[MASKED3:.+]] = firrtl.mux(%[[BITS3]], %[[ARG3_DATA]], %[[ZERO]])
+// CHECK:   %[[BITS4:.+]] = firrtl.bits %win 4 to 4
+// CHECK:   %[[MASKED4:.+]] = firrtl.mux(%[[BITS4]], %[[ARG4_DATA]], %[[ZERO]])
+
+// The masked values are combined in a balanced tree.
+// CHECK:   %[[OR01:.+]] = firrtl.or %[[MASKED0]], %[[MASKED1]]
+// CHECK:   %[[OR23:.+]] = firrtl.or %[[MASKED2]], %[[MASKED3]]
+// CHECK:   %[[OR0123:.+]] = firrtl.or %[[OR01]], %[[OR23]]
+// CHECK:   %[[OR01234:.+]] = firrtl.or %[[OR0123]], %[[MASKED4]]
+// CHECK:   firrtl.connect %[[RESULT_DATA]], %[[OR01234]]
+
+// Both merges share the sub-module.
+// CHECK-LABEL: firrtl.module @test_merge_wide(
+// CHECK:   firrtl.instance @handshake_merge_5ins_1outs
+// CHECK:   firrtl.instance @handshake_merge_5ins_1outs
+handshake.func @test_merge_wide(%arg0: index, %arg1: index, %arg2: index, %arg3: index, %arg4: index, %arg5: none, ...) -> (index, index, none) {
+  %0 = "handshake.merge"(%arg0, %arg1, %arg2, %arg3, %arg4) : (index, index, index, index, index) -> index
+  %1 = "handshake.merge"(%arg4, %arg3, %arg2, %arg1, %arg0) : (index, index, index, index, index) -> index
+  handshake.return %0, %1, %arg5 : index, index, none
+}
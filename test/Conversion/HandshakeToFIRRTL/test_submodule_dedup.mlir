@@ -0,0 +1,26 @@
+// RUN: circt-opt -lower-handshake-to-firrtl %s | FileCheck %s
+
+// Operations share a sub-module only if they have the same types and
+// attributes. Different sub-modules with the same base name get a suffix.
+
+// CHECK-LABEL: firrtl.module @handshake_fork_1ins_2outs_ctrl(
+// CHECK-LABEL: firrtl.module @handshake_constant_1ins_1outs(
+// CHECK:   firrtl.constant(42 : ui64)
+// CHECK-LABEL: firrtl.module @handshake_constant_1ins_1outs_1(
+// CHECK:   firrtl.constant(7 : ui64)
+// CHECK-NOT: firrtl.module @handshake_constant
+
+// CHECK-LABEL: firrtl.module @test_submodule_dedup(
+// CHECK:   firrtl.instance @handshake_fork_1ins_2outs_ctrl
+// CHECK:   firrtl.instance @handshake_constant_1ins_1outs {
+// CHECK:   firrtl.instance @handshake_fork_1ins_2outs_ctrl
+// CHECK:   firrtl.instance @handshake_constant_1ins_1outs_1 {
+// CHECK:   firrtl.instance @handshake_constant_1ins_1outs {
+handshake.func @test_submodule_dedup(%arg0: none, %arg1: none, ...) -> (index, index, index, none) {
+  %0:2 = "handshake.fork"(%arg0) {control = true} : (none) -> (none, none)
+  %1 = "handshake.constant"(%0#0) {value = 42 : index}: (none) -> index
+  %2:2 = "handshake.fork"(%0#1) {control = true} : (none) -> (none, none)
+  %3 = "handshake.constant"(%2#0) {value = 7 : index}: (none) -> index
+  %4 = "handshake.constant"(%2#1) {value = 42 : index}: (none) -> index
+  handshake.return %1, %3, %4, %arg1 : index, index, index, none
+}
@@ -0,0 +1,38 @@
+// RUN: circt-opt %s --convert-llhd-to-llvm="batch-entities=true" | FileCheck %s
+
+// CHECK-LABEL:   llvm.func @convert_batch(
+// CHECK-SAME:                             %{{.*}}: !llvm.ptr<i8>,
+// CHECK-SAME:                             %{{.*}}: !llvm.ptr<struct<()>>,
+// CHECK-SAME:                             %{{.*}}: !llvm.ptr<struct<(ptr<i8>, i64, i64, i64)>>) {
+// CHECK:           llvm.return
+// CHECK:         }
+
+// CHECK-LABEL:   llvm.func @convert_batch_batch(
+// CHECK-SAME:                                   %[[STATE:.*]]: !llvm.ptr<i8>,
+// CHECK-SAME:                                   %[[COUNT:.*]]: i64,
+// CHECK-SAME:                                   %[[STATES:.*]]: !llvm.ptr<ptr<struct<()>>>,
+// CHECK-SAME:                                   %[[TABLES:.*]]: !llvm.ptr<ptr<struct<(ptr<i8>, i64, i64, i64)>>>) {
+// CHECK:           %[[ZERO:.*]] = llvm.mlir.constant(0 : i64) : i64
+// CHECK:           llvm.br ^[[HEADER:.*]](%[[ZERO]] : i64)
+// CHECK:         ^[[HEADER]](%[[INDEX:.*]]: i64):
+// CHECK:           %[[MORE:.*]] = llvm.icmp "ult" %[[INDEX]], %[[COUNT]] : i64
+// CHECK:           llvm.cond_br %[[MORE]], ^[[LOOP:.*]], ^[[EXIT:.*]]
+// CHECK:         ^[[LOOP]]:
+// CHECK:           %[[STATEPTR:.*]] = llvm.getelementptr %[[STATES]]{{\[}}%[[INDEX]]]
+// CHECK:           %[[LOCAL:.*]] = llvm.load %[[STATEPTR]] : !llvm.ptr<ptr<struct<()>>>
+// CHECK:           %[[TABLEPTR:.*]] = llvm.getelementptr %[[TABLES]]{{\[}}%[[INDEX]]]
+// CHECK:           %[[TABLE:.*]] = llvm.load %[[TABLEPTR]] : !llvm.ptr<ptr<struct<(ptr<i8>, i64, i64, i64)>>>
+// CHECK:           llvm.call @convert_batch(%[[STATE]], %[[LOCAL]], %[[TABLE]])
+// CHECK:           %[[ONE:.*]] = llvm.mlir.constant(1 : i64) : i64
+// CHECK:           %[[NEXT:.*]] = llvm.add %[[INDEX]], %[[ONE]] : i64
+// CHECK:           llvm.br ^[[HEADER]](%[[NEXT]] : i64)
+// CHECK:         ^[[EXIT]]:
+// CHECK:           llvm.return
+// CHECK:         }
+llhd.entity @convert_batch (%in : !llhd.sig<i1>) -> () {}
+
+// Processes are not batched.
+// CHECK-NOT:     llvm.func @convert_batch_proc_batch
+llhd.proc @convert_batch_proc () -> () {
+  llhd.halt
+}
@@ -0,0 +1,45 @@
+// RUN: circt-opt %s --convert-llhd-to-llvm="inline-drives=true" | FileCheck %s
+
+// CHECK-LABEL:   llvm.func @convert_inline_drv(
+// CHECK-SAME:                                  %[[STATE:.*]]: !llvm.ptr<i8>,
+// CHECK-SAME:                                  %{{.*}}: !llvm.ptr<struct<()>>,
+// CHECK-SAME:                                  %{{.*}}: !llvm.ptr<struct<(ptr<i8>, i64, i64, i64)>>,
+// CHECK-SAME:                                  %[[BUFFER:.*]]: !llvm.ptr<struct<(ptr<struct<(ptr<struct<(ptr<i8>, i64, i64, i64)>>, i64, i64, i64, i64, i64)>>, i64, i64)>>) {
+// CHECK:           %[[SIZE:.*]] = llvm.load %{{.*}} : !llvm.ptr<i64>
+// CHECK:           %[[CAPACITY:.*]] = llvm.load %{{.*}} : !llvm.ptr<i64>
+// CHECK:           %[[FULL:.*]] = llvm.icmp "uge" %[[SIZE]], %[[CAPACITY]] : i64
+// CHECK:           llvm.cond_br %[[FULL]], ^[[CALL:.*]], ^[[APPEND:.*]]
+// CHECK:         ^[[APPEND]]:
+// CHECK:           %[[ENTRY:.*]] = llvm.getelementptr %{{.*}}{{\[}}%[[SIZE]]]
+// CHECK:           %[[VALUE:.*]] = llvm.zext %{{.*}} : i8 to i64
+// CHECK:           llvm.store %[[VALUE]], %{{.*}} : !llvm.ptr<i64>
+// CHECK:           %[[NEWSIZE:.*]] = llvm.add %[[SIZE]], %{{.*}} : i64
+// CHECK:           llvm.store %[[NEWSIZE]], %{{.*}} : !llvm.ptr<i64>
+// CHECK:           llvm.br ^[[CONT:.*]]
+// CHECK:         ^[[CALL]]:
+// CHECK:           llvm.call @driveSignal(%[[STATE]],
+// CHECK:           llvm.br ^[[CONT]]
+// CHECK:         ^[[CONT]]:
+// Arrays always go through the runtime library.
+// CHECK-NOT:       llvm.icmp "uge"
+// CHECK:           llvm.call @driveSignal(%[[STATE]],
+// CHECK:           llvm.return
+llhd.entity @convert_inline_drv (%sI8 : !llhd.sig<i8>, %sArr : !llhd.sig<!llhd.array<3xi5>>) -> () {
+  %cI8 = llhd.const 0 : i8
+  %cI5 = llhd.const 0 : i5
+  %cArr = llhd.array_uniform %cI5 : !llhd.array<3xi5>
+  %t = llhd.const #llhd.time<0ns, 1d, 0e> : !llhd.time
+  llhd.drv %sI8, %cI8 after %t : !llhd.sig<i8>
+  llhd.drv %sArr, %cArr after %t : !llhd.sig<!llhd.array<3xi5>>
+}
+
+// CHECK-LABEL:   llvm.func @convert_inline_drv_proc(
+// CHECK-SAME:                                       %{{.*}}: !llvm.ptr<struct<(ptr<struct<(ptr<struct<(ptr<i8>, i64, i64, i64)>>, i64, i64, i64, i64, i64)>>, i64, i64)>>) {
+// CHECK:           llvm.icmp "uge"
+// CHECK:           llvm.store %{{.*}} : !llvm.ptr<i64>
+llhd.proc @convert_inline_drv_proc () -> (%sI64 : !llhd.sig<i64>) {
+  %c = llhd.const 5 : i64
+  %t = llhd.const #llhd.time<0ns, 0d, 0e> : !llhd.time
+  llhd.drv %sI64, %c after %t : !llhd.sig<i64>
+  llhd.halt
+}
@@ -0,0 +1,46 @@
+// RUN: circt-opt -convert-rtl-to-llhd %s | FileCheck %s
+
+module {
+  // CHECK-LABEL: llhd.entity @arith
+  // CHECK-SAME: (%[[A:.+]] : !llhd.sig<i8>, %[[B:.+]] : !llhd.sig<i8>) ->
+  // CHECK-SAME: (%[[OUT:.+]] : !llhd.sig<i8>)
+  rtl.module @arith(%a: i8, %b: i8) -> (%out: i8) {
+    // CHECK-NEXT: %[[A0:.+]] = llhd.prb %[[A]]
+    // CHECK-NEXT: %[[B0:.+]] = llhd.prb %[[B]]
+    // CHECK-NEXT: %[[ADD0:.+]] = addi %[[A0]], %[[B0]] : i8
+    // CHECK-NEXT: %[[A1:.+]] = llhd.prb %[[A]]
+    // CHECK-NEXT: %[[ADD1:.+]] = addi %[[ADD0]], %[[A1]] : i8
+    // CHECK-NEXT: %[[C:.+]] = llhd.const 3 : i8
+    // CHECK-NEXT: %[[SUB:.+]] = subi %[[ADD1]], %[[C]] : i8
+    // CHECK-NEXT: %[[DELTA:.+]] = llhd.const #llhd.time<0ns, 1d, 0e>
+    // CHECK-NEXT: llhd.drv %[[OUT]], %[[SUB]] after %[[DELTA]]
+    // CHECK-NOT: llhd.sig
+    %0 = rtl.add %a, %b, %a : i8
+    %c3 = rtl.constant(3 : i8) : i8
+    %1 = rtl.sub %0, %c3 : i8
+    rtl.output %1 : i8
+  }
+
+  // CHECK-LABEL: llhd.entity @bits
+  rtl.module @bits(%a: i8, %b: i4, %p: i1) -> (%out: i12, %r: i1) {
+    // CHECK: %[[LOW:.+]] = llhd.extract_slice %{{.+}}, 0 : i8 -> i4
+    // CHECK: %[[ZERO:.+]] = llhd.const 0 : i12
+    // CHECK: %[[HI:.+]] = llhd.insert_slice %[[ZERO]], %{{.+}}, 4 : i12, i8
+    // CHECK: %[[CAT:.+]] = llhd.insert_slice %[[HI]], %[[LOW]], 0 : i12, i4
+    // CHECK: %[[EXT:.+]] = sexti %{{.+}} : i4 to i12
+    // CHECK: %[[SEL:.+]] = select %{{.+}}, %[[CAT]], %[[EXT]] : i12
+    // CHECK: %[[ONES:.+]] = llhd.const -1 : i8
+    // CHECK: %[[ANDR:.+]] = cmpi "eq", %{{.+}}, %[[ONES]] : i8
+    // CHECK: %[[CMP:.+]] = cmpi "ult", %{{.+}}, %{{.+}} : i4
+    // CHECK: %[[RED:.+]] = xor %[[ANDR]], %[[CMP]] : i1
+    // CHECK-NOT: llhd.sig
+    %0 = rtl.extract %a from 0 : (i8) -> i4
+    %1 = rtl.concat %a, %0 : (i8, i4) -> i12
+    %2 = rtl.sext %b : (i4) -> i12
+    %3 = rtl.mux %p, %1, %2 : i12
+    %4 = rtl.andr %a : i8
+    %5 = rtl.icmp "ult" %0, %b : i4
+    %6 = rtl.xor %4, %5 : i1
+    rtl.output %3, %6 : i12, i1
+  }
+}
@@ -0,0 +1,42 @@
+// RUN: circt-opt -convert-rtl-to-llhd %s | FileCheck %s
+
+module {
+  // CHECK-LABEL: llhd.entity @counter
+  // CHECK-SAME: (%[[CLK:.+]] : !llhd.sig<i1>, %[[RST:.+]] : !llhd.sig<i1>) ->
+  // CHECK-SAME: (%[[OUT:.+]] : !llhd.sig<i8>)
+  rtl.module @counter(%clock: i1, %reset: i1) -> (%out: i8) {
+    // CHECK: %[[INIT:.+]] = llhd.const 0 : i8
+    // CHECK: %[[REG:.+]] = llhd.sig "count" %[[INIT]] : i8
+    %count = sv.reg : !rtl.inout<i8>
+    // CHECK: %[[VAL:.+]] = llhd.prb %[[REG]] : !llhd.sig<i8>
+    %0 = rtl.read_inout %count : !rtl.inout<i8>
+    %c1 = rtl.constant(1 : i8) : i8
+    %c0 = rtl.constant(0 : i8) : i8
+    // CHECK: %[[NEXT:.+]] = addi %[[VAL]],
+    %1 = rtl.add %0, %c1 : i8
+
+    // The reset assignment comes last, so it takes precedence.
+    // CHECK: %[[CLK0:.+]] = llhd.prb %[[CLK]] : !llhd.sig<i1>
+    // CHECK: %[[RST0:.+]] = llhd.prb %[[RST]] : !llhd.sig<i1>
+    // CHECK: llhd.reg %[[REG]], (%{{.+}}, "rise" %[[CLK0]] after %{{.+}} if %[[RST0]] : i8), (%[[NEXT]], "rise" %[[CLK0]] after %{{.+}} : i8) : !llhd.sig<i8>
+    // CHECK-NOT: sv.
+    sv.always posedge %clock {
+      sv.passign %count, %1 : i8
+      sv.if %reset {
+        sv.passign %count, %c0 : i8
+      }
+    }
+
+    // Register randomization is dropped.
+    sv.ifdef "!SYNTHESIS" {
+      sv.initial {
+        sv.verbatim "`INIT_RANDOM_PROLOG_"
+      }
+    }
+
+    // CHECK: %[[RES:.+]] = llhd.prb %[[REG]] : !llhd.sig<i8>
+    // CHECK: llhd.drv %[[OUT]], %[[RES]]
+    %2 = rtl.read_inout %count : !rtl.inout<i8>
+    rtl.output %2 : i8
+  }
+}
@@ -0,0 +1,78 @@
+// RUN: circt-opt %s -partition-memrefs -split-input-file | FileCheck %s
+
+// The accesses of a loop unrolled by four each hit one of four banks.
+
+// CHECK-LABEL: func @unrolled
+func @unrolled() {
+  // CHECK-NEXT: %[[B0:.+]] = alloc() : memref<4xi32>
+  // CHECK-NEXT: %[[B1:.+]] = alloc() : memref<4xi32>
+  // CHECK-NEXT: %[[B2:.+]] = alloc() : memref<4xi32>
+  // CHECK-NEXT: %[[B3:.+]] = alloc() : memref<4xi32>
+  // CHECK-NEXT: affine.for %[[I:.+]] = 0 to 16 step 4 {
+  // CHECK-NEXT:   %[[V0:.+]] = affine.load %[[B0]][%[[I]] floordiv 4] : memref<4xi32>
+  // CHECK-NEXT:   %[[V1:.+]] = affine.load %[[B1]][%[[I]] floordiv 4] : memref<4xi32>
+  // CHECK-NEXT:   %[[V2:.+]] = affine.load %[[B2]][%[[I]] floordiv 4] : memref<4xi32>
+  // CHECK-NEXT:   %[[V3:.+]] = affine.load %[[B3]][%[[I]] floordiv 4] : memref<4xi32>
+  // CHECK:        affine.store %{{.+}}, %[[B3]][%[[I]] floordiv 4] : memref<4xi32>
+  // CHECK-NEXT: }
+  // CHECK-NEXT: dealloc %[[B0]] : memref<4xi32>
+  // CHECK-NEXT: dealloc %[[B1]] : memref<4xi32>
+  // CHECK-NEXT: dealloc %[[B2]] : memref<4xi32>
+  // CHECK-NEXT: dealloc %[[B3]] : memref<4xi32>
+  %A = alloc() : memref<16xi32>
+  affine.for %i = 0 to 16 step 4 {
+    %0 = affine.load %A[%i] : memref<16xi32>
+    %1 = affine.load %A[%i + 1] : memref<16xi32>
+    %2 = affine.load %A[%i + 2] : memref<16xi32>
+    %3 = affine.load %A[%i + 3] : memref<16xi32>
+    %4 = addi %0, %1 : i32
+    %5 = addi %2, %3 : i32
+    %6 = addi %4, %5 : i32
+    affine.store %6, %A[%i + 3] : memref<16xi32>
+  }
+  dealloc %A : memref<16xi32>
+  return
+}
+
+// -----
+
+// A two dimensional memref is banked along the dimension which allows the most
+// banks, up to the number of banks allowed.
+
+// CHECK-LABEL: func @matrix
+func @matrix() {
+  // CHECK-NEXT: %[[B0:.+]] = alloc() : memref<2x8xi32>
+  // CHECK-NEXT: %[[B1:.+]] = alloc() : memref<2x8xi32>
+  // CHECK-NEXT: %[[B2:.+]] = alloc() : memref<2x8xi32>
+  // CHECK-NEXT: %[[B3:.+]] = alloc() : memref<2x8xi32>
+  // CHECK-NEXT: affine.for %[[I:.+]] = 0 to 8 step 8 {
+  // CHECK-NEXT:   affine.for %[[J:.+]] = 0 to 8 {
+  // CHECK-NEXT:     affine.load %[[B0]][%[[I]] floordiv 4, %[[J]]] : memref<2x8xi32>
+  // CHECK-NEXT:     affine.load %[[B1]][%[[I]] floordiv 4, %[[J]]] : memref<2x8xi32>
+  %A = alloc() : memref<8x8xi32>
+  affine.for %i = 0 to 8 step 8 {
+    affine.for %j = 0 to 8 {
+      %0 = affine.load %A[%i, %j] : memref<8x8xi32>
+      %1 = affine.load %A[%i + 1, %j] : memref<8x8xi32>
+    }
+  }
+  return
+}
+
+// -----
+
+// Accesses which can hit any element leave the memref alone, and so do uses
+// other than affine loads and stores.
+
+// CHECK-LABEL: func @unchanged
+func @unchanged(%n: index) {
+  // CHECK-NEXT: alloc() : memref<16xi32>
+  // CHECK-NEXT: alloc() : memref<16xi32>
+  %A = alloc() : memref<16xi32>
+  %B = alloc() : memref<16xi32>
+  affine.for %i = 0 to 16 {
+    %0 = affine.load %A[%i] : memref<16xi32>
+    %1 = load %B[%n] : memref<16xi32>
+  }
+  return
+}
@@ -0,0 +1,31 @@
+#!/usr/bin/env python3
+# Print a function whose loop body is unrolled the specified number of times,
+# to measure the time -create-dataflow takes on large blocks.  Every eighth
+# step of the body uses another value defined before the loop, so the number
+# of merges grows with the body as well.
+
+import sys
+
+steps = int(sys.argv[1])
+liveIns = max((steps - 1) // 8, 1)
+
+print("func @unrolled(%n: index, %x: i32) -> i32 {")
+print("  %c0 = constant 0 : index")
+print("  %c1 = constant 1 : index")
+for i in range(liveIns):
+  print(f"  %k{i} = addi %x, %x : i32")
+print("  br ^bb1(%c0, %x : index, i32)")
+print("^bb1(%i: index, %acc: i32):")
+print("  %cond = cmpi \"slt\", %i, %n : index")
+print("  cond_br %cond, ^bb2, ^bb3")
+print("^bb2:")
+print("  %v0 = addi %acc, %x : i32")
+for i in range(1, steps):
+  op = "muli" if i % 2 else "addi"
+  operand = f"%k{i // 8 - 1}" if i % 8 == 0 else "%x"
+  print(f"  %v{i} = {op} %v{i - 1}, {operand} : i32")
+print("  %next = addi %i, %c1 : index")
+print(f"  br ^bb1(%next, %v{steps - 1} : index, i32)")
+print("^bb3:")
+print("  return %acc : i32")
+print("}")
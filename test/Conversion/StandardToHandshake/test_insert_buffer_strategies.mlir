@@ -0,0 +1,26 @@
+// RUN: circt-opt -handshake-insert-buffer="strategy=throughput" %s | FileCheck %s --check-prefix=THROUGHPUT
+// RUN: circt-opt -handshake-insert-buffer="strategy=all buffer-size=3" %s | FileCheck %s --check-prefix=ALL
+// RUN: circt-opt -handshake-insert-buffer="strategy=bogus" %s -verify-diagnostics
+
+// The left side of the addition goes through a sequential buffer, so the right
+// side and the control token need room for one more token.
+
+// THROUGHPUT-LABEL: handshake.func @reconvergent
+// THROUGHPUT:         %[[FORK:.+]]:2 = "handshake.fork"(%arg0)
+// THROUGHPUT:         %[[LEFT:.+]] = "handshake.buffer"(%[[FORK]]#0) {control = false, sequential = true, slots = 2 : i32}
+// THROUGHPUT-NEXT:    %[[RIGHT:.+]] = "handshake.buffer"(%[[FORK]]#1) {control = false, sequential = false, slots = 1 : i32}
+// THROUGHPUT-NEXT:    %[[SUM:.+]] = addi %[[LEFT]], %[[RIGHT]] : index
+// THROUGHPUT-NEXT:    %[[CTRL:.+]] = "handshake.buffer"(%arg1) {control = true, sequential = false, slots = 1 : i32}
+// THROUGHPUT-NEXT:    handshake.return %[[SUM]], %[[CTRL]] : index, none
+
+// ALL-LABEL: handshake.func @reconvergent
+// ALL-COUNT-4: sequential = true, slots = 3 : i32
+// ALL-NOT: "handshake.buffer"
+
+// expected-error @+1 {{unknown buffer insertion strategy 'bogus'}}
+handshake.func @reconvergent(%arg0: index, %arg1: none, ...) -> (index, none) {
+  %0:2 = "handshake.fork"(%arg0) {control = false} : (index) -> (index, index)
+  %1 = "handshake.buffer"(%0#0) {control = false, sequential = true, slots = 2 : i32} : (index) -> index
+  %2 = addi %1, %0#1 : index
+  handshake.return %2, %arg1 : index, none
+}
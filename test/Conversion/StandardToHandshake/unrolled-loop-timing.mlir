@@ -0,0 +1,15 @@
+// Benchmarks -create-dataflow on a loop unrolled into a few thousand
+// operations.  The timing report shows how long the conversion took, which
+// grows linearly with the size of the loop.
+// RUN: %python %S/Inputs/unrolled-loop.py 4000 > %t.mlir
+// RUN: circt-opt -create-dataflow -mlir-timing %t.mlir -o %t.out 2>&1 | FileCheck %s --check-prefix=TIMING
+// RUN: FileCheck %s < %t.out
+
+// TIMING: Total Execution Time
+
+// Every value defined before the loop goes through a mux in the loop header,
+// and %x is forked to all of its uses in the body.
+// CHECK-LABEL: handshake.func @unrolled
+// CHECK-COUNT-499: "handshake.mux"
+// CHECK: "handshake.fork"({{.*}}) {control = false} : (i32) -> (i32, i32, i32, i32
+// CHECK: handshake.return
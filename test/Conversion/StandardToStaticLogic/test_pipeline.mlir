@@ -5,25 +5,25 @@
 // CHECK:           br ^bb1
 // CHECK:         ^bb1:  // pred: ^bb0
 // CHECK:           %[[VAL_0:.*]]:2 = "staticlogic.pipeline"() ( {
-// CHECK:             %c1 = constant 1 : index
-// CHECK:             %c42 = constant 42 : index
+// CHECK:             %c1 = constant {staticlogic.stage = 0 : i64} 1 : index
+// CHECK:             %c42 = constant {staticlogic.stage = 0 : i64} 42 : index
 // CHECK:             "staticlogic.return"(%c1, %c42) : (index, index) -> ()
-// CHECK:           }) : () -> (index, index)
+// CHECK:           }) {II = 1 : i64, latency = 0 : i64} : () -> (index, index)
 // CHECK:           br ^bb2(%[[VAL_0:.*]]#0 : index)
 // CHECK:         ^bb2(%[[VAL_1:.*]]: index):  // 2 preds: ^bb1, ^bb3
 // CHECK:           %[[VAL_2:.*]] = "staticlogic.pipeline"(%[[VAL_1:.*]], %[[VAL_0:.*]]#1) ( {
 // CHECK:           ^bb0(%[[ARG_0:.*]]: index, %[[ARG_1:.*]]: index):  // no predecessors
-// CHECK:             %[[TMP_0:.*]] = cmpi "slt", %[[ARG_0:.*]], %[[ARG_1:.*]] : index
+// CHECK:             %[[TMP_0:.*]] = cmpi "slt", %[[ARG_0:.*]], %[[ARG_1:.*]] {staticlogic.stage = 0 : i64} : index
 // CHECK:             "staticlogic.return"(%[[TMP_0:.*]]) : (i1) -> ()
-// CHECK:           }) : (index, index) -> i1
+// CHECK:           }) {II = 1 : i64, latency = 1 : i64} : (index, index) -> i1
 // CHECK:           cond_br %[[VAL_2:.*]], ^bb3, ^bb4
 // CHECK:         ^bb3:  // pred: ^bb2
 // CHECK:           %[[VAL_3:.*]] = "staticlogic.pipeline"(%[[VAL_1:.*]]) ( {
 // CHECK:           ^bb0(%[[ARG_0:.*]]: index):  // no predecessors
-// CHECK:             %c1 = constant 1 : index
-// CHECK:             %[[TMP_1:.*]] = addi %[[ARG_0:.*]], %c1 : index
+// CHECK:             %c1 = constant {staticlogic.stage = 0 : i64} 1 : index
+// CHECK:             %[[TMP_1:.*]] = addi %[[ARG_0:.*]], %c1 {staticlogic.stage = 0 : i64} : index
 // CHECK:             "staticlogic.return"(%[[TMP_1:.*]]) : (index) -> ()
-// CHECK:           }) : (index) -> index
+// CHECK:           }) {II = 1 : i64, latency = 1 : i64} : (index) -> index
 // CHECK:           br ^bb2(%[[VAL_3:.*]] : index)
 // CHECK:         ^bb4:  // pred: ^bb2
 // CHECK:           return
@@ -0,0 +1,64 @@
+// RUN: circt-opt -create-pipeline -split-input-file %s | FileCheck %s
+
+// The multiplication feeds itself in the next iteration, so a new iteration can
+// only start once the multiplier is done.
+
+// CHECK-LABEL: func @recurrence
+// CHECK:       ^bb1(%{{.+}}: index):
+// CHECK:         %[[RES:.+]] = "staticlogic.pipeline"
+// CHECK:           muli {{.*}} {staticlogic.stage = 0 : i64}
+// CHECK:         }) {II = 3 : i64, latency = 3 : i64}
+// CHECK:         br ^bb1(%[[RES]] : index)
+func @recurrence(%arg0: index) {
+^bb0:
+  %c0 = constant 0 : index
+  br ^bb1(%c0 : index)
+^bb1(%0: index):
+  %1 = muli %0, %arg0 : index
+  br ^bb1(%1 : index)
+}
+
+// -----
+
+// The three accesses compete for the single memory port, and the store has to
+// finish before the loads of the next iteration.
+
+// CHECK-LABEL: func @memory_port
+// CHECK:         "staticlogic.pipeline"
+// CHECK:           load {{.*}} {staticlogic.stage = 0 : i64}
+// CHECK:           load {{.*}} {staticlogic.stage = 1 : i64}
+// CHECK:           addi {{.*}} {staticlogic.stage = 2 : i64}
+// CHECK:           store {{.*}} {staticlogic.stage = 3 : i64}
+// CHECK:         }) {II = 4 : i64, latency = 4 : i64}
+func @memory_port(%mem: memref<8xi32>, %i: index, %j: index) {
+^bb0:
+  br ^bb1
+^bb1:
+  %0 = load %mem[%i] : memref<8xi32>
+  %1 = load %mem[%j] : memref<8xi32>
+  %2 = addi %0, %1 : i32
+  store %2, %mem[%i] : memref<8xi32>
+  br ^bb1
+}
+
+// -----
+
+// Independent operations overlap fully, but never below the requested II.
+
+// RUN: circt-opt -create-pipeline='target-ii=2' %s | FileCheck %s --check-prefix=TARGET
+// TARGET-LABEL: func @independent
+// TARGET:         }) {II = 2 : i64
+// CHECK-LABEL: func @independent
+// CHECK:         %[[C1:.+]] = constant {staticlogic.stage = 0 : i64} 1 : index
+// CHECK:         %[[ADD:.+]] = addi {{.*}}, %[[C1]] {staticlogic.stage = 0 : i64}
+// CHECK:         muli %[[ADD]], {{.*}} {staticlogic.stage = 1 : i64}
+// CHECK:         }) {II = 1 : i64, latency = 4 : i64}
+func @independent(%arg0: index) -> index {
+^bb0:
+  br ^bb1
+^bb1:
+  %c1 = constant 1 : index
+  %0 = addi %arg0, %c1 : index
+  %1 = muli %0, %arg0 : index
+  return %1 : index
+}
@@ -0,0 +1,54 @@
+// RUN: circt-opt -create-pipeline -lower-staticlogic-to-firrtl %s | FileCheck %s
+
+// The function itself is left alone, the pipeline module is added after it.
+// CHECK-LABEL: func @independent
+// CHECK:         "staticlogic.pipeline"
+
+// CHECK-LABEL: firrtl.circuit "independent_pipeline0"
+// CHECK-LABEL: firrtl.module @independent_pipeline0(
+// CHECK-SAME:    %arg0: !firrtl.uint<64>, %clock: !firrtl.clock, %reset: !firrtl.uint<1>, %in_valid: !firrtl.uint<1>, %stall: !firrtl.uint<1>, %flush: !firrtl.uint<1>, %result0: !firrtl.flip<uint<64>>, %out_valid: !firrtl.flip<uint<1>>) {
+
+// Stage 0 computes the addition straight from the arguments.
+// CHECK:         %[[C1:.+]] = firrtl.constant(1 : ui64)
+// CHECK:         %[[ADD:.+]] = firrtl.add %arg0, %[[C1]]
+// CHECK:         %[[ADD_BITS:.+]] = firrtl.bits %[[ADD]] 63 to 0
+
+// Stage 1 reads the sum and the argument from stage registers, which hold
+// their value while the pipeline is stalled.
+// CHECK:         %[[ADD_REG:.+]] = firrtl.reg %clock
+// CHECK:         %[[ADD_NEXT:.+]] = firrtl.mux(%stall, %[[ADD_REG]], %[[ADD_BITS]])
+// CHECK:         firrtl.connect %[[ADD_REG]], %[[ADD_NEXT]]
+// CHECK:         %[[ARG_REG:.+]] = firrtl.reg %clock
+// CHECK:         %[[ARG_NEXT:.+]] = firrtl.mux(%stall, %[[ARG_REG]], %arg0)
+// CHECK:         firrtl.connect %[[ARG_REG]], %[[ARG_NEXT]]
+// CHECK:         %[[MUL:.+]] = firrtl.mul %[[ADD_REG]], %[[ARG_REG]]
+// CHECK:         %[[MUL_BITS:.+]] = firrtl.bits %[[MUL]] 63 to 0
+
+// The product is registered until the end of the multiplier latency.
+// CHECK:         %[[MUL_REG0:.+]] = firrtl.reg %clock
+// CHECK:         %[[MUL_REG1:.+]] = firrtl.reg %clock
+// CHECK:         %[[MUL_REG2:.+]] = firrtl.reg %clock
+// CHECK:         firrtl.connect %result0, %[[MUL_REG2]]
+
+// The valid bit follows the iteration for all four cycles.
+// CHECK:         %[[FALSE:.+]] = firrtl.constant(0 : ui1)
+// CHECK:         %[[NOT_STALL:.+]] = firrtl.not %stall
+// CHECK:         %[[IN_VALID:.+]] = firrtl.and %in_valid, %[[NOT_STALL]]
+// CHECK:         %[[VALID0:.+]] = firrtl.regreset %clock, %reset, %[[FALSE]]
+// CHECK:         %[[VALID0_NEXT:.+]] = firrtl.mux(%stall, %[[VALID0]], %[[IN_VALID]])
+// CHECK:         %[[VALID0_FLUSHED:.+]] = firrtl.mux(%flush, %[[FALSE]], %[[VALID0_NEXT]])
+// CHECK:         firrtl.connect %[[VALID0]], %[[VALID0_FLUSHED]]
+// CHECK:         firrtl.regreset
+// CHECK:         firrtl.regreset
+// CHECK:         %[[VALID3:.+]] = firrtl.regreset
+// CHECK:         firrtl.connect %out_valid, %[[VALID3]]
+
+func @independent(%arg0: index) -> index {
+^bb0:
+  br ^bb1
+^bb1:
+  %c1 = constant 1 : index
+  %0 = addi %arg0, %c1 : index
+  %1 = muli %0, %arg0 : index
+  return %1 : index
+}
@@ -0,0 +1,42 @@
+// RUN: circt-opt %s --esi-insert-buffers -verify-diagnostics | FileCheck %s
+// RUN: circt-opt %s --esi-insert-buffers=target-rate=0.5 | FileCheck --check-prefix=HALF %s
+
+module {
+  rtl.externmodule @Fork(%a: !esi.channel<i4>) -> (%x: !esi.channel<i4>, %y: !esi.channel<i4>)
+  rtl.externmodule @Slow(%a: !esi.channel<i4>) -> (%x: !esi.channel<i4>) attributes {esi.latency = 6 : i64}
+  rtl.externmodule @Join(%a: !esi.channel<i4>, %b: !esi.channel<i4>) -> (%x: !esi.channel<i4>)
+
+  // CHECK-LABEL: rtl.module @reconvergent
+  // HALF-LABEL: rtl.module @reconvergent
+  rtl.module @reconvergent(%clk: i1, %rstn: i1, %in: !esi.channel<i4>) -> (%out: !esi.channel<i4>) {
+    %x, %y = rtl.instance "fork" @Fork(%in) : (!esi.channel<i4>) -> (!esi.channel<i4>, !esi.channel<i4>)
+    %slow = rtl.instance "slow" @Slow(%x) : (!esi.channel<i4>) -> !esi.channel<i4>
+    // expected-remark @+1 {{inserted a 6 stage buffer on input 1 to absorb 6 cycles of slack}}
+    %out = rtl.instance "join" @Join(%slow, %y) : (!esi.channel<i4>, !esi.channel<i4>) -> !esi.channel<i4>
+    rtl.output %out : !esi.channel<i4>
+  }
+  // CHECK:      [[BUF:%.+]] = esi.buffer %clk, %rstn, %fork.y {stages = 6 : i64} : i4
+  // CHECK-NEXT: %join.x = rtl.instance "join" @Join(%slow.x, [[BUF]])
+  // HALF:       esi.buffer %clk, %rstn, %fork.y {stages = 3 : i64} : i4
+
+  // CHECK-LABEL: rtl.module @widen
+  rtl.module @widen(%clk: i1, %rstn: i1, %in: !esi.channel<i4>) -> (%out: !esi.channel<i4>) {
+    %x, %y = rtl.instance "fork" @Fork(%in) : (!esi.channel<i4>) -> (!esi.channel<i4>, !esi.channel<i4>)
+    %slow = rtl.instance "slow" @Slow(%x) : (!esi.channel<i4>) -> !esi.channel<i4>
+    // expected-remark @+1 {{widened buffer from 2 to 6 stages to absorb 4 cycles of slack}}
+    %buf = esi.buffer %clk, %rstn, %y { stages = 2, name = "keep" } : i4
+    %out = rtl.instance "join" @Join(%slow, %buf) : (!esi.channel<i4>, !esi.channel<i4>) -> !esi.channel<i4>
+    rtl.output %out : !esi.channel<i4>
+  }
+  // CHECK: esi.buffer %clk, %rstn, %fork.y {name = "keep", stages = 6 : i64} : i4
+
+  // CHECK-LABEL: rtl.module @balanced
+  rtl.module @balanced(%clk: i1, %rstn: i1, %in: !esi.channel<i4>) -> (%out: !esi.channel<i4>) {
+    %x, %y = rtl.instance "fork" @Fork(%in) : (!esi.channel<i4>) -> (!esi.channel<i4>, !esi.channel<i4>)
+    %slow = rtl.instance "slow" @Slow(%x) : (!esi.channel<i4>) -> !esi.channel<i4>
+    %slow2 = rtl.instance "slow2" @Slow(%y) : (!esi.channel<i4>) -> !esi.channel<i4>
+    %out = rtl.instance "join" @Join(%slow, %slow2) : (!esi.channel<i4>, !esi.channel<i4>) -> !esi.channel<i4>
+    rtl.output %out : !esi.channel<i4>
+  }
+  // CHECK-NOT: esi.buffer
+}
@@ -0,0 +1,36 @@
+// REQUIRES: capnp
+// RUN: circt-opt %s --lower-esi-capnp-to-rtl -verify-diagnostics | FileCheck %s
+
+module {
+  // CHECK-LABEL: rtl.module @encode(%a: i32) -> (!rtl.array<192xi1>)
+  rtl.module @encode(%a: i32) -> (!rtl.array<192xi1>) {
+    %0 = esi.encode.capnp %a : i32 -> !rtl.array<192xi1>
+    rtl.output %0 : !rtl.array<192xi1>
+  }
+  // CHECK:      [[ZERO:%.+]] = rtl.constant(0 : i32) : i32
+  // CHECK-NEXT: [[HDR:%.+]] = rtl.constant(79228162514264337602133884928 : i128) : i128
+  // CHECK-NEXT: [[MSG:%.+]] = rtl.concat [[ZERO]], %a, [[HDR]] : (i32, i32, i128) -> i192
+  // CHECK-NEXT: [[WIRE:%.+]] = rtl.wire : !rtl.inout<array<192xi1>>
+  // CHECK:      [[IDX:%.+]] = rtl.constant(-65 : i8) : i8
+  // CHECK-NEXT: [[ELEM:%.+]] = rtl.arrayindex [[WIRE]]{{\[}}[[IDX]]{{\]}}
+  // CHECK-NEXT: [[BIT:%.+]] = rtl.extract [[MSG]] from 191 : (i192) -> i1
+  // CHECK-NEXT: rtl.connect [[ELEM]], [[BIT]] : i1
+  // CHECK-NEXT: [[RES:%.+]] = rtl.read_inout [[WIRE]] : !rtl.inout<array<192xi1>>
+  // CHECK-NEXT: rtl.output [[RES]] : !rtl.array<192xi1>
+
+  // CHECK-LABEL: rtl.module @decode(%msg: !rtl.array<192xi1>) -> (i32)
+  rtl.module @decode(%msg: !rtl.array<192xi1>) -> (i32) {
+    %0 = esi.decode.capnp %msg : !rtl.array<192xi1> -> i32
+    rtl.output %0 : i32
+  }
+  // CHECK:      [[WIRE:%.+]] = rtl.wire : !rtl.inout<array<192xi1>>
+  // CHECK-NEXT: rtl.connect [[WIRE]], %msg : !rtl.array<192xi1>
+  // CHECK-NEXT: [[IDX:%.+]] = rtl.constant(-97 : i8) : i8
+  // CHECK-NEXT: [[ELEM:%.+]] = rtl.arrayindex [[WIRE]]{{\[}}[[IDX]]{{\]}}
+  // CHECK-NEXT: [[BIT:%.+]] = rtl.read_inout [[ELEM]] : !rtl.inout<i1>
+  // CHECK:      [[LASTIDX:%.+]] = rtl.constant(-128 : i8) : i8
+  // CHECK-NEXT: [[LAST:%.+]] = rtl.arrayindex [[WIRE]]{{\[}}[[LASTIDX]]{{\]}}
+  // CHECK-NEXT: [[LASTBIT:%.+]] = rtl.read_inout [[LAST]] : !rtl.inout<i1>
+  // CHECK-NEXT: [[RES:%.+]] = rtl.concat [[BIT]], {{.*}}, [[LASTBIT]] : (i1,
+  // CHECK-NEXT: rtl.output [[RES]] : i32
+}
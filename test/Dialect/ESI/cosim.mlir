@@ -1,6 +1,7 @@
 // REQUIRES: capnp
 // RUN: circt-opt %s -verify-diagnostics | circt-opt -verify-diagnostics | FileCheck %s
 // RUN: circt-opt %s --lower-esi-to-rtl -verify-diagnostics | circt-opt -verify-diagnostics | FileCheck --check-prefix=COSIM %s
+// RUN: circt-opt %s --lower-esi-to-rtl=cosim-max-msgs-per-poll=8 -verify-diagnostics | FileCheck --check-prefix=DRAIN %s
 // RUN: circt-translate %s -emit-esi-capnp -verify-diagnostics | FileCheck --check-prefix=CAPNP %s
 
 module {
@@ -30,6 +31,7 @@ module {
     // COSIM: %rawOutput, %valid = esi.unwrap.vr %send.x, %TestEP.DataInReady : si14
     // COSIM: %0 = esi.encode.capnp %rawOutput : si14 -> !rtl.array<192xi1>
     // COSIM: %TestEP.DataOutValid, %TestEP.DataOut, %TestEP.DataInReady = rtl.instance "TestEP" @Cosim_Endpoint(%clk, %rstn, %ready, %valid, %0) {parameters = {ENDPOINT_ID = 1 : i32, RECVTYPE_SIZE_BITS = 192 : i64, RECV_TYPE_ID = 14000240888948784983 : ui64, SEND_TYPE_ID = 10295436870447851681 : ui64, SEND_TYPE_SIZE_BITS = 192 : i64}} : (i1, i1, i1, i1, !rtl.array<192xi1>) -> (i1, !rtl.array<192xi1>, i1)
-    // COSIM: %1 = esi.decode.capnp %TestEP.DataOut : !rtl.array<192xi1> -> !esi.channel<i32>
+    // DRAIN: rtl.instance "TestEP" @Cosim_Endpoint(%clk, %rstn, %ready, %valid, %0) {parameters = {ENDPOINT_ID = 1 : i32, MAX_MSGS_PER_POLL = 8 : i32, RECVTYPE_SIZE_BITS = 192 : i64,
+    // COSIM: %1 = esi.decode.capnp %TestEP.DataOut : !rtl.array<192xi1> -> i32
   }
 }
@@ -43,3 +43,17 @@ rtl.module @test(%m : !sv.modport<@IData::@Noexist>) {
   // expected-error @+1 {{Could not find modport @IData::@Noexist in symbol table.}}
   %idataChanOut = esi.wrap.iface %m: !sv.modport<@IData::@Noexist> -> !esi.channel<i32>
 }
+
+// -----
+
+rtl.module @test(%clk: i1, %rstn: i1, %chan: !esi.channel<i4>) {
+  // expected-error @+1 {{unknown buffer kind 'lifo', expected 'pipeline' or 'fifo'}}
+  %buffered = esi.buffer %clk, %rstn, %chan { stages = 4, kind = "lifo" } : i4
+}
+
+// -----
+
+rtl.module @test(%clk: i1, %rstn: i1, %chan: !esi.channel<i6>) {
+  // expected-error @+1 {{width of 'i16' is not a multiple of the width of 'i6'}}
+  %wide = esi.pack %clk, %rstn, %chan : !esi.channel<i6> -> !esi.channel<i16>
+}
@@ -0,0 +1,17 @@
+// RUN: circt-opt %s -verify-diagnostics | circt-opt -verify-diagnostics | FileCheck %s
+// RUN: circt-opt %s --lower-esi-to-rtl -verify-diagnostics | FileCheck --check-prefix=RTL %s
+
+rtl.module @gearbox(%clk: i1, %rstn: i1, %narrow: !esi.channel<i8>) -> (%out: !esi.channel<i8>) {
+  %wide = esi.pack %clk, %rstn, %narrow : !esi.channel<i8> -> !esi.channel<i32>
+  %back = esi.unpack %clk, %rstn, %wide : !esi.channel<i32> -> !esi.channel<i8>
+  rtl.output %back : !esi.channel<i8>
+}
+// CHECK-LABEL: rtl.module @gearbox
+// CHECK-NEXT:    %0 = esi.pack %clk, %rstn, %narrow : !esi.channel<i8> -> !esi.channel<i32>
+// CHECK-NEXT:    %1 = esi.unpack %clk, %rstn, %0 : !esi.channel<i32> -> !esi.channel<i8>
+
+// RTL-LABEL: rtl.externmodule @ESI_Pack(
+// RTL-LABEL: rtl.externmodule @ESI_Unpack(
+// RTL-LABEL: rtl.module @gearbox
+// RTL:         %pack.a_ready, %pack.x, %pack.x_valid = rtl.instance "pack" @ESI_Pack(%clk, %rstn, %rawOutput, %valid, {{.+}}) {parameters = {IN_WIDTH = 8 : ui32, OUT_WIDTH = 32 : ui32}} : (i1, i1, i8, i1, i1) -> (i1, i32, i1)
+// RTL:         %unpack.a_ready, %unpack.x, %unpack.x_valid = rtl.instance "unpack" @ESI_Unpack(%clk, %rstn, %pack.x, %pack.x_valid, {{.+}}) {parameters = {IN_WIDTH = 32 : ui32, OUT_WIDTH = 8 : ui32}} : (i1, i1, i32, i1, i1) -> (i1, i8, i1)
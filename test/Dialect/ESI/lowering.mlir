@@ -1,6 +1,7 @@
 // RUN: circt-opt %s --lower-esi-to-physical -verify-diagnostics | circt-opt -verify-diagnostics | FileCheck %s
 // RUN: circt-opt %s --lower-esi-ports -verify-diagnostics | circt-opt -verify-diagnostics | FileCheck --check-prefix=IFACE %s
 // RUN: circt-opt %s --lower-esi-to-physical --lower-esi-ports --lower-esi-to-rtl -verify-diagnostics | circt-opt -verify-diagnostics | FileCheck --check-prefix=RTL %s
+// RUN: circt-opt %s --lower-esi-to-physical --lower-esi-ports --lower-esi-to-rtl=credits=8 -verify-diagnostics | FileCheck --check-prefix=CREDIT %s
 
 module {
   rtl.externmodule @Sender(%clk: i1) -> ( %x: !esi.channel<i4>, %y: i8 )
@@ -9,6 +10,13 @@ module {
   // CHECK-LABEL: rtl.externmodule @Sender(i1 {rtl.name = "clk"}) -> (%x: !esi.channel<i4>, %y: i8)
   // CHECK-LABEL: rtl.externmodule @Reciever(!esi.channel<i4> {rtl.name = "a"}, i1 {rtl.name = "clk"})
 
+  // CREDIT-LABEL: rtl.externmodule @ESI_CreditLink(
+  // CREDIT-NOT:   ESI_PipelineStage
+  // CREDIT:       rtl.instance "creditLink" @ESI_CreditLink({{.+}}) {parameters = {CREDITS = 8 : ui32, WIDTH = 4 : ui32}}
+
+  // RTL-LABEL: rtl.externmodule @ESI_FIFO(
+  // RTL:         rtl.instance "deep_fifo" @ESI_FIFO(%clk, %rstn, {{.+}}) {parameters = {DEPTH = 32 : ui32, WIDTH = 4 : ui32}}
+
   // IFACE-LABEL: sv.interface @IValidReady_i4 {
   // IFACE-NEXT:    sv.interface.signal @valid : i1
   // IFACE-NEXT:    sv.interface.signal @ready : i1
@@ -45,6 +53,14 @@ module {
     // IFACE-NEXT:    %7 = sv.modport.get %5 @source : !sv.interface<@IValidReady_i4> -> !sv.modport<@IValidReady_i4::@source>
     // IFACE-NEXT:    rtl.instance "recv2" @Reciever(%7, %clk) : (!sv.modport<@IValidReady_i4::@source>, i1) -> ()
 
+    %esiChan3, %1 = rtl.instance "sender3" @Sender (%clk) : (i1) -> (!esi.channel<i4>, i8)
+    %bufferedChan3 = esi.buffer %clk, %rstn, %esiChan3 { stages = 32, kind = "fifo", name = "deep" } : i4
+    rtl.instance "recv3" @Reciever (%bufferedChan3, %clk) : (!esi.channel<i4>, i1) -> ()
+
+    // CHECK:      %sender3.x, %sender3.y = rtl.instance "sender3" @Sender(%clk) : (i1) -> (!esi.channel<i4>, i8)
+    // CHECK-NEXT:  %4 = esi.fifo %clk, %rstn, %sender3.x {depth = 32 : i64, name = "deep_fifo"} : i4
+    // CHECK-NEXT:  rtl.instance "recv3" @Reciever(%4, %clk)  : (!esi.channel<i4>, i1) -> ()
+
     // After all 3 ESI lowering passes, there shouldn't be any ESI constructs!
     // RTL-NOT: esi
   }
@@ -0,0 +1,39 @@
+// RUN: circt-opt %s --lower-esi-ports -verify-diagnostics | FileCheck %s
+
+// The instances in each module are rewritten in order, whichever updated module
+// they instantiate.
+
+rtl.externmodule @Source(%clk: i1) -> (%x: !esi.channel<i8>)
+rtl.externmodule @Sink(%a: !esi.channel<i8>, %b: !esi.channel<i1>)
+rtl.externmodule @Plain(%clk: i1) -> (%y: i8)
+
+// CHECK-LABEL: rtl.externmodule @Source(i1 {rtl.name = "clk"}, !sv.modport<{{.*}}@sink> {rtl.name = "x"})
+// CHECK-LABEL: rtl.externmodule @Sink(!sv.modport<{{.*}}@source> {rtl.name = "a"}, !sv.modport<{{.*}}@source> {rtl.name = "b"})
+// CHECK-LABEL: rtl.externmodule @Plain(i1 {rtl.name = "clk"}) -> (%y: i8)
+
+// CHECK-LABEL: rtl.module @First
+rtl.module @First(%clk: i1, %b: !esi.channel<i1>) -> (%y: i8) {
+  // CHECK:      sv.interface.instance : !sv.interface<@IValidReady_i8>
+  // CHECK:      rtl.instance "src" @Source(%clk, {{%.+}}) : (i1, !sv.modport<@IValidReady_i8::@sink>) -> ()
+  %x = rtl.instance "src" @Source(%clk) : (i1) -> !esi.channel<i8>
+  // CHECK-NEXT: %plain.y = rtl.instance "plain" @Plain(%clk) : (i1) -> i8
+  %y = rtl.instance "plain" @Plain(%clk) : (i1) -> i8
+  // CHECK:      esi.unwrap.iface %b into
+  // CHECK:      rtl.instance "snk" @Sink({{%.+}}, {{%.+}}) : (!sv.modport<@IValidReady_i8::@source>, !sv.modport<@IValidReady_i1::@source>) -> ()
+  rtl.instance "snk" @Sink(%x, %b) : (!esi.channel<i8>, !esi.channel<i1>) -> ()
+  // CHECK-NEXT: rtl.output %plain.y : i8
+  rtl.output %y : i8
+}
+
+// CHECK-LABEL: rtl.module @Second
+rtl.module @Second(%clk: i1, %b: !esi.channel<i1>) {
+  // CHECK:      rtl.instance "src0" @Source(%clk, {{%.+}})
+  // CHECK:      rtl.instance "src1" @Source(%clk, {{%.+}})
+  // CHECK:      rtl.instance "snk" @Sink(
+  %x0 = rtl.instance "src0" @Source(%clk) : (i1) -> !esi.channel<i8>
+  %x1 = rtl.instance "src1" @Source(%clk) : (i1) -> !esi.channel<i8>
+  rtl.instance "snk" @Sink(%x1, %b) : (!esi.channel<i8>, !esi.channel<i1>) -> ()
+  // CHECK-NOT:  esi.wrap.iface
+  // CHECK:      rtl.output
+  rtl.output
+}
@@ -406,4 +406,161 @@ firrtl.module @xorUnsized(%inp_1: !firrtl.sint, %tmp10: !firrtl.flip<uint>) {
   %0 = firrtl.xor %inp_1, %inp_1 : (!firrtl.sint, !firrtl.sint) -> !firrtl.uint
   firrtl.connect %tmp10, %0 : !firrtl.flip<uint>, !firrtl.uint
 }
+
+// CHECK-LABEL: firrtl.module @Arithmetic
+firrtl.module @Arithmetic(%a: !firrtl.uint<4>,
+                          %out5: !firrtl.flip<uint<5>>,
+                          %out8: !firrtl.flip<uint<8>>,
+                          %outs5: !firrtl.flip<sint<5>>) {
+  %c3_ui4 = firrtl.constant(3 : ui4) : !firrtl.uint<4>
+  %c9_ui4 = firrtl.constant(9 : ui4) : !firrtl.uint<4>
+  %c0_ui4 = firrtl.constant(0 : ui4) : !firrtl.uint<4>
+  %c-3_si4 = firrtl.constant(-3 : si4) : !firrtl.sint<4>
+  %c2_si4 = firrtl.constant(2 : si4) : !firrtl.sint<4>
+
+  // CHECK-DAG: [[ADD:%.+]] = firrtl.constant(12 : i5) : !firrtl.uint<5>
+  // CHECK-DAG: [[SUB:%.+]] = firrtl.constant(-5 : i5) : !firrtl.sint<5>
+  // CHECK-DAG: [[ZERO5:%.+]] = firrtl.constant(0 : i5) : !firrtl.uint<5>
+  // CHECK-DAG: [[MUL:%.+]] = firrtl.constant(27 : i8) : !firrtl.uint<8>
+  // CHECK-DAG: [[ZERO8:%.+]] = firrtl.constant(0 : i8) : !firrtl.uint<8>
+  // CHECK-DAG: [[NEG:%.+]] = firrtl.constant(-3 : i5) : !firrtl.sint<5>
+  // CHECK-DAG: [[CVT:%.+]] = firrtl.constant(9 : i5) : !firrtl.sint<5>
+
+  // CHECK: firrtl.connect %out5, [[ADD]]
+  %0 = firrtl.add %c3_ui4, %c9_ui4 : (!firrtl.uint<4>, !firrtl.uint<4>) -> !firrtl.uint<5>
+  firrtl.connect %out5, %0 : !firrtl.flip<uint<5>>, !firrtl.uint<5>
+
+  // CHECK: firrtl.connect %outs5, [[SUB]]
+  %1 = firrtl.sub %c-3_si4, %c2_si4 : (!firrtl.sint<4>, !firrtl.sint<4>) -> !firrtl.sint<5>
+  firrtl.connect %outs5, %1 : !firrtl.flip<sint<5>>, !firrtl.sint<5>
+
+  // CHECK: firrtl.connect %out5, [[ZERO5]]
+  %2 = firrtl.sub %a, %a : (!firrtl.uint<4>, !firrtl.uint<4>) -> !firrtl.uint<5>
+  firrtl.connect %out5, %2 : !firrtl.flip<uint<5>>, !firrtl.uint<5>
+
+  // CHECK: firrtl.connect %out8, [[MUL]]
+  %3 = firrtl.mul %c3_ui4, %c9_ui4 : (!firrtl.uint<4>, !firrtl.uint<4>) -> !firrtl.uint<8>
+  firrtl.connect %out8, %3 : !firrtl.flip<uint<8>>, !firrtl.uint<8>
+
+  // CHECK: firrtl.connect %out8, [[ZERO8]]
+  %4 = firrtl.mul %a, %c0_ui4 : (!firrtl.uint<4>, !firrtl.uint<4>) -> !firrtl.uint<8>
+  firrtl.connect %out8, %4 : !firrtl.flip<uint<8>>, !firrtl.uint<8>
+
+  // CHECK: firrtl.connect %outs5, [[NEG]]
+  %5 = firrtl.neg %c3_ui4 : (!firrtl.uint<4>) -> !firrtl.sint<5>
+  firrtl.connect %outs5, %5 : !firrtl.flip<sint<5>>, !firrtl.sint<5>
+
+  // CHECK: firrtl.connect %outs5, [[CVT]]
+  %6 = firrtl.cvt %c9_ui4 : (!firrtl.uint<4>) -> !firrtl.sint<5>
+  firrtl.connect %outs5, %6 : !firrtl.flip<sint<5>>, !firrtl.sint<5>
+}
+
+// CHECK-LABEL: firrtl.module @Compare
+firrtl.module @Compare(%a: !firrtl.uint<4>, %s: !firrtl.sint<4>,
+                       %out: !firrtl.flip<uint<1>>) {
+  %c3_ui4 = firrtl.constant(3 : ui4) : !firrtl.uint<4>
+  %c9_ui4 = firrtl.constant(9 : ui4) : !firrtl.uint<4>
+  %c0_ui4 = firrtl.constant(0 : ui4) : !firrtl.uint<4>
+  %c-3_si4 = firrtl.constant(-3 : si4) : !firrtl.sint<4>
+  %c2_si3 = firrtl.constant(2 : si3) : !firrtl.sint<3>
+
+  // CHECK-DAG: [[TRUE:%.+]] = firrtl.constant(true) : !firrtl.uint<1>
+  // CHECK-DAG: [[FALSE:%.+]] = firrtl.constant(false) : !firrtl.uint<1>
+
+  // CHECK: firrtl.connect %out, [[TRUE]]
+  %0 = firrtl.lt %c3_ui4, %c9_ui4 : (!firrtl.uint<4>, !firrtl.uint<4>) -> !firrtl.uint<1>
+  firrtl.connect %out, %0 : !firrtl.flip<uint<1>>, !firrtl.uint<1>
+
+  // CHECK-NEXT: firrtl.connect %out, [[FALSE]]
+  %1 = firrtl.gt %c-3_si4, %c2_si3 : (!firrtl.sint<4>, !firrtl.sint<3>) -> !firrtl.uint<1>
+  firrtl.connect %out, %1 : !firrtl.flip<uint<1>>, !firrtl.uint<1>
+
+  // CHECK-NEXT: firrtl.connect %out, [[TRUE]]
+  %2 = firrtl.leq %s, %s : (!firrtl.sint<4>, !firrtl.sint<4>) -> !firrtl.uint<1>
+  firrtl.connect %out, %2 : !firrtl.flip<uint<1>>, !firrtl.uint<1>
+
+  // CHECK-NEXT: firrtl.connect %out, [[FALSE]]
+  %3 = firrtl.lt %a, %c0_ui4 : (!firrtl.uint<4>, !firrtl.uint<4>) -> !firrtl.uint<1>
+  firrtl.connect %out, %3 : !firrtl.flip<uint<1>>, !firrtl.uint<1>
+
+  // CHECK-NEXT: firrtl.connect %out, [[TRUE]]
+  %4 = firrtl.geq %a, %c0_ui4 : (!firrtl.uint<4>, !firrtl.uint<4>) -> !firrtl.uint<1>
+  firrtl.connect %out, %4 : !firrtl.flip<uint<1>>, !firrtl.uint<1>
+
+  // CHECK-NEXT: firrtl.connect %out, [[FALSE]]
+  %5 = firrtl.neq %a, %a : (!firrtl.uint<4>, !firrtl.uint<4>) -> !firrtl.uint<1>
+  firrtl.connect %out, %5 : !firrtl.flip<uint<1>>, !firrtl.uint<1>
+
+  // CHECK-NEXT: firrtl.lt %s, %c
+  %6 = firrtl.lt %s, %c-3_si4 : (!firrtl.sint<4>, !firrtl.sint<4>) -> !firrtl.uint<1>
+  firrtl.connect %out, %6 : !firrtl.flip<uint<1>>, !firrtl.uint<1>
+}
+
+// CHECK-LABEL: firrtl.module @DynamicShift
+firrtl.module @DynamicShift(%a: !firrtl.uint<4>,
+                            %out4: !firrtl.flip<uint<4>>,
+                            %outs4: !firrtl.flip<sint<4>>,
+                            %out7: !firrtl.flip<uint<7>>) {
+  %c0_ui2 = firrtl.constant(0 : ui2) : !firrtl.uint<2>
+  %c2_ui2 = firrtl.constant(2 : ui2) : !firrtl.uint<2>
+  %c13_ui4 = firrtl.constant(13 : ui4) : !firrtl.uint<4>
+  %c-6_si4 = firrtl.constant(-6 : si4) : !firrtl.sint<4>
+
+  // CHECK-DAG: [[DSHR:%.+]] = firrtl.constant(3 : i4) : !firrtl.uint<4>
+  // CHECK-DAG: [[DSHRS:%.+]] = firrtl.constant(-2 : i4) : !firrtl.sint<4>
+  // CHECK-DAG: [[DSHL:%.+]] = firrtl.constant(52 : i7) : !firrtl.uint<7>
+
+  // CHECK: firrtl.connect %out4, %a
+  %0 = firrtl.dshr %a, %c0_ui2 : (!firrtl.uint<4>, !firrtl.uint<2>) -> !firrtl.uint<4>
+  firrtl.connect %out4, %0 : !firrtl.flip<uint<4>>, !firrtl.uint<4>
+
+  // CHECK: firrtl.connect %out4, [[DSHR]]
+  %1 = firrtl.dshr %c13_ui4, %c2_ui2 : (!firrtl.uint<4>, !firrtl.uint<2>) -> !firrtl.uint<4>
+  firrtl.connect %out4, %1 : !firrtl.flip<uint<4>>, !firrtl.uint<4>
+
+  // CHECK: firrtl.connect %outs4, [[DSHRS]]
+  %2 = firrtl.dshr %c-6_si4, %c2_ui2 : (!firrtl.sint<4>, !firrtl.uint<2>) -> !firrtl.sint<4>
+  firrtl.connect %outs4, %2 : !firrtl.flip<sint<4>>, !firrtl.sint<4>
+
+  // CHECK: firrtl.connect %out7, [[DSHL]]
+  %3 = firrtl.dshl %c13_ui4, %c2_ui2 : (!firrtl.uint<4>, !firrtl.uint<2>) -> !firrtl.uint<7>
+  firrtl.connect %out7, %3 : !firrtl.flip<uint<7>>, !firrtl.uint<7>
+}
+
+// CHECK-LABEL: firrtl.module @Unary
+firrtl.module @Unary(%a: !firrtl.uint<4>, %z: !firrtl.uint<0>,
+                     %out1: !firrtl.flip<uint<1>>,
+                     %out4: !firrtl.flip<uint<4>>) {
+  %c13_ui4 = firrtl.constant(13 : ui4) : !firrtl.uint<4>
+  %c15_ui4 = firrtl.constant(15 : ui4) : !firrtl.uint<4>
+
+  // CHECK-DAG: [[TRUE:%.+]] = firrtl.constant(true) : !firrtl.uint<1>
+  // CHECK-DAG: [[FALSE:%.+]] = firrtl.constant(false) : !firrtl.uint<1>
+  // CHECK-DAG: [[NOT:%.+]] = firrtl.constant(2 : i4) : !firrtl.uint<4>
+
+  // CHECK: firrtl.connect %out4, %a
+  %0 = firrtl.not %a : (!firrtl.uint<4>) -> !firrtl.uint<4>
+  %1 = firrtl.not %0 : (!firrtl.uint<4>) -> !firrtl.uint<4>
+  firrtl.connect %out4, %1 : !firrtl.flip<uint<4>>, !firrtl.uint<4>
+
+  // CHECK-NEXT: firrtl.connect %out4, [[NOT]]
+  %2 = firrtl.not %c13_ui4 : (!firrtl.uint<4>) -> !firrtl.uint<4>
+  firrtl.connect %out4, %2 : !firrtl.flip<uint<4>>, !firrtl.uint<4>
+
+  // CHECK-NEXT: firrtl.connect %out1, [[TRUE]]
+  %3 = firrtl.andr %c15_ui4 : (!firrtl.uint<4>) -> !firrtl.uint<1>
+  firrtl.connect %out1, %3 : !firrtl.flip<uint<1>>, !firrtl.uint<1>
+
+  // CHECK-NEXT: firrtl.connect %out1, [[TRUE]]
+  %4 = firrtl.xorr %c13_ui4 : (!firrtl.uint<4>) -> !firrtl.uint<1>
+  firrtl.connect %out1, %4 : !firrtl.flip<uint<1>>, !firrtl.uint<1>
+
+  // CHECK-NEXT: firrtl.connect %out1, [[TRUE]]
+  %5 = firrtl.andr %z : (!firrtl.uint<0>) -> !firrtl.uint<1>
+  firrtl.connect %out1, %5 : !firrtl.flip<uint<1>>, !firrtl.uint<1>
+
+  // CHECK-NEXT: firrtl.connect %out1, [[FALSE]]
+  %6 = firrtl.orr %z : (!firrtl.uint<0>) -> !firrtl.uint<1>
+  firrtl.connect %out1, %6 : !firrtl.flip<uint<1>>, !firrtl.uint<1>
+}
 }
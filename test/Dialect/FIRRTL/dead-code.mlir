@@ -0,0 +1,103 @@
+// RUN: circt-opt -pass-pipeline='firrtl.circuit(firrtl-dead-code)' --split-input-file %s | FileCheck %s
+
+firrtl.circuit "Top" {
+  // Modules which aren't instantiated from the main module are removed.
+  // CHECK-NOT: @Unused
+  firrtl.module @Unused(%in: !firrtl.uint<1>) {
+    %a = firrtl.instance @UnusedExt {name = "a"} : !firrtl.flip<bundle<in: uint<1>>>
+  }
+  firrtl.extmodule @UnusedExt(!firrtl.uint<1> {firrtl.name = "in"})
+
+  // Inputs which are never read, and outputs which are never read by an
+  // instance, are removed.
+  // CHECK-LABEL: firrtl.module @Child
+  // CHECK-SAME: (%in: !firrtl.uint<8>, %out: !firrtl.flip<uint<8>>)
+  firrtl.module @Child(%in: !firrtl.uint<8>, %unusedIn: !firrtl.uint<8>,
+                       %out: !firrtl.flip<uint<8>>, %unusedOut: !firrtl.flip<uint<8>>) {
+    // CHECK-NEXT: firrtl.connect %out, %in
+    // CHECK-NEXT: }
+    firrtl.connect %out, %in : !firrtl.flip<uint<8>>, !firrtl.uint<8>
+    %0 = firrtl.not %in : (!firrtl.uint<8>) -> !firrtl.uint<8>
+    firrtl.connect %unusedOut, %0 : !firrtl.flip<uint<8>>, !firrtl.uint<8>
+  }
+
+  // An input which is always driven by the same constant is replaced by the
+  // constant.
+  // CHECK-LABEL: firrtl.module @ConstantIn
+  // CHECK-SAME: (%out: !firrtl.flip<uint<8>>)
+  firrtl.module @ConstantIn(%in: !firrtl.uint<8>, %out: !firrtl.flip<uint<8>>) {
+    // CHECK-NEXT: %c3_ui8 = firrtl.constant(3 : ui8) : !firrtl.uint<8>
+    // CHECK-NEXT: firrtl.connect %out, %c3_ui8
+    firrtl.connect %out, %in : !firrtl.flip<uint<8>>, !firrtl.uint<8>
+  }
+
+  // An output which is always driven by the same constant is replaced by the
+  // constant in the instantiating modules.
+  // CHECK-LABEL: firrtl.module @ConstantOut
+  // CHECK-SAME: (%in: !firrtl.uint<8>)
+  // CHECK-NEXT: }
+  firrtl.module @ConstantOut(%in: !firrtl.uint<8>, %out: !firrtl.flip<uint<8>>) {
+    %c5_ui8 = firrtl.constant(5 : ui8) : !firrtl.uint<8>
+    firrtl.connect %out, %c5_ui8 : !firrtl.flip<uint<8>>, !firrtl.uint<8>
+  }
+
+  // The ports of the main module are left alone.
+  // CHECK-LABEL: firrtl.module @Top
+  // CHECK-SAME: (%in: !firrtl.uint<8>, %unused: !firrtl.uint<8>, %out1: !firrtl.flip<uint<8>>, %out2: !firrtl.flip<uint<8>>, %out3: !firrtl.flip<uint<8>>)
+  firrtl.module @Top(%in: !firrtl.uint<8>, %unused: !firrtl.uint<8>,
+                     %out1: !firrtl.flip<uint<8>>, %out2: !firrtl.flip<uint<8>>,
+                     %out3: !firrtl.flip<uint<8>>) {
+    // CHECK: firrtl.instance @Child {name = "child"} : !firrtl.bundle<in: flip<uint<8>>, out: uint<8>>
+    %child = firrtl.instance @Child {name = "child"} : !firrtl.bundle<in: flip<uint<8>>, unusedIn: flip<uint<8>>, out: uint<8>, unusedOut: uint<8>>
+    %0 = firrtl.subfield %child("in") : (!firrtl.bundle<in: flip<uint<8>>, unusedIn: flip<uint<8>>, out: uint<8>, unusedOut: uint<8>>) -> !firrtl.flip<uint<8>>
+    %1 = firrtl.subfield %child("unusedIn") : (!firrtl.bundle<in: flip<uint<8>>, unusedIn: flip<uint<8>>, out: uint<8>, unusedOut: uint<8>>) -> !firrtl.flip<uint<8>>
+    %2 = firrtl.subfield %child("out") : (!firrtl.bundle<in: flip<uint<8>>, unusedIn: flip<uint<8>>, out: uint<8>, unusedOut: uint<8>>) -> !firrtl.uint<8>
+    %3 = firrtl.subfield %child("unusedOut") : (!firrtl.bundle<in: flip<uint<8>>, unusedIn: flip<uint<8>>, out: uint<8>, unusedOut: uint<8>>) -> !firrtl.uint<8>
+    firrtl.connect %0, %in : !firrtl.flip<uint<8>>, !firrtl.uint<8>
+    firrtl.connect %1, %in : !firrtl.flip<uint<8>>, !firrtl.uint<8>
+    firrtl.connect %out1, %2 : !firrtl.flip<uint<8>>, !firrtl.uint<8>
+
+    // CHECK: firrtl.instance @ConstantIn {name = "constantIn"} : !firrtl.bundle<out: uint<8>>
+    %constantIn = firrtl.instance @ConstantIn {name = "constantIn"} : !firrtl.bundle<in: flip<uint<8>>, out: uint<8>>
+    %4 = firrtl.subfield %constantIn("in") : (!firrtl.bundle<in: flip<uint<8>>, out: uint<8>>) -> !firrtl.flip<uint<8>>
+    %5 = firrtl.subfield %constantIn("out") : (!firrtl.bundle<in: flip<uint<8>>, out: uint<8>>) -> !firrtl.uint<8>
+    %c3_ui8 = firrtl.constant(3 : ui8) : !firrtl.uint<8>
+    firrtl.connect %4, %c3_ui8 : !firrtl.flip<uint<8>>, !firrtl.uint<8>
+    firrtl.connect %out2, %5 : !firrtl.flip<uint<8>>, !firrtl.uint<8>
+
+    // CHECK: firrtl.instance @ConstantOut {name = "constantOut"} : !firrtl.flip<bundle<in: uint<8>>>
+    // CHECK: [[CONST:%.+]] = firrtl.constant(5 : ui8) : !firrtl.uint<8>
+    // CHECK: firrtl.connect %out3, [[CONST]]
+    %constantOut = firrtl.instance @ConstantOut {name = "constantOut"} : !firrtl.bundle<in: flip<uint<8>>, out: uint<8>>
+    %6 = firrtl.subfield %constantOut("in") : (!firrtl.bundle<in: flip<uint<8>>, out: uint<8>>) -> !firrtl.flip<uint<8>>
+    %7 = firrtl.subfield %constantOut("out") : (!firrtl.bundle<in: flip<uint<8>>, out: uint<8>>) -> !firrtl.uint<8>
+    firrtl.connect %6, %in : !firrtl.flip<uint<8>>, !firrtl.uint<8>
+    firrtl.connect %out3, %7 : !firrtl.flip<uint<8>>, !firrtl.uint<8>
+  }
+}
+
+// -----
+
+// Removing a port can leave the ports of other modules dead.
+firrtl.circuit "Chain" {
+  // CHECK-LABEL: firrtl.module @Leaf
+  // CHECK-SAME: ()
+  firrtl.module @Leaf(%in: !firrtl.uint<1>) {}
+
+  // CHECK-LABEL: firrtl.module @Middle
+  // CHECK-SAME: ()
+  firrtl.module @Middle(%in: !firrtl.uint<1>) {
+    %leaf = firrtl.instance @Leaf {name = "leaf"} : !firrtl.flip<bundle<in: uint<1>>>
+    %0 = firrtl.subfield %leaf("in") : (!firrtl.flip<bundle<in: uint<1>>>) -> !firrtl.flip<uint<1>>
+    firrtl.connect %0, %in : !firrtl.flip<uint<1>>, !firrtl.uint<1>
+  }
+
+  // CHECK-LABEL: firrtl.module @Chain
+  firrtl.module @Chain(%in: !firrtl.uint<1>) {
+    // CHECK-NEXT: firrtl.instance @Middle {name = "middle"} : !firrtl.bundle<>
+    // CHECK-NEXT: }
+    %middle = firrtl.instance @Middle {name = "middle"} : !firrtl.flip<bundle<in: uint<1>>>
+    %0 = firrtl.subfield %middle("in") : (!firrtl.flip<bundle<in: uint<1>>>) -> !firrtl.flip<uint<1>>
+    firrtl.connect %0, %in : !firrtl.flip<uint<1>>, !firrtl.uint<1>
+  }
+}
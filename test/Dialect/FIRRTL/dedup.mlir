@@ -0,0 +1,74 @@
+// RUN: circt-opt -pass-pipeline='firrtl.circuit(firrtl-dedup)' --split-input-file %s | FileCheck %s
+
+firrtl.circuit "Top" {
+  // Modules which only differ in names and locations are merged.
+  // CHECK-LABEL: firrtl.module @Queue_1
+  firrtl.module @Queue_1(%in: !firrtl.uint<8>, %out: !firrtl.flip<uint<8>>) {
+    %w = firrtl.wire : !firrtl.uint<8>
+    firrtl.connect %w, %in : !firrtl.uint<8>, !firrtl.uint<8>
+    firrtl.connect %out, %w : !firrtl.flip<uint<8>>, !firrtl.uint<8>
+  }
+  // CHECK-NOT: firrtl.module @Queue_2
+  firrtl.module @Queue_2(%in: !firrtl.uint<8>, %out: !firrtl.flip<uint<8>>) {
+    %x = firrtl.wire : !firrtl.uint<8> loc("Queue.scala":12:3)
+    firrtl.connect %x, %in : !firrtl.uint<8>, !firrtl.uint<8>
+    firrtl.connect %out, %x : !firrtl.flip<uint<8>>, !firrtl.uint<8>
+  }
+
+  // Modules which differ in their operations are kept.
+  // CHECK-LABEL: firrtl.module @Queue_3
+  firrtl.module @Queue_3(%in: !firrtl.uint<8>, %out: !firrtl.flip<uint<8>>) {
+    %0 = firrtl.not %in : (!firrtl.uint<8>) -> !firrtl.uint<8>
+    firrtl.connect %out, %0 : !firrtl.flip<uint<8>>, !firrtl.uint<8>
+  }
+
+  // Modules which differ in their port names are kept.
+  // CHECK-LABEL: firrtl.module @Queue_4
+  firrtl.module @Queue_4(%a: !firrtl.uint<8>, %b: !firrtl.flip<uint<8>>) {
+    %w = firrtl.wire : !firrtl.uint<8>
+    firrtl.connect %w, %a : !firrtl.uint<8>, !firrtl.uint<8>
+    firrtl.connect %b, %w : !firrtl.flip<uint<8>>, !firrtl.uint<8>
+  }
+
+  // Modules which instantiate merged modules are merged too.
+  // CHECK-LABEL: firrtl.module @Wrapper_1
+  // CHECK-NEXT: firrtl.instance @Queue_1 {name = "q"}
+  firrtl.module @Wrapper_1(%in: !firrtl.uint<8>) {
+    %q = firrtl.instance @Queue_1 {name = "q"} : !firrtl.bundle<in: flip<uint<8>>, out: uint<8>>
+    %0 = firrtl.subfield %q("in") : (!firrtl.bundle<in: flip<uint<8>>, out: uint<8>>) -> !firrtl.flip<uint<8>>
+    firrtl.connect %0, %in : !firrtl.flip<uint<8>>, !firrtl.uint<8>
+  }
+  // CHECK-NOT: firrtl.module @Wrapper_2
+  firrtl.module @Wrapper_2(%in: !firrtl.uint<8>) {
+    %queue = firrtl.instance @Queue_2 {name = "queue"} : !firrtl.bundle<in: flip<uint<8>>, out: uint<8>>
+    %0 = firrtl.subfield %queue("in") : (!firrtl.bundle<in: flip<uint<8>>, out: uint<8>>) -> !firrtl.flip<uint<8>>
+    firrtl.connect %0, %in : !firrtl.flip<uint<8>>, !firrtl.uint<8>
+  }
+
+  // CHECK-LABEL: firrtl.module @Top
+  firrtl.module @Top(%in: !firrtl.uint<8>) {
+    // CHECK-NEXT: firrtl.instance @Queue_1 {name = "a"}
+    // CHECK-NEXT: firrtl.instance @Queue_1 {name = "b"}
+    // CHECK-NEXT: firrtl.instance @Queue_3 {name = "c"}
+    // CHECK-NEXT: firrtl.instance @Queue_4 {name = "d"}
+    // CHECK-NEXT: firrtl.instance @Wrapper_1 {name = "e"}
+    // CHECK-NEXT: firrtl.instance @Wrapper_1 {name = "f"}
+    %a = firrtl.instance @Queue_1 {name = "a"} : !firrtl.bundle<in: flip<uint<8>>, out: uint<8>>
+    %b = firrtl.instance @Queue_2 {name = "b"} : !firrtl.bundle<in: flip<uint<8>>, out: uint<8>>
+    %c = firrtl.instance @Queue_3 {name = "c"} : !firrtl.bundle<in: flip<uint<8>>, out: uint<8>>
+    %d = firrtl.instance @Queue_4 {name = "d"} : !firrtl.bundle<a: flip<uint<8>>, b: uint<8>>
+    %e = firrtl.instance @Wrapper_1 {name = "e"} : !firrtl.flip<bundle<in: uint<8>>>
+    %f = firrtl.instance @Wrapper_2 {name = "f"} : !firrtl.flip<bundle<in: uint<8>>>
+  }
+}
+
+// -----
+
+// The main module is never merged.
+// CHECK-LABEL: firrtl.circuit "Main"
+firrtl.circuit "Main" {
+  // CHECK: firrtl.module @Other
+  firrtl.module @Other() {}
+  // CHECK: firrtl.module @Main
+  firrtl.module @Main() {}
+}
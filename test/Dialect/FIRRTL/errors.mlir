@@ -356,3 +356,12 @@ firrtl.circuit "NodeMustBePassive" {
   }
 }
 
+
+// -----
+
+firrtl.circuit "VectorArrayCastShape" {
+  firrtl.module @VectorArrayCastShape(%a : !firrtl.vector<uint<4>, 2>) {
+    // expected-error @+1 {{vector and array type must have the same shape}}
+    %0 = firrtl.vectorArrayCast %a : (!firrtl.vector<uint<4>, 2>) -> !rtl.array<2xi3>
+  }
+}
@@ -0,0 +1,95 @@
+// RUN: circt-opt -pass-pipeline='firrtl.circuit(firrtl.module(firrtl-expand-whens))' --split-input-file --verify-diagnostics %s | FileCheck %s
+
+firrtl.circuit "Simple" {
+  // A connect in a when is muxed with the connect before it.
+  // CHECK-LABEL: firrtl.module @Simple
+  firrtl.module @Simple(%p: !firrtl.uint<1>, %a: !firrtl.uint<8>, %b: !firrtl.uint<8>, %out: !firrtl.flip<uint<8>>) {
+    // CHECK-NEXT: [[MUX:%.+]] = firrtl.mux(%p, %b, %a)
+    // CHECK-NEXT: firrtl.connect %out, [[MUX]]
+    // CHECK-NEXT: }
+    firrtl.connect %out, %a : !firrtl.flip<uint<8>>, !firrtl.uint<8>
+    firrtl.when %p {
+      firrtl.connect %out, %b : !firrtl.flip<uint<8>>, !firrtl.uint<8>
+    }
+  }
+
+  // Both branches of a when are muxed, and only the last connect in a branch
+  // counts.
+  // CHECK-LABEL: firrtl.module @ThenElse
+  firrtl.module @ThenElse(%p: !firrtl.uint<1>, %a: !firrtl.uint<8>, %b: !firrtl.uint<8>, %c: !firrtl.uint<8>, %out: !firrtl.flip<uint<8>>) {
+    // CHECK-NEXT: [[NOT:%.+]] = firrtl.not %p
+    // CHECK-NEXT: [[MUX:%.+]] = firrtl.mux(%p, %b, %c)
+    // CHECK-NEXT: firrtl.connect %out, [[MUX]]
+    // CHECK-NEXT: }
+    firrtl.when %p {
+      firrtl.connect %out, %a : !firrtl.flip<uint<8>>, !firrtl.uint<8>
+      firrtl.connect %out, %b : !firrtl.flip<uint<8>>, !firrtl.uint<8>
+    } else {
+      firrtl.connect %out, %c : !firrtl.flip<uint<8>>, !firrtl.uint<8>
+    }
+  }
+
+  // Declarations are moved out of the when, and registers keep their value.
+  // CHECK-LABEL: firrtl.module @Register
+  firrtl.module @Register(%clock: !firrtl.clock, %p: !firrtl.uint<1>, %a: !firrtl.uint<8>) {
+    // CHECK-NEXT: %r = firrtl.reg %clock
+    // CHECK-NEXT: %n = firrtl.node %a
+    // CHECK-NEXT: [[MUX:%.+]] = firrtl.mux(%p, %n, %r)
+    // CHECK-NEXT: firrtl.connect %r, [[MUX]]
+    // CHECK-NEXT: }
+    %r = firrtl.reg %clock {name = "r"} : (!firrtl.clock) -> !firrtl.uint<8>
+    firrtl.when %p {
+      %n = firrtl.node %a {name = "n"} : !firrtl.uint<8>
+      firrtl.connect %r, %n : !firrtl.uint<8>, !firrtl.uint<8>
+    }
+  }
+
+  // Nested whens only mux the destinations they connect, and statements get
+  // the conditions of their whens.
+  // CHECK-LABEL: firrtl.module @Nested
+  firrtl.module @Nested(%clock: !firrtl.clock, %p: !firrtl.uint<1>, %q: !firrtl.uint<1>, %a: !firrtl.uint<8>, %b: !firrtl.uint<8>, %out: !firrtl.flip<uint<8>>) {
+    // CHECK-NEXT: [[P_AND_Q:%.+]] = firrtl.and %p, %q
+    // CHECK-NEXT: [[EN:%.+]] = firrtl.and [[P_AND_Q]], %p
+    // CHECK-NEXT: firrtl.printf %clock, [[EN]], "hello"
+    // CHECK-NEXT: [[INNER:%.+]] = firrtl.mux(%q, %b, %a)
+    // CHECK-NEXT: [[OUTER:%.+]] = firrtl.mux(%p, [[INNER]], %a)
+    // CHECK-NEXT: firrtl.connect %out, [[OUTER]]
+    // CHECK-NEXT: }
+    firrtl.connect %out, %a : !firrtl.flip<uint<8>>, !firrtl.uint<8>
+    firrtl.when %p {
+      firrtl.when %q {
+        firrtl.printf %clock, %p, "hello"
+        firrtl.connect %out, %b : !firrtl.flip<uint<8>>, !firrtl.uint<8>
+      }
+    }
+  }
+
+  // Elements of aggregates are resolved to the same destination, whichever
+  // subfield refers to them, and invalid values don't need a mux.
+  // CHECK-LABEL: firrtl.module @Elements
+  firrtl.module @Elements(%p: !firrtl.uint<1>, %a: !firrtl.uint<8>, %out: !firrtl.flip<bundle<x: uint<8>, y: uint<8>>>) {
+    // CHECK-NEXT: [[X0:%.+]] = firrtl.subfield %out("x")
+    // CHECK-NEXT: [[INVALID:%.+]] = firrtl.invalidvalue
+    // CHECK-NEXT: [[X1:%.+]] = firrtl.subfield %out("x")
+    // CHECK-NEXT: firrtl.connect [[X0]], %a
+    // CHECK-NEXT: }
+    %0 = firrtl.subfield %out("x") : (!firrtl.flip<bundle<x: uint<8>, y: uint<8>>>) -> !firrtl.flip<uint<8>>
+    %invalid = firrtl.invalidvalue : !firrtl.uint<8>
+    firrtl.connect %0, %invalid : !firrtl.flip<uint<8>>, !firrtl.uint<8>
+    firrtl.when %p {
+      %1 = firrtl.subfield %out("x") : (!firrtl.flip<bundle<x: uint<8>, y: uint<8>>>) -> !firrtl.flip<uint<8>>
+      firrtl.connect %1, %a : !firrtl.flip<uint<8>>, !firrtl.uint<8>
+    }
+  }
+}
+
+// -----
+
+firrtl.circuit "Aggregate" {
+  firrtl.module @Aggregate(%p: !firrtl.uint<1>, %a: !firrtl.bundle<x: uint<8>>, %out: !firrtl.flip<bundle<x: uint<8>>>) {
+    firrtl.when %p {
+      // expected-error @+1 {{aggregate connects inside of a firrtl.when are not supported}}
+      firrtl.connect %out, %a : !firrtl.flip<bundle<x: uint<8>>>, !firrtl.bundle<x: uint<8>>
+    }
+  }
+}
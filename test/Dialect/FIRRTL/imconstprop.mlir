@@ -0,0 +1,124 @@
+// RUN: circt-opt -pass-pipeline='firrtl.circuit(firrtl-imconstprop)' --split-input-file %s | FileCheck %s
+
+firrtl.circuit "Top" {
+  // Constants tied to the inputs of all the instances flow into the module,
+  // the ports are left alone.
+  // CHECK-LABEL: firrtl.module @Child
+  // CHECK-SAME: (%in: !firrtl.uint<8>, %en: !firrtl.uint<1>, %out: !firrtl.flip<uint<8>>, %zero: !firrtl.flip<uint<8>>)
+  firrtl.module @Child(%in: !firrtl.uint<8>, %en: !firrtl.uint<1>,
+                       %out: !firrtl.flip<uint<8>>,
+                       %zero: !firrtl.flip<uint<8>>) {
+    // CHECK-NEXT: %c0_ui8 = firrtl.constant(0 : ui8) : !firrtl.uint<8>
+    // CHECK-NEXT: %c0_ui1 = firrtl.constant(0 : ui1) : !firrtl.uint<1>
+    // CHECK-NEXT: %0 = firrtl.mux(%c0_ui1, %c0_ui8, %in)
+    // CHECK-NEXT: firrtl.connect %out, %0
+    // CHECK-NEXT: firrtl.connect %zero, %c0_ui8
+    // CHECK-NEXT: }
+    %c0_ui8 = firrtl.constant(0 : ui8) : !firrtl.uint<8>
+    %0 = firrtl.mux(%en, %c0_ui8, %in) : (!firrtl.uint<1>, !firrtl.uint<8>, !firrtl.uint<8>) -> !firrtl.uint<8>
+    firrtl.connect %out, %0 : !firrtl.flip<uint<8>>, !firrtl.uint<8>
+    %w = firrtl.wire {name = "w"} : !firrtl.uint<8>
+    firrtl.connect %w, %c0_ui8 : !firrtl.uint<8>, !firrtl.uint<8>
+    %1 = firrtl.xor %w, %c0_ui8 : (!firrtl.uint<8>, !firrtl.uint<8>) -> !firrtl.uint<8>
+    firrtl.connect %zero, %1 : !firrtl.flip<uint<8>>, !firrtl.uint<8>
+  }
+
+  // Registers driven by a constant, or reset to the constant they are driven
+  // with, are constant.  A counter isn't.
+  // CHECK-LABEL: firrtl.module @Regs
+  firrtl.module @Regs(%clock: !firrtl.clock, %reset: !firrtl.uint<1>,
+                      %a: !firrtl.flip<uint<4>>, %b: !firrtl.flip<uint<4>>,
+                      %count: !firrtl.flip<uint<4>>) {
+    // CHECK-NEXT: %c0_ui4 = firrtl.constant(0 : ui4) : !firrtl.uint<4>
+    // CHECK-NEXT: %c1_ui4 = firrtl.constant(1 : ui4) : !firrtl.uint<4>
+    // CHECK-NEXT: %c3_ui4 = firrtl.constant(3 : ui4) : !firrtl.uint<4>
+    // CHECK-NEXT: %counter = firrtl.reg %clock
+    // CHECK-NEXT: [[SUM:%.+]] = firrtl.add %counter, %c1_ui4
+    // CHECK-NEXT: [[TAIL:%.+]] = firrtl.tail [[SUM]], 1
+    // CHECK-NEXT: firrtl.connect %counter, [[TAIL]]
+    // CHECK-NEXT: firrtl.connect %a, %c3_ui4
+    // CHECK-NEXT: firrtl.connect %b, %c0_ui4
+    // CHECK-NEXT: firrtl.connect %count, %counter
+    // CHECK-NEXT: }
+    %c0_ui4 = firrtl.constant(0 : ui4) : !firrtl.uint<4>
+    %c1_ui4 = firrtl.constant(1 : ui4) : !firrtl.uint<4>
+    %c3_ui2 = firrtl.constant(3 : ui2) : !firrtl.uint<2>
+    %r1 = firrtl.reg %clock {name = "r1"} : (!firrtl.clock) -> !firrtl.uint<4>
+    firrtl.connect %r1, %c3_ui2 : !firrtl.uint<4>, !firrtl.uint<2>
+    %r2 = firrtl.regreset %clock, %reset, %c0_ui4 {name = "r2"} : (!firrtl.clock, !firrtl.uint<1>, !firrtl.uint<4>) -> !firrtl.uint<4>
+    firrtl.connect %r2, %r2 : !firrtl.uint<4>, !firrtl.uint<4>
+    %counter = firrtl.reg %clock {name = "counter"} : (!firrtl.clock) -> !firrtl.uint<4>
+    %0 = firrtl.add %counter, %c1_ui4 : (!firrtl.uint<4>, !firrtl.uint<4>) -> !firrtl.uint<5>
+    %1 = firrtl.tail %0, 1 : (!firrtl.uint<5>) -> !firrtl.uint<4>
+    firrtl.connect %counter, %1 : !firrtl.uint<4>, !firrtl.uint<4>
+    firrtl.connect %a, %r1 : !firrtl.flip<uint<4>>, !firrtl.uint<4>
+    firrtl.connect %b, %r2 : !firrtl.flip<uint<4>>, !firrtl.uint<4>
+    firrtl.connect %count, %counter : !firrtl.flip<uint<4>>, !firrtl.uint<4>
+  }
+
+  // The inputs of the main module are unknown.  Constant outputs of an
+  // instance are used directly.
+  // CHECK-LABEL: firrtl.module @Top
+  firrtl.module @Top(%in: !firrtl.uint<8>, %clock: !firrtl.clock,
+                     %reset: !firrtl.uint<1>, %out1: !firrtl.flip<uint<8>>,
+                     %out2: !firrtl.flip<uint<8>>, %out3: !firrtl.flip<uint<8>>,
+                     %out4: !firrtl.flip<uint<4>>) {
+    // CHECK: %c0_ui8 = firrtl.constant(0 : ui8) : !firrtl.uint<8>
+    // CHECK: firrtl.connect %out2, %c0_ui8
+    // CHECK: firrtl.connect %out3, %c0_ui8
+    %c0_ui1 = firrtl.constant(0 : ui1) : !firrtl.uint<1>
+    %c1 = firrtl.instance @Child {name = "c1"} : !firrtl.bundle<in: flip<uint<8>>, en: flip<uint<1>>, out: uint<8>, zero: uint<8>>
+    %0 = firrtl.subfield %c1("in") : (!firrtl.bundle<in: flip<uint<8>>, en: flip<uint<1>>, out: uint<8>, zero: uint<8>>) -> !firrtl.flip<uint<8>>
+    %1 = firrtl.subfield %c1("en") : (!firrtl.bundle<in: flip<uint<8>>, en: flip<uint<1>>, out: uint<8>, zero: uint<8>>) -> !firrtl.flip<uint<1>>
+    %2 = firrtl.subfield %c1("out") : (!firrtl.bundle<in: flip<uint<8>>, en: flip<uint<1>>, out: uint<8>, zero: uint<8>>) -> !firrtl.uint<8>
+    %3 = firrtl.subfield %c1("zero") : (!firrtl.bundle<in: flip<uint<8>>, en: flip<uint<1>>, out: uint<8>, zero: uint<8>>) -> !firrtl.uint<8>
+    firrtl.connect %0, %in : !firrtl.flip<uint<8>>, !firrtl.uint<8>
+    firrtl.connect %1, %c0_ui1 : !firrtl.flip<uint<1>>, !firrtl.uint<1>
+    firrtl.connect %out1, %2 : !firrtl.flip<uint<8>>, !firrtl.uint<8>
+    firrtl.connect %out2, %3 : !firrtl.flip<uint<8>>, !firrtl.uint<8>
+
+    %c2 = firrtl.instance @Child {name = "c2"} : !firrtl.bundle<in: flip<uint<8>>, en: flip<uint<1>>, out: uint<8>, zero: uint<8>>
+    %4 = firrtl.subfield %c2("in") : (!firrtl.bundle<in: flip<uint<8>>, en: flip<uint<1>>, out: uint<8>, zero: uint<8>>) -> !firrtl.flip<uint<8>>
+    %5 = firrtl.subfield %c2("en") : (!firrtl.bundle<in: flip<uint<8>>, en: flip<uint<1>>, out: uint<8>, zero: uint<8>>) -> !firrtl.flip<uint<1>>
+    %6 = firrtl.subfield %c2("zero") : (!firrtl.bundle<in: flip<uint<8>>, en: flip<uint<1>>, out: uint<8>, zero: uint<8>>) -> !firrtl.uint<8>
+    firrtl.connect %4, %in : !firrtl.flip<uint<8>>, !firrtl.uint<8>
+    firrtl.connect %5, %c0_ui1 : !firrtl.flip<uint<1>>, !firrtl.uint<1>
+    firrtl.connect %out3, %6 : !firrtl.flip<uint<8>>, !firrtl.uint<8>
+
+    %regs = firrtl.instance @Regs {name = "regs"} : !firrtl.bundle<clock: flip<clock>, reset: flip<uint<1>>, a: uint<4>, b: uint<4>, count: uint<4>>
+    %7 = firrtl.subfield %regs("clock") : (!firrtl.bundle<clock: flip<clock>, reset: flip<uint<1>>, a: uint<4>, b: uint<4>, count: uint<4>>) -> !firrtl.flip<clock>
+    %8 = firrtl.subfield %regs("reset") : (!firrtl.bundle<clock: flip<clock>, reset: flip<uint<1>>, a: uint<4>, b: uint<4>, count: uint<4>>) -> !firrtl.flip<uint<1>>
+    %9 = firrtl.subfield %regs("count") : (!firrtl.bundle<clock: flip<clock>, reset: flip<uint<1>>, a: uint<4>, b: uint<4>, count: uint<4>>) -> !firrtl.uint<4>
+    firrtl.connect %7, %clock : !firrtl.flip<clock>, !firrtl.clock
+    firrtl.connect %8, %reset : !firrtl.flip<uint<1>>, !firrtl.uint<1>
+    firrtl.connect %out4, %9 : !firrtl.flip<uint<4>>, !firrtl.uint<4>
+  }
+}
+
+// -----
+
+// The inputs of an instance driven with different values are not constant.
+// CHECK-LABEL: firrtl.circuit "Different"
+firrtl.circuit "Different" {
+  // CHECK-LABEL: firrtl.module @Leaf
+  // CHECK-NEXT: firrtl.connect %out, %in
+  firrtl.module @Leaf(%in: !firrtl.uint<2>, %out: !firrtl.flip<uint<2>>) {
+    firrtl.connect %out, %in : !firrtl.flip<uint<2>>, !firrtl.uint<2>
+  }
+
+  firrtl.module @Different(%out1: !firrtl.flip<uint<2>>,
+                           %out2: !firrtl.flip<uint<2>>) {
+    %c1_ui2 = firrtl.constant(1 : ui2) : !firrtl.uint<2>
+    %c2_ui2 = firrtl.constant(2 : ui2) : !firrtl.uint<2>
+    %a = firrtl.instance @Leaf {name = "a"} : !firrtl.bundle<in: flip<uint<2>>, out: uint<2>>
+    %0 = firrtl.subfield %a("in") : (!firrtl.bundle<in: flip<uint<2>>, out: uint<2>>) -> !firrtl.flip<uint<2>>
+    %1 = firrtl.subfield %a("out") : (!firrtl.bundle<in: flip<uint<2>>, out: uint<2>>) -> !firrtl.uint<2>
+    firrtl.connect %0, %c1_ui2 : !firrtl.flip<uint<2>>, !firrtl.uint<2>
+    firrtl.connect %out1, %1 : !firrtl.flip<uint<2>>, !firrtl.uint<2>
+    %b = firrtl.instance @Leaf {name = "b"} : !firrtl.bundle<in: flip<uint<2>>, out: uint<2>>
+    %2 = firrtl.subfield %b("in") : (!firrtl.bundle<in: flip<uint<2>>, out: uint<2>>) -> !firrtl.flip<uint<2>>
+    %3 = firrtl.subfield %b("out") : (!firrtl.bundle<in: flip<uint<2>>, out: uint<2>>) -> !firrtl.uint<2>
+    firrtl.connect %2, %c2_ui2 : !firrtl.flip<uint<2>>, !firrtl.uint<2>
+    firrtl.connect %out2, %3 : !firrtl.flip<uint<2>>, !firrtl.uint<2>
+  }
+}
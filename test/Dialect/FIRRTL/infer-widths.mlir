@@ -0,0 +1,67 @@
+// RUN: circt-opt -pass-pipeline='firrtl.circuit(firrtl-infer-widths)' --split-input-file --verify-diagnostics %s | FileCheck %s
+
+firrtl.circuit "Foo" {
+  // The ports of a module are shared with all its instances.
+  // CHECK-LABEL: firrtl.module @Child
+  // CHECK-SAME: (%in: !firrtl.uint<8>, %out: !firrtl.flip<uint<9>>)
+  firrtl.module @Child(%in: !firrtl.uint, %out: !firrtl.flip<uint>) {
+    // CHECK: firrtl.add %in, %in : (!firrtl.uint<8>, !firrtl.uint<8>) -> !firrtl.uint<9>
+    %0 = firrtl.add %in, %in : (!firrtl.uint, !firrtl.uint) -> !firrtl.uint
+    firrtl.connect %out, %0 : !firrtl.flip<uint>, !firrtl.uint
+  }
+
+  // CHECK-LABEL: firrtl.module @Foo
+  // CHECK-SAME: %c: !firrtl.flip<uint<9>>
+  firrtl.module @Foo(%a: !firrtl.uint<8>, %b: !firrtl.uint<3>, %c: !firrtl.flip<uint>) {
+    // A wire is as wide as the widest value connected to it.
+    // CHECK: %w = firrtl.wire : !firrtl.uint<8>
+    %w = firrtl.wire : !firrtl.uint
+    firrtl.connect %w, %a : !firrtl.uint, !firrtl.uint<8>
+    firrtl.connect %w, %b : !firrtl.uint, !firrtl.uint<3>
+
+    // CHECK: firrtl.instance @Child {name = "child"} : !firrtl.bundle<in: flip<uint<8>>, out: uint<9>>
+    %child = firrtl.instance @Child {name = "child"} : !firrtl.bundle<in: flip<uint>, out: uint>
+    %0 = firrtl.subfield %child("in") : (!firrtl.bundle<in: flip<uint>, out: uint>) -> !firrtl.flip<uint>
+    %1 = firrtl.subfield %child("out") : (!firrtl.bundle<in: flip<uint>, out: uint>) -> !firrtl.uint
+    firrtl.connect %0, %w : !firrtl.flip<uint>, !firrtl.uint
+    firrtl.connect %c, %1 : !firrtl.flip<uint>, !firrtl.uint
+  }
+}
+
+// -----
+
+firrtl.circuit "Constants" {
+  // Unsized constants get the minimal width of their value.
+  // CHECK-LABEL: firrtl.module @Constants
+  // CHECK-SAME: %out: !firrtl.flip<uint<5>>
+  firrtl.module @Constants(%out: !firrtl.flip<uint>) {
+    // CHECK: firrtl.constant(5 : ui3) : !firrtl.uint<3>
+    // CHECK: firrtl.constant(-2 : si2) : !firrtl.sint<2>
+    %0 = firrtl.constant(5 : ui8) : !firrtl.uint
+    %1 = firrtl.constant(-2 : si8) : !firrtl.sint
+    %2 = firrtl.asUInt %1 : (!firrtl.sint) -> !firrtl.uint
+    %3 = firrtl.cat %0, %2 : (!firrtl.uint, !firrtl.uint) -> !firrtl.uint
+    firrtl.connect %out, %3 : !firrtl.flip<uint>, !firrtl.uint
+  }
+}
+
+// -----
+
+firrtl.circuit "Unconstrained" {
+  firrtl.module @Unconstrained() {
+    // expected-error @+1 {{uninferred width: type '!firrtl.uint' is unconstrained}}
+    %w = firrtl.wire : !firrtl.uint
+  }
+}
+
+// -----
+
+firrtl.circuit "Cycle" {
+  firrtl.module @Cycle(%clock: !firrtl.clock, %x: !firrtl.uint<4>) {
+    // A register which feeds its own increment needs an unbounded width.
+    %r = firrtl.reg %clock : (!firrtl.clock) -> !firrtl.uint
+    // expected-error @+1 {{width inference does not converge}}
+    %0 = firrtl.add %r, %x : (!firrtl.uint, !firrtl.uint<4>) -> !firrtl.uint
+    firrtl.connect %r, %0 : !firrtl.uint, !firrtl.uint
+  }
+}
@@ -0,0 +1,42 @@
+// RUN: circt-opt -canonicalize %s | FileCheck %s
+
+// A tree of forks is flattened into a single fork.
+// CHECK-LABEL: handshake.func @fork_tree(
+// CHECK-SAME:      %[[ARG0:.*]]: index, %[[ARG1:.*]]: none, ...)
+// CHECK-NEXT:    %[[FORK:.*]]:4 = "handshake.fork"(%[[ARG0]]) {control = false} : (index) -> (index, index, index, index)
+// CHECK-NEXT:    handshake.return %[[FORK]]#0, %[[FORK]]#1, %[[FORK]]#2, %[[FORK]]#3, %[[ARG1]]
+handshake.func @fork_tree(%arg0: index, %arg1: none, ...) -> (index, index, index, index, none) {
+  %0:2 = "handshake.fork"(%arg0) {control = false} : (index) -> (index, index)
+  %1:2 = "handshake.fork"(%0#0) {control = false} : (index) -> (index, index)
+  %2:2 = "handshake.fork"(%1#1) {control = false} : (index) -> (index, index)
+  handshake.return %1#0, %2#0, %2#1, %0#1, %arg1 : index, index, index, index, none
+}
+
+// The outputs of a fork which are discarded are removed, and a fork whose
+// outputs are all discarded becomes a sink.
+// CHECK-LABEL: handshake.func @fork_sinks(
+// CHECK-SAME:      %[[ARG0:.*]]: index, %[[ARG1:.*]]: none, ...)
+// CHECK-NEXT:    %[[FORK:.*]]:2 = "handshake.fork"(%[[ARG0]]) {control = false} : (index) -> (index, index)
+// CHECK-NEXT:    "handshake.sink"(%[[ARG1]]) : (none) -> ()
+// CHECK-NEXT:    handshake.return %[[FORK]]#0, %[[FORK]]#1
+handshake.func @fork_sinks(%arg0: index, %arg1: none, ...) -> (index, index) {
+  %0:3 = "handshake.fork"(%arg0) {control = false} : (index) -> (index, index, index)
+  "handshake.sink"(%0#1) : (index) -> ()
+  %1:2 = "handshake.fork"(%arg1) {control = true} : (none) -> (none, none)
+  "handshake.sink"(%1#0) : (none) -> ()
+  "handshake.sink"(%1#1) : (none) -> ()
+  handshake.return %0#0, %0#2 : index, index
+}
+
+// Chained buffers of the same kind are merged, their slots are added up.
+// CHECK-LABEL: handshake.func @buffer_chain(
+// CHECK-SAME:      %[[ARG0:.*]]: index, %[[ARG1:.*]]: none, ...)
+// CHECK-NEXT:    %[[SEQ:.*]] = "handshake.buffer"(%[[ARG0]]) {control = false, sequential = true, slots = 5 : i32} : (index) -> index
+// CHECK-NEXT:    %[[FIFO:.*]] = "handshake.buffer"(%[[SEQ]]) {control = false, sequential = false, slots = 1 : i32} : (index) -> index
+// CHECK-NEXT:    handshake.return %[[FIFO]], %[[ARG1]]
+handshake.func @buffer_chain(%arg0: index, %arg1: none, ...) -> (index, none) {
+  %0 = "handshake.buffer"(%arg0) {control = false, sequential = true, slots = 2 : i32} : (index) -> index
+  %1 = "handshake.buffer"(%0) {control = false, sequential = true, slots = 3 : i32} : (index) -> index
+  %2 = "handshake.buffer"(%1) {control = false, sequential = false, slots = 1 : i32} : (index) -> index
+  handshake.return %2, %arg1 : index, none
+}
@@ -0,0 +1,40 @@
+// RUN: circt-opt %s -canonicalize | FileCheck %s
+
+// CHECK-LABEL: @insert_slice_folding
+// CHECK-SAME: %[[INT:.*]]: i32
+// CHECK-SAME: %[[FULL:.*]]: i32
+// CHECK-SAME: %[[SLICE1:.*]]: i8
+// CHECK-SAME: %[[SLICE2:.*]]: i16
+// CHECK-SAME: %[[ARRAY:.*]]: !llhd.array<4xi1>
+func @insert_slice_folding(%int : i32, %full : i32, %slice1 : i8, %slice2 : i16, %array : !llhd.array<4xi1>)
+    -> (i32, i32, i32, i32, !llhd.array<4xi1>, i32) {
+  // CHECK-NEXT: %[[CONST:.*]] = llhd.const 4656 : i32
+  // Inserting a whole value replaces the target.
+  %0 = llhd.insert_slice %int, %full, 0 : i32, i32
+
+  // Inserting an extracted slice back at the same place is a no-op.
+  %ext = llhd.extract_slice %int, 4 : i32 -> i8
+  %1 = llhd.insert_slice %int, %ext, 4 : i32, i8
+
+  // An insertion overwritten by a later one is dropped.
+  // CHECK-NEXT: %[[INS1:.*]] = llhd.insert_slice %[[INT]], %[[SLICE2]], 2 : i32, i16
+  %ins = llhd.insert_slice %int, %slice1, 4 : i32, i8
+  %2 = llhd.insert_slice %ins, %slice2, 2 : i32, i16
+
+  // Partially overlapping insertions are kept.
+  // CHECK-NEXT: %[[INS2:.*]] = llhd.insert_slice %[[INT]], %[[SLICE1]], 12 : i32, i8
+  // CHECK-NEXT: %[[INS3:.*]] = llhd.insert_slice %[[INS2]], %[[SLICE2]], 2 : i32, i16
+  %ins2 = llhd.insert_slice %int, %slice1, 12 : i32, i8
+  %3 = llhd.insert_slice %ins2, %slice2, 2 : i32, i16
+
+  %arrext = llhd.extract_slice %array, 1 : !llhd.array<4xi1> -> !llhd.array<2xi1>
+  %4 = llhd.insert_slice %array, %arrext, 1 : !llhd.array<4xi1>, !llhd.array<2xi1>
+
+  // Constant insertions are folded.
+  %c0 = llhd.const 4096 : i32
+  %c1 = llhd.const 35 : i8
+  %5 = llhd.insert_slice %c0, %c1, 4 : i32, i8
+
+  // CHECK-NEXT: return %[[FULL]], %[[INT]], %[[INS1]], %[[INS3]], %[[ARRAY]], %[[CONST]] : i32, i32, i32, i32, !llhd.array<4xi1>, i32
+  return %0, %1, %2, %3, %4, %5 : i32, i32, i32, i32, !llhd.array<4xi1>, i32
+}
@@ -1,9 +1,17 @@
 // RUN: llhd-sim %s | FileCheck %s
+// RUN: llhd-sim %s --trace-format=vcd | FileCheck %s --check-prefix=VCD
 
 // CHECK: 0ps 0d 0e  root/bool  0x01
 // CHECK-NEXT: 0ps 0d 0e  root/fair  0xff00
 // CHECK-NEXT: 0ps 0d 0e  root/ginormous 0x000000000000000000000008727f6369aaf83ca15026747af8c7f196ce3f0ad2
 
+// VCD: $var wire 1 ! bool $end
+// VCD-NEXT: $var wire 16 " fair $end
+// VCD-NEXT: $var wire 256 # ginormous $end
+// VCD: #0
+// VCD-NEXT: b1 !
+// VCD-NEXT: b1111111100000000 "
+
 llhd.entity @root () -> () {
   %small = llhd.const 1 : i1
   %r = llhd.const 0xff00 : i16
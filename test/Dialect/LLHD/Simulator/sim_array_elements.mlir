@@ -0,0 +1,22 @@
+// RUN: llhd-sim %s -T 2000 | FileCheck %s
+// RUN: llhd-sim %s -T 2000 --trace-format=vcd | FileCheck %s --check-prefix=VCD
+
+// Only the driven element of the array is traced after the initial values.
+// CHECK: 0ps 0d 0e  root/mem[0]  0x00
+// CHECK: 0ps 0d 0e  root/mem[7]  0x00
+// CHECK-NEXT: 1000ps 0d 0e  root/mem[5]  0x2a
+// CHECK-NOT: root/mem
+
+// VCD: $var wire 8 [[ID5:.*]] mem[5] $end
+// VCD: #1000
+// VCD-NEXT: b00101010 [[ID5]]
+// VCD-NOT: {{^}}b
+llhd.entity @root () -> () {
+  %0 = llhd.const 0 : i8
+  %1 = llhd.array_uniform %0 : !llhd.array<8 x i8>
+  %mem = llhd.sig "mem" %1 : !llhd.array<8 x i8>
+  %elem = llhd.extract_element %mem, 5 : !llhd.sig<!llhd.array<8xi8>> -> !llhd.sig<i8>
+  %value = llhd.const 42 : i8
+  %time = llhd.const #llhd.time<1ns, 0d, 0e> : !llhd.time
+  llhd.drv %elem, %value after %time : !llhd.sig<i8>
+}
@@ -0,0 +1,21 @@
+// RUN: echo "root/toggle 0x1" > %t.a
+// RUN: echo "# Keep the default value." > %t.b
+// RUN: llhd-sim %s -n 3 --batch=%t.a,%t.b --threads=2
+// RUN: FileCheck %s --check-prefix=A < %t.a.trace
+// RUN: FileCheck %s --check-prefix=B < %t.b.trace
+
+// A: 0ps 0d 0e  root/toggle  0x01
+// A-NEXT: 1000ps 0d 0e  root/toggle  0x00
+// A-NEXT: 2000ps 0d 0e  root/toggle  0x01
+
+// B: 0ps 0d 0e  root/toggle  0x00
+// B-NEXT: 1000ps 0d 0e  root/toggle  0x01
+// B-NEXT: 2000ps 0d 0e  root/toggle  0x00
+llhd.entity @root () -> () {
+  %0 = llhd.const 0 : i1
+  %toggle = llhd.sig "toggle" %0 : i1
+  %1 = llhd.prb %toggle : !llhd.sig<i1>
+  %2 = llhd.not %1 : i1
+  %dt = llhd.const #llhd.time<1ns, 0d, 0e> : !llhd.time
+  llhd.drv %toggle, %2 after %dt : !llhd.sig<i1>
+}
@@ -0,0 +1,33 @@
+// RUN: llhd-sim %s -T 1000 --batch-entities | FileCheck %s
+
+// The three inverters are woken up by the toggle in the same step and run as
+// one batch, with the same results as one by one.
+// CHECK: 1000ps 0d 0e  root/a  0x01
+// CHECK-NEXT: 1000ps 1d 0e  root/b  0x00
+// CHECK-NEXT: 1000ps 1d 0e  root/c  0x00
+// CHECK-NEXT: 1000ps 1d 0e  root/d  0x00
+llhd.entity @root () -> () {
+  %0 = llhd.const 0 : i1
+  %a = llhd.sig "a" %0 : i1
+  %b = llhd.sig "b" %0 : i1
+  %c = llhd.sig "c" %0 : i1
+  %d = llhd.sig "d" %0 : i1
+  llhd.inst "inv0" @inv (%a) -> (%b) : (!llhd.sig<i1>) -> (!llhd.sig<i1>)
+  llhd.inst "inv1" @inv (%a) -> (%c) : (!llhd.sig<i1>) -> (!llhd.sig<i1>)
+  llhd.inst "inv2" @inv (%a) -> (%d) : (!llhd.sig<i1>) -> (!llhd.sig<i1>)
+  llhd.inst "gen" @toggle () -> (%a) : () -> (!llhd.sig<i1>)
+}
+
+llhd.entity @inv (%in : !llhd.sig<i1>) -> (%out : !llhd.sig<i1>) {
+  %0 = llhd.prb %in : !llhd.sig<i1>
+  %1 = llhd.not %0 : i1
+  %dt = llhd.const #llhd.time<0ns, 1d, 0e> : !llhd.time
+  llhd.drv %out, %1 after %dt : !llhd.sig<i1>
+}
+
+llhd.entity @toggle () -> (%out : !llhd.sig<i1>) {
+  %0 = llhd.prb %out : !llhd.sig<i1>
+  %1 = llhd.not %0 : i1
+  %dt = llhd.const #llhd.time<1ns, 0d, 0e> : !llhd.time
+  llhd.drv %out, %1 after %dt : !llhd.sig<i1>
+}
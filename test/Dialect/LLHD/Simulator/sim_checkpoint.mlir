@@ -0,0 +1,21 @@
+// RUN: llhd-sim %s -n 4 --checkpoint=%t.ckpt | FileCheck %s --check-prefix=FIRST
+// RUN: llhd-sim %s -n 4 --restore=%t.ckpt | FileCheck %s --check-prefix=RESTORED
+
+// FIRST: 0ps 0d 0e  root/toggle  0x00
+// FIRST-NEXT: 1000ps 0d 0e  root/toggle  0x01
+// FIRST-NEXT: 2000ps 0d 0e  root/toggle  0x00
+// FIRST-NEXT: 3000ps 0d 0e  root/toggle  0x01
+// FIRST-NOT: 4000ps
+
+// RESTORED: 3000ps 0d 0e  root/toggle  0x01
+// RESTORED-NEXT: 4000ps 0d 0e  root/toggle  0x00
+// RESTORED-NEXT: 5000ps 0d 0e  root/toggle  0x01
+// RESTORED-NEXT: 6000ps 0d 0e  root/toggle  0x00
+llhd.entity @root () -> () {
+  %0 = llhd.const 0 : i1
+  %toggle = llhd.sig "toggle" %0 : i1
+  %1 = llhd.prb %toggle : !llhd.sig<i1>
+  %2 = llhd.not %1 : i1
+  %dt = llhd.const #llhd.time<1ns, 0d, 0e> : !llhd.time
+  llhd.drv %toggle, %2 after %dt : !llhd.sig<i1>
+}
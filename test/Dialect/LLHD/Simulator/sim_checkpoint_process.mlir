@@ -0,0 +1,41 @@
+// RUN: llhd-sim %s -n 2 --checkpoint=%t.ckpt | FileCheck %s --check-prefix=FIRST
+// RUN: llhd-sim %s -n 3 --restore=%t.ckpt | FileCheck %s --check-prefix=RESTORED
+
+// The process is suspended in the middle of its body when the checkpoint is
+// written, with a signal slice and a time persisted across its blocks.
+
+// FIRST: 0ps 0d 0e  root/gen/s  0x00
+// FIRST-NEXT: 0ps 0d 0e  root/s  0x00
+// FIRST-NEXT: 1000ps 0d 0e  root/gen/s  0x01
+// FIRST-NEXT: 1000ps 0d 0e  root/s  0x01
+// FIRST-NOT: 2000ps
+
+// RESTORED: 1000ps 0d 0e  root/gen/s  0x01
+// RESTORED-NEXT: 1000ps 0d 0e  root/s  0x01
+// RESTORED-NEXT: 2000ps 0d 0e  root/gen/s  0x02
+// RESTORED-NEXT: 2000ps 0d 0e  root/s  0x02
+// RESTORED-NEXT: 3000ps 0d 0e  root/gen/s  0x03
+// RESTORED-NEXT: 3000ps 0d 0e  root/s  0x03
+llhd.entity @root () -> () {
+  %0 = llhd.const 0 : i8
+  %s = llhd.sig "s" %0 : i8
+  llhd.inst "gen" @gen () -> (%s) : () -> (!llhd.sig<i8>)
+}
+
+llhd.proc @gen () -> (%s : !llhd.sig<i8>) {
+  %lo = llhd.extract_slice %s, 0 : !llhd.sig<i8> -> !llhd.sig<i4>
+  %t = llhd.const #llhd.time<1ns, 0d, 0e> : !llhd.time
+  %c1 = llhd.const 1 : i4
+  llhd.drv %lo, %c1 after %t : !llhd.sig<i4>
+  llhd.wait for %t, ^second
+^second:
+  %c2 = llhd.const 2 : i4
+  llhd.drv %lo, %c2 after %t : !llhd.sig<i4>
+  llhd.wait for %t, ^third
+^third:
+  %p = llhd.prb %lo : !llhd.sig<i4>
+  %one = llhd.const 1 : i4
+  %next = addi %p, %one : i4
+  llhd.drv %lo, %next after %t : !llhd.sig<i4>
+  llhd.halt
+}
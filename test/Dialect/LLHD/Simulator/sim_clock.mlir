@@ -0,0 +1,47 @@
+// RUN: llhd-sim %s -n 6 | FileCheck %s
+// RUN: llhd-sim %s -n 6 --native-clocks=false | FileCheck %s
+// RUN: llhd-sim %s -n 6 --threads=2 | FileCheck %s
+// RUN: llhd-sim %s -n 6 --trace-format=no-trace --profile=%t.native.json
+// RUN: FileCheck %s --check-prefix=NATIVE < %t.native.json
+// RUN: llhd-sim %s -n 6 --trace-format=no-trace --native-clocks=false --profile=%t.jit.json
+// RUN: FileCheck %s --check-prefix=JIT < %t.jit.json
+
+// CHECK: 0ps 0d 0e  root/clk  0x00
+// CHECK-NEXT: 0ps 0d 0e  root/clock/clk  0x00
+// CHECK-NEXT: 0ps 0d 1e  root/clk  0x01
+// CHECK-NEXT: 0ps 0d 1e  root/clock/clk  0x01
+// CHECK-NEXT: 1000ps 0d 1e  root/clk  0x00
+// CHECK-NEXT: 1000ps 0d 1e  root/clock/clk  0x00
+// CHECK-NEXT: 2000ps 0d 1e  root/clk  0x01
+// CHECK-NEXT: 2000ps 0d 1e  root/clock/clk  0x01
+
+// The clock process runs natively, without activating its instance.
+// NATIVE: "path": "root/clock",
+// NATIVE-NEXT: "unit": "clock",
+// NATIVE-NEXT: "activations": 0,
+// NATIVE: "name": "root/clk",
+// NATIVE-NEXT: "drives": 3,
+// NATIVE-NEXT: "changes": 3
+
+// JIT: "path": "root/clock",
+// JIT-NEXT: "unit": "clock",
+// JIT-NEXT: "activations": 3,
+// JIT: "name": "root/clk",
+// JIT-NEXT: "drives": 3,
+// JIT-NEXT: "changes": 3
+llhd.entity @root () -> () {
+  %0 = llhd.const 0 : i1
+  %clk = llhd.sig "clk" %0 : i1
+  llhd.inst "clock" @clock () -> (%clk) : () -> (!llhd.sig<i1>)
+}
+
+llhd.proc @clock () -> (%clk : !llhd.sig<i1>) {
+  %eps = llhd.const #llhd.time<0ns, 0d, 1e> : !llhd.time
+  br ^loop
+^loop:
+  %v = llhd.prb %clk : !llhd.sig<i1>
+  %n = llhd.not %v : i1
+  llhd.drv %clk, %n after %eps : !llhd.sig<i1>
+  %half = llhd.const #llhd.time<1ns, 0d, 0e> : !llhd.time
+  llhd.wait for %half, ^loop
+}
@@ -0,0 +1,22 @@
+// RUN: printf 'monitor root/out\nrun 2000\npeek root/cnt\npoke root/in 0x05\nstep\nstep\npeek root/out\n' | llhd-sim %s --commands - --trace-format=no-trace | FileCheck %s
+
+// CHECK: 0ps root/out 0x01
+// CHECK-NEXT: root/cnt 0x02
+// The poked value reaches the entity one delta step later.
+// CHECK-NEXT: 2000ps root/out 0x06
+// CHECK-NEXT: root/out 0x06
+llhd.entity @root () -> () {
+  %0 = llhd.const 0 : i8
+  %cnt = llhd.sig "cnt" %0 : i8
+  %in = llhd.sig "in" %0 : i8
+  %out = llhd.sig "out" %0 : i8
+  %1 = llhd.prb %cnt : !llhd.sig<i8>
+  %one = llhd.const 1 : i8
+  %2 = addi %1, %one : i8
+  %dt = llhd.const #llhd.time<1ns, 0d, 0e> : !llhd.time
+  llhd.drv %cnt, %2 after %dt : !llhd.sig<i8>
+  %3 = llhd.prb %in : !llhd.sig<i8>
+  %4 = addi %3, %one : i8
+  %delta = llhd.const #llhd.time<0ns, 1d, 0e> : !llhd.time
+  llhd.drv %out, %4 after %delta : !llhd.sig<i8>
+}
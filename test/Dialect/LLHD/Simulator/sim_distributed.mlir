@@ -0,0 +1,44 @@
+// RUN: llhd-sim %s -T 1000 --partitions=2 | FileCheck %s
+// RUN: llhd-sim %s -T 1000 --partitions=2 -o %t
+// RUN: FileCheck %s --check-prefix=RANK0 < %t
+// RUN: FileCheck %s --check-prefix=RANK1 < %t.1
+
+// The inverter runs in process 1, the root and the toggle in process 0. Both
+// processes see the changes of the signals they share.
+// CHECK: 0ps 2d 0e  root/b  0x01
+// CHECK: 1000ps 0d 0e  root/a  0x01
+// CHECK: 1000ps 2d 0e  root/b  0x00
+
+// Each process only traces the signals of its own instances.
+// RANK0-NOT: root/inv/n
+// RANK0: 1000ps 2d 0e  root/b  0x00
+
+// RANK1-NOT: root/b
+// RANK1: 0ps 1d 0e  root/inv/n  0x01
+// RANK1: 1000ps 1d 0e  root/inv/n  0x00
+// RANK1-NOT: root/b
+llhd.entity @root () -> () {
+  %0 = llhd.const 0 : i1
+  %a = llhd.sig "a" %0 : i1
+  %b = llhd.sig "b" %0 : i1
+  llhd.inst "inv" @inv (%a) -> (%b) : (!llhd.sig<i1>) -> (!llhd.sig<i1>)
+  llhd.inst "gen" @toggle () -> (%a) : () -> (!llhd.sig<i1>)
+}
+
+llhd.entity @inv (%in : !llhd.sig<i1>) -> (%out : !llhd.sig<i1>) {
+  %0 = llhd.const 0 : i1
+  %n = llhd.sig "n" %0 : i1
+  %1 = llhd.prb %in : !llhd.sig<i1>
+  %2 = llhd.not %1 : i1
+  %dt = llhd.const #llhd.time<0ns, 1d, 0e> : !llhd.time
+  llhd.drv %n, %2 after %dt : !llhd.sig<i1>
+  %3 = llhd.prb %n : !llhd.sig<i1>
+  llhd.drv %out, %3 after %dt : !llhd.sig<i1>
+}
+
+llhd.entity @toggle () -> (%out : !llhd.sig<i1>) {
+  %0 = llhd.prb %out : !llhd.sig<i1>
+  %1 = llhd.not %0 : i1
+  %dt = llhd.const #llhd.time<1ns, 0d, 0e> : !llhd.time
+  llhd.drv %out, %1 after %dt : !llhd.sig<i1>
+}
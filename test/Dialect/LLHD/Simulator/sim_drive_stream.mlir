@@ -0,0 +1,26 @@
+// Drive root/s to 0x05 at 1000ps and to 0x0a at 3000ps.
+// RUN: printf 'LLHDSTIM\001\000\000\000\006\000\000\000root/s' > %t
+// RUN: printf '\350\003\000\000\000\000\000\000\000\000\000\000\001\000\000\000\005' >> %t
+// RUN: printf '\270\013\000\000\000\000\000\000\000\000\000\000\001\000\000\000\012' >> %t
+// RUN: llhd-sim %s --drive-stream=%t | FileCheck %s
+
+// A stream cut off in the middle of a drive is an error.
+// RUN: cp %t %t.truncated
+// RUN: printf '\000\000' >> %t.truncated
+// RUN: not llhd-sim %s --drive-stream=%t.truncated 2>&1 | FileCheck %s --check-prefix=TRUNCATED
+// TRUNCATED: truncated drive
+
+// CHECK: 0ps 0d 0e  root/s  0x00
+// CHECK-NEXT: 0ps 0d 0e  root/t  0x00
+// CHECK-NEXT: 1000ps 0d 0e  root/s  0x05
+// CHECK-NEXT: 1000ps 1d 0e  root/t  0x05
+// CHECK-NEXT: 3000ps 0d 0e  root/s  0x0a
+// CHECK-NEXT: 3000ps 1d 0e  root/t  0x0a
+llhd.entity @root () -> () {
+  %0 = llhd.const 0 : i8
+  %s = llhd.sig "s" %0 : i8
+  %t = llhd.sig "t" %0 : i8
+  %p = llhd.prb %s : !llhd.sig<i8>
+  %delta = llhd.const #llhd.time<0ns, 1d, 0e> : !llhd.time
+  llhd.drv %t, %p after %delta : !llhd.sig<i8>
+}
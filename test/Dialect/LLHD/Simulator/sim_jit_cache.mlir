@@ -0,0 +1,19 @@
+// RUN: rm -rf %t
+// RUN: llhd-sim %s -n 4 --jit-cache-dir=%t | FileCheck %s
+// RUN: ls %t | FileCheck %s --check-prefix=CACHE
+// RUN: llhd-sim %s -n 4 --jit-cache-dir=%t | FileCheck %s
+
+// CACHE: {{[0-9a-f]+}}.o
+
+// CHECK: 0ps 0d 0e  root/toggle  0x00
+// CHECK-NEXT: 1000ps 0d 0e  root/toggle  0x01
+// CHECK-NEXT: 2000ps 0d 0e  root/toggle  0x00
+// CHECK-NEXT: 3000ps 0d 0e  root/toggle  0x01
+llhd.entity @root () -> () {
+  %0 = llhd.const 0 : i1
+  %toggle = llhd.sig "toggle" %0 : i1
+  %1 = llhd.prb %toggle : !llhd.sig<i1>
+  %2 = llhd.not %1 : i1
+  %dt = llhd.const #llhd.time<1ns, 0d, 0e> : !llhd.time
+  llhd.drv %toggle, %2 after %dt : !llhd.sig<i1>
+}
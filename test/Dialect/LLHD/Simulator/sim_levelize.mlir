@@ -0,0 +1,37 @@
+// RUN: llhd-sim %s -T 1000 | FileCheck %s --check-prefix=EVENT
+// RUN: llhd-sim %s -T 1000 --levelize | FileCheck %s --check-prefix=LEVEL
+
+// Event-driven, each inverter takes one delta step.
+// EVENT: 1000ps 0d 0e  root/a  0x01
+// EVENT: 1000ps 1d 0e  root/b  0x00
+// EVENT: 1000ps 2d 0e  root/c  0x01
+
+// Levelized, the inverter chain settles in the step the toggle drives it.
+// LEVEL: 1000ps 0d 0e  root/a  0x01
+// LEVEL: 1000ps 0d 0e  root/b  0x00
+// LEVEL: 1000ps 0d 0e  root/c  0x01
+// LEVEL-NOT: 1000ps 1d
+llhd.entity @root () -> () {
+  %0 = llhd.const 0 : i1
+  %a = llhd.sig "a" %0 : i1
+  %b = llhd.sig "b" %0 : i1
+  %c = llhd.sig "c" %0 : i1
+  // Instantiate the inverters in reverse order of evaluation.
+  llhd.inst "inv2" @inv (%b) -> (%c) : (!llhd.sig<i1>) -> (!llhd.sig<i1>)
+  llhd.inst "inv1" @inv (%a) -> (%b) : (!llhd.sig<i1>) -> (!llhd.sig<i1>)
+  llhd.inst "gen" @toggle () -> (%a) : () -> (!llhd.sig<i1>)
+}
+
+llhd.entity @inv (%in : !llhd.sig<i1>) -> (%out : !llhd.sig<i1>) {
+  %0 = llhd.prb %in : !llhd.sig<i1>
+  %1 = llhd.not %0 : i1
+  %dt = llhd.const #llhd.time<0ns, 1d, 0e> : !llhd.time
+  llhd.drv %out, %1 after %dt : !llhd.sig<i1>
+}
+
+llhd.entity @toggle () -> (%out : !llhd.sig<i1>) {
+  %0 = llhd.prb %out : !llhd.sig<i1>
+  %1 = llhd.not %0 : i1
+  %dt = llhd.const #llhd.time<1ns, 0d, 0e> : !llhd.time
+  llhd.drv %out, %1 after %dt : !llhd.sig<i1>
+}
@@ -1,4 +1,5 @@
 // RUN: llhd-sim %s | FileCheck %s
+// RUN: llhd-sim %s --lazy-jit --threads=2 | FileCheck %s
 
 // CHECK: 0ps 0d 0e  root/proc/toggle  0x01
 // CHECK-NEXT: 0ps 0d 0e  root/toggle  0x01
@@ -0,0 +1,26 @@
+// RUN: llhd-sim %s -n 4 --profile=%t.json
+// RUN: FileCheck %s < %t.json
+
+// CHECK: "steps": 4,
+// CHECK: "eventsPerStep": {
+// CHECK-NEXT: "mean": 0.75,
+// CHECK-NEXT: "max": 1
+// CHECK: "wakeupsPerStep": {
+// CHECK: "max": 1
+// CHECK: "instances": [
+// CHECK: "path": "root",
+// CHECK-NEXT: "unit": "root",
+// CHECK-NEXT: "activations": 4,
+// CHECK-NEXT: "timeNs": {{[0-9]+}}
+// CHECK: "signals": [
+// CHECK: "name": "root/toggle",
+// CHECK-NEXT: "drives": 3,
+// CHECK-NEXT: "changes": 3
+llhd.entity @root () -> () {
+  %0 = llhd.const 0 : i1
+  %toggle = llhd.sig "toggle" %0 : i1
+  %1 = llhd.prb %toggle : !llhd.sig<i1>
+  %2 = llhd.not %1 : i1
+  %dt = llhd.const #llhd.time<1ns, 0d, 0e> : !llhd.time
+  llhd.drv %toggle, %2 after %dt : !llhd.sig<i1>
+}
@@ -1,4 +1,6 @@
 // RUN: llhd-sim %s -n 10 -r Foo | FileCheck %s
+// RUN: llhd-sim %s -n 10 -r Foo --lazy-jit | FileCheck %s
+// RUN: llhd-sim %s -n 10 -r Foo --tier-up=2 | FileCheck %s
 
 // CHECK: 0ps 0d 0e  Foo/toggle  0x00
 // CHECK-NEXT: 1000ps 0d 0e  Foo/toggle  0x01
@@ -0,0 +1,54 @@
+// RUN: llhd-sim %s -T 2000 --trace-format=merged --trace-filter='root/foo/*' | FileCheck %s --check-prefix=FOO
+// RUN: llhd-sim %s -T 2000 --trace-format=merged --trace-filter='root/[0-9]' | FileCheck %s --check-prefix=ROOT
+// RUN: llhd-sim %s -T 2000 --trace-format=merged --trace-filter='*/*/s' --trace-depth=0 | FileCheck %s --check-prefix=DEPTH
+// RUN: llhd-sim %s -T 2000 --trace-format=merged --trace-filter='*/*/s' --trace-depth=1 | FileCheck %s --check-prefix=DEPTH1
+// RUN: not llhd-sim %s -T 2000 --trace-filter='root/[' 2>&1 | FileCheck %s --check-prefix=INVALID
+// RUN: not llhd-sim %s -T 2000 --trace-filter='s' 2>&1 | FileCheck %s --check-prefix=SHORT
+
+// FOO: 0ps
+// FOO-NEXT:   root/foo/s  0x03
+// FOO-NEXT:   root/s  0x03
+// FOO-NEXT: 1000ps
+// FOO-NEXT:   root/foo/s  0x09
+// FOO-NEXT:   root/s  0x09
+// FOO-NEXT: 2000ps
+// FOO-NEXT:   root/foo/s  0x1b
+// FOO-NEXT:   root/s  0x1b
+
+// ROOT: 0ps
+// ROOT-NEXT:   root/1  0x01
+// ROOT-NOT: root/s
+
+// DEPTH-NOT: root
+
+// DEPTH1: 0ps
+// DEPTH1-NEXT:   root/foo/s  0x03
+// DEPTH1-NEXT:   root/s  0x03
+// DEPTH1-NEXT: 1000ps
+// DEPTH1-NEXT:   root/foo/s  0x09
+// DEPTH1-NEXT:   root/s  0x09
+// DEPTH1-NOT: root/1
+
+// INVALID: invalid trace filter 'root/[':
+// SHORT: invalid trace filter 's': expected an instance path and a signal name
+
+llhd.entity @root () -> () {
+  %0 = llhd.const 1 : i8
+  %s = llhd.sig "s" %0 : i8
+  %1 = llhd.sig "1" %0 : i8
+  llhd.inst "foo" @foo () -> (%s) : () -> (!llhd.sig<i8>)
+}
+
+llhd.proc @foo () -> (%s : !llhd.sig<i8>) {
+  br ^entry
+^entry:
+  %1 = llhd.prb %s : !llhd.sig<i8>
+  %2 = addi %1, %1 : i8
+  %t0 = llhd.const #llhd.time<0ns, 0d, 1e> : !llhd.time
+  llhd.drv %s, %2 after %t0 : !llhd.sig<i8>
+  %3 = addi %2, %1 : i8
+  %t1 = llhd.const #llhd.time<0ns, 0d, 2e> : !llhd.time
+  llhd.drv %s, %3 after %t1 : !llhd.sig<i8>
+  %t2 = llhd.const #llhd.time<1ns, 0d, 0e> : !llhd.time
+  llhd.wait for %t2, ^entry
+}
@@ -0,0 +1,30 @@
+// RUN: llhd-sim %s -T 10000 --watch=root/cnt==0x3 | FileCheck %s --check-prefix=STOP
+// RUN: llhd-sim %s -T 7000 --watch=root/cnt==0x5:trace | FileCheck %s --check-prefix=TRACE
+// RUN: llhd-sim %s -T 10000 --watch=root/cnt==0x2:checkpoint=%t --watch=root/cnt==0x2
+// RUN: llhd-sim %s -T 4000 --restore=%t | FileCheck %s --check-prefix=RESTORE
+
+// STOP: 0ps 0d 0e  root/cnt  0x00
+// STOP-NEXT: 1000ps 0d 0e  root/cnt  0x01
+// STOP-NEXT: 2000ps 0d 0e  root/cnt  0x02
+// STOP-NEXT: 3000ps 0d 0e  root/cnt  0x03
+// STOP-NOT: root/cnt
+
+// TRACE-NOT: 0x04
+// TRACE: 5000ps 0d 0e  root/cnt  0x05
+// TRACE-NEXT: 6000ps 0d 0e  root/cnt  0x06
+// TRACE-NEXT: 7000ps 0d 0e  root/cnt  0x07
+// TRACE-NOT: root/cnt
+
+// RESTORE-NOT: 0x01
+// RESTORE: 2000ps 0d 0e  root/cnt  0x02
+// RESTORE-NEXT: 3000ps 0d 0e  root/cnt  0x03
+// RESTORE-NEXT: 4000ps 0d 0e  root/cnt  0x04
+llhd.entity @root () -> () {
+  %0 = llhd.const 0 : i8
+  %cnt = llhd.sig "cnt" %0 : i8
+  %1 = llhd.prb %cnt : !llhd.sig<i8>
+  %one = llhd.const 1 : i8
+  %2 = addi %1, %one : i8
+  %dt = llhd.const #llhd.time<1ns, 0d, 0e> : !llhd.time
+  llhd.drv %cnt, %2 after %dt : !llhd.sig<i8>
+}
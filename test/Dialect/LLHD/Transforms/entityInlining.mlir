@@ -0,0 +1,47 @@
+// RUN: circt-opt %s -llhd-inline-entities | FileCheck %s
+
+// CHECK-LABEL: @inv
+llhd.entity @inv(%in : !llhd.sig<i1>) -> (%out : !llhd.sig<i1>) {
+  %0 = llhd.prb %in : !llhd.sig<i1>
+  %1 = llhd.not %0 : i1
+  %t = llhd.const #llhd.time<0ns, 1d, 0e> : !llhd.time
+  llhd.drv %out, %1 after %t : !llhd.sig<i1>
+}
+
+// CHECK-LABEL: @buf
+// CHECK-SAME: (%[[IN:[a-z0-9_]+]] : !llhd.sig<i1>) -> (%[[OUT:[a-z0-9_]+]] : !llhd.sig<i1>)
+// CHECK-NEXT: %[[INIT:.*]] = llhd.const false : i1
+// CHECK-NEXT: %[[X:.*]] = llhd.sig "x" %[[INIT]] : i1
+// CHECK-NEXT: %[[P0:.*]] = llhd.prb %[[IN]] : !llhd.sig<i1>
+// CHECK-NEXT: %[[N0:.*]] = llhd.not %[[P0]] : i1
+// CHECK-NEXT: %[[T0:.*]] = llhd.const #llhd.time<0ns, 1d, 0e> : !llhd.time
+// CHECK-NEXT: llhd.drv %[[X]], %[[N0]] after %[[T0]] : !llhd.sig<i1>
+// CHECK-NEXT: %[[P1:.*]] = llhd.prb %[[X]] : !llhd.sig<i1>
+// CHECK-NEXT: %[[N1:.*]] = llhd.not %[[P1]] : i1
+// CHECK-NEXT: %[[T1:.*]] = llhd.const #llhd.time<0ns, 1d, 0e> : !llhd.time
+// CHECK-NEXT: llhd.drv %[[OUT]], %[[N1]] after %[[T1]] : !llhd.sig<i1>
+// CHECK-NEXT: }
+llhd.entity @buf(%in : !llhd.sig<i1>) -> (%out : !llhd.sig<i1>) {
+  %init = llhd.const 0 : i1
+  %x = llhd.sig "x" %init : i1
+  llhd.inst "inv0" @inv(%in) -> (%x) : (!llhd.sig<i1>) -> !llhd.sig<i1>
+  llhd.inst "inv1" @inv(%x) -> (%out) : (!llhd.sig<i1>) -> !llhd.sig<i1>
+}
+
+llhd.proc @stim() -> (%s : !llhd.sig<i1>) {
+  llhd.halt
+}
+
+// Nested instances are flattened bottom-up and processes stay instances.
+// CHECK-LABEL: @root
+// CHECK: llhd.sig "a"
+// CHECK: llhd.sig "buf0/x"
+// CHECK-NOT: llhd.inst "buf0
+// CHECK: llhd.inst "stim" @stim() -> (%{{.*}}) : () -> !llhd.sig<i1>
+llhd.entity @root() -> () {
+  %init = llhd.const 0 : i1
+  %a = llhd.sig "a" %init : i1
+  %b = llhd.sig "b" %init : i1
+  llhd.inst "stim" @stim() -> (%a) : () -> !llhd.sig<i1>
+  llhd.inst "buf0" @buf(%a) -> (%b) : (!llhd.sig<i1>) -> !llhd.sig<i1>
+}
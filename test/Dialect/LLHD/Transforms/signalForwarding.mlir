@@ -0,0 +1,70 @@
+// RUN: circt-opt %s -llhd-signal-forwarding | FileCheck %s
+// RUN: circt-opt %s -llhd-signal-forwarding='remove-dead-signals=false' | FileCheck %s --check-prefix=KEEP
+
+// CHECK-LABEL: llhd.entity @entity_probes
+// CHECK-SAME: (%[[IN:.*]] : !llhd.sig<i8>) -> (%[[OUT:.*]] : !llhd.sig<i8>)
+// CHECK-NEXT: %[[TIME:.*]] = llhd.const
+// CHECK-NEXT: %[[P:.*]] = llhd.prb %[[IN]] : !llhd.sig<i8>
+// CHECK-NEXT: llhd.drv %[[OUT]], %[[P]] after %[[TIME]] : !llhd.sig<i8>
+// CHECK-NEXT: %[[SUM:.*]] = llhd.add %[[P]], %[[P]] : i8
+// CHECK-NEXT: llhd.drv %[[OUT]], %[[SUM]] after %[[TIME]] : !llhd.sig<i8>
+// CHECK-NEXT: }
+llhd.entity @entity_probes (%in : !llhd.sig<i8>) -> (%out : !llhd.sig<i8>) {
+  %time = llhd.const #llhd.time<0ns, 1d, 0e> : !llhd.time
+  %0 = llhd.prb %in : !llhd.sig<i8>
+  llhd.drv %out, %0 after %time : !llhd.sig<i8>
+  // The drive above only takes effect later, the probe sees the same value.
+  %1 = llhd.prb %in : !llhd.sig<i8>
+  %2 = llhd.prb %in : !llhd.sig<i8>
+  %3 = llhd.add %1, %2 : i8
+  llhd.drv %out, %3 after %time : !llhd.sig<i8>
+}
+
+// CHECK-LABEL: llhd.proc @proc_probes
+// CHECK-SAME: (%[[IN:.*]] : !llhd.sig<i8>) -> (%[[OUT:.*]] : !llhd.sig<i8>)
+// CHECK:       ^[[BB1:.*]]:
+// CHECK-NEXT:    %[[P1:.*]] = llhd.prb %[[IN]] : !llhd.sig<i8>
+// CHECK-NEXT:    br ^[[BB2:.*]]
+// CHECK:       ^[[BB2]]:
+// CHECK-NEXT:    llhd.drv %[[OUT]], %[[P1]] after
+// CHECK-NEXT:    llhd.wait
+// Probes in another temporal region observe a newer value.
+// CHECK:       ^{{.*}}:
+// CHECK-NEXT:    %[[P2:.*]] = llhd.prb %[[IN]] : !llhd.sig<i8>
+// CHECK-NEXT:    llhd.drv %[[OUT]], %[[P2]] after
+llhd.proc @proc_probes (%in : !llhd.sig<i8>) -> (%out : !llhd.sig<i8>) {
+  %time = llhd.const #llhd.time<0ns, 1d, 0e> : !llhd.time
+  br ^bb1
+^bb1:
+  %0 = llhd.prb %in : !llhd.sig<i8>
+  br ^bb2
+^bb2:
+  %1 = llhd.prb %in : !llhd.sig<i8>
+  llhd.drv %out, %1 after %time : !llhd.sig<i8>
+  llhd.wait ^bb3
+^bb3:
+  %2 = llhd.prb %in : !llhd.sig<i8>
+  llhd.drv %out, %2 after %time : !llhd.sig<i8>
+  br ^bb1
+}
+
+// CHECK-LABEL: llhd.entity @dead_signals
+// CHECK-NOT:   "dead"
+// CHECK:       llhd.sig "live"
+// CHECK-NOT:   "dead"
+// CHECK:       llhd.inst
+// KEEP-LABEL:  llhd.entity @dead_signals
+// KEEP:        llhd.sig "dead"
+// KEEP:        llhd.sig "live"
+llhd.entity @dead_signals () -> () {
+  %c = llhd.const 0 : i8
+  %time = llhd.const #llhd.time<0ns, 1d, 0e> : !llhd.time
+  %dead = llhd.sig "dead" %c : i8
+  %sub = llhd.extract_slice %dead, 0 : !llhd.sig<i8> -> !llhd.sig<i4>
+  %c4 = llhd.const 0 : i4
+  llhd.drv %dead, %c after %time : !llhd.sig<i8>
+  llhd.drv %sub, %c4 after %time : !llhd.sig<i4>
+  %live = llhd.sig "live" %c : i8
+  llhd.drv %live, %c after %time : !llhd.sig<i8>
+  llhd.inst "inst" @entity_probes(%live) -> (%live) : (!llhd.sig<i8>) -> !llhd.sig<i8>
+}
@@ -77,6 +77,26 @@ func @add_cstfold(%arg0: i7) -> i7 {
   return %0 : i7
 }
 
+// Folds wrap around at the width of the operation.
+// CHECK-LABEL: func @add_cstfold_overflow() -> i7 {
+// CHECK-NEXT:    %c-8_i7 = rtl.constant(-8 : i7)
+// CHECK-NEXT:    return %c-8_i7 : i7
+func @add_cstfold_overflow() -> i7 {
+  %c60_i7 = rtl.constant(60 : i7) : i7
+  %0 = rtl.add %c60_i7, %c60_i7 : i7
+  return %0 : i7
+}
+
+// CHECK-LABEL: func @add_cstfold_wide() -> i80 {
+// CHECK-NEXT:    %c18446744073709551616_i80 = rtl.constant(18446744073709551616 : i80)
+// CHECK-NEXT:    return %c18446744073709551616_i80 : i80
+func @add_cstfold_wide() -> i80 {
+  %c18446744073709551615_i80 = rtl.constant(18446744073709551615 : i80) : i80
+  %c1_i80 = rtl.constant(1 : i80) : i80
+  %0 = rtl.add %c18446744073709551615_i80, %c1_i80 : i80
+  return %0 : i80
+}
+
 // CHECK-LABEL: func @mul_cstfold(%arg0: i7) -> i7 {
 // CHECK-NEXT:    %c15_i7 = rtl.constant(15 : i7)
 // CHECK-NEXT:    %0 = rtl.mul %arg0, %c15_i7 : i7
@@ -588,3 +608,56 @@ func @concat_fold6(%arg0: i5, %arg1: i3) -> (i4) {
   %2 = rtl.concat %0, %1 : (i2, i2) -> i4
   return %2 : i4
 }
+
+// Whole-tree canonicalization
+
+// CHECK-LABEL: func @and_tree(%arg0: i7, %arg1: i7, %arg2: i7) -> i7 {
+// CHECK-NEXT:    %c3_i7 = rtl.constant(3 : i7) : i7
+// CHECK-NEXT:    [[RES:%[0-9]+]] = rtl.and %arg0, %arg2, %arg1, %c3_i7 : i7
+// CHECK-NEXT:    return [[RES]] : i7
+func @and_tree(%arg0: i7, %arg1: i7, %arg2: i7) -> i7 {
+  %c7_i7 = rtl.constant(7 : i7) : i7
+  %c11_i7 = rtl.constant(11 : i7) : i7
+  %0 = rtl.and %arg1, %c7_i7, %arg0 : i7
+  %1 = rtl.and %arg2, %0 : i7
+  %2 = rtl.and %1, %c11_i7 : i7
+  %3 = rtl.and %arg0, %2, %arg1 : i7
+  return %3 : i7
+}
+
+// CHECK-LABEL: func @or_tree_annulment(%arg0: i3, %arg1: i3) -> i3 {
+// CHECK-NEXT:    %c-1_i3 = rtl.constant(-1 : i3) : i3
+// CHECK-NEXT:    return %c-1_i3 : i3
+func @or_tree_annulment(%arg0: i3, %arg1: i3) -> i3 {
+  %c3_i3 = rtl.constant(3 : i3) : i3
+  %c4_i3 = rtl.constant(4 : i3) : i3
+  %0 = rtl.or %arg0, %c3_i3 : i3
+  %1 = rtl.or %arg1, %c4_i3 : i3
+  %2 = rtl.or %0, %1 : i3
+  return %2 : i3
+}
+
+// CHECK-LABEL: func @xor_tree(%arg0: i7, %arg1: i7, %arg2: i7) -> i7 {
+// CHECK-NEXT:    [[RES:%[0-9]+]] = rtl.xor %arg1, %arg2 : i7
+// CHECK-NEXT:    return [[RES]] : i7
+func @xor_tree(%arg0: i7, %arg1: i7, %arg2: i7) -> i7 {
+  %c5_i7 = rtl.constant(5 : i7) : i7
+  %0 = rtl.xor %arg0, %c5_i7, %arg1 : i7
+  %1 = rtl.xor %0, %arg0, %arg2 : i7
+  %2 = rtl.xor %1, %c5_i7 : i7
+  return %2 : i7
+}
+
+// CHECK-LABEL: func @add_tree(%arg0: i7, %arg1: i7) -> i7 {
+// CHECK-NEXT:    %c6_i7 = rtl.constant(6 : i7) : i7
+// CHECK-NEXT:    [[RES:%[0-9]+]] = rtl.add %arg1, %arg0, %c6_i7 : i7
+// CHECK-NEXT:    return [[RES]] : i7
+func @add_tree(%arg0: i7, %arg1: i7) -> i7 {
+  %c1_i7 = rtl.constant(1 : i7) : i7
+  %c2_i7 = rtl.constant(2 : i7) : i7
+  %c3_i7 = rtl.constant(3 : i7) : i7
+  %0 = rtl.add %c1_i7, %arg0 : i7
+  %1 = rtl.add %0, %c2_i7 : i7
+  %2 = rtl.add %arg1, %c3_i7, %1 : i7
+  return %2 : i7
+}
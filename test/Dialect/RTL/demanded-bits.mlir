@@ -0,0 +1,60 @@
+// RUN: circt-opt -pass-pipeline='rtl.module(rtl-demanded-bits)' %s | FileCheck %s
+
+// CHECK-LABEL: rtl.module @narrow_add(%a: i8, %b: i8) -> (i4) {
+// CHECK-NEXT:    %0 = rtl.extract %a from 0 : (i8) -> i4
+// CHECK-NEXT:    %1 = rtl.extract %b from 0 : (i8) -> i4
+// CHECK-NEXT:    %2 = rtl.add %0, %1 : i4
+// CHECK-NEXT:    rtl.output %2 : i4
+rtl.module @narrow_add(%a: i8, %b: i8) -> (i4) {
+  %0 = rtl.add %a, %b : i8
+  %1 = rtl.extract %0 from 0 : (i8) -> i4
+  rtl.output %1 : i4
+}
+
+// CHECK-LABEL: rtl.module @narrow_mux(%c: i1, %a: i8, %b: i8) -> (i2) {
+// CHECK-NEXT:    %0 = rtl.extract %a from 0 : (i8) -> i2
+// CHECK-NEXT:    %1 = rtl.extract %b from 0 : (i8) -> i2
+// CHECK-NEXT:    %2 = rtl.mux %c, %0, %1 : i2
+// CHECK-NEXT:    rtl.output %2 : i2
+rtl.module @narrow_mux(%c: i1, %a: i8, %b: i8) -> (i2) {
+  %0 = rtl.mux %c, %a, %b : i8
+  %1 = rtl.extract %0 from 0 : (i8) -> i2
+  rtl.output %1 : i2
+}
+
+// The multiply isn't used at all.
+// CHECK-LABEL: rtl.module @unused_range(%a: i8, %b: i8, %x: i4) -> (i3) {
+// CHECK-NEXT:    %0 = rtl.extract %x from 1 : (i4) -> i3
+// CHECK-NEXT:    rtl.output %0 : i3
+rtl.module @unused_range(%a: i8, %b: i8, %x: i4) -> (i3) {
+  %0 = rtl.mul %a, %b : i8
+  %1 = rtl.concat %x, %0 : (i4, i8) -> i12
+  %2 = rtl.extract %1 from 9 : (i12) -> i3
+  rtl.output %2 : i3
+}
+
+// The low bits of the concat are known, and the and clears the others.
+// CHECK-LABEL: rtl.module @known_bits(%a: i4) -> (i2) {
+// CHECK-NEXT:    %c0_i2 = rtl.constant(0 : i2) : i2
+// CHECK-NEXT:    rtl.output %c0_i2 : i2
+rtl.module @known_bits(%a: i4) -> (i2) {
+  %c0_i2 = rtl.constant(0 : i2) : i2
+  %c3_i6 = rtl.constant(3 : i6) : i6
+  %0 = rtl.concat %a, %c0_i2 : (i4, i2) -> i6
+  %1 = rtl.and %0, %c3_i6 : i6
+  %2 = rtl.extract %1 from 0 : (i6) -> i2
+  rtl.output %2 : i2
+}
+
+// Carries propagate upwards, so all of the low bits are needed.
+// CHECK-LABEL: rtl.module @keep_low_bits(%a: i8, %b: i8) -> (i2) {
+// CHECK-NEXT:    %0 = rtl.extract %a from 0 : (i8) -> i6
+// CHECK-NEXT:    %1 = rtl.extract %b from 0 : (i8) -> i6
+// CHECK-NEXT:    %2 = rtl.add %0, %1 : i6
+// CHECK-NEXT:    %3 = rtl.extract %2 from 4 : (i6) -> i2
+// CHECK-NEXT:    rtl.output %3 : i2
+rtl.module @keep_low_bits(%a: i8, %b: i8) -> (i2) {
+  %0 = rtl.add %a, %b : i8
+  %1 = rtl.extract %0 from 4 : (i8) -> i2
+  rtl.output %1 : i2
+}
@@ -0,0 +1,79 @@
+// RUN: circt-opt -pass-pipeline='rtl.module(rtl-structural-hash)' %s | FileCheck %s
+
+// CHECK-LABEL: rtl.module @commutative(%a: i4, %b: i4) -> (i4, i4, i4, i4) {
+// CHECK-NEXT:    %0 = rtl.and %a, %b : i4
+// CHECK-NEXT:    %1 = rtl.xor %0, %a : i4
+// CHECK-NEXT:    %2 = rtl.sub %a, %b : i4
+// CHECK-NEXT:    %3 = rtl.sub %b, %a : i4
+// CHECK-NEXT:    rtl.output %1, %1, %2, %3 : i4, i4, i4, i4
+rtl.module @commutative(%a: i4, %b: i4) -> (i4, i4, i4, i4) {
+  %0 = rtl.and %a, %b : i4
+  %1 = rtl.and %b, %a : i4
+  %2 = rtl.xor %0, %a : i4
+  %3 = rtl.xor %a, %1 : i4
+  %4 = rtl.sub %a, %b : i4
+  %5 = rtl.sub %b, %a : i4
+  rtl.output %2, %3, %4, %5 : i4, i4, i4, i4
+}
+
+// Merging %2 into %1 makes %0 and %3 equivalent after they've been hashed.
+// CHECK-LABEL: rtl.module @forward(%a: i4) -> (i4) {
+// CHECK-NEXT:    %0 = rtl.add %1, %a : i4
+// CHECK-NEXT:    %1 = rtl.mul %a, %a : i4
+// CHECK-NEXT:    %2 = rtl.sub %0, %0 : i4
+// CHECK-NEXT:    rtl.output %2 : i4
+rtl.module @forward(%a: i4) -> (i4) {
+  %0 = rtl.add %2, %a : i4
+  %1 = rtl.mul %a, %a : i4
+  %2 = rtl.mul %a, %a : i4
+  %3 = rtl.add %1, %a : i4
+  %4 = rtl.sub %0, %3 : i4
+  rtl.output %4 : i4
+}
+
+// The copy in the module body is kept so that the nested use can see it.
+// CHECK-LABEL: rtl.module @nested(%clk: i1, %a: i4, %b: i4) -> (i4) {
+// CHECK-NEXT:    sv.always posedge %clk {
+// CHECK-NEXT:      sv.fwrite "%x"(%0) : i4
+// CHECK-NEXT:    }
+// CHECK-NEXT:    %0 = rtl.or %b, %a : i4
+// CHECK-NEXT:    rtl.output %0 : i4
+rtl.module @nested(%clk: i1, %a: i4, %b: i4) -> (i4) {
+  sv.always posedge %clk {
+    %0 = rtl.or %a, %b : i4
+    sv.fwrite "%x"(%0) : i4
+  }
+  %1 = rtl.or %b, %a : i4
+  rtl.output %1 : i4
+}
+
+// Reads of an inout value are merged within a region, but not across
+// procedural blocks, which may run at different times.
+// CHECK-LABEL: rtl.module @reads(%clk: i1, %a: i4) -> (i4) {
+// CHECK-NEXT:    %r = sv.reg : !rtl.inout<i4>
+// CHECK-NEXT:    sv.always posedge %clk {
+// CHECK-NEXT:      %2 = rtl.read_inout %r : !rtl.inout<i4>
+// CHECK-NEXT:      sv.fwrite "%x"(%2) : i4
+// CHECK-NEXT:    }
+// CHECK-NEXT:    sv.initial {
+// CHECK-NEXT:      %2 = rtl.read_inout %r : !rtl.inout<i4>
+// CHECK-NEXT:      sv.fwrite "%x"(%2) : i4
+// CHECK-NEXT:    }
+// CHECK-NEXT:    %0 = rtl.read_inout %r : !rtl.inout<i4>
+// CHECK-NEXT:    %1 = rtl.add %0, %0 : i4
+// CHECK-NEXT:    rtl.output %1 : i4
+rtl.module @reads(%clk: i1, %a: i4) -> (i4) {
+  %r = sv.reg : !rtl.inout<i4>
+  sv.always posedge %clk {
+    %0 = rtl.read_inout %r : !rtl.inout<i4>
+    sv.fwrite "%x"(%0) : i4
+  }
+  sv.initial {
+    %1 = rtl.read_inout %r : !rtl.inout<i4>
+    sv.fwrite "%x"(%1) : i4
+  }
+  %2 = rtl.read_inout %r : !rtl.inout<i4>
+  %3 = rtl.read_inout %r : !rtl.inout<i4>
+  %4 = rtl.add %2, %3 : i4
+  rtl.output %4 : i4
+}
@@ -0,0 +1,68 @@
+// RUN: circt-opt -pass-pipeline='rtl.module(sv-merge-always)' %s | FileCheck %s
+
+// Always blocks with the same sensitivity list are merged into the first one,
+// and so are the reset blocks within them.
+// CHECK-LABEL: rtl.module @Merge
+rtl.module @Merge(%clock: i1, %clock2: i1, %reset: i1, %a: i8, %b: i8) {
+  %r1 = sv.reg : !rtl.inout<i8>
+  %r2 = sv.reg : !rtl.inout<i8>
+  %r3 = sv.reg : !rtl.inout<i8>
+
+  // CHECK:      sv.always posedge %clock {
+  // CHECK-NEXT:   sv.if %reset {
+  // CHECK-NEXT:     sv.passign %r1, %a : i8
+  // CHECK-NEXT:     sv.passign %r2, %b : i8
+  // CHECK-NEXT:   }
+  // CHECK-NEXT:   sv.passign %r1, %b : i8
+  // CHECK-NEXT:   sv.passign %r2, %a : i8
+  // CHECK-NEXT: }
+  sv.always posedge %clock {
+    sv.if %reset {
+      sv.passign %r1, %a : i8
+    }
+    sv.passign %r1, %b : i8
+  }
+
+  // A different clock is kept separate.
+  // CHECK-NEXT: sv.always posedge %clock2 {
+  // CHECK-NEXT:   sv.passign %r3, %a : i8
+  // CHECK-NEXT: }
+  sv.always posedge %clock2 {
+    sv.passign %r3, %a : i8
+  }
+  // CHECK-NOT: sv.always
+
+  sv.always posedge %clock {
+    sv.if %reset {
+      sv.passign %r2, %b : i8
+    }
+    sv.passign %r2, %a : i8
+  }
+}
+
+// An if isn't merged across an assignment to a destination it assigns.
+// CHECK-LABEL: rtl.module @Order
+rtl.module @Order(%clock: i1, %cond: i1, %a: i8, %b: i8) {
+  %r = sv.reg : !rtl.inout<i8>
+
+  // CHECK:      sv.always posedge %clock {
+  // CHECK-NEXT:   sv.if %cond {
+  // CHECK-NEXT:     sv.passign %r, %a : i8
+  // CHECK-NEXT:   }
+  // CHECK-NEXT:   sv.passign %r, %b : i8
+  // CHECK-NEXT:   sv.if %cond {
+  // CHECK-NEXT:     sv.passign %r, %b : i8
+  // CHECK-NEXT:   }
+  // CHECK-NEXT: }
+  sv.always posedge %clock {
+    sv.if %cond {
+      sv.passign %r, %a : i8
+    }
+    sv.passign %r, %b : i8
+  }
+  sv.always posedge %clock {
+    sv.if %cond {
+      sv.passign %r, %b : i8
+    }
+  }
+}
@@ -0,0 +1,130 @@
+// RUN: circt-opt -pass-pipeline='rtl.module(sv-retime)' %s | FileCheck %s
+// RUN: circt-opt -pass-pipeline='rtl.module(sv-retime{target-delay=12})' %s | FileCheck %s --check-prefix=TARGET
+
+// Registers feeding an adder are moved to its output, which balances the
+// paths before and after them.
+// CHECK-LABEL: rtl.module @Forward
+// TARGET-LABEL: rtl.module @Forward
+rtl.module @Forward(%clock: i1, %x: i8, %y: i8) -> (i8) {
+  // CHECK-NEXT: sv.always posedge %clock {
+  // CHECK-NEXT:   sv.passign %ra_retimed, [[SUM:%[0-9]+]] : i8
+  // CHECK-NEXT: }
+  // CHECK-NEXT: %ra_retimed = sv.reg : !rtl.inout<i8>
+  // CHECK-NEXT: [[SUM]] = rtl.add %x, %y : i8
+  // CHECK-NEXT: [[R:%[0-9]+]] = rtl.read_inout %ra_retimed : !rtl.inout<i8>
+  // CHECK-NEXT: [[PROD:%[0-9]+]] = rtl.mul [[R]], %x : i8
+  // CHECK-NEXT: rtl.output [[PROD]] : i8
+
+  // The critical path already meets the target.
+  // TARGET: rtl.add %0, %1 : i8
+  %ra = sv.reg : !rtl.inout<i8>
+  %rb = sv.reg : !rtl.inout<i8>
+  sv.always posedge %clock {
+    sv.passign %ra, %x : i8
+    sv.passign %rb, %y : i8
+  }
+  %0 = rtl.read_inout %ra : !rtl.inout<i8>
+  %1 = rtl.read_inout %rb : !rtl.inout<i8>
+  %2 = rtl.add %0, %1 : i8
+  %3 = rtl.mul %2, %x : i8
+  rtl.output %3 : i8
+}
+
+// A register at the end of a long path is moved to the operands of the
+// multiplier computing its next value.
+// CHECK-LABEL: rtl.module @Backward
+rtl.module @Backward(%clock: i1, %x: i8, %y: i8) -> (i8) {
+  // CHECK-NEXT: [[SUM:%[0-9]+]] = rtl.add %x, %y : i8
+  // CHECK-NEXT: [[R1:%.+]] = sv.reg : !rtl.inout<i8>
+  // CHECK-NEXT: [[V1:%[0-9]+]] = rtl.read_inout [[R1]] : !rtl.inout<i8>
+  // CHECK-NEXT: [[R2:%.+]] = sv.reg {name = "r_retimed"} : !rtl.inout<i8>
+  // CHECK-NEXT: [[V2:%[0-9]+]] = rtl.read_inout [[R2]] : !rtl.inout<i8>
+  // CHECK-NEXT: [[PROD:%[0-9]+]] = rtl.mul [[V1]], [[V2]] : i8
+  // CHECK-NEXT: sv.always posedge %clock {
+  // CHECK-NEXT:   sv.passign [[R1]], [[SUM]] : i8
+  // CHECK-NEXT:   sv.passign [[R2]], %x : i8
+  // CHECK-NEXT: }
+  // CHECK-NEXT: rtl.output [[PROD]] : i8
+  %r = sv.reg : !rtl.inout<i8>
+  %0 = rtl.add %x, %y : i8
+  %1 = rtl.mul %0, %x : i8
+  sv.always posedge %clock {
+    sv.passign %r, %1 : i8
+  }
+  %2 = rtl.read_inout %r : !rtl.inout<i8>
+  rtl.output %2 : i8
+}
+
+// Registers with a reset and a random initial value, as lowered from FIRRTL,
+// are merged into a register reset to the combination of their reset values.
+// CHECK-LABEL: rtl.module @Reset
+rtl.module @Reset(%clock: i1, %reset: i1, %x: i8, %y: i8) -> (i8) {
+  // CHECK:      sv.always posedge %clock {
+  // CHECK-NEXT:   sv.if %reset {
+  // CHECK-NEXT:     sv.passign %ra_retimed, [[RESET:%[0-9]+]] : i8
+  // CHECK-NEXT:   }
+  // CHECK-NEXT:   sv.if [[NOTRESET:%[0-9]+]] {
+  // CHECK-NEXT:     sv.passign %ra_retimed, [[NEXT:%[0-9]+]] : i8
+  // CHECK-NEXT:   }
+  // CHECK-NEXT: }
+  // CHECK-NEXT: sv.ifdef "!SYNTHESIS" {
+  // CHECK-NEXT:   sv.initial {
+  // CHECK-NEXT:     [[RANDOM:%[0-9]+]] = sv.textual_value "`RANDOM" : i8
+  // CHECK-NEXT:     sv.bpassign %ra_retimed, [[RANDOM]] : i8
+  // CHECK-NEXT:   }
+  // CHECK-NEXT: }
+  // CHECK-NEXT: %ra_retimed = sv.reg : !rtl.inout<i8>
+  // CHECK-NEXT: [[NEXT]] = rtl.xor %x, %y : i8
+  // CHECK-NEXT: [[RESET]] = rtl.xor %c1_i8, %c2_i8 : i8
+  // CHECK-NEXT: [[R:%[0-9]+]] = rtl.read_inout %ra_retimed : !rtl.inout<i8>
+  // CHECK-NEXT: [[PROD:%[0-9]+]] = rtl.mul [[R]], %x : i8
+  // CHECK-NEXT: rtl.output [[PROD]] : i8
+  %c1_i8 = rtl.constant(1 : i8) : i8
+  %c2_i8 = rtl.constant(2 : i8) : i8
+  %true = rtl.constant(true) : i1
+  %notReset = rtl.xor %reset, %true : i1
+  %ra = sv.reg : !rtl.inout<i8>
+  %rb = sv.reg : !rtl.inout<i8>
+  sv.always posedge %clock {
+    sv.if %reset {
+      sv.passign %ra, %c1_i8 : i8
+      sv.passign %rb, %c2_i8 : i8
+    }
+    sv.if %notReset {
+      sv.passign %ra, %x : i8
+      sv.passign %rb, %y : i8
+    }
+  }
+  sv.ifdef "!SYNTHESIS" {
+    sv.initial {
+      %4 = sv.textual_value "`RANDOM" : i8
+      sv.bpassign %ra, %4 : i8
+      %5 = sv.textual_value "`RANDOM" : i8
+      sv.bpassign %rb, %5 : i8
+    }
+  }
+  %0 = rtl.read_inout %ra : !rtl.inout<i8>
+  %1 = rtl.read_inout %rb : !rtl.inout<i8>
+  %2 = rtl.xor %0, %1 : i8
+  %3 = rtl.mul %2, %x : i8
+  rtl.output %3 : i8
+}
+
+// Registers on different clocks aren't merged.
+// CHECK-LABEL: rtl.module @Clocks
+rtl.module @Clocks(%clock: i1, %clock2: i1, %x: i8, %y: i8) -> (i8) {
+  // CHECK: rtl.add %0, %1 : i8
+  %ra = sv.reg : !rtl.inout<i8>
+  %rb = sv.reg : !rtl.inout<i8>
+  sv.always posedge %clock {
+    sv.passign %ra, %x : i8
+  }
+  sv.always posedge %clock2 {
+    sv.passign %rb, %y : i8
+  }
+  %0 = rtl.read_inout %ra : !rtl.inout<i8>
+  %1 = rtl.read_inout %rb : !rtl.inout<i8>
+  %2 = rtl.add %0, %1 : i8
+  %3 = rtl.mul %2, %x : i8
+  rtl.output %3 : i8
+}
@@ -0,0 +1,111 @@
+// RUN: circt-translate %s -emit-cxx-sim | FileCheck %s
+
+// CHECK-LABEL: struct Counter {
+// CHECK-NEXT:    // Ports.
+// CHECK-NEXT:    uint8_t clock = 0;
+// CHECK-NEXT:    uint8_t reset = 0;
+// CHECK-NEXT:    uint8_t en = 0;
+// CHECK-NEXT:    uint8_t count = 0;
+// CHECK:         void evalComb();
+// CHECK-NEXT:    bool evalSeq();
+// CHECK-EMPTY:
+// CHECK-NEXT:    // Registers and wires.
+// CHECK-NEXT:    uint8_t count_0 = 0;
+// CHECK-EMPTY:
+// CHECK-NEXT:    // Values.
+// CHECK-NEXT:    uint8_t [[SUM:_[0-9]+]] = 0;
+// CHECK-EMPTY:
+// CHECK-NEXT:    // The clocks at the last evaluation.
+// CHECK-NEXT:    uint8_t clock_prev = 0;
+// CHECK-NEXT:  };
+
+// CHECK-LABEL: inline void Counter::evalComb() {
+// CHECK-NEXT:    [[SUM]] = (uint64_t(count_0) + 1) & 0xFFull;
+// CHECK-NEXT:    count = count_0;
+// CHECK-NEXT:  }
+
+// CHECK-LABEL: inline bool Counter::evalSeq() {
+// CHECK-NEXT:    bool changed = false;
+// CHECK-NEXT:    const bool fire = (clock && !clock_prev);
+// CHECK-NEXT:    clock_prev = clock;
+// CHECK-NEXT:    uint8_t count_0_next = count_0;
+// CHECK-NEXT:    if (fire) {
+// CHECK-NEXT:      if (reset) {
+// CHECK-NEXT:        count_0_next = 0;
+// CHECK-NEXT:      } else {
+// CHECK-NEXT:        if (en) {
+// CHECK-NEXT:          count_0_next = [[SUM]];
+// CHECK-NEXT:        }
+// CHECK-NEXT:      }
+// CHECK-NEXT:    }
+// CHECK-NEXT:    if (count_0_next != count_0) {
+// CHECK-NEXT:      count_0 = count_0_next;
+// CHECK-NEXT:      changed = true;
+// CHECK-NEXT:    }
+// CHECK-NEXT:    return changed;
+// CHECK-NEXT:  }
+rtl.module @Counter(%clock: i1, %reset: i1, %en: i1) -> (%count: i8) {
+  %c0_i8 = rtl.constant 0 : i8
+  %c1_i8 = rtl.constant 1 : i8
+  %count = sv.reg : !rtl.inout<i8>
+  %0 = rtl.read_inout %count : !rtl.inout<i8>
+  %1 = rtl.add %0, %c1_i8 : i8
+  sv.always posedge %clock {
+    sv.if %reset {
+      sv.passign %count, %c0_i8 : i8
+    } else {
+      sv.if %en {
+        sv.passign %count, %1 : i8
+      }
+    }
+  }
+  // The random initialization for Verilog simulators is skipped.
+  sv.ifdef "!SYNTHESIS" {
+    sv.initial {
+      sv.bpassign %count, %c1_i8 : i8
+    }
+  }
+  rtl.output %0 : i8
+}
+
+// CHECK-LABEL: struct Adder {
+rtl.module @Adder(%a: i8, %b: i8) -> (%sum: i8) {
+  %0 = rtl.add %a, %b : i8
+  rtl.output %0 : i8
+}
+
+// Instantiated modules come first, and values are computed after their
+// operands, even when they are used before they are defined.
+// CHECK-LABEL: struct Top {
+// CHECK:         // Instances.
+// CHECK-NEXT:    Adder adder;
+
+// CHECK-LABEL: inline void Top::evalComb() {
+// CHECK-NEXT:    [[SEXT:_[0-9]+]] = (uint64_t(circt_sim::sext(a, 4))) & 0xFFull;
+// CHECK-NEXT:    adder.a = w;
+// CHECK-NEXT:    adder.b = [[SEXT]];
+// CHECK-NEXT:    adder.evalComb();
+// CHECK-NEXT:    [[XOR:_[0-9]+]] = uint64_t(adder.sum) ^ w;
+// CHECK-NEXT:    [[CAT:_[0-9]+]] = (uint64_t(a) << 8) | (uint64_t(a) << 4) | b;
+// CHECK-NEXT:    [[CMP:_[0-9]+]] = circt_sim::sext(a, 4) < circt_sim::sext(b, 4);
+// CHECK-NEXT:    [[EXT:_[0-9]+]] = (uint64_t(w) >> 2) & 0xFull;
+// CHECK-NEXT:    x = [[XOR]];
+// CHECK-NEXT:    y = [[CAT]];
+// CHECK-NEXT:    z = [[CMP]];
+// CHECK-NEXT:    e = [[EXT]];
+// CHECK-NEXT:  }
+
+// CHECK-LABEL: inline bool Top::evalSeq() {
+// CHECK-NEXT:    bool changed = false;
+// CHECK-NEXT:    changed |= adder.evalSeq();
+// CHECK-NEXT:    return changed;
+// CHECK-NEXT:  }
+rtl.module @Top(%a: i4, %b: i4, %w: i8) -> (%x: i8, %y: i12, %z: i1, %e: i4) {
+  %2 = rtl.xor %1, %w : i8
+  %1 = rtl.instance "adder" @Adder(%w, %0) : (i8, i8) -> (i8)
+  %0 = rtl.sext %a : (i4) -> i8
+  %3 = rtl.concat %a, %a, %b : (i4, i4, i4) -> i12
+  %4 = rtl.icmp "slt" %a, %b : i4
+  %5 = rtl.extract %w from 2 : (i8) -> i4
+  rtl.output %2, %3, %4, %5 : i8, i12, i1, i4
+}
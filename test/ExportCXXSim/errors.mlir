@@ -0,0 +1,14 @@
+// RUN: circt-translate %s -emit-cxx-sim -split-input-file -verify-diagnostics
+
+rtl.module @Loop(%a: i1) -> (%b: i1) {
+  // expected-error @+1 {{is part of a combinational loop, which the C++ simulation model doesn't support}}
+  %0 = rtl.xor %a, %1 : i1
+  %1 = rtl.and %a, %0 : i1
+  rtl.output %1 : i1
+}
+
+// -----
+
+// expected-error @+1 {{which the C++ simulation model doesn't support, only integers of up to 64 bits are}}
+rtl.module @Wide(%a: i65) {
+}
@@ -3,7 +3,10 @@
 // CHECK: OVERVIEW: CIRCT Translation Testing Tool
 
 // CHECK: Translation to perform
+// CHECK:     --emit-binary
+// CHECK-NEXT:     --emit-cxx-sim
 // CHECK:     --emit-firrtl-verilog
 // CHECK-NEXT:     --emit-verilog
 // CHECK-NEXT:     --llhd-to-verilog
+// CHECK-NEXT:     --parse-binary
 // CHECK-NEXT:     --parse-fir
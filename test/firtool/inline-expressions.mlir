@@ -0,0 +1,30 @@
+// RUN: firtool %s --format=mlir -verilog -lower-to-rtl -disable-opt | FileCheck %s --check-prefix=DEFAULT
+// RUN: firtool %s --format=mlir -verilog -lower-to-rtl -disable-opt --inline-expression-size=2 | FileCheck %s --check-prefix=INLINE
+// RUN: firtool %s --format=mlir -verilog -lower-to-rtl -disable-opt --inline-expression-size=2 -timing -o %t 2>&1 | FileCheck %s --check-prefix=STATS
+
+rtl.module @Inline(%a: i4, %b: i4, %c: i4) -> (%x: i4, %y: i4, %z: i4) {
+  %0 = rtl.add %a, %b : i4
+  %1 = rtl.xor %0, %c : i4
+  %2 = rtl.and %1, %a : i4
+  rtl.output %1, %1, %2 : i4, i4, i4
+}
+
+// By default every multiply used expression gets a wire.
+
+// DEFAULT-LABEL: module Inline(
+// DEFAULT:         wire [3:0] [[T:.+]] = {{.*}}a + b{{.*}} ^ c;
+// DEFAULT-NEXT:    assign x = [[T]];
+// DEFAULT-NEXT:    assign y = [[T]];
+// DEFAULT-NEXT:    assign z = [[T]] & a;
+
+// Expressions of up to two operations are duplicated into their users.
+
+// INLINE-LABEL: module Inline(
+// INLINE-NOT:     wire
+// INLINE:         assign x = {{.*}}a + b{{.*}} ^ c;
+// INLINE-NEXT:    assign y = {{.*}}a + b{{.*}} ^ c;
+// INLINE-NEXT:    assign z = ({{.*}}a + b{{.*}} ^ c) & a;
+
+// STATS: firtool Timing Report
+// STATS: {{ 1  }}verilog.expression-wires.baseline
+// STATS: {{ 0  }}verilog.expression-wires{{$}}
@@ -0,0 +1,35 @@
+// RUN: firtool %s --format=mlir -verilog -lower-to-rtl -disable-opt | FileCheck %s --check-prefix=ALL
+// RUN: firtool %s --format=mlir -verilog -lower-to-rtl -disable-opt --primary-location-only | FileCheck %s --check-prefix=PRIMARY
+// RUN: firtool %s --format=mlir -verilog -lower-to-rtl -disable-opt --primary-location-only --omit-repeated-locations | FileCheck %s --check-prefix=OMIT
+// RUN: firtool %s --format=mlir -verilog -lower-to-rtl -disable-opt --primary-location-only --omit-repeated-locations -emit-in-parallel | FileCheck %s --check-prefix=OMIT
+
+rtl.module @Locs(%a: i4, %b: i4) -> (%x: i4, %y: i4) {
+  %0 = rtl.add %a, %b : i4 loc(fused["Foo.scala":10:3, "Bar.scala":20:5])
+  %1 = rtl.xor %0, %a : i4 loc("Foo.scala":11:3)
+  rtl.output %1, %0 : i4, i4 loc("Foo.scala":12:1)
+}
+
+// The first statement of a module repeating the last location of the previous
+// one still gets it, whether modules are emitted in parallel or not.
+rtl.module @Next(%a: i4) -> (%x: i4) {
+  %0 = rtl.xor %a, %a : i4 loc("Foo.scala":12:1)
+  rtl.output %0 : i4 loc("Foo.scala":12:1)
+}
+
+// ALL-LABEL: module Locs(
+// ALL:         wire [3:0] _T = a + b; // Bar.scala:20:5, Foo.scala:10:3
+// ALL-NEXT:    assign x = _T ^ a;     // Foo.scala:11:3, :12:1
+// ALL-NEXT:    assign y = _T;         // Foo.scala:12:1
+
+// PRIMARY-LABEL: module Locs(
+// PRIMARY:         wire [3:0] _T = a + b; // Foo.scala:10:3
+// PRIMARY-NEXT:    assign x = _T ^ a;     // Foo.scala:12:1
+// PRIMARY-NEXT:    assign y = _T;         // Foo.scala:12:1
+
+// OMIT-LABEL: module Locs(
+// OMIT:         wire [3:0] _T = a + b; // Foo.scala:10:3
+// OMIT-NEXT:    assign x = _T ^ a;     // Foo.scala:12:1
+// OMIT-NEXT:    assign y = _T;{{$}}
+
+// OMIT-LABEL: module Next(
+// OMIT:         assign x = a ^ a; // Foo.scala:12:1
@@ -0,0 +1,19 @@
+// RUN: printf '1 2\n3 4\n\n5 6\n7 8\n' > %t.args
+// RUN: handshake-runner %s -batch=%t.args -threads=2 | FileCheck %s
+// RUN: circt-opt -create-dataflow %s | handshake-runner -batch=%t.args | FileCheck %s
+// CHECK: 3
+// CHECK-NEXT: 7
+// CHECK-NEXT: 11
+// CHECK-NEXT: 15
+
+// Errors point at the line of the file, blank lines included.
+// RUN: printf '1 2\n\n3\n' > %t.bad
+// RUN: not handshake-runner %s -batch=%t.bad 2>&1 | FileCheck %s --check-prefix=ERROR
+// ERROR: .bad:3: Toplevel function main has 2 actual arguments, but 1 arguments were provided.
+
+module {
+  func @main(%a: i32, %b: i32) -> i32 {
+    %0 = addi %a, %b : i32
+    return %0 : i32
+  }
+}
@@ -0,0 +1,37 @@
+// RUN: handshake-runner -cycleAccurate %s 3 2>/dev/null | FileCheck %s
+// RUN: handshake-runner -cycleAccurate %s 3 2>&1 >/dev/null | FileCheck %s --check-prefix=REPORT
+// RUN: handshake-runner -cycleAccurate -channelStats=%t.csv %s 3 >/dev/null 2>&1
+// RUN: FileCheck %s --check-prefix=CSV < %t.csv
+// RUN: handshake-runner -cycleAccurate -channelStats=%t.dot %s 3 >/dev/null 2>&1
+// RUN: FileCheck %s --check-prefix=DOT < %t.dot
+// CHECK: 6
+
+// The buffer delays one side of the addition by a cycle, so the other side and
+// the control token stall for a cycle.
+
+// REPORT: Cycles: 2
+// REPORT-NEXT: Stalls:
+// REPORT-NEXT: 1 cycles: argument #1
+// REPORT-NEXT: 1 cycles: handshake.fork result #1 at
+// REPORT-NEXT: Initiation intervals:
+
+// The addition waits for the buffer, and the return for the addition.
+
+// CSV: producer,result,consumer,tokens,producer_blocked,consumer_blocked,producer_fired,consumer_fired
+// CSV-NEXT: arg0,0,handshake.fork_0,1,0,0,0,1
+// CSV-NEXT: arg1,1,handshake.return_3,1,1,0,0,1
+// CSV-NEXT: handshake.fork_0,0,handshake.buffer_1,1,0,0,1,2
+// CSV-NEXT: handshake.fork_0,1,std.addi_2,1,1,0,1,1
+// CSV-NEXT: handshake.buffer_1,0,std.addi_2,1,0,1,2,1
+// CSV-NEXT: std.addi_2,0,handshake.return_3,1,0,1,1,1
+
+// DOT: "handshake.buffer_1" [label="handshake.buffer_1\nfired 2"];
+// DOT: "arg0" -> "handshake.fork_0" [label="1 tokens\nblocked 0/0"];
+// DOT: "handshake.fork_0" -> "std.addi_2" [label="1 tokens\nblocked 1/0", color=red, penwidth=3];
+
+handshake.func @main(%arg0: index, %arg1: none, ...) -> (index, none) {
+  %0:2 = "handshake.fork"(%arg0) {control = false} : (index) -> (index, index)
+  %1 = "handshake.buffer"(%0#0) {control = false, sequential = true, slots = 2 : i32} : (index) -> index
+  %2 = addi %1, %0#1 : index
+  handshake.return %2, %arg1 : index, none
+}
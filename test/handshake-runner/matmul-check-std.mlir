@@ -1,4 +1,5 @@
 // RUN: handshake-runner %s | FileCheck %s
+// RUN: handshake-runner -compile %s | FileCheck %s
 // RUN: circt-opt -create-dataflow %s | handshake-runner | FileCheck %s
 // CHECK: 200
 
@@ -1,5 +1,7 @@
 // RUN: handshake-runner %s | FileCheck %s
 // RUN: circt-opt -create-dataflow %s | handshake-runner | FileCheck %s
+// RUN: circt-opt -create-dataflow %s | handshake-runner -threads=4 | FileCheck %s
+// RUN: circt-opt -create-dataflow %s | handshake-runner -threads=4 -min-parallel-ops=1 | FileCheck %s
 // CHECK: 0
 
 module {
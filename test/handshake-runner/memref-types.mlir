@@ -0,0 +1,23 @@
+// RUN: handshake-runner %s 1,2,3 1.5,2.5 | FileCheck %s
+// RUN: handshake-runner -compile %s 1,2,3 1.5,2.5 | FileCheck %s
+
+// Elements of different widths are stored side by side without overlapping,
+// and f32 elements round trip through memory.
+// CHECK: 3 2.5 1,-2,7 2.5,1.5
+module {
+  func @main(%arg0: memref<3xi16>, %arg1: memref<2xf32>) -> (i16, f32) {
+    %c0 = constant 0 : index
+    %c1 = constant 1 : index
+    %c2 = constant 2 : index
+    %c7 = constant 7 : i16
+    %cm2 = constant -2 : i16
+    %0 = load %arg0[%c2] : memref<3xi16>
+    store %c7, %arg0[%c2] : memref<3xi16>
+    store %cm2, %arg0[%c1] : memref<3xi16>
+    %1 = load %arg1[%c1] : memref<2xf32>
+    %2 = load %arg1[%c0] : memref<2xf32>
+    store %2, %arg1[%c1] : memref<2xf32>
+    store %1, %arg1[%c0] : memref<2xf32>
+    return %0, %1 : i16, f32
+  }
+}
@@ -18,19 +18,26 @@
 #include "circt/Conversion/RTLToLLHD/RTLToLLHD.h"
 #include "circt/Conversion/StandardToHandshake/StandardToHandshake.h"
 #include "circt/Conversion/StandardToStaticLogic/StandardToStaticLogic.h"
+#include "circt/Conversion/StaticLogicToFIRRTL/StaticLogicToFIRRTL.h"
 #include "circt/Dialect/ESI/ESIDialect.h"
 #include "circt/Dialect/FIRRTL/FIRRTLDialect.h"
 #include "circt/Dialect/FIRRTL/Passes.h"
 #include "circt/Dialect/Handshake/HandshakeOps.h"
 #include "circt/Dialect/LLHD/IR/LLHDDialect.h"
 #include "circt/Dialect/LLHD/Transforms/Passes.h"
+#include "circt/Dialect/RTL/Passes.h"
 #include "circt/Dialect/RTL/RTLDialect.h"
+#include "circt/Dialect/SV/Passes.h"
 #include "circt/Dialect/SV/SVDialect.h"
 #include "circt/Dialect/StaticLogic/StaticLogic.h"
+#include "circt/Support/MemoryStats.h"
+#include "circt/Translation/BinaryIR.h"
 #include "mlir/Dialect/Affine/IR/AffineOps.h"
 #include "mlir/Dialect/LLVMIR/LLVMDialect.h"
 #include "mlir/Dialect/StandardOps/IR/Ops.h"
 #include "mlir/IR/AsmState.h"
+#include "mlir/IR/BuiltinOps.h"
+#include "mlir/Parser.h"
 #include "mlir/Pass/Pass.h"
 #include "mlir/Pass/PassManager.h"
 #include "mlir/Pass/PassRegistry.h"
@@ -39,6 +46,7 @@
 #include "mlir/Transforms/Passes.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/SourceMgr.h"
 #include "llvm/Support/ToolOutputFile.h"
 
 using namespace llvm;
@@ -78,6 +86,62 @@ static cl::opt<bool> allowUnregisteredDialects(
     "allow-unregistered-dialect",
     cl::desc("Allow operation with no registered dialects"), cl::init(false));
 
+static cl::opt<bool>
+    emitBinary("emit-binary",
+               cl::desc("Write the output in the binary IR format"),
+               cl::init(false));
+
+/// Run the pass pipeline over a single input, reading and writing the binary
+/// IR format as needed.  MlirOptMain only deals in textual IR and doesn't let
+/// us instrument its pass manager, so this handles every run where the input or
+/// the output is binary, or the memory usage is reported.
+static LogicalResult processBinary(raw_ostream &os,
+                                   std::unique_ptr<llvm::MemoryBuffer> buffer,
+                                   PassPipelineCLParser &passPipeline,
+                                   DialectRegistry &registry) {
+  MLIRContext context;
+  registry.appendTo(context.getDialectRegistry());
+  context.allowUnregisteredDialects(allowUnregisteredDialects);
+
+  llvm::SourceMgr sourceMgr;
+  sourceMgr.AddNewSourceBuffer(std::move(buffer), llvm::SMLoc());
+  SourceMgrDiagnosticHandler sourceMgrHandler(sourceMgr, &context);
+
+  // The memory report is printed once the pass manager is destroyed.
+  PassManager pm(&context);
+  MemoryStats *memStats = applyMemoryStatsCLOptions(pm);
+  MemorySnapshot parseSnapshot;
+  if (memStats)
+    parseSnapshot = MemorySnapshot::take(nullptr);
+
+  OwningModuleRef module;
+  auto *mainBuffer = sourceMgr.getMemoryBuffer(sourceMgr.getMainFileID());
+  if (isBinaryIR(mainBuffer->getBuffer()))
+    module = readBinaryIR(sourceMgr, &context);
+  else
+    module = parseSourceFile(sourceMgr, &context);
+  if (!module)
+    return failure();
+  if (memStats)
+    memStats->addPhase("parse", parseSnapshot,
+                       MemorySnapshot::take(module.get()));
+
+  pm.enableVerifier(verifyPasses);
+  applyPassManagerCLOptions(pm);
+  auto errorHandler = [&](const Twine &msg) {
+    return emitError(UnknownLoc::get(&context)) << msg;
+  };
+  if (failed(passPipeline.addToPipeline(pm, errorHandler)) ||
+      failed(pm.run(*module)))
+    return failure();
+
+  if (emitBinary)
+    return writeBinaryIR(*module, os);
+  module->print(os);
+  os << '\n';
+  return success();
+}
+
 int main(int argc, char **argv) {
   InitLLVM y(argc, argv);
 
@@ -97,6 +161,7 @@ int main(int argc, char **argv) {
   // Register any pass manager command line options.
   registerMLIRContextCLOptions();
   registerPassManagerCLOptions();
+  registerMemoryStatsCLOptions();
 
   // Register printer command line options.
   registerAsmPrinterCLOptions();
@@ -108,6 +173,7 @@ int main(int argc, char **argv) {
   registry.insert<handshake::HandshakeOpsDialect>();
   registry.insert<staticlogic::StaticLogicDialect>();
   staticlogic::registerStandardToStaticLogicPasses();
+  staticlogic::registerStaticLogicToFIRRTLPasses();
   handshake::registerStandardToHandshakePasses();
   handshake::registerHandshakeToFIRRTLPasses();
 
@@ -116,7 +182,9 @@ int main(int argc, char **argv) {
 
   registry.insert<llhd::LLHDDialect>();
   registry.insert<rtl::RTLDialect>();
+  rtl::registerPasses();
   registry.insert<sv::SVDialect>();
+  sv::registerPasses();
 
   llhd::initLLHDTransformationPasses();
   llhd::initLLHDToLLVMPass();
@@ -152,6 +220,23 @@ int main(int argc, char **argv) {
     exit(1);
   }
 
+  // Binary input is recognized by its magic number.  Splitting the input and
+  // checking diagnostics only make sense for textual IR.
+  bool isBinary = emitBinary || isBinaryIR(file->getBuffer());
+  if ((isBinary || isMemoryStatsEnabled()) &&
+      (splitInputFile || verifyDiagnostics)) {
+    llvm::errs() << "-split-input-file and -verify-diagnostics are not "
+                    "supported with binary IR or -memory-stats\n";
+    return 1;
+  }
+  if (isBinary || isMemoryStatsEnabled()) {
+    if (failed(processBinary(output->os(), std::move(file), passPipeline,
+                             registry)))
+      return 1;
+    output->keep();
+    return 0;
+  }
+
   return failed(MlirOptMain(output->os(), std::move(file), passPipeline,
                             registry, splitInputFile, verifyDiagnostics,
                             verifyPasses, allowUnregisteredDialects));
@@ -68,15 +68,23 @@ class Verilator:
         else:
           self.verilator = args.sim
         self.top = args.top
+        self.threads = args.threads
+        self.trace = args.trace
         if args.objdir != "":
           self.ObjDir = args.objdir
         else:
           self.ObjDir = os.path.basename(args.sources[0]) + ".obj_dir"
 
     def compile(self, sources):
-        return subprocess.run([self.verilator, "--cc", "--top-module", self.top,
-                               "-sv", "--build", "--exe",
-                               "--Mdir", self.ObjDir] + sources)
+        cmd = [self.verilator, "--cc", "--top-module", self.top, "-sv",
+               "--build", "--exe", "--Mdir", self.ObjDir]
+        if self.threads > 1:
+          cmd += ["--threads", str(self.threads)]
+        if self.trace == "vcd":
+          cmd.append("--trace")
+        elif self.trace == "fst":
+          cmd.append("--trace-fst")
+        return subprocess.run(cmd + sources)
 
     def run(self, cycles, args):
         exe = os.path.join(self.ObjDir, "V" + self.top)
@@ -117,6 +125,14 @@ def __main__(args):
                            help="Simulation arguments string.")
     argparser.add_argument("--no-default-driver", dest="no_default_driver", action='store_true',
                            help="Do not use the standard top module/drivers.")
+    argparser.add_argument("--threads", type=int, default=1,
+                           help="(Verilator) Number of threads to partition" +
+                           " the model into.")
+    argparser.add_argument("--trace", type=str, default="none",
+                           choices=["none", "vcd", "fst"],
+                           help="(Verilator) Build the model with tracing" +
+                           " support. Tracing is then enabled with the" +
+                           " driver's --trace* flags in --simargs.")
     argparser.add_argument("--cycles", type=int, default=-1,
                            help="Number of cycles to run the simulator. " +
                                 " -1 means don't stop.")
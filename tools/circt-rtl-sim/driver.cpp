@@ -9,16 +9,35 @@
 // A fairly standard, boilerplate Verilator C++ simulation driver. Assumes the
 // top level exposes just two signals: 'clk' and 'rstn'.
 //
+// The model may be built with Verilator's '--threads', which needs nothing
+// from the driver.  If it is built with '--trace' or '--trace-fst', tracing is
+// controlled at runtime with the '--trace-*' flags, so that long runs only pay
+// for it in the window being debugged.
+//
+// Designs which only ever act on ESI cosim messages can be run with
+// '--idle-skip <n>'. Once there was no cosim traffic for <n> cycles and no
+// message is waiting, the driver blocks until a client sends one instead of
+// spinning through empty cycles. Simulation time doesn't advance meanwhile.
+//
 //===----------------------------------------------------------------------===//
 
 #include "Vtop.h"
 
-#ifdef DEBUG
+#if VM_TRACE_FST
+#include "verilated_fst_c.h"
+using TraceFile = VerilatedFstC;
+static const char *defaultTraceFileName = "main.fst";
+#elif VM_TRACE
 #include "verilated_vcd_c.h"
+using TraceFile = VerilatedVcdC;
+static const char *defaultTraceFileName = "main.vcd";
 #endif
 
 #include "signal.h"
+#include <cstdlib>
 #include <iostream>
+#include <limits>
+#include <string>
 
 vluint64_t timeStamp;
 
@@ -29,6 +48,24 @@ void handle_sigint(int) { stopSimulation = true; }
 // Called by $time in Verilog.
 double sc_time_stamp() { return timeStamp; }
 
+// The idle skip protocol of the ESI cosim DPI server. These are only defined if
+// the server library is linked into the simulation.
+extern "C" unsigned long long cosimserverGetActivity() __attribute__((weak));
+extern "C" int cosimserverWaitForMessages(unsigned int timeoutMs)
+    __attribute__((weak));
+
+static void printUsage(const char *name) {
+  std::cerr << "usage: " << name << " [options] [+verilator-args]\n"
+            << "  --cycles <n>        Run <n> cycles out of reset.\n"
+            << "  --trace             Trace the whole simulation.\n"
+            << "  --trace-file <f>    Write the trace to <f>.\n"
+            << "  --trace-start <t>   Start tracing at tick <t>.\n"
+            << "  --trace-stop <t>    Stop tracing at tick <t>.\n"
+            << "  --trace-depth <n>   Trace <n> levels of hierarchy.\n"
+            << "  --idle-skip <n>     Wait for cosim messages after <n> idle "
+               "cycles.\n";
+}
+
 int main(int argc, char **argv) {
   // Register graceful exit handler.
   signal(SIGINT, handle_sigint);
@@ -37,28 +74,97 @@ int main(int argc, char **argv) {
 
   size_t numCyclesToRun = 0;
   bool runForever = true;
+  bool traceRequested = false;
+  std::string traceFileName;
+  vluint64_t traceStart = 0;
+  vluint64_t traceStop = std::numeric_limits<vluint64_t>::max();
+  int traceDepth = 99;
+  size_t idleSkipCycles = 0;
+
   // Search the command line args for those we are sensitive to.
   for (int i = 1; i < argc; ++i) {
-    if (std::string(argv[i]) == "--cycles") {
-      if (i + 1 < argc) {
-        numCyclesToRun = std::strtoull(argv[++i], nullptr, 10);
-        runForever = false;
-      } else {
-        std::cerr << "--cycles must be followed by number of cycles."
-                  << std::endl;
-        return 1;
-      }
+    std::string arg = argv[i];
+    if (arg == "--trace") {
+      traceRequested = true;
+      continue;
+    }
+    if (arg != "--cycles" && arg != "--trace-file" && arg != "--trace-start" &&
+        arg != "--trace-stop" && arg != "--trace-depth" && arg != "--idle-skip")
+      continue;
+
+    if (i + 1 >= argc) {
+      std::cerr << arg << " must be followed by a value." << std::endl;
+      printUsage(argv[0]);
+      return 1;
+    }
+    const char *value = argv[++i];
+    if (arg == "--cycles") {
+      numCyclesToRun = std::strtoull(value, nullptr, 10);
+      runForever = false;
+      continue;
+    }
+    if (arg == "--idle-skip") {
+      idleSkipCycles = std::strtoull(value, nullptr, 10);
+      continue;
     }
+
+    // All the other flags enable tracing.
+    traceRequested = true;
+    if (arg == "--trace-file")
+      traceFileName = value;
+    else if (arg == "--trace-start")
+      traceStart = std::strtoull(value, nullptr, 10);
+    else if (arg == "--trace-stop")
+      traceStop = std::strtoull(value, nullptr, 10);
+    else
+      traceDepth = std::atoi(value);
   }
 
   // Construct the simulated module's C++ model.
+#if VM_TRACE
+  // This has to be set before the model is constructed.
+  Verilated::traceEverOn(traceRequested);
+#endif
   auto &dut = *new Vtop();
-#ifdef DEBUG
-  VerilatedVcdC *tfp = new VerilatedVcdC;
-  Verilated::traceEverOn(true);
-  dut.trace(tfp, 99); // Trace 99 levels of hierarchy
-  tfp->open("main.vcd");
+
+#if VM_TRACE
+  TraceFile *tfp = nullptr;
+  if (traceFileName.empty())
+    traceFileName = defaultTraceFileName;
+#else
+  if (traceRequested)
+    std::cerr << "[driver] Ignoring the trace flags, the model was built "
+                 "without tracing support"
+              << std::endl;
+#endif
+
+  // Evaluate the model for one tick and toggle the clock, tracing the tick if
+  // it is in the window being traced.
+  auto tick = [&]() {
+    dut.eval();
+    dut.clk = !dut.clk;
+#if VM_TRACE
+    if (!traceRequested)
+      return;
+    if (!tfp && timeStamp >= traceStart && timeStamp < traceStop) {
+      std::cout << "[driver] Starting trace at tick #" << timeStamp
+                << std::endl;
+      tfp = new TraceFile;
+      dut.trace(tfp, traceDepth);
+      tfp->open(traceFileName.c_str());
+    }
+    if (!tfp)
+      return;
+    if (timeStamp >= traceStop) {
+      std::cout << "[driver] Stopping trace at tick #" << timeStamp
+                << std::endl;
+      tfp->close();
+      traceRequested = false;
+      return;
+    }
+    tfp->dump(timeStamp);
 #endif
+  };
 
   std::cout << "[driver] Starting simulation" << std::endl;
 
@@ -67,34 +173,56 @@ int main(int argc, char **argv) {
   dut.clk = 0;
 
   // Run for a few cycles with reset held.
-  for (timeStamp = 0; timeStamp < 8 && !Verilated::gotFinish(); timeStamp++) {
-    dut.eval();
-    dut.clk = !dut.clk;
-#ifdef DEBUG
-    tfp->dump(timeStamp);
-#endif
-  }
+  for (timeStamp = 0; timeStamp < 8 && !Verilated::gotFinish(); timeStamp++)
+    tick();
 
   // Take simulation out of reset.
   dut.rstn = 1;
 
+  if (idleSkipCycles && !cosimserverGetActivity) {
+    std::cerr << "[driver] Ignoring --idle-skip, the cosim server isn't linked"
+              << std::endl;
+    idleSkipCycles = 0;
+  }
+  unsigned long long lastActivity = 0;
+  size_t idleCycles = 0;
+
+  // Once the design was idle for long enough, wait for the next cosim message.
+  // This is checked once per clock cycle.
+  auto skipIdleCycles = [&]() {
+    auto activity = cosimserverGetActivity();
+    if (activity != lastActivity) {
+      lastActivity = activity;
+      idleCycles = 0;
+      return;
+    }
+    if (++idleCycles < idleSkipCycles)
+      return;
+    int rc;
+    while ((rc = cosimserverWaitForMessages(100)) == 0 && !stopSimulation)
+      ;
+    // Without a server nothing will ever wake the design up, stop trying.
+    if (rc < 0)
+      idleSkipCycles = 0;
+    idleCycles = 0;
+  };
+
   // Run for the specified number of cycles out of reset.
   vluint64_t endTime = timeStamp + (numCyclesToRun * 2);
   for (; (runForever || timeStamp <= endTime) && !Verilated::gotFinish() &&
          !stopSimulation;
        timeStamp++) {
-    dut.eval();
-    dut.clk = !dut.clk;
-#ifdef DEBUG
-    tfp->dump(timeStamp);
-#endif
+    tick();
+    if (idleSkipCycles && dut.clk)
+      skipIdleCycles();
   }
 
   // Tell the simulator that we're going to exit. This flushes the output(s) and
   // frees whatever memory may have been allocated.
   dut.final();
-#ifdef DEBUG
-  tfp->close();
+#if VM_TRACE
+  if (tfp && traceRequested)
+    tfp->close();
 #endif
 
   std::cout << "[driver] Ending simulation at tick #" << timeStamp << std::endl;
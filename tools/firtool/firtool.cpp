@@ -16,20 +16,40 @@
 #include "circt/Dialect/FIRRTL/FIRRTLDialect.h"
 #include "circt/Dialect/FIRRTL/FIRRTLOps.h"
 #include "circt/Dialect/FIRRTL/Passes.h"
+#include "circt/Dialect/RTL/Passes.h"
 #include "circt/Dialect/RTL/RTLDialect.h"
 #include "circt/Dialect/RTL/RTLOps.h"
+#include "circt/Dialect/SV/Passes.h"
 #include "circt/Dialect/SV/SVDialect.h"
+#include "circt/Support/AsyncOutputStream.h"
+#include "circt/Support/MemoryStats.h"
+#include "circt/Translation/BinaryIR.h"
 #include "circt/Translation/ExportVerilog.h"
 #include "mlir/Dialect/StandardOps/IR/Ops.h"
 #include "mlir/IR/BuiltinOps.h"
+#include "mlir/IR/Diagnostics.h"
+#include "mlir/IR/Verifier.h"
 #include "mlir/Parser.h"
 #include "mlir/Pass/Pass.h"
+#include "mlir/Pass/PassInstrumentation.h"
 #include "mlir/Pass/PassManager.h"
 #include "mlir/Support/FileUtilities.h"
 #include "mlir/Transforms/Passes.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Config/llvm-config.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
 #include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Parallel.h"
+#include "llvm/Support/Path.h"
 #include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/raw_sha1_ostream.h"
+
+#include <chrono>
+#include <mutex>
 
 using namespace llvm;
 using namespace mlir;
@@ -45,11 +65,12 @@ static cl::opt<InputFormatKind> inputFormat(
     cl::values(clEnumValN(InputUnspecified, "autodetect",
                           "Autodetect input format"),
                clEnumValN(InputFIRFile, "fir", "Parse as .fir file"),
-               clEnumValN(InputMLIRFile, "mlir", "Parse as .mlir file")),
+               clEnumValN(InputMLIRFile, "mlir",
+                          "Parse as .mlir file, textual or binary")),
     cl::init(InputUnspecified));
 
-static cl::opt<std::string>
-    inputFilename(cl::Positional, cl::desc("<input file>"), cl::init("-"));
+static cl::list<std::string>
+    inputFilenames(cl::Positional, cl::desc("<input files>"), cl::ZeroOrMore);
 
 static cl::opt<std::string> outputFilename("o", cl::desc("Output filename"),
                                            cl::value_desc("filename"),
@@ -66,94 +87,807 @@ static cl::opt<bool>
                      cl::desc("run the lower-types pass within lower-to-rtl"),
                      cl::init(false));
 
+static cl::opt<bool>
+    dedup("dedup",
+          cl::desc("merge structurally identical modules before lowering"),
+          cl::init(false));
+
+static cl::opt<bool> propagateConstants(
+    "imconstprop",
+    cl::desc("propagate constants across the modules before lowering"),
+    cl::init(false));
+
+static cl::opt<bool> removeDeadCode(
+    "remove-dead-code",
+    cl::desc("remove unreachable modules and dead ports before lowering"),
+    cl::init(false));
+
+static cl::opt<uint64_t> memMacroThreshold(
+    "mem-macro-threshold",
+    cl::desc("lower memories with at least this many bits to external SRAM "
+             "macros (0 disables it)"),
+    cl::init(0));
+
+static cl::opt<std::string>
+    memMacroConf("mem-macro-conf",
+                 cl::desc("file to write the memory macro configurations to"),
+                 cl::value_desc("filename"), cl::init(""));
+
+static cl::opt<bool> narrowDemandedBits(
+    "narrow-demanded-bits",
+    cl::desc("narrow RTL logic to the bits that are used (requires "
+             "-lower-to-rtl)"),
+    cl::init(false));
+
 static cl::opt<bool>
     ignoreFIRLocations("ignore-fir-locators",
                        cl::desc("ignore the @info locations in the .fir file"),
                        cl::init(false));
 
-enum OutputFormatKind { OutputMLIR, OutputVerilog, OutputDisabled };
+static cl::opt<bool>
+    parseInParallel("parse-in-parallel",
+                    cl::desc("parse the module bodies of a .fir file in "
+                             "parallel"),
+                    cl::init(false));
+
+static cl::opt<bool>
+    emitInParallel("emit-in-parallel",
+                   cl::desc("emit the Verilog for each module in parallel "
+                            "(requires -lower-to-rtl)"),
+                   cl::init(false));
+
+static cl::opt<unsigned>
+    numThreads("j",
+               cl::desc("number of threads to use, 0 for one per hardware "
+                        "thread"),
+               cl::value_desc("threads"), cl::init(0));
+
+static cl::opt<bool>
+    asyncOutput("async-output",
+                cl::desc("write the output on a separate thread, in large "
+                         "chunks (ignored with -j 1)"),
+                cl::init(true));
+
+static cl::opt<bool> primaryLocationOnly(
+    "primary-location-only",
+    cl::desc("only print the primary location of each statement in the "
+             "Verilog location comments (requires -lower-to-rtl)"),
+    cl::init(false));
+
+static cl::opt<bool> omitRepeatedLocations(
+    "omit-repeated-locations",
+    cl::desc("leave out a Verilog location comment that is the same as the "
+             "one on the line before (requires -lower-to-rtl)"),
+    cl::init(false));
+
+static cl::opt<unsigned> inlineExpressionSize(
+    "inline-expression-size",
+    cl::desc("emit multiply used expressions of up to this many operations "
+             "inline at each use instead of in a wire, 0 to disable "
+             "(requires -lower-to-rtl)"),
+    cl::value_desc("ops"), cl::init(0));
+
+static cl::opt<bool>
+    splitVerilog("split-verilog",
+                 cl::desc("emit one file per module into the directory given "
+                          "by -o, along with a filelist (requires "
+                          "-lower-to-rtl and -verilog)"),
+                 cl::init(false));
+
+static cl::opt<bool> streamModules(
+    "stream-modules",
+    cl::desc("parse, lower and emit one module at a time to bound memory use "
+             "(requires -lower-to-rtl and -verilog)"),
+    cl::init(false));
+
+static cl::opt<std::string> moduleCache(
+    "module-cache",
+    cl::desc("reuse the Verilog of modules that did not change since a "
+             "previous run, kept in the given directory (requires "
+             "-stream-modules)"),
+    cl::value_desc("directory"), cl::init(""));
+
+static cl::opt<bool>
+    benchmarkLexer("benchmark-lexer",
+                   cl::desc("only lex the .fir input and report the number of "
+                            "tokens per second"),
+                   cl::init(false), cl::Hidden);
+
+enum OutputFormatKind {
+  OutputMLIR,
+  OutputBinary,
+  OutputVerilog,
+  OutputDisabled
+};
 
 static cl::opt<OutputFormatKind> outputFormat(
     cl::desc("Specify output format:"),
     cl::values(clEnumValN(OutputMLIR, "mlir", "Emit MLIR dialect"),
+               clEnumValN(OutputBinary, "emit-binary",
+                          "Emit MLIR dialect in the binary IR format"),
                clEnumValN(OutputVerilog, "verilog", "Emit Verilog"),
                clEnumValN(OutputDisabled, "disable-output",
                           "Do not output anything")),
     cl::init(OutputMLIR));
 
-/// Process a single buffer of the input.
-static LogicalResult
-processBuffer(std::unique_ptr<llvm::MemoryBuffer> ownedBuffer,
-              raw_ostream &os) {
-  MLIRContext context;
+static cl::opt<bool>
+    timing("timing",
+           cl::desc("report the time spent in each phase, including import "
+                    "and export, and statistics about the IR on stderr"),
+           cl::init(false));
+
+enum TimingFormatKind { TimingText, TimingJSON };
+
+static cl::opt<TimingFormatKind> timingFormat(
+    "timing-format", cl::desc("Specify the format of the -timing report:"),
+    cl::values(clEnumValN(TimingText, "text", "a human readable report"),
+               clEnumValN(TimingJSON, "json", "a JSON report")),
+    cl::init(TimingText));
+
+namespace {
+/// Collects the time spent in each phase of firtool and some statistics about
+/// the IR, for the --timing report.
+class CompileStats {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  /// Record the time spent in 'phase' since 'start'.
+  void addPhase(StringRef phase, Clock::time_point start) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::chrono::duration<double> duration = Clock::now() - start;
+    auto it = phaseIndex.try_emplace(phase, phases.size());
+    if (it.second)
+      phases.push_back({phase.str(), 0.0});
+    phases[it.first->second].second += duration.count();
+  }
 
-  // Register our dialects.
-  context.loadDialect<firrtl::FIRRTLDialect, rtl::RTLDialect, sv::SVDialect>();
+  void setCounter(StringRef name, uint64_t value) {
+    counters.push_back({name.str(), value});
+  }
 
-  llvm::SourceMgr sourceMgr;
-  sourceMgr.AddNewSourceBuffer(std::move(ownedBuffer), llvm::SMLoc());
-  SourceMgrDiagnosticHandler sourceMgrHandler(sourceMgr, &context);
+  /// Count the operations in 'module', and the distinct types and attributes
+  /// they refer to, under 'prefix'.
+  void countIR(StringRef prefix, ModuleOp module) {
+    uint64_t numOps = 0;
+    DenseSet<Type> types;
+    DenseSet<Attribute> attrs;
+    module.walk([&](Operation *op) {
+      ++numOps;
+      types.insert(op->result_type_begin(), op->result_type_end());
+      for (auto &region : op->getRegions())
+        for (auto &block : region)
+          for (auto arg : block.getArguments())
+            types.insert(arg.getType());
+      for (auto attr : op->getAttrs())
+        attrs.insert(attr.second);
+    });
+    setCounter((prefix + ".ops").str(), numOps);
+    setCounter((prefix + ".types").str(), types.size());
+    setCounter((prefix + ".attributes").str(), attrs.size());
+  }
+
+  void print(raw_ostream &os, TimingFormatKind format) {
+    if (format == TimingJSON) {
+      llvm::json::OStream json(os, 2);
+      json.object([&] {
+        json.attributeArray("phases", [&] {
+          for (auto &phase : phases)
+            json.object([&] {
+              json.attribute("name", phase.first);
+              json.attribute("seconds", phase.second);
+            });
+        });
+        json.attributeObject("counters", [&] {
+          for (auto &counter : counters)
+            json.attribute(counter.first, int64_t(counter.second));
+        });
+      });
+      os << "\n";
+      return;
+    }
 
-  // Nothing in the parser is threaded.  Disable synchronization overhead.
-  context.disableMultithreading();
+    // The passes run within the lower phase, possibly nested or in parallel,
+    // so they're not part of the total.
+    double total = 0;
+    for (auto &phase : phases)
+      if (!StringRef(phase.first).startswith("pass: "))
+        total += phase.second;
+    os << "===" << std::string(73, '-') << "===\n";
+    os << "                         firtool Timing Report\n";
+    os << "===" << std::string(73, '-') << "===\n";
+    for (auto &phase : phases)
+      os << llvm::format("  %10.4f (%5.1f%%)  ", phase.second,
+                         total > 0 ? 100 * phase.second / total : 0.0)
+         << phase.first << "\n";
+    os << llvm::format("  %10.4f (100.0%%)  Total\n\n", total);
+    for (auto &counter : counters)
+      os << llvm::format("  %12llu  ", (unsigned long long)counter.second)
+         << counter.first << "\n";
+  }
 
-  // Apply any pass manager command line options.
-  PassManager pm(&context);
-  pm.enableVerifier(true);
-  applyPassManagerCLOptions(pm);
+private:
+  std::mutex mutex;
+  llvm::StringMap<size_t> phaseIndex;
+  std::vector<std::pair<std::string, double>> phases;
+  std::vector<std::pair<std::string, uint64_t>> counters;
+};
+
+/// Times each pass of a pipeline as a phase of its own.  The same pass may run
+/// on many operations in parallel, in which case the times are summed up.
+class PassTimer : public PassInstrumentation {
+public:
+  explicit PassTimer(CompileStats &stats) : stats(stats) {}
 
+  void runBeforePass(Pass *pass, Operation *op) override {
+    std::lock_guard<std::mutex> lock(mutex);
+    startTimes[{pass, op}] = CompileStats::Clock::now();
+  }
+  void runAfterPass(Pass *pass, Operation *op) override { stop(pass, op); }
+  void runAfterPassFailed(Pass *pass, Operation *op) override {
+    stop(pass, op);
+  }
+
+private:
+  void stop(Pass *pass, Operation *op) {
+    CompileStats::Clock::time_point start;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      auto it = startTimes.find({pass, op});
+      if (it == startTimes.end())
+        return;
+      start = it->second;
+      startTimes.erase(it);
+    }
+    stats.addPhase(("pass: " + pass->getName()).str(), start);
+  }
+
+  CompileStats &stats;
+  std::mutex mutex;
+  DenseMap<std::pair<Pass *, Operation *>, CompileStats::Clock::time_point>
+      startTimes;
+};
+} // end anonymous namespace
+
+/// Add the passes cleaning up the FIRRTL coming out of the parser.  They are
+/// nested on each firrtl.module, so the pass manager runs them on all modules
+/// in parallel.
+static void addFIRRTLCleanupPasses(PassManager &pm) {
+  auto &modulePM = pm.nest<firrtl::CircuitOp>().nest<firrtl::FModuleOp>();
+  modulePM.addPass(createCSEPass());
+  modulePM.addPass(createCanonicalizerPass());
+}
+
+/// Add the lowering of the circuit to RTL modules, and the optimizations run on
+/// each of them in parallel.
+static void addRTLLoweringPasses(PassManager &pm) {
+  // The lowering doesn't handle firrtl.when, resolve the connects first.
+  pm.nest<firrtl::CircuitOp>().nest<firrtl::FModuleOp>().addPass(
+      firrtl::createExpandWhensPass());
+  pm.addPass(firrtl::createLowerFIRRTLToRTLModulePass(memMacroThreshold,
+                                                      memMacroConf));
+  auto &modulePM = pm.nest<rtl::RTLModuleOp>();
+  modulePM.addPass(firrtl::createLowerFIRRTLToRTLPass());
+
+  // If enabled, run the optimizer.
+  if (!disableOptimization) {
+    modulePM.addPass(createCSEPass());
+    modulePM.addPass(rtl::createRTLStructuralHashPass());
+    if (narrowDemandedBits)
+      modulePM.addPass(rtl::createRTLDemandedBitsPass());
+    modulePM.addPass(createCanonicalizerPass());
+    modulePM.addPass(sv::createSVMergeAlwaysPass());
+  }
+}
+
+/// Return the symbol name of a module.
+static StringRef getModuleName(Operation *module) {
+  return module->getAttrOfType<StringAttr>(SymbolTable::getSymbolAttrName())
+      .getValue();
+}
+
+/// Return true if two modules have the same ports.
+static bool haveSamePorts(Operation *a, Operation *b) {
+  SmallVector<firrtl::ModulePortInfo, 8> aPorts, bPorts;
+  firrtl::getModulePortInfo(a, aPorts);
+  firrtl::getModulePortInfo(b, bPorts);
+  if (aPorts.size() != bPorts.size())
+    return false;
+  for (size_t i = 0, e = aPorts.size(); i != e; ++i)
+    if (aPorts[i].name != bPorts[i].name || aPorts[i].type != bPorts[i].type)
+      return false;
+  return true;
+}
+
+/// Return the name of the Verilog module an external module stands for.
+static StringRef getVerilogName(firrtl::FExtModuleOp extModule) {
+  if (auto defname = extModule.defname())
+    return *defname;
+  return getModuleName(extModule);
+}
+
+/// Move the modules of the circuits in 'others' into the circuit of 'module',
+/// which stays the main circuit.  An external module declared in one file is
+/// resolved to the module of the same name defined in another, which then
+/// replaces it.  The external modules standing for a Verilog module of another
+/// name are black boxes, which can't be resolved.
+static LogicalResult linkCircuits(ModuleOp module,
+                                  MutableArrayRef<OwningModuleRef> others) {
+  auto circuits = module.getOps<firrtl::CircuitOp>();
+  if (circuits.empty())
+    return module.emitError("no circuit to link into");
+  auto mainCircuit = *circuits.begin();
+  Block *mainBody = mainCircuit.getBody();
+
+  llvm::StringMap<Operation *> modules;
+  for (auto &op : *mainBody)
+    if (isa<firrtl::FModuleOp, firrtl::FExtModuleOp>(op))
+      modules[getModuleName(&op)] = &op;
+
+  for (auto &other : others) {
+    for (auto circuit : other->getOps<firrtl::CircuitOp>()) {
+      for (auto &op : llvm::make_early_inc_range(*circuit.getBody())) {
+        if (!isa<firrtl::FModuleOp, firrtl::FExtModuleOp>(op))
+          continue;
+        auto name = getModuleName(&op);
+        Operation *&existing = modules[name];
+        if (!existing) {
+          op.moveBefore(mainBody->getTerminator());
+          existing = &op;
+          continue;
+        }
+
+        auto extModule = dyn_cast<firrtl::FExtModuleOp>(op);
+        auto existingExtModule = dyn_cast<firrtl::FExtModuleOp>(existing);
+        auto diag = [&](const Twine &message) {
+          op.emitError(message).attachNote(existing->getLoc())
+              << "previous declaration is here";
+          return failure();
+        };
+        if (!extModule && !existingExtModule)
+          return diag("module '" + name + "' is defined in several inputs");
+        if (!haveSamePorts(&op, existing))
+          return diag("module '" + name +
+                      "' is declared with different ports in several inputs");
+
+        // Two declarations of the same external module.
+        if (extModule && existingExtModule) {
+          if (getVerilogName(extModule) != getVerilogName(existingExtModule))
+            return diag("external module '" + name +
+                        "' stands for different Verilog modules in several "
+                        "inputs");
+          op.erase();
+          continue;
+        }
+
+        // A declaration and a definition, the definition wins.
+        auto declaration = extModule ? extModule : existingExtModule;
+        if (getVerilogName(declaration) != name)
+          return diag("external module '" + name + "' with defname '" +
+                      getVerilogName(declaration) +
+                      "' conflicts with a module definition");
+        if (extModule) {
+          op.erase();
+          continue;
+        }
+        op.moveBefore(existing);
+        existing->erase();
+        existing = &op;
+      }
+    }
+  }
+  return success();
+}
+
+/// Parse the .fir files in 'linkedSourceMgrs' in parallel, each into its own
+/// circuit.  Diagnostics are reported in the order of the files.  The files
+/// are the unit of parallelism, their module bodies are parsed serially.
+static LogicalResult
+parseLinkedInputs(MLIRContext &context,
+                  ArrayRef<std::unique_ptr<llvm::SourceMgr>> linkedSourceMgrs,
+                  firrtl::FIRParserOptions options,
+                  SmallVectorImpl<OwningModuleRef> &modules) {
+  options.parseModulesInParallel = false;
+  modules.resize(linkedSourceMgrs.size());
+  auto parse = [&](size_t i) {
+    modules[i] = importFIRRTL(*linkedSourceMgrs[i], &context, options);
+  };
+  if (context.isMultithreadingEnabled()) {
+    ParallelDiagnosticHandler diagHandler(&context);
+    llvm::parallelForEachN(0, modules.size(), [&](size_t i) {
+      diagHandler.setOrderIDForThread(i);
+      parse(i);
+      diagHandler.eraseOrderIDForThread();
+    });
+  } else {
+    for (size_t i = 0, e = modules.size(); i != e; ++i)
+      parse(i);
+  }
+  return success(llvm::all_of(modules, [](OwningModuleRef &module) {
+    return bool(module);
+  }));
+}
+
+/// Parse, transform and emit the input in 'sourceMgr'.  The .fir files in
+/// 'linkedSourceMgrs', if any, are parsed along with it and linked into its
+/// circuit.
+static LogicalResult
+processInput(MLIRContext &context, llvm::SourceMgr &sourceMgr,
+             ArrayRef<std::unique_ptr<llvm::SourceMgr>> linkedSourceMgrs,
+             PassManager &pm, CompileStats &stats, MemoryStats *memStats,
+             raw_ostream &os) {
+  auto importStart = CompileStats::Clock::now();
+  MemorySnapshot importSnapshot;
+  if (memStats)
+    importSnapshot = MemorySnapshot::take(nullptr);
   OwningModuleRef module;
   if (inputFormat == InputFIRFile) {
     firrtl::FIRParserOptions options;
     options.ignoreInfoLocators = ignoreFIRLocations;
-    module = importFIRRTL(sourceMgr, &context, options);
+    options.parseModulesInParallel = parseInParallel;
+    if (linkedSourceMgrs.empty()) {
+      module = importFIRRTL(sourceMgr, &context, options);
+    } else {
+      // The main input is parsed along with the other ones, then they are all
+      // linked into its circuit.
+      SmallVector<OwningModuleRef, 4> modules;
+      if (succeeded(parseLinkedInputs(context, linkedSourceMgrs, options,
+                                      modules)) &&
+          succeeded(linkCircuits(modules[0].get(),
+                                 MutableArrayRef<OwningModuleRef>(modules)
+                                     .drop_front())) &&
+          succeeded(verify(modules[0].get())))
+        module = std::move(modules[0]);
+    }
+
+    // Lowering requires all the widths, compute any that were left out.
+    if (lowerToRTL)
+      pm.nest<firrtl::CircuitOp>().addPass(firrtl::createInferWidthsPass());
 
     // If we parsed a FIRRTL file and have optimizations enabled, clean it up.
-    if (!disableOptimization) {
-      pm.addPass(createCSEPass());
-      pm.addPass(createCanonicalizerPass());
-    }
+    if (!disableOptimization)
+      addFIRRTLCleanupPasses(pm);
   } else {
     assert(inputFormat == InputMLIRFile);
-    module = parseSourceFile(sourceMgr, &context);
+    auto *buffer = sourceMgr.getMemoryBuffer(sourceMgr.getMainFileID());
+    if (isBinaryIR(buffer->getBuffer()))
+      module = readBinaryIR(sourceMgr, &context);
+    else
+      module = parseSourceFile(sourceMgr, &context);
   }
   if (!module)
     return failure();
+  stats.addPhase("import", importStart);
+  if (memStats)
+    memStats->addPhase("import", importSnapshot,
+                       MemorySnapshot::take(module.get()));
+  if (timing)
+    stats.countIR("import", module.get());
 
   // Allow optimizations to run multithreaded.
-  context.disableMultithreading(false);
+  context.disableMultithreading(numThreads == 1);
 
   // Run the lower-to-rtl pass if requested.
   if (lowerToRTL) {
+    if (propagateConstants)
+      pm.nest<firrtl::CircuitOp>().addPass(firrtl::createIMConstPropPass());
+    if (dedup)
+      pm.nest<firrtl::CircuitOp>().addPass(firrtl::createDedupPass());
+    if (removeDeadCode)
+      pm.nest<firrtl::CircuitOp>().addPass(firrtl::createDeadCodePass());
     if (enableLowerTypes)
       pm.nest<firrtl::CircuitOp>().nest<firrtl::FModuleOp>().addPass(
           firrtl::createLowerFIRRTLTypesPass());
-    pm.addPass(firrtl::createLowerFIRRTLToRTLModulePass());
-    pm.nest<rtl::RTLModuleOp>().addPass(firrtl::createLowerFIRRTLToRTLPass());
-
-    // If enabled, run the optimizer.
-    if (!disableOptimization) {
-      pm.addPass(createCSEPass());
-      pm.addPass(createCanonicalizerPass());
-    }
+    addRTLLoweringPasses(pm);
   }
 
+  // The pipeline is timed as a whole, the times of the passes overlap when
+  // they're nested or run in parallel.
+  auto lowerStart = CompileStats::Clock::now();
   if (failed(pm.run(module.get())))
     return failure();
+  stats.addPhase("lower", lowerStart);
+  if (timing)
+    stats.countIR("final", module.get());
 
   // Finally, emit the output.
+  auto exportStart = CompileStats::Clock::now();
+  // The IR is left as is by the export, don't count its types and attributes
+  // again.
+  MemorySnapshot exportSnapshot;
+  if (memStats)
+    exportSnapshot = MemorySnapshot::take(module.get(), false);
+  auto startPos = os.tell();
+  auto result = success();
+  ExportVerilogStatistics verilogStats;
   switch (outputFormat) {
   case OutputMLIR:
     module->print(os);
-    return success();
+    break;
+  case OutputBinary:
+    result = writeBinaryIR(module.get(), os);
+    break;
   case OutputDisabled:
-    return success();
-  case OutputVerilog:
-    if (lowerToRTL)
-      return exportVerilog(module.get(), os);
-    return exportFIRRTLToVerilog(module.get(), os);
+    break;
+  case OutputVerilog: {
+    ExportVerilogOptions options;
+    options.emitInParallel = emitInParallel;
+    options.primaryLocationOnly = primaryLocationOnly;
+    options.omitRepeatedLocationInfo = omitRepeatedLocations;
+    options.maxInlineExpressionSize = inlineExpressionSize;
+    options.statistics = &verilogStats;
+    if (splitVerilog)
+      result = exportSplitVerilog(module.get(), outputFilename, options);
+    else if (lowerToRTL)
+      result = exportVerilog(module.get(), os, options);
+    else
+      result = exportFIRRTLToVerilog(module.get(), os);
+    break;
+  }
+  }
+  stats.addPhase("export", exportStart);
+  if (memStats)
+    memStats->addPhase("export", exportSnapshot,
+                       MemorySnapshot::take(module.get(), false));
+  stats.setCounter("bytes.emitted", os.tell() - startPos);
+  if (outputFormat == OutputVerilog && lowerToRTL) {
+    stats.setCounter("verilog.expression-wires.baseline",
+                     verilogStats.numExpressionWiresWithoutInlining);
+    stats.setCounter("verilog.expression-wires",
+                     verilogStats.numExpressionWires);
+  }
+
+  // Tear down the IR as part of the report, it is not free for big designs.
+  auto teardownStart = CompileStats::Clock::now();
+  MemorySnapshot teardownSnapshot;
+  if (memStats)
+    teardownSnapshot = MemorySnapshot::take(nullptr);
+  module = nullptr;
+  stats.addPhase("teardown", teardownStart);
+  if (memStats)
+    memStats->addPhase("teardown", teardownSnapshot,
+                       MemorySnapshot::take(nullptr));
+  return result;
+}
+
+/// Process the buffers of the input.  Several buffers are parsed and linked
+/// into the circuit of the first one.
+static LogicalResult
+processBuffer(std::vector<std::unique_ptr<llvm::MemoryBuffer>> ownedBuffers,
+              raw_ostream &os) {
+  MLIRContext context;
+
+  // Register our dialects.
+  context.loadDialect<firrtl::FIRRTLDialect, rtl::RTLDialect, sv::SVDialect>();
+
+  // The parser only reads the main buffer of a source manager, so every linked
+  // input gets its own.  The diagnostics of all of them are reported through
+  // the first one, which refers to the other buffers without owning them.
+  llvm::SourceMgr sourceMgr;
+  std::vector<std::unique_ptr<llvm::SourceMgr>> linkedSourceMgrs;
+  if (ownedBuffers.size() > 1) {
+    for (auto &buffer : ownedBuffers) {
+      sourceMgr.AddNewSourceBuffer(
+          llvm::MemoryBuffer::getMemBuffer(buffer->getMemBufferRef(),
+                                           /*RequiresNullTerminator=*/false),
+          llvm::SMLoc());
+      linkedSourceMgrs.push_back(std::make_unique<llvm::SourceMgr>());
+      linkedSourceMgrs.back()->AddNewSourceBuffer(std::move(buffer),
+                                                  llvm::SMLoc());
+    }
+  } else {
+    sourceMgr.AddNewSourceBuffer(std::move(ownedBuffers[0]), llvm::SMLoc());
   }
+  SourceMgrDiagnosticHandler sourceMgrHandler(sourceMgr, &context);
+
+  // The lowering to RTL processes modules in parallel, but nothing in the
+  // parser or the emitter is threaded unless module bodies or several inputs
+  // are parsed, or modules emitted, in parallel.  Disable synchronization
+  // overhead otherwise.
+  if (numThreads == 1 || (!lowerToRTL && !parseInParallel && !emitInParallel &&
+                          linkedSourceMgrs.empty()))
+    context.disableMultithreading();
+
+  // Apply any pass manager command line options.
+  PassManager pm(&context);
+  pm.enableVerifier(true);
+  applyPassManagerCLOptions(pm);
+
+  // The memory report is printed once the pass manager is destroyed.
+  MemoryStats *memStats = applyMemoryStatsCLOptions(pm);
+
+  CompileStats stats;
+  if (timing)
+    pm.addInstrumentation(std::make_unique<PassTimer>(stats));
+  auto result = processInput(context, sourceMgr, linkedSourceMgrs, pm, stats,
+                             memStats, os);
+  if (timing)
+    stats.print(llvm::errs(), timingFormat);
+  return result;
+}
+
+namespace {
+/// Caches the Verilog emitted for each module of a streamed circuit.  A module
+/// is streamed along with declarations of the modules it instantiates, so its
+/// IR, printed with locations, covers both its body and the signatures it
+/// depends on.  The key hashes that with the pipeline, which holds all options
+/// that affect the lowering, and the build of firtool, which determines how
+/// the lowering and emission behave.
+class ModuleCache {
+public:
+  ModuleCache(StringRef directory, PassManager &pm)
+      : directory(directory) {
+    llvm::raw_string_ostream os(config);
+    os << "firtool-module-cache-v1\n";
+    os << "llvm: " << LLVM_VERSION_STRING << '\n';
+    // Identify the build of firtool by its executable.
+    auto tool = llvm::sys::fs::getMainExecutable(
+        nullptr, reinterpret_cast<void *>(&addRTLLoweringPasses));
+    llvm::sys::fs::file_status status;
+    if (!llvm::sys::fs::status(tool, status))
+      os << "tool: " << tool << ' ' << status.getSize() << ' '
+         << status.getLastModificationTime().time_since_epoch().count()
+         << '\n';
+    pm.printAsTextualPipeline(os);
+    os << '\n';
+  }
+
+  /// Return the path of the cache entry for 'module'.  'withHeader' is set if
+  /// the Verilog of the module starts with the file header.
+  std::string getEntryPath(ModuleOp module, bool withHeader) {
+    llvm::raw_sha1_ostream hash;
+    hash << config << withHeader << '\n';
+    module->print(hash, OpPrintingFlags().enableDebugInfo());
+    SmallString<128> path(directory);
+    llvm::sys::path::append(path, llvm::toHex(hash.sha1(), true) + ".v");
+    return std::string(path);
+  }
+
+  /// Return the cached Verilog at 'path', or null if there is none.
+  std::unique_ptr<llvm::MemoryBuffer> lookup(StringRef path) {
+    auto buffer = llvm::MemoryBuffer::getFile(path);
+    if (!buffer)
+      return nullptr;
+    return std::move(*buffer);
+  }
+
+  /// Store 'verilog' at 'path'.  The entry is written to a temporary file and
+  /// renamed, so a concurrent or interrupted run never sees half an entry.
+  /// Failures are not fatal, the module is just emitted again next time.
+  void store(StringRef path, StringRef verilog) {
+    if (llvm::sys::fs::create_directories(directory))
+      return;
+    int fd;
+    SmallString<128> tempPath;
+    if (llvm::sys::fs::createUniqueFile(Twine(path) + ".tmp-%%%%%%%%", fd,
+                                        tempPath))
+      return;
+    {
+      llvm::raw_fd_ostream os(fd, /*shouldClose=*/true);
+      os << verilog;
+      if (os.has_error()) {
+        os.clear_error();
+        llvm::sys::fs::remove(tempPath);
+        return;
+      }
+    }
+    if (llvm::sys::fs::rename(tempPath, path))
+      llvm::sys::fs::remove(tempPath);
+  }
+
+private:
+  std::string directory;
+  std::string config;
 };
+} // end anonymous namespace
+
+/// Process a .fir buffer one module at a time.  Each module is lowered and
+/// emitted as Verilog before the next one is parsed.
+static LogicalResult
+streamBuffer(std::unique_ptr<llvm::MemoryBuffer> ownedBuffer, raw_ostream &os) {
+  MLIRContext context;
+
+  // Register our dialects.
+  context.loadDialect<firrtl::FIRRTLDialect, rtl::RTLDialect, sv::SVDialect>();
+
+  llvm::SourceMgr sourceMgr;
+  sourceMgr.AddNewSourceBuffer(std::move(ownedBuffer), llvm::SMLoc());
+  SourceMgrDiagnosticHandler sourceMgrHandler(sourceMgr, &context);
+
+  if (numThreads == 1)
+    context.disableMultithreading();
+
+  // Apply any pass manager command line options.
+  PassManager pm(&context);
+  pm.enableVerifier(true);
+  applyPassManagerCLOptions(pm);
+
+  // Lowering requires all the widths, compute any that were left out.
+  pm.nest<firrtl::CircuitOp>().addPass(firrtl::createInferWidthsPass());
+  if (!disableOptimization)
+    addFIRRTLCleanupPasses(pm);
+  if (enableLowerTypes)
+    pm.nest<firrtl::CircuitOp>().nest<firrtl::FModuleOp>().addPass(
+        firrtl::createLowerFIRRTLTypesPass());
+  addRTLLoweringPasses(pm);
+
+  Optional<ModuleCache> cache;
+  if (!moduleCache.empty())
+    cache.emplace(moduleCache, pm);
+
+  bool emittedHeader = false;
+  auto processModule = [&](ModuleOp module, StringRef moduleName) {
+    // Modules that didn't change are not lowered again.  The whole circuit is
+    // handed over at once if it can't be split, which isn't worth caching.
+    std::string cachePath;
+    if (cache && !moduleName.empty()) {
+      cachePath = cache->getEntryPath(module, !emittedHeader);
+      if (auto cached = cache->lookup(cachePath)) {
+        os << cached->getBuffer();
+        emittedHeader = true;
+        return success();
+      }
+    }
+
+    if (failed(pm.run(module)))
+      return failure();
+
+    // The other modules are only declarations of the modules instantiated by
+    // this one, and every module gets a copy of the file header.  Only emit
+    // the header once.
+    if (!moduleName.empty()) {
+      for (auto &op : llvm::make_early_inc_range(*module.getBody())) {
+        if (isa<rtl::RTLModuleOp, rtl::RTLExternModuleOp>(op)) {
+          auto name =
+              op.getAttrOfType<StringAttr>(SymbolTable::getSymbolAttrName());
+          if (name.getValue() != moduleName)
+            op.erase();
+        } else if (emittedHeader && !isa<ModuleTerminatorOp>(op)) {
+          op.erase();
+        }
+      }
+    }
+    emittedHeader = true;
+    if (cachePath.empty())
+      return exportVerilog(module, os);
+
+    std::string verilog;
+    llvm::raw_string_ostream verilogOS(verilog);
+    if (failed(exportVerilog(module, verilogOS)))
+      return failure();
+    os << verilogOS.str();
+    cache->store(cachePath, verilog);
+    return success();
+  };
+
+  firrtl::FIRParserOptions options;
+  options.ignoreInfoLocators = ignoreFIRLocations;
+  return firrtl::importFIRRTLStreaming(sourceMgr, &context, processModule,
+                                       options);
+}
+
+/// Lex a .fir buffer and report how fast the lexer went.
+static LogicalResult benchmarkLexing(std::unique_ptr<llvm::MemoryBuffer> buffer,
+                                     raw_ostream &os) {
+  MLIRContext context;
+  llvm::SourceMgr sourceMgr;
+  size_t numBytes = buffer->getBufferSize();
+  sourceMgr.AddNewSourceBuffer(std::move(buffer), llvm::SMLoc());
+  SourceMgrDiagnosticHandler sourceMgrHandler(sourceMgr, &context);
+
+  auto start = std::chrono::steady_clock::now();
+  auto numTokens = firrtl::lexFIRRTL(sourceMgr, &context);
+  std::chrono::duration<double> seconds =
+      std::chrono::steady_clock::now() - start;
+  if (!numTokens)
+    return failure();
+
+  os << "tokens: " << *numTokens << "\n";
+  os << "bytes: " << numBytes << "\n";
+  os << "seconds: " << seconds.count() << "\n";
+  os << "tokens/sec: " << uint64_t(*numTokens / seconds.count()) << "\n";
+  os << "MB/sec: " << numBytes / seconds.count() / 1e6 << "\n";
+  return success();
+}
 
 int main(int argc, char **argv) {
   InitLLVM y(argc, argv);
@@ -161,15 +895,26 @@ int main(int argc, char **argv) {
   // Register any pass manager command line options.
   registerMLIRContextCLOptions();
   registerPassManagerCLOptions();
+  registerMemoryStatsCLOptions();
 
   // Parse pass names in main to ensure static initialization completed.
   cl::ParseCommandLineOptions(argc, argv, "circt modular optimizer driver\n");
 
+  // The pass manager, the parser and the emitter all parallelize through LLVM's
+  // parallel algorithms, which share one pool sized by this strategy.
+  if (numThreads)
+    llvm::parallel::strategy = llvm::hardware_concurrency(numThreads);
+
+  if (inputFilenames.empty())
+    inputFilenames.push_back("-");
+  StringRef inputFilename = inputFilenames.front();
+
   // Figure out the input format if unspecified.
   if (inputFormat == InputUnspecified) {
-    if (StringRef(inputFilename).endswith(".fir"))
+    if (inputFilename.endswith(".fir"))
       inputFormat = InputFIRFile;
-    else if (StringRef(inputFilename).endswith(".mlir"))
+    else if (inputFilename.endswith(".mlir") ||
+             inputFilename.endswith(".mlirbc"))
       inputFormat = InputMLIRFile;
     else {
       llvm::errs() << "unknown input format: "
@@ -178,22 +923,91 @@ int main(int argc, char **argv) {
     }
   }
 
-  // Set up the input file.
+  if (inputFilenames.size() > 1 &&
+      (inputFormat != InputFIRFile || streamModules || benchmarkLexer)) {
+    llvm::errs() << "several inputs require .fir files, and are not supported "
+                    "with -stream-modules\n";
+    exit(1);
+  }
+
+  if (streamModules && (inputFormat != InputFIRFile || !lowerToRTL ||
+                        outputFormat != OutputVerilog)) {
+    llvm::errs() << "-stream-modules requires a .fir input, -lower-to-rtl and "
+                    "-verilog\n";
+    exit(1);
+  }
+  if (splitVerilog && (!lowerToRTL || outputFormat != OutputVerilog ||
+                       streamModules || outputFilename == "-")) {
+    llvm::errs() << "-split-verilog requires -lower-to-rtl, -verilog and an "
+                    "output directory, and is not supported with "
+                    "-stream-modules\n";
+    exit(1);
+  }
+  if ((dedup || removeDeadCode || propagateConstants) &&
+      (!lowerToRTL || streamModules)) {
+    llvm::errs() << "-dedup, -remove-dead-code and -imconstprop require "
+                    "-lower-to-rtl, and are not supported with "
+                    "-stream-modules\n";
+    exit(1);
+  }
+  // Memory macros are collected over the whole circuit, which a stream of
+  // modules never is.
+  if ((memMacroThreshold || !memMacroConf.empty()) && streamModules) {
+    llvm::errs() << "-mem-macro-threshold and -mem-macro-conf are not "
+                    "supported with -stream-modules\n";
+    exit(1);
+  }
+  if (!moduleCache.empty() && !streamModules) {
+    llvm::errs() << "-module-cache requires -stream-modules\n";
+    exit(1);
+  }
+  if (streamModules && (timing || isMemoryStatsEnabled())) {
+    llvm::errs() << "-timing and -memory-stats are not supported with "
+                    "-stream-modules\n";
+    exit(1);
+  }
+
+  // Set up the input files.  Large files are memory mapped rather than read.
   std::string errorMessage;
-  auto input = openInputFile(inputFilename, &errorMessage);
-  if (!input) {
-    llvm::errs() << errorMessage << "\n";
-    return 1;
+  std::vector<std::unique_ptr<llvm::MemoryBuffer>> inputs;
+  for (auto &filename : inputFilenames) {
+    inputs.push_back(openInputFile(filename, &errorMessage));
+    if (!inputs.back()) {
+      llvm::errs() << errorMessage << "\n";
+      return 1;
+    }
   }
 
+  // In split mode the output is a directory that is written by the emitter.
+  if (splitVerilog)
+    return failed(processBuffer(std::move(inputs), llvm::nulls()));
+
   auto output = openOutputFile(outputFilename, &errorMessage);
   if (!output) {
     llvm::errs() << errorMessage << "\n";
     return 1;
   }
 
-  if (failed(processBuffer(std::move(input), output->os())))
-    return 1;
+  if (benchmarkLexer) {
+    if (failed(benchmarkLexing(std::move(inputs[0]), output->os())))
+      return 1;
+    output->keep();
+    return 0;
+  }
+
+  // The emitters write many small pieces, hand them to a writer thread in
+  // large chunks so that the emission doesn't wait for the file system.
+  {
+    Optional<AsyncOutputStream> asyncOS;
+    raw_ostream *os = &output->os();
+    if (asyncOutput && numThreads != 1) {
+      asyncOS.emplace(output->os());
+      os = &*asyncOS;
+    }
+    if (failed(streamModules ? streamBuffer(std::move(inputs[0]), *os)
+                             : processBuffer(std::move(inputs), *os)))
+      return 1;
+  }
 
   output->keep();
   return 0;
@@ -14,7 +14,9 @@
 #include <stdio.h>
 
 #include <algorithm>
-#include <list>
+#include <atomic>
+#include <cstring>
+#include <deque>
 #include <map>
 #include <memory>
 #include <sstream>
@@ -25,16 +27,25 @@
 #include "mlir/IR/BuiltinOps.h"
 #include "mlir/IR/MLIRContext.h"
 #include "mlir/Parser.h"
+#include "mlir/Support/FileUtilities.h"
 #include "llvm/ADT/APFloat.h"
 #include "llvm/ADT/APInt.h"
 #include "llvm/ADT/Any.h"
+#include "llvm/ADT/BitVector.h"
 #include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/Support/Format.h"
 #include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MathExtras.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/SMLoc.h"
 #include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/ToolOutputFile.h"
 
 #include "circt/Dialect/Handshake/HandshakeOps.h"
 
@@ -63,6 +74,49 @@ static opt<bool> runStats("runStats", cl::Optional,
                           cl::desc("Print Execution Statistics"),
                           cl::init(false), cl::cat(mainCategory));
 
+static opt<std::string>
+    batchFileName("batch", cl::Optional,
+                  cl::desc("Run the toplevel function once for every line of "
+                           "the specified file, which holds whitespace "
+                           "separated arguments, or '-' for stdin"),
+                  cl::value_desc("filename"), cl::cat(mainCategory));
+
+static opt<unsigned> numThreads(
+    "threads", cl::Optional,
+    cl::desc("The number of threads to use in batch mode, 0 for all cores.  "
+             "Outside of batch mode, more than one thread executes the "
+             "independent operations of handshake functions concurrently"),
+    cl::init(0), cl::cat(mainCategory));
+
+static opt<unsigned> minParallelOps(
+    "min-parallel-ops", cl::Optional, cl::Hidden,
+    cl::desc("With more than one thread outside of batch mode, the number of "
+             "independent operations below which a step executes them on the "
+             "calling thread, which is cheaper than handing them to the "
+             "workers"),
+    cl::init(64), cl::cat(mainCategory));
+
+static opt<bool> cycleAccurate(
+    "cycleAccurate", cl::Optional,
+    cl::desc("Simulate handshake functions cycle by cycle, modeling buffer "
+             "capacities, backpressure and memory ports, and report stalls"),
+    cl::init(false), cl::cat(mainCategory));
+
+static opt<std::string> channelStatsFileName(
+    "channelStats", cl::Optional,
+    cl::desc("With -cycleAccurate, write the token and blocked cycle counts "
+             "of every channel and the firing count of every operation to the "
+             "specified file.  Files ending in '.dot' get an annotated graph "
+             "highlighting the hot channels, '.json' files get JSON and other "
+             "files get CSV"),
+    cl::value_desc("filename"), cl::cat(mainCategory));
+
+static opt<bool>
+    compile("compile", cl::Optional,
+            cl::desc("Compile standard dialect functions to bytecode instead "
+                     "of interpreting them"),
+            cl::init(false), cl::cat(mainCategory));
+
 STATISTIC(instructionsExecuted, "Instructions Executed");
 STATISTIC(simulatedTime, "Simulated Time");
 // static int instructionsExecuted = 0;
@@ -99,7 +153,7 @@ void executeOp(mlir::SubIOp op, std::vector<Any> &in, std::vector<Any> &out) {
   out[0] = any_cast<APInt>(in[0]) - any_cast<APInt>(in[1]);
 }
 void executeOp(mlir::SubFOp op, std::vector<Any> &in, std::vector<Any> &out) {
-  out[0] = any_cast<APFloat>(in[0]) + any_cast<APFloat>(in[1]);
+  out[0] = any_cast<APFloat>(in[0]) - any_cast<APFloat>(in[1]);
 }
 void executeOp(mlir::MulIOp op, std::vector<Any> &in, std::vector<Any> &out) {
   out[0] = any_cast<APInt>(in[0]) * any_cast<APInt>(in[1]);
@@ -135,12 +189,154 @@ void executeOp(mlir::ZeroExtendIOp op, std::vector<Any> &in,
   out[0] = any_cast<APInt>(in[0]).zext(width);
 }
 
+static double convertToDouble(APFloat value) {
+  bool losesInfo;
+  value.convert(APFloat::IEEEdouble(), APFloat::rmNearestTiesToEven,
+                &losesInfo);
+  return value.convertToDouble();
+}
+
+namespace {
+/// The memory allocated for one memref.  The elements are stored back to back
+/// as raw bits, each taking the size of its type rounded up to a power of two
+/// bytes, so that integers of up to 64 bits and floats are loaded and stored
+/// as native values.  Wider integers take whole 64 bit words.
+class MemRefBuffer {
+public:
+  MemRefBuffer(mlir::Type elementType, size_t size);
+
+  size_t size() const { return numElements; }
+
+  APInt loadInt(size_t index) const;
+  void storeInt(size_t index, const APInt &value);
+  double loadFloat(size_t index) const;
+  void storeFloat(size_t index, double value);
+
+  /// Load or store an element in the form the interpreters pass values
+  /// around.
+  Any load(size_t index) const {
+    if (!isFloat)
+      return loadInt(index);
+    if (width == 32)
+      return APFloat(float(loadFloat(index)));
+    return APFloat(loadFloat(index));
+  }
+  void store(size_t index, const Any &value) {
+    if (isFloat)
+      storeFloat(index, convertToDouble(any_cast<APFloat>(value)));
+    else
+      storeInt(index, any_cast<APInt>(value));
+  }
+
+private:
+  const char *getElement(size_t index) const {
+    assert(index < numElements && "out of bounds memref access");
+    return data.data() + index * stride;
+  }
+  char *getElement(size_t index) {
+    assert(index < numElements && "out of bounds memref access");
+    return data.data() + index * stride;
+  }
+
+  unsigned width;
+  bool isFloat;
+  /// The number of bytes taken by each element.
+  unsigned stride;
+  size_t numElements;
+  std::vector<char> data;
+};
+} // end anonymous namespace
+
+MemRefBuffer::MemRefBuffer(mlir::Type elementType, size_t size)
+    : numElements(size) {
+  if (!elementType.isa<mlir::IntegerType, mlir::FloatType>())
+    llvm_unreachable("Unknown result type!\n");
+  width = elementType.getIntOrFloatBitWidth();
+  isFloat = elementType.isa<mlir::FloatType>();
+  assert((!isFloat || width == 32 || width == 64) &&
+         "only f32 and f64 memrefs are supported");
+  stride = width <= 64 ? PowerOf2Ceil(alignTo(width, 8) / 8)
+                       : alignTo(width, 64) / 8;
+  data.resize(numElements * stride);
+}
+
+template <typename T>
+static uint64_t loadNative(const char *ptr) {
+  T value;
+  std::memcpy(&value, ptr, sizeof(T));
+  return value;
+}
+
+template <typename T>
+static void storeNative(char *ptr, uint64_t value) {
+  T narrowed = value;
+  std::memcpy(ptr, &narrowed, sizeof(T));
+}
+
+APInt MemRefBuffer::loadInt(size_t index) const {
+  const char *element = getElement(index);
+  switch (stride) {
+  case 1:
+    return APInt(width, loadNative<uint8_t>(element));
+  case 2:
+    return APInt(width, loadNative<uint16_t>(element));
+  case 4:
+    return APInt(width, loadNative<uint32_t>(element));
+  case 8:
+    return APInt(width, loadNative<uint64_t>(element));
+  }
+  SmallVector<uint64_t, 4> words(stride / 8);
+  std::memcpy(words.data(), element, stride);
+  return APInt(width, words);
+}
+
+void MemRefBuffer::storeInt(size_t index, const APInt &value) {
+  assert(value.getBitWidth() == width && "stored value has the wrong width");
+  char *element = getElement(index);
+  switch (stride) {
+  case 1:
+    return storeNative<uint8_t>(element, value.getZExtValue());
+  case 2:
+    return storeNative<uint16_t>(element, value.getZExtValue());
+  case 4:
+    return storeNative<uint32_t>(element, value.getZExtValue());
+  case 8:
+    return storeNative<uint64_t>(element, value.getZExtValue());
+  }
+  std::memcpy(element, value.getRawData(), stride);
+}
+
+double MemRefBuffer::loadFloat(size_t index) const {
+  const char *element = getElement(index);
+  if (width == 32) {
+    float value;
+    std::memcpy(&value, element, sizeof(float));
+    return value;
+  }
+  double value;
+  std::memcpy(&value, element, sizeof(double));
+  return value;
+}
+
+void MemRefBuffer::storeFloat(size_t index, double value) {
+  char *element = getElement(index);
+  if (width == 32) {
+    float narrowed = value;
+    std::memcpy(element, &narrowed, sizeof(float));
+    return;
+  }
+  std::memcpy(element, &value, sizeof(double));
+}
+
+/// The memrefs allocated by a run, indexed by the pseudo-pointers the
+/// interpreters pass around for them.
+using MemRefStore = std::vector<MemRefBuffer>;
+
 // Allocate a new matrix with dimensions given by the type, in the
 // given store.  Return the pseuddo-pointer to the new matrix in the
 // store (i.e. the first dimension index)
 unsigned allocateMemRef(mlir::MemRefType type, std::vector<Any> &in,
-                        std::vector<std::vector<Any>> &store,
-                        std::vector<double> &storeTimes) {
+                        MemRefStore &store, std::vector<double> &storeTimes) {
   ArrayRef<int64_t> shape = type.getShape();
   int allocationSize = 1;
   unsigned count = 0;
@@ -153,26 +349,13 @@ unsigned allocateMemRef(mlir::MemRefType type, std::vector<Any> &in,
     }
   }
   unsigned ptr = store.size();
-  store.resize(ptr + 1);
-  storeTimes.resize(ptr + 1);
-  store[ptr].resize(allocationSize);
-  storeTimes[ptr] = 0.0;
-  mlir::Type elementType = type.getElementType();
-  int width = elementType.getIntOrFloatBitWidth();
-  for (int i = 0; i < allocationSize; i++) {
-    if (elementType.isa<mlir::IntegerType>()) {
-      store[ptr][i] = APInt(width, 0);
-    } else if (elementType.isa<mlir::FloatType>()) {
-      store[ptr][i] = APFloat(0.0);
-    } else {
-      llvm_unreachable("Unknown result type!\n");
-    }
-  }
+  store.emplace_back(type.getElementType(), allocationSize);
+  storeTimes.push_back(0.0);
   return ptr;
 }
 
 void executeOp(mlir::LoadOp op, std::vector<Any> &in, std::vector<Any> &out,
-               std::vector<std::vector<Any>> &store) {
+               MemRefStore &store) {
   ArrayRef<int64_t> shape = op.getMemRefType().getShape();
   unsigned address = 0;
   for (unsigned i = 0; i < shape.size(); i++) {
@@ -184,12 +367,11 @@ void executeOp(mlir::LoadOp op, std::vector<Any> &in, std::vector<Any> &out,
   assert(address < ref.size());
   //  LLVM_DEBUG(dbgs() << "Load " << ref[address] << " from " << ptr << "[" <<
   //  address << "]\n");
-  Any result = ref[address];
-  out[0] = result;
+  out[0] = ref.load(address);
 }
 
 void executeOp(mlir::StoreOp op, std::vector<Any> &in, std::vector<Any> &out,
-               std::vector<std::vector<Any>> &store) {
+               MemRefStore &store) {
   ArrayRef<int64_t> shape = op.getMemRefType().getShape();
   unsigned address = 0;
   for (unsigned i = 0; i < shape.size(); i++) {
@@ -201,7 +383,7 @@ void executeOp(mlir::StoreOp op, std::vector<Any> &in, std::vector<Any> &out,
   //  LLVM_DEBUG(dbgs() << "Store " << in[0] << " to " << ptr << "[" << address
   //  << "]\n");
   assert(address < ref.size());
-  ref[address] = in[0];
+  ref.store(address, in[0]);
 }
 
 void executeOp(handshake::ForkOp op, std::vector<Any> &in,
@@ -220,7 +402,7 @@ void executeOp(handshake::ConstantOp op, std::vector<Any> &in,
   out[0] = attr.getValue();
 }
 void executeOp(handshake::StoreOp op, std::vector<Any> &in,
-               std::vector<Any> &out, std::vector<std::vector<Any>> &store) {
+               std::vector<Any> &out, MemRefStore &store) {
   // Forward the address and data to the memory op.
   out[0] = in[0];
   out[1] = in[1];
@@ -299,7 +481,7 @@ std::string printAnyValueWithType(mlir::Type type, Any &value) {
     out << any_cast<APInt>(value).getSExtValue();
     return out.str();
   } else if (type.isa<mlir::FloatType>()) {
-    out << any_cast<APFloat>(value).convertToDouble();
+    out << convertToDouble(any_cast<APFloat>(value));
     return out.str();
   } else if (type.isa<mlir::NoneType>()) {
     return "none";
@@ -308,19 +490,101 @@ std::string printAnyValueWithType(mlir::Type type, Any &value) {
   }
 }
 
-void scheduleIfNeeded(std::list<mlir::Operation *> &readyList,
-                      llvm::DenseMap<mlir::Value, Any> &valueMap,
-                      mlir::Operation *op) {
-  if (std::find(readyList.begin(), readyList.end(), op) == readyList.end()) {
-    readyList.push_back(op);
+namespace {
+/// The operations of a handshake function which might be ready to execute, in
+/// the order they were scheduled.  Operations are identified by their position
+/// in the function and are in the list at most once.  The users of every
+/// result are computed up front, so scheduling costs constant time per use.
+class ReadyList {
+public:
+  explicit ReadyList(mlir::Block &block);
+
+  bool empty() const { return queue.empty(); }
+  size_t size() const { return queue.size(); }
+
+  /// Remove the next operation from the list and return it.
+  mlir::Operation &pop();
+
+  /// Add the operation that was popped last back to the end of the list.
+  void reschedule() { schedule(current); }
+
+  /// Add the users of the specified value to the list.
+  void scheduleUses(mlir::Value value);
+
+  void print(raw_ostream &os) const;
+
+private:
+  void schedule(unsigned index) {
+    if (inQueue.test(index))
+      return;
+    inQueue.set(index);
+    queue.push_back(index);
+  }
+
+  std::vector<mlir::Operation *> ops;
+  llvm::DenseMap<mlir::Operation *, unsigned> opIndices;
+
+  /// The users of result 'r' of operation 'i' are the entries
+  /// [userBegins[k], userBegins[k + 1]) of 'users', with
+  /// k = resultBegins[i] + r.
+  std::vector<unsigned> resultBegins;
+  std::vector<unsigned> userBegins;
+  std::vector<unsigned> users;
+
+  std::deque<unsigned> queue;
+  llvm::BitVector inQueue;
+  /// The operation that was popped last.
+  unsigned current = 0;
+};
+} // end anonymous namespace
+
+ReadyList::ReadyList(mlir::Block &block) {
+  for (auto &op : block) {
+    opIndices[&op] = ops.size();
+    ops.push_back(&op);
   }
+  inQueue.resize(ops.size());
+
+  for (auto *op : ops) {
+    resultBegins.push_back(userBegins.size());
+    for (auto result : op->getResults()) {
+      userBegins.push_back(users.size());
+      for (auto *user : result.getUsers()) {
+        assert(opIndices.count(user) && "user outside of the function body");
+        users.push_back(opIndices.lookup(user));
+      }
+    }
+  }
+  userBegins.push_back(users.size());
 }
-void scheduleUses(std::list<mlir::Operation *> &readyList,
-                  llvm::DenseMap<mlir::Value, Any> &valueMap,
-                  mlir::Value value) {
-  for (auto &use : value.getUses()) {
-    scheduleIfNeeded(readyList, valueMap, use.getOwner());
+
+mlir::Operation &ReadyList::pop() {
+  assert(!queue.empty());
+  current = queue.front();
+  queue.pop_front();
+  inQueue.reset(current);
+  return *ops[current];
+}
+
+void ReadyList::scheduleUses(mlir::Value value) {
+  // Results use the precomputed lists.  Only those of operations other than
+  // the current one need to look up their owner.
+  if (auto result = value.dyn_cast<mlir::OpResult>()) {
+    mlir::Operation *owner = result.getOwner();
+    unsigned index = owner == ops[current] ? current : opIndices.lookup(owner);
+    unsigned k = resultBegins[index] + result.getResultNumber();
+    for (unsigned i = userBegins[k], e = userBegins[k + 1]; i != e; ++i)
+      schedule(users[i]);
+    return;
   }
+
+  for (auto *user : value.getUsers())
+    schedule(opIndices.lookup(user));
+}
+
+void ReadyList::print(raw_ostream &os) const {
+  for (unsigned index : queue)
+    os << "READY: " << *ops[index] << "\n";
 }
 
 bool executeStdOp(mlir::Operation &op, std::vector<Any> &inValues,
@@ -367,7 +631,7 @@ void executeFunction(mlir::FuncOp &toplevel,
                      llvm::DenseMap<mlir::Value, double> &timeMap,
                      std::vector<Any> &results,
                      std::vector<double> &resultTimes,
-                     std::vector<std::vector<Any>> &store,
+                     MemRefStore &store,
                      std::vector<double> &storeTimes) {
   mlir::Block &entryBlock = toplevel.getBody().front();
   // An iterator which walks over the instructions.
@@ -468,7 +732,7 @@ void executeFunction(mlir::FuncOp &toplevel,
         llvm::DenseMap<mlir::Value, double> newTimeMap;
         std::vector<Any> results(outputs);
         std::vector<double> resultTimes(outputs);
-        std::vector<std::vector<Any>> store;
+        MemRefStore store;
         std::vector<double> storeTimes;
         mlir::Block &entryBlock = funcOp.getBody().front();
         mlir::Block::BlockArgListType blockArgs = entryBlock.getArguments();
@@ -505,29 +769,120 @@ void executeFunction(mlir::FuncOp &toplevel,
   }
 }
 
+/// Execute a handshake operation whose results only depend on its operands.
+/// This doesn't touch any state shared with other operations, so that it can
+/// run on any thread.
+static void executePureOp(mlir::Operation &op, std::vector<Any> &inValues,
+                          std::vector<Any> &outValues, MemRefStore &store) {
+  if (executeStdOp(op, inValues, outValues)) {
+  } else if (auto Op = dyn_cast<handshake::StartOp>(op)) {
+  } else if (auto Op = dyn_cast<handshake::EndOp>(op)) {
+  } else if (auto Op = dyn_cast<handshake::SinkOp>(op)) {
+  } else if (auto Op = dyn_cast<handshake::ForkOp>(op))
+    executeOp(Op, inValues, outValues);
+  else if (auto Op = dyn_cast<handshake::JoinOp>(op))
+    executeOp(Op, inValues, outValues);
+  else if (auto Op = dyn_cast<handshake::ConstantOp>(op))
+    executeOp(Op, inValues, outValues);
+  else if (auto Op = dyn_cast<handshake::StoreOp>(op))
+    executeOp(Op, inValues, outValues, store);
+  else if (auto Op = dyn_cast<handshake::BranchOp>(op))
+    executeOp(Op, inValues, outValues);
+  else
+    llvm_unreachable("Unknown operation!\n");
+}
+
+namespace {
+/// An operation whose inputs were consumed, waiting to compute its results at
+/// the end of the current step.
+struct PendingOp {
+  mlir::Operation *op;
+  std::vector<Any> inValues;
+  std::vector<Any> outValues;
+  double time;
+};
+} // end anonymous namespace
+
 void executeHandshakeFunction(handshake::FuncOp &toplevel,
                               llvm::DenseMap<mlir::Value, Any> &valueMap,
                               llvm::DenseMap<mlir::Value, double> &timeMap,
                               std::vector<Any> &results,
                               std::vector<double> &resultTimes,
-                              std::vector<std::vector<Any>> &store,
-                              std::vector<double> &storeTimes) {
+                              MemRefStore &store,
+                              std::vector<double> &storeTimes,
+                              ThreadPool *threadPool) {
   mlir::Block &entryBlock = toplevel.getBody().front();
   // The arguments of the entry block.
   mlir::Block::BlockArgListType blockArgs = entryBlock.getArguments();
   // A list of operations which might be ready to execute.
-  std::list<mlir::Operation *> readyList;
+  ReadyList readyList(entryBlock);
+  // The buffer allocated for each MemoryOp, by ID.
+  llvm::DenseMap<unsigned, unsigned> idToBuffer;
 
   for (unsigned i = 0; i < blockArgs.size(); i++) {
-    scheduleUses(readyList, valueMap, blockArgs[i]);
+    readyList.scheduleUses(blockArgs[i]);
   }
+
+  // Record the results of an executed operation and schedule their users.
+  auto publishResults = [&](mlir::Operation &op, std::vector<Any> &outValues,
+                            double time) {
+    unsigned i = 0;
+    for (mlir::Value out : op.getResults()) {
+      LLVM_DEBUG(debugArg("OUT", out, outValues[i], time));
+      assert(outValues[i].hasValue());
+      valueMap[out] = std::move(outValues[i]);
+      timeMap[out] = time + 1;
+      readyList.scheduleUses(out);
+      i++;
+    }
+    instructionsExecuted++;
+  };
+
+  // With a thread pool, the operations are executed in steps.  The ones in
+  // the list at the start of a step are visited in order, and those which are
+  // ready consume their inputs right away.  Merges, branches and memories also
+  // produce their results right away, but the operations which only compute
+  // their results from their operands are deferred to the end of the step and
+  // run concurrently.  Their results are then published in the order they were
+  // visited, so that runs don't depend on the number of threads.
+  std::vector<PendingOp> pending;
+  size_t remainingInStep = 0;
+  auto runPending = [&]() {
+    size_t numChunks = 1;
+    if (pending.size() >= minParallelOps)
+      numChunks = std::min<size_t>(threadPool->getThreadCount(),
+                                   pending.size());
+    auto runChunk = [&](size_t chunk) {
+      size_t begin = pending.size() * chunk / numChunks;
+      size_t end = pending.size() * (chunk + 1) / numChunks;
+      for (size_t i = begin; i != end; ++i)
+        executePureOp(*pending[i].op, pending[i].inValues,
+                      pending[i].outValues, store);
+    };
+    for (size_t chunk = 1; chunk < numChunks; ++chunk)
+      threadPool->async([&, chunk] { runChunk(chunk); });
+    runChunk(0);
+    if (numChunks > 1)
+      threadPool->wait();
+
+    for (auto &pendingOp : pending)
+      publishResults(*pendingOp.op, pendingOp.outValues, pendingOp.time);
+    pending.clear();
+  };
+
 #define EXTRA_DEBUG
   while (true) {
+    if (threadPool) {
+      if (remainingInStep == 0) {
+        runPending();
+        remainingInStep = readyList.size();
+      }
+      --remainingInStep;
+    }
 #ifdef EXTRA_DEBUG
     LLVM_DEBUG(
-        for (auto t
-             : readyList) { dbgs() << "READY: " << *t << "\n"; } dbgs()
-            << "Live: " << valueMap.size() << "\n";
+        readyList.print(dbgs());
+        dbgs() << "Live: " << valueMap.size() << "\n";
         for (auto t
              : valueMap) {
           debugArg("Value:", t.first, t.second, 0.0);
@@ -535,9 +890,8 @@ void executeHandshakeFunction(handshake::FuncOp &toplevel,
           //        "\n";
         });
 #endif
-    assert(readyList.size() > 0);
-    mlir::Operation &op = *readyList.front();
-    readyList.pop_front();
+    assert(!readyList.empty());
+    mlir::Operation &op = readyList.pop();
 
     /*    for(mlir::Value out : op.getResults()) {
       if(valueMap.count(out) != 0) {
@@ -560,11 +914,11 @@ void executeHandshakeFunction(handshake::FuncOp &toplevel,
           auto t = valueMap[in];
           valueMap[op.getResult(0)] = t;
           timeMap[op.getResult(0)] = timeMap[in];
-          scheduleUses(readyList, valueMap, op.getResult(0));
+          readyList.scheduleUses(op.getResult(0));
 
           valueMap[op.getResult(1)] = APInt(INDEX_WIDTH, i);
           timeMap[op.getResult(1)] = timeMap[in];
-          scheduleUses(readyList, valueMap, op.getResult(1));
+          readyList.scheduleUses(op.getResult(1));
 
           // Consume the inputs.
           valueMap.erase(in);
@@ -589,7 +943,7 @@ void executeHandshakeFunction(handshake::FuncOp &toplevel,
           auto t = valueMap[in];
           valueMap[op.getResult(0)] = t;
           timeMap[op.getResult(0)] = timeMap[in];
-          scheduleUses(readyList, valueMap, op.getResult(0));
+          readyList.scheduleUses(op.getResult(0));
 
           // Consume the inputs.
           valueMap.erase(in);
@@ -612,7 +966,7 @@ void executeHandshakeFunction(handshake::FuncOp &toplevel,
         LLVM_DEBUG(dbgs() << "OP:  " << op << "\n");
         LLVM_DEBUG(dbgs() << "Rescheduling control...\n");
 #endif
-        readyList.push_back(&op);
+        readyList.reschedule();
         continue;
       }
       auto controlValue = valueMap[control];
@@ -625,7 +979,7 @@ void executeHandshakeFunction(handshake::FuncOp &toplevel,
         LLVM_DEBUG(dbgs() << "Rescheduling data("
                           << any_cast<APInt>(controlValue) << ")...\n");
 #endif
-        readyList.push_back(&op);
+        readyList.reschedule();
         continue;
       }
       auto inValue = valueMap[in];
@@ -636,7 +990,7 @@ void executeHandshakeFunction(handshake::FuncOp &toplevel,
       double time = std::max(controlTime, inTime);
       valueMap[op.getResult(0)] = inValue;
       timeMap[op.getResult(0)] = time;
-      scheduleUses(readyList, valueMap, op.getResult(0));
+      readyList.scheduleUses(op.getResult(0));
 
       // Consume the inputs.
       valueMap.erase(control);
@@ -660,7 +1014,7 @@ void executeHandshakeFunction(handshake::FuncOp &toplevel,
         LLVM_DEBUG(dbgs() << "OP:  " << op << "\n");
         LLVM_DEBUG(dbgs() << "Rescheduling...\n");
 #endif
-        readyList.push_back(&op);
+        readyList.reschedule();
         continue;
       }
       if (valueMap.count(address) && valueMap.count(nonce)) {
@@ -674,7 +1028,7 @@ void executeHandshakeFunction(handshake::FuncOp &toplevel,
         valueMap[addressOut] = addressValue;
         double time = std::max(addressTime, nonceTime);
         timeMap[addressOut] = time;
-        scheduleUses(readyList, valueMap, addressOut);
+        readyList.scheduleUses(addressOut);
         // Consume the inputs.
         valueMap.erase(address);
         valueMap.erase(nonce);
@@ -685,7 +1039,7 @@ void executeHandshakeFunction(handshake::FuncOp &toplevel,
         LLVM_DEBUG(debugArg("Data", data, dataValue, dataTime));
         valueMap[dataOut] = dataValue;
         timeMap[dataOut] = dataTime;
-        scheduleUses(readyList, valueMap, dataOut);
+        readyList.scheduleUses(dataOut);
         // Consume the inputs.
         valueMap.erase(data);
       } else {
@@ -695,7 +1049,6 @@ void executeHandshakeFunction(handshake::FuncOp &toplevel,
     }
     // Special handling for non-total functions.
     if (auto Op = dyn_cast<handshake::MemoryOp>(op)) {
-      static llvm::DenseMap<unsigned, unsigned> idToBuffer;
       int opIndex = 0;
       bool notReady = false;
       LLVM_DEBUG(dbgs() << "OP:  " << op << "\n");
@@ -731,14 +1084,14 @@ void executeHandshakeFunction(handshake::FuncOp &toplevel,
         //  address << "]\n");
         unsigned offset = any_cast<APInt>(addressValue).getZExtValue();
         assert(offset < ref.size());
-        ref[offset] = dataValue;
+        ref.store(offset, dataValue);
 
         // Implicit none argument
         APInt apnonearg(1, 0);
         valueMap[nonceOut] = apnonearg;
         double time = std::max(addressTime, dataTime);
         timeMap[nonceOut] = time;
-        scheduleUses(readyList, valueMap, nonceOut);
+        readyList.scheduleUses(nonceOut);
         // Consume the inputs.
         valueMap.erase(data);
         valueMap.erase(address);
@@ -763,14 +1116,14 @@ void executeHandshakeFunction(handshake::FuncOp &toplevel,
         unsigned offset = any_cast<APInt>(addressValue).getZExtValue();
         assert(offset < ref.size());
 
-        valueMap[dataOut] = ref[offset];
+        valueMap[dataOut] = ref.load(offset);
         timeMap[dataOut] = addressTime;
         // Implicit none argument
         APInt apnonearg(1, 0);
         valueMap[nonceOut] = apnonearg;
         timeMap[nonceOut] = addressTime;
-        scheduleUses(readyList, valueMap, dataOut);
-        scheduleUses(readyList, valueMap, nonceOut);
+        readyList.scheduleUses(dataOut);
+        readyList.scheduleUses(nonceOut);
         // Consume the inputs.
         valueMap.erase(address);
       }
@@ -780,7 +1133,7 @@ void executeHandshakeFunction(handshake::FuncOp &toplevel,
         LLVM_DEBUG(dbgs() << "OP:  " << op << "\n");
         LLVM_DEBUG(dbgs() << "Rescheduling...\n");
 #endif
-        readyList.push_back(&op);
+        readyList.reschedule();
         continue;
       }
       continue;
@@ -793,7 +1146,7 @@ void executeHandshakeFunction(handshake::FuncOp &toplevel,
 #ifdef EXTRA_DEBUG
         LLVM_DEBUG(dbgs() << "Rescheduling control...\n");
 #endif
-        readyList.push_back(&op);
+        readyList.reschedule();
         continue;
       }
       auto controlValue = valueMap[control];
@@ -804,7 +1157,7 @@ void executeHandshakeFunction(handshake::FuncOp &toplevel,
 #ifdef EXTRA_DEBUG
         LLVM_DEBUG(dbgs() << "Rescheduling data...\n");
 #endif
-        readyList.push_back(&op);
+        readyList.reschedule();
         continue;
       }
       auto inValue = valueMap[in];
@@ -817,7 +1170,7 @@ void executeHandshakeFunction(handshake::FuncOp &toplevel,
       double time = std::max(controlTime, inTime);
       valueMap[out] = inValue;
       timeMap[out] = time;
-      scheduleUses(readyList, valueMap, out);
+      readyList.scheduleUses(out);
 
       // Consume the inputs.
       valueMap.erase(control);
@@ -832,7 +1185,7 @@ void executeHandshakeFunction(handshake::FuncOp &toplevel,
     bool reschedule = false;
     LLVM_DEBUG(dbgs() << "OP: (" << op.getNumOperands() << "->"
                       << op.getNumResults() << ")" << op << "\n");
-    double time;
+    double time = 0.0;
     for (mlir::Value in : op.getOperands()) {
       if (valueMap.count(in) == 0) {
         reschedule = true;
@@ -845,90 +1198,1206 @@ void executeHandshakeFunction(handshake::FuncOp &toplevel,
     }
     if (reschedule) {
       LLVM_DEBUG(dbgs() << "Rescheduling data...\n");
-      readyList.push_back(&op);
+      readyList.reschedule();
       continue;
     }
     // Consume the inputs.
     for (mlir::Value in : op.getOperands()) {
       valueMap.erase(in);
     }
-    if (executeStdOp(op, inValues, outValues)) {
-    } else if (auto Op = dyn_cast<handshake::StartOp>(op)) {
-    } else if (auto Op = dyn_cast<handshake::EndOp>(op)) {
-    } else if (auto Op = dyn_cast<handshake::SinkOp>(op)) {
-    } else if (auto Op = dyn_cast<handshake::ForkOp>(op))
-      executeOp(Op, inValues, outValues);
-    else if (auto Op = dyn_cast<handshake::JoinOp>(op))
-      executeOp(Op, inValues, outValues);
-    else if (auto Op = dyn_cast<handshake::ConstantOp>(op))
-      executeOp(Op, inValues, outValues);
-    else if (auto Op = dyn_cast<handshake::StoreOp>(op))
-      executeOp(Op, inValues, outValues, store);
-    else if (auto Op = dyn_cast<handshake::BranchOp>(op))
-      executeOp(Op, inValues, outValues);
-    else if (auto Op = dyn_cast<handshake::ReturnOp>(op)) {
+    if (auto Op = dyn_cast<handshake::ReturnOp>(op)) {
       for (unsigned i = 0; i < results.size(); i++) {
         results[i] = inValues[i];
         resultTimes[i] = timeMap[Op.getOperand(i)];
       }
       return;
-      //} else {
-      // implement function calls.
+    }
+    if (threadPool) {
+      pending.push_back({&op, std::move(inValues), std::move(outValues), time});
+      continue;
+    }
+    executePureOp(op, inValues, outValues, store);
+    publishResults(op, outValues, time);
+  }
+}
+
+//===----------------------------------------------------------------------===//
+// Cycle accurate execution of handshake functions
+//===----------------------------------------------------------------------===//
+//
+// This models the circuits produced by HandshakeToFIRRTL.  Every value is a
+// channel which holds at most one token, and transfers at most one token in
+// and one token out each cycle.  Operations are combinational: they fire in
+// the cycle their inputs become valid if their outputs are free, and consuming
+// an input frees it in the same cycle.  Forks are eager.  Buffers hold up to
+// 'slots' tokens, and a token entering a sequential buffer leaves it in the
+// next cycle at the earliest.  Each memory port serves one request per cycle.
+// Loads complete in the same cycle.  Stores are written, and signal their
+// completion, in the next cycle.
+//
+// A channel that holds a token at the end of a cycle has stalled for that
+// cycle, blocking its producer.  A channel that is empty while another input
+// of its consumer holds a token blocks its consumer.  Merges don't wait for
+// all of their inputs, so their inputs never block them.
+//
+
+namespace {
+class CycleSimulator {
+public:
+  CycleSimulator(MemRefStore &store,
+                 std::vector<double> &storeTimes)
+      : store(store), storeTimes(storeTimes) {}
+
+  /// Run 'func' until it returns.  Return failure if it contains unsupported
+  /// operations or deadlocks.
+  LogicalResult run(handshake::FuncOp func,
+                    llvm::DenseMap<mlir::Value, Any> &valueMap,
+                    std::vector<Any> &results,
+                    std::vector<double> &resultTimes);
+
+  /// Print the number of cycles, the stall counts of every channel that
+  /// stalled and the initiation interval of every control merge.
+  void printReport(raw_ostream &os);
+
+  /// Print the counts of tokens and blocked cycles of every channel and the
+  /// firing counts of every operation, as a graph if 'format' is "dot", as
+  /// JSON if it is "json" and as CSV otherwise.
+  void printChannelStats(raw_ostream &os, StringRef format);
+
+private:
+  enum class Kind {
+    Std,
+    Forward,
+    Constant,
+    Source,
+    Sink,
+    Fork,
+    LazyFork,
+    Merge,
+    ControlMerge,
+    Mux,
+    ConditionalBranch,
+    Buffer,
+    Load,
+    Memory,
+    Return
+  };
+
+  struct Channel {
+    mlir::Value value;
+    Any data;
+    bool valid = false;
+    bool putThisCycle = false;
+    bool takenThisCycle = false;
+    /// The number of tokens consumed.
+    uint64_t tokens = 0;
+    /// The number of cycles this channel blocked its producer and consumer.
+    uint64_t stalls = 0;
+    uint64_t starved = 0;
+  };
+
+  /// A store request accepted by a memory port.
+  struct PendingStore {
+    bool writePending = false;
+    bool completionPending = false;
+    unsigned offset = 0;
+    Any data;
+  };
+
+  struct OpState {
+    mlir::Operation *op;
+    Kind kind;
+    SmallVector<unsigned, 4> inputs;
+    SmallVector<unsigned, 4> outputs;
+    /// Forks: the outputs which already got the current token.
+    SmallVector<bool, 4> sent;
+    /// Buffers: the stored tokens and the cycle each of them arrived in.
+    std::deque<std::pair<Any, uint64_t>> buffered;
+    /// Memories: the buffer backing them and their store ports.
+    unsigned buffer = 0;
+    SmallVector<PendingStore, 2> stores;
+    /// The number of times this operation fired, and when.
+    uint64_t numFired = 0, firstFired = 0, lastFired = 0;
+  };
+
+  LogicalResult addOp(mlir::Operation &op,
+                      llvm::DenseMap<mlir::Value, unsigned> &channelIds);
+  bool tryFire(OpState &state);
+  void startCycle();
+
+  bool canTake(unsigned ch) const {
+    return channels[ch].valid && !channels[ch].takenThisCycle;
+  }
+  bool canPut(unsigned ch) const {
+    return !channels[ch].valid && !channels[ch].putThisCycle;
+  }
+  Any take(unsigned ch) {
+    auto &channel = channels[ch];
+    channel.valid = false;
+    channel.takenThisCycle = true;
+    ++channel.tokens;
+    ++numTransfers;
+    return std::move(channel.data);
+  }
+  void put(unsigned ch, Any data) {
+    auto &channel = channels[ch];
+    channel.data = std::move(data);
+    channel.valid = true;
+    channel.putThisCycle = true;
+    ++numTransfers;
+  }
+
+  MemRefStore &store;
+  std::vector<double> &storeTimes;
+  std::vector<Channel> channels;
+  std::vector<OpState> ops;
+  llvm::DenseMap<unsigned, unsigned> memoryBuffers;
+  uint64_t cycle = 0;
+  uint64_t numTransfers = 0;
+  bool returned = false;
+  std::vector<Any> returnedValues;
+};
+} // end anonymous namespace
+
+LogicalResult
+CycleSimulator::addOp(mlir::Operation &op,
+                      llvm::DenseMap<mlir::Value, unsigned> &channelIds) {
+  OpState state;
+  state.op = &op;
+  for (auto operand : op.getOperands())
+    state.inputs.push_back(channelIds.lookup(operand));
+  for (auto result : op.getResults())
+    state.outputs.push_back(channelIds.lookup(result));
+
+  if (isa<handshake::BranchOp, handshake::JoinOp, handshake::StoreOp>(op))
+    state.kind = Kind::Forward;
+  else if (isa<handshake::ConstantOp>(op))
+    state.kind = Kind::Constant;
+  else if (isa<handshake::SourceOp>(op))
+    state.kind = Kind::Source;
+  else if (isa<handshake::SinkOp, handshake::EndOp>(op))
+    state.kind = Kind::Sink;
+  else if (isa<handshake::ForkOp>(op))
+    state.kind = Kind::Fork;
+  else if (isa<handshake::LazyForkOp>(op))
+    state.kind = Kind::LazyFork;
+  else if (isa<handshake::MergeOp>(op))
+    state.kind = Kind::Merge;
+  else if (isa<handshake::ControlMergeOp>(op))
+    state.kind = Kind::ControlMerge;
+  else if (isa<handshake::MuxOp>(op))
+    state.kind = Kind::Mux;
+  else if (isa<handshake::ConditionalBranchOp>(op))
+    state.kind = Kind::ConditionalBranch;
+  else if (isa<handshake::BufferOp>(op))
+    state.kind = Kind::Buffer;
+  else if (isa<handshake::LoadOp>(op))
+    state.kind = Kind::Load;
+  else if (isa<handshake::ReturnOp>(op))
+    state.kind = Kind::Return;
+  else if (auto memOp = dyn_cast<handshake::MemoryOp>(op)) {
+    state.kind = Kind::Memory;
+    unsigned id = memOp.getID();
+    if (!memoryBuffers.count(id)) {
+      std::vector<Any> nothing;
+      memoryBuffers[id] =
+          allocateMemRef(memOp.getMemRefType(), nothing, store, storeTimes);
+    }
+    state.buffer = memoryBuffers[id];
+    state.stores.resize(memOp.getStCount().getZExtValue());
+  } else if (op.getDialect() &&
+             op.getDialect()->getNamespace() ==
+                 StandardOpsDialect::getDialectNamespace())
+    state.kind = Kind::Std;
+  else
+    return op.emitOpError("is not supported by the cycle accurate runner");
+
+  state.sent.resize(state.outputs.size());
+  ops.push_back(std::move(state));
+  return success();
+}
+
+/// Reset the per-cycle transfer limits and retire the stores accepted in the
+/// previous cycle.
+void CycleSimulator::startCycle() {
+  for (auto &channel : channels)
+    channel.putThisCycle = channel.takenThisCycle = false;
+
+  for (auto &state : ops) {
+    for (auto &pending : state.stores) {
+      if (!pending.writePending)
+        continue;
+      store[state.buffer].store(pending.offset, pending.data);
+      pending.writePending = false;
+      pending.completionPending = true;
+      ++numTransfers;
+    }
+  }
+}
+
+/// Fire as much of 'state' as possible in the current cycle.  Return true if
+/// anything was transferred.
+bool CycleSimulator::tryFire(OpState &state) {
+  auto &inputs = state.inputs;
+  auto &outputs = state.outputs;
+  uint64_t transfersBefore = numTransfers;
+
+  auto allInputsValid = [&]() {
+    return llvm::all_of(inputs, [&](unsigned ch) { return canTake(ch); });
+  };
+  auto allOutputsFree = [&]() {
+    return llvm::all_of(outputs, [&](unsigned ch) { return canPut(ch); });
+  };
+
+  switch (state.kind) {
+  case Kind::Std:
+  case Kind::Forward:
+  case Kind::Constant:
+  case Kind::LazyFork: {
+    if (!allInputsValid() || !allOutputsFree())
+      break;
+    std::vector<Any> inValues, outValues(outputs.size());
+    for (unsigned ch : inputs)
+      inValues.push_back(take(ch));
+    if (state.kind == Kind::Std) {
+      if (!executeStdOp(*state.op, inValues, outValues))
+        llvm_unreachable("Unknown operation!\n");
+    } else if (state.kind == Kind::Constant) {
+      outValues[0] = state.op->getAttrOfType<mlir::IntegerAttr>("value")
+                         .getValue();
+    } else if (state.kind == Kind::LazyFork) {
+      for (auto &value : outValues)
+        value = inValues[0];
     } else {
-      llvm_unreachable("Unknown operation!\n");
+      for (unsigned i = 0, e = outValues.size(); i != e; ++i)
+        outValues[i] = inValues[i];
     }
-    i = 0;
-    for (mlir::Value out : op.getResults()) {
-      LLVM_DEBUG(debugArg("OUT", out, outValues[i], time));
-      assert(outValues[i].hasValue());
-      valueMap[out] = outValues[i];
-      timeMap[out] = time + 1;
-      scheduleUses(readyList, valueMap, out);
+    for (unsigned i = 0, e = outputs.size(); i != e; ++i)
+      put(outputs[i], std::move(outValues[i]));
+    break;
+  }
 
-      i++;
+  case Kind::Source:
+    if (canPut(outputs[0]))
+      put(outputs[0], APInt(1, 0));
+    break;
+
+  case Kind::Sink:
+    for (unsigned ch : inputs)
+      if (canTake(ch))
+        take(ch);
+    break;
+
+  case Kind::Fork: {
+    if (!canTake(inputs[0]))
+      break;
+    for (unsigned i = 0, e = outputs.size(); i != e; ++i) {
+      if (!state.sent[i] && canPut(outputs[i])) {
+        put(outputs[i], channels[inputs[0]].data);
+        state.sent[i] = true;
+      }
     }
-    instructionsExecuted++;
+    if (llvm::all_of(state.sent, [](bool sent) { return sent; })) {
+      take(inputs[0]);
+      std::fill(state.sent.begin(), state.sent.end(), false);
+    }
+    break;
+  }
+
+  case Kind::Merge:
+  case Kind::ControlMerge: {
+    if (!allOutputsFree())
+      break;
+    for (unsigned i = 0, e = inputs.size(); i != e; ++i) {
+      if (!canTake(inputs[i]))
+        continue;
+      put(outputs[0], take(inputs[i]));
+      if (state.kind == Kind::ControlMerge)
+        put(outputs[1], APInt(INDEX_WIDTH, i));
+      break;
+    }
+    break;
+  }
+
+  case Kind::Mux: {
+    if (!canTake(inputs[0]) || !canPut(outputs[0]))
+      break;
+    auto select = any_cast<APInt>(channels[inputs[0]].data).getZExtValue();
+    assert(select + 1 < inputs.size() && "mux select out of range");
+    unsigned in = inputs[select + 1];
+    if (!canTake(in))
+      break;
+    take(inputs[0]);
+    put(outputs[0], take(in));
+    break;
+  }
+
+  case Kind::ConditionalBranch: {
+    if (!allInputsValid())
+      break;
+    bool condition = any_cast<APInt>(channels[inputs[0]].data) != 0;
+    unsigned out = condition ? outputs[0] : outputs[1];
+    if (!canPut(out))
+      break;
+    take(inputs[0]);
+    put(out, take(inputs[1]));
+    break;
   }
+
+  case Kind::Buffer: {
+    auto bufferOp = cast<handshake::BufferOp>(state.op);
+    // The output side goes first so that a full buffer can accept a token in
+    // the same cycle it emits one.
+    uint64_t minAge = bufferOp.isSequential() ? 1 : 0;
+    if (!state.buffered.empty() &&
+        cycle >= state.buffered.front().second + minAge &&
+        canPut(outputs[0])) {
+      put(outputs[0], std::move(state.buffered.front().first));
+      state.buffered.pop_front();
+    }
+    uint64_t slots = std::max<uint64_t>(bufferOp.getNumSlots().getZExtValue(),
+                                        1);
+    if (state.buffered.size() < slots && canTake(inputs[0]))
+      state.buffered.push_back({take(inputs[0]), cycle});
+    break;
+  }
+
+  case Kind::Load: {
+    // Operands: indices, data from memory, control.  Results: data, indices
+    // sent to memory.
+    unsigned numIndices = inputs.size() - 2;
+    bool requestReady = canTake(inputs.back());
+    for (unsigned i = 0; i != numIndices; ++i)
+      requestReady &= canTake(inputs[i]) && canPut(outputs[i + 1]);
+    if (requestReady) {
+      take(inputs.back());
+      for (unsigned i = 0; i != numIndices; ++i)
+        put(outputs[i + 1], take(inputs[i]));
+    }
+    unsigned data = inputs[numIndices];
+    if (canTake(data) && canPut(outputs[0]))
+      put(outputs[0], take(data));
+    break;
+  }
+
+  case Kind::Memory: {
+    auto &buffer = store[state.buffer];
+    unsigned numStores = state.stores.size();
+    unsigned numLoads = inputs.size() - 2 * numStores;
+    for (unsigned i = 0; i != numStores; ++i) {
+      auto &pending = state.stores[i];
+      unsigned done = outputs[numLoads + i];
+      if (pending.completionPending && canPut(done)) {
+        put(done, APInt(1, 0));
+        pending.completionPending = false;
+      }
+      unsigned data = inputs[2 * i], address = inputs[2 * i + 1];
+      if (pending.writePending || pending.completionPending ||
+          !canTake(data) || !canTake(address))
+        continue;
+      pending.data = take(data);
+      pending.offset = any_cast<APInt>(take(address)).getZExtValue();
+      assert(pending.offset < buffer.size());
+      pending.writePending = true;
+    }
+    for (unsigned i = 0; i != numLoads; ++i) {
+      unsigned address = inputs[2 * numStores + i];
+      unsigned data = outputs[i];
+      unsigned done = outputs[numLoads + numStores + i];
+      if (!canTake(address) || !canPut(data) || !canPut(done))
+        continue;
+      unsigned offset = any_cast<APInt>(take(address)).getZExtValue();
+      assert(offset < buffer.size());
+      put(data, buffer.load(offset));
+      put(done, APInt(1, 0));
+    }
+    break;
+  }
+
+  case Kind::Return:
+    if (!allInputsValid())
+      break;
+    for (unsigned ch : inputs)
+      returnedValues.push_back(take(ch));
+    returned = true;
+    break;
+  }
+
+  if (numTransfers == transfersBefore)
+    return false;
+  if (state.numFired++ == 0)
+    state.firstFired = cycle;
+  state.lastFired = cycle;
+  return true;
 }
 
-int main(int argc, char **argv) {
-  InitLLVM y(argc, argv);
-  cl::ParseCommandLineOptions(
-      argc, argv,
-      "MLIR Standard dialect runner\n\n"
-      "This application executes a function in the given MLIR module\n"
-      "Arguments to the function are passed on the command line and\n"
-      "results are returned on stdout.\n"
-      "Memref types are specified as a comma-separated list of values.\n");
+LogicalResult CycleSimulator::run(handshake::FuncOp func,
+                                  llvm::DenseMap<mlir::Value, Any> &valueMap,
+                                  std::vector<Any> &results,
+                                  std::vector<double> &resultTimes) {
+  mlir::Block &entryBlock = func.getBody().front();
+
+  // Number all the channels.
+  llvm::DenseMap<mlir::Value, unsigned> channelIds;
+  auto addChannel = [&](mlir::Value value) {
+    channelIds[value] = channels.size();
+    channels.emplace_back();
+    channels.back().value = value;
+  };
+  for (auto arg : entryBlock.getArguments())
+    addChannel(arg);
+  for (auto &op : entryBlock)
+    for (auto result : op.getResults())
+      addChannel(result);
+
+  for (auto &op : entryBlock)
+    if (failed(addOp(op, channelIds)))
+      return failure();
+
+  // The arguments are available in the first cycle.
+  for (auto arg : entryBlock.getArguments()) {
+    auto it = valueMap.find(arg);
+    if (it == valueMap.end())
+      continue;
+    auto &channel = channels[channelIds[arg]];
+    channel.data = it->second;
+    channel.valid = true;
+  }
 
-  auto file_or_err = MemoryBuffer::getFileOrSTDIN(inputFileName.c_str());
-  if (std::error_code error = file_or_err.getError()) {
-    errs() << argv[0] << ": could not open input file '" << inputFileName
-           << "': " << error.message() << "\n";
-    return 1;
+  for (;; ++cycle) {
+    uint64_t transfersBefore = numTransfers;
+    startCycle();
+
+    // Keep evaluating the operations until the cycle settles.  This
+    // terminates since every channel transfers at most one token per cycle.
+    bool changed = true;
+    while (changed && !returned) {
+      changed = false;
+      for (auto &state : ops)
+        changed |= tryFire(state);
+    }
+
+    if (returned)
+      break;
+
+    for (auto &channel : channels)
+      if (channel.valid)
+        ++channel.stalls;
+    for (auto &state : ops) {
+      if (state.kind == Kind::Merge || state.kind == Kind::ControlMerge ||
+          llvm::none_of(state.inputs,
+                        [&](unsigned ch) { return channels[ch].valid; }))
+        continue;
+      for (unsigned ch : state.inputs)
+        if (!channels[ch].valid)
+          ++channels[ch].starved;
+    }
+
+    // Nothing happened in this cycle, so the next one will be the same.
+    if (numTransfers == transfersBefore)
+      return func.emitError("deadlocked in cycle ") << cycle;
   }
 
-  // Load the MLIR module.
-  mlir::MLIRContext context;
-  context.loadDialect<StandardOpsDialect, handshake::HandshakeOpsDialect>();
-  SourceMgr source_mgr;
-  source_mgr.AddNewSourceBuffer(std::move(*file_or_err), SMLoc());
-  mlir::OwningModuleRef module(mlir::parseSourceFile(source_mgr, &context));
-  if (!module)
-    return 1;
+  for (unsigned i = 0; i < results.size(); i++) {
+    results[i] = returnedValues[i];
+    resultTimes[i] = cycle;
+  }
+  for (auto &state : ops)
+    if (state.kind == Kind::Std)
+      instructionsExecuted += state.numFired;
+  return success();
+}
 
-  mlir::Operation *mainP = module->lookupSymbol(toplevelFunction);
-  // The toplevel function can accept any number of operands, and returns
-  // any number of results.
-  if (!mainP) {
-    errs() << "Toplevel function " << toplevelFunction << " not found!\n";
-    return 1;
+/// Describe a channel for the report.
+static void printChannel(raw_ostream &os, mlir::Value value) {
+  if (auto arg = value.dyn_cast<BlockArgument>()) {
+    os << "argument #" << arg.getArgNumber();
+    return;
+  }
+  auto result = value.cast<mlir::OpResult>();
+  os << result.getOwner()->getName() << " result #"
+     << result.getResultNumber() << " at " << value.getLoc();
+}
+
+void CycleSimulator::printReport(raw_ostream &os) {
+  os << "Cycles: " << cycle + 1 << "\n";
+
+  std::vector<unsigned> stalled;
+  for (unsigned i = 0, e = channels.size(); i != e; ++i)
+    if (channels[i].stalls)
+      stalled.push_back(i);
+  std::stable_sort(stalled.begin(), stalled.end(), [&](unsigned a, unsigned b) {
+    return channels[a].stalls > channels[b].stalls;
+  });
+  os << "Stalls:\n";
+  for (unsigned i : stalled) {
+    os << "  " << channels[i].stalls << " cycles: ";
+    printChannel(os, channels[i].value);
+    os << "\n";
+  }
+
+  os << "Initiation intervals:\n";
+  for (auto &state : ops) {
+    if (state.kind != Kind::ControlMerge || state.numFired < 2)
+      continue;
+    double interval = double(state.lastFired - state.firstFired) /
+                      double(state.numFired - 1);
+    os << "  " << format("%.2f", interval) << " over " << state.numFired
+       << " iterations: " << state.op->getName() << " at "
+       << state.op->getLoc() << "\n";
+  }
+}
+
+void CycleSimulator::printChannelStats(raw_ostream &os, StringRef format) {
+  // Name the operations like the graphs of the handshake analysis pass, and
+  // find the endpoints of every channel.
+  auto getOpName = [&](unsigned index) {
+    return (ops[index].op->getName().getStringRef() + "_" + Twine(index))
+        .str();
+  };
+  std::vector<std::string> producers(channels.size());
+  std::vector<std::string> consumers(channels.size());
+  std::vector<unsigned> numbers(channels.size());
+  std::vector<uint64_t> producerFired(channels.size());
+  std::vector<uint64_t> consumerFired(channels.size());
+  for (unsigned i = 0, e = channels.size(); i != e; ++i) {
+    if (auto arg = channels[i].value.dyn_cast<BlockArgument>()) {
+      producers[i] = "arg" + std::to_string(arg.getArgNumber());
+      numbers[i] = arg.getArgNumber();
+    }
+  }
+  for (unsigned i = 0, e = ops.size(); i != e; ++i) {
+    auto &state = ops[i];
+    for (unsigned ch : state.inputs) {
+      consumers[ch] = getOpName(i);
+      consumerFired[ch] = state.numFired;
+    }
+    for (auto it : llvm::enumerate(state.outputs)) {
+      producers[it.value()] = getOpName(i);
+      numbers[it.value()] = it.index();
+      producerFired[it.value()] = state.numFired;
+    }
+  }
+  uint64_t numCycles = cycle + 1;
+
+  if (format == "json") {
+    json::OStream json(os, 2);
+    json.object([&] {
+      json.attribute("cycles", int64_t(numCycles));
+      json.attributeArray("channels", [&] {
+        for (unsigned i = 0, e = channels.size(); i != e; ++i) {
+          json.object([&] {
+            json.attribute("producer", producers[i]);
+            json.attribute("result", int64_t(numbers[i]));
+            json.attribute("consumer", consumers[i]);
+            json.attribute("tokens", int64_t(channels[i].tokens));
+            json.attribute("producerBlocked", int64_t(channels[i].stalls));
+            json.attribute("consumerBlocked", int64_t(channels[i].starved));
+          });
+        }
+      });
+      json.attributeArray("operations", [&] {
+        for (unsigned i = 0, e = ops.size(); i != e; ++i) {
+          json.object([&] {
+            json.attribute("name", getOpName(i));
+            json.attribute("fired", int64_t(ops[i].numFired));
+          });
+        }
+      });
+    });
+    os << "\n";
+    return;
+  }
+
+  if (format != "dot") {
+    os << "producer,result,consumer,tokens,producer_blocked,consumer_blocked,"
+          "producer_fired,consumer_fired\n";
+    for (unsigned i = 0, e = channels.size(); i != e; ++i)
+      os << producers[i] << "," << numbers[i] << "," << consumers[i] << ","
+         << channels[i].tokens << "," << channels[i].stalls << ","
+         << channels[i].starved << "," << producerFired[i] << ","
+         << consumerFired[i] << "\n";
+    return;
+  }
+
+  // Channels which blocked either side for a tenth of the run are hot.
+  os << "Digraph G {\n\tsplines=spline;\n";
+  for (unsigned i = 0, e = ops.size(); i != e; ++i)
+    os << "\t\"" << getOpName(i) << "\" [label=\"" << getOpName(i)
+       << "\\nfired " << ops[i].numFired << "\"];\n";
+  for (unsigned i = 0, e = channels.size(); i != e; ++i) {
+    if (consumers[i].empty())
+      continue;
+    auto &channel = channels[i];
+    os << "\t\"" << producers[i] << "\" -> \"" << consumers[i]
+       << "\" [label=\"" << channel.tokens << " tokens\\nblocked "
+       << channel.stalls << "/" << channel.starved << "\"";
+    if (std::max(channel.stalls, channel.starved) * 10 >= numCycles)
+      os << ", color=red, penwidth=3";
+    os << "];\n";
+  }
+  os << "}\n";
+}
+
+//===----------------------------------------------------------------------===//
+// Compiled execution of standard dialect functions
+//===----------------------------------------------------------------------===//
+//
+// Instead of walking the IR and dispatching every op through a chain of
+// dyn_casts, each function is translated once into a flat list of
+// instructions with a precomputed opcode.  Every SSA value gets a dense
+// register number with typed storage, so executing an instruction is a switch
+// and a few vector accesses.  The simulated time is tracked exactly like the
+// interpreter above does.
+//
+
+namespace {
+enum class Opcode : uint8_t {
+  Constant,
+  AddI,
+  AddF,
+  SubI,
+  SubF,
+  MulI,
+  MulF,
+  CmpI,
+  CmpF,
+  SignedDivI,
+  UnsignedDivI,
+  DivF,
+  Copy,
+  SignExtendI,
+  ZeroExtendI,
+  Alloc,
+  Load,
+  Store,
+  Branch,
+  CondBranch,
+  Return,
+  Call
+};
+
+/// A single compiled operation.  The registers it reads, followed by the
+/// registers it writes, are stored contiguously in the register pool of the
+/// function starting at 'operands'.
+struct Instruction {
+  Opcode opcode;
+  /// Branches: whether the block arguments may be read after being written,
+  /// which requires copying them through a temporary.
+  bool overlapping = false;
+  unsigned numOperands = 0;
+  unsigned numResults = 0;
+  unsigned operands = 0;
+  /// Comparisons: the predicate.  Extensions: the result width.  Floating
+  /// point arithmetic: whether the result is single precision.  Conditional
+  /// branches: the number of operands forwarded to the true destination.
+  unsigned imm = 0;
+  /// Constants: the index in the constant pool.  Memory operations: the index
+  /// of the memref type.  Branches: the (true) destination.  Calls: the index
+  /// of the callee.
+  unsigned aux = 0;
+  /// Conditional branches: the false destination.
+  unsigned aux2 = 0;
+};
+
+struct CompiledFunction {
+  std::vector<Instruction> code;
+  std::vector<unsigned> registerPool;
+  std::vector<APInt> constants;
+  std::vector<mlir::MemRefType> memRefTypes;
+  std::vector<CompiledFunction *> callees;
+  /// Whether each register holds a floating point value, otherwise it holds an
+  /// integer, index or memref.
+  std::vector<bool> isFloatRegister;
+  /// The arguments of the entry block are assigned the first registers.
+  unsigned numArguments = 0;
+};
+
+/// The registers of one function invocation, along with the time each value
+/// became available.  Memrefs are stored as integers holding the buffer
+/// number.
+struct Frame {
+  explicit Frame(unsigned numRegisters)
+      : ints(numRegisters), floats(numRegisters), times(numRegisters) {}
+
+  std::vector<APInt> ints;
+  std::vector<double> floats;
+  std::vector<double> times;
+};
+
+class CompiledRunner {
+public:
+  /// Return the compiled form of 'func', compiling it and all the functions it
+  /// calls if needed.  Return null if 'func' contains unsupported operations.
+  CompiledFunction *getOrCompile(mlir::FuncOp func);
+
+  /// Execute 'fn' on the arguments in 'frame' and return the instruction that
+  /// returned from it.  The returned values are in 'frame'.
+  const Instruction &execute(const CompiledFunction &fn, Frame &frame);
+
+  /// The memory, which is swapped in from the interpreters' store for a run,
+  /// and the time each buffer was last accessed.
+  MemRefStore memory;
+  std::vector<double> memoryTimes;
+  /// The number of instructions executed, not counting control flow.
+  uint64_t numExecuted = 0;
+
+private:
+  LogicalResult compileOp(mlir::Operation &op, CompiledFunction &fn,
+                          llvm::DenseMap<mlir::Value, unsigned> &registers,
+                          llvm::DenseMap<mlir::Block *, unsigned> &blockStarts);
+
+  unsigned allocate(mlir::MemRefType type, const unsigned *dynamicSizes,
+                    const Frame &frame);
+
+  void branch(const CompiledFunction &fn, const Instruction &inst,
+              Frame &frame, const unsigned *sources,
+              const unsigned *destinations, unsigned count);
+
+  llvm::DenseMap<mlir::Operation *, std::unique_ptr<CompiledFunction>>
+      functions;
+};
+} // end anonymous namespace
+
+/// Return the opcode for operations whose operands and results map directly
+/// onto registers without any extra information.
+static Optional<Opcode> getSimpleOpcode(mlir::Operation &op) {
+  if (isa<mlir::AddIOp>(op))
+    return Opcode::AddI;
+  if (isa<mlir::AddFOp>(op))
+    return Opcode::AddF;
+  if (isa<mlir::SubIOp>(op))
+    return Opcode::SubI;
+  if (isa<mlir::SubFOp>(op))
+    return Opcode::SubF;
+  if (isa<mlir::MulIOp>(op))
+    return Opcode::MulI;
+  if (isa<mlir::MulFOp>(op))
+    return Opcode::MulF;
+  if (isa<mlir::SignedDivIOp>(op))
+    return Opcode::SignedDivI;
+  if (isa<mlir::UnsignedDivIOp>(op))
+    return Opcode::UnsignedDivI;
+  if (isa<mlir::DivFOp>(op))
+    return Opcode::DivF;
+  if (isa<mlir::IndexCastOp>(op))
+    return Opcode::Copy;
+  if (isa<mlir::AllocOp>(op))
+    return Opcode::Alloc;
+  if (isa<mlir::LoadOp>(op))
+    return Opcode::Load;
+  if (isa<mlir::StoreOp>(op))
+    return Opcode::Store;
+  if (isa<mlir::ReturnOp>(op))
+    return Opcode::Return;
+  return None;
+}
+
+CompiledFunction *CompiledRunner::getOrCompile(mlir::FuncOp func) {
+  auto &entry = functions[func];
+  if (entry)
+    return entry.get();
+  entry = std::make_unique<CompiledFunction>();
+  // Compiling callees may grow the map, so don't hold on to 'entry'.
+  CompiledFunction &fn = *entry;
+
+  // Number all the values.  Since each op becomes exactly one instruction,
+  // this also determines where each block starts.
+  llvm::DenseMap<mlir::Value, unsigned> registers;
+  llvm::DenseMap<mlir::Block *, unsigned> blockStarts;
+  auto addRegister = [&](mlir::Value value) {
+    registers[value] = fn.isFloatRegister.size();
+    fn.isFloatRegister.push_back(value.getType().isa<mlir::FloatType>());
+  };
+  unsigned numOps = 0;
+  for (auto &block : func.getBody()) {
+    blockStarts[&block] = numOps;
+    for (auto arg : block.getArguments())
+      addRegister(arg);
+    for (auto &op : block) {
+      for (auto result : op.getResults())
+        addRegister(result);
+      ++numOps;
+    }
+  }
+  fn.numArguments = func.getNumArguments();
+
+  fn.code.reserve(numOps);
+  for (auto &block : func.getBody()) {
+    for (auto &op : block) {
+      if (failed(compileOp(op, fn, registers, blockStarts))) {
+        functions.erase(func);
+        return nullptr;
+      }
+    }
+  }
+  return &fn;
+}
+
+LogicalResult CompiledRunner::compileOp(
+    mlir::Operation &op, CompiledFunction &fn,
+    llvm::DenseMap<mlir::Value, unsigned> &registers,
+    llvm::DenseMap<mlir::Block *, unsigned> &blockStarts) {
+  Instruction inst;
+  inst.operands = fn.registerPool.size();
+  auto addRegisters = [&](mlir::ValueRange values) {
+    for (auto value : values)
+      fn.registerPool.push_back(registers.lookup(value));
+  };
+  auto isSingle = [](mlir::Type type) { return type.isF32() ? 1 : 0; };
+
+  if (auto simple = getSimpleOpcode(op)) {
+    inst.opcode = simple.getValue();
+    if (auto load = dyn_cast<mlir::LoadOp>(op)) {
+      inst.aux = fn.memRefTypes.size();
+      fn.memRefTypes.push_back(load.getMemRefType());
+    } else if (auto store = dyn_cast<mlir::StoreOp>(op)) {
+      inst.aux = fn.memRefTypes.size();
+      fn.memRefTypes.push_back(store.getMemRefType());
+    } else if (auto alloc = dyn_cast<mlir::AllocOp>(op)) {
+      inst.aux = fn.memRefTypes.size();
+      fn.memRefTypes.push_back(alloc.getType());
+    } else if (op.getNumResults() == 1) {
+      inst.imm = isSingle(op.getResult(0).getType());
+    }
+  } else if (isa<mlir::ConstantIndexOp>(op)) {
+    inst.opcode = Opcode::Constant;
+    inst.aux = fn.constants.size();
+    auto attr = op.getAttrOfType<mlir::IntegerAttr>("value");
+    fn.constants.push_back(attr.getValue().sextOrTrunc(INDEX_WIDTH));
+  } else if (isa<mlir::ConstantIntOp>(op)) {
+    inst.opcode = Opcode::Constant;
+    inst.aux = fn.constants.size();
+    fn.constants.push_back(op.getAttrOfType<mlir::IntegerAttr>("value")
+                               .getValue());
+  } else if (auto cmp = dyn_cast<mlir::CmpIOp>(op)) {
+    inst.opcode = Opcode::CmpI;
+    inst.imm = (unsigned)cmp.getPredicate();
+  } else if (auto cmp = dyn_cast<mlir::CmpFOp>(op)) {
+    inst.opcode = Opcode::CmpF;
+    inst.imm = (unsigned)cmp.getPredicate();
+  } else if (isa<mlir::SignExtendIOp, mlir::ZeroExtendIOp>(op)) {
+    inst.opcode = isa<mlir::SignExtendIOp>(op) ? Opcode::SignExtendI
+                                               : Opcode::ZeroExtendI;
+    inst.imm = op.getResult(0).getType().getIntOrFloatBitWidth();
+  } else if (auto br = dyn_cast<mlir::BranchOp>(op)) {
+    inst.opcode = Opcode::Branch;
+    inst.aux = blockStarts.lookup(br.getDest());
+    inst.numOperands = br.getNumOperands();
+    addRegisters(br.getOperands());
+    addRegisters(br.getDest()->getArguments());
+    for (auto arg : br.getOperands())
+      if (arg.getParentBlock() == br.getDest() && arg.isa<BlockArgument>())
+        inst.overlapping = true;
+    fn.code.push_back(inst);
+    return success();
+  } else if (auto condBr = dyn_cast<mlir::CondBranchOp>(op)) {
+    inst.opcode = Opcode::CondBranch;
+    inst.imm = condBr.getNumTrueOperands();
+    inst.aux = blockStarts.lookup(condBr.getTrueDest());
+    inst.aux2 = blockStarts.lookup(condBr.getFalseDest());
+    inst.numOperands = condBr.getNumOperands();
+    addRegisters(condBr.getOperands());
+    addRegisters(condBr.getTrueDest()->getArguments());
+    addRegisters(condBr.getFalseDest()->getArguments());
+    for (auto *dest : {condBr.getTrueDest(), condBr.getFalseDest()})
+      for (auto arg : condBr.getOperands().drop_front())
+        if (arg.getParentBlock() == dest && arg.isa<BlockArgument>())
+          inst.overlapping = true;
+    fn.code.push_back(inst);
+    return success();
+  } else if (auto call = dyn_cast<mlir::CallOpInterface>(op)) {
+    auto callee = dyn_cast_or_null<mlir::FuncOp>(call.resolveCallable());
+    if (!callee)
+      return op.emitOpError("callee is not a function");
+    auto *compiledCallee = getOrCompile(callee);
+    if (!compiledCallee)
+      return failure();
+    inst.opcode = Opcode::Call;
+    inst.aux = fn.callees.size();
+    fn.callees.push_back(compiledCallee);
+  } else {
+    return op.emitOpError("is not supported by the compiled runner");
+  }
+
+  inst.numOperands = op.getNumOperands();
+  inst.numResults = op.getNumResults();
+  addRegisters(op.getOperands());
+  addRegisters(op.getResults());
+  fn.code.push_back(inst);
+  return success();
+}
+
+/// Round the result of a floating point operation to single precision if
+/// needed.
+static double roundFloat(double value, unsigned isSingle) {
+  return isSingle ? (double)(float)value : value;
+}
+
+/// Return the linear address of an element of a memref.
+static unsigned getAddress(ArrayRef<int64_t> shape, const unsigned *indices,
+                           const Frame &frame) {
+  unsigned address = 0;
+  for (unsigned i = 0, e = shape.size(); i != e; ++i)
+    address = address * shape[i] + frame.ints[indices[i]].getZExtValue();
+  return address;
+}
+
+unsigned CompiledRunner::allocate(mlir::MemRefType type,
+                                  const unsigned *dynamicSizes,
+                                  const Frame &frame) {
+  int allocationSize = 1;
+  for (int64_t dim : type.getShape()) {
+    if (dim > 0)
+      allocationSize *= dim;
+    else
+      allocationSize *= frame.ints[*dynamicSizes++].getSExtValue();
+  }
+  unsigned ptr = memory.size();
+  memory.emplace_back(type.getElementType(), allocationSize);
+  memoryTimes.push_back(0.0);
+  return ptr;
+}
+
+/// Copy the operands of a branch into the arguments of its destination.  All
+/// the arguments become available at the time the last operand did.
+void CompiledRunner::branch(const CompiledFunction &fn,
+                            const Instruction &inst, Frame &frame,
+                            const unsigned *sources,
+                            const unsigned *destinations, unsigned count) {
+  double time = 0.0;
+  for (unsigned i = 0; i != count; ++i)
+    time = std::max(time, frame.times[sources[i]]);
+
+  auto copy = [&](const Frame &from, unsigned src, unsigned dst) {
+    if (fn.isFloatRegister[dst])
+      frame.floats[dst] = from.floats[src];
+    else
+      frame.ints[dst] = from.ints[src];
+    frame.times[dst] = time;
+  };
+
+  if (!inst.overlapping) {
+    for (unsigned i = 0; i != count; ++i)
+      copy(frame, sources[i], destinations[i]);
+    return;
+  }
+
+  // Some arguments are forwarded to the same block, read them all first.
+  Frame temp(count);
+  for (unsigned i = 0; i != count; ++i) {
+    temp.ints[i] = frame.ints[sources[i]];
+    temp.floats[i] = frame.floats[sources[i]];
+  }
+  for (unsigned i = 0; i != count; ++i)
+    copy(temp, i, destinations[i]);
+}
+
+const Instruction &CompiledRunner::execute(const CompiledFunction &fn,
+                                           Frame &frame) {
+  auto &ints = frame.ints;
+  auto &floats = frame.floats;
+  auto &times = frame.times;
+  const Instruction *code = fn.code.data();
+  unsigned pc = 0;
+
+  while (true) {
+    const Instruction &inst = code[pc++];
+    const unsigned *regs = fn.registerPool.data() + inst.operands;
+
+    // The instruction executes once all its operands are available.
+    double time = 0.0;
+    for (unsigned i = 0; i != inst.numOperands; ++i)
+      time = std::max(time, times[regs[i]]);
+    const unsigned *results = regs + inst.numOperands;
+
+    switch (inst.opcode) {
+    case Opcode::Constant:
+      ints[results[0]] = fn.constants[inst.aux];
+      break;
+    case Opcode::AddI:
+      ints[results[0]] = ints[regs[0]] + ints[regs[1]];
+      break;
+    case Opcode::AddF:
+      floats[results[0]] = roundFloat(floats[regs[0]] + floats[regs[1]],
+                                      inst.imm);
+      break;
+    case Opcode::SubI:
+      ints[results[0]] = ints[regs[0]] - ints[regs[1]];
+      break;
+    case Opcode::SubF:
+      floats[results[0]] = roundFloat(floats[regs[0]] - floats[regs[1]],
+                                      inst.imm);
+      break;
+    case Opcode::MulI:
+      ints[results[0]] = ints[regs[0]] * ints[regs[1]];
+      break;
+    case Opcode::MulF:
+      floats[results[0]] = roundFloat(floats[regs[0]] * floats[regs[1]],
+                                      inst.imm);
+      break;
+    case Opcode::CmpI:
+      ints[results[0]] =
+          APInt(1, mlir::applyCmpPredicate((mlir::CmpIPredicate)inst.imm,
+                                           ints[regs[0]], ints[regs[1]]));
+      break;
+    case Opcode::CmpF:
+      ints[results[0]] = APInt(
+          1, mlir::applyCmpPredicate((mlir::CmpFPredicate)inst.imm,
+                                     APFloat(floats[regs[0]]),
+                                     APFloat(floats[regs[1]])));
+      break;
+    case Opcode::SignedDivI:
+      assert(ints[regs[1]].getZExtValue() && "Division By Zero!");
+      ints[results[0]] = ints[regs[0]].sdiv(ints[regs[1]]);
+      break;
+    case Opcode::UnsignedDivI:
+      assert(ints[regs[1]].getZExtValue() && "Division By Zero!");
+      ints[results[0]] = ints[regs[0]].udiv(ints[regs[1]]);
+      break;
+    case Opcode::DivF:
+      floats[results[0]] = roundFloat(floats[regs[0]] / floats[regs[1]],
+                                      inst.imm);
+      break;
+    case Opcode::Copy:
+      ints[results[0]] = ints[regs[0]];
+      break;
+    case Opcode::SignExtendI:
+      ints[results[0]] = ints[regs[0]].sext(inst.imm);
+      break;
+    case Opcode::ZeroExtendI:
+      ints[results[0]] = ints[regs[0]].zext(inst.imm);
+      break;
+    case Opcode::Alloc: {
+      unsigned ptr = allocate(fn.memRefTypes[inst.aux], regs, frame);
+      memoryTimes[ptr] = time;
+      ints[results[0]] = APInt(INDEX_WIDTH, ptr);
+      break;
+    }
+    case Opcode::Load: {
+      unsigned ptr = ints[regs[0]].getZExtValue();
+      unsigned address =
+          getAddress(fn.memRefTypes[inst.aux].getShape(), regs + 1, frame);
+      if (fn.isFloatRegister[results[0]])
+        floats[results[0]] = memory[ptr].loadFloat(address);
+      else
+        ints[results[0]] = memory[ptr].loadInt(address);
+      time = std::max(time, memoryTimes[ptr]);
+      memoryTimes[ptr] = time;
+      break;
+    }
+    case Opcode::Store: {
+      unsigned ptr = ints[regs[1]].getZExtValue();
+      unsigned address =
+          getAddress(fn.memRefTypes[inst.aux].getShape(), regs + 2, frame);
+      if (fn.isFloatRegister[regs[0]])
+        memory[ptr].storeFloat(address, floats[regs[0]]);
+      else
+        memory[ptr].storeInt(address, ints[regs[0]]);
+      time = std::max(time, memoryTimes[ptr]);
+      memoryTimes[ptr] = time;
+      break;
+    }
+    case Opcode::Branch:
+      branch(fn, inst, frame, regs, results, inst.numOperands);
+      pc = inst.aux;
+      continue;
+    case Opcode::CondBranch: {
+      unsigned numTrue = inst.imm;
+      unsigned numFalse = inst.numOperands - 1 - numTrue;
+      if (ints[regs[0]] != 0) {
+        branch(fn, inst, frame, regs + 1, results, numTrue);
+        pc = inst.aux;
+      } else {
+        branch(fn, inst, frame, regs + 1 + numTrue, results + numTrue,
+               numFalse);
+        pc = inst.aux2;
+      }
+      continue;
+    }
+    case Opcode::Return:
+      return inst;
+    case Opcode::Call: {
+      const CompiledFunction &callee = *fn.callees[inst.aux];
+      Frame calleeFrame(callee.isFloatRegister.size());
+      for (unsigned i = 0; i != inst.numOperands; ++i) {
+        calleeFrame.ints[i] = ints[regs[i]];
+        calleeFrame.floats[i] = floats[regs[i]];
+        calleeFrame.times[i] = times[regs[i]];
+      }
+      const Instruction &ret = execute(callee, calleeFrame);
+      const unsigned *returned = callee.registerPool.data() + ret.operands;
+      for (unsigned i = 0; i != inst.numResults; ++i) {
+        ints[results[i]] = calleeFrame.ints[returned[i]];
+        floats[results[i]] = calleeFrame.floats[returned[i]];
+        times[results[i]] = calleeFrame.times[returned[i]];
+      }
+      continue;
+    }
+    }
+
+    for (unsigned i = 0; i != inst.numResults; ++i)
+      times[results[i]] = time + 1;
+    ++numExecuted;
+  }
+}
+
+/// Execute 'toplevel' with the compiled runner.  This takes and returns values
+/// in the same form as executeFunction.  The compiled functions are kept in
+/// 'runner' for later runs.
+LogicalResult executeCompiledFunction(
+    CompiledRunner &runner, mlir::FuncOp &toplevel,
+    llvm::DenseMap<mlir::Value, Any> &valueMap,
+    llvm::DenseMap<mlir::Value, double> &timeMap, std::vector<Any> &results,
+    std::vector<double> &resultTimes, MemRefStore &store,
+    std::vector<double> &storeTimes) {
+  CompiledFunction *fn = runner.getOrCompile(toplevel);
+  if (!fn)
+    return failure();
+  runner.numExecuted = 0;
+
+  // The runner works on the memory in place.
+  std::swap(runner.memory, store);
+  std::swap(runner.memoryTimes, storeTimes);
+
+  Frame frame(fn->isFloatRegister.size());
+  auto blockArgs = toplevel.getBody().front().getArguments();
+  for (unsigned i = 0; i != fn->numArguments; ++i) {
+    auto &value = valueMap[blockArgs[i]];
+    if (any_isa<APInt>(value))
+      frame.ints[i] = any_cast<APInt>(value);
+    else if (any_isa<APFloat>(value))
+      frame.floats[i] = convertToDouble(any_cast<APFloat>(value));
+    else
+      frame.ints[i] = APInt(INDEX_WIDTH, any_cast<unsigned>(value));
+    frame.times[i] = timeMap[blockArgs[i]];
   }
 
+  const Instruction &ret = runner.execute(*fn, frame);
+  const unsigned *returned = fn->registerPool.data() + ret.operands;
+  for (unsigned i = 0; i < results.size(); i++) {
+    unsigned reg = returned[i];
+    if (fn->isFloatRegister[reg])
+      results[i] = APFloat(frame.floats[reg]);
+    else
+      results[i] = frame.ints[reg];
+    resultTimes[i] = frame.times[reg];
+  }
+  instructionsExecuted += runner.numExecuted;
+
+  // Hand the memory back so that the caller can print it.
+  std::swap(runner.memory, store);
+  std::swap(runner.memoryTimes, storeTimes);
+  return success();
+}
+
+namespace {
+/// The state used to run the toplevel function, reused between runs.
+struct ExecutionState {
   // The store associates each allocation in the program
   // (represented by a int) with a vector of values which can be
   // accessed by it.  Currently values are assumed to be an integer.
-  std::vector<std::vector<Any>> store;
+  MemRefStore store;
   std::vector<double> storeTimes;
 
   // The valueMap associates each SSA statement in the program
@@ -939,6 +2408,33 @@ int main(int argc, char **argv) {
   // The timeMap associates each value with the time it was created.
   llvm::DenseMap<mlir::Value, double> timeMap;
 
+  // The compiled functions, reused between runs.
+  CompiledRunner compiledRunner;
+
+  // The threads executing the operations of handshake functions, if any.
+  ThreadPool *threadPool = nullptr;
+
+  void reset() {
+    store.clear();
+    storeTimes.clear();
+    valueMap.clear();
+    timeMap.clear();
+  }
+};
+} // end anonymous namespace
+
+/// Execute the toplevel function once on the specified arguments and print the
+/// results to 'os'.  Errors are printed to 'errorOS'.
+static LogicalResult executeToplevel(mlir::Operation *mainP,
+                                     ArrayRef<std::string> inputArgs,
+                                     ExecutionState &state, raw_ostream &os,
+                                     raw_ostream &errorOS) {
+  state.reset();
+  auto &store = state.store;
+  auto &storeTimes = state.storeTimes;
+  auto &valueMap = state.valueMap;
+  auto &timeMap = state.timeMap;
+
   // We need three things in a function-type independent way.
   // The type signature of the function.
   mlir::FunctionType ftype;
@@ -954,8 +2450,7 @@ int main(int argc, char **argv) {
   unsigned realInputs;
   unsigned realOutputs;
 
-  if (mlir::FuncOp toplevel =
-          module->lookupSymbol<mlir::FuncOp>(toplevelFunction)) {
+  if (mlir::FuncOp toplevel = dyn_cast<mlir::FuncOp>(mainP)) {
     ftype = toplevel.getType();
     mlir::Block &entryBlock = toplevel.getBody().front();
     blockArgs = entryBlock.getArguments();
@@ -966,7 +2461,7 @@ int main(int argc, char **argv) {
     outputs = ftype.getNumResults();
     realOutputs = outputs;
   } else if (handshake::FuncOp toplevel =
-                 module->lookupSymbol<handshake::FuncOp>(toplevelFunction)) {
+                 dyn_cast<handshake::FuncOp>(mainP)) {
     ftype = toplevel.getType();
     mlir::Block &entryBlock = toplevel.getBody().front();
     blockArgs = entryBlock.getArguments();
@@ -977,14 +2472,14 @@ int main(int argc, char **argv) {
     outputs = ftype.getNumResults();
     realOutputs = outputs - 1;
     if (inputs == 0) {
-      errs() << "Function " << toplevelFunction << " is expected to have "
-             << "at least one dummy argument.\n";
-      return 1;
+      errorOS << "Function " << toplevelFunction << " is expected to have "
+              << "at least one dummy argument.\n";
+      return failure();
     }
     if (outputs == 0) {
-      errs() << "Function " << toplevelFunction << " is expected to have "
-             << "at least one dummy result.\n";
-      return 1;
+      errorOS << "Function " << toplevelFunction << " is expected to have "
+              << "at least one dummy result.\n";
+      return failure();
     }
     // Implicit none argument
     APInt apnonearg(1, 0);
@@ -994,10 +2489,10 @@ int main(int argc, char **argv) {
   }
 
   if (inputArgs.size() != realInputs) {
-    errs() << "Toplevel function " << toplevelFunction << " has " << realInputs
-           << " actual arguments, but " << inputArgs.size()
-           << " arguments were provided on the command line.\n";
-    return 1;
+    errorOS << "Toplevel function " << toplevelFunction << " has "
+            << realInputs << " actual arguments, but " << inputArgs.size()
+            << " arguments were provided.\n";
+    return failure();
   }
 
   for (unsigned i = 0; i < realInputs; i++) {
@@ -1014,7 +2509,8 @@ int main(int argc, char **argv) {
       std::stringstream arg(inputArgs[i]);
       while (!arg.eof()) {
         getline(arg, x, ',');
-        store[buffer][i++] = readValueWithType(memreftype.getElementType(), x);
+        store[buffer].store(i++,
+                            readValueWithType(memreftype.getElementType(), x));
       }
     } else {
       Any value = readValueWithType(type, inputArgs[i]);
@@ -1025,19 +2521,46 @@ int main(int argc, char **argv) {
 
   std::vector<Any> results(realOutputs);
   std::vector<double> resultTimes(realOutputs);
-  if (mlir::FuncOp toplevel =
-          module->lookupSymbol<mlir::FuncOp>(toplevelFunction)) {
-    executeFunction(toplevel, valueMap, timeMap, results, resultTimes, store,
-                    storeTimes);
+  if (mlir::FuncOp toplevel = dyn_cast<mlir::FuncOp>(mainP)) {
+    if (!compile)
+      executeFunction(toplevel, valueMap, timeMap, results, resultTimes, store,
+                      storeTimes);
+    else if (failed(executeCompiledFunction(
+                 state.compiledRunner, toplevel, valueMap, timeMap, results,
+                 resultTimes, store, storeTimes)))
+      return failure();
   } else if (handshake::FuncOp toplevel =
-                 module->lookupSymbol<handshake::FuncOp>(toplevelFunction)) {
-    executeHandshakeFunction(toplevel, valueMap, timeMap, results, resultTimes,
-                             store, storeTimes);
+                 dyn_cast<handshake::FuncOp>(mainP)) {
+    if (!cycleAccurate) {
+      executeHandshakeFunction(toplevel, valueMap, timeMap, results,
+                               resultTimes, store, storeTimes,
+                               state.threadPool);
+    } else {
+      CycleSimulator simulator(store, storeTimes);
+      auto result = simulator.run(toplevel, valueMap, results, resultTimes);
+      simulator.printReport(errorOS);
+      if (!channelStatsFileName.empty()) {
+        std::string errorMessage;
+        auto output = mlir::openOutputFile(channelStatsFileName, &errorMessage);
+        if (!output) {
+          errorOS << errorMessage << "\n";
+          return failure();
+        }
+        StringRef fileName = channelStatsFileName;
+        StringRef format = fileName.endswith(".dot")    ? "dot"
+                           : fileName.endswith(".json") ? "json"
+                                                        : "csv";
+        simulator.printChannelStats(output->os(), format);
+        output->keep();
+      }
+      if (failed(result))
+        return failure();
+    }
   }
   double time = 0.0;
   for (unsigned i = 0; i < results.size(); i++) {
     mlir::Type t = ftype.getResult(i);
-    outs() << printAnyValueWithType(t, results[i]) << " ";
+    os << printAnyValueWithType(t, results[i]) << " ";
     time = std::max(resultTimes[i], time);
   }
   // Go back through the arguments and output any memrefs.
@@ -1050,15 +2573,124 @@ int main(int argc, char **argv) {
       auto elementType = memreftype.getElementType();
       for (int j = 0; j < memreftype.getNumElements(); j++) {
         if (j != 0)
-          outs() << ",";
-        outs() << printAnyValueWithType(elementType, store[buffer][j]);
+          os << ",";
+        Any value = store[buffer].load(j);
+        os << printAnyValueWithType(elementType, value);
       }
-      outs() << " ";
+      os << " ";
     }
   }
-  outs() << "\n";
+  os << "\n";
 
   simulatedTime += (int)time;
 
-  return 0;
+  return success();
+}
+
+int main(int argc, char **argv) {
+  InitLLVM y(argc, argv);
+  cl::ParseCommandLineOptions(
+      argc, argv,
+      "MLIR Standard dialect runner\n\n"
+      "This application executes a function in the given MLIR module\n"
+      "Arguments to the function are passed on the command line and\n"
+      "results are returned on stdout.\n"
+      "Memref types are specified as a comma-separated list of values.\n");
+
+  if (!channelStatsFileName.empty() &&
+      (!cycleAccurate || !batchFileName.empty())) {
+    errs() << argv[0]
+           << ": -channelStats needs -cycleAccurate and is not supported in "
+              "batch mode\n";
+    return 1;
+  }
+
+  auto file_or_err = MemoryBuffer::getFileOrSTDIN(inputFileName.c_str());
+  if (std::error_code error = file_or_err.getError()) {
+    errs() << argv[0] << ": could not open input file '" << inputFileName
+           << "': " << error.message() << "\n";
+    return 1;
+  }
+
+  // Load the MLIR module.
+  mlir::MLIRContext context;
+  context.loadDialect<StandardOpsDialect, handshake::HandshakeOpsDialect>();
+  SourceMgr source_mgr;
+  source_mgr.AddNewSourceBuffer(std::move(*file_or_err), SMLoc());
+  mlir::OwningModuleRef module(mlir::parseSourceFile(source_mgr, &context));
+  if (!module)
+    return 1;
+
+  mlir::Operation *mainP = module->lookupSymbol(toplevelFunction);
+  // The toplevel function can accept any number of operands, and returns
+  // any number of results.
+  if (!mainP) {
+    errs() << "Toplevel function " << toplevelFunction << " not found!\n";
+    return 1;
+  }
+
+  if (batchFileName.empty()) {
+    std::unique_ptr<ThreadPool> threadPool;
+    if (numThreads > 1)
+      threadPool =
+          std::make_unique<ThreadPool>(hardware_concurrency(numThreads));
+    ExecutionState state;
+    state.threadPool = threadPool.get();
+    std::string error;
+    raw_string_ostream errorOS(error);
+    auto result = executeToplevel(mainP, inputArgs, state, outs(), errorOS);
+    errs() << errorOS.str();
+    return failed(result) ? 1 : 0;
+  }
+
+  // Read one set of arguments per line, ignoring blank lines.
+  auto batchOrErr = MemoryBuffer::getFileOrSTDIN(batchFileName);
+  if (std::error_code error = batchOrErr.getError()) {
+    errs() << argv[0] << ": could not open batch file '" << batchFileName
+           << "': " << error.message() << "\n";
+    return 1;
+  }
+  // Each entry keeps its line number for the error messages.
+  std::vector<std::vector<std::string>> batch;
+  std::vector<size_t> batchLines;
+  SmallVector<StringRef, 0> lines;
+  (*batchOrErr)->getBuffer().split(lines, '\n');
+  for (size_t i = 0, e = lines.size(); i != e; ++i) {
+    SmallVector<StringRef, 8> args;
+    SplitString(lines[i], args);
+    if (args.empty())
+      continue;
+    batch.emplace_back(args.begin(), args.end());
+    batchLines.push_back(i + 1);
+  }
+
+  // Each thread runs a contiguous range of the inputs, reusing its state
+  // between runs.  The results are printed in input order at the end.
+  std::vector<std::string> outputs(batch.size());
+  std::vector<std::string> errors(batch.size());
+  std::atomic<bool> failedAny(false);
+  ThreadPool threadPool(hardware_concurrency(numThreads));
+  size_t numShards = std::min<size_t>(threadPool.getThreadCount(),
+                                      std::max<size_t>(batch.size(), 1));
+  for (size_t shard = 0; shard != numShards; ++shard) {
+    threadPool.async([&, shard] {
+      ExecutionState state;
+      size_t begin = batch.size() * shard / numShards;
+      size_t end = batch.size() * (shard + 1) / numShards;
+      for (size_t i = begin; i != end; ++i) {
+        raw_string_ostream os(outputs[i]);
+        raw_string_ostream errorOS(errors[i]);
+        if (failed(executeToplevel(mainP, batch[i], state, os, errorOS)))
+          failedAny = true;
+      }
+    });
+  }
+  threadPool.wait();
+
+  for (size_t i = 0, e = batch.size(); i != e; ++i) {
+    outs() << outputs[i];
+    if (!errors[i].empty())
+      errs() << batchFileName << ":" << batchLines[i] << ": " << errors[i];
+  }
+  return failedAny ? 1 : 0;
 }
@@ -13,6 +13,9 @@
 #include "circt/Conversion/LLHDToLLVM/LLHDToLLVM.h"
 #include "circt/Dialect/LLHD/IR/LLHDDialect.h"
 #include "circt/Dialect/LLHD/Simulator/Engine.h"
+#include "circt/Dialect/LLHD/Simulator/Transport.h"
+#include "circt/Dialect/LLHD/Transforms/Passes.h"
+#include "circt/Support/MemoryStats.h"
 
 #include "mlir/Dialect/LLVMIR/LLVMDialect.h"
 #include "mlir/Dialect/StandardOps/IR/Ops.h"
@@ -23,7 +26,11 @@
 #include "mlir/Target/LLVMIR.h"
 #include "mlir/Transforms/Passes.h"
 
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/Support/Format.h"
 #include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/ToolOutputFile.h"
 
 using namespace llvm;
@@ -59,6 +66,54 @@ static cl::opt<bool> dumpMLIR("dump-mlir",
 static cl::opt<bool> dumpLayout("dump-layout",
                                 cl::desc("Dump the gathered instance layout"));
 
+static cl::opt<unsigned> threads(
+    "threads",
+    cl::desc("Number of threads used to run the instances woken up in the "
+             "same delta step"),
+    cl::value_desc("N"), cl::init(1));
+
+static cl::opt<bool> levelize(
+    "levelize",
+    cl::desc("Run the combinational entity instances in a static order, "
+             "applying their delta drives right away, such that combinational "
+             "logic settles in a single delta step. Processes and registers "
+             "stay event-driven"),
+    cl::init(false));
+
+static cl::opt<bool> lazyJIT(
+    "lazy-jit",
+    cl::desc("Compile every unit on its first invocation instead of compiling "
+             "the whole design before the simulation starts. Disables the JIT "
+             "cache"),
+    cl::init(false));
+
+static cl::opt<unsigned> tierUp(
+    "tier-up",
+    cl::desc("Compile the units lazily without optimizations, and recompile "
+             "the units of the instances run N times at the requested "
+             "optimization level in the background. Disables the JIT cache"),
+    cl::value_desc("N"), cl::init(0));
+
+static cl::opt<bool> batchEntities(
+    "batch-entities",
+    cl::desc("Run the instances of an entity woken up in the same delta step "
+             "with a single call of a batched variant of the entity. Only "
+             "applies to single-threaded runs. Disables the JIT cache"),
+    cl::init(false));
+
+static cl::opt<bool> nativeClocks(
+    "native-clocks",
+    cl::desc("Toggle the signal of the clock processes, which forever invert "
+             "a bit and wait for a constant time, without running their "
+             "compiled code"),
+    cl::init(true));
+
+static cl::opt<bool> inlineEntities(
+    "inline-entities",
+    cl::desc("Flatten the entity hierarchy before simulating it, such that "
+             "only the root and the process instances remain"),
+    cl::init(false));
+
 static cl::opt<std::string> root(
     "root",
     cl::desc("Specify the name of the entity to use as root of the design"),
@@ -80,6 +135,7 @@ enum TraceFormat {
   merged,
   mergedReduce,
   namedOnly,
+  vcd,
   noTrace = -1
 };
 
@@ -99,8 +155,227 @@ static cl::opt<TraceFormat> traceMode(
             namedOnly, "named-only",
             "Only dump changes for real-time steps, only for top-level "
             "instance and signals not having the default name '(sig)?[0-9]*'"),
+        clEnumVal(vcd, "Dump changes for real-time steps, for all instances, "
+                       "in the Value Change Dump (VCD) format"),
         clEnumValN(noTrace, "no-trace", "Don't dump a signal trace")));
 
+static cl::list<std::string> traceFilters(
+    "trace-filter",
+    cl::desc("Only trace the signals matching the given hierarchical glob "
+             "filter, e.g. 'root/core/*/pc'. Can be repeated"),
+    cl::value_desc("filter"), cl::ZeroOrMore);
+
+static cl::opt<int> traceDepth(
+    "trace-depth",
+    cl::desc("Only trace the signals of instances at most this many levels "
+             "below the root"),
+    cl::value_desc("depth"), cl::init(-1));
+
+static cl::opt<std::string> jitCacheDir(
+    "jit-cache-dir",
+    cl::desc("Store the compiled design in the given directory and reuse it "
+             "in later runs of the same design, root and optimization level"),
+    cl::value_desc("directory"), cl::init(""));
+
+static cl::opt<std::string> checkpointFile(
+    "checkpoint",
+    cl::desc("Write a checkpoint of the simulation state to the given file "
+             "when the simulation stops"),
+    cl::value_desc("filename"));
+
+static cl::opt<std::string> restoreFile(
+    "restore",
+    cl::desc("Start the simulation from a checkpoint previously written with "
+             "--checkpoint for the same design"),
+    cl::value_desc("filename"));
+
+static cl::opt<std::string> profileFile(
+    "profile",
+    cl::desc("Record per-instance and per-signal simulation statistics and "
+             "write them to the given file in JSON format"),
+    cl::value_desc("filename"));
+
+static cl::opt<std::string> driveStream(
+    "drive-stream",
+    cl::desc("Drive the signals with the external drives of the given binary "
+             "stimulus file, read incrementally as the simulation advances"),
+    cl::value_desc("filename"));
+
+static cl::list<std::string> watchpoints(
+    "watch",
+    cl::desc("Watch a signal value, e.g. root/done==0x1 or root/err!=0x0. "
+             "When the condition first holds after a change of the signal, "
+             "stop the simulation (the default, or :stop), start tracing "
+             "(:trace) or write a checkpoint (:checkpoint=<filename>)"),
+    cl::value_desc("signal==value[:action]"));
+
+static cl::opt<std::string> commandFile(
+    "commands",
+    cl::desc("Drive the simulation with the commands of the given file, or of "
+             "stdin with '-', one per line: `step` runs one delta step, `run "
+             "<ps>` runs up to the given time, `peek <signal>` prints a signal "
+             "value, `poke <signal> <value>` drives a signal in the next delta "
+             "step and `monitor <signal>` prints every change of a signal"),
+    cl::value_desc("filename"));
+
+static cl::list<std::string> batchStimuli(
+    "batch",
+    cl::desc("Compile the design once and run one independent simulation per "
+             "given stimulus file, using --threads parallel runs. The trace "
+             "of each run is written to the stimulus file name with a .trace "
+             "extension"),
+    cl::value_desc("filenames"), cl::CommaSeparated);
+
+static cl::opt<unsigned> partitions(
+    "partitions",
+    cl::desc("Fork into N processes connected by local sockets, each running "
+             "a share of the subtrees of the instance hierarchy. Process i > 0 "
+             "writes the trace of its signals to the output file name with a "
+             ".i extension, and does not trace when writing to stdout"),
+    cl::value_desc("N"), cl::init(1));
+
+static cl::list<std::string> peers(
+    "peers",
+    cl::desc("Run process --rank of a simulation distributed over TCP, given "
+             "the host:port endpoint of every process. Traces are written as "
+             "with --partitions"),
+    cl::value_desc("endpoints"), cl::CommaSeparated);
+
+static cl::opt<unsigned> rank("rank",
+                              cl::desc("The rank of this process in --peers"),
+                              cl::value_desc("N"), cl::init(0));
+
+/// Parse a watchpoint of the form `signal==value[:action]`, or with `!=`, and
+/// add it to the engine.
+static LogicalResult addWatchpoint(llhd::sim::Engine &engine,
+                                   StringRef spec) {
+  auto specAndAction = spec.split(':');
+  auto action = llhd::sim::WatchAction::stop;
+  StringRef checkpointPath;
+  auto actionName = specAndAction.second;
+  if (actionName == "trace") {
+    action = llhd::sim::WatchAction::trace;
+  } else if (actionName.consume_front("checkpoint=")) {
+    action = llhd::sim::WatchAction::checkpoint;
+    checkpointPath = actionName;
+  } else if (!actionName.empty() && actionName != "stop") {
+    llvm::errs() << "Unknown watchpoint action " << actionName << "\n";
+    return failure();
+  }
+
+  auto cond = specAndAction.first;
+  bool equal = true;
+  size_t pos = cond.find("==");
+  if (pos == StringRef::npos) {
+    equal = false;
+    pos = cond.find("!=");
+  }
+  StringRef hex = pos == StringRef::npos ? "" : cond.drop_front(pos + 2);
+  hex.consume_front("0x");
+  if (hex.empty() || !llvm::all_of(hex, llvm::isHexDigit)) {
+    llvm::errs() << "Invalid watchpoint " << spec << "\n";
+    return failure();
+  }
+
+  llvm::APInt expected(hex.size() * 4, hex, 16);
+  auto predicate = [expected, equal](const uint8_t *value, uint64_t size) {
+    auto bits = expected.zextOrTrunc(size * 8);
+    for (uint64_t i = 0; i < size; ++i)
+      if (bits.extractBitsAsZExtValue(8, i * 8) != value[i])
+        return !equal;
+    return equal;
+  };
+  return engine.addWatchpoint(cond.take_front(pos), predicate, action,
+                              checkpointPath);
+}
+
+/// Print the given little-endian value in hexadecimal.
+static void printValue(raw_ostream &os, ArrayRef<uint8_t> value) {
+  os << "0x";
+  for (size_t i = value.size(); i > 0; --i)
+    os << format_hex_no_prefix(value[i - 1], 2);
+}
+
+/// Run the simulation commands read from the given file, or stdin for "-",
+/// see --commands. The output is flushed after every command, such that it
+/// can be followed while the simulation runs.
+static int runCommands(llhd::sim::Engine &engine, StringRef path) {
+  auto file = MemoryBuffer::getFileOrSTDIN(path);
+  if (!file) {
+    llvm::errs() << "Could not open commands " << path << ": "
+                 << file.getError().message() << "\n";
+    return 1;
+  }
+  if (failed(engine.start()))
+    return 1;
+
+  SmallVector<StringRef, 0> lines;
+  (*file)->getBuffer().split(lines, '\n');
+  for (unsigned lineNo = 1, e = lines.size(); lineNo <= e; ++lineNo) {
+    SmallVector<StringRef, 3> args;
+    lines[lineNo - 1].rtrim('\r').split(args, ' ', -1, /*KeepEmpty=*/false);
+    if (args.empty() || args[0].startswith("#"))
+      continue;
+
+    auto error = [&](const Twine &message) {
+      llvm::errs() << path << ":" << lineNo << ": " << message << "\n";
+      return 1;
+    };
+    auto command = args[0];
+    int numArgs = StringSwitch<int>(command)
+                      .Case("step", 0)
+                      .Cases("run", "peek", "monitor", 1)
+                      .Case("poke", 2)
+                      .Default(-1);
+    if (numArgs < 0 || args.size() != size_t(numArgs) + 1)
+      return error("invalid command");
+
+    int signal = -1;
+    if (command != "step" && command != "run") {
+      signal = engine.lookupSignal(args[1]);
+      if (signal < 0)
+        return error("unknown signal " + args[1]);
+    }
+
+    if (command == "step") {
+      if (failed(engine.stepDelta()))
+        return 1;
+    } else if (command == "run") {
+      uint64_t time;
+      if (args[1].getAsInteger(10, time))
+        return error("invalid time " + args[1]);
+      if (failed(engine.runUntil(time)))
+        return 1;
+    } else if (command == "peek") {
+      llvm::outs() << args[1] << " ";
+      printValue(llvm::outs(), engine.peek(signal));
+      llvm::outs() << "\n";
+    } else if (command == "poke") {
+      StringRef hex = args[2];
+      hex.consume_front("0x");
+      if (hex.empty() || !llvm::all_of(hex, llvm::isHexDigit))
+        return error("invalid value " + args[2]);
+      APInt value(hex.size() * 4, hex, 16);
+      SmallVector<uint8_t, 8> bytes;
+      for (unsigned i = 0; i < value.getBitWidth(); i += 8)
+        bytes.push_back(value.extractBitsAsZExtValue(
+            std::min(8u, value.getBitWidth() - i), i));
+      engine.poke(signal, bytes);
+    } else {
+      std::string name = args[1].str();
+      engine.onChange(signal, [&engine, name](unsigned,
+                                              ArrayRef<uint8_t> value) {
+        llvm::outs() << engine.getTime() << "ps " << name << " ";
+        printValue(llvm::outs(), value);
+        llvm::outs() << "\n";
+      });
+    }
+    llvm::outs().flush();
+  }
+  engine.finish();
+  return 0;
+}
+
 static int dumpLLVM(ModuleOp module, MLIRContext &context) {
   if (dumpLLVMDialect) {
     module.dump();
@@ -130,8 +405,14 @@ static int dumpLLVM(ModuleOp module, MLIRContext &context) {
 
 static LogicalResult applyMLIRPasses(ModuleOp module) {
   PassManager pm(module.getContext());
+  applyMemoryStatsCLOptions(pm);
 
-  pm.addPass(llhd::createConvertLLHDToLLVMPass());
+  // Shrink the units before lowering them. The signals are all kept, as they
+  // are traced.
+  pm.addPass(llhd::createSignalForwardingPass(/*removeDeadSignals=*/false));
+  pm.addPass(createCanonicalizerPass());
+  pm.addPass(llhd::createConvertLLHDToLLVMPass(/*inlineDrives=*/true,
+                                              batchEntities));
 
   return pm.run(module);
 }
@@ -141,8 +422,38 @@ int main(int argc, char **argv) {
 
   InitLLVM y(argc, argv);
 
+  registerMemoryStatsCLOptions();
   cl::ParseCommandLineOptions(argc, argv, "LLHD simulator\n");
 
+  // Set up the processes of a distributed simulation before anything else,
+  // such that the forked processes start from a clean state.
+  std::unique_ptr<llhd::sim::Transport> transport;
+  if (partitions > 1 || !peers.empty()) {
+    if (!batchStimuli.empty() || !checkpointFile.empty() ||
+        !restoreFile.empty() || !commandFile.empty()) {
+      llvm::errs() << "--batch, --checkpoint, --restore and --commands are not "
+                      "supported in distributed simulation\n";
+      return 1;
+    }
+    auto maybeTransport = peers.empty()
+                              ? llhd::sim::forkLocalTransport(partitions)
+                              : llhd::sim::connectSocketTransport(rank, peers);
+    if (!maybeTransport) {
+      llvm::errs() << llvm::toString(maybeTransport.takeError()) << "\n";
+      return 1;
+    }
+    transport = std::move(*maybeTransport);
+  }
+  unsigned processRank = transport ? transport->getRank() : 0;
+  std::string outputPath = outputFilename;
+  auto traceFormat = traceMode.getValue();
+  if (processRank != 0) {
+    if (outputPath == "-")
+      traceFormat = noTrace;
+    else
+      outputPath += "." + std::to_string(processRank);
+  }
+
   // Set up the input and output files.
   std::string errorMessage;
   auto file = openInputFile(inputFilename, &errorMessage);
@@ -151,7 +462,7 @@ int main(int argc, char **argv) {
     return 1;
   }
 
-  auto output = openOutputFile(outputFilename, &errorMessage);
+  auto output = openOutputFile(outputPath, &errorMessage);
   if (!output) {
     llvm::errs() << errorMessage << "\n";
     exit(1);
@@ -168,16 +479,41 @@ int main(int argc, char **argv) {
 
   OwningModuleRef module(parseSourceFile(mgr, &context));
 
+  // The instance layout is gathered from the parsed module, flatten it before
+  // building the engine.
+  if (module && inlineEntities) {
+    PassManager pm(&context);
+    applyMemoryStatsCLOptions(pm);
+    pm.addPass(llhd::createEntityInliningPass());
+    if (failed(pm.run(*module))) {
+      llvm::errs() << "Flattening the entity hierarchy failed.\n";
+      return 1;
+    }
+  }
+
   if (dumpMLIR) {
     module->dump();
     llvm::errs() << "\n";
     return 0;
   }
 
+  // The cached object does not carry the lowered module, only use the cache
+  // when the module does not need to be dumped and is compiled up front.
+  StringRef cacheDir = jitCacheDir;
+  if (dumpLLVMDialect || dumpLLVMIR || lazyJIT || tierUp || batchEntities)
+    cacheDir = "";
+
   llhd::sim::Engine engine(
       output->os(), *module, &applyMLIRPasses,
       makeOptimizingTransformer(optimizationLevel, 0, nullptr), root,
-      traceMode);
+      traceFormat, threads, cacheDir, optimizationLevel, levelize, lazyJIT,
+      tierUp);
+  if (failed(engine.setTraceFilters(traceFilters, traceDepth)))
+    return 1;
+  if (batchEntities)
+    engine.enableEntityBatching();
+  if (!nativeClocks)
+    engine.disableNativeClocks();
 
   if (dumpLLVMDialect || dumpLLVMIR) {
     return dumpLLVM(engine.getModule(), context);
@@ -189,7 +525,45 @@ int main(int argc, char **argv) {
     return 0;
   }
 
-  engine.simulate(nSteps, maxTime);
+  if (!batchStimuli.empty())
+    return engine.simulateBatch(batchStimuli, nSteps, maxTime, threads) != 0;
+
+  if (!restoreFile.empty() && failed(engine.restore(restoreFile)))
+    return 1;
+
+  if (!driveStream.empty() && failed(engine.streamStimulus(driveStream)))
+    return 1;
+
+  for (auto &spec : watchpoints)
+    if (failed(addWatchpoint(engine, spec)))
+      return 1;
+
+  if (!profileFile.empty())
+    engine.enableProfiling();
+
+  if (transport) {
+    int result = engine.simulateDistributed(*transport, nSteps, maxTime);
+    if (failed(transport->close()) || result != 0)
+      return 1;
+  } else if (!commandFile.empty()) {
+    if (runCommands(engine, commandFile) != 0)
+      return 1;
+  } else if (engine.simulate(nSteps, maxTime) != 0) {
+    return 1;
+  }
+
+  if (!profileFile.empty()) {
+    auto profileOutput = openOutputFile(profileFile, &errorMessage);
+    if (!profileOutput) {
+      llvm::errs() << errorMessage << "\n";
+      return 1;
+    }
+    engine.dumpProfile(profileOutput->os());
+    profileOutput->keep();
+  }
+
+  if (!checkpointFile.empty() && failed(engine.checkpoint(checkpointFile)))
+    return 1;
 
   output->keep();
   return 0;